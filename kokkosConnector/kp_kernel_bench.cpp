@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <string>
+#include "kp_kernel_timer.h"
+#include "kp_kernel_info.h"
+
+/*
+ * Tool overhead benchmark
+ *
+ * Times the connector's begin/end kernel path around a kernel that
+ * spins for a given number of microseconds, without publishing, with a
+ * synchronous publish per kernel, and with the asynchronous publisher.
+ * The kernel time is subtracted, so the result is the tool overhead. The publish function writes each message
+ * to /dev/null and can spin for a given number of microseconds per
+ * message to stand in for the cost of a network send.
+ */
+
+static int null_fd;
+static int send_us = 0;
+static int kernel_us = 1;
+static unsigned long long msg_count, msg_bytes;
+
+static void spin(int usec) {
+	const double end = seconds() + usec * 1e-6;
+	while (seconds() < end)
+		;
+}
+
+static int publish_null(const char* msg, size_t len) {
+	if (send_us > 0)
+		spin(send_us);
+	msg_count++;
+	msg_bytes += len;
+	return (write(null_fd, msg, len) == (ssize_t) len) ? 0 : -1;
+}
+
+static double run(const char* label, int kernels, int window_ms, bool publish) {
+	KernelEventPublisher publisher;
+	bool ldms_publish = publish;
+	KernelPerformanceInfo info(std::string("bench_kernel"), PARALLEL_FOR,
+		&publisher, seconds(), getEpochMS(), 0, &ldms_publish);
+	double t0, t1, work = 0;
+
+	msg_count = msg_bytes = 0;
+	publisher.configure(publish_null, window_ms, 1 << 16, 65536,
+		1, "bench", 0, 0);
+	publisher.start();
+	t0 = seconds();
+	for (int i = 0; i < kernels; i++) {
+		info.startTimer();
+		if (kernel_us > 0) {
+			const double k0 = seconds();
+			spin(kernel_us);
+			work += seconds() - k0;
+		}
+		info.addFromTimer();
+	}
+	t1 = seconds() - work;
+	publisher.stop();
+
+	printf("%-12s %10.1f ns/kernel %10llu messages %12llu bytes %8llu dropped\n",
+		label, (t1 - t0) * 1e9 / kernels, msg_count, msg_bytes,
+		(unsigned long long) publisher.getDropped());
+	return t1 - t0;
+}
+
+int main(int argc, char* argv[]) {
+	int kernels = 200000;
+	int window_ms = 100;
+	int op;
+
+	while ((op = getopt(argc, argv, "n:w:s:k:h")) != -1) {
+		switch (op) {
+		case 'n':
+			kernels = atoi(optarg);
+			break;
+		case 'w':
+			window_ms = atoi(optarg);
+			break;
+		case 's':
+			send_us = atoi(optarg);
+			break;
+		case 'k':
+			kernel_us = atoi(optarg);
+			break;
+		default:
+			printf("Usage: %s [-n kernels] [-k kernel_usec] [-w window_ms] [-s send_usec]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (kernels < 1 || window_ms < 1 || kernel_us < 0) {
+		printf("Usage: %s [-n kernels] [-k kernel_usec] [-w window_ms] [-s send_usec]\n", argv[0]);
+		return 1;
+	}
+	null_fd = open("/dev/null", O_WRONLY);
+	if (null_fd < 0) {
+		perror("/dev/null");
+		return 1;
+	}
+
+	run("no-publish", kernels, 0, false);
+	run("synchronous", kernels, 0, true);
+	run("asynchronous", kernels, window_ms, true);
+	return 0;
+}
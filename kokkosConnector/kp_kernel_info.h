@@ -16,10 +16,7 @@
 #endif // HAVE_GCC_ABI_DEMANGLE
 
 #include "kp_kernel_timer.h"
-
-#include <ldms/ldms.h>
-#include <ldms/ldmsd_stream.h>
-#include <ovis_util/util.h>
+#include "kp_kernel_ring.h"
 
 char* demangleName(char* kernelName)
 {
@@ -47,21 +44,16 @@ static double total_time = 0;
 class KernelPerformanceInfo {
 	public:
 
-		KernelPerformanceInfo(std::string kName, KernelExecutionType kernelType, ldms_t* the_ldms,
-				const char* node_name,
-				const int rank_no,
-				const int job_id,
+		KernelPerformanceInfo(std::string kName, KernelExecutionType kernelType,
+				KernelEventPublisher* the_publisher,
 				const double job_start,
 				const uint64_t job_epoch_start,
 				const uint16_t kernel_nest_level,
-				const int tool_verbosity,
 				bool* ldms_global_publish):
-			kType(kernelType), ldms(the_ldms),
-				nodename(node_name), rank(rank_no),
-				jobid(job_id), jobStartTime(job_start),
+			kType(kernelType), publisher(the_publisher),
+				jobStartTime(job_start),
 				jobStartEpochTimeMS(job_epoch_start),
 				nestingLevel(kernel_nest_level),
-				verbosity(tool_verbosity),
 				ldms_publish(ldms_global_publish) {
 
 			kernelName = (char*) malloc(sizeof(char) * (kName.size() + 1));
@@ -104,30 +96,19 @@ class KernelPerformanceInfo {
 			incrementCount();
 
 			if( (*ldms_publish) ) {
-				const int buffer_size = (NULL == kernelName) ? 4096 :
-					( strlen(kernelName) > 3072 ? 2048 + strlen(kernelName) : 4096 );
-
-				char* big_buffer = (char*) malloc( sizeof(char) * buffer_size );
-
+				KernelEvent ev;
 				double epoch_stamp = (double) jobStartEpochTimeMS;
 				epoch_stamp += static_cast<double>( now - jobStartTime ) * 1000.0;
-				epoch_stamp = epoch_stamp / 1000.0;
-
-				snprintf( big_buffer, buffer_size, "{ \"job-id\" : %d, \"node-name\" : \"%s\", \"rank\" : %d, \"timestamp\" : \"%.6f\", \"kokkos-perf-data\" : [ { \"name\" : \"%s\", \"type\" : %d, \"current-kernel-count\" : %llu, \"total-kernel-count\" : %llu, \"level\" : %u, \"current-kernel-time\" : %.9f, \"total-kernel-time\" : %.9f } ] }\n",
-					jobid, nodename, rank, epoch_stamp,
-					(NULL==kernelName) ? "" : kernelName,
-					(int) kType, callCount, kernel_ex * kernelSampleRate, nestingLevel, sample_time, total_time );
-
-				if( verbosity > 0 ) {
-					printf("%s", big_buffer);
-				}
-
-                                int rc = ldmsd_stream_publish( (*ldms), "kokkos-perf-data", LDMSD_STREAM_JSON,
-					big_buffer, strlen(big_buffer) + 1);
 
-				//int rc = ldmsd_stream_publish( (*ldms), "kokkos-perf-data", LDMSD_STREAM_JSON,                                                                                                                big_buffer, strlen(big_buffer) + 1);
-				// always check your return codes :p
-				free( big_buffer );
+				ev.name = kernelName;
+				ev.type = (int) kType;
+				ev.level = nestingLevel;
+				ev.callCount = callCount;
+				ev.totalCount = kernel_ex * kernelSampleRate;
+				ev.timestamp = epoch_stamp / 1000.0;
+				ev.sampleTime = sample_time;
+				ev.totalTime = total_time;
+				publisher->record(ev);
 			}
 		}
 
@@ -163,14 +144,10 @@ class KernelPerformanceInfo {
 		uint64_t kernelSampleRate;
 
 		KernelExecutionType kType;
-		ldms_t* ldms;
+		KernelEventPublisher* publisher;
 
 		bool* ldms_publish;
 		const uint16_t nestingLevel;
-		const char* nodename;
-		const int rank;
-		const int jobid;
-		const int verbosity;
 		const uint64_t jobStartEpochTimeMS;
 };
 
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <inttypes.h>
+#include <errno.h>
 #include <execinfo.h>
 #include <cstdlib>
 #include <cstring>
@@ -36,15 +37,28 @@ static int slurm_rank;
 static int slurm_job_id;
 static int tool_verbosity;
 static char hostname_kp[HOST_NAME_MAX];
+static KernelEventPublisher publisher;
+
+static int publish_ldms(const char* msg, size_t len) {
+	if( !ldms_publish ) {
+		return ENOTCONN;
+	}
+	return ldmsd_stream_publish( ldms, "kokkos-perf-data", LDMSD_STREAM_JSON,
+		msg, len );
+}
+
+static int env_int(const char* name, int def) {
+	const char* str = getenv(name);
+	return (NULL == str) ? def : atoi(str);
+}
 
 
 void increment_counter(const char* name, KernelExecutionType kType) {
 	std::string nameStr(name);
 
 	if(count_map.find(name) == count_map.end()) {
-		KernelPerformanceInfo* info = new KernelPerformanceInfo(nameStr, kType, &ldms, hostname_kp,
-				slurm_rank, slurm_job_id, initTime, initTimeEpochMS,
-				0, tool_verbosity, &ldms_publish);
+		KernelPerformanceInfo* info = new KernelPerformanceInfo(nameStr, kType, &publisher,
+				initTime, initTimeEpochMS, 0, &ldms_publish);
 		count_map.insert(std::pair<std::string, KernelPerformanceInfo*>(nameStr, info));
 
 		currentEntry = info;
@@ -59,9 +73,8 @@ void increment_counter_region(const char* name, KernelExecutionType kType) {
 	std::string nameStr(name);
 
 	if(count_map.find(name) == count_map.end()) {
-		KernelPerformanceInfo* info = new KernelPerformanceInfo(nameStr, kType, &ldms, hostname_kp,
-				slurm_rank, slurm_job_id, initTime, initTimeEpochMS,
-				0, tool_verbosity, &ldms_publish);
+		KernelPerformanceInfo* info = new KernelPerformanceInfo(nameStr, kType, &publisher,
+				initTime, initTimeEpochMS, 0, &ldms_publish);
 		count_map.insert(std::pair<std::string, KernelPerformanceInfo*>(nameStr, info));
 
 		regions[current_region_level] = info;
@@ -182,10 +195,23 @@ extern "C" void kokkosp_init_library(const int loadSeq,
 
 	initTime = seconds();
 	initTimeEpochMS = getEpochMS();
+
+	publisher.configure(publish_ldms,
+		env_int("KOKKOS_LDMS_PUBLISH_WINDOW", 1000),
+		env_int("KOKKOS_LDMS_RING_SIZE", 8192),
+		env_int("KOKKOS_LDMS_MAX_MSG_SIZE", 65536),
+		slurm_job_id, hostname_kp, slurm_rank, tool_verbosity);
+	publisher.start();
 }
 
 extern "C" void kokkosp_finalize_library() {
+	publisher.stop();
 
+	const uint64_t dropped = publisher.getDropped();
+	if( dropped > 0 ) {
+		fprintf(stderr, "KokkosP: %llu kernel events were dropped because the publishing ring was full. Slurm_ID = %d, Rank = %d, Hostname = %s\n",
+			(unsigned long long) dropped, slurm_job_id, slurm_rank, hostname_kp);
+	}
 }
 
 extern "C" void kokkosp_begin_parallel_for(const char* name, const uint32_t devID, uint64_t* kID) {
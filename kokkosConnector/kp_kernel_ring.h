@@ -0,0 +1,263 @@
+
+#ifndef _H_KOKKOSP_KERNEL_RING
+#define _H_KOKKOSP_KERNEL_RING
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "kp_kernel_timer.h"
+
+/*
+ * Asynchronous publishing of kernel events
+ *
+ * The end of every kernel records a KernelEvent into a ring owned by
+ * the calling thread. A background thread drains all rings once per
+ * window and publishes the events as the "kokkos-perf-data" array of
+ * one JSON message, splitting the array across messages only when it
+ * grows past the message size limit. A full ring drops the event; the
+ * number of dropped events is reported in every message.
+ *
+ * A window of 0 publishes each event synchronously from the kernel
+ * callback, as the connector did before.
+ */
+
+struct KernelEvent {
+	const char* name;
+	int type;
+	uint16_t level;
+	unsigned long long callCount;
+	unsigned long long totalCount;
+	double timestamp;	/* seconds since the epoch */
+	double sampleTime;
+	double totalTime;
+};
+
+/* Single-producer, single-consumer ring of kernel events */
+class KernelEventRing {
+	public:
+		KernelEventRing(size_t size) :
+			mask(size - 1), events(size), head(0), tail(0), dropped(0) {
+		}
+
+		/* Called by the owning thread only */
+		bool push(const KernelEvent& ev) {
+			const size_t h = head.load(std::memory_order_relaxed);
+			if (h - tail.load(std::memory_order_acquire) > mask) {
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			events[h & mask] = ev;
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		/* Called by the publisher thread only */
+		bool pop(KernelEvent& ev) {
+			const size_t t = tail.load(std::memory_order_relaxed);
+			if (t == head.load(std::memory_order_acquire))
+				return false;
+			ev = events[t & mask];
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		uint64_t getDropped() {
+			return dropped.load(std::memory_order_relaxed);
+		}
+
+	private:
+		const size_t mask;
+		std::vector<KernelEvent> events;
+		std::atomic<size_t> head;
+		std::atomic<size_t> tail;
+		std::atomic<uint64_t> dropped;
+};
+
+/* Sends one JSON message, len includes the terminating '\0' */
+typedef int (*kp_publish_fn_t)(const char* msg, size_t len);
+
+class KernelEventPublisher {
+	public:
+		KernelEventPublisher() :
+			publish(NULL), windowMS(0), ringSize(0), maxMsgSize(0),
+			jobid(0), rank(0), nodename(""), verbosity(0),
+			running(false), stopping(false), id(nextId()) {
+		}
+
+		~KernelEventPublisher() {
+			stop();
+			for (size_t i = 0; i < rings.size(); i++)
+				delete rings[i];
+		}
+
+		/*
+		 * window_ms   Publishing window, 0 publishes synchronously
+		 * ring_size   Events per thread ring, rounded up to a power of 2
+		 * max_msg     Size at which a message is sent before the window ends
+		 */
+		void configure(kp_publish_fn_t fn, int window_ms, size_t ring_size,
+				size_t max_msg, int job_id, const char* node_name,
+				int rank_no, int tool_verbosity) {
+			publish = fn;
+			windowMS = window_ms;
+			ringSize = 1;
+			while (ringSize < ring_size)
+				ringSize <<= 1;
+			maxMsgSize = max_msg;
+			jobid = job_id;
+			nodename = node_name;
+			rank = rank_no;
+			verbosity = tool_verbosity;
+		}
+
+		void start() {
+			if (windowMS <= 0 || running)
+				return;
+			stopping = false;
+			running = true;
+			thread = std::thread(&KernelEventPublisher::run, this);
+		}
+
+		/* Stop the publisher thread after it published what is left */
+		void stop() {
+			if (!running)
+				return;
+			{
+				std::lock_guard<std::mutex> lock(stopLock);
+				stopping = true;
+			}
+			stopCond.notify_one();
+			thread.join();
+			running = false;
+		}
+
+		void record(const KernelEvent& ev) {
+			if (windowMS <= 0) {
+				std::string msg;
+				beginMessage(msg, ev.timestamp, 0);
+				appendEvent(msg, ev, true);
+				sendMessage(msg);
+				return;
+			}
+			threadRing()->push(ev);
+		}
+
+		uint64_t getDropped() {
+			std::lock_guard<std::mutex> lock(ringLock);
+			uint64_t n = 0;
+			for (size_t i = 0; i < rings.size(); i++)
+				n += rings[i]->getDropped();
+			return n;
+		}
+
+	private:
+		KernelEventRing* threadRing() {
+			static thread_local KernelEventRing* ring = NULL;
+			static thread_local uint64_t ringOwner = 0;
+			if (ringOwner != id) {
+				/* Threads may exit before their events are
+				 * published, the publisher frees the rings */
+				ring = new KernelEventRing(ringSize);
+				ringOwner = id;
+				std::lock_guard<std::mutex> lock(ringLock);
+				rings.push_back(ring);
+			}
+			return ring;
+		}
+
+		static uint64_t nextId() {
+			static std::atomic<uint64_t> next(1);
+			return next.fetch_add(1);
+		}
+
+		void beginMessage(std::string& msg, double timestamp, uint64_t dropped) {
+			char buf[512];
+			snprintf(buf, sizeof(buf), "{ \"job-id\" : %d, \"node-name\" : \"%s\", \"rank\" : %d, \"timestamp\" : \"%.6f\", \"dropped-events\" : %llu, \"kokkos-perf-data\" : [ ",
+				jobid, nodename, rank, timestamp, (unsigned long long)dropped);
+			msg.assign(buf);
+		}
+
+		void appendEvent(std::string& msg, const KernelEvent& ev, bool first) {
+			char buf[512];
+			if (!first)
+				msg.append(", ");
+			msg.append("{ \"name\" : \"");
+			msg.append((NULL == ev.name) ? "" : ev.name);
+			snprintf(buf, sizeof(buf), "\", \"timestamp\" : \"%.6f\", \"type\" : %d, \"current-kernel-count\" : %llu, \"total-kernel-count\" : %llu, \"level\" : %u, \"current-kernel-time\" : %.9f, \"total-kernel-time\" : %.9f }",
+				ev.timestamp, ev.type, ev.callCount, ev.totalCount,
+				ev.level, ev.sampleTime, ev.totalTime);
+			msg.append(buf);
+		}
+
+		void sendMessage(std::string& msg) {
+			msg.append(" ] }\n");
+			if (verbosity > 0)
+				printf("%s", msg.c_str());
+			publish(msg.c_str(), msg.size() + 1);
+		}
+
+		/* Publish everything recorded so far */
+		void drain() {
+			std::vector<KernelEventRing*> snapshot;
+			std::string msg;
+			KernelEvent ev;
+			size_t count = 0;
+			uint64_t dropped = getDropped();
+			{
+				std::lock_guard<std::mutex> lock(ringLock);
+				snapshot = rings;
+			}
+			for (size_t i = 0; i < snapshot.size(); i++) {
+				while (snapshot[i]->pop(ev)) {
+					if (0 == count)
+						beginMessage(msg, ev.timestamp, dropped);
+					appendEvent(msg, ev, 0 == count);
+					count++;
+					if (msg.size() >= maxMsgSize) {
+						sendMessage(msg);
+						count = 0;
+					}
+				}
+			}
+			if (count)
+				sendMessage(msg);
+		}
+
+		void run() {
+			std::unique_lock<std::mutex> lock(stopLock);
+			while (!stopping) {
+				stopCond.wait_for(lock, std::chrono::milliseconds(windowMS));
+				lock.unlock();
+				drain();
+				lock.lock();
+			}
+		}
+
+		kp_publish_fn_t publish;
+		int windowMS;
+		size_t ringSize;
+		size_t maxMsgSize;
+		int jobid;
+		int rank;
+		const char* nodename;
+		int verbosity;
+
+		std::mutex ringLock;
+		std::vector<KernelEventRing*> rings;
+
+		std::thread thread;
+		std::mutex stopLock;
+		std::condition_variable stopCond;
+		bool running;
+		bool stopping;
+		const uint64_t id;
+};
+
+#endif
@@ -85,7 +85,7 @@ LDMSD_CTRL_CMD_MAP = {'usage': {'req_attr': [], 'opt_attr': ['name']},
                       ###############################
                       ##### Producer Policy #####
                       'prdcr_add': {'req_attr': ['name', 'type', 'xprt', 'host', 'port', 'interval'],
-                                    'opt_attr' : [ 'auth', 'perm' ] },
+                                    'opt_attr' : [ 'auth', 'perm', 'pin' ] },
                       'prdcr_del': {'req_attr': ['name']},
                       'prdcr_start': {'req_attr': ['name'],
                                       'opt_attr': ['interval']},
@@ -101,7 +101,8 @@ LDMSD_CTRL_CMD_MAP = {'usage': {'req_attr': [], 'opt_attr': ['name']},
                       'prdcr_stream_status' : {'req_attr':['regex'], 'opt_attr':[]},
                       ##### Updater Policy #####
                       'updtr_add': {'req_attr': ['name'],
-                                    'opt_attr': ['offset', 'push', 'interval', 'auto_interval', 'perm']},
+                                    'opt_attr': ['offset', 'push', 'interval', 'auto_interval', 'perm',
+                                                 'delta']},
                       'updtr_del': {'req_attr': ['name']},
                       'updtr_match_add': {'req_attr': ['name', 'regex', 'match']},
                       'updtr_match_del': {'req_attr': ['name', 'regex', 'match']},
@@ -116,7 +117,9 @@ LDMSD_CTRL_CMD_MAP = {'usage': {'req_attr': [], 'opt_attr': ['name']},
                       'update_time_stats' : {'req_attr': [], 'opt_attr' : ['name']},
                       ##### Storage Policy #####
                       'strgp_add': {'req_attr': ['name', 'plugin', 'container'],
-                                    'opt_attr' : ['schema', 'regex', 'flush', 'decomposition', 'perm' ] },
+                                    'opt_attr' : ['schema', 'regex', 'flush', 'decomposition', 'perm',
+                                                  'queue_depth', 'queue_threads', 'queue_policy',
+                                                  'commit' ] },
                       'strgp_del': {'req_attr': ['name']},
                       'strgp_prdcr_add': {'req_attr': ['name', 'regex']},
                       'strgp_prdcr_del': {'req_attr': ['name', 'regex']},
@@ -128,6 +131,7 @@ LDMSD_CTRL_CMD_MAP = {'usage': {'req_attr': [], 'opt_attr': ['name']},
                       'store_time_stats': {'req_attr': [], 'opt_attr':['name']},
                       ##### Plugin #####
                       'plugn_sets': {'req_attr': [], 'opt_attr': ['name']},
+                      'plugn_jitter': {'req_attr': [], 'opt_attr': ['name', 'reset']},
                       'plugn_status': {'req_attr': [], 'opt_attr': ['name']},
                       ##### Streams ###
                       'publish': {'req_attr': ['name'], 'opt_attr': []},
@@ -269,7 +273,13 @@ class LDMSD_Req_Attr(object):
     AUTH = 35
     RESET = 36
     DECOMPOSITION = 37
-    LAST = 38
+    QUEUE_DEPTH = 38
+    QUEUE_THREADS = 39
+    QUEUE_POLICY = 40
+    DELTA = 41
+    COMMIT = 42
+    PIN = 43
+    LAST = 44
 
     NAME_ID_MAP = {'name': NAME,
                    'interval': INTERVAL,
@@ -311,6 +321,12 @@ class LDMSD_Req_Attr(object):
                    'reset': RESET,
                    'auth': AUTH,
                    'decomposition' : DECOMPOSITION,
+                   'queue_depth' : QUEUE_DEPTH,
+                   'queue_threads' : QUEUE_THREADS,
+                   'queue_policy' : QUEUE_POLICY,
+                   'delta' : DELTA,
+                   'commit' : COMMIT,
+                   'pin' : PIN,
                    'TERMINATING': LAST
         }
 
@@ -351,6 +367,12 @@ class LDMSD_Req_Attr(object):
                    RESET : 'reset',
                    AUTH : 'auth',
                    DECOMPOSITION : 'decomposition',
+                   QUEUE_DEPTH : 'queue_depth',
+                   QUEUE_THREADS : 'queue_threads',
+                   QUEUE_POLICY : 'queue_policy',
+                   DELTA : 'delta',
+                   COMMIT : 'commit',
+                   PIN : 'pin',
                    LAST : 'TERMINATING'
         }
 
@@ -497,6 +519,7 @@ class LDMSD_Request(object):
     PLUGN_CONFIG = 0X500 + 7
     PLUGN_LIST = 0x500 + 8
     PLUGN_SETS = 0x500 + 9
+    PLUGN_JITTER = 0x500 + 10
 
     SET_UDATA = 0x600
     SET_UDATA_REGEX = 0x600 + 1
@@ -592,6 +615,7 @@ class LDMSD_Request(object):
             'usage': {'id': PLUGN_LIST},
 
             'plugn_sets': {'id': PLUGN_SETS},
+            'plugn_jitter': {'id': PLUGN_JITTER},
 
             'udata': {'id': SET_UDATA},
             'udata_regex': {'id': SET_UDATA_REGEX},
@@ -1541,6 +1565,33 @@ class Communicator(object):
             self.close()
             return errno.ENOTCONN, str(e)
 
+    def plugn_jitter(self, name=None, reset=False):
+        """
+        Query the wake up jitter statistics of the samplers
+
+        Parameters:
+        [name] - The sampler plugin name
+        [reset] - Clear the statistics after the query
+
+        Returns:
+        A tuple of status, data
+        - status is an errno from the errno module
+        - data is a list of per-sampler jitter statistics
+        """
+        attr_list = [LDMSD_Req_Attr(attr_id=LDMSD_Req_Attr.RESET,
+                                    value=str(reset))]
+        if name:
+            attr_list.append(LDMSD_Req_Attr(attr_id=LDMSD_Req_Attr.NAME,
+                                            value=name))
+        req = LDMSD_Request(command_id=LDMSD_Request.PLUGN_JITTER, attrs=attr_list)
+        try:
+            req.send(self)
+            resp = req.receive(self)
+            return resp['errcode'], resp['msg']
+        except Exception as e:
+            self.close()
+            return errno.ENOTCONN, str(e)
+
     def plugn_sets(self, name=None):
         """
         List the sets by plugin that provides that sets. If name is provided only provide sets for that plugin
@@ -1931,7 +1982,8 @@ class Communicator(object):
             self.close()
             return errno.ENOTCONN, str(e)
 
-    def prdcr_add(self, name, ptype, xprt, host, port, reconnect, auth=None, perm=None):
+    def prdcr_add(self, name, ptype, xprt, host, port, reconnect, auth=None, perm=None,
+                  pin=None):
         """
         Add a producer. A producer is a peer to the LDMSD being configured.
         Once started, the LDSMD will attempt to connect to this peer
@@ -1951,6 +2003,8 @@ class Communicator(object):
         Keyword Parameters:
         perm - The configuration client permission required to
                modify the producer configuration. Default is None.
+        pin  - 'true' keeps the connection on the zap I/O thread it was
+               assigned to when it connected. Default is None ('false').
 
         Returns:
         A tuple of status, data
@@ -1969,6 +2023,8 @@ class Communicator(object):
             attrs.append(LDMSD_Req_Attr(attr_id=LDMSD_Req_Attr.AUTH, value=auth))
         if perm:
             attrs.append(LDMSD_Req_Attr(attr_id=LDMSD_Req_Attr.PERM, value=str(perm)))
+        if pin is not None:
+            attrs.append(LDMSD_Req_Attr(attr_id=LDMSD_Req_Attr.PIN, value=str(pin)))
 
         req = LDMSD_Request(
                 command_id=LDMSD_Request.PRDCR_ADD,
@@ -2245,7 +2301,8 @@ class Communicator(object):
         except Exception as e:
             return errno.ENOTCONN, str(e)
 
-    def updtr_add(self, name, interval=1000000, offset=None, push=None, auto=None, perm=None):
+    def updtr_add(self, name, interval=1000000, offset=None, push=None, auto=None, perm=None,
+                  delta=None):
         """
         Add an Updater that will periodically update Producer metric sets either
         by pulling the content or by registering for an update push. The default
@@ -2270,6 +2327,11 @@ class Communicator(object):
                     the given sample interval. The default is False.
         perm      - The configuration client permission required to
                     modify the updater configuration.
+        delta     - [True|False] If True, the updater looks up the sets
+                    asking for delta-encoded updates: only the data that
+                    changed since the previous update is transferred when
+                    the transport and the producer support it. The default
+                    is False.
 
         Returns:
         A tuple of status, data
@@ -2303,6 +2365,8 @@ class Communicator(object):
             ]
         if perm:
             attrs.append(LDMSD_Req_Attr(attr_id=LDMSD_Req_Attr.PERM, value=str(perm)))
+        if delta is not None:
+            attrs.append(LDMSD_Req_Attr(attr_id=LDMSD_Req_Attr.DELTA, value=str(delta)))
         req = LDMSD_Request(command_id=LDMSD_Request.UPDTR_ADD, attrs=attrs)
         try:
             req.send(self)
@@ -2630,7 +2694,9 @@ class Communicator(object):
             return errno.ENOTCONN, str(e)
 
     def strgp_add(self, name, plugin, container, schema=None,
-                  regex=None, perm=0o777, flush=None, decomp=None):
+                  regex=None, perm=0o777, flush=None, decomp=None,
+                  queue_depth=None, queue_threads=None, queue_policy=None,
+                  commit=None):
         """
         Add a Storage Policy that will store metric set data when
         updates complete on a metric set.
@@ -2649,6 +2715,15 @@ class Communicator(object):
         flush   -   Interval between calls to the storage plugin flush method.
                     By default, the flush method is not called.
         decomp  -   The path to a decomposition configuration file
+        queue_depth - The number of set updates that can be queued for
+                    the storage worker threads. By default (0), the data is
+                    stored synchronously in the update completion path.
+        queue_threads - The number of storage worker threads (default 1)
+        queue_policy - What to do when the queue is full: 'drop_oldest'
+                    (default), 'drop_newest' or 'block'
+        commit  -   'serial' (default) stores in the update completion path;
+                    'parallel' commits on the shared commit threads together
+                    with the other parallel storage policies of the set
         Returns:
         A tuple of status, data
         - status is an errno from the errno module
@@ -2669,6 +2744,14 @@ class Communicator(object):
             attrs.append(LDMSD_Req_Attr(attr_id = LDMSD_Req_Attr.DECOMPOSITION, value = decomp))
         if flush is not None:
             attrs.append(LDMSD_Req_Attr(attr_name='flush', value=flush))
+        if queue_depth is not None:
+            attrs.append(LDMSD_Req_Attr(attr_id = LDMSD_Req_Attr.QUEUE_DEPTH, value = str(queue_depth)))
+        if queue_threads is not None:
+            attrs.append(LDMSD_Req_Attr(attr_id = LDMSD_Req_Attr.QUEUE_THREADS, value = str(queue_threads)))
+        if queue_policy is not None:
+            attrs.append(LDMSD_Req_Attr(attr_id = LDMSD_Req_Attr.QUEUE_POLICY, value = queue_policy))
+        if commit is not None:
+            attrs.append(LDMSD_Req_Attr(attr_id = LDMSD_Req_Attr.COMMIT, value = commit))
         req = LDMSD_Request(command_id=LDMSD_Request.STRGP_ADD, attrs=attrs)
         try:
             req.send(self)
@@ -61,9 +61,203 @@
 #include <pwd.h>
 #include <sys/syscall.h>
 #include <assert.h>
+#include <endian.h>
+#include <time.h>
 #include "ldms.h"
 #include "ldmsd.h"
-#include </usr/include/libpq-fe.h>
+#include <libpq-fe.h>
+
+/*
+ * Rows are buffered in the PostgreSQL binary COPY format and sent with
+ * "COPY <schema> FROM STDIN (FORMAT binary)". Each row is an int16 field
+ * count followed by an int32 length and the network-order value of each
+ * field; integers are sent as NUMERIC to match the DECIMAL columns.
+ */
+static const char pgcopy_hdr[] = {
+	'P', 'G', 'C', 'O', 'P', 'Y', '\n', '\377', '\r', '\n', '\0',
+	0, 0, 0, 0,	/* flags */
+	0, 0, 0, 0	/* header extension length */
+};
+static const char pgcopy_trailer[] = { '\377', '\377' };
+
+/* Seconds between the UNIX and PostgreSQL (2000-01-01) epochs */
+#define PG_EPOCH_OFFSET 946684800L
+#define VARCHAR_LEN 255
+
+struct row_buf {
+	char *data;
+	size_t len;
+	size_t alloc;
+	int rows;
+	time_t first;	/* time the first buffered row was added */
+};
+
+static int buf_reserve(struct row_buf *b, size_t sz)
+{
+	size_t alloc;
+	char *data;
+
+	if (b->len + sz <= b->alloc)
+		return 0;
+	alloc = (b->alloc ? b->alloc : 4096);
+	while (alloc < b->len + sz)
+		alloc *= 2;
+	data = realloc(b->data, alloc);
+	if (!data)
+		return ENOMEM;
+	b->data = data;
+	b->alloc = alloc;
+	return 0;
+}
+
+static inline void put_u16(struct row_buf *b, uint16_t v)
+{
+	v = htobe16(v);
+	memcpy(&b->data[b->len], &v, sizeof(v));
+	b->len += sizeof(v);
+}
+
+static inline void put_u32(struct row_buf *b, uint32_t v)
+{
+	v = htobe32(v);
+	memcpy(&b->data[b->len], &v, sizeof(v));
+	b->len += sizeof(v);
+}
+
+static inline void put_u64(struct row_buf *b, uint64_t v)
+{
+	v = htobe64(v);
+	memcpy(&b->data[b->len], &v, sizeof(v));
+	b->len += sizeof(v);
+}
+
+/* The largest encoded field: a 20 digit NUMERIC is five base-10000 digits */
+#define FIELD_MAX (4 + 8 + 5 * 2)
+
+static void put_numeric(struct row_buf *b, int neg, uint64_t v)
+{
+	uint16_t digits[5];
+	int n = 0;
+
+	while (v) {
+		digits[n++] = v % 10000;
+		v /= 10000;
+	}
+	put_u32(b, 8 + 2 * n);
+	put_u16(b, n);			/* ndigits */
+	put_u16(b, n ? n - 1 : 0);	/* weight */
+	put_u16(b, neg ? 0x4000 : 0);	/* sign */
+	put_u16(b, 0);			/* dscale */
+	while (n)
+		put_u16(b, digits[--n]);
+}
+
+static inline void put_signed(struct row_buf *b, int64_t v)
+{
+	if (v < 0)
+		put_numeric(b, 1, (uint64_t)(-(v + 1)) + 1);
+	else
+		put_numeric(b, 0, v);
+}
+
+static inline void put_double(struct row_buf *b, double d)
+{
+	uint64_t v;
+	memcpy(&v, &d, sizeof(v));
+	put_u32(b, sizeof(v));
+	put_u64(b, v);
+}
+
+static int put_value(struct row_buf *b, ldms_set_t s, int i,
+		     enum ldms_value_type type)
+{
+	const char *str;
+	size_t len;
+
+	if (type == LDMS_V_CHAR_ARRAY) {
+		str = ldms_metric_array_get_str(s, i);
+		len = strnlen(str, VARCHAR_LEN);
+		/* Do not split a UTF-8 sequence, the server rejects it */
+		while (len && ((unsigned char)str[len] & 0xC0) == 0x80)
+			len--;
+		if (buf_reserve(b, 4 + len))
+			return ENOMEM;
+		put_u32(b, len);
+		memcpy(&b->data[b->len], str, len);
+		b->len += len;
+		return 0;
+	}
+	if (buf_reserve(b, FIELD_MAX))
+		return ENOMEM;
+	switch (type) {
+	case LDMS_V_CHAR:
+	case LDMS_V_S8:
+		put_signed(b, ldms_metric_get_s8(s, i));
+		break;
+	case LDMS_V_U8:
+		put_numeric(b, 0, ldms_metric_get_u8(s, i));
+		break;
+	case LDMS_V_U16:
+		put_numeric(b, 0, ldms_metric_get_u16(s, i));
+		break;
+	case LDMS_V_S16:
+		put_signed(b, ldms_metric_get_s16(s, i));
+		break;
+	case LDMS_V_U32:
+		put_numeric(b, 0, ldms_metric_get_u32(s, i));
+		break;
+	case LDMS_V_S32:
+		put_signed(b, ldms_metric_get_s32(s, i));
+		break;
+	case LDMS_V_U64:
+		put_numeric(b, 0, ldms_metric_get_u64(s, i));
+		break;
+	case LDMS_V_S64:
+		put_signed(b, ldms_metric_get_s64(s, i));
+		break;
+	case LDMS_V_F32:
+		put_double(b, ldms_metric_get_float(s, i));
+		break;
+	case LDMS_V_D64:
+		put_double(b, ldms_metric_get_double(s, i));
+		break;
+	default:
+		assert(0 == "Invalid LDMS metric type");
+		return EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * Append a row of the metrics in metric_arry that have a column, followed
+ * by the transaction timestamp. field_count is the number of columns. On
+ * error the caller discards the partial row.
+ */
+static int put_row(struct row_buf *b, int field_count, ldms_set_t set,
+		   int *metric_arry, size_t metric_count)
+{
+	struct ldms_timestamp timestamp;
+	enum ldms_value_type type;
+	int i;
+
+	if (buf_reserve(b, 2))
+		return ENOMEM;
+	put_u16(b, field_count);
+	for (i = 0; i < metric_count; i++) {
+		type = ldms_metric_type_get(set, metric_arry[i]);
+		if (type > LDMS_V_CHAR_ARRAY)
+			continue;
+		if (put_value(b, set, metric_arry[i], type))
+			return ENOMEM;
+	}
+	timestamp = ldms_transaction_timestamp_get(set);
+	if (buf_reserve(b, 12))
+		return ENOMEM;
+	put_u32(b, 8);
+	put_u64(b, ((int64_t)timestamp.sec - PG_EPOCH_OFFSET) * 1000000
+		   + timestamp.usec);
+	return 0;
+}
 
 static char user[100];
 static char hostaddr[100];
@@ -79,103 +273,39 @@ struct timescale_store {
         int job_mid;
         int comp_mid;
         char **metric_name;
+        int metric_count;
+        int field_count;	/* supported metrics + timestamp */
         LIST_ENTRY(timescale_store) entry;
         PGconn *conn;
+        struct row_buf buf;	/* rows waiting to be copied */
+        struct row_buf copy_buf;	/* rows being copied by flush_proc */
+        int batch_rows;
+        int batch_age;
+        int async;
+        int stop;
+        uint64_t dropped;
+        uint64_t flush_req;
+        uint64_t flush_done;
+        pthread_cond_t flush_cv;
+        pthread_cond_t done_cv;
+        pthread_t thread;
         size_t measurement_limit;
         char measurement[0];
 };
 
 #define MEASUREMENT_LIMIT_DEFAULT	8192
+#define BATCH_ROWS_DEFAULT	1024
+#define BATCH_AGE_DEFAULT	1	/* seconds */
+/* Rows buffered while the flush thread is busy, in batch_rows units */
+#define BACKLOG_BATCHES		16
 static long measurement_limit = MEASUREMENT_LIMIT_DEFAULT;
+static int batch_rows = BATCH_ROWS_DEFAULT;
+static int batch_age = BATCH_AGE_DEFAULT;
+static int async_flush = 0;
 static pthread_mutex_t cfg_lock = PTHREAD_MUTEX_INITIALIZER;
 LIST_HEAD(timescale_store_list, timescale_store) store_list;
 static ldmsd_msg_log_f msglog;
 
-static int set_none_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
-{
-	assert(0 == "Invalid LDMS metric type");
-}
-static int update_offset(size_t cnt, size_t *line_off, size_t line_len)
-{
-	if (cnt + *line_off < line_len) {
-		*line_off += cnt;
-		return 0;
-	}
-	return E2BIG;
-}
-static int set_u8_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
-{
-	size_t cnt = snprintf(&line[*line_off], line_len, "%hhu", ldms_metric_get_u8(s, i));
-	return update_offset(cnt, line_off, line_len);
-}
-static int set_s8_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
-{
-	size_t cnt = snprintf(&line[*line_off], line_len, "%hhd", ldms_metric_get_s8(s, i));
-	return update_offset(cnt, line_off, line_len);
-}
-static int set_u16_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
-{
-	size_t cnt = snprintf(&line[*line_off], line_len, "%hu", ldms_metric_get_u16(s, i));
-	return update_offset(cnt, line_off, line_len);
-}
-static int set_s16_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
-{
-	size_t cnt = snprintf(&line[*line_off], line_len, "%hd", ldms_metric_get_s16(s, i));
-	return update_offset(cnt, line_off, line_len);
-}
-static int set_str_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
-{
-	size_t cnt = snprintf(&line[*line_off], line_len, "\'%s\'", ldms_metric_array_get_str(s, i));
-	return update_offset(cnt, line_off, line_len);
-}
-static int set_u32_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
-{
-	size_t cnt = snprintf(&line[*line_off], line_len, "%u", ldms_metric_get_u32(s, i));
-	return update_offset(cnt, line_off, line_len);
-}
-static int set_s32_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
-{
-	size_t cnt = snprintf(&line[*line_off], line_len, "%d", ldms_metric_get_s32(s, i));
-	return update_offset(cnt, line_off, line_len);
-}
-static int set_u64_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
-{
-	size_t cnt = snprintf(&line[*line_off], line_len, "%lu", ldms_metric_get_u64(s, i));
-	return update_offset(cnt, line_off, line_len);
-}
-static int set_s64_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
-{
-	size_t cnt = snprintf(&line[*line_off], line_len, "%ld", ldms_metric_get_s64(s, i));
-	return update_offset(cnt, line_off, line_len);
-}
-static int set_float_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
-{
-	size_t cnt = snprintf(&line[*line_off], line_len, "%f", ldms_metric_get_float(s, i));
-	return update_offset(cnt, line_off, line_len);
-}
-static int set_double_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
-{
-	size_t cnt = snprintf(&line[*line_off], line_len, "%lf", ldms_metric_get_double(s, i));
-	return update_offset(cnt, line_off, line_len);
-}
-
-typedef int (*timescale_value_set_fn)(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i);
-timescale_value_set_fn timescale_value_set[] = {
-	[LDMS_V_NONE] = set_none_fn,
-	[LDMS_V_CHAR] = set_s8_fn,
-	[LDMS_V_U8] = set_u8_fn,
-	[LDMS_V_S8] = set_s8_fn,
-	[LDMS_V_U16] = set_u16_fn,
-	[LDMS_V_S16] = set_s16_fn,
-	[LDMS_V_U32] = set_u32_fn,
-	[LDMS_V_S32] = set_s32_fn,
-	[LDMS_V_U64] = set_u64_fn,
-	[LDMS_V_S64] = set_s64_fn,
-	[LDMS_V_F32] = set_float_fn,
-	[LDMS_V_D64] = set_double_fn,
-	[LDMS_V_CHAR_ARRAY] = set_str_fn
-};
-
 static char *fixup(char *name)
 {
         char *s = name;
@@ -212,30 +342,32 @@ static char *fixup(char *name)
 static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct attr_value_list *avl)
 {
         char *value, *pwfile = NULL;
+        FILE *file = NULL;
+        int rc = EINVAL;
         pthread_mutex_lock(&cfg_lock);
 
         value = av_value(avl, "user");
         if (!value) {
                 msglog(LDMSD_LERROR, "The 'user' keyword is required.\n");
-                return EINVAL;
+                goto out;
         }
         strncpy(user, value, sizeof(user));
 
         pwfile = av_value(avl, "pwfile");
         if (!pwfile) {
                 msglog(LDMSD_LERROR, "The 'pwfile' keyword is required.\n");
-                return EINVAL;
+                goto out;
         }
         if (pwfile) {
                 if (!pwfile || pwfile[0] != '/') {
                         msglog(LDMSD_LERROR, "Invalid password file path! Must start with '/'.\n");
-                        return EINVAL;
+                        goto out;
                 }
 
-                FILE *file = fopen(pwfile, "r");
+                file = fopen(pwfile, "r");
                 if (!file) {
                         msglog(LDMSD_LERROR, "Unable to open password file!\n");
-                        return EINVAL;
+                        goto out;
                 }
                 char line[600];
                 char *s, *ptr;
@@ -247,38 +379,39 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct
                                 s = strtok_r(&line[11], " \t\n", &ptr);
                                 if (!s) {
                                         msglog(LDMSD_LERROR, "Auth error: the secret word is an empty srting.\n");
-                                        return EINVAL;
+                                        goto out;
                                 }
                                 break;
                         }
                 }
                 if (!s) {
                         msglog(LDMSD_LERROR, "No secret word in the file!\n");
-                        return EINVAL;
+                        goto out;
                 }
-                strncpy(password, strdup(s), sizeof(password));
+                strncpy(password, s, sizeof(password));
 
                 fclose(file);
+                file = NULL;
         }
 
         value = av_value(avl, "hostaddr");
         if (!value) {
                 msglog(LDMSD_LERROR, "The 'hostaddr' keyword is required.\n");
-                return EINVAL;
+                goto out;
         }
         strncpy(hostaddr, value, sizeof(hostaddr));
 
         value = av_value(avl, "port");
         if (!value) {
                 msglog(LDMSD_LERROR, "The 'port' keyword is required.\n");
-                return EINVAL;
+                goto out;
         }
         strncpy(port, value, sizeof(port));
 
         value = av_value(avl, "dbname");
         if (!value) {
                 msglog(LDMSD_LERROR, "The 'dbname' keyword is required.\n");
-                return EINVAL;
+                goto out;
         }
         strncpy(dbname, value, sizeof(dbname));
 
@@ -293,8 +426,38 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct
                 }
         }
 
+        value = av_value(avl, "batch_rows");
+        if (value) {
+                batch_rows = strtol(value, NULL, 0);
+                if (batch_rows <= 0) {
+                        msglog(LDMSD_LERROR,
+                                "'%s' is not a valid 'batch_rows' value\n",
+                                value);
+                        batch_rows = BATCH_ROWS_DEFAULT;
+                }
+        }
+
+        value = av_value(avl, "batch_age");
+        if (value) {
+                batch_age = strtol(value, NULL, 0);
+                if (batch_age < 0) {
+                        msglog(LDMSD_LERROR,
+                                "'%s' is not a valid 'batch_age' value\n",
+                                value);
+                        batch_age = BATCH_AGE_DEFAULT;
+                }
+        }
+
+        value = av_value(avl, "async");
+        if (value)
+                async_flush = atoi(value);
+
+        rc = 0;
+ out:
+        if (file)
+                fclose(file);
         pthread_mutex_unlock(&cfg_lock);
-        return 0;
+        return rc;
 }
 
 static void term(struct ldmsd_plugin *self)
@@ -305,9 +468,12 @@ static const char *usage(struct ldmsd_plugin *self)
 {
         return "config name=store_timescale user=<username> pwfile=<full path to password file> "
                "hostaddr=<host ip addr> port=<port no> dbname=<database name> "
-               "measurement_limit=<sql statement length>";
+               "measurement_limit=<sql statement length> "
+               "batch_rows=<rows> batch_age=<seconds> async=<0|1>";
 }
 
+static void *flush_proc(void *arg);
+
 static ldmsd_store_handle_t
 open_store(struct ldmsd_store *s, const char *container, const char *schema,
 	   struct ldmsd_strgp_metric_list *metric_list, void *ucontext)
@@ -319,8 +485,14 @@ open_store(struct ldmsd_store *s, const char *container, const char *schema,
         is = malloc(sizeof(*is) + measurement_limit);
         if (!is)
                 goto out;
+        memset(is, 0, sizeof(*is));
         is->measurement_limit = measurement_limit;
+        is->batch_rows = batch_rows;
+        is->batch_age = batch_age;
+        is->async = async_flush;
         pthread_mutex_init(&is->lock, NULL);
+        pthread_cond_init(&is->flush_cv, NULL);
+        pthread_cond_init(&is->done_cv, NULL);
         is->store = s;
         is->ucontext = ucontext;
         is->container = strdup(container);
@@ -391,6 +563,13 @@ open_store(struct ldmsd_store *s, const char *container, const char *schema,
                 PQclear(res);
                 goto err4;
         }
+        PQclear(res);
+
+        if (is->async && pthread_create(&is->thread, NULL, flush_proc, is)) {
+                msglog(LDMSD_LERROR, "Error %d creating the flush thread.\n",
+                       errno);
+                goto err4;
+        }
 
         pthread_mutex_lock(&cfg_lock);
         LIST_INSERT_HEAD(&store_list, is, entry);
@@ -420,14 +599,22 @@ static int init_store(struct timescale_store *is, ldms_set_t set, int *mids, int
 	is->metric_name = calloc(sizeof(char *), count);
 	if (!is->metric_name)
 		return ENOMEM;
+	is->metric_count = count;
 
 	/* Refactor metric names containing special characters */
 	for (i = 0; i < count; i++) {
-		char *name = strdup(ldms_metric_name_get(set, i));
+		char *name = strdup(ldms_metric_name_get(set, mids[i]));
 		if (!name)
 			return ENOMEM;
 		is->metric_name[i] = fixup(name);
 	}
+
+	/* Unsupported metric types are skipped, see open_store() */
+	is->field_count = 1;
+	for (i = 0; i < count; i++) {
+		if (ldms_metric_type_get(set, mids[i]) <= LDMS_V_CHAR_ARRAY)
+			is->field_count++;
+	}
 	return 0;
 }
 
@@ -464,103 +651,191 @@ static inline size_t __element_byte_len(enum ldms_value_type t)
 	return __element_byte_len_[t];
 }
 
+/*
+ * Send the buffered rows to the database. The caller must own the
+ * connection: the flush thread in async mode, or the holder of is->lock
+ * otherwise.
+ */
+static int copy_rows(struct timescale_store *is, struct row_buf *b)
+{
+	PGresult *res;
+	char sql[256];
+	int rc = 0;
+
+	if (!b->rows)
+		return 0;
+	if (PQstatus(is->conn) != CONNECTION_OK) {
+		PQreset(is->conn);
+		if (PQstatus(is->conn) != CONNECTION_OK) {
+			msglog(LDMSD_LERROR, "TimescaleDB connection failed, "
+			       "%d rows of '%s' dropped.\n", b->rows, is->schema);
+			rc = ENOTCONN;
+			goto out;
+		}
+	}
+	snprintf(sql, sizeof(sql), "COPY %s FROM STDIN (FORMAT binary)",
+		 is->schema);
+	res = PQexec(is->conn, sql);
+	if (PQresultStatus(res) != PGRES_COPY_IN) {
+		msglog(LDMSD_LERROR, "COPY error '%s' with sql %s\n",
+		       PQerrorMessage(is->conn), sql);
+		PQclear(res);
+		rc = EIO;
+		goto out;
+	}
+	PQclear(res);
+	if (PQputCopyData(is->conn, pgcopy_hdr, sizeof(pgcopy_hdr)) != 1
+	    || PQputCopyData(is->conn, b->data, b->len) != 1
+	    || PQputCopyData(is->conn, pgcopy_trailer,
+			     sizeof(pgcopy_trailer)) != 1) {
+		PQputCopyEnd(is->conn, "ldmsd: failed to send COPY data");
+		rc = EIO;
+	} else if (PQputCopyEnd(is->conn, NULL) != 1) {
+		rc = EIO;
+	}
+	while ((res = PQgetResult(is->conn))) {
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			rc = EIO;
+		PQclear(res);
+	}
+	if (rc)
+		msglog(LDMSD_LERROR, "COPY of %d rows into '%s' failed: %s\n",
+		       b->rows, is->schema, PQerrorMessage(is->conn));
+ out:
+	b->len = 0;
+	b->rows = 0;
+	return rc;
+}
+
+static inline int batch_ready(struct timescale_store *is, time_t now)
+{
+	return is->buf.rows >= is->batch_rows ||
+		(is->buf.rows && now - is->buf.first >= is->batch_age);
+}
+
+static void *flush_proc(void *arg)
+{
+	struct timescale_store *is = arg;
+	struct timespec ts;
+	struct row_buf tmp;
+	uint64_t gen, dropped;
+	time_t now;
+
+	pthread_mutex_lock(&is->lock);
+	while (1) {
+		now = time(NULL);
+		while (!is->stop && is->flush_req == is->flush_done
+		       && !batch_ready(is, now)) {
+			ts.tv_sec = (is->buf.rows ? is->buf.first : now)
+					+ is->batch_age;
+			ts.tv_nsec = 0;
+			pthread_cond_timedwait(&is->flush_cv, &is->lock, &ts);
+			now = time(NULL);
+		}
+		/* Take the pending rows; store() keeps filling the other buffer */
+		tmp = is->buf;
+		is->buf = is->copy_buf;
+		is->copy_buf = tmp;
+		gen = is->flush_req;
+		dropped = is->dropped;
+		is->dropped = 0;
+		pthread_mutex_unlock(&is->lock);
+
+		if (dropped)
+			msglog(LDMSD_LERROR, "TimescaleDB is falling behind, "
+			       "%lu rows of '%s' dropped.\n", dropped, is->schema);
+		copy_rows(is, &is->copy_buf);
+
+		pthread_mutex_lock(&is->lock);
+		is->flush_done = gen;
+		pthread_cond_broadcast(&is->done_cv);
+		if (is->stop && !is->buf.rows)
+			break;
+	}
+	pthread_mutex_unlock(&is->lock);
+	return NULL;
+}
+
 static int
 store(ldmsd_store_handle_t _sh, ldms_set_t set, int *metric_arry, size_t metric_count)
 {
         struct timescale_store *is = _sh;
-        struct ldms_timestamp timestamp;
-        int i;
+        struct row_buf *b;
         int rc = 0;
-        size_t cnt_insert, off_insert;
-        char *measurement_insert;
-        enum ldms_value_type metric_type;
+        size_t row_off;
+        time_t now;
         if (!is)
                 return EINVAL;
 
         pthread_mutex_lock(&is->lock);
-        if (is->job_mid < 0) {
+        if (!is->field_count) {
                 rc = init_store(is, set, metric_arry, metric_count);
-                if (rc)
-                        goto err;
-        }
-
-        measurement_insert = is->measurement;
-        cnt_insert = snprintf(measurement_insert, is->measurement_limit,
-                   "INSERT INTO %s VALUES(",
-                   is->schema);
-
-        off_insert = cnt_insert;
-
-        int comma = 0;
-        for (i = 0; i < metric_count; i++) {
-                metric_type = ldms_metric_type_get(set, metric_arry[i]);
-                if (metric_type > LDMS_V_CHAR_ARRAY) {
-                        msglog(LDMSD_LERROR,
-                               "The metric %s:%s of type %s is not supported by "
-                               "TimescaleDB and is being ignored.\n",
-                               is->schema,
-                               ldms_metric_name_get(set, metric_arry[i]),
-                               ldms_metric_type_to_str(metric_type));
-                        continue;
+                if (rc) {
+                        is->field_count = 0;
+                        pthread_mutex_unlock(&is->lock);
+                        msglog(LDMSD_LERROR, "Error %d initializing '%s'.\n",
+                               rc, is->schema);
+                        return rc;
                 }
-                if (comma) {
-                        if (off_insert > is->measurement_limit - 16)
-                                goto err;
-                        measurement_insert[off_insert++] = ',';
-                } else
-                        comma = 1;
-
-                if (timescale_value_set[metric_type](measurement_insert, &off_insert,
-						  is->measurement_limit - off_insert,
-						  set, metric_arry[i]))
-                        goto err;
+        }
+        b = &is->buf;
+        if (is->async && b->rows >= is->batch_rows * BACKLOG_BATCHES) {
+                /* The flush thread can't keep up with the database */
+                is->dropped++;
+                pthread_mutex_unlock(&is->lock);
+                return 0;
         }
 
-        timestamp = ldms_transaction_timestamp_get(set);
-
-        char str[100] = {0};
-        sprintf(str, "%d", timestamp.sec);
-        char command[150];
-        strcpy(command, "date '+%Y-%m-%d %H:%M:%S+08' -d @");
-        strcat(command, str);
-        FILE *fp;
-        char buffer[50];
-        fp=popen(command, "r");
-        char *strdate = fgets(buffer, sizeof(buffer), fp);
-	if (fp)
-		pclose(fp);
-
-	if (strdate) {
-		cnt_insert = snprintf(&measurement_insert[off_insert], is->measurement_limit - off_insert, ",'%s')", buffer);
-		off_insert += cnt_insert;
-
-		PGresult *res = PQexec(is->conn, measurement_insert);
-		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-			msglog(LDMSD_LERROR, "Insert table error! with sql %s \n", measurement_insert);
-			PQclear(res);
-			PQfinish(is->conn);
-		}
-	} else {
-		msglog(LDMSD_LERROR, "Unable to format date for table insertion!\n");
-	}
+        row_off = b->len;
+        if (put_row(b, is->field_count, set, metric_arry, metric_count))
+                goto err;
+
+        now = time(NULL);
+        if (!b->rows)
+                b->first = now;
+        b->rows++;
+        if (batch_ready(is, now)) {
+                if (is->async)
+                        pthread_cond_signal(&is->flush_cv);
+                else
+                        copy_rows(is, b);
+        }
         pthread_mutex_unlock(&is->lock);
         return 0;
 err:
+        /* Discard the partial row */
+        b->len = row_off;
         pthread_mutex_unlock(&is->lock);
 
-        msglog(LDMSD_LERROR, "Overflow formatting TimescaleDB measurement data.\n");
+        msglog(LDMSD_LERROR, "Out of memory formatting TimescaleDB measurement data.\n");
         msglog(LDMSD_LERROR, "SCHEMA: %s \n", is->schema);
         return ENOMEM;
 }
 
 static int flush_store(ldmsd_store_handle_t _sh)
 {
-        return 0;
+	struct timescale_store *is = _sh;
+	uint64_t gen;
+
+	if (!is)
+		return EINVAL;
+	pthread_mutex_lock(&is->lock);
+	if (is->async) {
+		gen = ++is->flush_req;
+		pthread_cond_signal(&is->flush_cv);
+		while (is->flush_done < gen)
+			pthread_cond_wait(&is->done_cv, &is->lock);
+	} else {
+		copy_rows(is, &is->buf);
+	}
+	pthread_mutex_unlock(&is->lock);
+	return 0;
 }
 
 static void close_store(ldmsd_store_handle_t _sh)
 {
 	struct timescale_store *is = _sh;
+	int i;
 
 	if (!is)
 		return;
@@ -569,6 +844,23 @@ static void close_store(ldmsd_store_handle_t _sh)
 	LIST_REMOVE(is, entry);
 	pthread_mutex_unlock(&cfg_lock);
 
+	if (is->async) {
+		pthread_mutex_lock(&is->lock);
+		is->stop = 1;
+		pthread_cond_signal(&is->flush_cv);
+		pthread_mutex_unlock(&is->lock);
+		pthread_join(is->thread, NULL);
+	} else {
+		copy_rows(is, &is->buf);
+	}
+
+	if (is->metric_name) {
+		for (i = 0; i < is->metric_count; i++)
+			free(is->metric_name[i]);
+		free(is->metric_name);
+	}
+	free(is->buf.data);
+	free(is->copy_buf.data);
 	free(is->container);
 	free(is->schema);
 	PQfinish(is->conn);
@@ -0,0 +1,315 @@
+/*
+ * The encoders are static, so the test is built from the plugin source.
+ */
+#include "store_timescale.c"
+#include <math.h>
+
+/*
+ * store_timescale binary COPY encoding
+ *
+ * Known values are encoded with the plugin's writers and compared byte
+ * for byte with the PostgreSQL binary COPY format, built independently
+ * here: the file header and trailer, NUMERIC values (base-10000 digits,
+ * weight, sign and dscale), float8 values including NaN and infinities,
+ * and a whole row of an LDMS set with its field count, a VARCHAR cut on a
+ * UTF-8 character boundary and the timestamp.
+ */
+
+#define SCHEMA_NAME "tstest"
+#define STR_LEN 300
+
+/* provided by ldmsd to the plugins it loads */
+void ldmsd_log(enum ldmsd_loglevel level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (level < LDMSD_LWARNING)
+		return;
+	printf("# ");
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+enum ldmsd_loglevel ldmsd_loglevel_get()
+{
+	return LDMSD_LWARNING;
+}
+
+/* The expected encoding */
+struct expect {
+	unsigned char data[1024];
+	size_t len;
+};
+
+static void ex_be(struct expect *e, uint64_t v, int bytes)
+{
+	while (bytes--)
+		e->data[e->len++] = v >> (8 * bytes);
+}
+
+/* A NUMERIC field: ndigits base-10000 digits, most significant first */
+static void ex_numeric(struct expect *e, int neg, int weight,
+		       int ndigits, const uint16_t *digits)
+{
+	int i;
+	ex_be(e, 8 + 2 * ndigits, 4);
+	ex_be(e, ndigits, 2);
+	ex_be(e, weight, 2);
+	ex_be(e, neg ? 0x4000 : 0, 2);	/* NUMERIC_POS or NUMERIC_NEG */
+	ex_be(e, 0, 2);			/* dscale, integers only */
+	for (i = 0; i < ndigits; i++)
+		ex_be(e, digits[i], 2);
+}
+
+static void ex_float8(struct expect *e, uint64_t bits)
+{
+	ex_be(e, 8, 4);
+	ex_be(e, bits, 8);
+}
+
+static int same(const char *what, struct row_buf *b, struct expect *e)
+{
+	size_t i;
+
+	if (b->len == e->len && 0 == memcmp(b->data, e->data, e->len))
+		return 1;
+	printf("# %s: %zu bytes, expected %zu\n", what, b->len, e->len);
+	for (i = 0; i < b->len && i < e->len; i++) {
+		if ((unsigned char)b->data[i] != e->data[i]) {
+			printf("# first difference at byte %zu: 0x%02x, "
+			       "expected 0x%02x\n", i,
+			       (unsigned char)b->data[i], e->data[i]);
+			break;
+		}
+	}
+	return 0;
+}
+
+static int test_header(void)
+{
+	static const unsigned char hdr[] = "PGCOPY\n\377\r\n";
+	int ok;
+
+	ok = sizeof(pgcopy_hdr) == 19 &&
+	     0 == memcmp(pgcopy_hdr, hdr, 11) &&
+	     0 == memcmp(pgcopy_hdr + 11, "\0\0\0\0\0\0\0\0", 8) &&
+	     sizeof(pgcopy_trailer) == 2 &&
+	     (unsigned char)pgcopy_trailer[0] == 0xff &&
+	     (unsigned char)pgcopy_trailer[1] == 0xff;
+	if (!ok)
+		printf("# the COPY header or trailer differs\n");
+	return ok;
+}
+
+static const struct numeric_case {
+	const char *name;
+	int is_signed;
+	int64_t s;
+	uint64_t u;
+	int neg;
+	int weight;
+	int ndigits;
+	uint16_t digits[5];
+} numeric_cases[] = {
+	{ "0", 0, 0, 0, 0, 0, 0, {0} },
+	{ "signed 0", 1, 0, 0, 0, 0, 0, {0} },
+	{ "1", 0, 0, 1, 0, 0, 1, {1} },
+	{ "9999", 0, 0, 9999, 0, 0, 1, {9999} },
+	{ "10000", 0, 0, 10000, 0, 1, 2, {1, 0} },
+	{ "100000000", 0, 0, 100000000, 0, 2, 3, {1, 0, 0} },
+	{ "123456789", 0, 0, 123456789, 0, 2, 3, {1, 2345, 6789} },
+	{ "-1", 1, -1, 0, 1, 0, 1, {1} },
+	{ "-10000", 1, -10000, 0, 1, 1, 2, {1, 0} },
+	{ "-1234", 1, -1234, 0, 1, 0, 1, {1234} },
+	{ "UINT64_MAX", 0, 0, UINT64_MAX, 0, 4, 5,
+		{1844, 6744, 737, 955, 1615} },
+	{ "INT64_MAX", 1, INT64_MAX, 0, 0, 4, 5,
+		{922, 3372, 368, 5477, 5807} },
+	{ "INT64_MIN", 1, INT64_MIN, 0, 1, 4, 5,
+		{922, 3372, 368, 5477, 5808} },
+};
+
+static int test_numeric(void)
+{
+	const struct numeric_case *c;
+	struct row_buf b = {0};
+	struct expect e;
+	int i, ok = 1;
+
+	for (i = 0; i < sizeof(numeric_cases) / sizeof(numeric_cases[0]); i++) {
+		c = &numeric_cases[i];
+		b.len = 0;
+		if (buf_reserve(&b, FIELD_MAX)) {
+			printf("Bail out! out of memory\n");
+			exit(1);
+		}
+		if (c->is_signed)
+			put_signed(&b, c->s);
+		else
+			put_numeric(&b, 0, c->u);
+		e.len = 0;
+		ex_numeric(&e, c->neg, c->weight, c->ndigits, c->digits);
+		ok &= same(c->name, &b, &e);
+	}
+	free(b.data);
+	return ok;
+}
+
+static const struct float8_case {
+	const char *name;
+	double d;
+	uint64_t bits;
+} float8_cases[] = {
+	{ "0.0", 0.0, 0x0000000000000000ULL },
+	{ "-0.0", -0.0, 0x8000000000000000ULL },
+	{ "1.5", 1.5, 0x3ff8000000000000ULL },
+	{ "-2.0", -2.0, 0xc000000000000000ULL },
+	{ "Infinity", INFINITY, 0x7ff0000000000000ULL },
+	{ "-Infinity", -INFINITY, 0xfff0000000000000ULL },
+};
+
+static int test_float8(void)
+{
+	const struct float8_case *c;
+	struct row_buf b = {0};
+	struct expect e;
+	uint64_t bits;
+	int i, ok = 1;
+
+	for (i = 0; i < sizeof(float8_cases) / sizeof(float8_cases[0]); i++) {
+		c = &float8_cases[i];
+		b.len = 0;
+		if (buf_reserve(&b, FIELD_MAX)) {
+			printf("Bail out! out of memory\n");
+			exit(1);
+		}
+		put_double(&b, c->d);
+		e.len = 0;
+		ex_float8(&e, c->bits);
+		ok &= same(c->name, &b, &e);
+	}
+	/* Any NaN is accepted by float8recv(); check that it is a NaN */
+	b.len = 0;
+	put_double(&b, NAN);
+	memcpy(&bits, b.data + 4, sizeof(bits));
+	bits = be64toh(bits);
+	if (b.len != 12 || memcmp(b.data, "\0\0\0\x08", 4) ||
+	    (bits & 0x7ff0000000000000ULL) != 0x7ff0000000000000ULL ||
+	    !(bits & 0x000fffffffffffffULL)) {
+		printf("# NaN is encoded as 0x%016" PRIx64 "\n", bits);
+		ok = 0;
+	}
+	free(b.data);
+	return ok;
+}
+
+/*
+ * A row of a set with a zero, a negative and a large integer, a float,
+ * a double, a string of two-byte UTF-8 characters longer than the
+ * VARCHAR and an array, which has no column.
+ */
+static int test_row(void)
+{
+	static const uint16_t u64_max[] = {1844, 6744, 737, 955, 1615};
+	static const uint16_t s32_neg[] = {1, 2345, 6789};
+	char str[STR_LEN];
+	int metric_array[7];
+	struct ldms_timestamp ts;
+	struct row_buf b = {0};
+	struct expect e = {0};
+	ldms_schema_t schema;
+	ldms_set_t set;
+	int64_t usec;
+	int i, ok;
+
+	ldms_init(16 * 1024 * 1024);
+	schema = ldms_schema_new(SCHEMA_NAME);
+	if (!schema) {
+		printf("Bail out! cannot create the schema\n");
+		exit(1);
+	}
+	metric_array[0] = ldms_schema_metric_add(schema, "zero", LDMS_V_U32);
+	metric_array[1] = ldms_schema_metric_add(schema, "neg", LDMS_V_S32);
+	metric_array[2] = ldms_schema_metric_add(schema, "big", LDMS_V_U64);
+	metric_array[3] = ldms_schema_metric_add(schema, "flt", LDMS_V_F32);
+	metric_array[4] = ldms_schema_metric_add(schema, "dbl", LDMS_V_D64);
+	metric_array[5] = ldms_schema_metric_array_add(schema, "str",
+					LDMS_V_CHAR_ARRAY, STR_LEN);
+	metric_array[6] = ldms_schema_metric_array_add(schema, "arr",
+					LDMS_V_U64_ARRAY, 4);
+	set = ldms_set_new("node/" SCHEMA_NAME, schema);
+	if (!set) {
+		printf("Bail out! cannot create the set\n");
+		exit(1);
+	}
+
+	/* 128 x U+00E9: VARCHAR_LEN (255) bytes end inside a character */
+	for (i = 0; i < 256; i += 2) {
+		str[i] = (char)0xc3;
+		str[i + 1] = (char)0xa9;
+	}
+	str[256] = '\0';
+	ldms_transaction_begin(set);
+	ldms_metric_set_u32(set, metric_array[0], 0);
+	ldms_metric_set_s32(set, metric_array[1], -123456789);
+	ldms_metric_set_u64(set, metric_array[2], UINT64_MAX);
+	ldms_metric_set_float(set, metric_array[3], 0.5f);
+	ldms_metric_set_double(set, metric_array[4], -INFINITY);
+	ldms_metric_array_set_str(set, metric_array[5], str);
+	ldms_transaction_end(set);
+	ts = ldms_transaction_timestamp_get(set);
+
+	ex_be(&e, 6, 2);		/* fields: 5 metrics + timestamp */
+	ex_numeric(&e, 0, 0, 0, NULL);
+	ex_numeric(&e, 1, 2, 3, s32_neg);
+	ex_numeric(&e, 0, 4, 5, u64_max);
+	ex_float8(&e, 0x3fe0000000000000ULL);
+	ex_float8(&e, 0xfff0000000000000ULL);
+	ex_be(&e, 254, 4);		/* 127 whole characters */
+	memcpy(&e.data[e.len], str, 254);
+	e.len += 254;
+	usec = ((int64_t)ts.sec - 946684800) * 1000000 + ts.usec;
+	ex_be(&e, 8, 4);
+	ex_be(&e, usec, 8);
+
+	if (put_row(&b, 6, set, metric_array, 7)) {
+		printf("# put_row() failed\n");
+		ok = 0;
+	} else {
+		ok = same("row", &b, &e);
+	}
+	free(b.data);
+	ldms_set_delete(set);
+	ldms_schema_delete(schema);
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	int ok, rc = 0;
+
+	msglog = ldmsd_log;
+	printf("1..4\n");
+
+	ok = test_header();
+	printf("%s 1 - COPY header and trailer\n", ok ? "ok" : "not ok");
+	rc |= !ok;
+
+	ok = test_numeric();
+	printf("%s 2 - NUMERIC zero, negatives, weight and 64-bit limits\n",
+	       ok ? "ok" : "not ok");
+	rc |= !ok;
+
+	ok = test_float8();
+	printf("%s 3 - float8 values, NaN and infinities\n",
+	       ok ? "ok" : "not ok");
+	rc |= !ok;
+
+	ok = test_row();
+	printf("%s 4 - row framing, UTF-8 VARCHAR cut and timestamp\n",
+	       ok ? "ok" : "not ok");
+	rc |= !ok;
+
+	return rc;
+}
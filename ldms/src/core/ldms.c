@@ -72,6 +72,7 @@
 #include "ldms_heap.h"
 #include "ldms_private.h"
 #include "coll/rbt.h"
+#include "coll/fnv_hash.h"
 
 ovis_log_t xlog;
 
@@ -154,6 +155,110 @@ static struct rbt __id_tree = {
 
 static pthread_mutex_t __set_tree_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Set name and set_id indices
+ *
+ * Looking a set up by name or by set_id is the common case on a busy
+ * daemon: every lookup, update, push and notify request from a peer
+ * does one. These lookups are served from hash tables split into
+ * shards, each guarded by its own read-write lock, so that the zap I/O
+ * threads neither serialize on the set tree lock nor on each other.
+ *
+ * The set tree remains the ordered view used by dir and regex lookup.
+ * Writers take the set tree lock first and then the write lock of the
+ * shard, so the trees and the indices always describe the same sets.
+ */
+#define LDMS_SET_SHARDS		32
+#define LDMS_SET_SHARD_DEPTH	509
+
+struct ldms_set_shard {
+	pthread_rwlock_t lock;
+	htbl_t tbl;
+} __attribute__((aligned(64)));
+
+static struct ldms_set_shard __name_shard[LDMS_SET_SHARDS];
+static struct ldms_set_shard __id_shard[LDMS_SET_SHARDS];
+static pthread_once_t __set_shard_once = PTHREAD_ONCE_INIT;
+
+static int __set_name_cmp(const void *a, const void *b, size_t key_len)
+{
+	return strcmp(a, b);
+}
+
+static int __set_id_cmp(const void *a, const void *b, size_t key_len)
+{
+	uint64_t _a = *(const uint64_t *)a;
+	uint64_t _b = *(const uint64_t *)b;
+	return (_a != _b);
+}
+
+static void __set_shard_init_once(void)
+{
+	int i;
+	for (i = 0; i < LDMS_SET_SHARDS; i++) {
+		pthread_rwlock_init(&__name_shard[i].lock, NULL);
+		__name_shard[i].tbl = htbl_alloc(__set_name_cmp,
+						 LDMS_SET_SHARD_DEPTH);
+		pthread_rwlock_init(&__id_shard[i].lock, NULL);
+		__id_shard[i].tbl = htbl_alloc(__set_id_cmp,
+					       LDMS_SET_SHARD_DEPTH);
+		if (!__name_shard[i].tbl || !__id_shard[i].tbl) {
+			ovis_log(NULL, OVIS_LCRIT,
+				 "Memory allocation failure in %s\n", __func__);
+			assert(0 == "ENOMEM");
+		}
+	}
+}
+
+static inline struct ldms_set_shard *__name_shard_get(const char *name,
+						      size_t len)
+{
+	pthread_once(&__set_shard_once, __set_shard_init_once);
+	return &__name_shard[fnv_hash_a1_32(name, len, 0) % LDMS_SET_SHARDS];
+}
+
+static inline struct ldms_set_shard *__id_shard_get(uint64_t id)
+{
+	pthread_once(&__set_shard_once, __set_shard_init_once);
+	return &__id_shard[id % LDMS_SET_SHARDS];
+}
+
+/* Caller must hold the set tree lock */
+static void __set_index_ins(struct ldms_set *set)
+{
+	const char *name = get_instance_name(set->meta)->name;
+	size_t len = strlen(name) + 1;
+	struct ldms_set_shard *shard;
+
+	hent_init(&set->name_ent, name, len);
+	shard = __name_shard_get(name, len);
+	pthread_rwlock_wrlock(&shard->lock);
+	htbl_ins(shard->tbl, &set->name_ent);
+	pthread_rwlock_unlock(&shard->lock);
+
+	hent_init(&set->id_ent, &set->set_id, sizeof(set->set_id));
+	shard = __id_shard_get(set->set_id);
+	pthread_rwlock_wrlock(&shard->lock);
+	htbl_ins(shard->tbl, &set->id_ent);
+	pthread_rwlock_unlock(&shard->lock);
+}
+
+/* Caller must hold the set tree lock */
+static void __set_index_del(struct ldms_set *set)
+{
+	struct ldms_set_shard *shard;
+
+	shard = __name_shard_get(set->name_ent.key, set->name_ent.key_len);
+	pthread_rwlock_wrlock(&shard->lock);
+	htbl_del(shard->tbl, &set->name_ent);
+	pthread_rwlock_unlock(&shard->lock);
+
+	shard = __id_shard_get(set->set_id);
+	pthread_rwlock_wrlock(&shard->lock);
+	htbl_del(shard->tbl, &set->id_ent);
+	pthread_rwlock_unlock(&shard->lock);
+}
+
 static struct rbt __del_tree = {
 	.root = NULL,
 	.comparator = id_comparator
@@ -171,6 +276,104 @@ int ldms_set_deleting_count()
 
 static pthread_mutex_t __del_tree_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Directory generation
+ *
+ * __dir_gn is bumped whenever a set is added to or removed from the set
+ * tree, or the set-info of a published set changes. The generation
+ * starts at the process start time in the upper 32 bits, so that a
+ * generation handed out by a previous instance of this process is older
+ * than __dir_gn_floor and cannot be mistaken for one of ours.
+ *
+ * Deleted set names are remembered with the generation of the deletion
+ * so that an incremental dir can report them. Only the most recent
+ * LDMS_DIR_TOMBSTONE_MAX are kept; __dir_gn_floor is the oldest
+ * generation an incremental dir can start from. The tombstones are
+ * protected by the set tree lock.
+ */
+struct ldms_dir_tombstone {
+	uint64_t gn;
+	uid_t uid;
+	gid_t gid;
+	uint32_t perm;
+	TAILQ_ENTRY(ldms_dir_tombstone) entry;
+	char name[OVIS_FLEX];
+};
+static TAILQ_HEAD(__dir_tomb_head, ldms_dir_tombstone) __dir_tomb_list =
+			TAILQ_HEAD_INITIALIZER(__dir_tomb_list);
+static int __dir_tomb_count;
+static uint64_t __dir_gn;
+static uint64_t __dir_gn_floor;
+static pthread_once_t __dir_gn_once = PTHREAD_ONCE_INIT;
+
+static void __dir_gn_init_once(void)
+{
+	__dir_gn = __dir_gn_floor = (uint64_t)time(NULL) << 32;
+}
+
+uint64_t __ldms_dir_gn_next(void)
+{
+	pthread_once(&__dir_gn_once, __dir_gn_init_once);
+	return __sync_add_and_fetch(&__dir_gn, 1);
+}
+
+uint64_t __ldms_dir_gn(void)
+{
+	pthread_once(&__dir_gn_once, __dir_gn_init_once);
+	return __sync_add_and_fetch(&__dir_gn, 0);
+}
+
+int __ldms_dir_gn_valid(uint64_t gn)
+{
+	return (gn >= __dir_gn_floor && gn <= __ldms_dir_gn());
+}
+
+/* Caller must hold the ldms set tree lock. */
+static void __dir_tombstone_add(struct ldms_set *set)
+{
+	struct ldms_dir_tombstone *t;
+	ldms_name_t name = get_instance_name(set->meta);
+	uint64_t gn = __ldms_dir_gn_next();
+
+	if (__dir_tomb_count >= LDMS_DIR_TOMBSTONE_MAX) {
+		t = TAILQ_FIRST(&__dir_tomb_list);
+		TAILQ_REMOVE(&__dir_tomb_list, t, entry);
+		__dir_tomb_count--;
+		__dir_gn_floor = t->gn;
+		free(t);
+	}
+	t = malloc(sizeof(*t) + name->len);
+	if (!t) {
+		/* Incremental dirs cannot start before this deletion */
+		__dir_gn_floor = gn;
+		return;
+	}
+	t->gn = gn;
+	t->uid = __le32_to_cpu(set->meta->uid);
+	t->gid = __le32_to_cpu(set->meta->gid);
+	t->perm = __le32_to_cpu(set->meta->perm);
+	memcpy(t->name, name->name, name->len);
+	TAILQ_INSERT_TAIL(&__dir_tomb_list, t, entry);
+	__dir_tomb_count++;
+}
+
+/* Caller must hold the ldms set tree lock. */
+int __ldms_dir_for_all_tombstones(uint64_t since,
+				  __ldms_dir_tombstone_cb_t cb, void *arg)
+{
+	struct ldms_dir_tombstone *t;
+	int rc;
+
+	TAILQ_FOREACH_REVERSE(t, &__dir_tomb_list, __dir_tomb_head, entry) {
+		if (t->gn <= since)
+			break;
+		rc = cb(t->name, t->uid, t->gid, t->perm, arg);
+		if (rc)
+			return rc;
+	}
+	return 0;
+}
+
 void __ldms_gn_inc(struct ldms_set *set, ldms_mdesc_t desc)
 {
 	if (desc->vd_flags & LDMS_MDESC_F_DATA) {
@@ -181,17 +384,25 @@ void __ldms_gn_inc(struct ldms_set *set, ldms_mdesc_t desc)
 	}
 }
 
-/* Caller must hold the ldms set tree lock. */
+/*
+ * Returns the set with a reference taken on it. The caller does not need
+ * to hold the ldms set tree lock.
+ */
 struct ldms_set *__ldms_find_local_set(const char *set_name)
 {
-	struct rbn *z;
+	struct ldms_set_shard *shard;
 	struct ldms_set *s = NULL;
-
-	z = rbt_find(&__set_tree, (void *)set_name);
-	if (z) {
-		s = container_of(z, struct ldms_set, rb_node);
+	size_t len = strlen(set_name) + 1;
+	hent_t ent;
+
+	shard = __name_shard_get(set_name, len);
+	pthread_rwlock_rdlock(&shard->lock);
+	ent = htbl_find(shard->tbl, set_name, len);
+	if (ent) {
+		s = container_of(ent, struct ldms_set, name_ent);
 		ref_get(&s->ref, __func__);
 	}
+	pthread_rwlock_unlock(&shard->lock);
 	return s;
 }
 
@@ -228,11 +439,7 @@ void __ldms_set_tree_unlock()
 
 ldms_set_t ldms_set_by_name(const char *set_name)
 {
-	struct ldms_set *set;
-	__ldms_set_tree_lock();
-	set = __ldms_find_local_set(set_name);
-	__ldms_set_tree_unlock();
-	return set;
+	return __ldms_find_local_set(set_name);
 }
 
 struct set_mode {
@@ -313,6 +520,78 @@ void ldms_set_data_copy_set(ldms_set_t s, int on)
 		s->flags &= ~LDMS_SET_F_DATA_COPY;
 }
 
+struct ldms_set_snapshot {
+	struct ldms_set set;
+	size_t mem_sz;		/* size of the meta + data memory */
+};
+
+void ldms_set_snapshot_free(ldms_set_t snap)
+{
+	struct ldms_set_snapshot *ss;
+	if (!snap)
+		return;
+	assert(snap->flags & LDMS_SET_F_SNAPSHOT);
+	ss = container_of(snap, struct ldms_set_snapshot, set);
+	free(snap->meta);
+	free(ss);
+}
+
+ldms_set_t ldms_set_snapshot(ldms_set_t s, ldms_set_t snap)
+{
+	struct ldms_set_snapshot *ss;
+	struct ldms_set_hdr *meta;
+	struct ldms_data_hdr *data;
+	size_t meta_sz, data_sz, heap_sz;
+
+	meta_sz = __le32_to_cpu(s->meta->meta_sz);
+	data_sz = __le32_to_cpu(s->meta->data_sz);
+	if (snap) {
+		ss = container_of(snap, struct ldms_set_snapshot, set);
+		if (ss->mem_sz < meta_sz + data_sz) {
+			ldms_set_snapshot_free(snap);
+			snap = NULL;
+		}
+	}
+	if (!snap) {
+		ss = calloc(1, sizeof(*ss));
+		if (!ss)
+			goto enomem;
+		ss->mem_sz = meta_sz + data_sz;
+		ss->set.meta = malloc(ss->mem_sz);
+		if (!ss->set.meta) {
+			free(ss);
+			goto enomem;
+		}
+		snap = &ss->set;
+		LIST_INIT(&snap->local_info);
+		LIST_INIT(&snap->remote_info);
+		snap->flags = LDMS_SET_F_SNAPSHOT;
+	}
+	meta = snap->meta;
+	data = (void *)meta + meta_sz;
+	memcpy(meta, s->meta, meta_sz);
+	memcpy(data, s->data, data_sz);
+	/* The snapshot has exactly one data slot */
+	meta->array_card = __cpu_to_le32(1);
+	data->curr_idx = 0;
+	snap->set_id = s->set_id;
+	snap->curr_idx = 0;
+	snap->data_array = data;
+	snap->data = data;
+	if (s->heap) {
+		heap_sz = data->heap.size;
+		snap->heap = ldms_heap_get(&snap->heap_inst, &data->heap,
+					   (void *)data + data_sz - heap_sz);
+	} else {
+		snap->heap = NULL;
+	}
+	return snap;
+
+ enomem:
+	errno = ENOMEM;
+	return NULL;
+}
+
 struct cb_arg {
 	void *user_arg;
 	int (*user_cb)(struct ldms_set *, void *);
@@ -360,20 +639,9 @@ struct get_set_names_arg {
  */
 
 
-#define STATE_BUF_SZ 4
-#define PERM_BUF_SZ 16
-size_t __ldms_format_set_meta_as_json(struct ldms_set *set,
-				      int need_comma,
-				      char *buf, size_t buf_size)
+void __ldms_format_perm(uint32_t perm, char *buf)
 {
-	size_t cnt;
-	char dbuf[2*LDMS_DIGEST_LENGTH+1];
-	ldms_digest_t digest = ldms_set_digest_get(set);
-
-	/* format perm */
-	uint32_t perm = __le32_to_cpu(set->meta->perm);
-	char perm_str[PERM_BUF_SZ];
-	char *s = perm_str;
+	char *s = buf;
 	int i;
 	*s = '-';
 	s++;
@@ -396,9 +664,10 @@ size_t __ldms_format_set_meta_as_json(struct ldms_set *set,
 		s++;
 	}
 	*s = '\0';
+}
 
-	/* format state flags */
-	char state[STATE_BUF_SZ];
+void __ldms_format_set_state(struct ldms_set *set, char *state)
+{
 	if (set->data->trans.flags == LDMS_TRANSACTION_END)
 		state[0] = 'C';
 	else
@@ -414,6 +683,20 @@ size_t __ldms_format_set_meta_as_json(struct ldms_set *set,
 	else
 		state[2] = ' ';
 	state[3] = '\0';
+}
+
+size_t __ldms_format_set_meta_as_json(struct ldms_set *set,
+				      int need_comma,
+				      char *buf, size_t buf_size)
+{
+	size_t cnt;
+	char dbuf[2*LDMS_DIGEST_LENGTH+1];
+	ldms_digest_t digest = ldms_set_digest_get(set);
+	char perm_str[LDMS_PERM_STR_SZ];
+	char state[LDMS_STATE_STR_SZ];
+
+	__ldms_format_perm(__le32_to_cpu(set->meta->perm), perm_str);
+	__ldms_format_set_state(set, state);
 
 	cnt = snprintf(buf, buf_size,
 		       "%c{"
@@ -549,9 +832,7 @@ __record_set(const char *instance_name,
 	zap_err_t zerr;
 	size_t sz;
 
-	__ldms_set_tree_lock();
 	set = __ldms_find_local_set(instance_name);
-	__ldms_set_tree_unlock();
 	if (set) {
 		ref_put(&set->ref, "__ldms_find_local_set");
 		errno = EEXIST;
@@ -598,6 +879,8 @@ __record_set(const char *instance_name,
 	}
 	rbt_ins(&__set_tree, &set->rb_node);
 	rbt_ins(&__id_tree, &set->id_node);
+	__set_index_ins(set);
+	set->dir_gn = set->dir_add_gn = __ldms_dir_gn_next();
 
  unlock_set_tree:
 	__ldms_set_tree_unlock();
@@ -610,15 +893,20 @@ __record_set(const char *instance_name,
 }
 
 /**
- * Callers must hold the set_tree lock
+ * No reference is taken on the returned set. Callers that need the set
+ * to stay in the set tree must hold the set_tree lock.
  */
 extern struct ldms_set *__ldms_set_by_id(uint64_t id)
 {
+	struct ldms_set_shard *shard = __id_shard_get(id);
 	struct ldms_set *set = NULL;
-	struct rbn *rbn;
-	rbn = rbt_find(&__id_tree, (void *)id);
-	if (rbn)
-		set = container_of(rbn, struct ldms_set, id_node);
+	hent_t ent;
+
+	pthread_rwlock_rdlock(&shard->lock);
+	ent = htbl_find(shard->tbl, &id, sizeof(id));
+	if (ent)
+		set = container_of(ent, struct ldms_set, id_ent);
+	pthread_rwlock_unlock(&shard->lock);
 	return set;
 }
 
@@ -775,6 +1063,49 @@ int ldms_xprt_update(struct ldms_set *set, ldms_update_cb_t cb, void *arg)
 	return rc;
 }
 
+int ldms_xprt_update_batch(ldms_set_t *sets, int n, ldms_update_cb_t cb,
+			   void **cb_args, int *rcs)
+{
+	ldms_t xprt;
+	int i, j, grc, rc = 0;
+
+	if (!cb)
+		return EINVAL;
+
+	i = 0;
+	while (i < n) {
+		if (0 == (sets[i]->flags & LDMS_SET_F_REMOTE)) {
+			rcs[i] = 0;
+			cb(sets[i]->xprt, sets[i], 0, (cb_args?cb_args[i]:NULL));
+			i++;
+			continue;
+		}
+		/* group the consecutive sets on the same transport */
+		for (j = i + 1; j < n; j++) {
+			if (0 == (sets[j]->flags & LDMS_SET_F_REMOTE) ||
+			    sets[j]->xprt != sets[i]->xprt)
+				break;
+		}
+		xprt = ldms_xprt_get(sets[i]->xprt);
+		if (!xprt) {
+			for (; i < j; i++)
+				rcs[i] = EINVAL;
+			if (!rc)
+				rc = EINVAL;
+			continue;
+		}
+		pthread_mutex_lock(&xprt->lock);
+		grc = __ldms_remote_update_batch(xprt, &sets[i], j - i, cb,
+					(cb_args?&cb_args[i]:NULL), &rcs[i]);
+		pthread_mutex_unlock(&xprt->lock);
+		if (grc && !rc)
+			rc = grc;
+		ldms_xprt_put(xprt);
+		i = j;
+	}
+	return rc;
+}
+
 void __ldms_set_on_xprt_term(ldms_set_t set, ldms_t xprt)
 {
 	struct rbn *rbn;
@@ -885,6 +1216,8 @@ void __ldms_set_delete(ldms_set_t s, int notify)
 	}
 	rbt_del(&__set_tree, &s->rb_node);
 	rbt_del(&__id_tree, &s->id_node);
+	__set_index_del(s);
+	__dir_tombstone_add(s);
 	__ldms_set_tree_unlock();
 
 	/* NOTE: We will clean up the push and lookup collections
@@ -961,7 +1294,13 @@ int ldms_xprt_lookup(ldms_t x, const char *path, enum ldms_lookup_flags flags,
 
 int ldms_xprt_dir(ldms_t x, ldms_dir_cb_t cb, void *cb_arg, uint32_t flags)
 {
-	return __ldms_remote_dir(x, cb, cb_arg, flags);
+	return __ldms_remote_dir(x, cb, cb_arg, flags, 0);
+}
+
+int ldms_xprt_dir_since(ldms_t x, ldms_dir_cb_t cb, void *cb_arg,
+			uint32_t flags, uint64_t gn)
+{
+	return __ldms_remote_dir(x, cb, cb_arg, flags, gn);
 }
 
 int ldms_xprt_dir_cancel(ldms_t x)
@@ -580,6 +580,8 @@ typedef void (*ldms_lookup_cb_t)(ldms_t t, enum ldms_lookup_status status,
 #define LDMS_SET_F_REMOTE	0x0008
 #define LDMS_SET_F_PUSH_CHANGE	0x0010
 #define LDMS_SET_F_DATA_COPY	0x0020 /* set array data copy on transaction begin */
+#define LDMS_SET_F_SNAPSHOT	0x0040 /* private copy from ldms_set_snapshot() */
+#define LDMS_SET_F_DELTA	0x0080 /* data updates may be delta-encoded */
 #define LDMS_SET_F_PUBLISHED	0x100000 /* Set is in the set tree. */
 #define LDMS_SET_ID_DATA	0x1000000
 
@@ -688,6 +690,20 @@ const char *ldms_xprt_type_name(ldms_t x);
  */
 void ldms_xprt_priority_set(ldms_t x, int prio);
 
+/**
+ * \brief Pin the ldms transport to its IO thread
+ *
+ * The endpoints of the transports are periodically moved from busy IO
+ * threads to less busy ones. A pinned transport stays on the IO thread
+ * that it was assigned to when it connected.
+ *
+ * A non-zero value for the \c pinned argument pins the transport.
+ *
+ * \param x	The transport handle
+ * \param pinned	The pinned flag
+ */
+void ldms_xprt_pinned_set(ldms_t x, int pinned);
+
 enum ldms_xprt_event_type {
 	/*! A new connection is established */
 	LDMS_XPRT_EVENT_CONNECTED,
@@ -703,9 +719,18 @@ enum ldms_xprt_event_type {
 	LDMS_XPRT_EVENT_SET_DELETE,
 	/*! A send request is completed */
 	LDMS_XPRT_EVENT_SEND_COMPLETE,
+	/*! Receive a stream message, see ldms_xprt_stream_send() */
+	LDMS_XPRT_EVENT_STREAM,
 	LDMS_XPRT_EVENT_LAST
 };
 
+struct ldms_xprt_stream_data {
+	char *data;		/*! The message data, \c data_len bytes */
+	const char *name;	/*! The stream name */
+	uint32_t type;		/*! The stream payload type */
+	uint32_t flags;		/*! LDMS_STREAM_F_* flags from the sender */
+};
+
 struct ldms_xprt_set_delete_data {
 	ldms_set_t set;		/*! The local set looked up at peer */
 	const char *name;	/*! The name of the set */
@@ -724,6 +749,7 @@ typedef struct ldms_xprt_event {
 		 */
 		char *data;
 		struct ldms_xprt_set_delete_data set_delete;
+		struct ldms_xprt_stream_data stream;
 	};
 	size_t data_len;
 } *ldms_xprt_event_t;
@@ -878,6 +904,77 @@ extern int ldms_xprt_send(ldms_t x, char *msg_buf, size_t msg_len);
  */
 size_t ldms_xprt_msg_max(ldms_t x);
 
+/**
+ * \brief Accept stream messages on the transport
+ *
+ * Must be called before ldms_xprt_connect() or ldms_xprt_listen(). The
+ * transport then advertises that it accepts stream messages, and the
+ * transports accepted by a listening transport inherit the setting.
+ * Received messages are delivered to the event callback as
+ * LDMS_XPRT_EVENT_STREAM events. The \c stream.data buffer is owned by
+ * ldms and is only valid until the callback returns.
+ *
+ * \param x The transport handle
+ */
+void ldms_xprt_stream_recv_enable(ldms_t x);
+
+/**
+ * \brief Query if the peer accepts stream messages
+ *
+ * \param x The connected transport handle
+ * \retval !0 if ldms_xprt_stream_send() may be used on \c x
+ */
+int ldms_xprt_stream_supported(ldms_t x);
+
+/*! The sender asks the receiving application to acknowledge the message */
+#define LDMS_STREAM_F_ACK	0x1
+
+/**
+ * \brief Send a stream message to the peer
+ *
+ * The message is sent with a compact binary header and the data is
+ * gathered directly from \c data; messages larger than the transport
+ * message size are fragmented and reassembled by the peer.
+ *
+ * The number of bytes in flight to the peer is limited by the
+ * LDMS_STREAM_CREDIT window. EAGAIN is returned when the peer has not
+ * yet consumed enough of the previous messages, and the caller may
+ * retry later or drop the message.
+ *
+ * \param x	The transport handle
+ * \param name	The stream name
+ * \param type	The stream payload type, an application defined value
+ *		less than 256
+ * \param flags	LDMS_STREAM_F_* flags, passed on to the receiver
+ * \param data	The message data
+ * \param data_len The length of \c data in bytes
+ *
+ * \retval 0		The message was queued for sending
+ * \retval ENOTCONN	The transport is not connected
+ * \retval ENOTSUP	The peer does not accept stream messages
+ * \retval EAGAIN	The credit window is exhausted
+ * \retval errno	Other errors
+ */
+int ldms_xprt_stream_send(ldms_t x, const char *name, uint8_t type,
+			  uint8_t flags, const char *data, size_t data_len);
+
+/**
+ * \brief Send a stream message, waiting for the credit window
+ *
+ * The same as ldms_xprt_stream_send() except that when the credit window
+ * is exhausted the caller waits up to \c timeout_ms milliseconds for the
+ * peer to return credit. A \c timeout_ms of zero or less does not wait.
+ *
+ * \retval 0		The message was queued for sending
+ * \retval ETIMEDOUT	The window did not open within \c timeout_ms
+ * \retval ENOTCONN	The transport is not connected or disconnected
+ *			while waiting
+ * \retval errno	Other errors, see ldms_xprt_stream_send()
+ */
+int ldms_xprt_stream_send_wait(ldms_t x, const char *name, uint8_t type,
+			       uint8_t flags, const char *data,
+			       size_t data_len, int timeout_ms);
+
 /** \} */
 
 /**
@@ -970,6 +1067,14 @@ typedef struct ldms_dir_s {
 	/** count of sets in the set_name array */
 	int set_count;
 
+	/**
+	 * The directory generation of the peer when this directory was
+	 * produced, or 0 if the peer does not support incremental
+	 * directories or this is an LDMS_DIR_F_NOTIFY update. See
+	 * ldms_xprt_dir_since().
+	 */
+	uint64_t gn;
+
 	/** Array of ldms_dir_set_s structures */
 	struct ldms_dir_set_s set_data[OVIS_FLEX];
 
@@ -1032,8 +1137,41 @@ int ldms_xprt_dir_cancel(ldms_t t);
  * \returns	0 if the query was submitted successfully
  */
 #define LDMS_DIR_F_NOTIFY	1
+#define LDMS_DIR_F_JSON		2 /*! Use the JSON encoding even if the peer
+				   *  supports the binary one */
 extern int ldms_xprt_dir(ldms_t x, ldms_dir_cb_t cb, void *cb_arg, uint32_t flags);
 
+/**
+ * \brief Query the sets that changed on the peer since a generation.
+ *
+ * Like ldms_xprt_dir(), but only the changes since the directory
+ * generation \c gn are returned. \c gn is the \c gn member of an
+ * ldms_dir_s previously returned by the same peer. The changes are
+ * delivered as LDMS_DIR_DEL, LDMS_DIR_ADD and LDMS_DIR_UPD directories,
+ * deletions first. A set may be reported more than once if it changes
+ * while the directory is being produced.
+ *
+ * If \c gn is 0, is too old for the peer to have kept track of the
+ * deletions since then, or comes from a previous instance of the peer,
+ * a complete LDMS_DIR_LIST directory is returned instead. Peers that do
+ * not support the binary directory encoding, and requests with
+ * LDMS_DIR_F_JSON, always get a complete list with \c gn 0.
+ *
+ * Incremental directories track set creation, deletion and set-info
+ * changes; the meta and data generation numbers and timestamps of the
+ * returned sets are current, but a change in those alone does not make
+ * a set part of an incremental directory.
+ *
+ * \param x	 The transport handle
+ * \param cb	 The callback function
+ * \param cb_arg A user context for \c cb
+ * \param flags	 LDMS_DIR_F_NOTIFY and/or LDMS_DIR_F_JSON
+ * \param gn	 The directory generation to start from
+ * \returns	0 if the query was submitted successfully
+ */
+extern int ldms_xprt_dir_since(ldms_t x, ldms_dir_cb_t cb, void *cb_arg,
+			       uint32_t flags, uint64_t gn);
+
 #define LDMS_XPRT_LIBPATH_DEFAULT PLUGINDIR
 #define LDMS_DEFAULT_PORT	LDMSDPORT
 #define LDMS_LOOKUP_PATH_MAX	511
@@ -1043,6 +1181,7 @@ enum ldms_lookup_flags {
 	LDMS_LOOKUP_BY_SCHEMA = 1,
 	LDMS_LOOKUP_RE = 2,
 	LDMS_LOOKUP_SET_INFO = 4,
+	LDMS_LOOKUP_DELTA = 8,
 };
 
 /**
@@ -1070,6 +1209,10 @@ enum ldms_lookup_flags {
  * - LDMS_LOOKUP_RE The name parameter is a regular expression
  * - LDMS_LOOKUP_BY_INSTANCE The <tt>name</tt> refers to the set instance
  * - LDMS_LOOKUP_BY_SCHEMA The <tt>name</tt> refers to the set schema
+ * - LDMS_LOOKUP_DELTA Update the data of the set(s) with delta-encoded
+ *   transfers if the transport and the peer support them, i.e. only the
+ *   values that changed since the previous update are transferred. The
+ *   peer falls back to full transfers otherwise.
  *
  * See the ldms_xprt_dir() function for detail on how to query a host for
  * the list of published metric sets.
@@ -1134,6 +1277,32 @@ typedef void (*ldms_update_cb_t)(ldms_t t, ldms_set_t s, int flags, void *arg);
  */
 extern int ldms_xprt_update(ldms_set_t s, ldms_update_cb_t update_cb, void *arg);
 
+/**
+ * \brief Update the contents of many metric sets.
+ *
+ * Updates the local copies of the metric sets in \c sets. The reads of
+ * consecutive sets that share a transport are posted to the transport
+ * together, so that a transport that supports vectored reads (e.g. sock)
+ * issues a single request for the whole group instead of one request per
+ * set. The \c update_cb is called once for every set exactly as if
+ * ldms_xprt_update() had been called on it.
+ *
+ * \param sets	 The array of metric set handles to update.
+ * \param n	 The number of entries in \c sets.
+ * \param update_cb The function to call when the update of a set has
+ *		    completed. It must not be NULL.
+ * \param cb_args An array of \c n callback arguments; \c cb_args[i] is
+ *		  given to \c update_cb for \c sets[i]. May be NULL.
+ * \param rcs	 An array of \c n return codes; \c rcs[i] is set to 0 if the
+ *		 update of \c sets[i] was posted, or to an errno otherwise. The
+ *		 \c update_cb is not called for the sets that failed to post.
+ * \returns	 0 if all the updates were posted, or the first error
+ *		 encountered.
+ */
+extern int ldms_xprt_update_batch(ldms_set_t *sets, int n,
+				  ldms_update_cb_t update_cb, void **cb_args,
+				  int *rcs);
+
 #define LDMS_XPRT_PUSH_F_CHANGE	1
 /**
  * \brief Register a remote set for push notifications
@@ -1976,6 +2145,38 @@ uint64_t ldms_set_heap_size_get(ldms_set_t s);
  */
 void ldms_set_data_copy_set(ldms_set_t s, int on_n_off);
 
+/**
+ * \brief Take a private, point-in-time copy of a set
+ *
+ * The snapshot holds a copy of the set meta-data and of the current data
+ * slot (including the heap). It is not published, has no transport
+ * association and is not affected by subsequent updates of \c s, so it can
+ * be handed to another thread (e.g. a storage worker) and read there with
+ * the usual \c ldms_metric_* and \c ldms_list_* accessors.
+ *
+ * If \c snap is not \c NULL, it must be a snapshot previously returned by
+ * this function. Its memory is reused when it is large enough to hold the
+ * image of \c s; otherwise it is released and a new snapshot is allocated.
+ *
+ * The caller must make sure that \c s is not being updated concurrently,
+ * e.g. by calling this function from the update completion callback.
+ *
+ * \param s    The \c ldms_set_t handle of the source set.
+ * \param snap A snapshot to reuse, or \c NULL.
+ *
+ * \retval snapshot The snapshot handle.
+ * \retval NULL     If there is not enough memory; \c errno is set and
+ *                  \c snap (if any) is released.
+ */
+ldms_set_t ldms_set_snapshot(ldms_set_t s, ldms_set_t snap);
+
+/**
+ * \brief Release a set snapshot
+ *
+ * \param snap The snapshot handle returned by \c ldms_set_snapshot().
+ */
+void ldms_set_snapshot_free(ldms_set_t snap);
+
 /** \} */
 
 /**
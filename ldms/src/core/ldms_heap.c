@@ -52,6 +52,7 @@
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -118,6 +119,8 @@ static int heap_stat(struct rrbn *rbn, void *fn_data, int level)
 	return 0;
 }
 
+static void __sc_stat(ldms_heap_t heap, ldms_heap_info_t info);
+
 uint64_t ldms_heap_off(ldms_heap_t h, void *p)
 {
 	uint64_t off;
@@ -149,6 +152,7 @@ void ldms_heap_get_info(ldms_heap_t heap, ldms_heap_info_t info)
 
 	info->smallest = heap->data->size + 1;
 	rrbt_traverse(heap->addr_tree, heap_stat, info);
+	__sc_stat(heap, info);
 
 	pthread_mutex_unlock(&heap->lock);
 }
@@ -163,6 +167,21 @@ static void get_pow2(size_t n, size_t *pow2, size_t *bits)
 	*bits = _bits;
 }
 
+static int __sc_enable;
+static pthread_once_t __sc_once = PTHREAD_ONCE_INIT;
+
+static void __sc_init_once(void)
+{
+	char *s = getenv("LDMS_HEAP_SIZE_CLASS");
+	__sc_enable = (s ? atoi(s) : 0);
+}
+
+void ldms_heap_size_class_enable(int enable)
+{
+	pthread_once(&__sc_once, __sc_init_once);
+	__sc_enable = enable;
+}
+
 size_t ldms_heap_grain_size(size_t grain_sz)
 {
 	return ((grain_sz > sizeof(struct mm_free)) ? grain_sz : sizeof(struct mm_free));
@@ -185,6 +204,9 @@ void ldms_heap_init(struct ldms_heap *heap, void *base, size_t size, size_t grai
 
 	heap->size = size;
 	heap->gn = 0;
+	heap->sc_table = 0;
+	pthread_once(&__sc_once, __sc_init_once);
+	heap->flags = (__sc_enable ? LDMS_HEAP_F_SIZE_CLASS : 0);
 
 	/* Inialize the size and address r-b trees */
 	rrbt_init(&heap->size_tree);
@@ -234,18 +256,14 @@ size_t ldms_heap_alloc_size(size_t grain_sz, size_t data_sz)
 	return MMR_ROUNDUP(data_sz, ldms_heap_grain_size(grain_sz));
 }
 
-void *ldms_heap_alloc(ldms_heap_t heap, size_t size)
+/* Allocate \c count grains from the trees; the heap lock is held */
+static struct mm_alloc *__heap_alloc(ldms_heap_t heap, uint64_t count)
 {
 	struct mm_free *p, *n;
 	struct mm_alloc *a;
 	struct rrbn *rbn;
-	uint64_t count;
 	uint64_t remainder;
 
-
-	size = ldms_heap_alloc_size(heap->data->grain, size);
-	count = size >> heap->data->grain_bits;
-
 #if LDMS_HEAP_DEBUG
 	printf("------- %p: heap_alloc(%ld) -- start\n", heap, count);
 	printf("                         ---size tree ----\n");
@@ -256,12 +274,9 @@ void *ldms_heap_alloc(ldms_heap_t heap, size_t size)
 	rrbt_print(heap->addr_tree);
 #endif /* LDMS_HEAP_DEBUG */
 
-	pthread_mutex_lock(&heap->lock);
 	rbn = rrbt_find_lub(heap->size_tree, &count);
-	if (!rbn) {
-		pthread_mutex_unlock(&heap->lock);
+	if (!rbn)
 		return NULL;
-	}
 
 	p = container_of(rbn, struct mm_free, size_node);
 
@@ -283,15 +298,15 @@ void *ldms_heap_alloc(ldms_heap_t heap, size_t size)
 	}
 	a = (struct mm_alloc *)p;
 	a->count = count;
-	a += 1;
 #if LDMS_HEAP_DEBUG
 	printf("---%lx (size:%lx[%p], addr:%lx[%p], end:%lx) ---- heap_alloc(%ld) -- end\n",
-			ldms_heap_off(heap, a),
+			ldms_heap_off(heap, a + 1),
 			rrbt_off(heap->size_tree, rbn),
 			rbn,
 			rrbt_off(heap->addr_tree, RRBN(p->addr_node)),
 			&p->addr_node,
-			rrbt_off(heap->addr_tree, RRBN(p->addr_node)) + size,  count);
+			rrbt_off(heap->addr_tree, RRBN(p->addr_node)) + (count << heap->data->grain_bits),
+			count);
 	printf("                         ---size tree ----\n");
 	rrbt_verify(heap->size_tree);
 	rrbt_print(heap->size_tree);
@@ -300,30 +315,26 @@ void *ldms_heap_alloc(ldms_heap_t heap, size_t size)
 	rrbt_print(heap->addr_tree);
 	printf("------------------------------------------\n");
 #endif /* LDMS_HEAP_DEBUG */
-	heap->data->gn++;
-	pthread_mutex_unlock(&heap->lock);
 	return a;
 }
 
-void ldms_heap_free(ldms_heap_t heap, void *d)
+/* Return the chunk \c a to the trees; the heap lock is held */
+static void __heap_free(ldms_heap_t heap, struct mm_alloc *a)
 {
 	uint64_t count;
-	struct mm_alloc *a = d;
 	struct mm_free *p;
 	struct mm_free *q;
 	struct rrbn *rbn;
 	uint64_t offset;
 	uint64_t end;
 
-	a--;
 	p = (void *)a;
-	pthread_mutex_lock(&heap->lock);
 	offset = ldms_heap_off(heap, p);
 	count = a->count;
 #if LDMS_HEAP_DEBUG
 	printf("------- %p: heap_free(%lx, %ld) -- start\n",
 			heap,
-			ldms_heap_off(heap, d),
+			ldms_heap_off(heap, a + 1),
 			count);
 	rbn = rrbt_find_glb(heap->addr_tree, &offset);
 	if (rbn) {
@@ -381,11 +392,8 @@ void ldms_heap_free(ldms_heap_t heap, void *d)
 	rrbt_ins(heap->size_tree, RRBN(p->size_node));
 	rrbt_ins(heap->addr_tree, RRBN(p->addr_node));
 
-	/* Modify generation nubmer */
-	heap->data->gn++;
-
 #if LDMS_HEAP_DEBUG
-	printf("------- heap_free(%lx, %ld) -- end\n", ldms_heap_off(heap, d), count);
+	printf("------- heap_free(%lx, %ld) -- end\n", ldms_heap_off(heap, a + 1), count);
 	printf("                         ---size tree ----\n");
 	rrbt_verify(heap->size_tree);
 	rrbt_print(heap->size_tree);
@@ -394,6 +402,163 @@ void ldms_heap_free(ldms_heap_t heap, void *d)
 	rrbt_print(heap->addr_tree);
 	printf("------------------------------------------\n");
 #endif /* LDMS_HEAP_DEBUG */
+}
+
+/*
+ * Size-class free lists
+ *
+ * A freed chunk of up to LDMS_HEAP_SC_COUNT grains is pushed onto the
+ * list for its grain count instead of being coalesced back into the
+ * trees. The chunk keeps its mm_alloc prefix and the lists are linked
+ * by heap offsets, so the heap remains position independent and a peer
+ * sees a cached chunk as ordinary allocated memory. The list heads live
+ * in a table that is itself allocated from the heap the first time a
+ * small chunk is freed; its location is recorded in heap->sc_table.
+ */
+struct mm_sc_chunk {
+	struct mm_alloc hdr;
+	uint32_t pad;
+	uint64_t next;		/* Offset of the next cached chunk, 0 at the end */
+};
+
+struct mm_sc_table {
+	struct mm_alloc hdr;
+	uint32_t pad;
+	uint64_t head[LDMS_HEAP_SC_COUNT + 1]; /* Indexed by grain count */
+};
+
+static struct mm_sc_table *__sc_table(ldms_heap_t heap)
+{
+	uint64_t off;
+	if (!heap->data->sc_table)
+		return NULL;
+	off = offsetof(struct ldms_heap_base, start) +
+		((uint64_t)(heap->data->sc_table - 1) << heap->data->grain_bits);
+	return ldms_heap_ptr(heap, off);
+}
+
+static struct mm_sc_table *__sc_table_new(ldms_heap_t heap)
+{
+	struct mm_sc_table *t;
+	uint64_t count;
+
+	count = ldms_heap_alloc_size(heap->data->grain,
+			sizeof(*t) - sizeof(struct mm_alloc));
+	count >>= heap->data->grain_bits;
+	t = (void *)__heap_alloc(heap, count);
+	if (!t)
+		return NULL;
+	memset(t->head, 0, sizeof(t->head));
+	heap->data->sc_table = ((ldms_heap_off(heap, t) -
+				 offsetof(struct ldms_heap_base, start))
+				>> heap->data->grain_bits) + 1;
+	return t;
+}
+
+/*
+ * Return all cached chunks and the table to the trees so that they can
+ * be coalesced. Returns non-zero if anything was released.
+ */
+static int __sc_drain(ldms_heap_t heap)
+{
+	struct mm_sc_table *t = __sc_table(heap);
+	struct mm_sc_chunk *c;
+	int i;
+
+	if (!t)
+		return 0;
+	for (i = 1; i <= LDMS_HEAP_SC_COUNT; i++) {
+		while (t->head[i]) {
+			c = ldms_heap_ptr(heap, t->head[i]);
+			t->head[i] = c->next;
+			__heap_free(heap, &c->hdr);
+		}
+	}
+	heap->data->sc_table = 0;
+	__heap_free(heap, &t->hdr);
+	return 1;
+}
+
+static void __sc_stat(ldms_heap_t heap, ldms_heap_info_t info)
+{
+	struct mm_sc_table *t = __sc_table(heap);
+	struct mm_sc_chunk *c;
+	int i;
+
+	if (!t)
+		return;
+	for (i = 1; i <= LDMS_HEAP_SC_COUNT; i++) {
+		for (c = ldms_heap_ptr(heap, t->head[i]); c;
+		     c = ldms_heap_ptr(heap, c->next)) {
+			info->sc_chunks++;
+			info->free_chunks++;
+			info->free_bytes += i;
+			if (i < info->smallest)
+				info->smallest = i;
+			if (i > info->largest)
+				info->largest = i;
+		}
+	}
+}
+
+void *ldms_heap_alloc(ldms_heap_t heap, size_t size)
+{
+	struct mm_sc_table *t;
+	struct mm_sc_chunk *c;
+	struct mm_alloc *a;
+	uint64_t count;
+
+	size = ldms_heap_alloc_size(heap->data->grain, size);
+	count = size >> heap->data->grain_bits;
+
+	pthread_mutex_lock(&heap->lock);
+	if (count <= LDMS_HEAP_SC_COUNT) {
+		t = __sc_table(heap);
+		if (t && t->head[count]) {
+			c = ldms_heap_ptr(heap, t->head[count]);
+			t->head[count] = c->next;
+			a = &c->hdr;
+			assert(a->count == count);
+			goto out;
+		}
+	}
+	a = __heap_alloc(heap, count);
+	if (!a && __sc_drain(heap))
+		a = __heap_alloc(heap, count);
+	if (!a) {
+		pthread_mutex_unlock(&heap->lock);
+		return NULL;
+	}
+ out:
+	heap->data->gn++;
+	pthread_mutex_unlock(&heap->lock);
+	return a + 1;
+}
+
+void ldms_heap_free(ldms_heap_t heap, void *d)
+{
+	struct mm_alloc *a = d;
+	struct mm_sc_table *t;
+	struct mm_sc_chunk *c;
+
+	a--;
+	pthread_mutex_lock(&heap->lock);
+	if (a->count <= LDMS_HEAP_SC_COUNT
+	    && (heap->data->flags & LDMS_HEAP_F_SIZE_CLASS)) {
+		t = __sc_table(heap);
+		if (!t)
+			t = __sc_table_new(heap);
+		if (t) {
+			c = (void *)a;
+			c->next = t->head[a->count];
+			t->head[a->count] = ldms_heap_off(heap, c);
+			goto out;
+		}
+	}
+	__heap_free(heap, a);
+ out:
+	/* Modify generation nubmer */
+	heap->data->gn++;
 	pthread_mutex_unlock(&heap->lock);
 }
 
@@ -60,14 +60,29 @@ typedef struct ldms_heap_info {
 	size_t free_bytes;	/*< number of unallocated grains current */
 	size_t largest;		/*< largest unallocated chunk size in grains */
 	size_t smallest;	/*< smallest unallocated chunk size in grains */
+	size_t sc_chunks;	/*< number of free chunks on size-class lists */
 } *ldms_heap_info_t;
 #define LDMS_HEAP_MIN_SIZE 512
 
+/*
+ * Chunks of up to LDMS_HEAP_SC_COUNT grains are kept on per-size-class
+ * free lists when the heap was initialized with LDMS_HEAP_F_SIZE_CLASS.
+ */
+#define LDMS_HEAP_SC_COUNT 8
+#define LDMS_HEAP_F_SIZE_CLASS 0x1
+
+/*
+ * NB: sc_table and flags occupy what used to be alignment padding, so
+ * the layout (and the wire format of the set data) is unchanged. Peers
+ * never walk the heap; they only follow offsets into it.
+ */
 struct ldms_heap {
 	uint32_t grain_bits:8;
 	uint32_t grain:24;	/* Minimum allocation size and alignment */
+	uint32_t sc_table;	/* Size-class table grain index + 1, 0 if none */
 	uint64_t size;		/* Size of the heap in bytes */
 	uint32_t gn;            /* Changes when alloc and free  */
+	uint32_t flags;		/* LDMS_HEAP_F_xxx */
 	struct rrbt size_tree;	/* Tree ordered by size */
 	struct rrbt addr_tree;	/* Tree ordered by addr/offset */
 };
@@ -109,6 +124,20 @@ void ldms_heap_get_info(ldms_heap_t h, ldms_heap_info_t i);
  */
 void ldms_heap_init(struct ldms_heap *heap, void *base, size_t size, size_t grain);
 
+/**
+ * \brief Enable or disable the size-class free lists for new heaps
+ *
+ * When enabled, heaps initialized afterwards by \c ldms_heap_init()
+ * keep freed chunks of up to \c LDMS_HEAP_SC_COUNT grains on
+ * offset-linked free lists inside the heap, so that allocating and
+ * freeing list and record entries of these sizes does not touch the
+ * size and address trees. The default is taken from the
+ * \c LDMS_HEAP_SIZE_CLASS environment variable (disabled if unset).
+ *
+ * \param enable 0 to disable, non-zero to enable.
+ */
+void ldms_heap_size_class_enable(int enable);
+
 /**
  * \brief Gets a handle to the heap at the specified base address
  *
@@ -55,6 +55,7 @@
 #include <openssl/evp.h>
 #include "ovis_util/os_util.h"
 #include "ovis_ref/ref.h"
+#include "coll/htbl.h"
 #include "ldms_heap.h"
 #include "ldms.h"
 
@@ -132,6 +133,8 @@ struct ldms_set {
 	struct ldms_set_info_list remote_info; /*set info from the lookup operation */
 	struct rbn rb_node;	/* Indexed by instance name */
 	struct rbn id_node;	/* Indexed by set_id */
+	struct hent name_ent;	/* Sharded name index entry */
+	struct hent id_ent;	/* Sharded set_id index entry */
 	struct rbn del_node;	/* Indexed by timestamp */
 	pthread_mutex_t lock;
 	int curr_idx;
@@ -149,6 +152,8 @@ struct ldms_set {
 	struct ldms_context *notify_ctxt; /* Notify req context */
 	ldms_heap_t heap;
 	struct ldms_heap_instance heap_inst;
+	uint64_t dir_gn;	/* dir generation of the last add or set-info change */
+	uint64_t dir_add_gn;	/* dir generation when the set was added */
 };
 
 /* Convenience macro to roundup a value to a multiple of the _s parameter */
@@ -158,7 +163,8 @@ extern int __ldms_xprt_push(ldms_set_t s, int push_flags);
 extern int __ldms_remote_lookup(ldms_t _x, const char *path,
 				enum ldms_lookup_flags flags,
 				ldms_lookup_cb_t cb, void *cb_arg);
-extern int __ldms_remote_dir(ldms_t x, ldms_dir_cb_t cb, void *cb_arg, uint32_t flags);
+extern int __ldms_remote_dir(ldms_t x, ldms_dir_cb_t cb, void *cb_arg,
+			     uint32_t flags, uint64_t gn);
 extern int __ldms_remote_dir_cancel(ldms_t x);
 extern struct ldms_set *
 __ldms_create_set(const char *instance_name, const char *schema_name,
@@ -181,6 +187,22 @@ extern int __ldms_get_local_set_list(struct ldms_name_list *head);
 extern void __ldms_empty_name_list(struct ldms_name_list *name_list);
 
 extern void __ldms_dir_update(ldms_set_t set, enum ldms_dir_type t);
+
+/* Directory generation, see ldms_xprt_dir_since() */
+#define LDMS_DIR_TOMBSTONE_MAX	4096
+extern uint64_t __ldms_dir_gn_next(void);
+/* The caller must hold the ldms set tree lock. */
+extern uint64_t __ldms_dir_gn(void);
+extern int __ldms_dir_gn_valid(uint64_t gn);
+typedef int (*__ldms_dir_tombstone_cb_t)(const char *name, uid_t uid,
+					 gid_t gid, uint32_t perm, void *arg);
+extern int __ldms_dir_for_all_tombstones(uint64_t since,
+				__ldms_dir_tombstone_cb_t cb, void *arg);
+
+#define LDMS_PERM_STR_SZ 16
+#define LDMS_STATE_STR_SZ 4
+extern void __ldms_format_perm(uint32_t perm, char *buf);
+extern void __ldms_format_set_state(struct ldms_set *set, char *buf);
 /* format set meta info (not metrics) into buf.
  * \return count of characters added.
  * NOTE: set->lock mutex must be held before this is called.
@@ -200,6 +222,8 @@ extern struct ldms_set *__ldms_local_set_first(void);
 extern struct ldms_set *__ldms_local_set_next(struct ldms_set *);
 
 extern int __ldms_remote_update(ldms_t t, ldms_set_t s, ldms_update_cb_t cb, void *arg);
+extern int __ldms_remote_update_batch(ldms_t t, ldms_set_t *sets, int n,
+				      ldms_update_cb_t cb, void **args, int *rcs);
 extern void __ldms_set_tree_lock();
 extern void __ldms_set_tree_unlock();
 
@@ -56,6 +56,7 @@
 #include <sys/queue.h>
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <endian.h>
 #include <pthread.h>
 #include <dlfcn.h>
 #include <assert.h>
@@ -118,6 +119,7 @@ static char *xprt_event_type_names[] = {
 	[LDMS_XPRT_EVENT_RECV] = "RECV",
 	[LDMS_XPRT_EVENT_SET_DELETE] = "SET_DELETE",
 	[LDMS_XPRT_EVENT_SEND_COMPLETE] = "SEND_COMPLETE",
+	[LDMS_XPRT_EVENT_STREAM] = "STREAM",
 };
 
 const char *ldms_xprt_event_type_to_str(enum ldms_xprt_event_type t)
@@ -478,6 +480,333 @@ static void send_req_notify_reply(struct ldms_xprt *x,
 	return;
 }
 
+/*
+ * Binary directory encoding
+ *
+ * A dir_bin accumulates set entries, set-info pairs and strings for one
+ * message of at most `max` payload bytes. Strings are interned through
+ * a small open-addressed table so that a schema name or set-info pair
+ * shared by many sets is sent once per message.
+ */
+#define DIR_BIN_STR_SLOTS	4096
+#define DIR_BIN_STR_PROBE	32
+
+struct dir_bin {
+	enum ldms_dir_type type;
+	size_t max;		/* maximum payload size */
+	uint64_t gn;		/* directory generation sent to the peer */
+	uint32_t set_count;
+	uint32_t set_alloc;
+	uint32_t kv_count;
+	uint32_t kv_alloc;
+	uint32_t str_len;
+	uint32_t str_alloc;
+	struct ldms_dir_bin_set *sets;
+	struct ldms_dir_bin_kv *kv;
+	char *str;
+	/*
+	 * String offset + 1 of interned strings, 0 if the slot is free.
+	 * Slots referring past str_len are left over from an entry that
+	 * did not fit and are free as well; since offsets only grow
+	 * along a probe sequence, this never hides a valid entry.
+	 */
+	uint32_t str_slot[DIR_BIN_STR_SLOTS];
+};
+
+struct dir_bin_msg {
+	TAILQ_ENTRY(dir_bin_msg) entry;
+	size_t len;
+	char data[OVIS_FLEX];	/* struct ldms_reply */
+};
+TAILQ_HEAD(dir_bin_msg_list, dir_bin_msg);
+
+static struct dir_bin *dir_bin_new(enum ldms_dir_type type, size_t max,
+				   uint64_t gn)
+{
+	struct dir_bin *b = calloc(1, sizeof(*b));
+	if (!b)
+		return NULL;
+	b->type = type;
+	b->max = max;
+	b->gn = gn;
+	return b;
+}
+
+static void dir_bin_free(struct dir_bin *b)
+{
+	if (!b)
+		return;
+	free(b->sets);
+	free(b->kv);
+	free(b->str);
+	free(b);
+}
+
+static void dir_bin_reset(struct dir_bin *b)
+{
+	b->set_count = 0;
+	b->kv_count = 0;
+	b->str_len = 0;
+	memset(b->str_slot, 0, sizeof(b->str_slot));
+}
+
+static size_t dir_bin_size(struct dir_bin *b)
+{
+	return sizeof(struct ldms_dir_bin_hdr)
+		+ b->set_count * sizeof(struct ldms_dir_bin_set)
+		+ b->kv_count * sizeof(struct ldms_dir_bin_kv)
+		+ b->str_len;
+}
+
+static int __dir_bin_grow(void **p, uint32_t *alloc, uint32_t need, size_t sz)
+{
+	uint32_t n = (*alloc ? *alloc : 64);
+	void *np;
+	if (need <= *alloc)
+		return 0;
+	while (n < need)
+		n *= 2;
+	np = realloc(*p, n * sz);
+	if (!np)
+		return ENOMEM;
+	*p = np;
+	*alloc = n;
+	return 0;
+}
+
+static int dir_bin_str(struct dir_bin *b, const char *s, uint32_t *off)
+{
+	uint32_t h = 2166136261u;	/* FNV-1a */
+	size_t len;
+	const char *c;
+	uint32_t i, v, slot = 0;
+	int free_slot = -1;
+
+	for (c = s; *c; c++) {
+		h ^= (unsigned char)*c;
+		h *= 16777619u;
+	}
+	len = c - s + 1;
+	for (i = 0; i < DIR_BIN_STR_PROBE; i++) {
+		slot = (h + i) % DIR_BIN_STR_SLOTS;
+		v = b->str_slot[slot];
+		if (!v || v - 1 >= b->str_len) {
+			free_slot = slot;
+			break;
+		}
+		if (0 == strcmp(&b->str[v - 1], s)) {
+			*off = v - 1;
+			return 0;
+		}
+	}
+	if (__dir_bin_grow((void **)&b->str, &b->str_alloc,
+			   b->str_len + len, 1))
+		return ENOMEM;
+	*off = b->str_len;
+	memcpy(&b->str[b->str_len], s, len);
+	b->str_len += len;
+	if (free_slot >= 0)
+		b->str_slot[free_slot] = *off + 1;
+	return 0;
+}
+
+static struct ldms_dir_bin_set *dir_bin_entry(struct dir_bin *b,
+					      enum ldms_dir_type t)
+{
+	struct ldms_dir_bin_set *e;
+	if (__dir_bin_grow((void **)&b->sets, &b->set_alloc,
+			   b->set_count + 1, sizeof(*e)))
+		return NULL;
+	e = &b->sets[b->set_count++];
+	memset(e, 0, sizeof(*e));
+	e->type = htonl(t);
+	return e;
+}
+
+static int dir_bin_kv_add(struct dir_bin *b, struct ldms_set_info_pair *pair)
+{
+	struct ldms_dir_bin_kv *kv;
+	uint32_t k, v;
+	if (__dir_bin_grow((void **)&b->kv, &b->kv_alloc,
+			   b->kv_count + 1, sizeof(*kv)))
+		return ENOMEM;
+	if (dir_bin_str(b, pair->key, &k) || dir_bin_str(b, pair->value, &v))
+		return ENOMEM;
+	kv = &b->kv[b->kv_count++];
+	kv->key = htonl(k);
+	kv->value = htonl(v);
+	return 0;
+}
+
+/*
+ * Append a set to the message. Returns ENOSPC, and leaves the message
+ * as it was, if the set does not fit. The caller must hold the set lock.
+ */
+static int dir_bin_add_set(struct dir_bin *b, enum ldms_dir_type t,
+			   struct ldms_set *set)
+{
+	uint32_t set_count = b->set_count;
+	uint32_t kv_count = b->kv_count;
+	uint32_t str_len = b->str_len;
+	struct ldms_dir_bin_set *e;
+	struct ldms_set_info_pair *info;
+	ldms_digest_t digest;
+	uint32_t off;
+	int rc = ENOMEM;
+
+	e = dir_bin_entry(b, t);
+	if (!e)
+		goto err;
+	if (dir_bin_str(b, get_instance_name(set->meta)->name, &off))
+		goto err;
+	e->inst_name = htonl(off);
+	if (dir_bin_str(b, get_schema_name(set->meta)->name, &off))
+		goto err;
+	e->schema_name = htonl(off);
+	digest = ldms_set_digest_get(set);
+	if (digest) {
+		memcpy(e->digest, digest->digest, LDMS_DIGEST_LENGTH);
+		e->flags = htonl(LDMS_DIR_BIN_F_DIGEST);
+	}
+	__ldms_format_set_state(set, e->state);
+	e->meta_size = htonl(__le32_to_cpu(set->meta->meta_sz));
+	e->data_size = htonl(__le32_to_cpu(set->meta->data_sz));
+	e->heap_size = htonl(__le32_to_cpu(set->meta->heap_sz));
+	e->uid = htonl(__le32_to_cpu(set->meta->uid));
+	e->gid = htonl(__le32_to_cpu(set->meta->gid));
+	e->perm = htonl(__le32_to_cpu(set->meta->perm));
+	e->card = htonl(__le32_to_cpu(set->meta->card));
+	e->array_card = htonl(__le32_to_cpu(set->meta->array_card));
+	e->meta_gn = htobe64(__le64_to_cpu(set->meta->meta_gn));
+	e->data_gn = htobe64(__le64_to_cpu(set->data->gn));
+	e->ts_sec = htonl(__le32_to_cpu(set->data->trans.ts.sec));
+	e->ts_usec = htonl(__le32_to_cpu(set->data->trans.ts.usec));
+	e->dur_sec = htonl(__le32_to_cpu(set->data->trans.dur.sec));
+	e->dur_usec = htonl(__le32_to_cpu(set->data->trans.dur.usec));
+
+	/* Same info as the JSON format: local, then remote not overridden */
+	e->info_idx = htonl(b->kv_count);
+	LIST_FOREACH(info, &set->local_info, entry) {
+		if (dir_bin_kv_add(b, info))
+			goto err;
+	}
+	LIST_FOREACH(info, &set->remote_info, entry) {
+		if (__ldms_set_info_find(&set->local_info, info->key))
+			continue;
+		if (dir_bin_kv_add(b, info))
+			goto err;
+	}
+	e->info_count = htonl(b->kv_count - ntohl(e->info_idx));
+	if (dir_bin_size(b) > b->max) {
+		rc = ENOSPC;
+		goto err;
+	}
+	return 0;
+ err:
+	b->set_count = set_count;
+	b->kv_count = kv_count;
+	b->str_len = str_len;
+	return rc;
+}
+
+/* Append a deleted set, only the name and access are known. */
+static int dir_bin_add_name(struct dir_bin *b, const char *name, uid_t uid,
+			    gid_t gid, uint32_t perm)
+{
+	uint32_t set_count = b->set_count;
+	uint32_t str_len = b->str_len;
+	struct ldms_dir_bin_set *e;
+	uint32_t off;
+	int rc = ENOMEM;
+
+	e = dir_bin_entry(b, LDMS_DIR_DEL);
+	if (!e)
+		goto err;
+	if (dir_bin_str(b, name, &off))
+		goto err;
+	e->inst_name = htonl(off);
+	if (dir_bin_str(b, "", &off))
+		goto err;
+	e->schema_name = htonl(off);
+	memcpy(e->state, "   ", 4);
+	e->uid = htonl(uid);
+	e->gid = htonl(gid);
+	e->perm = htonl(perm);
+	e->info_idx = htonl(b->kv_count);
+	if (dir_bin_size(b) > b->max) {
+		rc = ENOSPC;
+		goto err;
+	}
+	return 0;
+ err:
+	b->set_count = set_count;
+	b->str_len = str_len;
+	return rc;
+}
+
+/* Turn the accumulated entries into a reply message and reset \c b */
+static struct dir_bin_msg *dir_bin_msg_new(struct dir_bin *b, uint32_t cmd)
+{
+	struct dir_bin_msg *m;
+	struct ldms_reply *reply;
+	struct ldms_dir_bin_hdr *hdr;
+	size_t payload = dir_bin_size(b);
+	char *p;
+
+	m = malloc(sizeof(*m) + sizeof(struct ldms_reply_hdr)
+		   + sizeof(struct ldms_dir_reply) + payload);
+	if (!m)
+		return NULL;
+	m->len = sizeof(struct ldms_reply_hdr)
+		+ sizeof(struct ldms_dir_reply) + payload;
+	reply = (struct ldms_reply *)m->data;
+	reply->hdr.xid = 0;
+	reply->hdr.cmd = htonl(cmd);
+	reply->hdr.rc = 0;
+	reply->hdr.len = htonl(m->len);
+	reply->dir.type = htonl(b->type | LDMS_DIR_REPLY_F_BIN);
+	reply->dir.more = 0;
+	reply->dir.json_data_len = htonl(payload);
+	hdr = (struct ldms_dir_bin_hdr *)reply->dir.json_data;
+	hdr->gn = htobe64(b->gn);
+	hdr->set_count = htonl(b->set_count);
+	hdr->kv_count = htonl(b->kv_count);
+	hdr->str_len = htonl(b->str_len);
+	p = (char *)(hdr + 1);
+	memcpy(p, b->sets, b->set_count * sizeof(*b->sets));
+	p += b->set_count * sizeof(*b->sets);
+	memcpy(p, b->kv, b->kv_count * sizeof(*b->kv));
+	p += b->kv_count * sizeof(*b->kv);
+	memcpy(p, b->str, b->str_len);
+	dir_bin_reset(b);
+	return m;
+}
+
+static void dir_bin_msg_list_free(struct dir_bin_msg_list *list)
+{
+	struct dir_bin_msg *m;
+	while ((m = TAILQ_FIRST(list))) {
+		TAILQ_REMOVE(list, m, entry);
+		free(m);
+	}
+}
+
+/* The binary counterpart of __ldms_format_set_for_dir() */
+static struct dir_bin_msg *__dir_bin_format_set(struct ldms_set *set,
+						enum ldms_dir_type t)
+{
+	struct dir_bin_msg *m = NULL;
+	struct dir_bin *b;
+
+	b = dir_bin_new(t, SIZE_MAX, 0);
+	if (!b)
+		return NULL;
+	if (0 == dir_bin_add_set(b, t, set))
+		m = dir_bin_msg_new(b, LDMS_CMD_DIR_UPDATE_REPLY);
+	dir_bin_free(b);
+	return m;
+}
+
 char *__ldms_format_set_for_dir(struct ldms_set *set, size_t *buf_sz)
 {
 	size_t json_buf_sz = 4096;
@@ -500,24 +829,62 @@ char *__ldms_format_set_for_dir(struct ldms_set *set, size_t *buf_sz)
 	return json_buf;
 }
 
+static void send_dir_update_bin(struct ldms_xprt *x, struct dir_bin_msg *m)
+{
+	struct ldms_reply *reply = (struct ldms_reply *)m->data;
+	zap_err_t zerr;
+
+	if (!ldms_xprt_connected(x))
+		return;
+	if (m->len >= ldms_xprt_msg_max(x)) {
+		XPRT_LOG(x, OVIS_LERROR, "Directory message is too large (%lu) "
+				"for the max transport message (%lu).\n",
+				m->len, ldms_xprt_msg_max(x));
+		return;
+	}
+	reply->hdr.xid = x->remote_dir_xid;
+	zerr = zap_send(x->zap_ep, reply, m->len);
+	if (zerr != ZAP_ERR_OK) {
+		x->zerrno = zerr;
+		XPRT_LOG(x, OVIS_LERROR, "%s: x %p: "
+				"zap_send synchronously error. '%s'\n",
+				__func__, x, zap_err_str(zerr));
+		ldms_xprt_close(x);
+	}
+}
+
 static void dir_update(struct ldms_set *set, enum ldms_dir_type t)
 {
-	char *json_buf;
+	char *json_buf = NULL;
 	size_t json_cnt;
+	struct dir_bin_msg *bin_msg = NULL;
 	struct ldms_xprt *x;
-	json_buf = __ldms_format_set_for_dir(set, &json_cnt);
 	pthread_mutex_lock(&xprt_list_lock);
 	LIST_FOREACH(x, &xprt_list, xprt_link) {
+		if (!x->remote_dir_xid)
+			continue;
+		/* Format the set once per encoding, and only if needed */
+		if (x->remote_dir_bin) {
+			if (!bin_msg)
+				bin_msg = __dir_bin_format_set(set, t);
+			if (!bin_msg) {
+				XPRT_LOG(x, OVIS_LCRIT, "%s: memory allocation error\n", __func__);
+				break;
+			}
+			send_dir_update_bin(x, bin_msg);
+			continue;
+		}
+		if (!json_buf)
+			json_buf = __ldms_format_set_for_dir(set, &json_cnt);
 		if (!json_buf) {
 			XPRT_LOG(x, OVIS_LCRIT, "%s: memory allocation error\n", __func__);
 			break;
 		}
-		if (x->remote_dir_xid)
-			send_dir_update(x, t, json_buf, json_cnt);
+		send_dir_update(x, t, json_buf, json_cnt);
 	}
 	pthread_mutex_unlock(&xprt_list_lock);
-	if (json_buf)
-		free(json_buf);
+	free(json_buf);
+	free(bin_msg);
 }
 
 void __ldms_dir_add_set(struct ldms_set *set)
@@ -563,6 +930,7 @@ void __ldms_dir_del_set(struct ldms_set *set)
 
 void __ldms_dir_upd_set(struct ldms_set *set)
 {
+	set->dir_gn = __ldms_dir_gn_next();
 	dir_update(set, LDMS_DIR_UPD);
 }
 
@@ -573,11 +941,93 @@ void ldms_xprt_close(ldms_t x)
 	__ldms_xprt_term(x);
 }
 
+/*
+ * Stream messages that span several fragments are reassembled into
+ * buffers taken from a pool of power-of-two size classes, so that a
+ * steady stream of large messages does not allocate per message.
+ * Buffers larger than the largest class are not cached.
+ */
+#define STREAM_RBUF_MIN_SHIFT	16
+#define STREAM_RBUF_MAX_SHIFT	24
+#define STREAM_RBUF_CLASSES	(STREAM_RBUF_MAX_SHIFT - STREAM_RBUF_MIN_SHIFT + 1)
+#define STREAM_RBUF_CACHE	8	/* free buffers kept per class */
+
+struct ldms_stream_rbuf {
+	uint32_t msg_no;
+	uint32_t data_len;
+	uint32_t recv_len;
+	uint8_t type;
+	uint8_t flags;
+	int cls;		/* size class, -1 if not pooled */
+	char *data;		/* follows the name in buf */
+	LIST_ENTRY(ldms_stream_rbuf) entry;
+	char buf[OVIS_FLEX];	/* name, data and a terminating NUL */
+};
+
+static pthread_mutex_t stream_rbuf_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+	LIST_HEAD(, ldms_stream_rbuf) free_list;
+	int count;
+} stream_rbuf_pool[STREAM_RBUF_CLASSES];
+
+static struct ldms_stream_rbuf *__stream_rbuf_get(size_t sz)
+{
+	struct ldms_stream_rbuf *rbuf;
+	int cls;
+
+	for (cls = 0; cls < STREAM_RBUF_CLASSES; cls++) {
+		if (sz <= (1UL << (cls + STREAM_RBUF_MIN_SHIFT)))
+			break;
+	}
+	if (cls == STREAM_RBUF_CLASSES) {
+		rbuf = malloc(sizeof(*rbuf) + sz);
+		if (rbuf)
+			rbuf->cls = -1;
+		return rbuf;
+	}
+	pthread_mutex_lock(&stream_rbuf_lock);
+	rbuf = LIST_FIRST(&stream_rbuf_pool[cls].free_list);
+	if (rbuf) {
+		LIST_REMOVE(rbuf, entry);
+		stream_rbuf_pool[cls].count--;
+	}
+	pthread_mutex_unlock(&stream_rbuf_lock);
+	if (!rbuf) {
+		rbuf = malloc(sizeof(*rbuf) +
+			      (1UL << (cls + STREAM_RBUF_MIN_SHIFT)));
+		if (!rbuf)
+			return NULL;
+		rbuf->cls = cls;
+	}
+	return rbuf;
+}
+
+static void __stream_rbuf_put(struct ldms_stream_rbuf *rbuf)
+{
+	int cls = rbuf->cls;
+
+	if (cls >= 0) {
+		pthread_mutex_lock(&stream_rbuf_lock);
+		if (stream_rbuf_pool[cls].count < STREAM_RBUF_CACHE) {
+			LIST_INSERT_HEAD(&stream_rbuf_pool[cls].free_list,
+					 rbuf, entry);
+			stream_rbuf_pool[cls].count++;
+			rbuf = NULL;
+		}
+		pthread_mutex_unlock(&stream_rbuf_lock);
+	}
+	free(rbuf);
+}
+
 void __ldms_xprt_resource_free(struct ldms_xprt *x)
 {
 	int drop_ep_ref = 0;
 	pthread_mutex_lock(&x->lock);
 	x->remote_dir_xid = x->local_dir_xid = 0;
+	if (x->stream_rbuf) {
+		__stream_rbuf_put(x->stream_rbuf);
+		x->stream_rbuf = NULL;
+	}
 
 #ifdef DEBUG
 	XPRT_LOG(x, OVIS_LALWAYS, "xprt_resource_free. zap %p: active_dir = %d.\n",
@@ -647,6 +1097,7 @@ void ldms_xprt_put(ldms_t x)
 
 	__ldms_xprt_resource_free(x);
 	sem_destroy(&x->sem);
+	pthread_cond_destroy(&x->stream_credit_cond);
 	if (x->app_ctxt && x->app_ctxt_free_fn)
 		x->app_ctxt_free_fn(x->app_ctxt);
 	free(x);
@@ -661,9 +1112,7 @@ static void process_set_delete_request(struct ldms_xprt *x, struct ldms_request
 	 * Always notify the application about peer set delete. If we happened
 	 * not to have the set yet, `event.set_delete.set` will be NULL.
 	 */
-	__ldms_set_tree_lock();
 	set = __ldms_find_local_set(req->set_delete.inst_name);
-	__ldms_set_tree_unlock();
 	if (set) {
 		if (set->xprt != x) {
 			assert(set->xprt != x);
@@ -713,6 +1162,159 @@ struct make_dir_arg {
 	ssize_t set_list_len;	/* current length of this buffer */
 };
 
+struct dir_bin_walk {
+	struct ldms_xprt *x;
+	uint64_t since;		/* 0 for a complete list */
+	enum ldms_dir_type type;	/* of the sets added by this pass */
+	struct dir_bin *b;
+	struct dir_bin_msg_list msgs;
+};
+
+static int dir_bin_walk_flush(struct dir_bin_walk *w)
+{
+	struct dir_bin_msg *m;
+	m = dir_bin_msg_new(w->b, LDMS_CMD_DIR_REPLY);
+	if (!m)
+		return ENOMEM;
+	TAILQ_INSERT_TAIL(&w->msgs, m, entry);
+	return 0;
+}
+
+static int dir_bin_walk_add(struct dir_bin_walk *w, struct ldms_set *set,
+			    const char *name, uid_t uid, gid_t gid,
+			    uint32_t perm)
+{
+	struct dir_bin *b = w->b;
+	int rc, retry = 1;
+ again:
+	if (set)
+		rc = dir_bin_add_set(b, w->type, set);
+	else
+		rc = dir_bin_add_name(b, name, uid, gid, perm);
+	if (rc != ENOSPC)
+		return rc;
+	if (retry && b->set_count) {
+		/* Send what we have and start a new message */
+		rc = dir_bin_walk_flush(w);
+		if (rc)
+			return rc;
+		retry = 0;
+		goto again;
+	}
+	XPRT_LOG(w->x, OVIS_LERROR, "%s: the directory entry of '%s' does not "
+		 "fit in the max transport message (%lu), skipped.\n", __func__,
+		 set ? get_instance_name(set->meta)->name : name, b->max);
+	return 0;
+}
+
+static int dir_bin_tombstone_cb(const char *name, uid_t uid, gid_t gid,
+				uint32_t perm, void *arg)
+{
+	struct dir_bin_walk *w = arg;
+	if (ldms_access_check(w->x, LDMS_ACCESS_READ, uid, gid, perm))
+		return 0;
+	return dir_bin_walk_add(w, NULL, name, uid, gid, perm);
+}
+
+static int dir_bin_set_cb(struct ldms_set *set, void *arg)
+{
+	struct dir_bin_walk *w = arg;
+	int rc;
+
+	if (w->since) {
+		if (set->dir_gn <= w->since)
+			return 0;
+		if ((set->dir_add_gn > w->since) != (w->type == LDMS_DIR_ADD))
+			return 0;
+	}
+	if (ldms_access_check(w->x, LDMS_ACCESS_READ,
+			      __le32_to_cpu(set->meta->uid),
+			      __le32_to_cpu(set->meta->gid),
+			      __le32_to_cpu(set->meta->perm)))
+		return 0;
+	pthread_mutex_lock(&set->lock);
+	rc = dir_bin_walk_add(w, set, NULL, 0, 0, 0);
+	pthread_mutex_unlock(&set->lock);
+	return rc;
+}
+
+/*
+ * Reply to a dir request in the binary encoding. The directory is
+ * encoded while walking the set tree and sent once the tree lock has
+ * been dropped. An incremental reply lists the deletions, then the
+ * additions, then the updates since w.since, so that a set deleted and
+ * re-created in the meantime ends up present on the peer.
+ */
+static int process_dir_request_bin(struct ldms_xprt *x, struct ldms_request *req,
+				   uint32_t flags)
+{
+	struct dir_bin_walk w;
+	struct dir_bin_msg *m, *next;
+	struct ldms_reply *reply;
+	size_t max;
+	zap_err_t zerr;
+	int rc = 0;
+
+	memset(&w, 0, sizeof(w));
+	w.x = x;
+	TAILQ_INIT(&w.msgs);
+	max = ldms_xprt_msg_max(x) - sizeof(struct ldms_reply_hdr)
+		- sizeof(struct ldms_dir_reply);
+
+	__ldms_set_tree_lock();
+	if ((flags & LDMS_DIR_REQ_F_SINCE) && __ldms_dir_gn_valid(be64toh(req->dir.gn)))
+		w.since = be64toh(req->dir.gn);
+	w.b = dir_bin_new(w.since ? LDMS_DIR_UPD : LDMS_DIR_LIST, max,
+			  __ldms_dir_gn());
+	if (!w.b) {
+		rc = ENOMEM;
+		goto unlock;
+	}
+	if (w.since) {
+		rc = __ldms_dir_for_all_tombstones(w.since, dir_bin_tombstone_cb, &w);
+		if (rc)
+			goto unlock;
+		w.type = LDMS_DIR_ADD;
+		rc = __ldms_for_all_sets(dir_bin_set_cb, &w);
+		if (rc)
+			goto unlock;
+		w.type = LDMS_DIR_UPD;
+	} else {
+		w.type = LDMS_DIR_LIST;
+	}
+	rc = __ldms_for_all_sets(dir_bin_set_cb, &w);
+ unlock:
+	__ldms_set_tree_unlock();
+	if (rc)
+		goto out;
+
+	/* The last message, possibly an empty list or "nothing changed" */
+	if (w.b->set_count || TAILQ_EMPTY(&w.msgs)) {
+		rc = dir_bin_walk_flush(&w);
+		if (rc)
+			goto out;
+	}
+
+	TAILQ_FOREACH(m, &w.msgs, entry) {
+		next = TAILQ_NEXT(m, entry);
+		reply = (struct ldms_reply *)m->data;
+		reply->hdr.xid = req->hdr.xid;
+		reply->dir.more = htonl(next ? 1 : 0);
+		zerr = zap_send(x->zap_ep, reply, m->len);
+		if (zerr != ZAP_ERR_OK) {
+			x->zerrno = zerr;
+			XPRT_LOG(x, OVIS_LERROR, "%s: x %p: "
+				"zap_send synchronous error. '%s'\n",
+			       __FUNCTION__, x, zap_err_str(zerr));
+			break;
+		}
+	}
+ out:
+	dir_bin_msg_list_free(&w.msgs);
+	dir_bin_free(w.b);
+	return rc;
+}
+
 static void process_dir_request(struct ldms_xprt *x, struct ldms_request *req)
 {
 	size_t len;
@@ -725,19 +1327,30 @@ static void process_dir_request(struct ldms_xprt *x, struct ldms_request *req)
 	ldms_stats_entry_t e = &x->stats.ops[LDMS_XPRT_OP_DIR_REP];
 	int64_t dur_us;
 	struct timespec end, start;
+	uint32_t flags;
 
 	(void)clock_gettime(CLOCK_REALTIME, &start);
 
-	if (req->dir.flags)
+	flags = ntohl(req->dir.flags);
+	if (flags & LDMS_DIR_F_NOTIFY) {
 		/* Register for directory updates */
 		x->remote_dir_xid = req->hdr.xid;
-	else
+		x->remote_dir_bin = !!(flags & LDMS_DIR_REQ_F_BIN);
+	} else {
 		/* Cancel any previous dir update */
 		x->remote_dir_xid = 0;
+	}
 
 	hdrlen = sizeof(struct ldms_reply_hdr)
 		+ sizeof(struct ldms_dir_reply);
 
+	if (flags & LDMS_DIR_REQ_F_BIN) {
+		rc = process_dir_request_bin(x, req, flags);
+		if (rc)
+			goto out;
+		goto stats;
+	}
+
 	__ldms_set_tree_lock();
 	rc = __ldms_get_local_set_list(&name_list);
 	__ldms_set_tree_unlock();
@@ -787,9 +1400,7 @@ static void process_dir_request(struct ldms_xprt *x, struct ldms_request *req)
 	}
 	struct ldms_set *set;
 	LIST_FOREACH(name, &name_list, entry) {
-		__ldms_set_tree_lock();
 		set = __ldms_find_local_set(name->name);
-		__ldms_set_tree_unlock();
 		if (!set)
 			continue;
 		uid = __le32_to_cpu(set->meta->uid);
@@ -866,6 +1477,7 @@ static void process_dir_request(struct ldms_xprt *x, struct ldms_request *req)
 	}
 	free(reply);
 	__ldms_empty_name_list(&name_list);
+ stats:
 	(void)clock_gettime(CLOCK_REALTIME, &end);
 	dur_us = ldms_timespec_diff_us(&start, &end);
 	if (e->min_us > dur_us)
@@ -929,6 +1541,138 @@ process_send_request(struct ldms_xprt *x, struct ldms_request *req)
 	x->event_cb(x, &event, x->event_cb_arg);
 }
 
+/*
+ * Return the data bytes of the stream fragments consumed so far to the
+ * peer once they amount to a quarter of the window.
+ */
+static void __stream_credit_return(struct ldms_xprt *x, uint32_t len)
+{
+	struct ldms_request req;
+	size_t req_len;
+	zap_err_t zerr;
+
+	x->stream_consumed += len;
+	if (x->stream_consumed < LDMS_STREAM_CREDIT / 4)
+		return;
+	req_len = sizeof(req.hdr) + sizeof(req.stream_credit);
+	req.hdr.xid = 0;
+	req.hdr.cmd = htonl(LDMS_CMD_STREAM_CREDIT);
+	req.hdr.len = htonl(req_len);
+	req.stream_credit.credit = htonl(x->stream_consumed);
+	x->stream_consumed = 0;
+	zerr = zap_send(x->zap_ep, &req, req_len);
+	if (zerr)
+		XPRT_LOG(x, OVIS_LERROR, "%s: zap_send error '%s'\n",
+			 __func__, zap_err_str(zerr));
+}
+
+static void __stream_deliver(struct ldms_xprt *x, const char *name,
+			     uint8_t type, uint8_t flags,
+			     char *data, uint32_t data_len)
+{
+	struct ldms_xprt_event event;
+
+	if (!x->event_cb)
+		return;
+	event.type = LDMS_XPRT_EVENT_STREAM;
+	event.stream.data = data;
+	event.stream.name = name;
+	event.stream.type = type;
+	event.stream.flags = flags;
+	event.data_len = data_len;
+	x->event_cb(x, &event, x->event_cb_arg);
+}
+
+static void
+process_stream_request(struct ldms_xprt *x, struct ldms_request *req)
+{
+	struct ldms_stream_cmd_param *p = &req->stream;
+	struct ldms_stream_rbuf *rbuf = x->stream_rbuf;
+	uint32_t msg_no = ntohl(p->msg_no);
+	uint32_t data_len = ntohl(p->data_len);
+	uint32_t data_off = ntohl(p->data_off);
+	uint32_t frag_len = ntohl(p->frag_len);
+	uint16_t name_len = ntohs(p->name_len);
+	size_t req_len = ntohl(req->hdr.len);
+	char *data = p->data;
+
+	if (!x->stream_recv)
+		return;
+	if (data_off > data_len || frag_len > data_len - data_off ||
+	    req_len != sizeof(req->hdr) + sizeof(*p) +
+			(data_off ? 0 : name_len) + frag_len ||
+	    (!data_off && (!name_len || p->data[name_len - 1]))) {
+		XPRT_LOG(x, OVIS_LERROR, "Malformed stream message %u\n",
+			 msg_no);
+		/*
+		 * frag_len cannot be trusted; return only the payload the
+		 * message length accounts for, bounded by max_msg, so that a
+		 * bad fragment cannot inflate the sender's credit.
+		 */
+		if (req_len > sizeof(req->hdr) + sizeof(*p) &&
+		    req_len <= x->max_msg)
+			__stream_credit_return(x, req_len - sizeof(req->hdr)
+						  - sizeof(*p));
+		return;
+	}
+
+	if (!data_off) {
+		/* The first fragment of a message, drop any unfinished one */
+		if (rbuf) {
+			XPRT_LOG(x, OVIS_LERROR, "Stream message %u is "
+				 "incomplete\n", rbuf->msg_no);
+			__stream_rbuf_put(rbuf);
+			x->stream_rbuf = NULL;
+		}
+		data += name_len;
+		if (frag_len == data_len) {
+			/* Delivered straight from the receive buffer */
+			__stream_deliver(x, p->data, p->type, p->flags,
+					 data, data_len);
+			goto out;
+		}
+		rbuf = __stream_rbuf_get(name_len + data_len + 1);
+		if (!rbuf) {
+			XPRT_LOG(x, OVIS_LCRITICAL, "Out of memory receiving "
+				 "stream message %u\n", msg_no);
+			goto out;
+		}
+		memcpy(rbuf->buf, p->data, name_len);
+		rbuf->data = rbuf->buf + name_len;
+		rbuf->msg_no = msg_no;
+		rbuf->data_len = data_len;
+		rbuf->recv_len = 0;
+		rbuf->type = p->type;
+		rbuf->flags = p->flags;
+		x->stream_rbuf = rbuf;
+	} else if (!rbuf || rbuf->msg_no != msg_no ||
+		   rbuf->recv_len != data_off) {
+		/* The rest of a message that was dropped */
+		goto out;
+	}
+
+	memcpy(rbuf->data + data_off, data, frag_len);
+	rbuf->recv_len += frag_len;
+	if (rbuf->recv_len < rbuf->data_len)
+		goto out;
+	rbuf->data[rbuf->data_len] = '\0';
+	x->stream_rbuf = NULL;
+	__stream_deliver(x, rbuf->buf, rbuf->type, rbuf->flags,
+			 rbuf->data, rbuf->data_len);
+	__stream_rbuf_put(rbuf);
+ out:
+	__stream_credit_return(x, frag_len);
+}
+
+static void
+process_stream_credit_request(struct ldms_xprt *x, struct ldms_request *req)
+{
+	pthread_mutex_lock(&x->lock);
+	x->stream_credit += ntohl(req->stream_credit.credit);
+	pthread_cond_broadcast(&x->stream_credit_cond);
+	pthread_mutex_unlock(&x->lock);
+}
+
 static int
 process_auth_msg(struct ldms_xprt *x, struct ldms_request *req)
 {
@@ -1360,17 +2104,15 @@ static void process_lookup_request_re(struct ldms_xprt *x, struct ldms_request *
 			goto err_0;
 		}
 	} else if (0 == (flags & LDMS_LOOKUP_BY_SCHEMA)) {
-		__ldms_set_tree_lock();
 		set = __ldms_find_local_set(req->lookup.path);
 		if (!set) {
 			rc = ENOENT;
-			goto err_1;
+			goto err_0;
 		}
-		__ldms_set_tree_unlock();
 		rc = __send_lookup_reply(x, set, req->hdr.xid, 0);
 		ref_put(&set->ref, "__ldms_find_local_set");
 		if (rc)
-			goto err_1;
+			goto err_0;
 		return;
 	}
 
@@ -1440,64 +2182,81 @@ static void process_lookup_request(struct ldms_xprt *x, struct ldms_request *req
 	process_lookup_request_re(x, req, flags);
 }
 
-static int do_read_all(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
+/*
+ * Post the read of \c len bytes at offset \c off of the set memory for
+ * \c ctxt. If \c ent is not NULL, the read is only described in \c ent
+ * so that the caller can post it together with the reads of other sets
+ * (see __ldms_remote_update_batch()).
+ */
+static int do_read_post(ldms_t x, ldms_set_t s, struct ldms_context *ctxt,
+			size_t off, size_t len, int zflags,
+			struct zap_read_ent *ent)
+{
+	struct zap_read_ent _ent;
+	int rc, n;
+
+	assert(x == ctxt->x);
+	if (ent || zflags) {
+		if (!ent)
+			ent = &_ent;
+		ent->src_map = s->rmap;
+		ent->src = zap_map_addr(s->rmap) + off;
+		ent->dst_map = s->lmap;
+		ent->dst = zap_map_addr(s->lmap) + off;
+		ent->sz = len;
+		ent->context = ctxt;
+		ent->flags = zflags;
+		if (ent != &_ent)
+			return 0;
+		rc = zap_read_v(x->zap_ep, ent, 1, &n);
+	} else {
+		rc = zap_read(x->zap_ep, s->rmap, zap_map_addr(s->rmap) + off,
+			      s->lmap, zap_map_addr(s->lmap) + off, len, ctxt);
+	}
+	if (rc) {
+		x->zerrno = rc;
+		__ldms_free_ctxt(x, ctxt);
+	}
+	return zap_zerr2errno(rc);
+}
+
+static int do_read_all(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg,
+		       struct zap_read_ent *ent)
 {
 	/* Read metadata and the first set in the set array in 1 RDMA read. */
 	TF();
 	struct ldms_context *ctxt;
-	int rc;
 	uint32_t len = __le32_to_cpu(s->meta->meta_sz)
 			+ __le32_to_cpu(s->meta->data_sz);
 
 	ctxt = __ldms_alloc_ctxt(x, sizeof(*ctxt), LDMS_CONTEXT_UPDATE,
 				 s, cb, arg, 0, 0);
-	if (!ctxt) {
-		rc = ENOMEM;
-		goto out;
-	}
-	assert(x == ctxt->x);
-	rc = zap_read(x->zap_ep, s->rmap, zap_map_addr(s->rmap),
-		      s->lmap, zap_map_addr(s->lmap), len, ctxt);
-	if (rc) {
-		x->zerrno = rc;
-		__ldms_free_ctxt(x, ctxt);
-	}
-out:
-	return zap_zerr2errno(rc);
+	if (!ctxt)
+		return ENOMEM;
+	return do_read_post(x, s, ctxt, 0, len, 0, ent);
 }
 
-static int do_read_meta(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
+static int do_read_meta(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg,
+			struct zap_read_ent *ent)
 {
 	/* Read only the metadata; the data will be updated separately when the
 	 * metadata read completed. */
 	TF();
 	struct ldms_context *ctxt;
-	int rc;
 	uint32_t meta_sz = __le32_to_cpu(s->meta->meta_sz);
 
 	ctxt = __ldms_alloc_ctxt(x, sizeof(*ctxt), LDMS_CONTEXT_UPDATE_META,
 							s, cb, arg, 0, 0);
-	if (!ctxt) {
-		rc = ENOMEM;
-		goto out;
-	}
-	assert(x == ctxt->x);
-	rc = zap_read(x->zap_ep, s->rmap, zap_map_addr(s->rmap),
-			s->lmap, zap_map_addr(s->lmap), meta_sz, ctxt);
-	if (rc) {
-		x->zerrno = rc;
-		__ldms_free_ctxt(x, ctxt);
-	}
-out:
-	return zap_zerr2errno(rc);
+	if (!ctxt)
+		return ENOMEM;
+	return do_read_post(x, s, ctxt, 0, meta_sz, 0, ent);
 }
 
 static int do_read_data(ldms_t x, ldms_set_t s, int idx_from, int idx_to,
-			ldms_update_cb_t cb, void*arg)
+			ldms_update_cb_t cb, void*arg, struct zap_read_ent *ent)
 {
 	/* Read multiple set data in the set array from `idx_from` to `idx_to`
 	 * (inclusive) in 1 RDMA read. */
-	int rc;
 	uint32_t data_sz;
 	struct ldms_context *ctxt;
 	size_t doff, dlen;
@@ -1506,25 +2265,17 @@ static int do_read_data(ldms_t x, ldms_set_t s, int idx_from, int idx_to,
 	ctxt = __ldms_alloc_ctxt(x, sizeof(*ctxt), LDMS_CONTEXT_UPDATE,
 						s, cb, arg, idx_from, idx_to);
 
-	if (!ctxt) {
-		rc = ENOMEM;
-		goto out;
-	}
+	if (!ctxt)
+		return ENOMEM;
 	data_sz = __le32_to_cpu(s->meta->data_sz);
 	doff = (uint8_t *)s->data_array - (uint8_t *)s->meta
 							+ idx_from * data_sz;
 	dlen = (idx_to - idx_from + 1) * data_sz;
 
-	assert(x == ctxt->x);
-	rc = zap_read(x->zap_ep, s->rmap, zap_map_addr(s->rmap) + doff,
-		      s->lmap, zap_map_addr(s->lmap) + doff, dlen, ctxt);
-	if (rc) {
-		x->zerrno = rc;
-		rc = zap_zerr2errno(rc);
-		__ldms_free_ctxt(x, ctxt);
-	}
-out:
-	return rc;
+	/* only the data changes from one update to the next */
+	return do_read_post(x, s, ctxt, doff, dlen,
+			    (s->flags & LDMS_SET_F_DELTA)?ZAP_READ_F_DELTA:0,
+			    ent);
 }
 
 /*
@@ -1537,7 +2288,8 @@ out:
  * they don't match, then the meta data is fetched and then the data
  * is fetched again.
  */
-int __ldms_remote_update(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
+static int __remote_update(ldms_t x, ldms_set_t s, ldms_update_cb_t cb,
+			   void *arg, struct zap_read_ent *ent)
 {
 	assert(x == s->xprt);
 	if (!ldms_xprt_connected(x))
@@ -1562,11 +2314,11 @@ int __ldms_remote_update(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
 	if (meta_meta_gn == 0 || meta_meta_gn != data_meta_gn) {
 		if (s->curr_idx == (n-1)) {
 			/* We can update the metadata along with the data */
-			rc = do_read_all(x, s, cb, arg);
+			rc = do_read_all(x, s, cb, arg, ent);
 		} else {
 			/* Otherwise, need to update metadata and data
 			 * separately */
-			rc = do_read_meta(x, s, cb, arg);
+			rc = do_read_meta(x, s, cb, arg, ent);
 		}
 	} else {
 		idx_from = (s->curr_idx + 1) % n;
@@ -1576,7 +2328,7 @@ int __ldms_remote_update(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
 			idx_to = idx_next;
 		else
 			idx_to = (idx_curr < idx_from)?(n - 1):(idx_curr);
-		rc = do_read_data(x, s, idx_from, idx_to, cb, arg);
+		rc = do_read_data(x, s, idx_from, idx_to, cb, arg, ent);
 	}
 	if (rc) {
 		zap_put_ep(x->zap_ep, "ldms_xprt:set_update", __func__, __LINE__);
@@ -1584,6 +2336,59 @@ int __ldms_remote_update(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
 	return rc;
 }
 
+int __ldms_remote_update(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
+{
+	return __remote_update(x, s, cb, arg, NULL);
+}
+
+/*
+ * Update the sets in \c sets that are all on the transport \c x. The reads
+ * are handed to the transport in groups of up to LDMS_UPDATE_BATCH_CHUNK
+ * entries with zap_read_v() so that transports supporting vectored reads
+ * need only one request per group. The completion of each read is handled
+ * exactly as a read posted by __ldms_remote_update(). The caller must hold
+ * x->lock.
+ */
+#define LDMS_UPDATE_BATCH_CHUNK 64
+int __ldms_remote_update_batch(ldms_t x, ldms_set_t *sets, int n,
+			       ldms_update_cb_t cb, void **args, int *rcs)
+{
+	struct zap_read_ent ents[LDMS_UPDATE_BATCH_CHUNK];
+	int set_idx[LDMS_UPDATE_BATCH_CHUNK];
+	int i, j, cnt, n_posted, rc = 0;
+	zap_err_t zerr;
+
+	i = 0;
+	while (i < n) {
+		cnt = 0;
+		for (; i < n && cnt < LDMS_UPDATE_BATCH_CHUNK; i++) {
+			rcs[i] = __remote_update(x, sets[i], cb,
+					(args?args[i]:NULL), &ents[cnt]);
+			if (rcs[i]) {
+				if (!rc)
+					rc = rcs[i];
+				continue;
+			}
+			set_idx[cnt++] = i;
+		}
+		if (!cnt)
+			continue;
+		n_posted = 0;
+		zerr = zap_read_v(x->zap_ep, ents, cnt, &n_posted);
+		if (!zerr)
+			continue;
+		x->zerrno = zerr;
+		for (j = n_posted; j < cnt; j++) {
+			__ldms_free_ctxt(x, ents[j].context);
+			zap_put_ep(x->zap_ep, "ldms_xprt:set_update", __func__, __LINE__);
+			rcs[set_idx[j]] = zap_zerr2errno(zerr);
+			if (!rc)
+				rc = rcs[set_idx[j]];
+		}
+	}
+	return rc;
+}
+
 static
 int ldms_xprt_recv_request(struct ldms_xprt *x, struct ldms_request *req)
 {
@@ -1624,6 +2429,12 @@ int ldms_xprt_recv_request(struct ldms_xprt *x, struct ldms_request *req)
 	case LDMS_CMD_SET_DELETE:
 		process_set_delete_request(x, req);
 		break;
+	case LDMS_CMD_STREAM_MSG:
+		process_stream_request(x, req);
+		break;
+	case LDMS_CMD_STREAM_CREDIT:
+		process_stream_credit_request(x, req);
+		break;
 	default:
 		XPRT_LOG(x, OVIS_LERROR, "Unrecognized request %d\n", cmd);
 		assert(0 == "Unrecognized LDMS_CMD request type");
@@ -1676,99 +2487,75 @@ void process_dir_cancel_reply(struct ldms_xprt *x, struct ldms_reply *reply,
 }
 
 static int __process_dir_set_info(struct ldms_set *lset, enum ldms_dir_type type,
-				ldms_dir_set_t dset, json_entity_t info_list)
+				  ldms_dir_set_t dset)
 {
-	json_entity_t info_entity, k, v;
-	int j, rc = 0  ;
+	int j, rc = 0;
 	int dir_upd = 0;
 	struct ldms_set_info_pair *pair, *nxt_pair;
 
-	if (lset)
-		pthread_mutex_lock(&lset->lock);
-	for (j = 0, info_entity = json_item_first(info_list); info_entity;
-	     info_entity = json_item_next(info_entity), j++) {
-		k = json_value_find(info_entity, "key");
-		v = json_value_find(info_entity, "value");
-		char *nkey = strdup(json_value_str(k)->str);
-		char *nvalue = strdup(json_value_str(v)->str);
-		if (!nkey || !nvalue) {
-			free(nkey);
-			free(nvalue);
-			rc = ENOMEM;
-			goto out;
-		}
-		dset->info[j].key = nkey;
-		dset->info[j].value = nvalue;
-
-		if (lset) {
-			const char *key = dset->info[j].key;
-			const char *val = dset->info[j].value;
-			rc = __ldms_set_info_set(&lset->remote_info, key, val);
-			if (rc > 0)
-				goto out;
-			else if (rc == 0)
-				dir_upd = 1;
-			else
-				rc = 0; /* no change */
-		}
-	}
 	if (!lset)
 		return 0;
+	pthread_mutex_lock(&lset->lock);
+	for (j = 0; j < dset->info_count; j++) {
+		const char *key = dset->info[j].key;
+		const char *val = dset->info[j].value;
+		rc = __ldms_set_info_set(&lset->remote_info, key, val);
+		if (rc > 0)
+			goto out;
+		else if (rc == 0)
+			dir_upd = 1;
+		else
+			rc = 0; /* no change */
+	}
 
 	pair = LIST_FIRST(&lset->remote_info);
 	while (pair) {
 		nxt_pair = LIST_NEXT(pair, entry);
-		for (j = 0, info_entity = json_item_first(info_list); info_entity;
-				info_entity = json_item_next(info_entity)) {
-			k = json_value_find(info_entity, "key");
-			if (0 == strcmp(pair->key, json_value_str(k)->str))
+		for (j = 0; j < dset->info_count; j++) {
+			if (0 == strcmp(pair->key, dset->info[j].key))
 				break;
 		}
-		if (!info_entity) {
+		if (j == dset->info_count) {
 			__ldms_set_info_unset(pair);
 			dir_upd = 1;
 		}
 		pair = nxt_pair;
 	}
 out:
-	if (lset) {
-		pthread_mutex_unlock(&lset->lock);
-		if (!rc) {
-			if ((type == LDMS_DIR_UPD) && dir_upd &&
-					(lset->flags & LDMS_SET_F_PUBLISHED)) {
-				__ldms_dir_upd_set(lset);
-			}
+	pthread_mutex_unlock(&lset->lock);
+	if (!rc) {
+		if ((type == LDMS_DIR_UPD) && dir_upd &&
+				(lset->flags & LDMS_SET_F_PUBLISHED)) {
+			__ldms_dir_upd_set(lset);
 		}
 	}
 	return rc;
 }
 
-static
-void __process_dir_reply(struct ldms_xprt *x, struct ldms_reply *reply,
-		       struct ldms_context *ctxt, int more)
+/* If this set is in our local set tree, update it's set info */
+static int __process_dir_set(enum ldms_dir_type type, ldms_dir_set_t dset)
 {
-	enum ldms_dir_type type = ntohl(reply->dir.type);
-	int i, rc = ntohl(reply->hdr.rc);
-	size_t count, json_data_len;
-	ldms_dir_t dir = NULL;
-	json_parser_t p = NULL;
-	json_entity_t dir_attr, dir_list, set_entity, info_list;
-	json_entity_t dir_entity = NULL;
 	struct ldms_set *lset;
-	ldms_stats_entry_t e = &x->stats.ops[LDMS_XPRT_OP_DIR_REQ];
-	int64_t dur_us;
-	struct timespec end, start;
-
-	json_data_len = ntohl(reply->hdr.len) - sizeof(struct ldms_reply_hdr)
-				- sizeof(struct ldms_dir_reply);
-
-	if (!ctxt->dir.cb)
-		return;
+	int rc;
 
-	if (rc)
-		goto out;
+	__ldms_set_tree_lock();
+	lset = __ldms_find_local_set(dset->inst_name);
+	rc = __process_dir_set_info(lset, type, dset);
+	if (lset)
+		ref_put(&lset->ref, "__ldms_find_local_set");
+	__ldms_set_tree_unlock();
+	return rc;
+}
 
-	(void)clock_gettime(CLOCK_REALTIME, &start);
+static int __dir_json_decode(enum ldms_dir_type type, int more,
+			     char *data, size_t data_len, ldms_dir_t *pdir)
+{
+	int i, j, rc;
+	size_t count;
+	ldms_dir_t dir = NULL;
+	json_parser_t p = NULL;
+	json_entity_t dir_attr, dir_list, set_entity, info_list, info_entity;
+	json_entity_t dir_entity = NULL;
 
 	p = json_parser_new(0);
 	if (!p) {
@@ -1776,7 +2563,7 @@ void __process_dir_reply(struct ldms_xprt *x, struct ldms_reply *reply,
 		goto out;
 	}
 
-	rc = json_parse_buffer(p, reply->dir.json_data, json_data_len, &dir_entity);
+	rc = json_parse_buffer(p, data, data_len, &dir_entity);
 	if (rc)
 		goto out;
 
@@ -1793,7 +2580,7 @@ void __process_dir_reply(struct ldms_xprt *x, struct ldms_reply *reply,
 	}
 	count = json_list_len(dir_list);
 
-	dir = malloc(sizeof (*dir) +
+	dir = calloc(1, sizeof (*dir) +
 		     (count * sizeof(void *)) +
 		     (count * sizeof(struct ldms_dir_set_s)));
 	rc = ENOMEM;
@@ -1803,6 +2590,7 @@ void __process_dir_reply(struct ldms_xprt *x, struct ldms_reply *reply,
 	dir->type = type;
 	dir->more = more;
 	dir->set_count = count;
+	dir->gn = 0;
 
 	for (i = 0, set_entity = json_item_first(dir_list); set_entity;
 	     set_entity = json_item_next(set_entity), i++) {
@@ -1874,31 +2662,207 @@ void __process_dir_reply(struct ldms_xprt *x, struct ldms_reply *reply,
 			dir->set_data[i].info = NULL;
 			continue;
 		}
-		dir->set_data[i].info = malloc(sizeof(struct ldms_key_value_s) * info_count);
+		dir->set_data[i].info = calloc(info_count, sizeof(struct ldms_key_value_s));
 		if (!dir->set_data[i].info) {
 			rc = ENOMEM;
 			goto out;
 		}
-
-		/* If this set is in our local set tree, update it's set info */
-		__ldms_set_tree_lock();
 		dir->set_data[i].info_count = info_count;
-		lset = __ldms_find_local_set(dir->set_data[i].inst_name);
-		rc = __process_dir_set_info(lset, type, &dir->set_data[i], info_list);
-		if (lset)
-			ref_put(&lset->ref, "__ldms_find_local_set");
-		__ldms_set_tree_unlock();
+		for (j = 0, info_entity = json_item_first(info_list); info_entity;
+		     info_entity = json_item_next(info_entity), j++) {
+			e = json_value_find(info_entity, "key");
+			dir->set_data[i].info[j].key = strdup(json_value_str(e)->str);
+			e = json_value_find(info_entity, "value");
+			dir->set_data[i].info[j].value = strdup(json_value_str(e)->str);
+			if (!dir->set_data[i].info[j].key ||
+			    !dir->set_data[i].info[j].value) {
+				rc = ENOMEM;
+				goto out;
+			}
+		}
+
+		rc = __process_dir_set(type, &dir->set_data[i]);
 		if (rc)
 			break;
 	}
+out:
+	json_entity_free(dir_entity);
+	json_parser_free(p);
+	*pdir = dir;
+	return rc;
+}
+
+static char *__dir_bin_strdup(const char *str, uint32_t str_len, uint32_t off)
+{
+	off = ntohl(off);
+	if (off >= str_len) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return strdup(&str[off]);
+}
+
+/*
+ * Decode the run of same-type entries starting at *pos into a directory
+ * and advance *pos to the next run, or to 0 after the last one. A
+ * message with no entries decodes into an empty directory of the
+ * message type.
+ */
+static int __dir_bin_decode(enum ldms_dir_type type, int more,
+			    char *data, size_t data_len, uint32_t *pos,
+			    ldms_dir_t *pdir)
+{
+	struct ldms_dir_bin_hdr *hdr = (void *)data;
+	struct ldms_dir_bin_set *sets;
+	struct ldms_dir_bin_kv *kv;
+	const char *str;
+	uint32_t i, j, n, count, kv_count, str_len, idx;
+	char buf[2*LDMS_DIGEST_LENGTH+1];
+	ldms_dir_set_t dset;
+	ldms_dir_t dir;
+	int rc = 0;
+
+	*pdir = NULL;
+	if (data_len < sizeof(*hdr))
+		return EINVAL;
+	count = ntohl(hdr->set_count);
+	kv_count = ntohl(hdr->kv_count);
+	str_len = ntohl(hdr->str_len);
+	if (data_len != sizeof(*hdr) + (uint64_t)count * sizeof(*sets)
+			+ (uint64_t)kv_count * sizeof(*kv) + str_len)
+		return EINVAL;
+	sets = (void *)(hdr + 1);
+	kv = (void *)(sets + count);
+	str = (void *)(kv + kv_count);
+	if (str_len && str[str_len - 1])
+		return EINVAL;
+
+	if (*pos < count)
+		type = ntohl(sets[*pos].type);
+	for (n = *pos; n < count && ntohl(sets[n].type) == type; n++)
+		;
+	dir = calloc(1, sizeof(*dir) + (n - *pos) * sizeof(struct ldms_dir_set_s));
+	if (!dir)
+		return ENOMEM;
+	dir->type = type;
+	dir->more = more || (n < count);
+	dir->gn = be64toh(hdr->gn);
+	*pdir = dir;
+
+	for (i = *pos; i < n; i++) {
+		struct ldms_dir_bin_set *e = &sets[i];
+		dset = &dir->set_data[i - *pos];
+		dir->set_count = i - *pos + 1;	/* entries to free on error */
+		dset->inst_name = __dir_bin_strdup(str, str_len, e->inst_name);
+		dset->schema_name = __dir_bin_strdup(str, str_len, e->schema_name);
+		if (ntohl(e->flags) & LDMS_DIR_BIN_F_DIGEST)
+			dset->digest_str = strdup(ldms_digest_str(
+					(ldms_digest_t)e->digest, buf, sizeof(buf)));
+		else
+			dset->digest_str = strdup("");
+		memcpy(buf, e->state, sizeof(e->state));
+		buf[sizeof(e->state) - 1] = '\0';
+		dset->flags = strdup(buf);
+		__ldms_format_perm(ntohl(e->perm), buf);
+		dset->perm = strdup(buf);
+		if (!dset->inst_name || !dset->schema_name || !dset->digest_str
+				|| !dset->flags || !dset->perm) {
+			rc = errno;
+			goto out;
+		}
+		dset->meta_size = ntohl(e->meta_size);
+		dset->data_size = ntohl(e->data_size);
+		dset->heap_size = ntohl(e->heap_size);
+		dset->uid = ntohl(e->uid);
+		dset->gid = ntohl(e->gid);
+		dset->card = ntohl(e->card);
+		dset->array_card = ntohl(e->array_card);
+		dset->meta_gn = be64toh(e->meta_gn);
+		dset->data_gn = be64toh(e->data_gn);
+		dset->timestamp.sec = ntohl(e->ts_sec);
+		dset->timestamp.usec = ntohl(e->ts_usec);
+		dset->duration.sec = ntohl(e->dur_sec);
+		dset->duration.usec = ntohl(e->dur_usec);
+
+		idx = ntohl(e->info_idx);
+		dset->info_count = ntohl(e->info_count);
+		if (idx > kv_count || dset->info_count > kv_count - idx) {
+			dset->info_count = 0;
+			rc = EINVAL;
+			goto out;
+		}
+		if (!dset->info_count)
+			continue;
+		dset->info = calloc(dset->info_count, sizeof(*dset->info));
+		if (!dset->info) {
+			dset->info_count = 0;
+			rc = ENOMEM;
+			goto out;
+		}
+		for (j = 0; j < dset->info_count; j++) {
+			dset->info[j].key = __dir_bin_strdup(str, str_len, kv[idx + j].key);
+			dset->info[j].value = __dir_bin_strdup(str, str_len, kv[idx + j].value);
+			if (!dset->info[j].key || !dset->info[j].value) {
+				rc = errno;
+				goto out;
+			}
+		}
+		rc = __process_dir_set(type, dset);
+		if (rc)
+			goto out;
+	}
+	*pos = (n < count) ? n : 0;
+ out:
+	return rc;
+}
+
+static
+void __process_dir_reply(struct ldms_xprt *x, struct ldms_reply *reply,
+		       struct ldms_context *ctxt, int more)
+{
+	enum ldms_dir_type type = ntohl(reply->dir.type);
+	int rc = ntohl(reply->hdr.rc);
+	size_t data_len;
+	ldms_dir_t dir = NULL;
+	ldms_stats_entry_t e = &x->stats.ops[LDMS_XPRT_OP_DIR_REQ];
+	int64_t dur_us;
+	struct timespec end, start;
+
+	data_len = ntohl(reply->hdr.len) - sizeof(struct ldms_reply_hdr)
+				- sizeof(struct ldms_dir_reply);
+
+	if (!ctxt->dir.cb)
+		return;
+
+	if (rc)
+		goto out;
+
+	(void)clock_gettime(CLOCK_REALTIME, &start);
 
+	if (type & LDMS_DIR_REPLY_F_BIN) {
+		uint32_t pos = 0;
+		do {
+			rc = __dir_bin_decode(type & ~LDMS_DIR_REPLY_F_BIN, more,
+					      reply->dir.json_data, data_len,
+					      &pos, &dir);
+			if (rc)
+				break;
+			/* Callback owns dir memory. */
+			ctxt->dir.cb((ldms_t)x, 0, dir, ctxt->dir.cb_arg);
+			dir = NULL;
+		} while (pos);
+		if (!rc)
+			goto stats;
+	} else {
+		rc = __dir_json_decode(type, more, reply->dir.json_data,
+				       data_len, &dir);
+	}
 out:
 	/* Callback owns dir memory. */
 	ctxt->dir.cb((ldms_t)x, rc, rc ? NULL : dir, ctxt->dir.cb_arg);
-	json_entity_free(dir_entity);
-	json_parser_free(p);
 	if (rc && dir)
 		ldms_xprt_dir_free(x, dir);
+ stats:
 	(void)clock_gettime(CLOCK_REALTIME, &end);
 	dur_us = ldms_timespec_diff_us(&start, &end);
 	if (e->min_us > dur_us)
@@ -2127,6 +3091,8 @@ void __ldms_xprt_conn_msg_init(ldms_t _x, struct ldms_conn_msg *msg)
 	struct ldms_xprt *x = _x;
 	bzero(msg, sizeof(*msg));
 	LDMS_VERSION_SET(msg->ver);
+	msg->features = htonl(LDMS_CONN_F_DIR_BIN |
+			      (x->stream_recv ? LDMS_CONN_F_STREAM : 0));
 	if (x->auth)
 		strncpy(msg->auth_name,
 			x->auth->plugin->name, sizeof(msg->auth_name));
@@ -2173,7 +3139,7 @@ int ldms_xprt_names(ldms_t x, char *lcl_name, size_t lcl_name_sz,
 	return 0;
 }
 
-static void ldms_zap_handle_conn_req(zap_ep_t zep)
+static void ldms_zap_handle_conn_req(zap_ep_t zep, uint32_t peer_features)
 {
 	static char rej_msg[64] = "Insufficient resources";
 	struct ldms_conn_msg msg;
@@ -2200,6 +3166,8 @@ static void ldms_zap_handle_conn_req(zap_ep_t zep)
 	_x->zap = x->zap;
 	_x->zap_ep = zep;
 	_x->max_msg = zap_max_msg(x->zap);
+	_x->peer_features = peer_features;
+	_x->stream_recv = x->stream_recv;
 	_x->event_cb = x->event_cb;
 	_x->event_cb_arg = x->event_cb_arg;
 	if (!_x->event_cb)
@@ -2346,7 +3314,8 @@ static void __handle_update_meta(ldms_t x, struct ldms_context *ctxt,
 	ldms_set_t set = ctxt->update.s;
 	int idx = (set->curr_idx + 1) % __le32_to_cpu(set->meta->array_card);
 
-	rc = do_read_data(x, set, idx, idx, ctxt->update.cb, ctxt->update.cb_arg);
+	rc = do_read_data(x, set, idx, idx, ctxt->update.cb, ctxt->update.cb_arg,
+			  NULL);
 	if (rc) {
 		ctxt->update.cb(x, set, LDMS_UPD_ERROR(rc), ctxt->update.cb_arg);
 		zap_put_ep(x->zap_ep, "ldms_xprt:set_update", __func__, __LINE__);
@@ -2539,9 +3508,7 @@ static void handle_rendezvous_lookup(zap_ep_t zep, zap_event_t ev,
 	schema_name = (ldms_name_t)lu->set_info;
 	inst_name = (ldms_name_t)&(schema_name->name[schema_name->len]);
 
-	__ldms_set_tree_lock();
 	lset = __ldms_find_local_set(inst_name->name);
-	__ldms_set_tree_unlock();
 
 	if (lset) {
 		rc = EEXIST;
@@ -2555,7 +3522,9 @@ static void handle_rendezvous_lookup(zap_ep_t zep, zap_event_t ev,
 	lset = __ldms_create_set(inst_name->name, schema_name->name,
 				 ntohl(lu->meta_len), ntohl(lu->data_len),
 				 ntohl(lu->card), ntohl(lu->array_card),
-				 LDMS_SET_F_REMOTE);
+				 LDMS_SET_F_REMOTE |
+				 ((ctxt->lu_req.flags & LDMS_LOOKUP_DELTA)?
+				  LDMS_SET_F_DELTA:0));
 	if (!lset) {
 		rc = errno;
 		goto callback;
@@ -2744,6 +3713,14 @@ static int __ldms_conn_msg_verify(struct ldms_xprt *x, const void *data,
 	return 0;
 }
 
+static uint32_t __ldms_conn_msg_features(const void *data, int data_len)
+{
+	const struct ldms_conn_msg *msg = data;
+	if (data_len < sizeof(*msg))
+		return 0; /* peer predates the features field */
+	return ntohl(msg->features);
+}
+
 /* Callers must _not_ hold the transport lock */
 static void __ldms_xprt_release_sets(ldms_t x, struct rbt *set_coll)
 {
@@ -2821,7 +3798,8 @@ static void ldms_zap_cb(zap_ep_t zep, zap_event_t ev)
 			zap_reject(zep, rej_msg, strlen(rej_msg)+1);
 			break;
 		}
-		ldms_zap_handle_conn_req(zep);
+		ldms_zap_handle_conn_req(zep,
+			__ldms_conn_msg_features(ev->data, ev->data_len));
 		break;
 	case ZAP_EVENT_REJECTED:
 		(void)clock_gettime(CLOCK_REALTIME, &x->stats.disconnected);
@@ -2842,6 +3820,7 @@ static void ldms_zap_cb(zap_ep_t zep, zap_event_t ev)
 			__ldms_xprt_term(x);
 			break;
 		}
+		x->peer_features = __ldms_conn_msg_features(ev->data, ev->data_len);
 		/* then, proceed to authentication */
 		ldms_xprt_auth_begin(x);
 		break;
@@ -2887,6 +3866,8 @@ static void ldms_zap_cb(zap_ep_t zep, zap_event_t ev)
 
 		set_coll = x->set_coll;
 		x->set_coll.root = NULL;
+		/* Wake the stream senders waiting for credit */
+		pthread_cond_broadcast(&x->stream_credit_cond);
 		pthread_mutex_unlock(&x->lock);
 		if (x->event_cb)
 			x->event_cb(x, &event, x->event_cb_arg);
@@ -3037,6 +4018,9 @@ void __ldms_xprt_init(struct ldms_xprt *x, const char *name)
 	for (op_e = 0; op_e < LDMS_XPRT_OP_COUNT; op_e++)
 		x->stats.ops[op_e].min_us = LLONG_MAX;
 
+	x->stream_credit = LDMS_STREAM_CREDIT;
+	pthread_cond_init(&x->stream_credit_cond, NULL);
+
 	TAILQ_INIT(&x->ctxt_list);
 	sem_init(&x->sem, 0, 0);
 	rbt_init(&x->set_coll, rbn_ptr_cmp);
@@ -3051,6 +4035,11 @@ void ldms_xprt_priority_set(ldms_t x, int prio)
 	zap_set_priority(x->zap_ep, prio);
 }
 
+void ldms_xprt_pinned_set(ldms_t x, int pinned)
+{
+	zap_set_pinned(x->zap_ep, pinned);
+}
+
 ldms_t ldms_xprt_new_with_auth(const char *xprt_name,
 			       const char *auth_name,
 			       struct attr_value_list *auth_av_list)
@@ -3120,13 +4109,23 @@ size_t format_lookup_req(struct ldms_request *req, enum ldms_lookup_flags flags,
 	return len;
 }
 
-size_t format_dir_req(struct ldms_request *req, uint64_t xid,
-		      uint32_t flags)
+size_t format_dir_req(struct ldms_xprt *x, struct ldms_request *req,
+		      uint64_t xid, uint32_t flags, uint64_t gn)
 {
 	size_t len;
+	uint32_t req_flags = flags & LDMS_DIR_F_NOTIFY;
 	req->hdr.xid = xid;
 	req->hdr.cmd = htonl(LDMS_CMD_DIR);
-	req->dir.flags = htonl(flags);
+	req->dir.gn = 0;
+	if ((x->peer_features & LDMS_CONN_F_DIR_BIN) &&
+	    !(flags & LDMS_DIR_F_JSON)) {
+		req_flags |= LDMS_DIR_REQ_F_BIN;
+		if (gn) {
+			req_flags |= LDMS_DIR_REQ_F_SINCE;
+			req->dir.gn = htobe64(gn);
+		}
+	}
+	req->dir.flags = htonl(req_flags);
 	len = sizeof(struct ldms_request_hdr) +
 		sizeof(struct ldms_dir_cmd_param);
 	req->hdr.len = htonl(len);
@@ -3238,7 +4237,133 @@ size_t ldms_xprt_msg_max(ldms_t x)
 			sizeof(struct ldms_send_cmd_param));
 }
 
-int __ldms_remote_dir(ldms_t _x, ldms_dir_cb_t cb, void *cb_arg, uint32_t flags)
+void ldms_xprt_stream_recv_enable(ldms_t x)
+{
+	x->stream_recv = 1;
+}
+
+int ldms_xprt_stream_supported(ldms_t x)
+{
+	return (x->peer_features & LDMS_CONN_F_STREAM) != 0;
+}
+
+static int __stream_send(ldms_t _x, const char *name, uint8_t type,
+			 uint8_t flags, const char *data, size_t data_len,
+			 const struct timespec *abstime)
+{
+	struct ldms_xprt *x = _x;
+	struct ldms_request req;
+	struct iovec iov[3];
+	size_t hdr_len = sizeof(req.hdr) + sizeof(req.stream);
+	size_t name_len = strlen(name) + 1;
+	size_t off, frag, room;
+	zap_err_t zerr;
+	int iovcnt, rc = 0;
+
+	if (!ldms_xprt_connected(x))
+		return ENOTCONN;
+	if (!ldms_xprt_stream_supported(x))
+		return ENOTSUP;
+	if (LDMS_XPRT_AUTH_GUARD(x))
+		return EPERM;
+	if (name_len > UINT16_MAX || data_len > UINT32_MAX ||
+	    hdr_len + name_len >= x->max_msg)
+		return EINVAL;
+
+	ldms_xprt_get(x);
+	/* The fragments of a message must not interleave with another's */
+	pthread_mutex_lock(&x->lock);
+	/* A full window admits a message larger than the window */
+	while (x->stream_credit < (int64_t)data_len &&
+	       x->stream_credit < LDMS_STREAM_CREDIT) {
+		if (!abstime) {
+			rc = EAGAIN;
+			goto out;
+		}
+		rc = pthread_cond_timedwait(&x->stream_credit_cond, &x->lock,
+					    abstime);
+		if (rc)
+			goto out;
+		if (!ldms_xprt_connected(x)) {
+			rc = ENOTCONN;
+			goto out;
+		}
+	}
+	x->stream_credit -= data_len;
+	req.hdr.xid = 0;
+	req.hdr.cmd = htonl(LDMS_CMD_STREAM_MSG);
+	req.stream.msg_no = htonl(++x->stream_msg_no);
+	req.stream.data_len = htonl(data_len);
+	req.stream.type = type;
+	req.stream.flags = flags;
+	off = 0;
+	do {
+		iovcnt = 0;
+		room = x->max_msg - hdr_len;
+		iov[iovcnt].iov_base = &req;
+		iov[iovcnt++].iov_len = hdr_len;
+		if (!off) {
+			iov[iovcnt].iov_base = (void *)name;
+			iov[iovcnt++].iov_len = name_len;
+			room -= name_len;
+		}
+		frag = data_len - off;
+		if (frag > room)
+			frag = room;
+		if (frag) {
+			iov[iovcnt].iov_base = (void *)(data + off);
+			iov[iovcnt++].iov_len = frag;
+		}
+		req.stream.data_off = htonl(off);
+		req.stream.frag_len = htonl(frag);
+		req.stream.name_len = htons(off ? 0 : name_len);
+		req.hdr.len = htonl(hdr_len + (off ? 0 : name_len) + frag);
+		zerr = zap_sendv(x->zap_ep, iov, iovcnt);
+		if (zerr) {
+			rc = zap_zerr2errno(zerr);
+			/*
+			 * The fragments that were sent return their credit
+			 * from the peer; restore the rest of the message's.
+			 */
+			x->stream_credit += data_len - off;
+			pthread_cond_broadcast(&x->stream_credit_cond);
+			break;
+		}
+		off += frag;
+	} while (off < data_len);
+ out:
+	pthread_mutex_unlock(&x->lock);
+	ldms_xprt_put(x);
+	return rc;
+}
+
+int ldms_xprt_stream_send(ldms_t x, const char *name, uint8_t type,
+			  uint8_t flags, const char *data, size_t data_len)
+{
+	return __stream_send(x, name, type, flags, data, data_len, NULL);
+}
+
+int ldms_xprt_stream_send_wait(ldms_t x, const char *name, uint8_t type,
+			       uint8_t flags, const char *data,
+			       size_t data_len, int timeout_ms)
+{
+	struct timespec abstime;
+
+	if (timeout_ms <= 0)
+		return ldms_xprt_stream_send(x, name, type, flags,
+					     data, data_len);
+	clock_gettime(CLOCK_REALTIME, &abstime);
+	abstime.tv_sec += timeout_ms / 1000;
+	abstime.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (abstime.tv_nsec >= 1000000000L) {
+		abstime.tv_sec++;
+		abstime.tv_nsec -= 1000000000L;
+	}
+	return __stream_send(x, name, type, flags, data, data_len, &abstime);
+}
+
+int __ldms_remote_dir(ldms_t _x, ldms_dir_cb_t cb, void *cb_arg,
+		      uint32_t flags, uint64_t gn)
 {
 	struct ldms_xprt *x = _x;
 	struct ldms_request *req;
@@ -3267,8 +4392,8 @@ int __ldms_remote_dir(ldms_t _x, ldms_dir_cb_t cb, void *cb_arg, uint32_t flags)
 		return ENOMEM;
 	}
 	req = (struct ldms_request *)(ctxt + 1);
-	len = format_dir_req(req, (uint64_t)(unsigned long)ctxt, flags);
-	if (flags)
+	len = format_dir_req(x, req, (uint64_t)(unsigned long)ctxt, flags, gn);
+	if (flags & LDMS_DIR_F_NOTIFY)
 		x->local_dir_xid = (uint64_t)ctxt;
 	pthread_mutex_unlock(&x->lock);
 
@@ -3356,9 +4481,7 @@ int __ldms_remote_lookup(ldms_t _x, const char *path,
 	if (LDMS_XPRT_AUTH_GUARD(x))
 		return EPERM;
 
-	__ldms_set_tree_lock();
 	struct ldms_set *set = __ldms_find_local_set(path);
-	__ldms_set_tree_unlock();
 	if (set) {
 		ldms_set_put(set);
 		return EEXIST;
@@ -3750,8 +4873,7 @@ int ldms_xprt_connect(ldms_t x, struct sockaddr *sa, socklen_t sa_len,
 	_x->event_cb = cb;
 	_x->event_cb_arg = cb_arg;
 	ldms_xprt_get(x);
-	rc = zap_connect(_x->zap_ep, sa, sa_len,
-			 (void*)&msg, sizeof(msg.ver) + strlen(msg.auth_name) + 1);
+	rc = zap_connect(_x->zap_ep, sa, sa_len, (void*)&msg, sizeof(msg));
 	if (rc) {
 		__ldms_xprt_resource_free(x);
 		ldms_xprt_put(x);
@@ -3857,9 +4979,7 @@ extern ldms_set_t ldms_xprt_set_by_name(ldms_t x, const char *set_name)
 	struct ldms_set *set;
 	struct rbn *rbn;
 
-	__ldms_set_tree_lock();
 	set = __ldms_find_local_set(set_name);
-	__ldms_set_tree_unlock();
 	if (!set)
 		return NULL;
 	pthread_mutex_lock(&x->lock);
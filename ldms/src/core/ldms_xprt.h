@@ -121,6 +121,8 @@ enum ldms_request_cmd {
 	LDMS_CMD_CANCEL_PUSH,
 	LDMS_CMD_AUTH,
 	LDMS_CMD_SET_DELETE,
+	LDMS_CMD_STREAM_MSG,
+	LDMS_CMD_STREAM_CREDIT,
 	LDMS_CMD_REPLY = 0x100,
 	LDMS_CMD_DIR_REPLY,
 	LDMS_CMD_DIR_CANCEL_REPLY,
@@ -136,9 +138,18 @@ enum ldms_request_cmd {
 	LDMS_CMD_XPRT_PRIVATE = 0x80000000,
 };
 
+/*
+ * Optional protocol features advertised in ldms_conn_msg.features.
+ * Peers that predate the field send a shorter message and are treated
+ * as advertising none of them.
+ */
+#define LDMS_CONN_F_DIR_BIN	0x1	/* binary and incremental dir replies */
+#define LDMS_CONN_F_STREAM	0x2	/* accepts LDMS_CMD_STREAM_MSG */
+
 struct ldms_conn_msg {
 	struct ldms_version ver;
 	char auth_name[LDMS_AUTH_NAME_MAX + 1];
+	uint32_t features;
 };
 
 struct ldms_send_cmd_param {
@@ -146,14 +157,51 @@ struct ldms_send_cmd_param {
 	char msg[OVIS_FLEX];
 };
 
+/*
+ * A stream message is sent as one or more LDMS_CMD_STREAM_MSG fragments
+ * of at most max_msg bytes. The first fragment (data_off == 0) carries
+ * the NUL-terminated stream name, name_len bytes including the NUL,
+ * ahead of the data. The fragments of a message are sent back to back
+ * and are never interleaved with those of another message.
+ */
+struct ldms_stream_cmd_param {
+	uint32_t msg_no;	/*! Per-xprt message sequence number */
+	uint32_t data_len;	/*! Total length of the message data */
+	uint32_t data_off;	/*! Offset of this fragment's data */
+	uint32_t frag_len;	/*! Length of the data in this fragment */
+	uint16_t name_len;	/*! Length of the name, first fragment only */
+	uint8_t type;		/*! Stream payload type */
+	uint8_t flags;
+	char data[OVIS_FLEX];
+};
+
+/*
+ * The number of stream data bytes a publisher may have in flight on a
+ * transport. The receiver returns credit with LDMS_CMD_STREAM_CREDIT as
+ * it delivers messages.
+ */
+#define LDMS_STREAM_CREDIT	(1024 * 1024)
+
+struct ldms_stream_credit_cmd_param {
+	uint32_t credit;	/*! Bytes consumed since the last credit */
+};
+
 struct ldms_lookup_cmd_param {
 	uint32_t flags;
 	uint32_t path_len;
 	char path[LDMS_LOOKUP_PATH_MAX+1];
 };
 
+/*
+ * Directory request flags beyond LDMS_DIR_F_NOTIFY. These are only sent
+ * to peers that advertised LDMS_CONN_F_DIR_BIN.
+ */
+#define LDMS_DIR_REQ_F_BIN	0x10000	/*! Reply in the binary encoding */
+#define LDMS_DIR_REQ_F_SINCE	0x20000	/*! Only the changes since dir.gn */
+
 struct ldms_dir_cmd_param {
 	uint32_t flags;		/*! Directory update flags */
+	uint64_t gn;		/*! Generation for LDMS_DIR_REQ_F_SINCE */
 };
 
 struct ldms_set_delete_cmd_param {
@@ -186,6 +234,8 @@ struct ldms_request {
 		struct ldms_send_cmd_param send;
 		struct ldms_dir_cmd_param dir;
 		struct ldms_set_delete_cmd_param set_delete;
+		struct ldms_stream_cmd_param stream;
+		struct ldms_stream_credit_cmd_param stream_credit;
 		struct ldms_lookup_cmd_param lookup;
 		struct ldms_req_notify_cmd_param req_notify;
 		struct ldms_cancel_notify_cmd_param cancel_notify;
@@ -235,6 +285,63 @@ struct ldms_dir_reply {
 	char json_data[OVIS_FLEX];
 };
 
+/*
+ * Binary directory encoding
+ *
+ * Set in ldms_dir_reply.type when json_data holds a binary directory
+ * instead of JSON. The payload is an ldms_dir_bin_hdr followed by
+ * set_count fixed-size set entries, kv_count set-info entries and a
+ * string table of str_len bytes. Strings are referenced by their offset
+ * in the string table and each distinct string (schema names, set-info
+ * keys and values) is stored once per message. All integers are in
+ * network byte order.
+ *
+ * Each entry carries its own ldms_dir_type so that the deletions,
+ * additions and updates of an incremental dir fit in one message; the
+ * receiver delivers every run of entries of the same type as a separate
+ * ldms_dir_t. The type in ldms_dir_reply is that of an empty message.
+ */
+#define LDMS_DIR_REPLY_F_BIN	0x80000000
+
+struct ldms_dir_bin_hdr {
+	uint64_t gn;		/* directory generation of the peer */
+	uint32_t set_count;
+	uint32_t kv_count;
+	uint32_t str_len;
+};
+
+#define LDMS_DIR_BIN_F_DIGEST	0x1	/* digest[] is valid */
+
+struct ldms_dir_bin_set {
+	uint32_t type;		/* enum ldms_dir_type */
+	uint32_t inst_name;	/* string table offsets */
+	uint32_t schema_name;
+	uint32_t info_idx;	/* first set-info entry of this set */
+	uint32_t info_count;
+	uint32_t meta_size;
+	uint32_t data_size;
+	uint32_t heap_size;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t perm;
+	uint32_t card;
+	uint32_t array_card;
+	uint64_t meta_gn;
+	uint64_t data_gn;
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t dur_sec;
+	uint32_t dur_usec;
+	uint32_t flags;		/* LDMS_DIR_BIN_F_* */
+	char state[4];		/* set state flags, as in the JSON "flags" */
+	unsigned char digest[LDMS_DIGEST_LENGTH];
+};
+
+struct ldms_dir_bin_kv {
+	uint32_t key;		/* string table offsets */
+	uint32_t value;
+};
+
 struct ldms_req_notify_reply {
 	struct ldms_notify_event_s event;
 };
@@ -351,6 +458,22 @@ struct ldms_xprt {
 	uint64_t local_dir_xid;
 	/* This is the peers local_dir_xid that we provide when providing dir updates */
 	uint64_t remote_dir_xid;
+	/* !0 if the peer asked for dir updates in the binary encoding */
+	int remote_dir_bin;
+	/* LDMS_CONN_F_* features advertised by the peer */
+	uint32_t peer_features;
+
+	/* !0 if this transport accepts stream messages */
+	int stream_recv;
+	/* Stream data bytes we may still send to the peer */
+	int64_t stream_credit;
+	/* Signaled when credit returns or the transport disconnects */
+	pthread_cond_t stream_credit_cond;
+	uint32_t stream_msg_no;
+	/* Stream data bytes delivered but not yet credited to the peer */
+	uint32_t stream_consumed;
+	/* The stream message being reassembled */
+	struct ldms_stream_rbuf *stream_rbuf;
 
 #ifdef DEBUG
 	int active_dir; /* Number of outstanding dir requests */
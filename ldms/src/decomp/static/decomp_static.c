@@ -55,6 +55,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include <openssl/evp.h>
 
@@ -339,27 +340,71 @@ typedef struct __decomp_static_row_cfg_s {
 	__decomp_index_t idxs; /* array of struct */
 	struct ldms_digest_s schema_digest;
 	size_t row_sz;
-	struct rbt mid_rbt; /* collection of metric IDs mapping */
+	size_t phony_off; /* offset of the phony metric values in a row */
+	int col_off; /* offset of the row columns in the resolved mid array */
+	/*
+	 * Released rows, ready to be reused. The row header and indices of
+	 * a cached row stay initialized; only the columns are refilled.
+	 */
+	struct ldmsd_row_list_s row_cache;
+	int row_cache_len;
 } *__decomp_static_row_cfg_t;
 
-typedef struct __decomp_static_cfg_s {
-	struct ldmsd_decomp_s decomp;
-	int row_count;
-	struct __decomp_static_row_cfg_s rows[OVIS_FLEX];
-} *__decomp_static_cfg_t;
+/* The maximum number of released rows cached by a row configuration */
+#define DECOMP_STATIC_ROW_CACHE_MAX 256
 
+/* metric IDs of a destination column resolved for an LDMS schema */
+typedef struct __decomp_static_col_mid_s {
+	int mid;
+	int rec_mid;
+	enum ldms_value_type mtype;
+	enum ldms_value_type rec_mtype;
+} *__decomp_static_col_mid_t;
+
+/*
+ * The metric IDs of all columns of all rows, resolved for an LDMS schema
+ * digest. The columns of row `i` start at `col_mids[rows[i].col_off]`.
+ */
 typedef struct __decomp_static_mid_rbn_s {
 	struct rbn rbn;
 	struct ldms_digest_s ldms_digest;
 	int col_count;
-	struct {
-		int mid;
-		int rec_mid;
-		enum ldms_value_type mtype;
-		enum ldms_value_type rec_mtype;
-	} col_mids[OVIS_FLEX];
+	struct __decomp_static_col_mid_s col_mids[OVIS_FLEX];
 } *__decomp_static_mid_rbn_t;
 
+/* per-column scratch state used while making the rows of a set */
+struct _col_mval_s {
+	ldms_mval_t mval;
+	ldms_mval_t rec_array;
+	union {
+		ldms_mval_t le;
+		ldms_mval_t rec;
+	};
+	enum ldms_value_type mtype;
+	size_t array_len;
+	int metric_id;
+	int rec_metric_id;
+	int rec_array_len;
+	int rec_array_idx;
+};
+
+typedef struct __decomp_static_scratch_s {
+	LIST_ENTRY(__decomp_static_scratch_s) entry;
+	struct _col_mval_s col_mvals[OVIS_FLEX];
+} *__decomp_static_scratch_t;
+
+typedef struct __decomp_static_cfg_s {
+	struct ldmsd_decomp_s decomp;
+	pthread_mutex_t lock; /* protects mid_rbt, scratch_list and row caches */
+	struct rbt mid_rbt; /* LDMS schema digest -> resolved metric IDs */
+	__decomp_static_mid_rbn_t last_mid_rbn; /* the most recently used */
+	LIST_HEAD(, __decomp_static_scratch_s) scratch_list;
+	int max_col_count; /* of all rows, to size the scratch */
+	int total_col_count; /* of all rows */
+	int row_count;
+	struct __decomp_static_row_cfg_s rows[OVIS_FLEX];
+} *__decomp_static_cfg_t;
+
 int __mid_rbn_cmp(void *tree_key, const void *key)
 {
 	return memcmp(tree_key, key, sizeof(struct ldms_digest_s));
@@ -387,8 +432,26 @@ static void __decomp_static_cfg_free(__decomp_static_cfg_t dcfg)
 	int i, j;
 	struct __decomp_static_row_cfg_s *drow;
 	struct __decomp_static_col_cfg_s *dcol;
+	__decomp_static_mid_rbn_t mid_rbn;
+	__decomp_static_scratch_t scratch;
+	ldmsd_row_t row;
+	if (!dcfg)
+		return;
+	while ((mid_rbn = (void*)rbt_min(&dcfg->mid_rbt))) {
+		rbt_del(&dcfg->mid_rbt, &mid_rbn->rbn);
+		free(mid_rbn);
+	}
+	while ((scratch = LIST_FIRST(&dcfg->scratch_list))) {
+		LIST_REMOVE(scratch, entry);
+		free(scratch);
+	}
 	for (i = 0; i < dcfg->row_count; i++) {
 		drow = &dcfg->rows[i];
+		/* cached rows */
+		while ((row = TAILQ_FIRST(&drow->row_cache))) {
+			TAILQ_REMOVE(&drow->row_cache, row, entry);
+			free(row);
+		}
 		/* cols */
 		for (j = 0; j < drow->col_count; j++) {
 			dcol = &drow->cols[j];
@@ -408,6 +471,7 @@ static void __decomp_static_cfg_free(__decomp_static_cfg_t dcfg)
 		/* schema */
 		free(drow->schema_name);
 	}
+	pthread_mutex_destroy(&dcfg->lock);
 	free(dcfg);
 }
 
@@ -454,6 +518,11 @@ __decomp_static_config( ldmsd_strgp_t strgp, json_entity_t jcfg,
 		goto err_0;
 	}
 	dcfg->decomp = __decomp_static;
+	pthread_mutex_init(&dcfg->lock, NULL);
+	rbt_init(&dcfg->mid_rbt, __mid_rbn_cmp);
+	LIST_INIT(&dcfg->scratch_list);
+	for (i = 0; i < jrows->item_count; i++)
+		TAILQ_INIT(&dcfg->rows[i].row_cache);
 
 	/* for each row schema */
 	i = 0;
@@ -468,7 +537,6 @@ __decomp_static_config( ldmsd_strgp_t strgp, json_entity_t jcfg,
 		drow = &dcfg->rows[i];
 		drow->row_sz = sizeof(struct ldmsd_row_s);
 		EVP_DigestInit_ex(evp_ctx, EVP_sha256(), NULL);
-		rbt_init(&drow->mid_rbt, __mid_rbn_cmp);
 
 		/* schema name */
 		jsch = __jdict_str(jrow, "schema");
@@ -725,6 +793,16 @@ __decomp_static_config( ldmsd_strgp_t strgp, json_entity_t jcfg,
 		free(col_id_tbl);
 		col_id_tbl = NULL;
 	next_row:
+		/* the phony metric values are at the end of the row */
+		drow->phony_off = drow->row_sz;
+		for (j = 0; j < drow->col_count; j++) {
+			if (0 == strcmp(drow->cols[j].src, "timestamp"))
+				drow->phony_off -= sizeof(union ldms_value);
+		}
+		drow->col_off = dcfg->total_col_count;
+		dcfg->total_col_count += drow->col_count;
+		if (dcfg->max_col_count < drow->col_count)
+			dcfg->max_col_count = drow->col_count;
 		dcfg->row_count++;
 		i++;
 	}
@@ -743,7 +821,7 @@ __decomp_static_config( ldmsd_strgp_t strgp, json_entity_t jcfg,
 	return NULL;
 }
 
-static int __decomp_static_resolve_mid(__decomp_static_mid_rbn_t mid_rbn,
+static int __decomp_static_resolve_mid(__decomp_static_col_mid_t col_mids,
 				       __decomp_static_row_cfg_t drow,
 				       ldms_set_t set)
 {
@@ -752,36 +830,36 @@ static int __decomp_static_resolve_mid(__decomp_static_mid_rbn_t mid_rbn,
 	size_t mlen;
 	const char *src;
 	enum ldms_value_type mtype;
-	for (i = 0; i < mid_rbn->col_count; i++) {
-		mid_rbn->col_mids[i].mid = -1;
-		mid_rbn->col_mids[i].rec_mid = -1;
+	for (i = 0; i < drow->col_count; i++) {
+		col_mids[i].mid = -1;
+		col_mids[i].rec_mid = -1;
 
 		src = drow->cols[i].src;
 
 		if (0 == strcmp(src, "timestamp")) {
-			mid_rbn->col_mids[i].mid = LDMSD_PHONY_METRIC_ID_TIMESTAMP;
-			mid_rbn->col_mids[i].rec_mtype = LDMS_V_TIMESTAMP;
+			col_mids[i].mid = LDMSD_PHONY_METRIC_ID_TIMESTAMP;
+			col_mids[i].rec_mtype = LDMS_V_TIMESTAMP;
 			continue;
 		}
 
 		if (0 == strcmp(src, "producer")) {
-			mid_rbn->col_mids[i].mid = LDMSD_PHONY_METRIC_ID_PRODUCER;
-			mid_rbn->col_mids[i].rec_mtype = LDMS_V_CHAR_ARRAY;
+			col_mids[i].mid = LDMSD_PHONY_METRIC_ID_PRODUCER;
+			col_mids[i].rec_mtype = LDMS_V_CHAR_ARRAY;
 			continue;
 		}
 
 		if (0 == strcmp(src, "instance")) {
-			mid_rbn->col_mids[i].mid = LDMSD_PHONY_METRIC_ID_INSTANCE;
-			mid_rbn->col_mids[i].rec_mtype = LDMS_V_CHAR_ARRAY;
+			col_mids[i].mid = LDMSD_PHONY_METRIC_ID_INSTANCE;
+			col_mids[i].rec_mtype = LDMS_V_CHAR_ARRAY;
 			continue;
 		}
 
 		mid = ldms_metric_by_name(set, drow->cols[i].src);
-		mid_rbn->col_mids[i].mid = mid;
+		col_mids[i].mid = mid;
 		if (mid < 0) /* OK to not exist */
 			continue;
 		mtype = ldms_metric_type_get(set, mid);
-		mid_rbn->col_mids[i].mtype = mtype;
+		col_mids[i].mtype = mtype;
 		if (mtype == LDMS_V_LIST)
 			goto list_routine;
 		if (mtype == LDMS_V_RECORD_ARRAY)
@@ -789,11 +867,11 @@ static int __decomp_static_resolve_mid(__decomp_static_mid_rbn_t mid_rbn,
 
 		/* primitives & array of primitives */
 		if (mtype > LDMS_V_D64_ARRAY) {
-			mid_rbn->col_mids[i].mid = -EINVAL;
+			col_mids[i].mid = -EINVAL;
 			continue;
 		}
-		mid_rbn->col_mids[i].rec_mid = -EINVAL;
-		mid_rbn->col_mids[i].rec_mtype = LDMS_V_NONE;
+		col_mids[i].rec_mid = -EINVAL;
+		col_mids[i].rec_mtype = LDMS_V_NONE;
 		continue;
 
 	list_routine:
@@ -802,27 +880,27 @@ static int __decomp_static_resolve_mid(__decomp_static_mid_rbn_t mid_rbn,
 		le = ldms_list_first(set, lh, &mtype, &mlen);
 		if (!le) {
 			/* list empty. can't init yet */
-			mid_rbn->col_mids[i].rec_mid = -1;
+			col_mids[i].rec_mid = -1;
 			continue;
 		}
 		if (mtype == LDMS_V_LIST) {
 			/* LIST of LIST is not supported */
-			mid_rbn->col_mids[i].rec_mid = -EINVAL;
-			mid_rbn->col_mids[i].rec_mtype = LDMS_V_NONE;
+			col_mids[i].rec_mid = -EINVAL;
+			col_mids[i].rec_mtype = LDMS_V_NONE;
 			continue;
 		}
 		if (!drow->cols[i].rec_member) {
 			/* expect LIST of non-record elements */
-			mid_rbn->col_mids[i].rec_mid = -EINVAL;
-			mid_rbn->col_mids[i].rec_mtype = LDMS_V_NONE;
+			col_mids[i].rec_mid = -EINVAL;
+			col_mids[i].rec_mtype = LDMS_V_NONE;
 			continue;
 		}
 		/* handling LIST of records */
 		mid = ldms_record_metric_find(le, drow->cols[i].rec_member);
-		mid_rbn->col_mids[i].rec_mid = mid;
+		col_mids[i].rec_mid = mid;
 		if (mid >= 0) {
 			mtype = ldms_record_metric_type_get(le, mid, &mlen);
-			mid_rbn->col_mids[i].rec_mtype = mtype;
+			col_mids[i].rec_mtype = mtype;
 		}
 		continue;
 
@@ -830,24 +908,155 @@ static int __decomp_static_resolve_mid(__decomp_static_mid_rbn_t mid_rbn,
 		rec_array = ldms_metric_get(set, mid);
 		rec = ldms_record_array_get_inst(rec_array, 0);
 		if (!drow->cols[i].rec_member) {
-			mid_rbn->col_mids[i].rec_mid = -EINVAL;
-			mid_rbn->col_mids[i].rec_mtype = LDMS_V_NONE;
+			col_mids[i].rec_mid = -EINVAL;
+			col_mids[i].rec_mtype = LDMS_V_NONE;
 			continue;
 		}
 		mid = ldms_record_metric_find(rec, drow->cols[i].rec_member);
 		if (mid < 0) {
-			mid_rbn->col_mids[i].rec_mid = -ENOENT;
-			mid_rbn->col_mids[i].rec_mtype = LDMS_V_NONE;
+			col_mids[i].rec_mid = -ENOENT;
+			col_mids[i].rec_mtype = LDMS_V_NONE;
 			continue;
 		}
 		mtype = ldms_record_metric_type_get(rec, mid, &mlen);
-		mid_rbn->col_mids[i].rec_mid = mid;
-		mid_rbn->col_mids[i].rec_mtype = mtype;
+		col_mids[i].rec_mid = mid;
+		col_mids[i].rec_mtype = mtype;
 		continue;
 	}
 	return 0;
 }
 
+/*
+ * Get the metric IDs resolved for the LDMS schema of `set`, resolving them
+ * for all rows the first time the schema digest is seen.
+ */
+static __decomp_static_mid_rbn_t
+__decomp_static_mid_rbn_get(__decomp_static_cfg_t dcfg, ldms_set_t set,
+			    ldms_digest_t ldms_digest)
+{
+	__decomp_static_mid_rbn_t mid_rbn;
+	int i, rc;
+
+	pthread_mutex_lock(&dcfg->lock);
+	mid_rbn = (void*)rbt_find(&dcfg->mid_rbt, ldms_digest);
+	if (mid_rbn)
+		goto out;
+	mid_rbn = calloc(1, sizeof(*mid_rbn) +
+			    dcfg->total_col_count * sizeof(mid_rbn->col_mids[0]));
+	if (!mid_rbn) {
+		rc = ENOMEM;
+		goto err;
+	}
+	memcpy(&mid_rbn->ldms_digest, ldms_digest, sizeof(*ldms_digest));
+	rbn_init(&mid_rbn->rbn, &mid_rbn->ldms_digest);
+	mid_rbn->col_count = dcfg->total_col_count;
+	for (i = 0; i < dcfg->row_count; i++) {
+		rc = __decomp_static_resolve_mid(
+				&mid_rbn->col_mids[dcfg->rows[i].col_off],
+				&dcfg->rows[i], set);
+		if (rc) {
+			free(mid_rbn);
+			goto err;
+		}
+	}
+	rbt_ins(&dcfg->mid_rbt, &mid_rbn->rbn);
+ out:
+	__atomic_store_n(&dcfg->last_mid_rbn, mid_rbn, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&dcfg->lock);
+	return mid_rbn;
+ err:
+	pthread_mutex_unlock(&dcfg->lock);
+	errno = rc;
+	return NULL;
+}
+
+static __decomp_static_scratch_t
+__decomp_static_scratch_get(__decomp_static_cfg_t dcfg)
+{
+	__decomp_static_scratch_t scratch;
+
+	pthread_mutex_lock(&dcfg->lock);
+	scratch = LIST_FIRST(&dcfg->scratch_list);
+	if (scratch)
+		LIST_REMOVE(scratch, entry);
+	pthread_mutex_unlock(&dcfg->lock);
+	if (scratch)
+		return scratch;
+	return malloc(sizeof(*scratch) +
+		      dcfg->max_col_count * sizeof(scratch->col_mvals[0]));
+}
+
+static void __decomp_static_scratch_put(__decomp_static_cfg_t dcfg,
+					__decomp_static_scratch_t scratch)
+{
+	pthread_mutex_lock(&dcfg->lock);
+	LIST_INSERT_HEAD(&dcfg->scratch_list, scratch, entry);
+	pthread_mutex_unlock(&dcfg->lock);
+}
+
+/*
+ * Get a row of `drow` shape with the header and the indices initialized,
+ * reusing a released row if there is one.
+ */
+static ldmsd_row_t __decomp_static_row_get(__decomp_static_cfg_t dcfg,
+					   __decomp_static_row_cfg_t drow)
+{
+	ldmsd_row_t row;
+	ldmsd_row_index_t idx;
+	int j, k, c;
+
+	pthread_mutex_lock(&dcfg->lock);
+	row = TAILQ_FIRST(&drow->row_cache);
+	if (row) {
+		TAILQ_REMOVE(&drow->row_cache, row, entry);
+		drow->row_cache_len--;
+	}
+	pthread_mutex_unlock(&dcfg->lock);
+	if (row)
+		return row;
+
+	row = calloc(1, drow->row_sz);
+	if (!row)
+		return NULL;
+	row->schema_name = drow->schema_name;
+	row->schema_digest = &drow->schema_digest;
+	row->idx_count = drow->idx_count;
+	row->col_count = drow->col_count;
+
+	/* indices */
+	row->indices = (void*)&row->cols[row->col_count];
+	idx = (void*)&row->indices[row->idx_count];
+	for (j = 0; j < row->idx_count; j++) {
+		row->indices[j] = idx;
+		idx->col_count = drow->idxs[j].col_count;
+		idx->name = drow->idxs[j].name;
+		for (k = 0; k < idx->col_count; k++) {
+			c = drow->idxs[j].col_idx[k];
+			idx->cols[k] = &row->cols[c];
+		}
+		idx = (void*)&idx->cols[idx->col_count];
+	}
+	assert((void*)idx == (void*)row + drow->phony_off);
+	return row;
+}
+
+/* Return the row to the cache of its row configuration */
+static void __decomp_static_row_put(__decomp_static_cfg_t dcfg, ldmsd_row_t row)
+{
+	__decomp_static_row_cfg_t drow;
+
+	drow = container_of(row->schema_digest,
+			    struct __decomp_static_row_cfg_s, schema_digest);
+	pthread_mutex_lock(&dcfg->lock);
+	if (drow->row_cache_len < DECOMP_STATIC_ROW_CACHE_MAX) {
+		TAILQ_INSERT_HEAD(&drow->row_cache, row, entry);
+		drow->row_cache_len++;
+		row = NULL;
+	}
+	pthread_mutex_unlock(&dcfg->lock);
+	free(row);
+}
+
 static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 				     ldmsd_row_list_t row_list, int *row_count)
 {
@@ -856,26 +1065,14 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 	__decomp_static_col_cfg_t dcol;
 	ldmsd_row_t row;
 	ldmsd_col_t col;
-	ldmsd_row_index_t idx;
 	ldms_mval_t mval, lh, le, rec_array;
 	enum ldms_value_type mtype;
 	size_t mlen;
-	int i, j, k, c, mid, rc, rec_mid;
-	struct _col_mval_s {
-		ldms_mval_t mval;
-		ldms_mval_t rec_array;
-		union {
-			ldms_mval_t le;
-			ldms_mval_t rec;
-		};
-		enum ldms_value_type mtype;
-		size_t array_len;
-		int metric_id;
-		int rec_metric_id;
-		int rec_array_len;
-		int rec_array_idx;
-	} *col_mvals = NULL, *mcol;
+	int i, j, mid, rc, rec_mid;
+	__decomp_static_scratch_t scratch;
+	struct _col_mval_s *col_mvals, *mcol;
 	__decomp_static_mid_rbn_t mid_rbn;
+	__decomp_static_col_mid_t col_mids;
 	ldms_digest_t ldms_digest;
 	TAILQ_HEAD(, _list_entry) list_cols;
 	int row_more_le;
@@ -898,39 +1095,29 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 	TAILQ_INIT(&list_cols);
 	ldms_digest = ldms_set_digest_get(set);
 
+	/* mid resolve; the common case is the same LDMS schema as last time */
+	mid_rbn = __atomic_load_n(&dcfg->last_mid_rbn, __ATOMIC_ACQUIRE);
+	if (!mid_rbn || memcmp(&mid_rbn->ldms_digest, ldms_digest,
+			       sizeof(*ldms_digest))) {
+		mid_rbn = __decomp_static_mid_rbn_get(dcfg, set, ldms_digest);
+		if (!mid_rbn)
+			return errno;
+	}
+
+	/* col_mvals is a temporary scratch paper to create rows from a set
+	 * with records. It is returned to the config at the end. */
+	scratch = __decomp_static_scratch_get(dcfg);
+	if (!scratch)
+		return ENOMEM;
+	col_mvals = scratch->col_mvals;
+
 	*row_count = 0;
 	for (i = 0; i < dcfg->row_count; i++) {
 		drow = &dcfg->rows[i];
-
-		/* mid resolve */
-		mid_rbn = (void*)rbt_find(&drow->mid_rbt, ldms_digest);
-		if (mid_rbn) /* metric IDs have already been resolved for this LDMS schema */
-			goto make_col_mvals;
-		/* Resolving `src` -> metric ID */
-		mid_rbn = calloc(1, sizeof(*mid_rbn) +
-				    drow->col_count * sizeof(mid_rbn->col_mids[0]));
-		if (!mid_rbn) {
-			rc = ENOMEM;
-			goto err_0;
-		}
-		memcpy(&mid_rbn->ldms_digest, ldms_digest, sizeof(*ldms_digest));
-		rbn_init(&mid_rbn->rbn, &mid_rbn->ldms_digest);
-		mid_rbn->col_count = drow->col_count;
-		rbt_ins(&drow->mid_rbt, &mid_rbn->rbn);
-		rc = __decomp_static_resolve_mid(mid_rbn, drow, set);
-		if (rc)
-			goto err_0;
-	make_col_mvals:
-		/* col_mvals is a temporary scratch paper to create rows from
-		 * a set with records. col_mvals is freed at the end of
-		 * `make_row`. */
-		col_mvals = calloc(1, drow->col_count * sizeof(*col_mvals));
-		if (!col_mvals) {
-			rc = ENOMEM;
-			goto err_0;
-		}
+		col_mids = &mid_rbn->col_mids[drow->col_off];
+		memset(col_mvals, 0, drow->col_count * sizeof(*col_mvals));
 		for (j = 0; j < drow->col_count; j++) {
-			mid = mid_rbn->col_mids[j].mid;
+			mid = col_mids[j].mid;
 			mcol = &col_mvals[j];
 			if (mid < 0) /* metric not existed in the set */
 				goto col_mvals_fill;
@@ -962,11 +1149,11 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 			}
 			mval = ldms_metric_get(set, mid);
 			mtype = ldms_metric_type_get(set, mid);
-			if (mtype != mid_rbn->col_mids[j].mtype) {
+			if (mtype != col_mids[j].mtype) {
 				ldmsd_lerror("strgp '%s': the metric type (%s) of "
 					     "row %d:col %d is different from the type (%s) of "
 					     "LDMS metric '%s'.\n", strgp->obj.name,
-					     ldms_metric_type_to_str(mid_rbn->col_mids[j].mtype),
+					     ldms_metric_type_to_str(col_mids[j].mtype),
 					     i, j, ldms_metric_type_to_str(mtype),
 					     ldms_metric_name_get(set, mid));
 				rc = EINVAL;
@@ -1008,7 +1195,8 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 			continue;
 		col_mvals_rec_mid:
 			/* handling record */
-			rec_mid = mid_rbn->col_mids[j].rec_mid;
+			rec_mid = __atomic_load_n(&col_mids[j].rec_mid,
+						  __ATOMIC_RELAXED);
 			if (rec_mid >= 0) {
 				mval = ldms_record_metric_get(le, rec_mid);
 				mcol->mval = mval;
@@ -1018,9 +1206,15 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 			}
 			if (rec_mid == -1) {
 				/* has not been resolved yet ..
-				 * try resolving it here */
+				 * try resolving it here. The cache is shared
+				 * by the threads decomposing sets of this
+				 * digest; they all resolve the same id, so
+				 * the first one to store it wins. */
+				int unresolved = -1;
 				rec_mid = ldms_record_metric_find(le, drow->cols[j].rec_member);
-				mid_rbn->col_mids[j].rec_mid = rec_mid;
+				__atomic_compare_exchange_n(&col_mids[j].rec_mid,
+						&unresolved, rec_mid, 0,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED);
 				goto col_mvals_rec_mid;
 			}
 			/* member not exist, use fill */
@@ -1028,7 +1222,8 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 			goto col_mvals_fill;
 
 		col_mvals_rec_array:
-			rec_mid = mid_rbn->col_mids[j].rec_mid;
+			rec_mid = __atomic_load_n(&col_mids[j].rec_mid,
+						  __ATOMIC_RELAXED);
 			if (rec_mid < 0) {
 				mcol->rec_metric_id = rec_mid;
 				goto col_mvals_fill;
@@ -1051,32 +1246,14 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 		}
 
 	make_row: /* make/expand rows according to col_mvals */
-		row = calloc(1, drow->row_sz);
+		row = __decomp_static_row_get(dcfg, drow);
 		if (!row) {
 			rc = errno;
 			goto err_0;
 		}
-		row->schema_name = drow->schema_name;
-		row->schema_digest = &drow->schema_digest;
-		row->idx_count = drow->idx_count;
-		row->col_count = drow->col_count;
-
-		/* indices */
-		row->indices = (void*)&row->cols[row->col_count];
-		idx = (void*)&row->indices[row->idx_count];
-		for (j = 0; j < row->idx_count; j++) {
-			row->indices[j] = idx;
-			idx->col_count = drow->idxs[j].col_count;
-			idx->name = drow->idxs[j].name;
-			for (k = 0; k < idx->col_count; k++) {
-				c = drow->idxs[j].col_idx[k];
-				idx->cols[k] = &row->cols[c];
-			}
-			idx = (void*)&idx->cols[idx->col_count];
-		}
 
 		/* phony mvals are next to the idx data */
-		phony = (void*)idx;
+		phony = (void*)row + drow->phony_off;
 
 		row_more_le = 0;
 		/* cols */
@@ -1086,6 +1263,7 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 			mcol = &col_mvals[j];
 
 			if (dcol->type != mcol->mtype) {
+				__decomp_static_row_put(dcfg, row);
 				ldmsd_lerror("strgp '%s': row '%d' col[dst] '%s': "
 					     "the value type (%s) is not "
 					     "compatible with the source metric type (%s). "
@@ -1103,7 +1281,7 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 			col->name = dcol->dst;
 			col->type = mcol->mtype;
 			col->array_len = mcol->array_len;
-			if (mid_rbn->col_mids[j].mid == LDMSD_PHONY_METRIC_ID_TIMESTAMP) {
+			if (col_mids[j].mid == LDMSD_PHONY_METRIC_ID_TIMESTAMP) {
 				phony->v_ts = ts;
 				col->mval = phony;
 				phony++;
@@ -1126,7 +1304,8 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 			row_more_le = 1;
 			if (drow->cols[j].rec_member) {
 				/* expect record */
-				rec_mid = mid_rbn->col_mids[j].rec_mid;
+				rec_mid = __atomic_load_n(&col_mids[j].rec_mid,
+							  __ATOMIC_RELAXED);
 				if (rec_mid < 0) {
 					goto col_fill;
 				}
@@ -1142,7 +1321,8 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 			continue;
 
 		col_rec_array:
-			rec_mid = mid_rbn->col_mids[j].rec_mid;
+			rec_mid = __atomic_load_n(&col_mids[j].rec_mid,
+						  __ATOMIC_RELAXED);
 			if (rec_mid < 0 || mcol->rec_array_idx < 0)
 				goto col_fill;
 			/* step */
@@ -1165,14 +1345,12 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 		row = NULL;
 		if (row_more_le)
 			goto make_row;
-		free(col_mvals);
-		col_mvals = NULL;
 	}
+	__decomp_static_scratch_put(dcfg, scratch);
 	return 0;
  err_0:
 	/* clean up stuff here */
-	if (col_mvals)
-		free(col_mvals);
+	__decomp_static_scratch_put(dcfg, scratch);
 	__decomp_static_release_rows(strgp, row_list);
 	return rc;
 }
@@ -1180,9 +1358,10 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 static void __decomp_static_release_rows(ldmsd_strgp_t strgp,
 					 ldmsd_row_list_t row_list)
 {
+	__decomp_static_cfg_t dcfg = (void*)strgp->decomp;
 	ldmsd_row_t row;
 	while ((row = TAILQ_FIRST(row_list))) {
 		TAILQ_REMOVE(row_list, row, entry);
-		free(row);
+		__decomp_static_row_put(dcfg, row);
 	}
 }
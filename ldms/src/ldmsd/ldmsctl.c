@@ -529,8 +529,10 @@ static int __thread_stats_print(json_entity_t stats)
 		return EINVAL;
 	}
 
-	printf("%-16s %-12s %-12s\n", "Name", "Samples", "Utilization");
-	printf("---------------- ------------ ------------\n");
+	printf("%-16s %-12s %-12s %-12s %-12s\n", "Name", "Samples",
+			"Utilization", "Migrated In", "Migrated Out");
+	printf("---------------- ------------ ------------ ------------ "
+			"------------\n");
 	entries = json_value_find(stats, "entries");
 	if (entries->type != JSON_LIST_VALUE) {
 		printf("Unrecognized thread stats format\n");
@@ -543,9 +545,13 @@ static int __thread_stats_print(json_entity_t stats)
 				json_value_int(json_value_find(e, "sample_count")));
 		u = json_value_find(e, "utilization");
 		if (u->type == JSON_INT_VALUE)
-			printf("%12ld\n", json_value_int(u));
+			printf("%12ld ", json_value_int(u));
 		else
-			printf("%12g\n", json_value_float(u));
+			printf("%12g ", json_value_float(u));
+		u = json_value_find(e, "migrated_in");
+		printf("%12ld ", u ? json_value_int(u) : 0);
+		u = json_value_find(e, "migrated_out");
+		printf("%12ld\n", u ? json_value_int(u) : 0);
 	}
 	return 0;
 }
@@ -911,6 +917,9 @@ static void help_updtr_add()
 		"                       the given interval and offset values. If not\n"
 		"                       specified, the value is `false`.\n"
 		"     [perm=]      The permission to modify the updater in the future.\n"
+		"     [delta=]     [true|false] If true, only the data that changed since\n"
+		"                  the previous update is transferred when the transport\n"
+		"                  and the producer support it. The default is `false`.\n"
 		);
 
 }
@@ -1034,6 +1043,29 @@ void __print_updtr_status(json_entity_t updtr)
 				json_value_str(xprt)->str,
 				json_value_str(prdcr_state)->str);
 	}
+
+	json_entity_t tick = json_value_find(updtr, "tick");
+	if (!tick)
+		return;
+	if (tick->type != JSON_DICT_VALUE)
+		goto invalid_result_format;
+	json_entity_t cpu = json_value_find(tick, "cpu_us");
+	if (!cpu || cpu->type != JSON_DICT_VALUE)
+		goto invalid_result_format;
+	printf("    ticks %" PRId64 " sets %" PRId64 " updates %" PRId64
+	       " rebuilds %" PRId64 "\n"
+	       "    last tick: sets %" PRId64 " updates %" PRId64
+	       " cpu %.1f us (min %.1f avg %.1f max %.1f)\n",
+	       json_value_int(json_value_find(tick, "count")),
+	       json_value_int(json_value_find(tick, "sets")),
+	       json_value_int(json_value_find(tick, "updates")),
+	       json_value_int(json_value_find(tick, "rebuilds")),
+	       json_value_int(json_value_find(tick, "last_sets")),
+	       json_value_int(json_value_find(tick, "last_updates")),
+	       json_value_float(json_value_find(cpu, "last")),
+	       json_value_float(json_value_find(cpu, "min")),
+	       json_value_float(json_value_find(cpu, "avg")),
+	       json_value_float(json_value_find(cpu, "max")));
 	return;
 
 invalid_result_format:
@@ -1267,7 +1299,17 @@ static void help_strgp_add()
 		"     [flush=]     The interval between calls to the storage plugin flush method.\n"
 		"                  By default, the flush method is not called.\n"
 		"     [perm=]      The permission to modify the storage policy in the future.\n"
-		"     [decomposition=]   The path to the decomposition configuration file.\n");
+		"     [decomposition=]   The path to the decomposition configuration file.\n"
+		"     [queue_depth=]     The number of set updates that can be queued for the\n"
+		"                        storage worker threads. By default (0), the data is\n"
+		"                        stored synchronously in the update completion path.\n"
+		"     [queue_threads=]   The number of storage worker threads (default 1).\n"
+		"     [queue_policy=]    The action when the queue is full: drop_oldest\n"
+		"                        (default), drop_newest or block.\n"
+		"     [commit=]          serial (default) stores in the update completion\n"
+		"                        path, one storage policy after the other; parallel\n"
+		"                        commits on the shared commit threads together with\n"
+		"                        the other parallel storage policies of the set.\n");
 }
 
 static void help_strgp_del()
@@ -1327,6 +1369,42 @@ static void help_strgp_stop()
 		"     name=   The storage policy name\n");
 }
 
+/* Upper bound in us of the latency histogram bucket of the p-th percentile */
+static int64_t __lat_hist_pct(json_entity_t buckets, int64_t count, double p)
+{
+	json_entity_t b;
+	int64_t n = 0, target = count * p;
+	int i = 0;
+
+	for (b = json_item_first(buckets); b; b = json_item_next(b), i++) {
+		n += json_value_int(b);
+		if (n > target)
+			break;
+	}
+	return (int64_t)1 << i;
+}
+
+static void __print_lat_hist(const char *name, json_entity_t hist)
+{
+	json_entity_t count, buckets;
+
+	if (!hist || hist->type != JSON_DICT_VALUE)
+		return;
+	count = json_value_find(hist, "count");
+	buckets = json_value_find(hist, "buckets");
+	if (!count || !buckets || buckets->type != JSON_LIST_VALUE)
+		return;
+	if (!json_value_int(count)) {
+		printf("%12s: no samples\n", name);
+		return;
+	}
+	printf("%12s: count %" PRId64 " p50 < %" PRId64 " us p99 < %" PRId64
+	       " us p999 < %" PRId64 " us\n", name, json_value_int(count),
+	       __lat_hist_pct(buckets, json_value_int(count), 0.50),
+	       __lat_hist_pct(buckets, json_value_int(count), 0.99),
+	       __lat_hist_pct(buckets, json_value_int(count), 0.999));
+}
+
 void __print_strgp_status(json_entity_t strgp)
 {
 	if (strgp->type != JSON_DICT_VALUE)
@@ -1380,6 +1458,41 @@ void __print_strgp_status(json_entity_t strgp)
 		printf(" %s", json_value_str(metric)->str);
 	}
 	printf("\n");
+
+	json_entity_t commit = json_value_find(strgp, "commit");
+	json_entity_t latency = json_value_find(strgp, "latency");
+	if (commit && latency) {
+		if (latency->type != JSON_DICT_VALUE)
+			goto invalid_result_format;
+		printf("      commit: %s\n", json_value_str(commit)->str);
+		__print_lat_hist("update", json_value_find(latency, "update"));
+		__print_lat_hist("commit", json_value_find(latency, "commit"));
+	}
+
+	json_entity_t queue = json_value_find(strgp, "queue");
+	if (!queue)
+		return;
+	if (queue->type != JSON_DICT_VALUE)
+		goto invalid_result_format;
+	json_entity_t policy = json_value_find(queue, "policy");
+	if (!policy)
+		goto invalid_result_format;
+	printf("       queue: policy %s depth %" PRId64 "/%" PRId64
+	       " high_water %" PRId64 " threads %" PRId64 "\n"
+	       "              enqueued %" PRId64 " stored %" PRId64
+	       " dropped_oldest %" PRId64 " dropped_newest %" PRId64
+	       " blocked %" PRId64 " block_timeouts %" PRId64 "\n",
+	       json_value_str(policy)->str,
+	       json_value_int(json_value_find(queue, "depth")),
+	       json_value_int(json_value_find(queue, "max_depth")),
+	       json_value_int(json_value_find(queue, "high_water")),
+	       json_value_int(json_value_find(queue, "threads")),
+	       json_value_int(json_value_find(queue, "enqueued")),
+	       json_value_int(json_value_find(queue, "stored")),
+	       json_value_int(json_value_find(queue, "dropped_oldest")),
+	       json_value_int(json_value_find(queue, "dropped_newest")),
+	       json_value_int(json_value_find(queue, "blocked")),
+	       json_value_int(json_value_find(queue, "block_timeouts")));
 	return;
 
 invalid_result_format:
@@ -1502,6 +1615,78 @@ static void help_plugn_sets()
 	       "      [name]=   Plugin name\n");
 }
 
+static void help_plugn_jitter()
+{
+	printf("\nQuery the wake up jitter statistics of the samplers\n"
+	       "Parameters:\n"
+	       "      [name]=   Sampler plugin name\n"
+	       "      [reset]=  true to clear the statistics after the query\n");
+}
+
+static void __print_plugn_jitter(json_entity_t pi)
+{
+	json_entity_t hist, h;
+	uint64_t lo;
+	int i;
+
+	printf("%-16s %6ld %12ld %12ld %12ld %12ld\n",
+		json_value_str(json_value_find(pi, "name"))->str,
+		json_value_int(json_value_find(pi, "thread_id")),
+		json_value_int(json_value_find(pi, "count")),
+		json_value_int(json_value_find(pi, "min_ns")),
+		json_value_int(json_value_find(pi, "mean_ns")),
+		json_value_int(json_value_find(pi, "max_ns")));
+	hist = json_value_find(pi, "hist");
+	if (!hist || hist->type != JSON_LIST_VALUE)
+		return;
+	for (i = 0, h = json_item_first(hist); h; i++, h = json_item_next(h)) {
+		if (!json_value_int(h))
+			continue;
+		lo = i ? (1UL << i) : 0;
+		printf("    >= %12lu ns %12ld\n", lo, json_value_int(h));
+	}
+}
+
+static void resp_plugn_jitter(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp_err)
+{
+	if (rsp_err) {
+		resp_generic(resp, len, rsp_err);
+		return;
+	}
+
+	ldmsd_req_attr_t attr = ldmsd_first_attr(resp);
+	if (!attr->discrim || (attr->attr_id != LDMSD_ATTR_JSON))
+		return;
+
+	json_parser_t parser;
+	json_entity_t json, pi;
+	int rc;
+	parser = json_parser_new(0);
+	if (!parser) {
+		printf("Error creating a JSON parser.\n");
+		return;
+	}
+	rc = json_parse_buffer(parser, (char*)attr->attr_value, len, &json);
+	json_parser_free(parser);
+	if (rc) {
+		printf("syntax error parsing JSON string\n");
+		return;
+	}
+
+	if (json->type != JSON_LIST_VALUE) {
+		printf("---Invalid result format---\n");
+		goto out;
+	}
+
+	printf("%-16s %-6s %-12s %-12s %-12s %-12s\n",
+		"Name", "Thread", "Wakeups", "Min(ns)", "Mean(ns)", "Max(ns)");
+	printf("---------------- ------ ------------ ------------ ------------ ------------\n");
+	for (pi = json_item_first(json); pi; pi = json_item_next(pi))
+		__print_plugn_jitter(pi);
+out:
+	json_entity_free(json);
+}
+
 static void help_version()
 {
 	printf( "\nGet the LDMS version.\n");
@@ -2401,6 +2586,7 @@ static struct command command_tbl[] = {
 	{ "metric_sets_default_authz", LDMSD_SET_DEFAULT_AUTHZ_REQ, NULL,
 			help_metric_sets_default_authz, resp_generic },
 	{ "oneshot", LDMSD_ONESHOT_REQ, NULL, help_oneshot, resp_generic },
+	{ "plugn_jitter", LDMSD_PLUGN_JITTER_REQ, NULL, help_plugn_jitter, resp_plugn_jitter },
 	{ "plugn_sets", LDMSD_PLUGN_SETS_REQ, NULL, help_plugn_sets, resp_plugn_sets },
 	{ "prdcr_add", LDMSD_PRDCR_ADD_REQ, NULL, help_prdcr_add, resp_generic },
 	{ "prdcr_del", LDMSD_PRDCR_DEL_REQ, NULL, help_prdcr_del, resp_generic },
@@ -96,7 +96,7 @@
 #define LDMSD_LOGFILE "/var/log/ldmsd.log"
 #define LDMSD_PIDFILE_FMT "/var/run/%s.pid"
 
-const char *short_opts = "B:l:s:x:P:m:Fkr:v:Vc:u:a:A:n:tL:";
+const char *short_opts = "B:l:s:x:P:C:m:Fkr:v:Vc:u:a:A:n:tL:";
 
 struct option long_opts[] = {
 	{ "default_auth_args",     required_argument, 0,  'A' },
@@ -107,6 +107,7 @@ struct option long_opts[] = {
 	{ "set_memory",            required_argument, 0,  'm' },
 	{ "daemon_name",           required_argument, 0,  'n' },
 	{ "worker_threads",        required_argument, 0,  'P' },
+	{ "worker_cpus",           required_argument, 0,  'C' },
 	{ "pid_file",              required_argument, 0,  'r' },
 	{ "kernel_file",           required_argument, 0,  's' },
 	{ "log_level",             required_argument, 0,  'v' },
@@ -646,6 +647,8 @@ void usage_hint(char *argv[],char *hint)
 	       "                                                  [" LDMSD_SETFILE "]\n");
 	printf("  Thread Options\n");
 	printf("    -P COUNT,     --worker_threads COUNT          Count of event threads to start.\n");
+	printf("    -C CPUS,      --worker_cpus CPUS              Pin the event threads to the CPU list CPUS, e.g. 0-3,8.\n"
+	       "                                                  Thread i is pinned to the i-th CPU (modulo the list length).\n");
 	printf("  Configuration Options\n");
 	printf("    -c PATH                                       The path to configuration file (optional, default: <none>).\n");
 	printf("    -V                                            Print LDMS version and exit.\n");
@@ -666,6 +669,8 @@ int ev_thread_count = 0;
 ovis_scheduler_t *ovis_scheduler;
 pthread_t *ev_thread;		/* sampler threads */
 int *ev_count;			/* number of hosts/samplers assigned to each thread */
+int *ev_cpus;			/* CPUs to pin the sampler threads to */
+int ev_cpu_count;
 
 int find_least_busy_thread()
 {
@@ -697,6 +702,63 @@ pthread_t get_thread(int idx)
 	return ev_thread[idx];
 }
 
+/*
+ * Parse a CPU list such as "0-3,8" into ev_cpus.
+ */
+static int parse_cpu_list(const char *str)
+{
+	char *s, *tok, *ptr, *end;
+	long lo, hi;
+	int *cpus = NULL, *tmp;
+	int n = 0;
+	int rc = EINVAL;
+
+	s = strdup(str);
+	if (!s)
+		return ENOMEM;
+	for (tok = strtok_r(s, ",", &ptr); tok; tok = strtok_r(NULL, ",", &ptr)) {
+		lo = strtol(tok, &end, 10);
+		if (end == tok || lo < 0)
+			goto out;
+		hi = lo;
+		if (*end == '-') {
+			tok = end + 1;
+			hi = strtol(tok, &end, 10);
+			if (end == tok || hi < lo)
+				goto out;
+		}
+		if (*end != '\0')
+			goto out;
+		tmp = realloc(cpus, (n + hi - lo + 1) * sizeof(*cpus));
+		if (!tmp) {
+			rc = ENOMEM;
+			goto out;
+		}
+		cpus = tmp;
+		while (lo <= hi)
+			cpus[n++] = lo++;
+	}
+	if (!n)
+		goto out;
+	free(ev_cpus);
+	ev_cpus = cpus;
+	ev_cpu_count = n;
+	cpus = NULL;
+	rc = 0;
+out:
+	free(cpus);
+	free(s);
+	return rc;
+}
+
+static int ev_thread_pin(int idx)
+{
+	if (!ev_cpu_count)
+		return 0;
+	return ovis_scheduler_affinity_set(ovis_scheduler[idx],
+					   &ev_cpus[idx % ev_cpu_count], 1);
+}
+
 void kpublish(int map_fd, int set_no, int set_size, char *set_name)
 {
 	ldms_set_t map_set;
@@ -1390,8 +1452,7 @@ int ldmsd_start_sampler(char *plugin_name, char *interval, char *offset)
 	pi->sample_interval_us = sample_interval;
 	if (offset) {
 		sample_offset = strtol(offset, NULL, 0);
-		if ( !((sample_interval >= 10) &&
-		       (sample_interval >= labs(sample_offset)*2)) ){
+		if (sample_interval < labs(sample_offset)*2) {
 			rc = EDOM;
 			goto out;
 		}
@@ -1403,6 +1464,7 @@ int ldmsd_start_sampler(char *plugin_name, char *interval, char *offset)
 	pi->oev.param.periodic.phase_us = sample_offset;
 	pi->oev.param.ctxt = pi;
 	pi->oev.param.cb_fn = plugin_sampler_cb;
+	ovis_event_jitter_reset(&pi->oev);
 
 	pi->ref_count++;
 
@@ -1761,6 +1823,8 @@ int ldmsd_listen_start(ldmsd_listen_t listen)
 		free(args);
 		goto out;
 	}
+	/* Publishers may send stream data as ldms stream messages */
+	ldms_xprt_stream_recv_enable(listen->x);
 
 	rc = listen_on_ldms_xprt(listen);
  out:
@@ -1922,6 +1986,7 @@ int ldmsd_process_cmd_line_arg(char opt, char *value)
 {
 	char *lval, *rval;
 	char *dup_auth;
+	int i, rc;
 	switch (opt) {
 	case 'B':
 		if (check_arg("B", value, LO_UINT))
@@ -2025,6 +2090,23 @@ int ldmsd_process_cmd_line_arg(char opt, char *value)
 				ev_thread_count = EVTH_MAX;
 		}
 		break;
+	case 'C':
+		if (check_arg("C", value, LO_UINT))
+			return EINVAL;
+		rc = parse_cpu_list(value);
+		if (rc) {
+			ldmsd_log(LDMSD_LERROR, "Invalid CPU list '%s'\n", value);
+			return rc;
+		}
+		if (ovis_scheduler) {
+			/* the threads are running, re-pin them */
+			for (i = 0; i < ev_thread_count; i++) {
+				rc = ev_thread_pin(i);
+				if (rc)
+					return rc;
+			}
+		}
+		break;
 	case 'm':
 		if (max_mem_sz_str) {
 			ldmsd_log(LDMSD_LERROR, "The memory limit was already "
@@ -2421,6 +2503,11 @@ int main(int argc, char *argv[])
 			ldmsd_log(LDMSD_LERROR, "Error creating an OVIS scheduler.\n");
 			cleanup(6, "OVIS scheduler create failed");
 		}
+		ret = ev_thread_pin(op);
+		if (ret) {
+			ldmsd_log(LDMSD_LERROR, "Error %d setting the CPU affinity "
+					"of event thread %d.\n", ret, op);
+		}
 		ret = pthread_create(&ev_thread[op], NULL, event_proc, ovis_scheduler[op]);
 		if (ret) {
 			ldmsd_log(LDMSD_LERROR, "Error %d creating the event "
@@ -208,6 +208,7 @@ typedef struct ldmsd_prdcr {
 	long conn_intrvl_us;	/* connect interval */
 	char *conn_auth;			/* auth method for the connection */
 	struct attr_value_list *conn_auth_args;  /* auth options of the connection auth */
+	int pin;			/* keep the xprt on its zap io thread */
 
 	enum ldmsd_prdcr_state {
 		/** Producer task has stopped & no outstanding xprt */
@@ -242,15 +243,34 @@ typedef struct ldmsd_prdcr {
 	 * Maintains a tree of all metric sets available from this
 	 * producer. It is a tree to allow quick lookup by the logic
 	 * that handles dir_add and dir_del directory updates from the
-	 * producer.
+	 * producer. The producer sets are kept when the connection goes
+	 * down and are looked up again after the producer reconnects.
 	 */
 	struct rbt set_tree;
+	/**
+	 * The directory generation of the last complete directory reply
+	 * from the producer, or 0. A reconnect asks for the changes since
+	 * then with ldms_xprt_dir_since().
+	 */
+	uint64_t dir_gn;
+	/**
+	 * Incremented when an LDMS_DIR_LIST directory starts, so that the
+	 * producer sets it does not list can be removed once it ends.
+	 */
+	uint64_t dir_list_gn;
+	int dir_listing;	/* an LDMS_DIR_LIST directory is in progress */
 	/**
 	 * Maintains a free of all metric sets with update hint
 	 * available from this producer. It is a tree to allow
 	 * quick lookup by the logic that handles update schedule.
 	 */
 	struct rbt hint_set_tree;
+	/**
+	 * Incremented when a set is added to or removed from \c set_tree or
+	 * \c hint_set_tree. The updaters rebuild their schedule of this
+	 * producer when it changes. Protected by the producer lock.
+	 */
+	uint64_t set_gn;
 } *ldmsd_prdcr_t;
 
 struct ldmsd_strgp;
@@ -283,6 +303,20 @@ struct ldmsd_stat {
 	int count;
 };
 
+/**
+ * Latency histogram
+ *
+ * Bucket \c i counts the durations from 2^(i-1) up to 2^i microseconds;
+ * bucket 0 counts those under 1 us and the last bucket also counts
+ * everything longer. Updated with atomic increments, so it may be updated
+ * from any thread without a lock.
+ */
+#define LDMSD_LAT_HIST_BUCKETS 24
+struct ldmsd_lat_hist {
+	uint64_t count;
+	uint64_t bucket[LDMSD_LAT_HIST_BUCKETS];
+};
+
 typedef struct ldmsd_prdcr_set {
 	char *inst_name;
 	char *schema_name;
@@ -298,6 +332,7 @@ typedef struct ldmsd_prdcr_set {
 		LDMSD_PRDCR_SET_STATE_DELETED
 	} state;
 	uint64_t last_gn;
+	uint64_t dir_list_gn;	/* prdcr->dir_list_gn when last listed */
 	pthread_mutex_t lock;
 	LIST_HEAD(ldmsd_strgp_ref_list, ldmsd_strgp_ref) strgp_list;
 	struct rbn rbn;
@@ -348,6 +383,9 @@ typedef struct ldmsd_updtr_task {
 	int set_count;
 	struct rbn rbn;
 	LIST_ENTRY(ldmsd_updtr_task) entry; /* Entry in the list of to-be-deleted tasks */
+	/* The sets to update, one entry per producer of the updater */
+	struct updtr_prdcr_sched *prdcr_sched;
+	int prdcr_sched_count;
 } *ldmsd_updtr_task_t;
 LIST_HEAD(ldmsd_updtr_task_list, ldmsd_updtr_task);
 
@@ -378,6 +416,12 @@ typedef struct ldmsd_updtr {
 	 */
 	uint8_t is_auto_task;
 
+	/*
+	 * Non-zero if the sets are looked up with LDMS_LOOKUP_DELTA, i.e.
+	 * the set data updates transfer only what changed.
+	 */
+	uint8_t is_delta;
+
 	/* The default schedule specified from configuration */
 	struct ldmsd_updtr_task default_task;
 	/*
@@ -393,6 +437,18 @@ typedef struct ldmsd_updtr {
 	 */
 	struct rbt prdcr_tree;
 	LIST_HEAD(updtr_match_list, ldmsd_name_match) match_list;
+
+	/* The cost of the update ticks, protected by the updater lock */
+	struct ldmsd_updtr_tick_stats {
+		uint64_t ticks;
+		uint64_t sets;		/* sets visited */
+		uint64_t updates;	/* pull updates issued */
+		uint64_t rebuilds;	/* producer schedules rebuilt */
+		int last_sets;
+		int last_updates;
+		double last_cpu_us;
+		struct ldmsd_stat cpu;	/* thread CPU time per tick in usec */
+	} tick_stats;
 } *ldmsd_updtr_t;
 
 typedef struct ldmsd_name_match {
@@ -425,6 +481,25 @@ typedef struct ldmsd_strgp_metric {
 typedef struct ldmsd_row_s *ldmsd_row_t;
 typedef struct ldmsd_row_list_s *ldmsd_row_list_t;
 typedef void (*strgp_update_fn_t)(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set);
+
+/**
+ * What to do when a set update arrives and the storage queue is full.
+ */
+typedef enum ldmsd_strgp_queue_policy {
+	/** Discard the oldest queued update to make room */
+	LDMSD_STRGP_QUEUE_DROP_OLDEST,
+	/** Discard the update that just arrived */
+	LDMSD_STRGP_QUEUE_DROP_NEWEST,
+	/**
+	 * Wait on the update path until a worker frees a slot, at most
+	 * LDMSD_STRGP_QUEUE_BLOCK_MS, then discard the update that arrived
+	 */
+	LDMSD_STRGP_QUEUE_BLOCK,
+} ldmsd_strgp_queue_policy_t;
+
+#define LDMSD_STRGP_QUEUE_BLOCK_MS 1000
+
+typedef struct ldmsd_strgp_queue_s *ldmsd_strgp_queue_t;
 struct ldmsd_strgp {
 	struct ldmsd_cfgobj obj;
 
@@ -469,11 +544,34 @@ struct ldmsd_strgp {
 	/** Decomposer resource handle */
 	struct ldmsd_decomp_s *decomp;
 	char *decomp_name;
+	/** Hash of the decomposition configuration \c decomp was made from */
+	uint64_t decomp_digest;
 
 	/** Regular expression for the schema */
 	regex_t schema_regex;
 
 	struct ldmsd_stat stat;
+
+	/**
+	 * Asynchronous storage queue configuration. If \c queue_depth is 0,
+	 * the set data is stored synchronously in the update completion path.
+	 */
+	int queue_depth;
+	int queue_threads;
+	ldmsd_strgp_queue_policy_t queue_policy;
+	/** The storage queue; only exists while the strgp is running */
+	ldmsd_strgp_queue_t queue;
+
+	/**
+	 * Commit on the shared commit thread pool in parallel with the
+	 * other storage policies of the set, see ldmsd_strgp_commit_parallel()
+	 */
+	int commit_parallel;
+
+	/** From the update completion to the end of the store()/commit() */
+	struct ldmsd_lat_hist update_lat;
+	/** Duration of the store()/commit() call */
+	struct ldmsd_lat_hist commit_lat;
 };
 
 
@@ -847,8 +945,17 @@ struct ldmsd_store {
 	int (*store)(ldmsd_store_handle_t sh, ldms_set_t set, int *, size_t count);
 
 	int (*commit)(ldmsd_strgp_t strgp, ldms_set_t set, ldmsd_row_list_t row_list, int row_count);
+
+	/** LDMSD_STORE_F_* */
+	int flags;
 };
 
+/**
+ * The store() and commit() of the plugin may be called concurrently on the
+ * same store handle, e.g. by the workers of a storage queue.
+ */
+#define LDMSD_STORE_F_MT_SAFE 0x1
+
 #define LDMSD_STR_WRAP(NAME) #NAME
 #define LDMSD_LWRAP(NAME) LDMSD_L ## NAME
 /**
@@ -1212,6 +1319,61 @@ static inline const char *ldmsd_strgp_state_str(enum ldmsd_strgp_state state) {
 	}
 	return "BAD STATE";
 }
+static inline const char *
+ldmsd_strgp_queue_policy_str(ldmsd_strgp_queue_policy_t policy) {
+	switch (policy) {
+	case LDMSD_STRGP_QUEUE_DROP_OLDEST:
+		return "drop_oldest";
+	case LDMSD_STRGP_QUEUE_DROP_NEWEST:
+		return "drop_newest";
+	case LDMSD_STRGP_QUEUE_BLOCK:
+		return "block";
+	}
+	return "BAD POLICY";
+}
+int ldmsd_strgp_queue_policy_from_str(const char *str,
+				      ldmsd_strgp_queue_policy_t *policy);
+
+/** Snapshot of the storage queue counters */
+struct ldmsd_strgp_queue_stats {
+	int depth;		/* number of queued updates */
+	int max_depth;		/* the configured queue capacity */
+	int high_water;		/* the largest depth seen */
+	int threads;		/* number of worker threads */
+	uint64_t enqueued;	/* updates accepted into the queue */
+	uint64_t stored;	/* updates handed to the store */
+	uint64_t dropped_oldest; /* queued updates discarded (drop_oldest) */
+	uint64_t dropped_newest; /* arriving updates discarded (drop_newest) */
+	uint64_t blocked;	/* times the update path waited (block) */
+	uint64_t block_timeouts; /* waits that ended in a drop (block) */
+	struct ldmsd_stat store_stat; /* store() / commit() time in workers */
+};
+
+/**
+ * \brief Get the storage queue counters of a storage policy
+ *
+ * Caller must hold the strgp lock.
+ *
+ * \retval 0      \c stats is populated.
+ * \retval ENOENT The storage policy is not running with a queue.
+ */
+int ldmsd_strgp_queue_stats_get(ldmsd_strgp_t strgp,
+				struct ldmsd_strgp_queue_stats *stats);
+
+/**
+ * \brief Store a set update with the storage policies in parallel mode
+ *
+ * Runs the store()/commit() of every running storage policy of \c prd_set
+ * that has \c commit_parallel set on the commit thread pool and returns
+ * when all of them are done. Storage policies whose decomposers were
+ * configured from identical configurations share the rows of one
+ * decomposition.
+ *
+ * The caller must hold \c prd_set->lock and no storage policy lock.
+ */
+void ldmsd_strgp_commit_parallel(ldmsd_prdcr_set_t prd_set,
+				 struct timespec *update_ts);
+
 int ldmsd_strgp_stop(const char *strgp_name, ldmsd_sec_ctxt_t ctxt);
 int ldmsd_strgp_start(const char *name, ldmsd_sec_ctxt_t ctxt);
 
@@ -1278,6 +1440,9 @@ int ldmsd_compile_regex(regex_t *regex, const char *ex, char *errbuf, size_t err
 /* Receive a message from an ldms endpoint */
 void ldmsd_recv_msg(ldms_t x, char *data, size_t data_len);
 
+/* Deliver a stream message received from an ldms endpoint */
+void ldmsd_recv_stream(ldms_t x, ldms_xprt_event_t e);
+
 /* Get the hostname of this ldmsd */
 extern const char *ldmsd_myhostname_get();
 
@@ -1444,6 +1609,9 @@ int ldmsd_timespec_from_str(struct timespec *result, const char *str);
 void ldmsd_timespec_add(struct timespec *a, struct timespec *b, struct timespec *result);
 int ldmsd_timespec_cmp(struct timespec *a, struct timespec *b);
 void ldmsd_timespec_diff(struct timespec *a, struct timespec *b, struct timespec *result);
+void ldmsd_stat_update(struct ldmsd_stat *stat, struct timespec *start, struct timespec *end);
+void ldmsd_lat_hist_update(struct ldmsd_lat_hist *hist, struct timespec *start,
+			   struct timespec *end);
 
 void ldmsd_log_flush_interval_set(unsigned long interval);
 void ldmsd_flush_log();
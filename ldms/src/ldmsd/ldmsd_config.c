@@ -80,6 +80,7 @@
 #include "ldmsd.h"
 #include "ldms_xprt.h"
 #include "ldmsd_request.h"
+#include "ldmsd_stream.h"
 #include "config.h"
 
 extern void cleanup(int x, char *reason);
@@ -996,6 +997,30 @@ void ldmsd_recv_msg(ldms_t x, char *data, size_t data_len)
 	}
 }
 
+void ldmsd_recv_stream(ldms_t x, ldms_xprt_event_t e)
+{
+	ldmsd_xprt_ctxt_t ctxt = ldms_xprt_ctxt_get(x);
+	struct ldmsd_cfg_xprt_s xprt;
+
+	if (e->stream.type != LDMSD_STREAM_STRING &&
+	    e->stream.type != LDMSD_STREAM_JSON) {
+		ldmsd_log(LDMSD_LERROR, "Stream '%s': unknown type %d\n",
+			  e->stream.name, e->stream.type);
+		return;
+	}
+	if (e->stream.flags & LDMS_STREAM_F_ACK) {
+		/* The same acknowledgement as stream_publish_handler() */
+		xprt.ldms.ldms = x;
+		xprt.send_fn = send_ldms_fn;
+		xprt.max_msg = ldms_xprt_msg_max(x);
+		xprt.type = LDMSD_CFG_TYPE_LDMS;
+		ldmsd_send_error_reply(&xprt, 0, 0, "ACK", sizeof("ACK"));
+	}
+	ldmsd_stream_deliver(e->stream.name, e->stream.type,
+			     e->stream.data, e->data_len, NULL,
+			     ctxt ? ctxt->name : NULL);
+}
+
 static void __listen_connect_cb(ldms_t x, ldms_xprt_event_t e, void *cb_arg)
 {
 	switch (e->type) {
@@ -1010,6 +1035,9 @@ static void __listen_connect_cb(ldms_t x, ldms_xprt_event_t e, void *cb_arg)
 	case LDMS_XPRT_EVENT_RECV:
 		ldmsd_recv_msg(x, e->data, e->data_len);
 		break;
+	case LDMS_XPRT_EVENT_STREAM:
+		ldmsd_recv_stream(x, e);
+		break;
 	case LDMS_XPRT_EVENT_SEND_COMPLETE:
 		break;
 	default:
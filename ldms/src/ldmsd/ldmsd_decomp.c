@@ -63,6 +63,7 @@
 
 #include "ovis_json/ovis_json.h"
 #include "coll/rbt.h"
+#include "coll/fnv_hash.h"
 
 #include "ldmsd.h"
 #include "ldmsd_request.h"
@@ -289,6 +290,7 @@ int ldmsd_decomp_config(ldmsd_strgp_t strgp, const char *json_path, ldmsd_req_ct
 		rc = errno;
 		goto err_4;
 	}
+	strgp->decomp_digest = fnv_hash_a1_64(buff, sz, 0);
 
 	/* decomp config success! */
 	rc = 0;
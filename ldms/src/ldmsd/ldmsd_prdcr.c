@@ -196,6 +196,7 @@ void prdcr_hint_tree_update(ldmsd_prdcr_t prdcr, ldmsd_prdcr_set_t prd_set,
 		prd_set->updt_hint_entry.le_prev = NULL;
 		ldmsd_prdcr_set_ref_put(prd_set);
 
+		prdcr->set_gn++;
 		if (LIST_EMPTY(&list->list)) {
 			rbt_del(&prdcr->hint_set_tree, &list->rbn);
 			free(list->rbn.key);
@@ -215,6 +216,7 @@ void prdcr_hint_tree_update(ldmsd_prdcr_t prdcr, ldmsd_prdcr_set_t prd_set,
 		}
 		ldmsd_prdcr_set_ref_get(prd_set);
 		LIST_INSERT_HEAD(&list->list, prd_set, updt_hint_entry);
+		prdcr->set_gn++;
 	}
 }
 
@@ -223,6 +225,7 @@ static void prdcr_reset_set(ldmsd_prdcr_t prdcr, ldmsd_prdcr_set_t prd_set)
 	prdcr_hint_tree_update(prdcr, prd_set,
 			       &prd_set->updt_hint, UPDT_HINT_TREE_REMOVE);
 	rbt_del(&prdcr->set_tree, &prd_set->rbn);
+	prdcr->set_gn++;
 	ldmsd_prdcr_set_ref_put(prd_set);	/* set_tree reference */
 	prdcr_set_del(prd_set);
 }
@@ -238,6 +241,53 @@ static void prdcr_reset_sets(ldmsd_prdcr_t prdcr)
 		prd_set = container_of(rbn, struct ldmsd_prdcr_set, rbn);
 		prdcr_reset_set(prdcr, prd_set);
 	}
+	prdcr->dir_gn = 0;
+}
+
+/**
+ * Release the sets looked up over a transport that went down
+ *
+ * The producer sets, their storage policies and update hints are kept
+ * and go back to the START state, so the updaters look them up again
+ * once the producer reconnects, and the directory of the reconnect only
+ * needs to report what changed in the meantime.
+ */
+static void prdcr_release_sets(ldmsd_prdcr_t prdcr)
+{
+	ldmsd_prdcr_set_t prd_set;
+	struct rbn *rbn;
+	for (rbn = rbt_min(&prdcr->set_tree); rbn; rbn = rbn_succ(rbn)) {
+		prd_set = container_of(rbn, struct ldmsd_prdcr_set, rbn);
+		pthread_mutex_lock(&prd_set->lock);
+		if (prd_set->set) {
+			ldms_set_ref_put(prd_set->set, "prdcr_set");
+			ldms_set_unpublish(prd_set->set);
+			ldms_set_delete(prd_set->set);
+			prd_set->set = NULL;
+		}
+		prd_set->push_flags &= ~LDMSD_PRDCR_SET_F_PUSH_REG;
+		prd_set->last_gn = 0;
+		prd_set->state = LDMSD_PRDCR_SET_STATE_START;
+		pthread_mutex_unlock(&prd_set->lock);
+	}
+}
+
+/**
+ * Destroy the sets that the last LDMS_DIR_LIST directory did not list
+ */
+static void prdcr_sweep_sets(ldmsd_prdcr_t prdcr)
+{
+	ldmsd_prdcr_set_t prd_set;
+	struct rbn *rbn, *next;
+	for (rbn = rbt_min(&prdcr->set_tree); rbn; rbn = next) {
+		next = rbn_succ(rbn);
+		prd_set = container_of(rbn, struct ldmsd_prdcr_set, rbn);
+		if (prd_set->dir_list_gn == prdcr->dir_list_gn)
+			continue;
+		ldmsd_log(LDMSD_LINFO, "Producer %s no longer has the set %s\n",
+			  prdcr->obj.name, prd_set->inst_name);
+		prdcr_reset_set(prdcr, prd_set);
+	}
 }
 
 /**
@@ -334,6 +384,33 @@ static void __update_set_info(ldmsd_prdcr_set_t set, ldms_dir_set_t dset)
 	}
 }
 
+/*
+ * Apply the set-info of a directory entry to a producer set that is
+ * already there. Must be called with the prdcr->lock held.
+ */
+static void prdcr_set_info_refresh(ldmsd_prdcr_t prdcr, ldmsd_prdcr_set_t set,
+				   ldms_dir_set_t dset)
+{
+	struct ldmsd_updtr_schedule prev_hint;
+
+	pthread_mutex_lock(&set->lock);
+	prdcr_hint_tree_update(prdcr, set, &set->updt_hint, UPDT_HINT_TREE_REMOVE);
+	prev_hint = set->updt_hint;
+	__update_set_info(set, dset);
+	prdcr_hint_tree_update(prdcr, set, &set->updt_hint, UPDT_HINT_TREE_ADD);
+	pthread_mutex_unlock(&set->lock);
+	if (0 != ldmsd_updtr_schedule_cmp(&prev_hint, &set->updt_hint)) {
+		/*
+		 * Update Updater tasks only when
+		 * there are any changes to
+		 * avoid unnecessary iterations.
+		 */
+		ldmsd_prdcr_unlock(prdcr);
+		ldmsd_prd_set_updtr_task_update(set);
+		ldmsd_prdcr_lock(prdcr);
+	}
+}
+
 extern void __ldmsd_prdset_lookup_cb(ldms_t xprt, enum ldms_lookup_status status,
 				     int more, ldms_set_t set, void *arg);
 static void _add_cb(ldms_t xprt, ldmsd_prdcr_t prdcr, ldms_dir_set_t dset)
@@ -344,6 +421,11 @@ static void _add_cb(ldms_t xprt, ldmsd_prdcr_t prdcr, ldms_dir_set_t dset)
 
 	/* Check to see if it's already there */
 	set = _find_set(prdcr, dset->inst_name);
+	if (set && !set->set && strcmp(set->schema_name, dset->schema_name)) {
+		/* Kept from a previous connection, but the set was re-created */
+		prdcr_reset_set(prdcr, set);
+		set = NULL;
+	}
 	if (!set) {
 		/* See if the ldms set is already there */
 		ldms_set_t xs = ldms_xprt_set_by_name(xprt, dset->inst_name);
@@ -363,18 +445,23 @@ static void _add_cb(ldms_t xprt, ldmsd_prdcr_t prdcr, ldms_dir_set_t dset)
 			return;
 		}
 		set->prdcr = prdcr;
+		set->dir_list_gn = prdcr->dir_list_gn;
 		ldmsd_prdcr_set_ref_get(set); 	/* set_tree reference */
 		rbt_ins(&prdcr->set_tree, &set->rbn);
+		prdcr->set_gn++;
 	} else {
 		/* This can happen when the lookup fails with an error,
 		 * e.g. ENOENT, the dir told us the set was there, but when
 		 * we get around to looking it up, it is gone. If the set then
 		 * appears on the upstream ldmsd, we will get a dir_upd and hit
-		 * this path
+		 * this path. It also happens for the sets kept across a
+		 * reconnect; their set-info may have changed in between.
 		 */
 		ldmsd_log(LDMSD_LINFO, "Received a dir_add update for "
 			  "'%s', prdcr_set still present with refcount %d, and set "
 			  "%p.\n", dset->inst_name, set->ref_count, set->set);
+		set->dir_list_gn = prdcr->dir_list_gn;
+		prdcr_set_info_refresh(prdcr, set, dset);
 		return;
 	}
 
@@ -401,9 +488,22 @@ static void prdcr_dir_cb_add(ldms_t xprt, ldms_dir_t dir, ldmsd_prdcr_t prdcr)
 		_add_cb(xprt, prdcr, &dir->set_data[i]);
 }
 
+/*
+ * A complete directory, possibly in several parts. The sets it does not
+ * list, e.g. sets kept from a previous connection that were deleted
+ * while disconnected, are removed once the last part has arrived.
+ */
 static void prdcr_dir_cb_list(ldms_t xprt, ldms_dir_t dir, ldmsd_prdcr_t prdcr)
 {
-	return prdcr_dir_cb_add(xprt, dir, prdcr);
+	if (!prdcr->dir_listing) {
+		prdcr->dir_listing = 1;
+		prdcr->dir_list_gn++;
+	}
+	prdcr_dir_cb_add(xprt, dir, prdcr);
+	if (!dir->more) {
+		prdcr->dir_listing = 0;
+		prdcr_sweep_sets(prdcr);
+	}
 }
 
 /*
@@ -429,7 +529,6 @@ static void prdcr_dir_cb_upd(ldms_t xprt, ldms_dir_t dir, ldmsd_prdcr_t prdcr)
 {
 	ldmsd_prdcr_set_t set;
 	int i;
-	struct ldmsd_updtr_schedule prev_hint;
 
 	for (i = 0; i < dir->set_count; i++) {
 		set = ldmsd_prdcr_set_find(prdcr, dir->set_data[i].inst_name);
@@ -441,22 +540,7 @@ static void prdcr_dir_cb_upd(ldms_t xprt, ldms_dir_t dir, ldmsd_prdcr_t prdcr)
 				  dir->set_data[i].inst_name);
 			continue;
 		}
-		pthread_mutex_lock(&set->lock);
-		prdcr_hint_tree_update(prdcr, set, &set->updt_hint, UPDT_HINT_TREE_REMOVE);
-		prev_hint = set->updt_hint;
-		__update_set_info(set, &dir->set_data[i]);
-		prdcr_hint_tree_update(prdcr, set, &set->updt_hint, UPDT_HINT_TREE_ADD);
-		pthread_mutex_unlock(&set->lock);
-		if (0 != ldmsd_updtr_schedule_cmp(&prev_hint, &set->updt_hint)) {
-			/*
-			 * Update Updater tasks only when
-			 * there are any changes to
-			 * avoid unnecessary iterations.
-			 */
-			ldmsd_prdcr_unlock(prdcr);
-			ldmsd_prd_set_updtr_task_update(set);
-			ldmsd_prdcr_lock(prdcr);
-		}
+		prdcr_set_info_refresh(prdcr, set, &dir->set_data[i]);
 	}
 }
 
@@ -487,6 +571,9 @@ static void prdcr_dir_cb(ldms_t xprt, int status, ldms_dir_t dir, void *arg)
 		prdcr_dir_cb_upd(xprt, dir, prdcr);
 		break;
 	}
+	/* Only the replies to the dir request carry a generation */
+	if (dir->gn && !dir->more)
+		prdcr->dir_gn = dir->gn;
 	ldmsd_prdcr_unlock(prdcr);
 	ldms_xprt_dir_free(xprt, dir);
 }
@@ -621,14 +708,25 @@ static void prdcr_connect_cb(ldms_t x, ldms_xprt_event_t e, void *cb_arg)
 				  "Could not subscribe to stream data on producer %s\n",
 				  prdcr->obj.name);
 		}
-		if (ldms_xprt_dir(prdcr->xprt, prdcr_dir_cb, prdcr,
-				  LDMS_DIR_F_NOTIFY))
+		/*
+		 * The producer sets kept from the previous connection only
+		 * need the changes since the last directory. A peer that
+		 * cannot tell, e.g. because it restarted, replies with a
+		 * complete LDMS_DIR_LIST instead, which also removes the
+		 * kept sets it no longer has.
+		 */
+		prdcr->dir_listing = 0;
+		if (ldms_xprt_dir_since(prdcr->xprt, prdcr_dir_cb, prdcr,
+					LDMS_DIR_F_NOTIFY, prdcr->dir_gn))
 			ldms_xprt_close(prdcr->xprt);
 		ldmsd_task_stop(&prdcr->task);
 		break;
 	case LDMS_XPRT_EVENT_RECV:
 		ldmsd_recv_msg(x, e->data, e->data_len);
 		break;
+	case LDMS_XPRT_EVENT_STREAM:
+		ldmsd_recv_stream(x, e);
+		break;
 	case LDMS_XPRT_EVENT_SET_DELETE:
 		__prdcr_remote_set_delete(prdcr, e->set_delete.name);
 		break;
@@ -658,14 +756,15 @@ static void prdcr_connect_cb(ldms_t x, ldms_xprt_event_t e, void *cb_arg)
 	return;
 
 reset_prdcr:
-	prdcr_reset_sets(prdcr);
 	switch (prdcr->conn_state) {
 	case LDMSD_PRDCR_STATE_STOPPING:
+		prdcr_reset_sets(prdcr);
 		prdcr->conn_state = LDMSD_PRDCR_STATE_STOPPED;
 		break;
 	case LDMSD_PRDCR_STATE_DISCONNECTED:
 	case LDMSD_PRDCR_STATE_CONNECTING:
 	case LDMSD_PRDCR_STATE_CONNECTED:
+		prdcr_release_sets(prdcr);
 		prdcr->conn_state = LDMSD_PRDCR_STATE_DISCONNECTED;
 		ldmsd_task_start(&prdcr->task, prdcr_task_cb, prdcr,
 				 0, prdcr->conn_intrvl_us, 0);
@@ -706,6 +805,10 @@ static void prdcr_connect(ldmsd_prdcr_t prdcr)
 						      prdcr->conn_auth,
 						      prdcr->conn_auth_args);
 		if (prdcr->xprt) {
+			if (prdcr->pin)
+				ldms_xprt_pinned_set(prdcr->xprt, 1);
+			/* Receive the streams the producer forwards */
+			ldms_xprt_stream_recv_enable(prdcr->xprt);
 			ret  = ldms_xprt_connect(prdcr->xprt,
 						 (struct sockaddr *)&prdcr->ss,
 						 prdcr->ss_len,
@@ -726,6 +829,8 @@ static void prdcr_connect(ldmsd_prdcr_t prdcr)
 		/* Call connect callback to advance state and update timers*/
 		if (prdcr->xprt) {
 			struct ldms_xprt_event conn_ev = {.type = LDMS_XPRT_EVENT_CONNECTED};
+			if (prdcr->pin)
+				ldms_xprt_pinned_set(prdcr->xprt, 1);
 			prdcr_connect_cb(prdcr->xprt, &conn_ev, prdcr);
 		}
 		break;
@@ -984,8 +1089,10 @@ int __ldmsd_prdcr_stop(ldmsd_prdcr_t prdcr, ldmsd_sec_ctxt_t ctxt)
 	ldmsd_prdcr_unlock(prdcr);
 	ldmsd_task_join(&prdcr->task);
 	ldmsd_prdcr_lock(prdcr);
-	if (!prdcr->xprt)
+	if (!prdcr->xprt) {
+		prdcr_reset_sets(prdcr);
 		prdcr->conn_state = LDMSD_PRDCR_STATE_STOPPED;
+	}
 out:
 	ldmsd_prdcr_unlock(prdcr);
 	return rc;
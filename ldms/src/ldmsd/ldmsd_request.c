@@ -232,6 +232,7 @@ static int plugn_term_handler(ldmsd_req_ctxt_t req_ctxt);
 static int plugn_config_handler(ldmsd_req_ctxt_t req_ctxt);
 static int plugn_list_handler(ldmsd_req_ctxt_t req_ctxt);
 static int plugn_sets_handler(ldmsd_req_ctxt_t req_ctxt);
+static int plugn_jitter_handler(ldmsd_req_ctxt_t req_ctxt);
 static int set_udata_handler(ldmsd_req_ctxt_t req_ctxt);
 static int set_udata_regex_handler(ldmsd_req_ctxt_t req_ctxt);
 static int verbosity_change_handler(ldmsd_req_ctxt_t reqc);
@@ -450,6 +451,9 @@ static struct request_handler_entry request_handler[] = {
 	[LDMSD_PLUGN_SETS_REQ] = {
 		LDMSD_PLUGN_SETS_REQ, plugn_sets_handler, XALL
 	},
+	[LDMSD_PLUGN_JITTER_REQ] = {
+		LDMSD_PLUGN_JITTER_REQ, plugn_jitter_handler, XALL
+	},
 
 	/* SET */
 	[LDMSD_SET_UDATA_REQ] = {
@@ -1473,8 +1477,9 @@ static int prdcr_add_handler(ldmsd_req_ctxt_t reqc)
 	size_t cnt;
 	uid_t uid;
 	gid_t gid;
-	int perm;
+	int perm, pin;
 	char *perm_s = NULL;
+	char *pin_s = NULL;
 
 	reqc->errcode = 0;
 	name = host = xprt = type_s = port_s = interval_s = auth = NULL;
@@ -1556,6 +1561,20 @@ static int prdcr_add_handler(ldmsd_req_ctxt_t reqc)
 	if (perm_s)
 		perm = strtol(perm_s, NULL, 0);
 
+	pin = 0;
+	pin_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_PIN);
+	if (pin_s) {
+		if (0 == strcasecmp(pin_s, "true")) {
+			pin = 1;
+		} else if (0 != strcasecmp(pin_s, "false")) {
+			reqc->errcode = EINVAL;
+			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+				       "The pin option requires "
+				       "either 'true', or 'false'\n");
+			goto send_reply;
+		}
+	}
+
 	prdcr = ldmsd_prdcr_new_with_auth(name, xprt, host, port_no, type,
 					  interval_us, auth, uid, gid, perm);
 	if (!prdcr) {
@@ -1568,11 +1587,12 @@ static int prdcr_add_handler(ldmsd_req_ctxt_t reqc)
 		else
 			goto enomem;
 	}
+	prdcr->pin = pin;
 	__dlog(DLOG_CFGOK, "prdcr_add name=%s xprt=%s host=%s port=%u type=%s "
-		"interval=%d auth=%s uid=%d gid=%d perm=%o\n",
+		"interval=%d auth=%s uid=%d gid=%d perm=%o pin=%s\n",
 		name, xprt, host, port_no, type_s,
 		interval_us, auth ? auth : "none", (int)uid, (int)gid,
-		(unsigned)perm);
+		(unsigned)perm, pin ? "true" : "false");
 
 	goto send_reply;
 ebadauth:
@@ -1608,6 +1628,7 @@ send_reply:
 	free(host);
 	free(xprt);
 	free(perm_s);
+	free(pin_s);
 	free(auth);
 	return 0;
 }
@@ -2422,8 +2443,11 @@ int strgp_decomp_init(ldmsd_strgp_t strgp, ldmsd_req_ctxt_t req);
 static int strgp_add_handler(ldmsd_req_ctxt_t reqc)
 {
 	char *attr_name, *name, *plugin, *container, *schema, *interval, *regex;
-	char *decomp;
+	char *decomp, *qdepth_s, *qthreads_s, *qpolicy_s, *commit_s;
 	name = plugin = container = schema = NULL;
+	qdepth_s = qthreads_s = qpolicy_s = commit_s = NULL;
+	int qdepth = 0, qthreads = 1, commit_parallel = 0;
+	ldmsd_strgp_queue_policy_t qpolicy = LDMSD_STRGP_QUEUE_DROP_OLDEST;
 	size_t cnt = 0;
 	uid_t uid;
 	gid_t gid;
@@ -2490,6 +2514,66 @@ static int strgp_add_handler(ldmsd_req_ctxt_t reqc)
 		}
 	}
 
+	qdepth_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_QUEUE_DEPTH);
+	if (qdepth_s) {
+		qdepth = atoi(qdepth_s);
+		if (qdepth < 0) {
+			reqc->errcode = EINVAL;
+			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+				"The specified queue_depth, \"%s\", is invalid.",
+				qdepth_s);
+			goto send_reply;
+		}
+	}
+	qthreads_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_QUEUE_THREADS);
+	if (qthreads_s) {
+		qthreads = atoi(qthreads_s);
+		if (qthreads <= 0) {
+			reqc->errcode = EINVAL;
+			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+				"The specified queue_threads, \"%s\", is invalid.",
+				qthreads_s);
+			goto send_reply;
+		}
+	}
+	qpolicy_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_QUEUE_POLICY);
+	if (qpolicy_s) {
+		if (ldmsd_strgp_queue_policy_from_str(qpolicy_s, &qpolicy)) {
+			reqc->errcode = EINVAL;
+			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+				"The specified queue_policy, \"%s\", is invalid. "
+				"It must be drop_oldest, drop_newest or block.",
+				qpolicy_s);
+			goto send_reply;
+		}
+	}
+	if ((qthreads_s || qpolicy_s) && !qdepth) {
+		reqc->errcode = EINVAL;
+		cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+			"The attributes 'queue_threads' and 'queue_policy' "
+			"require 'queue_depth'.");
+		goto send_reply;
+	}
+	commit_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_COMMIT);
+	if (commit_s) {
+		if (0 == strcasecmp(commit_s, "parallel")) {
+			commit_parallel = 1;
+		} else if (0 != strcasecmp(commit_s, "serial")) {
+			reqc->errcode = EINVAL;
+			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+				"The specified commit, \"%s\", is invalid. "
+				"It must be serial or parallel.", commit_s);
+			goto send_reply;
+		}
+	}
+	if (commit_parallel && qdepth) {
+		reqc->errcode = EINVAL;
+		cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+			"The attributes 'commit=parallel' and 'queue_depth' "
+			"are mutually exclusive.");
+		goto send_reply;
+	}
+
 
 	struct ldmsd_plugin_cfg *store;
 	store = ldmsd_get_plugin(plugin);
@@ -2541,6 +2625,10 @@ static int strgp_add_handler(ldmsd_req_ctxt_t reqc)
 		goto enomem;
 
 	strgp->flush_interval = flush_interval;
+	strgp->queue_depth = qdepth;
+	strgp->queue_threads = qthreads;
+	strgp->queue_policy = qpolicy;
+	strgp->commit_parallel = commit_parallel;
 
 	if (decomp) {
 		strgp->decomp_name = strdup(decomp);
@@ -2555,13 +2643,17 @@ static int strgp_add_handler(ldmsd_req_ctxt_t reqc)
 	}
 	if (reqc->line_buf[0] == '\0' || reqc->line_buf[0] == '0')
 		__dlog(DLOG_CFGOK, "strgp_add name=%s plugin=%s container=%s"
-			"%s%s" "%s%s" "%s%s" "%s%s" "%s%s\n",
+			"%s%s" "%s%s" "%s%s" "%s%s" "%s%s" "%s%s" "%s%s" "%s%s" "%s%s\n",
 			name, plugin, container,
 			schema ? " schema=" : "", schema ? schema : "",
 			regex ? " regex=" : "", regex ? regex : "",
 			decomp ? " decomp=" : "", decomp ? decomp : "",
 			interval ? " flush=" : "", interval ? interval : "",
-			perm_s ? " perm=" : "", perm_s ? perm_s : ""
+			perm_s ? " perm=" : "", perm_s ? perm_s : "",
+			qdepth_s ? " queue_depth=" : "", qdepth_s ? qdepth_s : "",
+			qthreads_s ? " queue_threads=" : "", qthreads_s ? qthreads_s : "",
+			qpolicy_s ? " queue_policy=" : "", qpolicy_s ? qpolicy_s : "",
+			commit_s ? " commit=" : "", commit_s ? commit_s : ""
 			);
 
 	goto send_reply;
@@ -2600,6 +2692,10 @@ send_reply:
 	free(container);
 	free(schema);
 	free(perm_s);
+	free(qdepth_s);
+	free(qthreads_s);
+	free(qpolicy_s);
+	free(commit_s);
 	return 0;
 }
 
@@ -3003,6 +3099,23 @@ send_reply:
 	return 0;
 }
 
+/* "name":{"count":N,"buckets":[...]}, the buckets are updated without the strgp lock */
+static int __lat_hist_json(ldmsd_req_ctxt_t reqc, const char *name,
+			   struct ldmsd_lat_hist *hist)
+{
+	int i, rc;
+
+	rc = linebuf_printf(reqc, ",\"%s\":{\"count\":%"PRIu64",\"buckets\":[",
+			    name, __atomic_load_n(&hist->count, __ATOMIC_RELAXED));
+	for (i = 0; !rc && i < LDMSD_LAT_HIST_BUCKETS; i++) {
+		rc = linebuf_printf(reqc, "%s%"PRIu64, (i ? "," : ""),
+			__atomic_load_n(&hist->bucket[i], __ATOMIC_RELAXED));
+	}
+	if (!rc)
+		rc = linebuf_printf(reqc, "]}");
+	return rc;
+}
+
 int __strgp_status_json_obj(ldmsd_req_ctxt_t reqc, ldmsd_strgp_t strgp,
 							int strgp_cnt)
 {
@@ -3010,6 +3123,7 @@ int __strgp_status_json_obj(ldmsd_req_ctxt_t reqc, ldmsd_strgp_t strgp,
 	int match_count, metric_count;
 	ldmsd_name_match_t match;
 	ldmsd_strgp_metric_t metric;
+	struct ldmsd_strgp_queue_stats qstats;
 
 	if (strgp_cnt) {
 		rc = linebuf_printf(reqc, ",\n");
@@ -3066,7 +3180,45 @@ int __strgp_status_json_obj(ldmsd_req_ctxt_t reqc, ldmsd_strgp_t strgp,
 		if (rc)
 			goto out;
 	}
-	rc = linebuf_printf(reqc, "]}");
+	rc = linebuf_printf(reqc, "]");
+	if (rc)
+		goto out;
+	if (0 == ldmsd_strgp_queue_stats_get(strgp, &qstats)) {
+		rc = linebuf_printf(reqc,
+			",\"queue\":{\"policy\":\"%s\","
+			"\"depth\":%d,"
+			"\"max_depth\":%d,"
+			"\"high_water\":%d,"
+			"\"threads\":%d,"
+			"\"enqueued\":%"PRIu64","
+			"\"stored\":%"PRIu64","
+			"\"dropped_oldest\":%"PRIu64","
+			"\"dropped_newest\":%"PRIu64","
+			"\"blocked\":%"PRIu64","
+			"\"block_timeouts\":%"PRIu64","
+			"\"store_time\":{\"min\":%lf,\"max\":%lf,"
+			"\"avg\":%lf,\"cnt\":%d}}",
+			ldmsd_strgp_queue_policy_str(strgp->queue_policy),
+			qstats.depth, qstats.max_depth, qstats.high_water,
+			qstats.threads, qstats.enqueued, qstats.stored,
+			qstats.dropped_oldest, qstats.dropped_newest,
+			qstats.blocked, qstats.block_timeouts,
+			qstats.store_stat.min, qstats.store_stat.max,
+			qstats.store_stat.avg, qstats.store_stat.count);
+		if (rc)
+			goto out;
+	}
+	rc = linebuf_printf(reqc, ",\"commit\":\"%s\",\"latency\":{\"unit\":\"us\"",
+			    strgp->commit_parallel ? "parallel" : "serial");
+	if (rc)
+		goto out;
+	rc = __lat_hist_json(reqc, "update", &strgp->update_lat);
+	if (rc)
+		goto out;
+	rc = __lat_hist_json(reqc, "commit", &strgp->commit_lat);
+	if (rc)
+		goto out;
+	rc = linebuf_printf(reqc, "}}");
 out:
 	ldmsd_strgp_unlock(strgp);
 	return rc;
@@ -3151,14 +3303,15 @@ out:
 static int updtr_add_handler(ldmsd_req_ctxt_t reqc)
 {
 	char *name, *offset_str, *interval_str, *push, *auto_interval, *attr_name;
-	name = offset_str = interval_str = push = auto_interval = NULL;
+	char *delta;
+	name = offset_str = interval_str = push = auto_interval = delta = NULL;
 	size_t cnt = 0;
 	uid_t uid;
 	gid_t gid;
 	int perm;
 	char *perm_s = NULL;
 	char *endptr;
-	int push_flags, is_auto_task;
+	int push_flags, is_auto_task, is_delta;
 	long interval, offset;
 
 	reqc->errcode = 0;
@@ -3280,6 +3433,19 @@ static int updtr_add_handler(ldmsd_req_ctxt_t reqc)
 	} else {
 		is_auto_task = 0;
 	}
+	is_delta = 0;
+	delta = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_DELTA);
+	if (delta) {
+		if (0 == strcasecmp(delta, "true")) {
+			is_delta = 1;
+		} else if (0 != strcasecmp(delta, "false")) {
+			reqc->errcode = EINVAL;
+			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+				       "The delta option requires "
+				       "either 'true', or 'false'\n");
+			goto send_reply;
+		}
+	}
 	push_flags = 0;
 	if (push) {
 		if (0 == strcasecmp(push, "onchange")) {
@@ -3315,13 +3481,15 @@ static int updtr_add_handler(ldmsd_req_ctxt_t reqc)
 				       "The updtr could not be created.");
 		}
 	} else {
+		updtr->is_delta = is_delta;
 		__dlog(DLOG_CFGOK, "updtr_add name=%s interval=%s offset=%s%s%s"
-			"%s%s%s%s\n", name, interval_str,
+			"%s%s%s%s%s%s\n", name, interval_str,
 			offset_str ? offset_str : "0",
 			auto_interval ? " auto_interval=" : "",
 			auto_interval ? auto_interval : "",
 			push ? " push=" : "", push ? push : "",
-			perm_s ? " perm" : "", perm_s ? perm_s : "");
+			perm_s ? " perm" : "", perm_s ? perm_s : "",
+			delta ? " delta=" : "", delta ? delta : "");
 	}
 
 send_reply:
@@ -3332,6 +3500,7 @@ send_reply:
 	free(offset_str);
 	free(push);
 	free(perm_s);
+	free(delta);
 	return 0;
 }
 
@@ -3978,6 +4147,7 @@ int __updtr_status_json_obj(ldmsd_req_ctxt_t reqc, ldmsd_updtr_t updtr,
 	int skipped_cnt = 0;
 	int oversampled_cnt = 0;
 	const char *str;
+	struct ldmsd_updtr_tick_stats *tick;
 
 	if (updtr_cnt) {
 		rc = linebuf_printf(reqc, ",\n");
@@ -4067,10 +4237,25 @@ int __updtr_status_json_obj(ldmsd_req_ctxt_t reqc, ldmsd_updtr_t updtr,
 			}
 		}
 	}
+	tick = &updtr->tick_stats;
 	rc = linebuf_printf(reqc, "],"
 				  "\"outstanding count\":%d,"
-				  "\"oversampled count\":%d}",
-				  skipped_cnt, oversampled_cnt);
+				  "\"oversampled count\":%d,"
+				  "\"tick\":{\"count\":%"PRIu64","
+				  "\"sets\":%"PRIu64","
+				  "\"updates\":%"PRIu64","
+				  "\"rebuilds\":%"PRIu64","
+				  "\"last_sets\":%d,"
+				  "\"last_updates\":%d,"
+				  "\"cpu_us\":{\"last\":%lf,\"min\":%lf,"
+				  "\"max\":%lf,\"avg\":%lf}}}",
+				  skipped_cnt, oversampled_cnt,
+				  tick->ticks, tick->sets, tick->updates,
+				  tick->rebuilds, tick->last_sets,
+				  tick->last_updates, tick->last_cpu_us,
+				  tick->cpu.min, tick->cpu.max, tick->cpu.avg);
+	if (reset)
+		memset(tick, 0, sizeof(*tick));
 out:
 	ldmsd_updtr_unlock(updtr);
 	return rc;
@@ -5319,6 +5504,118 @@ err0:
 	goto out;
 }
 
+/*
+ * {"name":<string>, "thread_id":<int>, "sample_interval_us":<int>,
+ *  "count":<int>, "min_ns":<int>, "mean_ns":<int>, "max_ns":<int>,
+ *  "hist":[<int>, ...] }
+ *
+ * hist[i] is the number of wake ups with a jitter in [2^i, 2^(i+1)) ns.
+ */
+static int __plugn_jitter_json_obj(ldmsd_req_ctxt_t reqc,
+				   struct ldmsd_plugin_cfg *p, int reset)
+{
+	struct ovis_event_jitter_s j;
+	int i, rc;
+
+	pthread_mutex_lock(&p->lock);
+	ovis_event_jitter_get(&p->oev, &j);
+	if (reset)
+		ovis_event_jitter_reset(&p->oev);
+	rc = linebuf_printf(reqc,
+			"{\"name\":\"%s\",\"thread_id\":%d,"
+			"\"sample_interval_us\":%ld,"
+			"\"count\":%lu,\"min_ns\":%lu,"
+			"\"mean_ns\":%lu,\"max_ns\":%lu,\"hist\":[",
+			p->plugin->name, p->thread_id,
+			p->sample_interval_us, j.count, j.min_ns,
+			j.count ? j.sum_ns / j.count : 0, j.max_ns);
+	pthread_mutex_unlock(&p->lock);
+	if (rc)
+		return rc;
+	for (i = 0; i < OVIS_EVENT_JITTER_BINS; i++) {
+		rc = linebuf_printf(reqc, "%s%lu", i ? "," : "", j.hist[i]);
+		if (rc)
+			return rc;
+	}
+	return linebuf_printf(reqc, "]}");
+}
+
+static int plugn_jitter_handler(ldmsd_req_ctxt_t reqc)
+{
+	extern struct plugin_list plugin_list;
+	struct ldmsd_plugin_cfg *p;
+	struct ldmsd_req_attr_s attr;
+	char *name, *s;
+	int rc, count, reset = 0;
+
+	name = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_NAME);
+	s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_RESET);
+	__dlog(DLOG_QUERY, "plugn_jitter%s%s%s%s\n",
+		name ? " name=" : "", name ? name : "",
+		s ? " reset=" : "", s ? s : "");
+	if (s) {
+		if (0 != strcasecmp(s, "false"))
+			reset = 1;
+		free(s);
+	}
+
+	if (name) {
+		p = ldmsd_get_plugin(name);
+		if (!p || p->plugin->type != LDMSD_PLUGIN_SAMPLER) {
+			reqc->errcode = ENOENT;
+			(void) snprintf(reqc->line_buf, reqc->line_len,
+					"Sampler '%s' not found.", name);
+			ldmsd_send_req_response(reqc, reqc->line_buf);
+			rc = 0;
+			goto out;
+		}
+	}
+
+	rc = linebuf_printf(reqc, "[");
+	if (rc)
+		goto err;
+	count = 0;
+	LIST_FOREACH(p, &plugin_list, entry) {
+		if (p->plugin->type != LDMSD_PLUGIN_SAMPLER)
+			continue;
+		if (name && 0 != strcmp(name, p->plugin->name))
+			continue;
+		if (count) {
+			rc = linebuf_printf(reqc, ",\n");
+			if (rc)
+				goto err;
+		}
+		count++;
+		rc = __plugn_jitter_json_obj(reqc, p, reset);
+		if (rc)
+			goto err;
+	}
+	rc = linebuf_printf(reqc, "]");
+	if (rc)
+		goto err;
+
+	attr.discrim = 1;
+	attr.attr_len = reqc->line_off;
+	attr.attr_id = LDMSD_ATTR_JSON;
+	ldmsd_hton_req_attr(&attr);
+	rc = ldmsd_append_reply(reqc, (char *)&attr, sizeof(attr), LDMSD_REQ_SOM_F);
+	if (rc)
+		goto out;
+	rc = ldmsd_append_reply(reqc, reqc->line_buf, reqc->line_off, 0);
+	if (rc)
+		goto out;
+	attr.discrim = 0;
+	rc = ldmsd_append_reply(reqc, (char *)&attr.discrim,
+				sizeof(uint32_t), LDMSD_REQ_EOM_F);
+out:
+	free(name);
+	return rc;
+err:
+	ldmsd_send_error_reply(reqc->xprt, reqc->key.msg_no, rc,
+						"internal error", 15);
+	goto out;
+}
+
 extern int ldmsd_set_udata(const char *set_name, const char *metric_name,
 			   const char *udata_s, ldmsd_sec_ctxt_t sctxt);
 static int set_udata_handler(ldmsd_req_ctxt_t reqc)
@@ -6603,7 +6900,11 @@ err:
  * 		{ "name" : <string>,
  *  	  "sample_count" : <float>,
  *  	  "sample_rate" : <float>,
- *        "utilization" : <float>
+ *        "utilization" : <float>,
+ *        "sq_sz" : <int>,
+ *        "n_eps" : <int>,
+ *        "migrated_in" : <int>,
+ *        "migrated_out" : <int>
  *      },
  *      . . .
  *   ]
@@ -6638,7 +6939,9 @@ static char * __thread_stats_as_json(size_t *json_sz)
 		__APPEND("   \"sample_rate\": %g,\n", res->entries[i].sample_rate);
 		__APPEND("   \"utilization\": %g,\n", res->entries[i].utilization);
 		__APPEND("   \"sq_sz\": %lu,\n", res->entries[i].sq_sz);
-		__APPEND("   \"n_eps\": %lu\n", res->entries[i].n_eps);
+		__APPEND("   \"n_eps\": %lu,\n", res->entries[i].n_eps);
+		__APPEND("   \"migrated_in\": %lu,\n", res->entries[i].migrated_in);
+		__APPEND("   \"migrated_out\": %lu\n", res->entries[i].migrated_out);
 		if (i < res->count - 1)
 			__APPEND("  },\n");
 		else
@@ -7007,16 +7310,47 @@ static int __on_republish_resp(ldmsd_req_cmd_t rcmd)
 	return 0;
 }
 
+/* Seconds between the warnings about dropped republished data */
+#define REPUBLISH_DROP_WARN_INTERVAL 60
+static time_t republish_drop_warned;
+
 static int stream_republish_cb(ldmsd_stream_client_t c, void *ctxt,
 			       ldmsd_stream_type_t stream_type,
 			       const char *data, size_t data_len,
 			       json_entity_t entity)
 {
 	ldms_t ldms = (ldms_t)ctxt;
+	time_t now, last;
 	int rc, attr_id = LDMSD_ATTR_STRING;
 	const char *stream = ldmsd_stream_client_name(c);
-	ldmsd_req_cmd_t rcmd = ldmsd_req_cmd_new(ldms, LDMSD_STREAM_PUBLISH_REQ,
-						 NULL, __on_republish_resp, NULL);
+	ldmsd_req_cmd_t rcmd;
+
+	if (ldms_xprt_stream_supported(ldms)) {
+		/* The subscriber does not acknowledge republished data */
+		rc = ldms_xprt_stream_send_wait(ldms, stream, stream_type, 0,
+					data, data_len,
+					LDMSD_STREAM_REPUBLISH_TIMEOUT_MS);
+		if (rc == ETIMEDOUT || rc == EAGAIN) {
+			ldmsd_client_stream_pubstats_drop(c, data_len);
+			now = time(NULL);
+			last = __atomic_load_n(&republish_drop_warned,
+					       __ATOMIC_RELAXED);
+			if (now - last >= REPUBLISH_DROP_WARN_INTERVAL &&
+			    __atomic_compare_exchange_n(&republish_drop_warned,
+					&last, now, 0, __ATOMIC_RELAXED,
+					__ATOMIC_RELAXED))
+				ldmsd_log(LDMSD_LWARNING, "stream '%s' data "
+					  "dropped, the subscriber is behind. "
+					  "See stream_status for the drop "
+					  "counts.\n", stream);
+		}
+		if (rc)
+			return rc;
+		return ldmsd_client_stream_pubstats_update(c, data_len);
+	}
+
+	rcmd = ldmsd_req_cmd_new(ldms, LDMSD_STREAM_PUBLISH_REQ,
+				 NULL, __on_republish_resp, NULL);
 	if (!rcmd) {
 		ldmsd_log(LDMSD_LCRITICAL, "ldmsd is out of memory\n");
 		return ENOMEM;
@@ -122,6 +122,7 @@ enum ldmsd_request {
 	LDMSD_PLUGN_CONFIG_REQ,
 	LDMSD_PLUGN_LIST_REQ,
 	LDMSD_PLUGN_SETS_REQ,
+	LDMSD_PLUGN_JITTER_REQ,
 	LDMSD_SET_UDATA_REQ = 0x600,
 	LDMSD_SET_UDATA_REGEX_REQ,
 	LDMSD_VERBOSE_REQ,
@@ -224,6 +225,12 @@ enum ldmsd_request_attr {
 	LDMSD_ATTR_AUTH,
 	LDMSD_ATTR_RESET,
 	LDMSD_ATTR_DECOMP,
+	LDMSD_ATTR_QUEUE_DEPTH,
+	LDMSD_ATTR_QUEUE_THREADS,
+	LDMSD_ATTR_QUEUE_POLICY,
+	LDMSD_ATTR_DELTA,
+	LDMSD_ATTR_COMMIT,
+	LDMSD_ATTR_PIN,
 	LDMSD_ATTR_LAST,
 };
 
@@ -86,6 +86,7 @@ const struct req_str_id req_str_id_table[] = {
 	{  "metric_sets_default_authz", LDMSD_SET_DEFAULT_AUTHZ_REQ  },
 	{  "oneshot",            LDMSD_ONESHOT_REQ  },
 	{  "option",             LDMSD_CMDLINE_OPTIONS_SET_REQ  },
+	{  "plugn_jitter",       LDMSD_PLUGN_JITTER_REQ  },
 	{  "plugn_sets",         LDMSD_PLUGN_SETS_REQ  },
 	{  "plugn_status",       LDMSD_PLUGN_STATUS_REQ  },
 	{  "prdcr_add",          LDMSD_PRDCR_ADD_REQ  },
@@ -149,8 +150,10 @@ const struct req_str_id attr_str_id_table[] = {
 	{  "auto_interval",     LDMSD_ATTR_AUTO_INTERVAL  },
 	{  "auto_switch",       LDMSD_ATTR_AUTO_SWITCH  },
 	{  "base",              LDMSD_ATTR_BASE  },
+	{  "commit",            LDMSD_ATTR_COMMIT  },
 	{  "container",         LDMSD_ATTR_CONTAINER  },
 	{  "decomposition",     LDMSD_ATTR_DECOMP  },
+	{  "delta",             LDMSD_ATTR_DELTA  },
 	{  "flush",		LDMSD_ATTR_INTERVAL },
 	{  "gid",               LDMSD_ATTR_GID  },
 	{  "host",              LDMSD_ATTR_HOST  },
@@ -166,11 +169,16 @@ const struct req_str_id attr_str_id_table[] = {
 	{  "path",              LDMSD_ATTR_PATH  },
 	{  "peer_name",         LDMSD_ATTR_PEER_NAME },
 	{  "perm",              LDMSD_ATTR_PERM  },
+	{  "pin",               LDMSD_ATTR_PIN  },
 	{  "plugin",            LDMSD_ATTR_PLUGIN  },
 	{  "port",              LDMSD_ATTR_PORT  },
 	{  "producer",          LDMSD_ATTR_PRODUCER  },
 	{  "push",              LDMSD_ATTR_PUSH  },
+	{  "queue_depth",       LDMSD_ATTR_QUEUE_DEPTH  },
+	{  "queue_policy",      LDMSD_ATTR_QUEUE_POLICY  },
+	{  "queue_threads",     LDMSD_ATTR_QUEUE_THREADS  },
 	{  "regex",             LDMSD_ATTR_REGEX  },
+	{  "reset",             LDMSD_ATTR_RESET  },
 	{  "schema",            LDMSD_ATTR_SCHEMA  },
 	{  "stream",            LDMSD_ATTR_STREAM  },
 	{  "string",            LDMSD_ATTR_STRING  },
@@ -265,6 +273,7 @@ const char *ldmsd_req_id2str(enum ldmsd_request req_id)
 	case LDMSD_PLUGN_CONFIG_REQ : return "PLUGN_CONFIG_REQ";
 	case LDMSD_PLUGN_LIST_REQ   : return "PLUGN_LIST_REQ";
 	case LDMSD_PLUGN_SETS_REQ   : return "PLUGN_SETS_REQ";
+	case LDMSD_PLUGN_JITTER_REQ : return "PLUGN_JITTER_REQ";
 
 	case LDMSD_SET_UDATA_REQ         : return "SET_UDATA_REQ";
 	case LDMSD_SET_UDATA_REGEX_REQ   : return "SET_UDATA_REGEX_REQ";
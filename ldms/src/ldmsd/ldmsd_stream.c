@@ -7,6 +7,7 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include <semaphore.h>
+#include <pthread.h>
 #include <ovis_json/ovis_json.h>
 #include <execinfo.h> /* for backtrace_symbols() */
 #include "ldms.h"
@@ -32,6 +33,8 @@ struct ldmsd_stream_info_s {
 	time_t last_ts; /* Timestamp of the last message */
 	int count; /* The number of received messages */
 	size_t total_bytes; /* Total data size of all received messages */
+	int drops; /* The number of messages that could not be republished */
+	size_t drop_bytes; /* Total data size of the dropped messages */
 };
 
 typedef struct ldmsd_stream_publisher_s {
@@ -48,9 +51,36 @@ struct ldmsd_stream_client_s {
 	void *c_ctxt;
 	ldmsd_stream_t c_s;
 	int c_flags;
+	int c_ref;	/* the stream list + deliveries in progress */
+	int c_closed;
 	LIST_ENTRY(ldmsd_stream_client_s) c_ent;
 };
 
+/*
+ * A parsed JSON entity shared by the subscribers of one message. It is
+ * only allocated when a subscriber asks to keep the entity beyond its
+ * callback.
+ */
+struct ldmsd_stream_entity_s {
+	int ref;
+	json_entity_t entity;
+};
+
+/*
+ * The delivery in progress on this thread. Deliveries nest when a
+ * subscriber publishes to another local stream from its callback.
+ */
+struct stream_deliver_ctxt {
+	ldmsd_stream_client_t *snap;	/* the clients referenced */
+	int n;
+	json_entity_t entity;
+	int entity_owned;		/* entity was parsed by the delivery */
+	struct ldmsd_stream_entity_s *se;
+	struct stream_deliver_ctxt *prev;
+};
+
+static __thread struct stream_deliver_ctxt *__deliver_ctxt;
+
 static int p_cmp(void *tree_key, const void *key)
 {
 	return strcmp((char *)tree_key, (const char *)key);
@@ -62,6 +92,9 @@ struct ldmsd_stream_s {
 	struct ldmsd_stream_info_s s_pub_info;
 	struct rbn s_ent;
 	pthread_mutex_t s_lock;
+	pthread_cond_t s_close_cond; /* signaled when a closed client is released */
+	pthread_mutex_t s_cb_lock; /* serializes the callbacks (recursive) */
+	int s_c_count;
 	LIST_HEAD(ldmsd_client_list, ldmsd_stream_client_s) s_c_list;
 	struct rbt s_p_tree;
 };
@@ -85,6 +118,7 @@ static ldmsd_stream_t __find_stream(const char *stream_name)
 
 static struct ldmsd_stream_s *__new_stream(const char *name)
 {
+	pthread_mutexattr_t attr;
 	struct ldmsd_stream_s *s = calloc(1, sizeof(*s));
 	if (!s)
 		return NULL;
@@ -92,6 +126,12 @@ static struct ldmsd_stream_s *__new_stream(const char *name)
 	if (!s->s_name)
 		goto del_stream;
 	pthread_mutex_init(&s->s_lock, NULL);
+	pthread_cond_init(&s->s_close_cond, NULL);
+	/* A callback may deliver to its own stream */
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&s->s_cb_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
 	LIST_INIT(&s->s_c_list);
 	rbt_init(&s->s_p_tree, p_cmp);
 	rbn_init(&s->s_ent, (char *)s->s_name);
@@ -264,15 +304,111 @@ int ldmsd_stream_subscriber_count(const char *stream_name)
 	return subscriber_count;
 }
 
+/*
+ * The JSON parser is reused by every delivery on the thread and freed
+ * when the thread exits.
+ */
+static pthread_key_t __parser_key;
+static pthread_once_t __parser_once = PTHREAD_ONCE_INIT;
+static __thread json_parser_t __parser;
+
+static void __parser_key_destroy(void *arg)
+{
+	json_parser_free(arg);
+}
+
+static void __parser_key_init(void)
+{
+	(void)pthread_key_create(&__parser_key, __parser_key_destroy);
+}
+
+static json_parser_t __thread_parser(void)
+{
+	if (__parser)
+		return __parser;
+	pthread_once(&__parser_once, __parser_key_init);
+	__parser = json_parser_new(0);
+	if (__parser)
+		pthread_setspecific(__parser_key, __parser);
+	return __parser;
+}
+
+ldmsd_stream_entity_t ldmsd_stream_entity_get(json_entity_t entity)
+{
+	struct stream_deliver_ctxt *ctxt;
+	ldmsd_stream_entity_t se;
+
+	if (!entity)
+		return NULL;
+	for (ctxt = __deliver_ctxt; ctxt; ctxt = ctxt->prev) {
+		if (ctxt->entity == entity)
+			break;
+	}
+	if (ctxt && ctxt->se) {
+		__sync_fetch_and_add(&ctxt->se->ref, 1);
+		return ctxt->se;
+	}
+	se = malloc(sizeof(*se));
+	if (!se)
+		return NULL;
+	if (ctxt && ctxt->entity_owned) {
+		/* The delivery hands the parsed entity over to se */
+		se->entity = entity;
+		se->ref = 2;
+		ctxt->se = se;
+		return se;
+	}
+	/* The entity belongs to the publisher */
+	se->entity = json_entity_copy(entity);
+	if (!se->entity) {
+		free(se);
+		return NULL;
+	}
+	se->ref = 1;
+	if (ctxt) {
+		se->ref = 2;
+		ctxt->se = se;
+	}
+	return se;
+}
+
+json_entity_t ldmsd_stream_entity_json(ldmsd_stream_entity_t se)
+{
+	return se->entity;
+}
+
+void ldmsd_stream_entity_put(ldmsd_stream_entity_t se)
+{
+	if (!se)
+		return;
+	if (0 == __sync_sub_and_fetch(&se->ref, 1)) {
+		json_entity_free(se->entity);
+		free(se);
+	}
+}
+
+/* The caller must hold the stream lock. */
+static void __client_put(ldmsd_stream_client_t c)
+{
+	if (--c->c_ref)
+		return;
+	free(c);
+}
+
+#define STREAM_SNAPSHOT_LEN 16
+
 void ldmsd_stream_deliver(const char *stream_name, ldmsd_stream_type_t stream_type,
 			  const char *data, size_t data_len,
 			  json_entity_t entity, const char *p_name)
 {
 	json_parser_t parser = NULL;
 	ldmsd_stream_client_t c;
+	ldmsd_stream_client_t snap_buf[STREAM_SNAPSHOT_LEN];
+	ldmsd_stream_client_t *snap = snap_buf;
 	ldmsd_stream_publisher_t p;
 	ldmsd_stream_t s = __find_stream(stream_name);
-	int need_free = 0;
+	struct stream_deliver_ctxt ctxt;
+	int i, n, rc, wake, serial;
 	time_t now;
 
 	now = time(NULL);
@@ -288,42 +424,113 @@ void ldmsd_stream_deliver(const char *stream_name, ldmsd_stream_type_t stream_ty
 	s->s_recv_info.last_ts = now;
 	s->s_recv_info.total_bytes += data_len;
 
+	if (p_name) {
+		p = __find_publisher(s, p_name);
+		if (!p) {
+			p = __new_publisher(p_name);
+			if (p) {
+				p->p_info.first_ts = now;
+				rbt_ins(&s->s_p_tree, &p->p_ent);
+			}
+		}
+		if (p) {
+			p->p_info.last_ts = now;
+			p->p_info.count += 1;
+			p->p_info.total_bytes += data_len;
+		}
+	}
+
+	/*
+	 * The callbacks of a stream are called one at a time unless every
+	 * client set LDMSD_STREAM_F_UNLOCKED. The s_cb_lock is taken before
+	 * any client reference, so a thread waiting for it holds none that
+	 * ldmsd_stream_close() would wait for.
+	 */
+	serial = 0;
 	LIST_FOREACH(c, &s->s_c_list, c_ent) {
+		if (!(c->c_flags & LDMSD_STREAM_F_UNLOCKED)) {
+			serial = 1;
+			break;
+		}
+	}
+	if (serial) {
+		pthread_mutex_unlock(&s->s_lock);
+		pthread_mutex_lock(&s->s_cb_lock);
+		pthread_mutex_lock(&s->s_lock);
+	}
+
+	/*
+	 * Take a snapshot of the clients so that the callbacks run without
+	 * the stream lock. A client closed in the meantime stays allocated
+	 * until the snapshot reference is dropped.
+	 */
+	n = s->s_c_count;
+	if (n > STREAM_SNAPSHOT_LEN) {
+		snap = malloc(n * sizeof(*snap));
+		if (!snap) {
+			pthread_mutex_unlock(&s->s_lock);
+			if (serial)
+				pthread_mutex_unlock(&s->s_cb_lock);
+			msglog("Out of memory delivering stream '%s'\n", stream_name);
+			return;
+		}
+	}
+	i = 0;
+	LIST_FOREACH(c, &s->s_c_list, c_ent) {
+		c->c_ref++;
+		snap[i++] = c;
+	}
+	pthread_mutex_unlock(&s->s_lock);
+
+	ctxt.snap = snap;
+	ctxt.n = n;
+	ctxt.entity = entity;
+	ctxt.entity_owned = 0;
+	ctxt.se = NULL;
+	ctxt.prev = __deliver_ctxt;
+	__deliver_ctxt = &ctxt;
+	for (i = 0; i < n; i++) {
+		c = snap[i];
+		if (__atomic_load_n(&c->c_closed, __ATOMIC_ACQUIRE))
+			continue;
 		if (stream_type == LDMSD_STREAM_JSON
-			&& c->c_flags == 0	/* client wants parsed data */
-			&& entity == NULL	/* data hasn't been parsed yet */
+			&& !(c->c_flags & LDMSD_STREAM_F_RAW) /* client wants parsed data */
+			&& ctxt.entity == NULL	/* data hasn't been parsed yet */
 			&& parser == NULL)	/* we haven't tried and failed already */
 		{
-			parser = json_parser_new(0);
+			parser = __thread_parser();
 			if (!parser)
 				continue;
-			int rc = json_parse_buffer(parser, (char *)data, data_len, &entity);
+			rc = json_parse_buffer(parser, (char *)data, data_len,
+					       &ctxt.entity);
 			if (rc)
 				continue;
-			need_free = 1;
+			ctxt.entity_owned = 1;
 		}
-		c->c_cb_fn(c, c->c_ctxt, stream_type, data, data_len, entity);
+		c->c_cb_fn(c, c->c_ctxt, stream_type, data, data_len, ctxt.entity);
 	}
-
-	if (p_name) {
-		p = __find_publisher(s, p_name);
-		if (!p) {
-			p = __new_publisher(p_name);
-			if (!p)
-				return;
-			p->p_info.first_ts = now;
-			rbt_ins(&s->s_p_tree, &p->p_ent);
-		}
-		p->p_info.last_ts = now;
-		p->p_info.count += 1;
-		p->p_info.total_bytes += data_len;
+	__deliver_ctxt = ctxt.prev;
+	if (serial)
+		pthread_mutex_unlock(&s->s_cb_lock);
+
+	if (ctxt.se)
+		ldmsd_stream_entity_put(ctxt.se);
+	else if (ctxt.entity_owned)
+		json_entity_free(ctxt.entity);
+
+	if (!n)
+		return;
+	wake = 0;
+	pthread_mutex_lock(&s->s_lock);
+	for (i = 0; i < n; i++) {
+		wake |= snap[i]->c_closed;
+		__client_put(snap[i]);
 	}
-
-	if (entity && need_free)
-		json_entity_free(entity);
-	if (parser)
-		json_parser_free(parser);
+	if (wake)
+		pthread_cond_broadcast(&s->s_close_cond);
 	pthread_mutex_unlock(&s->s_lock);
+	if (snap != snap_buf)
+		free(snap);
 }
 
 ldmsd_stream_client_t
@@ -355,9 +562,12 @@ ldmsd_stream_subscribe(const char *stream_name,
 	}
 	c->c_s = s;
 	c->c_flags = 0;
+	c->c_ref = 1;
+	c->c_closed = 0;
 	c->c_cb_fn = cb_fn;
 	c->c_ctxt = ctxt;
 	LIST_INSERT_HEAD(&s->s_c_list, c, c_ent);
+	s->s_c_count++;
 	pthread_mutex_unlock(&s->s_lock);
 	return c;
  err_1:
@@ -368,7 +578,9 @@ ldmsd_stream_subscribe(const char *stream_name,
 
 void ldmsd_stream_flags_set(ldmsd_stream_client_t c, uint32_t f)
 {
+	pthread_mutex_lock(&c->c_s->s_lock);
 	c->c_flags = f;
+	pthread_mutex_unlock(&c->c_s->s_lock);
 }
 
 uint32_t ldmsd_stream_flags_get(ldmsd_stream_client_t c)
@@ -390,20 +602,52 @@ int ldmsd_client_stream_pubstats_update(ldmsd_stream_client_t c, size_t data_len
 {
 	ldmsd_stream_t s = c->c_s;
 	time_t now = time(NULL);
+	pthread_mutex_lock(&s->s_lock);
 	if (!s->s_pub_info.first_ts)
 		s->s_pub_info.first_ts = now;
 	s->s_pub_info.count += 1;
 	s->s_pub_info.last_ts = now;
 	s->s_pub_info.total_bytes += data_len;
+	pthread_mutex_unlock(&s->s_lock);
+	return 0;
+}
+
+int ldmsd_client_stream_pubstats_drop(ldmsd_stream_client_t c, size_t data_len)
+{
+	ldmsd_stream_t s = c->c_s;
+	pthread_mutex_lock(&s->s_lock);
+	s->s_pub_info.drops += 1;
+	s->s_pub_info.drop_bytes += data_len;
+	pthread_mutex_unlock(&s->s_lock);
 	return 0;
 }
 
 void ldmsd_stream_close(ldmsd_stream_client_t c)
 {
-	pthread_mutex_lock(&c->c_s->s_lock);
+	ldmsd_stream_t s = c->c_s;
+	struct stream_deliver_ctxt *ctxt;
+	int i, self = 0;
+
+	/*
+	 * The client may be closed from a callback of the stream. The
+	 * references taken by the deliveries on this thread are not waited
+	 * for.
+	 */
+	for (ctxt = __deliver_ctxt; ctxt; ctxt = ctxt->prev) {
+		for (i = 0; i < ctxt->n; i++) {
+			if (ctxt->snap[i] == c)
+				self++;
+		}
+	}
+	pthread_mutex_lock(&s->s_lock);
 	LIST_REMOVE(c, c_ent);
-	pthread_mutex_unlock(&c->c_s->s_lock);
-	free(c);
+	s->s_c_count--;
+	__atomic_store_n(&c->c_closed, 1, __ATOMIC_RELEASE);
+	/* Wait for the callbacks running on other threads to return */
+	while (c->c_ref > 1 + self)
+		pthread_cond_wait(&s->s_close_cond, &s->s_lock);
+	__client_put(c);
+	pthread_mutex_unlock(&s->s_lock);
 }
 
 static int stream_send(struct stream_ctxt *ctxt, struct ldmsd_msg_buf *buf,
@@ -458,21 +702,78 @@ static int stream_hdr_send(struct stream_ctxt *ctxt, uint32_t msg_no,
 	return rc;
 }
 
-/**
- * \brief Publish data to stream
- *
- * \param xprt The LDMS transport handle
- * \param stream_name The name of the stream to publish
- * \param attr_id The attribute id for the data (LDMS_ATTR_STRING, LDMS_ATTR_JSON, etc...)
- * \param data A pointer to the buffer to send
- * \param data_len The size of the data buffer in bytes
- *
- * \returns 0 on success, or an errno
+/* Collect the stream's publishing statistics */
+static int __stream_pub_stats_update(const char *stream_name, size_t data_len)
+{
+	ldmsd_stream_t s;
+	time_t now = time(NULL);
+	s = __find_stream(stream_name);
+	if (!s) {
+		s = __new_stream(stream_name);
+		if (!s)
+			return ENOMEM;
+		pthread_mutex_lock(&s->s_lock);
+	}
+	if (!s->s_pub_info.first_ts)
+		s->s_pub_info.first_ts = now;
+	s->s_pub_info.count += 1;
+	s->s_pub_info.last_ts = now;
+	s->s_pub_info.total_bytes += data_len;
+	pthread_mutex_unlock(&s->s_lock);
+	return 0;
+}
+
+/*
+ * The data is sent as an ldms stream message when the peer accepts
+ * them, and as an LDMSD_STREAM_PUBLISH_REQ request otherwise. The sender
+ * waits up to timeout_ms for stream credit; 0 does not wait.
  */
+static int __stream_publish(ldms_t xprt,
+			    const char *stream_name,
+			    ldmsd_stream_type_t stream_type,
+			    const char *data, size_t data_len,
+			    int timeout_ms)
+{
+	int rc;
+
+	if (!data_len)
+		return 0;
+	if (!ldms_xprt_stream_supported(xprt))
+		return ldmsd_stream_publish_req(xprt, stream_name, stream_type,
+						data, data_len);
+	if (stream_type != LDMSD_STREAM_STRING &&
+	    stream_type != LDMSD_STREAM_JSON)
+		return EINVAL;
+	rc = ldms_xprt_stream_send_wait(xprt, stream_name, stream_type,
+					LDMS_STREAM_F_ACK, data, data_len,
+					timeout_ms);
+	if (rc)
+		return rc;
+	return __stream_pub_stats_update(stream_name, data_len);
+}
+
 int ldmsd_stream_publish(ldms_t xprt,
 			 const char *stream_name,
 			 ldmsd_stream_type_t stream_type,
 			 const char *data, size_t data_len)
+{
+	return __stream_publish(xprt, stream_name, stream_type, data, data_len,
+				LDMSD_STREAM_PUBLISH_TIMEOUT_MS);
+}
+
+int ldmsd_stream_try_publish(ldms_t xprt,
+			     const char *stream_name,
+			     ldmsd_stream_type_t stream_type,
+			     const char *data, size_t data_len)
+{
+	return __stream_publish(xprt, stream_name, stream_type, data, data_len,
+				0);
+}
+
+int ldmsd_stream_publish_req(ldms_t xprt,
+			     const char *stream_name,
+			     ldmsd_stream_type_t stream_type,
+			     const char *data, size_t data_len)
 {
 	struct ldmsd_req_attr_s a;
 	struct ldmsd_msg_buf *buf;
@@ -507,26 +808,7 @@ int ldmsd_stream_publish(ldms_t xprt,
 			(char *)&a.discrim, sizeof(a.discrim));
 	if (rc)
 		goto err;
-	rc = 0;
-
-	/* Collect the stream's publishing statistics */
-	ldmsd_stream_t s;
-	time_t now = time(NULL);
-	s = __find_stream(stream_name);
-	if (!s) {
-		s = __new_stream(stream_name);
-		if (!s) {
-			rc = ENOMEM;
-			goto err;
-		}
-		pthread_mutex_lock(&s->s_lock);
-	}
-	if (!s->s_pub_info.first_ts)
-		s->s_pub_info.first_ts = now;
-	s->s_pub_info.count += 1;
-	s->s_pub_info.last_ts = now;
-	s->s_pub_info.total_bytes += data_len;
-	pthread_mutex_unlock(&s->s_lock);
+	rc = __stream_pub_stats_update(stream_name, data_len);
 
  err:
 	if (buf)
@@ -890,7 +1172,7 @@ int __stream_info_json(struct buf_s *buf, struct ldmsd_stream_info_s *info)
 	if (rc)
 		return rc;
 	if (0 == info->first_ts)
-		goto end;
+		goto drops;
 
 	rc = buf_printf(buf, "\"first_ts\":%ld,"
 			     "\"last_ts\":%ld,"
@@ -905,8 +1187,17 @@ int __stream_info_json(struct buf_s *buf, struct ldmsd_stream_info_s *info)
 				     "\"bytes/sec\":%lf",
 				     (info->count*1.0)/(info->last_ts - info->first_ts),
 				     info->total_bytes*1.0/(info->last_ts - info->first_ts));
+		if (rc)
+			return rc;
+	}
+drops:
+	if (info->drops) {
+		rc = buf_printf(buf, "%s\"dropped\":%d,\"dropped_bytes\":%ld",
+				(info->first_ts ? "," : ""),
+				info->drops, info->drop_bytes);
+		if (rc)
+			return rc;
 	}
-end:
 	rc = buf_printf(buf, "}");
 	return rc;
 }
@@ -999,6 +1290,8 @@ char *ldmsd_stream_dir_dump()
 		tot_recv.count += s->s_recv_info.count;
 		tot_pub.total_bytes += s->s_pub_info.total_bytes;
 		tot_pub.count += s->s_pub_info.count;
+		tot_pub.drops += s->s_pub_info.drops;
+		tot_pub.drop_bytes += s->s_pub_info.drop_bytes;
 		if (tot_recv.first_ts == 0)
 			tot_recv.first_ts = s->s_recv_info.first_ts;
 		else if (tot_recv.first_ts > s->s_recv_info.first_ts)
@@ -8,6 +8,8 @@ extern "C" {
 
 struct ldmsd_stream_client_s;
 typedef struct ldmsd_stream_client_s *ldmsd_stream_client_t;
+struct ldmsd_stream_entity_s;
+typedef struct ldmsd_stream_entity_s *ldmsd_stream_entity_t;
 
 typedef enum ldmsd_stream_type_e {
 	LDMSD_STREAM_STRING,
@@ -58,17 +60,52 @@ extern int ldmsd_stream_new_publish(const char *name, ldms_t xprt);
  * STRING data can be in any format, and is delivered as-is to
  * subscribers.
  *
+ * If the subscriber has not yet consumed enough of the data published
+ * before, the function waits up to LDMSD_STREAM_PUBLISH_TIMEOUT_MS for
+ * it to catch up.
+ *
  * \param xprt The LDMS transport handle
  * \param stream_name The stream name
  * \param stream_type The format of the data to be published
  * \param data Pointer to a buffer containting the data to pubish
  * \param data_len The size of the buffer to publish
  * \return 0 The data was succesfully sent
+ * \return ETIMEDOUT The subscriber did not catch up in time; the data
+ *                   was not sent
  * \return !0 An error indicating why the data could not be published
  */
 extern int ldmsd_stream_publish(ldms_t xprt, const char *stream_name,
 				ldmsd_stream_type_t stream_type,
 				const char *data, size_t data_len);
+
+#define LDMSD_STREAM_PUBLISH_TIMEOUT_MS 10000
+/*
+ * Republishing runs in the stream delivery path, so it waits for a slow
+ * subscriber for a shorter time before the data is dropped.
+ */
+#define LDMSD_STREAM_REPUBLISH_TIMEOUT_MS 1000
+
+/**
+ * \brief Publish data to a stream without waiting
+ *
+ * The same as ldmsd_stream_publish() except that EAGAIN is returned at
+ * once when the subscriber has not yet consumed enough of the data
+ * published before. The caller may retry later or drop the data.
+ */
+extern int ldmsd_stream_try_publish(ldms_t xprt, const char *stream_name,
+				    ldmsd_stream_type_t stream_type,
+				    const char *data, size_t data_len);
+
+/**
+ * \brief Publish data to a stream as an ldmsd request
+ *
+ * The same as ldmsd_stream_publish() except that the data is always
+ * framed as an LDMSD_STREAM_PUBLISH_REQ request, as it is for peers that
+ * do not accept ldms stream messages.
+ */
+extern int ldmsd_stream_publish_req(ldms_t xprt, const char *stream_name,
+				    ldmsd_stream_type_t stream_type,
+				    const char *data, size_t data_len);
 /**
  * \brief Callback function invoked when stream data arrives
  *
@@ -78,8 +115,16 @@ extern int ldmsd_stream_publish(ldms_t xprt, const char *stream_name,
  * \param data Pointer to the published data
  * \param data_len The number of bytes of data pointed to by \c data
  * \param entity If stream_type is LDMSD_STREAM_JSON, a pointer to a
- * parsed JSON object.
+ * parsed JSON object. The object is shared by all subscribers, must not
+ * be modified, and is only valid until the callback returns unless it is
+ * kept with ldmsd_stream_entity_get().
  * \returns An integer indication the success or failure of handling the data
+ *
+ * The callback is called without the stream lock held, so it may
+ * publish, subscribe and close clients. The callbacks of a stream are
+ * called one at a time unless every client of the stream has set
+ * LDMSD_STREAM_F_UNLOCKED, in which case they may run on several threads
+ * at once.
  */
 typedef int (*ldmsd_stream_recv_cb_t)(ldmsd_stream_client_t c, void *cb_arg,
 				      ldmsd_stream_type_t stream_type,
@@ -98,9 +143,38 @@ ldmsd_stream_subscribe(const char *stream_name,
 		       ldmsd_stream_recv_cb_t cb_fn, void *cb_arg);
 /**
  * \brief Close a subscribed stream
+ *
+ * The callback is not called after the function returns. If the callback
+ * is running on other threads the function waits for it to return, so
+ * the caller must not hold a lock that the callback takes. The function
+ * may be called from a callback of the stream.
+ *
  * \param c The client handle
  */
 extern void ldmsd_stream_close(ldmsd_stream_client_t c);
+/**
+ * \brief Keep a parsed JSON entity beyond the receive callback
+ *
+ * Called from a receive callback with the \c entity it was given. The
+ * subscribers of the message share one reference-counted entity, so
+ * keeping it does not copy or re-parse the data. Called with any other
+ * entity, a copy is made.
+ *
+ * \param entity The parsed JSON entity
+ * \returns The entity handle, or NULL if \c entity is NULL or there is
+ *          no memory.
+ */
+extern ldmsd_stream_entity_t ldmsd_stream_entity_get(json_entity_t entity);
+/**
+ * \brief Return the JSON entity of a handle from ldmsd_stream_entity_get()
+ */
+extern json_entity_t ldmsd_stream_entity_json(ldmsd_stream_entity_t se);
+/**
+ * \brief Release an entity handle
+ *
+ * The entity is freed when the last handle is released.
+ */
+extern void ldmsd_stream_entity_put(ldmsd_stream_entity_t se);
 /**
  * \brief Return the name of the stream to which the client is subscribed
  *
@@ -145,6 +219,7 @@ void ldmsd_stream_deliver(const char *stream_name, ldmsd_stream_type_t stream_ty
 int ldmsd_stream_response(ldms_xprt_event_t e);
 
 #define LDMSD_STREAM_F_RAW	1	/*< Don't parse incoming stream data */
+#define LDMSD_STREAM_F_UNLOCKED	2	/*< The callback may run on several threads at once */
 /**
  * \brief Set stream delivery flags
  *
@@ -177,6 +252,14 @@ int ldmsd_stream_subscriber_count(const char *stream_name);
  */
 int ldmsd_client_stream_pubstats_update(ldmsd_stream_client_t c, size_t data_len);
 
+/**
+ * \brief Count data the client could not republish
+ *
+ * The dropped messages and bytes are reported by \c stream_status in the
+ * stream's publish statistics.
+ */
+int ldmsd_client_stream_pubstats_drop(ldmsd_stream_client_t c, size_t data_len);
+
 /**
  * Dump stream clients in JSON.
  *
@@ -55,6 +55,8 @@
 #include <assert.h>
 #include <time.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <stdint.h>
 #include <coll/rbt.h>
 #include <ovis_util/util.h>
 #include "ldms.h"
@@ -95,6 +97,7 @@ void ldmsd_strgp___del(ldmsd_cfgobj_t obj)
 	if (strgp->decomp_name)
 		free(strgp->decomp_name);
 	free(strgp->digest);
+	assert(!strgp->queue);
 	ldmsd_cfgobj___del(obj);
 }
 
@@ -134,6 +137,37 @@ void ldmsd_timespec_add(struct timespec *a, struct timespec *b, struct timespec
 	}
 }
 
+void ldmsd_stat_update(struct ldmsd_stat *stat, struct timespec *start,
+		       struct timespec *end)
+{
+	double dur = ((end->tv_sec - start->tv_sec) * 1e9 +
+		      (end->tv_nsec - start->tv_nsec)) / 1e3; /* usec */
+
+	stat->count++;
+	if (1 == stat->count) {
+		stat->avg = stat->min = stat->max = dur;
+	} else {
+		stat->avg = (stat->avg * ((stat->count - 1.0)/stat->count)) + (dur/stat->count);
+		if (stat->min > dur)
+			stat->min = dur;
+		else if (stat->max < dur)
+			stat->max = dur;
+	}
+}
+
+void ldmsd_lat_hist_update(struct ldmsd_lat_hist *hist, struct timespec *start,
+			   struct timespec *end)
+{
+	int64_t us = (end->tv_sec - start->tv_sec) * 1000000 +
+		     (end->tv_nsec - start->tv_nsec) / 1000;
+	int i = 0;
+
+	while (i < LDMSD_LAT_HIST_BUCKETS - 1 && us >= (1L << i))
+		i++;
+	__atomic_fetch_add(&hist->bucket[i], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+}
+
 int ldmsd_timespec_from_str(struct timespec *result, const char *str)
 {
 	int rc = 0;
@@ -175,57 +209,759 @@ out:
 	return rc;
 }
 
-static void strgp_decompose(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set)
+static void strgp_decompose(ldmsd_strgp_t strgp, ldms_set_t set)
 {
 	struct ldmsd_row_list_s row_list = TAILQ_HEAD_INITIALIZER(row_list);
 	int row_count, rc;
-	rc = strgp->decomp->decompose(strgp, prd_set->set, &row_list, &row_count);
+	rc = strgp->decomp->decompose(strgp, set, &row_list, &row_count);
 	if (rc) {
 		ldmsd_log(LDMSD_LERROR, "strgp decompose error: %d\n", rc);
 		return;
 	}
-	rc = strgp->store->commit(strgp, prd_set->set, &row_list, row_count);
+	rc = strgp->store->commit(strgp, set, &row_list, row_count);
 	if (rc) {
 		ldmsd_log(LDMSD_LERROR, "strgp row commit error: %d\n", rc);
 	}
 	strgp->decomp->release_rows(strgp, &row_list);
 }
 
+/*
+ * Hand the set data to the decomposer/store.
+ *
+ * Returns ENOENT if the strgp has neither a decomposer nor an open store.
+ */
+static int strgp_store(ldmsd_strgp_t strgp, ldms_set_t set)
+{
+	if (strgp->decomp_name) {
+		/* decomp() interface routine */
+		if (!strgp->decomp)
+			return ENOENT;
+		strgp_decompose(strgp, set);
+		return 0;
+	}
+	/* store() interface routine */
+	if (!strgp->store_handle)
+		return ENOENT;
+	strgp->store->store(strgp->store_handle, set,
+			    strgp->metric_arry, strgp->metric_count);
+	return 0;
+}
+
+/* Returns 1 if the store should be flushed now and restarts the interval. */
+static int strgp_flush_due(ldmsd_strgp_t strgp)
+{
+	struct timespec expiry;
+	struct timespec now;
+
+	if (!strgp->flush_interval.tv_sec && !strgp->flush_interval.tv_nsec)
+		return 0;
+	ldmsd_timespec_add(&strgp->last_flush, &strgp->flush_interval, &expiry);
+	clock_gettime(CLOCK_REALTIME, &now);
+	if (ldmsd_timespec_cmp(&now, &expiry) < 0)
+		return 0;
+	strgp->last_flush = now;
+	return 1;
+}
+
 /* protected by strgp lock */
 static void strgp_update_fn(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set)
 {
 	if (strgp->state != LDMSD_STRGP_STATE_RUNNING)
 		return;
-	if (!strgp->decomp_name)
-		goto store_routine;
-
-	/* decomp() interface routine */
-	if (!strgp->decomp) {
+	if (strgp_store(strgp, prd_set->set)) {
 		strgp->state = LDMSD_STRGP_STATE_STOPPED;
 		return;
 	}
-	strgp_decompose(strgp, prd_set);
-	goto out;
+	if (strgp_flush_due(strgp))
+		strgp->store->flush(strgp->store_handle);
+}
 
-	/* store() interface routine */
- store_routine:
-	if (!strgp->store_handle) {
+/*
+ * Parallel commit
+ *
+ * The storage policies added with commit=parallel are not run by the
+ * updater one after another. The update completion path hands all of them
+ * to ldmsd_strgp_commit_parallel(), which decomposes the set once for each
+ * decomposition configuration in use and runs the commit() (or store())
+ * of every storage policy on a pool of commit threads shared by all
+ * storage policies. The completion path waits for the commits, so the set
+ * does not change under them and the updates of a set are committed to a
+ * storage policy in order; the update latency is that of the slowest store
+ * rather than the sum of all of them.
+ *
+ * The rows of one decomposition are shared read-only by the commits and
+ * released by the storage policy that made them once all commits are done.
+ * Each pool thread has its own job queue. Jobs are dealt round-robin and a
+ * thread whose queue is empty steals the newest job of another queue. The
+ * completion thread runs one of the jobs itself.
+ */
+struct strgp_rows {
+	ldmsd_strgp_t owner;	/* decomposed the rows and releases them */
+	struct ldmsd_row_list_s row_list;
+	int row_count;
+	int rc;
+};
+
+struct strgp_commit_batch {
+	pthread_mutex_t lock;
+	pthread_cond_t done_cv;
+	int pending;
+	struct timespec *update_ts;
+};
+
+struct strgp_commit_job {
+	ldmsd_strgp_t strgp;
+	ldms_set_t set;
+	struct strgp_rows *rows;	/* NULL for the store() interface */
+	struct strgp_commit_batch *batch;
+	TAILQ_ENTRY(strgp_commit_job) entry;
+};
+TAILQ_HEAD(strgp_commit_job_list, strgp_commit_job);
+
+struct strgp_commit_worker {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	struct strgp_commit_job_list q;
+};
+
+#define LDMSD_COMMIT_THREADS_ENV "LDMSD_COMMIT_THREADS"
+#define STRGP_COMMIT_THREADS_MAX 16
+
+static struct strgp_commit_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work_cv;	/* signaled when jobs are posted */
+	int queued;		/* jobs posted and not taken yet */
+	int next;		/* the worker dealt the next job */
+	int count;
+	struct strgp_commit_worker *workers;
+} commit_pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work_cv = PTHREAD_COND_INITIALIZER,
+};
+
+static void strgp_commit_job_run(struct strgp_commit_job *job)
+{
+	ldmsd_strgp_t strgp = job->strgp;
+	struct strgp_commit_batch *batch = job->batch;
+	struct timespec start, end;
+	int rc;
+
+	ldmsd_strgp_lock(strgp);
+	if (strgp->state != LDMSD_STRGP_STATE_RUNNING)
+		goto out;
+	clock_gettime(CLOCK_REALTIME, &start);
+	if (job->rows) {
+		rc = strgp->store->commit(strgp, job->set, &job->rows->row_list,
+					  job->rows->row_count);
+		if (rc)
+			ldmsd_log(LDMSD_LERROR, "strgp row commit error: %d\n", rc);
+	} else if (strgp_store(strgp, job->set)) {
 		strgp->state = LDMSD_STRGP_STATE_STOPPED;
-		return;
+		goto out;
 	}
-	strgp->store->store(strgp->store_handle, prd_set->set,
-			    strgp->metric_arry, strgp->metric_count);
+	clock_gettime(CLOCK_REALTIME, &end);
+	ldmsd_stat_update(&strgp->stat, &start, &end);
+	ldmsd_lat_hist_update(&strgp->commit_lat, &start, &end);
+	ldmsd_lat_hist_update(&strgp->update_lat, batch->update_ts, &end);
+	if (strgp_flush_due(strgp))
+		strgp->store->flush(strgp->store_handle);
+ out:
+	ldmsd_strgp_unlock(strgp);
+	/* the job and the batch belong to the waiter once pending is 0 */
+	pthread_mutex_lock(&batch->lock);
+	if (0 == --batch->pending)
+		pthread_cond_signal(&batch->done_cv);
+	pthread_mutex_unlock(&batch->lock);
+}
+
+/* The oldest job of our own queue, or the newest job of another queue */
+static struct strgp_commit_job *strgp_commit_job_take(int self)
+{
+	struct strgp_commit_pool *p = &commit_pool;
+	struct strgp_commit_worker *w;
+	struct strgp_commit_job *job;
+	int i;
+
+	for (i = 0; i < p->count; i++) {
+		w = &p->workers[(self + i) % p->count];
+		pthread_mutex_lock(&w->lock);
+		if (i == 0)
+			job = TAILQ_FIRST(&w->q);
+		else
+			job = TAILQ_LAST(&w->q, strgp_commit_job_list);
+		if (job)
+			TAILQ_REMOVE(&w->q, job, entry);
+		pthread_mutex_unlock(&w->lock);
+		if (job) {
+			__atomic_sub_fetch(&p->queued, 1, __ATOMIC_SEQ_CST);
+			return job;
+		}
+	}
+	return NULL;
+}
+
+static void *strgp_commit_proc(void *arg)
+{
+	struct strgp_commit_pool *p = &commit_pool;
+	int self = (int)(uintptr_t)arg;
+	struct strgp_commit_job *job;
+
+	while (1) {
+		job = strgp_commit_job_take(self);
+		if (job) {
+			strgp_commit_job_run(job);
+			continue;
+		}
+		pthread_mutex_lock(&p->lock);
+		/* A taker may briefly drive the count below 0, see post */
+		while (__atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) <= 0)
+			pthread_cond_wait(&p->work_cv, &p->lock);
+		pthread_mutex_unlock(&p->lock);
+	}
+	return NULL;
+}
+
+/* Start the commit threads on first use. Returns 0 if there is a pool. */
+static int strgp_commit_pool_start(void)
+{
+	struct strgp_commit_pool *p = &commit_pool;
+	struct strgp_commit_worker *workers;
+	char name[16];
+	char *str;
+	int i, count, rc = 0;
+
+	if (__atomic_load_n(&p->count, __ATOMIC_ACQUIRE))
+		return 0;
+	pthread_mutex_lock(&p->lock);
+	if (p->count)
+		goto out;
+	str = getenv(LDMSD_COMMIT_THREADS_ENV);
+	if (str)
+		count = atoi(str);
+	else
+		count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (count < 1)
+		count = 1;
+	if (count > STRGP_COMMIT_THREADS_MAX)
+		count = STRGP_COMMIT_THREADS_MAX;
+	workers = calloc(count, sizeof(*workers));
+	if (!workers) {
+		rc = ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < count; i++) {
+		pthread_mutex_init(&workers[i].lock, NULL);
+		TAILQ_INIT(&workers[i].q);
+	}
+	p->workers = workers;
+	__atomic_store_n(&p->count, count, __ATOMIC_RELEASE);
+	for (i = 0; i < count; i++) {
+		rc = pthread_create(&workers[i].thread, NULL, strgp_commit_proc,
+				    (void *)(uintptr_t)i);
+		if (rc)
+			break;
+		snprintf(name, sizeof(name), "strgp_commit:%d", i);
+		pthread_setname_np(workers[i].thread, name);
+	}
+	if (i == 0) {
+		/* no thread to run the jobs; commit in the update path */
+		ldmsd_log(LDMSD_LERROR, "Cannot create the commit threads: %d\n", rc);
+		__atomic_store_n(&p->count, 0, __ATOMIC_RELEASE);
+		p->workers = NULL;
+		free(workers);
+		goto out;
+	}
+	/* the queues of the threads that failed to start are stolen from */
+	rc = 0;
+	ldmsd_log(LDMSD_LINFO, "Started %d of %d commit threads\n", i, count);
  out:
-	if (strgp->flush_interval.tv_sec || strgp->flush_interval.tv_nsec) {
-		struct timespec expiry;
-		struct timespec now;
-		ldmsd_timespec_add(&strgp->last_flush, &strgp->flush_interval, &expiry);
-		clock_gettime(CLOCK_REALTIME, &now);
-		if (ldmsd_timespec_cmp(&now, &expiry) >= 0) {
-			clock_gettime(CLOCK_REALTIME, &strgp->last_flush);
+	pthread_mutex_unlock(&p->lock);
+	return rc;
+}
+
+static void strgp_commit_post(struct strgp_commit_job *jobs, int count)
+{
+	struct strgp_commit_pool *p = &commit_pool;
+	struct strgp_commit_worker *w;
+	int i;
+
+	pthread_mutex_lock(&p->lock);
+	for (i = 0; i < count; i++) {
+		w = &p->workers[p->next];
+		p->next = (p->next + 1) % p->count;
+		pthread_mutex_lock(&w->lock);
+		TAILQ_INSERT_TAIL(&w->q, &jobs[i], entry);
+		pthread_mutex_unlock(&w->lock);
+		__atomic_add_fetch(&p->queued, 1, __ATOMIC_SEQ_CST);
+	}
+	pthread_cond_broadcast(&p->work_cv);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/*
+ * Find the rows decomposed with the same configuration as \c strgp. The
+ * configuration file is parsed when a storage policy starts, so policies
+ * naming the same file may still run different configurations; the
+ * digest of the file content is compared instead of the path.
+ */
+static struct strgp_rows *
+strgp_rows_find(struct strgp_rows *rows, int count, ldmsd_strgp_t strgp)
+{
+	int i;
+	for (i = 0; i < count; i++) {
+		if (rows[i].owner->decomp == strgp->decomp ||
+		    rows[i].owner->decomp_digest == strgp->decomp_digest)
+			return &rows[i];
+	}
+	return NULL;
+}
+
+void ldmsd_strgp_commit_parallel(ldmsd_prdcr_set_t prd_set,
+				 struct timespec *update_ts)
+{
+	struct strgp_commit_batch batch;
+	struct strgp_commit_job *jobs;
+	struct strgp_rows *rows, *r;
+	ldmsd_strgp_ref_t ref;
+	ldmsd_strgp_t strgp;
+	int i, count = 0, job_count = 0, rows_count = 0;
+
+	LIST_FOREACH(ref, &prd_set->strgp_list, entry) {
+		if (ref->strgp->commit_parallel)
+			count++;
+	}
+	jobs = calloc(count, sizeof(*jobs));
+	rows = calloc(count, sizeof(*rows));
+	if (!jobs || !rows) {
+		ldmsd_log(LDMSD_LERROR, "Out of memory committing set '%s'.\n",
+			  prd_set->inst_name);
+		goto out;
+	}
+	pthread_mutex_init(&batch.lock, NULL);
+	pthread_cond_init(&batch.done_cv, NULL);
+	batch.update_ts = update_ts;
+
+	LIST_FOREACH(ref, &prd_set->strgp_list, entry) {
+		strgp = ref->strgp;
+		if (!strgp->commit_parallel)
+			continue;
+		ldmsd_strgp_lock(strgp);
+		if (strgp->state != LDMSD_STRGP_STATE_RUNNING)
+			goto next;
+		r = NULL;
+		if (strgp->decomp_name) {
+			if (!strgp->decomp) {
+				strgp->state = LDMSD_STRGP_STATE_STOPPED;
+				goto next;
+			}
+			r = strgp_rows_find(rows, rows_count, strgp);
+			if (!r) {
+				r = &rows[rows_count++];
+				r->owner = strgp;
+				TAILQ_INIT(&r->row_list);
+				r->rc = strgp->decomp->decompose(strgp, prd_set->set,
+						&r->row_list, &r->row_count);
+				if (r->rc)
+					ldmsd_log(LDMSD_LERROR,
+						  "strgp decompose error: %d\n", r->rc);
+			}
+			if (r->rc)
+				goto next;
+		} else if (!strgp->store_handle) {
+			strgp->state = LDMSD_STRGP_STATE_STOPPED;
+			goto next;
+		}
+		jobs[job_count].strgp = strgp;
+		jobs[job_count].set = prd_set->set;
+		jobs[job_count].rows = r;
+		jobs[job_count].batch = &batch;
+		job_count++;
+	next:
+		ldmsd_strgp_unlock(strgp);
+	}
+
+	batch.pending = job_count;
+	if (job_count > 1 && 0 == strgp_commit_pool_start()) {
+		strgp_commit_post(&jobs[1], job_count - 1);
+		job_count = 1;
+	}
+	for (i = 0; i < job_count; i++)
+		strgp_commit_job_run(&jobs[i]);
+	pthread_mutex_lock(&batch.lock);
+	while (batch.pending)
+		pthread_cond_wait(&batch.done_cv, &batch.lock);
+	pthread_mutex_unlock(&batch.lock);
+	pthread_mutex_destroy(&batch.lock);
+	pthread_cond_destroy(&batch.done_cv);
+
+	for (i = 0; i < rows_count; i++) {
+		if (rows[i].rc)
+			continue;
+		ldmsd_strgp_lock(rows[i].owner);
+		rows[i].owner->decomp->release_rows(rows[i].owner,
+						    &rows[i].row_list);
+		ldmsd_strgp_unlock(rows[i].owner);
+	}
+ out:
+	free(jobs);
+	free(rows);
+}
+
+/*
+ * Asynchronous storage queue
+ *
+ * When a strgp is configured with a queue depth, the update completion path
+ * only takes a snapshot of the set and appends it to the strgp queue. The
+ * worker threads of the queue hand the snapshots to store()/commit(), so a
+ * slow storage backend no longer stalls the zap I/O thread that completed
+ * the update.
+ *
+ * Updates of the same set are never stored concurrently nor out of order: a
+ * worker skips the queue entries of a set that another worker is storing.
+ * The store plugin and the decomposer are called by one worker at a time,
+ * as in the update completion path, unless the strgp has no decomposer and
+ * the plugin sets LDMSD_STORE_F_MT_SAFE.
+ * Snapshots are recycled through a free list so that the steady state does
+ * not allocate.
+ */
+struct strgp_qent {
+	const void *key;	/* the source set; keeps per-set ordering */
+	ldms_set_t snap;
+	struct timespec ts;	/* when the update was queued */
+	TAILQ_ENTRY(strgp_qent) entry;
+};
+TAILQ_HEAD(strgp_qent_list, strgp_qent);
+
+struct strgp_worker {
+	pthread_t thread;
+	const void *key;	/* the set being stored, or NULL */
+	ldmsd_strgp_queue_t q;
+};
+
+struct ldmsd_strgp_queue_s {
+	ldmsd_strgp_t strgp;
+	pthread_mutex_t lock;
+	pthread_cond_t work_cv;		/* signaled when there is work */
+	pthread_cond_t space_cv;	/* signaled when a slot is freed */
+	pthread_mutex_t store_lock;	/* serializes the store calls */
+	int store_mt;			/* the store calls are not serialized */
+	int stopping;
+	struct strgp_qent_list q;	/* queued updates, oldest first */
+	struct strgp_qent_list free_q;	/* recycled entries */
+	int free_count;
+	struct ldmsd_strgp_queue_stats stats;
+	int thread_count;
+	struct strgp_worker workers[OVIS_FLEX];
+};
+
+int ldmsd_strgp_queue_policy_from_str(const char *str,
+				      ldmsd_strgp_queue_policy_t *policy)
+{
+	if (0 == strcasecmp(str, "drop_oldest"))
+		*policy = LDMSD_STRGP_QUEUE_DROP_OLDEST;
+	else if (0 == strcasecmp(str, "drop_newest"))
+		*policy = LDMSD_STRGP_QUEUE_DROP_NEWEST;
+	else if (0 == strcasecmp(str, "block"))
+		*policy = LDMSD_STRGP_QUEUE_BLOCK;
+	else
+		return EINVAL;
+	return 0;
+}
+
+/* Caller must hold q->lock */
+static void strgp_qent_recycle(ldmsd_strgp_queue_t q, struct strgp_qent *ent)
+{
+	if (q->free_count >= q->stats.max_depth) {
+		ldms_set_snapshot_free(ent->snap);
+		free(ent);
+		return;
+	}
+	ent->key = NULL;
+	TAILQ_INSERT_HEAD(&q->free_q, ent, entry);
+	q->free_count++;
+}
+
+/* Caller must hold q->lock */
+static struct strgp_qent *strgp_qent_next(ldmsd_strgp_queue_t q)
+{
+	struct strgp_qent *ent;
+	int i;
+
+	TAILQ_FOREACH(ent, &q->q, entry) {
+		for (i = 0; i < q->thread_count; i++) {
+			if (q->workers[i].key == ent->key)
+				break;
+		}
+		if (i == q->thread_count)
+			return ent;
+	}
+	return NULL;
+}
+
+static void *strgp_queue_proc(void *arg)
+{
+	struct strgp_worker *w = arg;
+	ldmsd_strgp_queue_t q = w->q;
+	ldmsd_strgp_t strgp = q->strgp;
+	struct strgp_qent *ent;
+	struct timespec start, end;
+	int flush;
+
+	pthread_mutex_lock(&q->lock);
+	while (1) {
+		ent = strgp_qent_next(q);
+		if (!ent) {
+			if (q->stopping && TAILQ_EMPTY(&q->q))
+				break;
+			pthread_cond_wait(&q->work_cv, &q->lock);
+			continue;
+		}
+		TAILQ_REMOVE(&q->q, ent, entry);
+		q->stats.depth--;
+		w->key = ent->key;
+		pthread_cond_signal(&q->space_cv);
+		pthread_mutex_unlock(&q->lock);
+
+		if (!q->store_mt)
+			pthread_mutex_lock(&q->store_lock);
+		clock_gettime(CLOCK_REALTIME, &start);
+		strgp_store(strgp, ent->snap);
+		clock_gettime(CLOCK_REALTIME, &end);
+		if (!q->store_mt)
+			pthread_mutex_unlock(&q->store_lock);
+
+		ldmsd_lat_hist_update(&strgp->commit_lat, &start, &end);
+		ldmsd_lat_hist_update(&strgp->update_lat, &ent->ts, &end);
+
+		pthread_mutex_lock(&q->lock);
+		ldmsd_stat_update(&q->stats.store_stat, &start, &end);
+		q->stats.stored++;
+		w->key = NULL;
+		strgp_qent_recycle(q, ent);
+		flush = strgp_flush_due(strgp);
+		/* Entries of this set may have been skipped by other workers */
+		pthread_cond_broadcast(&q->work_cv);
+		if (flush) {
+			pthread_mutex_unlock(&q->lock);
+			pthread_mutex_lock(&q->store_lock);
 			strgp->store->flush(strgp->store_handle);
+			pthread_mutex_unlock(&q->store_lock);
+			pthread_mutex_lock(&q->lock);
 		}
 	}
+	pthread_mutex_unlock(&q->lock);
+	return NULL;
+}
+
+/* Drain the queue, join the workers and free the queue. */
+static void strgp_queue_free(ldmsd_strgp_queue_t q)
+{
+	struct strgp_qent *ent;
+	int i;
+
+	pthread_mutex_lock(&q->lock);
+	q->stopping = 1;
+	pthread_cond_broadcast(&q->work_cv);
+	pthread_cond_broadcast(&q->space_cv);
+	pthread_mutex_unlock(&q->lock);
+	for (i = 0; i < q->thread_count; i++) {
+		if (q->workers[i].thread)
+			pthread_join(q->workers[i].thread, NULL);
+	}
+	/* Queued entries are left only if no worker could be started */
+	while ((ent = TAILQ_FIRST(&q->q))) {
+		TAILQ_REMOVE(&q->q, ent, entry);
+		ldms_set_snapshot_free(ent->snap);
+		free(ent);
+	}
+	while ((ent = TAILQ_FIRST(&q->free_q))) {
+		TAILQ_REMOVE(&q->free_q, ent, entry);
+		ldms_set_snapshot_free(ent->snap);
+		free(ent);
+	}
+	pthread_mutex_destroy(&q->lock);
+	pthread_mutex_destroy(&q->store_lock);
+	pthread_cond_destroy(&q->work_cv);
+	pthread_cond_destroy(&q->space_cv);
+	free(q);
+}
+
+static ldmsd_strgp_queue_t strgp_queue_new(ldmsd_strgp_t strgp)
+{
+	ldmsd_strgp_queue_t q;
+	char name[16];
+	int i, rc;
+	int count = strgp->queue_threads > 0 ? strgp->queue_threads : 1;
+
+	q = calloc(1, sizeof(*q) + count * sizeof(q->workers[0]));
+	if (!q)
+		return NULL;
+	q->strgp = strgp;
+	q->store_mt = !strgp->decomp_name &&
+		      (strgp->store->flags & LDMSD_STORE_F_MT_SAFE);
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_mutex_init(&q->store_lock, NULL);
+	pthread_cond_init(&q->work_cv, NULL);
+	pthread_cond_init(&q->space_cv, NULL);
+	TAILQ_INIT(&q->q);
+	TAILQ_INIT(&q->free_q);
+	q->stats.max_depth = strgp->queue_depth;
+	q->stats.threads = count;
+	q->thread_count = count;
+	for (i = 0; i < count; i++) {
+		q->workers[i].q = q;
+		rc = pthread_create(&q->workers[i].thread, NULL,
+				    strgp_queue_proc, &q->workers[i]);
+		if (rc) {
+			q->workers[i].thread = 0;
+			strgp_queue_free(q);
+			errno = rc;
+			return NULL;
+		}
+		snprintf(name, sizeof(name), "strgp:%hu", (unsigned short)i);
+		pthread_setname_np(q->workers[i].thread, name);
+	}
+	return q;
+}
+
+/* protected by strgp lock */
+static void strgp_enqueue_fn(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set)
+{
+	ldmsd_strgp_queue_t q = strgp->queue;
+	struct strgp_qent *ent;
+	struct timespec deadline = { 0, 0 };
+	ldms_set_t snap;
+
+	if (strgp->state != LDMSD_STRGP_STATE_RUNNING || !q)
+		return;
+
+	pthread_mutex_lock(&q->lock);
+	while (q->stats.depth >= q->stats.max_depth) {
+		switch (strgp->queue_policy) {
+		case LDMSD_STRGP_QUEUE_DROP_OLDEST:
+			ent = TAILQ_FIRST(&q->q);
+			if (!ent)
+				goto drop_newest;
+			TAILQ_REMOVE(&q->q, ent, entry);
+			q->stats.depth--;
+			q->stats.dropped_oldest++;
+			strgp_qent_recycle(q, ent);
+			break;
+		case LDMSD_STRGP_QUEUE_BLOCK:
+			/*
+			 * This stalls the thread completing the update, and
+			 * the other updates it would complete, so the wait is
+			 * bounded.
+			 */
+			if (q->stopping)
+				goto drop_newest;
+			if (!deadline.tv_sec) {
+				q->stats.blocked++;
+				clock_gettime(CLOCK_REALTIME, &deadline);
+				deadline.tv_sec += LDMSD_STRGP_QUEUE_BLOCK_MS / 1000;
+				deadline.tv_nsec += (LDMSD_STRGP_QUEUE_BLOCK_MS % 1000) * 1000000;
+				if (deadline.tv_nsec >= 1000000000) {
+					deadline.tv_sec++;
+					deadline.tv_nsec -= 1000000000;
+				}
+			}
+			if (ETIMEDOUT == pthread_cond_timedwait(&q->space_cv,
+							&q->lock, &deadline)
+			    && q->stats.depth >= q->stats.max_depth) {
+				q->stats.block_timeouts++;
+				goto drop_newest;
+			}
+			break;
+		case LDMSD_STRGP_QUEUE_DROP_NEWEST:
+		default:
+			goto drop_newest;
+		}
+	}
+	/* Reserve the slot; the snapshot is taken without the queue lock */
+	q->stats.depth++;
+	ent = TAILQ_FIRST(&q->free_q);
+	if (ent) {
+		TAILQ_REMOVE(&q->free_q, ent, entry);
+		q->free_count--;
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	if (!ent) {
+		ent = calloc(1, sizeof(*ent));
+		if (!ent)
+			goto enomem;
+	}
+	snap = ldms_set_snapshot(prd_set->set, ent->snap);
+	if (!snap) {
+		free(ent);
+		goto enomem;
+	}
+	ent->snap = snap;
+	ent->key = prd_set->set;
+	clock_gettime(CLOCK_REALTIME, &ent->ts);
+
+	pthread_mutex_lock(&q->lock);
+	TAILQ_INSERT_TAIL(&q->q, ent, entry);
+	q->stats.enqueued++;
+	if (q->stats.depth > q->stats.high_water)
+		q->stats.high_water = q->stats.depth;
+	pthread_cond_signal(&q->work_cv);
+	pthread_mutex_unlock(&q->lock);
+	return;
+
+ drop_newest:
+	q->stats.dropped_newest++;
+	pthread_mutex_unlock(&q->lock);
+	return;
+
+ enomem:
+	ldmsd_log(LDMSD_LERROR, "strgp '%s': out of memory queuing set '%s'.\n",
+		  strgp->obj.name, prd_set->inst_name);
+	pthread_mutex_lock(&q->lock);
+	q->stats.depth--;
+	q->stats.dropped_newest++;
+	pthread_cond_signal(&q->space_cv);
+	pthread_mutex_unlock(&q->lock);
+}
+
+/* Caller must hold the strgp lock */
+int ldmsd_strgp_queue_stats_get(ldmsd_strgp_t strgp,
+				struct ldmsd_strgp_queue_stats *stats)
+{
+	ldmsd_strgp_queue_t q = strgp->queue;
+	if (!q)
+		return ENOENT;
+	pthread_mutex_lock(&q->lock);
+	*stats = q->stats;
+	pthread_mutex_unlock(&q->lock);
+	return 0;
+}
+
+/* Caller must hold the strgp lock */
+static int strgp_queue_start(ldmsd_strgp_t strgp)
+{
+	if (!strgp->queue_depth) {
+		strgp->update_fn = strgp_update_fn;
+		return 0;
+	}
+	strgp->queue = strgp_queue_new(strgp);
+	if (!strgp->queue)
+		return errno;
+	strgp->update_fn = strgp_enqueue_fn;
+	return 0;
+}
+
+/*
+ * Caller must hold the strgp lock. The queued updates are stored before
+ * returning so that the store can be closed afterward.
+ */
+static void strgp_queue_stop(ldmsd_strgp_t strgp)
+{
+	if (!strgp->queue)
+		return;
+	strgp_queue_free(strgp->queue);
+	strgp->queue = NULL;
+	strgp->update_fn = strgp_update_fn;
 }
 
 ldmsd_strgp_t
@@ -246,6 +982,8 @@ ldmsd_strgp_new_with_auth(const char *name, uid_t uid, gid_t gid, int perm)
 	strgp->last_flush.tv_sec = 0;
 	strgp->last_flush.tv_nsec = 0;
 	strgp->update_fn = strgp_update_fn;
+	strgp->queue_threads = 1;
+	strgp->queue_policy = LDMSD_STRGP_QUEUE_DROP_OLDEST;
 	LIST_INIT(&strgp->prdcr_list);
 	TAILQ_INIT(&strgp->metric_list);
 	ldmsd_task_init(&strgp->task);
@@ -729,6 +1467,9 @@ int __ldmsd_strgp_start(ldmsd_strgp_t strgp, ldmsd_sec_ctxt_t ctxt)
 		rc = EBUSY;
 		goto out;
 	}
+	rc = strgp_queue_start(strgp);
+	if (rc)
+		goto out;
 	strgp->state = LDMSD_STRGP_STATE_RUNNING;
 	clock_gettime(CLOCK_REALTIME, &strgp->last_flush);
 	strgp->obj.perm |= LDMSD_PERM_DSTART;
@@ -764,6 +1505,7 @@ int __ldmsd_strgp_stop(ldmsd_strgp_t strgp, ldmsd_sec_ctxt_t ctxt)
 		goto out;
 	}
 	ldmsd_task_stop(&strgp->task);
+	strgp_queue_stop(strgp);
 	strgp_close(strgp);
 	strgp->state = LDMSD_STRGP_STATE_STOPPED;
 	strgp->obj.perm &= ~LDMSD_PERM_DSTART;
@@ -844,6 +1586,7 @@ void ldmsd_strgp_close()
 			goto next;
 		}
 		ldmsd_task_stop(&strgp->task);
+		strgp_queue_stop(strgp);
 		strgp_close(strgp);
 		strgp->state = LDMSD_STRGP_STATE_STOPPED;
 		ldmsd_strgp_unlock(strgp);
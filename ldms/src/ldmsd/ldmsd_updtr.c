@@ -68,6 +68,7 @@ static inline double ts_diff_usec(struct timespec *a, struct timespec *b)
 	return (aa - bb)/1e3; /* make it usec */
 }
 
+static void updtr_task_sched_free(ldmsd_updtr_task_t task);
 void ldmsd_updtr___del(ldmsd_cfgobj_t obj)
 {
 	ldmsd_updtr_t updtr = (ldmsd_updtr_t)obj;
@@ -89,6 +90,7 @@ void ldmsd_updtr___del(ldmsd_cfgobj_t obj)
 		ldmsd_cfgobj_put(&prdcr_ref->prdcr->obj);
 		free(prdcr_ref);
 	}
+	updtr_task_sched_free(&updtr->default_task);
 	ldmsd_cfgobj___del(obj);
 }
 
@@ -203,6 +205,7 @@ static void updtr_task_del(ldmsd_updtr_task_t task)
 	ldmsd_updtr_t updtr = task->updtr;
 	ldmsd_task_join(&task->task);
 	rbt_del(&updtr->task_tree, &task->rbn);
+	updtr_task_sched_free(task);
 	free(task);
 }
 
@@ -216,23 +219,6 @@ static void updtr_task_set_reset(ldmsd_updtr_task_t task)
 	task->set_count = 0;
 }
 
-static inline void
-__stats(struct ldmsd_stat *stat, struct timespec *start, struct timespec *end)
-{
-	double dur = ts_diff_usec(end, start);
-
-	stat->count++;
-	if (1 == stat->count) {
-		stat->avg = stat->min = stat->max = dur;
-	} else {
-		stat->avg = (stat->avg * ((stat->count - 1.0)/stat->count)) + (dur/stat->count);
-		if (stat->min > dur)
-			stat->min = dur;
-		else if (stat->max < dur)
-			stat->max = dur;
-	}
-}
-
 static void updtr_update_cb(ldms_t t, ldms_set_t set, int status, void *arg)
 {
 	uint64_t gn, push_it = 0;
@@ -240,10 +226,11 @@ static void updtr_update_cb(ldms_t t, ldms_set_t set, int status, void *arg)
 	int errcode;
 	struct timespec start;
 	struct timespec end;
+	struct timespec update_ts;
 
 	pthread_mutex_lock(&prd_set->lock);
 	clock_gettime(CLOCK_REALTIME, &prd_set->updt_stat.end);
-	__stats(&prd_set->updt_stat, &prd_set->updt_stat.start, &prd_set->updt_stat.end);
+	ldmsd_stat_update(&prd_set->updt_stat, &prd_set->updt_stat.start, &prd_set->updt_stat.end);
 
 	errcode = LDMS_UPD_ERROR(status);
 	ldmsd_log(LDMSD_LDEBUG, "Update complete for Set %s with status %#x\n",
@@ -276,16 +263,29 @@ static void updtr_update_cb(ldms_t t, ldms_set_t set, int status, void *arg)
 	push_it = 1;
 
 	ldmsd_strgp_ref_t str_ref;
+	int parallel = 0;
+	clock_gettime(CLOCK_REALTIME, &update_ts);
 	LIST_FOREACH(str_ref, &prd_set->strgp_list, entry) {
 		ldmsd_strgp_t strgp = str_ref->strgp;
 
+		if (strgp->commit_parallel) {
+			parallel = 1;
+			continue;
+		}
 		ldmsd_strgp_lock(strgp);
 		clock_gettime(CLOCK_REALTIME, &start);
 		strgp->update_fn(strgp, prd_set);
 		clock_gettime(CLOCK_REALTIME, &end);
-		__stats(&strgp->stat, &start, &end);
+		ldmsd_stat_update(&strgp->stat, &start, &end);
+		if (!strgp->queue) {
+			/* queued updates are accounted for by the workers */
+			ldmsd_lat_hist_update(&strgp->commit_lat, &start, &end);
+			ldmsd_lat_hist_update(&strgp->update_lat, &update_ts, &end);
+		}
 		ldmsd_strgp_unlock(strgp);
 	}
+	if (parallel)
+		ldmsd_strgp_commit_parallel(prd_set, &update_ts);
 set_ready:
 	if ((status & LDMS_UPD_F_MORE) == 0)
 		/* No more data pending move prdcr_set state UPDATING --> READY */
@@ -336,9 +336,55 @@ __grp_iter_cb(ldms_set_t grp, const char *name, void *arg)
 	return 0;
 }
 
+/*
+ * The pull updates of the sets of a producer are collected in a batch and
+ * handed to ldms_xprt_update_batch() together, so that the transport can
+ * request the data of many sets at once.
+ */
+#define UPDTR_BATCH_MAX 64
+struct updtr_batch_s {
+	int count;
+	int total;	/* updates added since the batch was initialized */
+	ldms_set_t sets[UPDTR_BATCH_MAX];
+	void *args[UPDTR_BATCH_MAX];
+	int rcs[UPDTR_BATCH_MAX];
+};
+
+static void updtr_batch_flush(struct updtr_batch_s *batch)
+{
+	int i;
+	ldmsd_prdcr_set_t prd_set;
+
+	if (!batch->count)
+		return;
+	ldms_xprt_update_batch(batch->sets, batch->count, updtr_update_cb,
+			       batch->args, batch->rcs);
+	for (i = 0; i < batch->count; i++) {
+		if (!batch->rcs[i])
+			continue;
+		prd_set = batch->args[i];
+		ldmsd_log(LDMSD_LINFO, "Synchronous error %d: Updating Set %s\n",
+					batch->rcs[i], prd_set->inst_name);
+		ldmsd_prdcr_set_ref_put(prd_set);
+	}
+	batch->count = 0;
+}
+
+static void updtr_batch_add(struct updtr_batch_s *batch,
+			    ldmsd_prdcr_set_t prd_set)
+{
+	batch->sets[batch->count] = prd_set->set;
+	batch->args[batch->count] = prd_set;
+	batch->count++;
+	batch->total++;
+	if (batch->count == UPDTR_BATCH_MAX)
+		updtr_batch_flush(batch);
+}
+
 void __ldmsd_prdset_lookup_cb(ldms_t xprt, enum ldms_lookup_status status,
 			      int more, ldms_set_t set, void *arg);
-static int schedule_set_updates(ldmsd_prdcr_set_t prd_set, ldmsd_updtr_task_t task)
+static int schedule_set_updates(ldmsd_prdcr_set_t prd_set, ldmsd_updtr_task_t task,
+				struct updtr_batch_s *batch)
 {
 	int rc = 0;
 	int flags;
@@ -382,14 +428,15 @@ static int schedule_set_updates(ldmsd_prdcr_set_t prd_set, ldmsd_updtr_task_t ta
 					 */
 					rc = ldms_xprt_lookup(pset->prdcr->xprt,
 							      pset->inst_name,
-							      LDMS_LOOKUP_BY_INSTANCE,
+							      LDMS_LOOKUP_BY_INSTANCE |
+							      (updtr->is_delta?LDMS_LOOKUP_DELTA:0),
 							      __ldmsd_prdset_lookup_cb, pset);
 					if (rc)
 						goto out;
 				}
 				if (pset->state != LDMSD_PRDCR_SET_STATE_READY)
 					continue; /* It is OK. The set might not be ready */
-				rc = schedule_set_updates(pset, task);
+				rc = schedule_set_updates(pset, task, batch);
 				if (rc)
 					goto out;
 			}
@@ -399,7 +446,8 @@ static int schedule_set_updates(ldmsd_prdcr_set_t prd_set, ldmsd_updtr_task_t ta
 			 * do not update the setgroup.
 			 */
 		} else {
-			rc = ldms_xprt_update(prd_set->set, updtr_update_cb, prd_set);
+			/* The batch flush reports the synchronous errors */
+			updtr_batch_add(batch, prd_set);
 		}
 	} else if (0 == (prd_set->push_flags & LDMSD_PRDCR_SET_F_PUSH_REG)) {
 		op_s = "Registering push for";
@@ -585,34 +633,145 @@ out:
 	return;
 }
 
-static void schedule_prdcr_updates(ldmsd_updtr_task_t task,
-				   ldmsd_prdcr_t prdcr, ldmsd_name_match_t match)
+/*
+ * Precomputed update schedule
+ *
+ * Each task keeps, for every producer of the updater, the list of the sets
+ * it updates, so a tick does not walk all sets of all producers and run the
+ * regular expressions of the updater on each of them. The list of a
+ * producer is rebuilt when the producer's set_gn shows that a set came or
+ * went or changed its update hint. The producers and the match list of an
+ * updater cannot change while it runs, and the lists are dropped when the
+ * updater stops.
+ */
+struct updtr_prdcr_sched {
+	ldmsd_prdcr_t prdcr;
+	uint64_t set_gn;	/* prdcr->set_gn when the list was built */
+	int valid;
+	int count;
+	int alloc;
+	ldmsd_prdcr_set_t *sets;
+};
+
+/* Returns 1 if the updater updates the set */
+static int updtr_set_match(ldmsd_updtr_t updtr, ldmsd_prdcr_set_t prd_set)
+{
+	ldmsd_name_match_t match;
+	const char *str;
+
+	if (LIST_EMPTY(&updtr->match_list))
+		return 1;
+	LIST_FOREACH(match, &updtr->match_list, entry) {
+		if (match->selector == LDMSD_NAME_MATCH_INST_NAME)
+			str = prd_set->inst_name;
+		else
+			str = prd_set->schema_name;
+		if (0 == regexec(&match->regex, str, 0, NULL, 0))
+			return 1;
+	}
+	return 0;
+}
+
+/* Caller must hold the producer lock */
+static int updtr_prdcr_sched_build(ldmsd_updtr_task_t task,
+				   struct updtr_prdcr_sched *ps)
 {
 	ldmsd_updtr_t updtr = task->updtr;
-	struct timespec ts;
-	ldmsd_prdcr_lock(prdcr);
-	if (prdcr->conn_state != LDMSD_PRDCR_STATE_CONNECTED || prdcr->xprt->disconnected)
-		goto out;
+	ldmsd_prdcr_t prdcr = ps->prdcr;
+	ldmsd_prdcr_set_t prd_set, *sets;
+	int alloc;
 
-	ldmsd_prdcr_set_t prd_set;
+	ps->valid = 0;
+	ps->count = 0;
 	if (updtr->is_auto_task)
 		prd_set = ldmsd_prdcr_set_first_by_hint(prdcr, &task->hint);
 	else
 		prd_set = ldmsd_prdcr_set_first(prdcr);
-
 	while (prd_set) {
-		int rc;
-		const char *str;
+		if (!updtr_set_match(updtr, prd_set))
+			goto next;
+		if (ps->count == ps->alloc) {
+			alloc = (ps->alloc ? ps->alloc * 2 : 16);
+			sets = realloc(ps->sets, alloc * sizeof(*sets));
+			if (!sets)
+				return ENOMEM;
+			ps->sets = sets;
+			ps->alloc = alloc;
+		}
+		ps->sets[ps->count++] = prd_set;
+	next:
+		if (updtr->is_auto_task)
+			prd_set = ldmsd_prdcr_set_next_by_hint(prd_set);
+		else
+			prd_set = ldmsd_prdcr_set_next(prd_set);
+	}
+	ps->set_gn = prdcr->set_gn;
+	ps->valid = 1;
+	updtr->tick_stats.rebuilds++;
+	return 0;
+}
 
-		if (match) {
-			if (match->selector == LDMSD_NAME_MATCH_INST_NAME)
-				str = prd_set->inst_name;
-			else
-				str = prd_set->schema_name;
-			rc = regexec(&match->regex, str, 0, NULL, 0);
-			if (rc)
-				goto next_prd_set;
+/* Caller must hold the updater lock */
+static int updtr_task_sched_init(ldmsd_updtr_task_t task)
+{
+	ldmsd_updtr_t updtr = task->updtr;
+	ldmsd_prdcr_ref_t ref;
+	int i, count;
+
+	if (task->prdcr_sched)
+		return 0;
+	count = rbt_card(&updtr->prdcr_tree);
+	if (!count)
+		return 0;
+	task->prdcr_sched = calloc(count, sizeof(*task->prdcr_sched));
+	if (!task->prdcr_sched)
+		return ENOMEM;
+	task->prdcr_sched_count = count;
+	for (i = 0, ref = updtr_prdcr_ref_first(updtr); ref && i < count;
+			i++, ref = updtr_prdcr_ref_next(ref))
+		task->prdcr_sched[i].prdcr = ref->prdcr;
+	return 0;
+}
+
+/* Caller must hold the updater lock or have joined the task */
+static void updtr_task_sched_free(ldmsd_updtr_task_t task)
+{
+	int i;
+
+	for (i = 0; i < task->prdcr_sched_count; i++)
+		free(task->prdcr_sched[i].sets);
+	free(task->prdcr_sched);
+	task->prdcr_sched = NULL;
+	task->prdcr_sched_count = 0;
+}
+
+/* Returns the number of pull updates issued */
+static int schedule_prdcr_updates(ldmsd_updtr_task_t task,
+				  struct updtr_prdcr_sched *ps,
+				  struct timespec *now)
+{
+	ldmsd_updtr_t updtr = task->updtr;
+	ldmsd_prdcr_t prdcr = ps->prdcr;
+	struct updtr_batch_s batch = { .count = 0, .total = 0 };
+	ldmsd_prdcr_set_t prd_set;
+	int i, rc;
+
+	ldmsd_prdcr_lock(prdcr);
+	if (prdcr->conn_state != LDMSD_PRDCR_STATE_CONNECTED || prdcr->xprt->disconnected)
+		goto out;
+
+	if (!ps->valid || ps->set_gn != prdcr->set_gn) {
+		rc = updtr_prdcr_sched_build(task, ps);
+		if (rc) {
+			ldmsd_log(LDMSD_LERROR, "updtr '%s': error %d building "
+				  "the update schedule of producer '%s'\n",
+				  updtr->obj.name, rc, prdcr->obj.name);
+			goto out;
 		}
+	}
+
+	for (i = 0; i < ps->count; i++) {
+		prd_set = ps->sets[i];
 
 		ldmsd_log(LDMSD_LDEBUG, "updtr_task sched '%ld': set '%s'\n",
 				task->sched.intrvl_us, prd_set->inst_name);
@@ -620,9 +779,8 @@ static void schedule_prdcr_updates(ldmsd_updtr_task_t task,
 
 		switch (prd_set->state) {
 		case LDMSD_PRDCR_SET_STATE_READY:
-			clock_gettime(CLOCK_REALTIME, &ts);
-			if (ts_diff_usec(&ts, &prd_set->lookup_complete_ts) < 1000000) {
-				goto next_prd_set;
+			if (ts_diff_usec(now, &prd_set->lookup_complete_ts) < 1000000) {
+				continue;
 			}
 			break;
 		case LDMSD_PRDCR_SET_STATE_START:
@@ -631,7 +789,8 @@ static void schedule_prdcr_updates(ldmsd_updtr_task_t task,
 			prd_set->state = LDMSD_PRDCR_SET_STATE_LOOKUP;
 			assert(prd_set->set == NULL);
 			rc = ldms_xprt_lookup(prdcr->xprt, prd_set->inst_name,
-					      LDMS_LOOKUP_BY_INSTANCE,
+					      LDMS_LOOKUP_BY_INSTANCE |
+					      (updtr->is_delta?LDMS_LOOKUP_DELTA:0),
 					      __ldmsd_prdset_lookup_cb, prd_set);
 			if (rc) {
 				/* If the error is EEXIST, the set is already in the set tree. */
@@ -651,12 +810,12 @@ static void schedule_prdcr_updates(ldmsd_updtr_task_t task,
 				prd_set->state = LDMSD_PRDCR_SET_STATE_START;
 				ldmsd_prdcr_set_ref_put(prd_set);
 			}
-			goto next_prd_set;
+			continue;
 		case LDMSD_PRDCR_SET_STATE_LOOKUP:
 			ldmsd_log(LDMSD_LINFO, "%s: Set %s: "
 				"there is an outstanding lookup.\n",
 				__func__, prd_set->inst_name);
-			goto next_prd_set;
+			continue;
 		case LDMSD_PRDCR_SET_STATE_UPDATING:
 			ldmsd_log(LDMSD_LINFO, "%s: Set %s: "
 				"there is an outstanding update.\n",
@@ -664,19 +823,15 @@ static void schedule_prdcr_updates(ldmsd_updtr_task_t task,
 			__atomic_fetch_add(&prd_set->skipped_upd_cnt, 1, __ATOMIC_SEQ_CST);
 		case LDMSD_PRDCR_SET_STATE_DELETED:
 		default:
-			goto next_prd_set;
+			continue;
 		}
 
-		schedule_set_updates(prd_set, task);
-
-next_prd_set:
-		if (updtr->is_auto_task)
-			prd_set = ldmsd_prdcr_set_next_by_hint(prd_set);
-		else
-			prd_set = ldmsd_prdcr_set_next(prd_set);
+		schedule_set_updates(prd_set, task, &batch);
 	}
+	updtr_batch_flush(&batch);
 out:
 	ldmsd_prdcr_unlock(prdcr);
+	return batch.total;
 }
 
 static void cancel_prdcr_updates(ldmsd_updtr_t updtr,
@@ -714,24 +869,32 @@ out:
 static void schedule_updates(ldmsd_updtr_task_t task)
 {
 	ldmsd_updtr_t updtr = task->updtr;
-	ldmsd_name_match_t match;
+	struct ldmsd_updtr_tick_stats *stats = &updtr->tick_stats;
+	struct timespec cpu_start, cpu_end, now;
+	int i, rc, updates = 0;
 
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
 	updtr_task_set_reset(task);
-	if (!LIST_EMPTY(&updtr->match_list)) {
-		LIST_FOREACH(match, &updtr->match_list, entry) {
-			ldmsd_prdcr_ref_t ref;
-			for (ref = updtr_prdcr_ref_first(updtr); ref;
-					ref = updtr_prdcr_ref_next(ref))
-				schedule_prdcr_updates(task, ref->prdcr, match);
-		}
-	} else {
-		ldmsd_prdcr_ref_t ref;
-		for (ref = updtr_prdcr_ref_first(updtr); ref;
-				ref = updtr_prdcr_ref_next(ref))
-			schedule_prdcr_updates(task, ref->prdcr, NULL);
+	rc = updtr_task_sched_init(task);
+	if (rc) {
+		ldmsd_log(LDMSD_LERROR, "updtr '%s': error %d allocating the "
+			  "update schedule\n", updtr->obj.name, rc);
+		return;
 	}
+	clock_gettime(CLOCK_REALTIME, &now);
+	for (i = 0; i < task->prdcr_sched_count; i++)
+		updates += schedule_prdcr_updates(task, &task->prdcr_sched[i], &now);
 	if ((!task->is_default) && (0 == task->set_count))
 		updtr_task_stop(task);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+
+	stats->ticks++;
+	stats->sets += task->set_count;
+	stats->updates += updates;
+	stats->last_sets = task->set_count;
+	stats->last_updates = updates;
+	stats->last_cpu_us = ts_diff_usec(&cpu_end, &cpu_start);
+	ldmsd_stat_update(&stats->cpu, &cpu_start, &cpu_end);
 }
 
 static void cancel_push(ldmsd_updtr_t updtr)
@@ -1130,6 +1293,7 @@ static void __updtr_tasks_stop(ldmsd_updtr_t updtr)
 	/* Stop the default task */
 	ldmsd_task_stop(&updtr->default_task.task);
 	ldmsd_task_join(&updtr->default_task.task);
+	updtr_task_sched_free(&updtr->default_task);
 
 	/* Stop the task tree management task */
 	ldmsd_task_stop(&updtr->tree_mgmt_task.task);
@@ -0,0 +1,169 @@
+/*
+ * Local stream delivery throughput.
+ *
+ * Publishes JSON messages of several sizes to a stream with a varying
+ * number of subscribers through ldmsd_stream_deliver() and reports
+ * messages/sec. Several publisher threads can deliver to the same stream
+ * at once (-t), subscribers can keep the parsed entity past their
+ * callback (-k) and ask for unlocked delivery (-u).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <ovis_json/ovis_json.h>
+#include "ldms.h"
+#include "../ldmsd_stream.h"
+
+#define STREAM "bench"
+
+static int keep;
+static int unlocked;
+static int nthreads = 1;
+static long nmsgs = 100000;
+static char *msg;
+static size_t msg_len;
+static long recv_count;
+
+static int recv_cb(ldmsd_stream_client_t c, void *ctxt,
+		   ldmsd_stream_type_t stream_type,
+		   const char *data, size_t data_len,
+		   json_entity_t entity)
+{
+	ldmsd_stream_entity_t se;
+
+	__sync_fetch_and_add(&recv_count, 1);
+	if (keep && entity) {
+		se = ldmsd_stream_entity_get(entity);
+		ldmsd_stream_entity_put(se);
+	}
+	return 0;
+}
+
+static void *publish_proc(void *arg)
+{
+	long i, n = (long)arg;
+	for (i = 0; i < n; i++)
+		ldmsd_stream_deliver(STREAM, LDMSD_STREAM_JSON,
+				     msg, msg_len, NULL, NULL);
+	return NULL;
+}
+
+static void msg_build(size_t size)
+{
+	size_t hdr;
+	free(msg);
+	msg = malloc(size + 64);
+	if (!msg) {
+		perror("malloc");
+		exit(1);
+	}
+	hdr = sprintf(msg, "{\"seq\":1,\"data\":\"");
+	if (size > hdr + 2) {
+		memset(msg + hdr, 'x', size - hdr - 2);
+		hdr = size - 2;
+	}
+	msg_len = hdr + sprintf(msg + hdr, "\"}");
+}
+
+static void run(size_t size, int nsubs)
+{
+	ldmsd_stream_client_t *c;
+	pthread_t *t;
+	struct timespec t0, t1;
+	double sec;
+	int i;
+
+	msg_build(size);
+	c = calloc(nsubs, sizeof(*c));
+	t = calloc(nthreads, sizeof(*t));
+	if (!c || !t) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < nsubs; i++) {
+		c[i] = ldmsd_stream_subscribe(STREAM, recv_cb, &c[i]);
+		if (!c[i]) {
+			perror("ldmsd_stream_subscribe");
+			exit(1);
+		}
+		if (unlocked)
+			ldmsd_stream_flags_set(c[i], LDMSD_STREAM_F_UNLOCKED);
+	}
+	recv_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < nthreads; i++)
+		pthread_create(&t[i], NULL, publish_proc,
+			       (void *)(nmsgs / nthreads));
+	for (i = 0; i < nthreads; i++)
+		pthread_join(t[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	printf("%8zu %5d %12.0f msg/s %12.0f deliveries/s\n",
+	       msg_len, nsubs, (nmsgs / nthreads) * nthreads / sec,
+	       recv_count / sec);
+	for (i = 0; i < nsubs; i++)
+		ldmsd_stream_close(c[i]);
+	free(c);
+	free(t);
+}
+
+static void usage(char *argv0)
+{
+	printf("usage: %s [-n MESSAGES] [-t THREADS] [-k] [-u]\n"
+	       "          [-s SIZE,SIZE,...] [-c SUBSCRIBERS,SUBSCRIBERS,...]\n",
+	       argv0);
+}
+
+int main(int argc, char **argv)
+{
+	char *sizes = strdup("64,1024,16384");
+	char *subs = strdup("1,4,16");
+	char *s, *n, *ptr;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:t:kus:c:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nmsgs = atol(optarg);
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'k':
+			keep = 1;
+			break;
+		case 'u':
+			unlocked = 1;
+			break;
+		case 's':
+			free(sizes);
+			sizes = strdup(optarg);
+			break;
+		case 'c':
+			free(subs);
+			subs = strdup(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (nthreads < 1)
+		nthreads = 1;
+	printf("%8s %5s %18s %25s\n", "bytes", "subs", "messages", "callbacks");
+	for (s = strtok_r(sizes, ",", &ptr); s; s = strtok_r(NULL, ",", &ptr)) {
+		char *sub_list = strdup(subs);
+		char *ptr2;
+		for (n = strtok_r(sub_list, ",", &ptr2); n;
+		     n = strtok_r(NULL, ",", &ptr2))
+			run(strtoul(s, NULL, 0), atoi(n));
+		free(sub_list);
+	}
+	free(sizes);
+	free(subs);
+	return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * Remote stream publish throughput.
+ *
+ * Publishes JSON messages of several sizes to a running ldmsd, first as
+ * LDMSD_STREAM_PUBLISH_REQ requests (ldmsd_stream_publish_req()) and then
+ * as ldms stream messages (ldmsd_stream_try_publish()), and reports
+ * messages/sec and bytes/sec for each. A run ends when the daemon has
+ * acknowledged every message, so the rates are end to end. Stream
+ * messages that are refused for lack of credit are retried.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <semaphore.h>
+#include <time.h>
+#include "ldms.h"
+#include "../ldmsd_stream.h"
+
+#define STREAM "bench"
+#define ACK_TIMEOUT 60 /* seconds */
+
+typedef int (*publish_fn_t)(ldms_t x, const char *stream_name,
+			    ldmsd_stream_type_t stream_type,
+			    const char *data, size_t data_len);
+
+static long nmsgs = 100000;
+static char *msg;
+static size_t msg_len;
+static long ack_count;
+static sem_t conn_sem;
+static int conn_rc = ENOTCONN;
+
+static void event_cb(ldms_t x, ldms_xprt_event_t e, void *cb_arg)
+{
+	switch (e->type) {
+	case LDMS_XPRT_EVENT_CONNECTED:
+		conn_rc = 0;
+		sem_post(&conn_sem);
+		break;
+	case LDMS_XPRT_EVENT_RECV:
+		__sync_fetch_and_add(&ack_count, 1);
+		break;
+	case LDMS_XPRT_EVENT_REJECTED:
+	case LDMS_XPRT_EVENT_ERROR:
+	case LDMS_XPRT_EVENT_DISCONNECTED:
+		conn_rc = ECONNREFUSED;
+		sem_post(&conn_sem);
+		break;
+	default:
+		break;
+	}
+}
+
+static void msg_build(size_t size)
+{
+	size_t hdr;
+	free(msg);
+	msg = malloc(size + 64);
+	if (!msg) {
+		perror("malloc");
+		exit(1);
+	}
+	hdr = sprintf(msg, "{\"seq\":1,\"data\":\"");
+	if (size > hdr + 2) {
+		memset(msg + hdr, 'x', size - hdr - 2);
+		hdr = size - 2;
+	}
+	msg_len = hdr + sprintf(msg + hdr, "\"}") + 1;
+}
+
+static double elapsed(struct timespec *t0)
+{
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+static int run(ldms_t x, const char *name, publish_fn_t fn)
+{
+	struct timespec t0;
+	double sec;
+	long i, retry = 0;
+	int rc;
+
+	ack_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < nmsgs; i++) {
+		while (EAGAIN == (rc = fn(x, STREAM, LDMSD_STREAM_JSON,
+					  msg, msg_len))) {
+			retry++;
+			usleep(10);
+		}
+		if (rc) {
+			printf("%s: error %d publishing message %ld\n",
+			       name, rc, i);
+			return rc;
+		}
+	}
+	while (ack_count < nmsgs) {
+		if (elapsed(&t0) > ACK_TIMEOUT) {
+			printf("%s: %ld of %ld messages acknowledged\n",
+			       name, ack_count, nmsgs);
+			return ETIMEDOUT;
+		}
+		usleep(100);
+	}
+	sec = elapsed(&t0);
+	printf("%8zu %-8s %12.0f msg/s %10.1f MB/s %10ld retries\n",
+	       msg_len, name, nmsgs / sec, nmsgs * msg_len / sec / 1e6, retry);
+	return 0;
+}
+
+static void usage(char *argv0)
+{
+	printf("usage: %s -h HOST -p PORT [-x XPRT] [-a AUTH]\n"
+	       "          [-n MESSAGES] [-s SIZE,SIZE,...]\n",
+	       argv0);
+}
+
+int main(int argc, char **argv)
+{
+	char *sizes = strdup("64,1024,16384,262144");
+	char *xprt = "sock";
+	char *auth = "none";
+	char *host = NULL;
+	char *port = NULL;
+	char *s, *ptr;
+	ldms_t x;
+	int opt, rc;
+
+	while ((opt = getopt(argc, argv, "x:h:p:a:n:s:")) != -1) {
+		switch (opt) {
+		case 'x':
+			xprt = optarg;
+			break;
+		case 'h':
+			host = optarg;
+			break;
+		case 'p':
+			port = optarg;
+			break;
+		case 'a':
+			auth = optarg;
+			break;
+		case 'n':
+			nmsgs = atol(optarg);
+			break;
+		case 's':
+			free(sizes);
+			sizes = strdup(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (!host || !port || nmsgs < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	x = ldms_xprt_new_with_auth(xprt, auth, NULL);
+	if (!x) {
+		printf("Error %d creating the '%s' transport\n", errno, xprt);
+		return 1;
+	}
+	sem_init(&conn_sem, 0, 0);
+	rc = ldms_xprt_connect_by_name(x, host, port, event_cb, NULL);
+	if (!rc) {
+		sem_wait(&conn_sem);
+		rc = conn_rc;
+	}
+	if (rc) {
+		printf("Error %d connecting to %s:%s\n", rc, host, port);
+		return 1;
+	}
+	if (!ldms_xprt_stream_supported(x))
+		printf("# the peer does not accept ldms stream messages, "
+		       "both runs use requests\n");
+
+	printf("%8s %-8s %18s %15s %18s\n",
+	       "bytes", "path", "messages", "bandwidth", "");
+	for (s = strtok_r(sizes, ",", &ptr); s; s = strtok_r(NULL, ",", &ptr)) {
+		msg_build(strtoul(s, NULL, 0));
+		rc = run(x, "request", ldmsd_stream_publish_req);
+		if (rc)
+			break;
+		rc = run(x, "stream", ldmsd_stream_try_publish);
+		if (rc)
+			break;
+	}
+	ldms_xprt_close(x);
+	free(sizes);
+	return rc ? 1 : 0;
+}
@@ -65,11 +65,14 @@
 #include <glob.h>
 #include <sys/sysmacros.h>
 #include <sys/sysinfo.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 #include <coll/rbt.h>
 
 #include "ldmsd.h"
 #include "../sampler_base.h"
+#include "../sampler_procfs.h"
 #include "ldmsd_stream.h"
 #include "mmalloc.h"
 #define DSTRING_USE_SHORT
@@ -448,6 +451,19 @@ struct set_key {
 	int64_t os_pid;
 };
 
+/* /proc/<pid> files kept open across samples */
+enum lps_file {
+	LPS_STAT,
+	LPS_STATUS,
+	LPS_IO,
+	LPS_OOM_SCORE,
+	LPS_OOM_SCORE_ADJ,
+	LPS_SYSCALL,
+	LPS_TIMERSLACK_NS,
+	LPS_WCHAN,
+	LPS_F_COUNT
+};
+
 struct linux_proc_sampler_set {
 	struct set_key key;
 	ldms_set_t set;
@@ -458,12 +474,18 @@ struct linux_proc_sampler_set {
 	char *fd_ident; /* json prefix for all file messages */
 	size_t fd_ident_sz; /* json prefix for all file messages */
 	struct rbt fn_rbt; /* tree for fd numbers of this process */
+	struct timeval sample_start; /* for the timing metric */
+	int dirfd; /* O_PATH descriptor of /proc/<pid>, or -1 */
+	int fd_dirfd; /* /proc/<pid>/fd for counting with getdents64, or -1 */
+	int n_cached; /* descriptors held, counted in inst->fd_cached */
+	procfs_file_t pf[LPS_F_COUNT];
 	LIST_ENTRY(linux_proc_sampler_set) del;
 };
 LIST_HEAD(set_del_list, linux_proc_sampler_set);
 
 typedef struct linux_proc_sampler_inst_s *linux_proc_sampler_inst_t;
-typedef int (*handler_fn_t)(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t set);
+typedef int (*handler_fn_t)(linux_proc_sampler_inst_t inst,
+			    struct linux_proc_sampler_set *as);
 struct handler_info {
 	handler_fn_t fn;
 	const char *fn_name;
@@ -485,11 +507,18 @@ struct linux_proc_sampler_inst_s {
 	bool fd_use_regex; /* match object is ready */
 	regex_t fd_regex; /* match object for fd_exclude */
 	long sc_clk_tck;
-	struct timeval sample_start;
 
 	struct rbt set_rbt;
 	pthread_mutex_t mutex;
 
+	int sample_threads; /* size of the pool, 0 to sample in the caller */
+	struct lps_pool *pool;
+	struct linux_proc_sampler_set **sample_vec; /* sets of this sample */
+	int sample_vec_max;
+	long fd_cache_max; /* descriptors the sets may keep open */
+	long fd_cached;
+	int fd_count_stat; /* the size of /proc/<pid>/fd is its entry count */
+
 	char *stream_name;
 	char *published_pid_dir;
 	char *env_stream;
@@ -530,18 +559,18 @@ static void data_set_key(linux_proc_sampler_inst_t inst, struct linux_proc_sampl
 
 }
 
-static int cmdline_handler(linux_proc_sampler_inst_t, pid_t, ldms_set_t);
-static int n_open_files_handler(linux_proc_sampler_inst_t, pid_t, ldms_set_t);
-static int io_handler(linux_proc_sampler_inst_t, pid_t, ldms_set_t);
-static int oom_score_handler(linux_proc_sampler_inst_t, pid_t, ldms_set_t);
-static int oom_score_adj_handler(linux_proc_sampler_inst_t, pid_t, ldms_set_t);
-static int root_handler(linux_proc_sampler_inst_t, pid_t, ldms_set_t);
-static int stat_handler(linux_proc_sampler_inst_t, pid_t, ldms_set_t);
-static int status_handler(linux_proc_sampler_inst_t, pid_t, ldms_set_t);
-static int syscall_handler(linux_proc_sampler_inst_t, pid_t, ldms_set_t);
-static int timerslack_ns_handler(linux_proc_sampler_inst_t, pid_t, ldms_set_t);
-static int wchan_handler(linux_proc_sampler_inst_t, pid_t, ldms_set_t);
-static int timing_handler(linux_proc_sampler_inst_t, pid_t, ldms_set_t);
+static int cmdline_handler(linux_proc_sampler_inst_t, struct linux_proc_sampler_set *);
+static int n_open_files_handler(linux_proc_sampler_inst_t, struct linux_proc_sampler_set *);
+static int io_handler(linux_proc_sampler_inst_t, struct linux_proc_sampler_set *);
+static int oom_score_handler(linux_proc_sampler_inst_t, struct linux_proc_sampler_set *);
+static int oom_score_adj_handler(linux_proc_sampler_inst_t, struct linux_proc_sampler_set *);
+static int root_handler(linux_proc_sampler_inst_t, struct linux_proc_sampler_set *);
+static int stat_handler(linux_proc_sampler_inst_t, struct linux_proc_sampler_set *);
+static int status_handler(linux_proc_sampler_inst_t, struct linux_proc_sampler_set *);
+static int syscall_handler(linux_proc_sampler_inst_t, struct linux_proc_sampler_set *);
+static int timerslack_ns_handler(linux_proc_sampler_inst_t, struct linux_proc_sampler_set *);
+static int wchan_handler(linux_proc_sampler_inst_t, struct linux_proc_sampler_set *);
+static int timing_handler(linux_proc_sampler_inst_t, struct linux_proc_sampler_set *);
 
 /* mapping metric -> handler */
 struct handler_info handler_info_tbl[] = {
@@ -565,16 +594,17 @@ static inline linux_proc_sampler_metric_info_t find_metric_info_by_name(const ch
 /* ============ Handlers ============ */
 
 /*
- * Read content of the file (given `path`) into string metric at `idx` in `set`,
- * with maximum length `max_len`.
+ * Read content of the file (given `path` relative to `dirfd`) into string
+ * metric at `idx` in `set`, with maximum length `max_len`.
  *
  * **REMARK**: The metric is not '\0'-terminated.
  */
-static int __read_str(ldms_set_t set, int idx, const char *path, int max_len)
+static int __read_str(ldms_set_t set, int idx, int dirfd, const char *path,
+		      int max_len)
 {
 	int fd, rlen;
 	ldms_mval_t str = ldms_metric_get(set, idx);
-	fd = open(path, O_RDONLY);
+	fd = openat(dirfd, path, O_RDONLY|O_CLOEXEC);
 	if (fd < 0)
 		return errno;
 	rlen = read(fd, str->a_char, max_len);
@@ -582,17 +612,6 @@ static int __read_str(ldms_set_t set, int idx, const char *path, int max_len)
 	return rlen;
 }
 
-/* like `__read_str()`, but also '\0'-terminate the string */
-static int __read_str0(ldms_set_t set, int idx, const char *path, int max_len)
-{
-	ldms_mval_t str = ldms_metric_get(set, idx);
-	int rlen = __read_str(set, idx, path, max_len);
-	if (rlen == max_len)
-		rlen = max_len - 1;
-	str->a_char[rlen] = '\0';
-	return rlen;
-}
-
 /* Convenient functions that set `set[midx] = val` if midx > 0 */
 static inline void __may_set_u64(ldms_set_t set, int midx, uint64_t val)
 {
@@ -606,15 +625,192 @@ static inline void __may_set_char(ldms_set_t set, int midx, char val)
 		ldms_metric_set_char(set, midx, val);
 }
 
-static inline void __may_set_str(ldms_set_t set, int midx, const char *s)
+/* like `__may_set_str()`, for the `n` characters at `s` */
+static inline void __may_set_strn(ldms_set_t set, int midx, const char *s,
+				  size_t n)
 {
 	ldms_mval_t mval;
-	int len;
+	size_t len;
 	if (midx <= 0)
 		return;
 	mval = ldms_metric_get(set, midx);
 	len = ldms_metric_array_get_len(set, midx);
-	snprintf(mval->a_char, len, "%s", s);
+	if (n >= len)
+		n = len - 1;
+	memcpy(mval->a_char, s, n);
+	mval->a_char[n] = '\0';
+}
+
+/* ============ /proc/<pid> files ============ */
+
+/*
+ * The pid directory is opened O_PATH at the first sample and the files
+ * read every sample are opened relative to it and kept in the set, to be
+ * reread with pread(). The files stay bound to the process first sampled
+ * even if its pid is reused. The sets of an instance keep at most
+ * fd_cache_max descriptors open; past that, files are opened by path and
+ * closed after each read.
+ */
+static const struct lps_file_info {
+	const char *name;
+	size_t buf_sz; /* initial buffer size */
+} lps_file_info[LPS_F_COUNT] = {
+	[LPS_STAT] = { "stat", 1024 },
+	[LPS_STATUS] = { "status", 2048 },
+	[LPS_IO] = { "io", 256 },
+	[LPS_OOM_SCORE] = { "oom_score", 32 },
+	[LPS_OOM_SCORE_ADJ] = { "oom_score_adj", 32 },
+	[LPS_SYSCALL] = { "syscall", 256 },
+	[LPS_TIMERSLACK_NS] = { "timerslack_ns", 32 },
+	[LPS_WCHAN] = { "wchan", WCHAN_SZ },
+};
+
+/* Count a descriptor kept by `as`; return 0 if the instance has too many */
+static int lps_fd_reserve(linux_proc_sampler_inst_t inst,
+			  struct linux_proc_sampler_set *as)
+{
+	if (__atomic_add_fetch(&inst->fd_cached, 1, __ATOMIC_RELAXED)
+						<= inst->fd_cache_max) {
+		as->n_cached++;
+		return 1;
+	}
+	__atomic_sub_fetch(&inst->fd_cached, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static void lps_fd_release(linux_proc_sampler_inst_t inst,
+			   struct linux_proc_sampler_set *as, int n)
+{
+	as->n_cached -= n;
+	__atomic_sub_fetch(&inst->fd_cached, n, __ATOMIC_RELAXED);
+}
+
+/*
+ * Return the directory descriptor to open /proc/<pid>/`name` with, and
+ * in `*rel` the path relative to it. When the pid directory is not open,
+ * the full path is built in `buf` and AT_FDCWD is returned.
+ */
+static int lps_at(linux_proc_sampler_inst_t inst,
+		  struct linux_proc_sampler_set *as, const char *name,
+		  char *buf, size_t sz, const char **rel)
+{
+	if (as->dirfd < 0 && lps_fd_reserve(inst, as)) {
+		snprintf(buf, sz, "/proc/%" PRId64, as->key.os_pid);
+		as->dirfd = open(buf, O_PATH|O_DIRECTORY|O_CLOEXEC);
+		if (as->dirfd < 0)
+			lps_fd_release(inst, as, 1);
+	}
+	if (as->dirfd >= 0) {
+		*rel = name;
+		return as->dirfd;
+	}
+	snprintf(buf, sz, "/proc/%" PRId64 "/%s", as->key.os_pid, name);
+	*rel = buf;
+	return AT_FDCWD;
+}
+
+static void lps_file_put(struct linux_proc_sampler_set *as, enum lps_file i,
+			 procfs_file_t f)
+{
+	if (f && f != as->pf[i])
+		procfs_file_close(f);
+}
+
+/*
+ * Read the whole /proc/<pid> file `i`. The content is in f->buf until
+ * the file is given back with lps_file_put().
+ */
+static procfs_file_t lps_file_get(linux_proc_sampler_inst_t inst,
+				  struct linux_proc_sampler_set *as,
+				  enum lps_file i, int *rc)
+{
+	char path[PROCPID_SZ];
+	const char *rel;
+	procfs_file_t f = as->pf[i];
+	int dirfd;
+
+	if (!f) {
+		dirfd = lps_at(inst, as, lps_file_info[i].name,
+			       path, sizeof(path), &rel);
+		f = procfs_file_openat(dirfd, rel, lps_file_info[i].buf_sz);
+		if (!f) {
+			*rc = errno;
+			return NULL;
+		}
+		if (lps_fd_reserve(inst, as))
+			as->pf[i] = f;
+	}
+	*rc = procfs_file_read(f);
+	if (*rc) {
+		lps_file_put(as, i, f);
+		return NULL;
+	}
+	return f;
+}
+
+static void lps_files_close(linux_proc_sampler_inst_t inst,
+			    struct linux_proc_sampler_set *as)
+{
+	int i;
+	for (i = 0; i < LPS_F_COUNT; i++) {
+		procfs_file_close(as->pf[i]);
+		as->pf[i] = NULL;
+	}
+	if (as->fd_dirfd >= 0)
+		close(as->fd_dirfd);
+	if (as->dirfd >= 0)
+		close(as->dirfd);
+	as->fd_dirfd = as->dirfd = -1;
+	lps_fd_release(inst, as, as->n_cached);
+}
+
+struct lps_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+/*
+ * Count the open files in /proc/<pid>/fd with getdents64(), reusing the
+ * directory descriptor. Returns -1 with errno set on error.
+ */
+static int lps_fd_count(linux_proc_sampler_inst_t inst,
+			struct linux_proc_sampler_set *as,
+			int dirfd, const char *rel)
+{
+	char buf[4096] __attribute__((aligned(8)));
+	struct lps_dirent64 *d;
+	long len, off;
+	int fd = as->fd_dirfd;
+	int n = 0, err;
+
+	if (fd < 0) {
+		fd = openat(dirfd, rel, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+		if (fd < 0)
+			return -1;
+		if (lps_fd_reserve(inst, as))
+			as->fd_dirfd = fd;
+	} else if (lseek(fd, 0, SEEK_SET) < 0) {
+		return -1;
+	}
+	while ((len = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+		for (off = 0; off < len; off += d->d_reclen) {
+			d = (void *)(buf + off);
+			if (d->d_name[0] == '.')
+				continue; /* skip self and parent */
+			n++;
+		}
+	}
+	err = errno;
+	if (fd != as->fd_dirfd)
+		close(fd);
+	if (len < 0) {
+		errno = err;
+		return -1;
+	}
+	return n;
 }
 
 /* reformat nul-delimited argv per sep given.
@@ -677,17 +873,21 @@ static int check_sep(linux_proc_sampler_inst_t inst, const char *sep)
 	return 0;
 }
 
-static int cmdline_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t set)
+static int cmdline_handler(linux_proc_sampler_inst_t inst,
+			   struct linux_proc_sampler_set *as)
 {
 	/* populate `cmdline` and maybe `cmdline_len` */
+	ldms_set_t set = as->set;
 	ldms_mval_t cmdline;
-	int len;
-	char path[CMDLINE_SZ];
+	int len, dirfd;
+	char path[PROCPID_SZ];
+	const char *rel;
 	cmdline = ldms_metric_get(set, inst->metric_idx[APP_CMDLINE]);
 	if (cmdline->a_char[0])
 		return 0; /* already set */
-	snprintf(path, sizeof(path), "/proc/%d/cmdline", pid);
-	len = __read_str(set, inst->metric_idx[APP_CMDLINE], path, CMDLINE_SZ);
+	dirfd = lps_at(inst, as, "cmdline", path, sizeof(path), &rel);
+	len = __read_str(set, inst->metric_idx[APP_CMDLINE], dirfd, rel,
+			 CMDLINE_SZ);
 	cmdline->a_char[CMDLINE_SZ - 1] = 0; /* in case len == CMDLINE_SZ */
 	len = quote_argv(inst, len, cmdline->a_char, CMDLINE_SZ, inst->argv_sep);
 	if (inst->metric_idx[APP_CMDLINE_LEN] > 0)
@@ -695,53 +895,58 @@ static int cmdline_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t
 	return 0;
 }
 
-static int n_open_files_handler(linux_proc_sampler_inst_t inst, pid_t pid,
-				ldms_set_t set)
+static int n_open_files_handler(linux_proc_sampler_inst_t inst,
+				struct linux_proc_sampler_set *as)
 {
 	/* populate n_open_files */
 	char path[PROCPID_SZ];
-	DIR *dir;
-	struct dirent *dent;
-	int n;
-	snprintf(path, sizeof(path), "/proc/%d/fd", pid);
-	dir = opendir(path);
-	if (!dir)
-		return errno;
-	n = 0;
-	while ((dent = readdir(dir))) {
-		if (strcmp(dent->d_name, ".") == 0)
-			continue; /* skip self */
-		if (strcmp(dent->d_name, "..") == 0)
-			continue; /* skip parent */
-		n += 1;
+	const char *rel;
+	struct stat st;
+	int dirfd, n;
+	dirfd = lps_at(inst, as, "fd", path, sizeof(path), &rel);
+	if (inst->fd_count_stat) {
+		/* Linux 6.2 and later report the count as the size */
+		if (fstatat(dirfd, rel, &st, 0))
+			return errno;
+		n = st.st_size;
+	} else {
+		n = lps_fd_count(inst, as, dirfd, rel);
+		if (n < 0)
+			return errno;
 	}
-	ldms_metric_set_u64(set, inst->metric_idx[APP_N_OPEN_FILES], n);
-	closedir(dir);
+	ldms_metric_set_u64(as->set, inst->metric_idx[APP_N_OPEN_FILES], n);
 	return 0;
 }
 
-static int io_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t set)
+static const char *io_keys[] = {
+	"rchar", "wchar", "syscr", "syscw",
+	"read_bytes", "write_bytes", "cancelled_write_bytes"
+};
+
+static int io_handler(linux_proc_sampler_inst_t inst,
+		      struct linux_proc_sampler_set *as)
 {
 	/* populate io_* */
-	char path[PROCPID_SZ];
+	ldms_set_t set = as->set;
+	procfs_file_t f;
+	const char *p, *key;
+	size_t len;
 	uint64_t val[7];
-	int n, rc;
-	snprintf(path, sizeof(path), "/proc/%d/io", pid);
-	FILE *f = fopen(path, "r");
+	int i, rc;
+	f = lps_file_get(inst, as, LPS_IO, &rc);
 	if (!f)
-		return errno;
-	n = fscanf(f,   "rchar: %lu\n"
-			"wchar: %lu\n"
-			"syscr: %lu\n"
-			"syscw: %lu\n"
-			"read_bytes: %lu\n"
-			"write_bytes: %lu\n"
-			"cancelled_write_bytes: %lu\n",
-			val+0, val+1, val+2, val+3, val+4, val+5, val+6);
-	if (n != 7) {
-		rc = EINVAL;
-		goto out;
-	}
+		return rc;
+	p = f->buf;
+	for (i = 0; i < 7; i++) {
+		p = procfs_scan_word(p, ':', &key, &len);
+		if (!p || len != strlen(io_keys[i]) || memcmp(key, io_keys[i], len))
+			goto einval;
+		p = procfs_scan_u64(p, &val[i]);
+		if (!p)
+			goto einval;
+		p = procfs_next_line(p);
+	}
+	lps_file_put(as, LPS_IO, f);
 	__may_set_u64(set, inst->metric_idx[APP_IO_READ_B]	   , val[0]);
 	__may_set_u64(set, inst->metric_idx[APP_IO_WRITE_B]	  , val[1]);
 	__may_set_u64(set, inst->metric_idx[APP_IO_N_READ]	   , val[2]);
@@ -749,61 +954,69 @@ static int io_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t set)
 	__may_set_u64(set, inst->metric_idx[APP_IO_READ_DEV_B]       , val[4]);
 	__may_set_u64(set, inst->metric_idx[APP_IO_WRITE_DEV_B]      , val[5]);
 	__may_set_u64(set, inst->metric_idx[APP_IO_WRITE_CANCELLED_B], val[6]);
-	rc = 0;
- out:
-	fclose(f);
-	return rc;
+	return 0;
+ einval:
+	lps_file_put(as, LPS_IO, f);
+	return EINVAL;
+}
+
+/* Read the number in /proc/<pid> file `i` */
+static int lps_file_u64(linux_proc_sampler_inst_t inst,
+			struct linux_proc_sampler_set *as,
+			enum lps_file i, uint64_t *x)
+{
+	procfs_file_t f;
+	const char *p;
+	int rc;
+	f = lps_file_get(inst, as, i, &rc);
+	if (!f)
+		return rc;
+	p = procfs_scan_u64(f->buf, x);
+	lps_file_put(as, i, f);
+	return p ? 0 : EINVAL;
 }
 
-static int oom_score_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t set)
+static int oom_score_handler(linux_proc_sampler_inst_t inst,
+			     struct linux_proc_sampler_set *as)
 {
 	/* according to `proc_oom_score()` in Linux kernel src tree, oom_score
 	 * is `unsigned long` */
-	char path[PROCPID_SZ];
 	uint64_t x;
-	int n;
-	snprintf(path, sizeof(path), "/proc/%d/oom_score", pid);
-	FILE *f = fopen(path, "r");
-	if (!f)
-		return errno;
-	n = fscanf(f, "%lu", &x);
-	fclose(f);
-	if (n != 1)
-		return EINVAL;
-	ldms_metric_set_u64(set, inst->metric_idx[APP_OOM_SCORE], x);
+	int rc = lps_file_u64(inst, as, LPS_OOM_SCORE, &x);
+	if (rc)
+		return rc;
+	ldms_metric_set_u64(as->set, inst->metric_idx[APP_OOM_SCORE], x);
 	return 0;
 }
 
-static int oom_score_adj_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t set)
+static int oom_score_adj_handler(linux_proc_sampler_inst_t inst,
+				 struct linux_proc_sampler_set *as)
 {
 	/* according to `proc_oom_score_adj_read()` in Linux kernel src tree,
 	 * oom_score_adj is `short` */
-	char path[PROCPID_SZ];
-	int x;
-	int n;
-	snprintf(path, sizeof(path), "/proc/%d/oom_score_adj", pid);
-	FILE *f = fopen(path, "r");
-	if (!f)
-		return errno;
-	n = fscanf(f, "%d", &x);
-	fclose(f);
-	if (n != 1)
-		return EINVAL;
-	ldms_metric_set_s64(set, inst->metric_idx[APP_OOM_SCORE_ADJ], x);
+	uint64_t x;
+	int rc = lps_file_u64(inst, as, LPS_OOM_SCORE_ADJ, &x);
+	if (rc)
+		return rc;
+	ldms_metric_set_s64(as->set, inst->metric_idx[APP_OOM_SCORE_ADJ],
+			    (int64_t)x);
 	return 0;
 }
 
-static int root_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t set)
+static int root_handler(linux_proc_sampler_inst_t inst,
+			struct linux_proc_sampler_set *as)
 {
 	char path[PROCPID_SZ];
+	const char *rel;
 	ssize_t len;
+	int dirfd;
 	int midx = inst->metric_idx[APP_ROOT];
 	assert(midx > 0);
-	ldms_mval_t mval = ldms_metric_get(set, midx);
-	int alen = ldms_metric_array_get_len(set, midx);
+	ldms_mval_t mval = ldms_metric_get(as->set, midx);
+	int alen = ldms_metric_array_get_len(as->set, midx);
 	/* /proc/<PID>/root is a soft link */
-	snprintf(path, sizeof(path), "/proc/%d/root", pid);
-	len = readlink(path, mval->a_char, alen - 1);
+	dirfd = lps_at(inst, as, "root", path, sizeof(path), &rel);
+	len = readlinkat(dirfd, rel, mval->a_char, alen - 1);
 	if (len < 0) {
 		mval->a_char[0] = '\0';
 		return errno;
@@ -812,51 +1025,48 @@ static int root_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t se
 	return 0;
 }
 
-static int stat_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t set)
+static int stat_handler(linux_proc_sampler_inst_t inst,
+			struct linux_proc_sampler_set *as)
 {
-	char buff[CMDLINE_SZ];
-	char *str;
-	char name[128]; /* should be enough to hold program name */
-	int off, n;
+	ldms_set_t set = as->set;
+	procfs_file_t f;
+	const char *p, *comm, *end, *state;
+	size_t len;
 	uint64_t val;
-	char state;
-	pid_t _pid;
 	linux_proc_sampler_metric_e code;
-	FILE *f;
-	snprintf(buff, sizeof(buff), "/proc/%d/stat", pid);
-	f = fopen(buff, "r");
-	if (!f)
-		return errno;
-	char *s;
-	errno = 0;
-	s = fgets(buff, sizeof(buff), f);
-	fclose(f);
-	str = buff;
-	if (s != buff) {
-		if (errno) {
-			INST_LOG(inst, LDMSD_LDEBUG,
-				"error reading /proc/%d/stat %s\n", pid, STRERROR(errno));
-			return errno;
-		}
-		return EINVAL;
+	int rc;
+	f = lps_file_get(inst, as, LPS_STAT, &rc);
+	if (!f) {
+		INST_LOG(inst, LDMSD_LDEBUG, "error reading /proc/%" PRId64
+			 "/stat %s\n", as->key.os_pid, STRERROR(rc));
+		return rc;
 	}
-	n = sscanf(str, "%d (%[^)]) %c%n", &_pid, name, &state, &off);
-	if (n != 3)
-		return EINVAL;
-	str += off;
-	if (_pid != pid)
-		return EINVAL; /* should not happen */
-	__may_set_u64(set, inst->metric_idx[APP_STAT_PID], _pid);
-	__may_set_str(set, inst->metric_idx[APP_STAT_COMM], name);
-	__may_set_char(set, inst->metric_idx[APP_STAT_STATE], state);
+	/* pid (comm) state ...; comm may hold spaces and parentheses */
+	p = procfs_scan_u64(f->buf, &val);
+	if (!p || (int64_t)val != as->key.os_pid)
+		goto einval; /* should not happen */
+	comm = strchr(p, '(');
+	end = strrchr(p, ')');
+	if (!comm || !end || end < comm)
+		goto einval;
+	comm++;
+	p = procfs_scan_word(end + 1, '\0', &state, &len);
+	if (!p)
+		goto einval;
+	__may_set_u64(set, inst->metric_idx[APP_STAT_PID], val);
+	__may_set_strn(set, inst->metric_idx[APP_STAT_COMM], comm, end - comm);
+	__may_set_char(set, inst->metric_idx[APP_STAT_STATE], state[0]);
 	for (code = APP_STAT_PPID; code <= _APP_STAT_LAST; code++) {
-		n = sscanf(str, "%lu%n", &val, &off);
-		if (n != 1)
-			return EINVAL;
-		str += off;
+		p = procfs_scan_u64(p, &val);
+		if (!p)
+			goto einval;
 		__may_set_u64(set, inst->metric_idx[code], val);
 	}
+	lps_file_put(as, LPS_STAT, f);
 	return 0;
+ einval:
+	lps_file_put(as, LPS_STAT, f);
+	return EINVAL;
 }
 
 typedef struct status_line_handler_s {
@@ -988,35 +1198,43 @@ struct status_line_handler_s status_line_tbl[] = {
 	{ "nonvoluntary_ctxt_switches", APP_STATUS_NONVOLUNTARY_CTXT_SWITCHES, __line_dec},
 };
 
-static int status_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t set)
+static int status_handler(linux_proc_sampler_inst_t inst,
+			  struct linux_proc_sampler_set *as)
 {
-	char buff[CMDLINE_SZ];
-	FILE *f;
-	char *line, *key, *ptr;
+	procfs_file_t f;
+	char *line, *next, *ptr;
 	status_line_handler_t sh;
+	int rc;
 
-	snprintf(buff, sizeof(buff), "/proc/%d/status", pid);
-	f = fopen(buff, "r");
+	f = lps_file_get(inst, as, LPS_STATUS, &rc);
 	if (!f)
-		return errno;
-	while ((line = fgets(buff, sizeof(buff), f))) {
-		key = strtok_r(line, ":", &ptr);
-		sh = find_status_line_handler(key);
+		return rc;
+	/* The lines are split in place: "Key:\tvalue\n" */
+	for (line = f->buf; *line; line = next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+		ptr = strchr(line, ':');
+		if (!ptr)
+			continue;
+		*ptr++ = '\0';
+		sh = find_status_line_handler(line);
 		if (!sh)
 			continue;
 		while (isspace(*ptr)) {
 			ptr++;
 		}
-		ptr[strlen(ptr)-1] = '\0'; /* eliminate trailing space */
 		if (inst->metric_idx[sh->code] > 0
 			|| sh->code == APP_STATUS_SIG_QUEUED
 			|| sh->code == APP_STATUS_UID
 			|| sh->code == APP_STATUS_GID
 			) {
-			sh->fn(inst, set, ptr, sh->code);
+			sh->fn(inst, as->set, ptr, sh->code);
 		}
 	}
-	fclose(f);
+	lps_file_put(as, LPS_STATUS, f);
 	return 0;
 }
 
@@ -1025,10 +1243,8 @@ int __line_dec(linux_proc_sampler_inst_t inst, ldms_set_t set,
 		const char *linebuf, linux_proc_sampler_metric_e code)
 {
 	/* scan for a uint64_t */
-	int n;
 	uint64_t x;
-	n = sscanf(linebuf, "%ld", &x);
-	if (n != 1)
+	if (!procfs_scan_u64(linebuf, &x))
 		return EINVAL;
 	ldms_metric_set_u64(set, inst->metric_idx[code], x);
 	return 0;
@@ -1038,57 +1254,53 @@ static
 int __line_dec_array(linux_proc_sampler_inst_t inst, ldms_set_t set,
 		const char *linebuf, linux_proc_sampler_metric_e code)
 {
-	int i, n, alen, pos;
+	int i, alen;
 	int midx = inst->metric_idx[code];
 	const char *ptr = linebuf;
 	uint64_t val;
 	alen = ldms_metric_array_get_len(set, midx);
 	for (i = 0; i < alen; i++) {
-		n = sscanf(ptr, "%lu%n", &val, &pos);
-		if (n != 1)
+		ptr = procfs_scan_u64(ptr, &val);
+		if (!ptr)
 			break;
 		ldms_metric_array_set_u64(set, midx, i, val);
-		ptr += pos;
 	}
 	return 0;
 }
 
 static
-int __line_hex(linux_proc_sampler_inst_t inst, ldms_set_t set,
-		const char *linebuf, linux_proc_sampler_metric_e code)
+int __line_base(linux_proc_sampler_inst_t inst, ldms_set_t set,
+		const char *linebuf, linux_proc_sampler_metric_e code, int base)
 {
-	int n;
-	uint64_t x;
-	n = sscanf(linebuf, "%lx", &x);
-	if (n != 1)
+	char *end;
+	uint64_t x = strtoull(linebuf, &end, base);
+	if (end == linebuf)
 		return EINVAL;
 	ldms_metric_set_u64(set, inst->metric_idx[code], x);
 	return 0;
 }
 
+static
+int __line_hex(linux_proc_sampler_inst_t inst, ldms_set_t set,
+		const char *linebuf, linux_proc_sampler_metric_e code)
+{
+	return __line_base(inst, set, linebuf, code, 16);
+}
+
 static
 int __line_oct(linux_proc_sampler_inst_t inst, ldms_set_t set,
 		const char *linebuf, linux_proc_sampler_metric_e code)
 {
-	int n;
-	uint64_t x;
-	n = sscanf(linebuf, "%lo", &x);
-	if (n != 1)
-		return EINVAL;
-	ldms_metric_set_u64(set, inst->metric_idx[code], x);
-	return 0;
+	return __line_base(inst, set, linebuf, code, 8);
 }
 
 static
 int __line_char(linux_proc_sampler_inst_t inst, ldms_set_t set,
 		const char *linebuf, linux_proc_sampler_metric_e code)
 {
-	int n;
-	char x;
-	n = sscanf(linebuf, "%c", &x);
-	if (n != 1)
+	if (!linebuf[0])
 		return EINVAL;
-	ldms_metric_set_char(set, inst->metric_idx[code], x);
+	ldms_metric_set_char(set, inst->metric_idx[code], linebuf[0]);
 	return 0;
 }
 
@@ -1097,9 +1309,9 @@ int __line_sigq(linux_proc_sampler_inst_t inst, ldms_set_t set,
 		const char *linebuf, linux_proc_sampler_metric_e code)
 {
 	uint64_t q, l;
-	int n;
-	n = sscanf(linebuf, "%lu/%lu", &q, &l);
-	if (n != 2)
+	const char *p;
+	p = procfs_scan_u64(linebuf, &q);
+	if (!p || *p != '/' || !procfs_scan_u64(p + 1, &l))
 		return EINVAL;
 	__may_set_u64(set, inst->metric_idx[APP_STATUS_SIG_QUEUED], q);
 	__may_set_u64(set, inst->metric_idx[APP_STATUS_SIG_LIMIT] , l);
@@ -1118,6 +1330,26 @@ int __line_str(linux_proc_sampler_inst_t inst, ldms_set_t set, const char *lineb
 	return 0;
 }
 
+/*
+ * Scan the four ids of a Uid: or Gid: line into x and their text into w.
+ */
+static int __line_ids(const char *linebuf, uint64_t x[4], char w[4][21])
+{
+	const char *p = linebuf, *word;
+	size_t len;
+	int k;
+	for (k = 0; k < 4; k++) {
+		p = procfs_scan_word(p, '\0', &word, &len);
+		if (!p || !procfs_scan_u64(word, &x[k]))
+			return EINVAL;
+		if (len > 20)
+			len = 20;
+		memcpy(w[k], word, len);
+		w[k][len] = '\0';
+	}
+	return 0;
+}
+
 static const char *lps_info_uid[4] = {
 	"0.uid.lps", "1.uid.lps", "2.uid.lps", "3.uid.lps"
 };
@@ -1130,15 +1362,9 @@ int __line_uid(linux_proc_sampler_inst_t inst, ldms_set_t set, const char *lineb
 		linux_proc_sampler_metric_e code)
 {
 	/* populate `status_uid` and/or `status_*username` if changed. */
-	int n;
 	uint64_t x[4];
-	char w[4][20] = { {'\0'}, {'\0'}, {'\0'}, {'\0'} };
-	n = sscanf(linebuf, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
-			 x, x+1, x+2, x+3);
-	if (n != 4)
-		return EINVAL;
-	n = sscanf(linebuf, "%20s %20s %20s %20s", w[0], w[1], w[2], w[3]);
-	if (n != 4)
+	char w[4][21];
+	if (__line_ids(linebuf, x, w))
 		return EINVAL;
 	int k;
 	for (k = 0; k < 4; k++) {
@@ -1194,15 +1420,9 @@ int __line_gid(linux_proc_sampler_inst_t inst, ldms_set_t set, const char *lineb
 		linux_proc_sampler_metric_e code)
 {
 	/* populate `status_uid` and/or `status_username` if changed. */
-	int n;
 	uint64_t x[4];
-	char w[4][20] = { {'\0'}, {'\0'}, {'\0'}, {'\0'} };
-	n = sscanf(linebuf, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
-			 x, x+1, x+2, x+3);
-	if (n != 4)
-		return EINVAL;
-	n = sscanf(linebuf, "%20s %20s %20s %20s", w[0], w[1], w[2], w[3]);
-	if (n != 4)
+	char w[4][21];
+	if (__line_ids(linebuf, x, w))
 		return EINVAL;
 	int k;
 	for (k = 0; k < 4; k++) {
@@ -1266,15 +1486,16 @@ int __line_bitmap(linux_proc_sampler_inst_t inst, ldms_set_t set, const char *li
 	int n = strlen(linebuf);
 	int midx = inst->metric_idx[code];
 	int alen = ldms_metric_array_get_len(set, midx);
-	int i, val;
+	int i;
+	uint32_t val;
 	for (i = 0; i < alen && n; i++) {
 		/* reverse scan */
 		s = memrchr(linebuf, ',', n);
 		if (!s) {
 			s = linebuf;
-			sscanf(s, "%x", &val);
+			val = strtoul(s, NULL, 16);
 		} else {
-			sscanf(s, ",%x", &val);
+			val = strtoul(s + 1, NULL, 16);
 		}
 		ldms_metric_array_set_u32(set, midx, i, val);
 		n = s - linebuf;
@@ -1407,14 +1628,14 @@ err:
 	return rc;
 }
 
-static int syscall_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t set)
+static int syscall_handler(linux_proc_sampler_inst_t inst,
+			   struct linux_proc_sampler_set *as)
 {
-	char buff[CMDLINE_SZ];
-	FILE *f;
-	char *ret;
-	int i, n;
+	ldms_set_t set = as->set;
+	procfs_file_t f;
+	char *p, *end;
+	int i, n, rc;
 	uint64_t val[9] = {0};
-	snprintf(buff, sizeof(buff), "/proc/%d/syscall", pid);
 	/*
 	 * NOTE: The file contains single line wcich could be:
 	 * - "running": the process is running.
@@ -1423,23 +1644,27 @@ static int syscall_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t
 	 * - "<SYSCALL_NUM> <ARG0> ... <ARG5> <STACK_PTR> <PROGRAM_CTR>": the
 	 *   syscall number, 6 arguments, stack pointer and program counter.
 	 */
-	f = fopen(buff, "r");
+	f = lps_file_get(inst, as, LPS_SYSCALL, &rc);
 	if (!f)
-		return errno;
-	ret = fgets(buff, sizeof(buff), f);
-	fclose(f);
+		return rc;
 	int call = -1;
-	if (!ret)
-		return errno;
-	if (0 == strncmp(buff, "running", 7)) {
-		n = 0;
-	} else {
-		n = sscanf(buff, "%d %lx %lx %lx %lx %lx %lx %lx %lx",
-				 &call, val+1, val+2, val+3, val+4,
-				 val+5, val+6, val+7, val+8);
-		if (n)
+	if (!f->len) {
+		lps_file_put(as, LPS_SYSCALL, f);
+		return 0;
+	}
+	n = 0;
+	if (0 != strncmp(f->buf, "running", 7)) {
+		call = strtol(f->buf, &end, 10);
+		if (end != f->buf) {
 			val[0] = (uint64_t)call;
+			for (n = 1, p = end; n < 9; n++, p = end) {
+				val[n] = strtoull(p, &end, 16);
+				if (end == p)
+					break;
+			}
+		}
 	}
+	lps_file_put(as, LPS_SYSCALL, f);
 	if (inst->metric_idx[APP_SYSCALL] > 0) {
 		for (i = 0; i < n; i++) {
 			ldms_metric_array_set_u64(set,
@@ -1454,12 +1679,13 @@ static int syscall_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t
 		}
 	}
 	if (inst->metric_idx[APP_SYSCALL_NAME] > 0) {
-		char *name0[SYSCALL_MAX];
-		char *name = (char*)name0;
+		char name0[SYSCALL_MAX];
+		char *name = name0;
 		if (n > 0) {
 			if (inst->n_syscalls != -1) {
 				name = get_syscall_name(inst, call);
 				if (!name) {
+					name = name0;
 					sprintf(name, "SYS_%d", call);
 				}
 			} else {
@@ -1477,50 +1703,48 @@ static int syscall_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t
 	return 0;
 }
 
-static int timerslack_ns_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t set)
+static int timerslack_ns_handler(linux_proc_sampler_inst_t inst,
+				 struct linux_proc_sampler_set *as)
 {
-	char path[PROCPID_SZ];
 	uint64_t x;
-	int n;
-	snprintf(path, sizeof(path), "/proc/%d/timerslack_ns", pid);
-	FILE *f = fopen(path, "r");
-	if (!f && errno != ENOENT)
-		return errno;
-	if (!f) {
-		ldms_metric_set_u64(set, inst->metric_idx[APP_TIMERSLACK_NS], 0);
-		return 0;
-	}
-	n = fscanf(f, "%lu", &x);
-	fclose(f);
-	if (n != 1)
-		return EINVAL;
-	ldms_metric_set_u64(set, inst->metric_idx[APP_TIMERSLACK_NS], x);
+	int rc = lps_file_u64(inst, as, LPS_TIMERSLACK_NS, &x);
+	if (rc == ENOENT)
+		x = 0; /* not in this kernel */
+	else if (rc)
+		return rc;
+	ldms_metric_set_u64(as->set, inst->metric_idx[APP_TIMERSLACK_NS], x);
 	return 0;
 }
 
-static int wchan_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t set)
+static int wchan_handler(linux_proc_sampler_inst_t inst,
+			 struct linux_proc_sampler_set *as)
 {
-	char path[PROCPID_SZ];
-	snprintf(path, sizeof(path), "/proc/%d/wchan", pid);
-	__read_str0(set, inst->metric_idx[APP_WCHAN], path, WCHAN_SZ);
+	procfs_file_t f;
+	int rc;
+	f = lps_file_get(inst, as, LPS_WCHAN, &rc);
+	if (!f)
+		return 0;
+	__may_set_strn(as->set, inst->metric_idx[APP_WCHAN], f->buf, f->len);
+	lps_file_put(as, LPS_WCHAN, f);
 	return 0;
 }
 
 
-static int timing_handler(linux_proc_sampler_inst_t inst, pid_t pid, ldms_set_t set)
+static int timing_handler(linux_proc_sampler_inst_t inst,
+			  struct linux_proc_sampler_set *as)
 {
 	struct timeval t2;
 	gettimeofday(&t2, NULL);
-	uint64_t x_us = (t2.tv_sec - inst->sample_start.tv_sec)*1000000;
-	int64_t d_us = (int64_t)t2.tv_usec - (int64_t)inst->sample_start.tv_usec;
+	uint64_t x_us = (t2.tv_sec - as->sample_start.tv_sec)*1000000;
+	int64_t d_us = (int64_t)t2.tv_usec - (int64_t)as->sample_start.tv_usec;
 	if (d_us < 0)
 		x_us += (uint64_t)(1000000 + d_us);
 	else
 		x_us += (uint64_t) d_us;
 
-	ldms_metric_set_u64(set, inst->metric_idx[APP_TIMING], x_us);
-	inst->sample_start.tv_sec = 0;
-	inst->sample_start.tv_usec = 0;
+	ldms_metric_set_u64(as->set, inst->metric_idx[APP_TIMING], x_us);
+	as->sample_start.tv_sec = 0;
+	as->sample_start.tv_usec = 0;
 #ifdef LPDEBUG
 	INST_LOG(inst, LDMSD_LDEBUG, "In %" PRIu64 " microseconds\n", x_us);
 #endif
@@ -1612,6 +1836,7 @@ void app_set_destroy(linux_proc_sampler_inst_t inst, struct linux_proc_sampler_s
 	}
 	a->key.start_tick = 0;
 	a->key.os_pid = 0;
+	lps_files_close(inst, a);
 	free(a->fd_ident);
 	fn_rbt_destroy(inst, &a->fn_rbt);
 	free(a);
@@ -1619,48 +1844,209 @@ void app_set_destroy(linux_proc_sampler_inst_t inst, struct linux_proc_sampler_s
 
 static int publish_fd_pid(linux_proc_sampler_inst_t inst, struct linux_proc_sampler_set *app_set);
 
+/* Sample one set; a handler error marks the set dead */
+static void lps_sample_set(linux_proc_sampler_inst_t inst,
+			   struct linux_proc_sampler_set *app_set)
+{
+	int i, rc;
+	ldms_transaction_begin(app_set->set);
+	gettimeofday(&app_set->sample_start, NULL);
+	for (i = 0; i < inst->n_fn; i++) {
+		rc = inst->fn[i].fn(inst, app_set);
+		if (rc) {
+#ifdef LPDEBUG
+			if (rc != ENOENT) {
+				INST_LOG(inst, LDMSD_LDEBUG,
+					"Removing set %s. Error %d(%s)"
+					" from %s\n",
+					ldms_set_instance_name_get(
+						app_set->set),
+					rc, STRERROR(rc),
+					inst->fn[i].fn_name);
+			}
+#endif
+			app_set->dead = rc;
+			break;
+		}
+	}
+#ifdef LPDEBUG
+	if (!app_set->dead)
+		INST_LOG(inst, LDMSD_LDEBUG, "Got data for %s\n",
+			ldms_set_instance_name_get(app_set->set));
+#endif
+	ldms_transaction_end(app_set->set);
+}
+
+/*
+ * Sampling pool
+ *
+ * The sets of a sample are in inst->sample_vec. The caller and the pool
+ * threads claim them LPS_BATCH at a time until none are left; the sets
+ * are independent, so only the claim index is shared. The caller returns
+ * when every thread has finished its last batch.
+ */
+#define LPS_BATCH 8
+
+struct lps_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t start_cv;
+	pthread_cond_t done_cv;
+	pthread_t *threads;
+	int n_threads;
+	int stop;
+	uint64_t gen; /* sample generation */
+	int busy; /* threads working on this generation */
+	int n_sets;
+	int next; /* next set to claim */
+	linux_proc_sampler_inst_t inst;
+};
+
+static void lps_pool_run(struct lps_pool *pool)
+{
+	linux_proc_sampler_inst_t inst = pool->inst;
+	int i, n;
+	while ((i = __atomic_fetch_add(&pool->next, LPS_BATCH,
+				       __ATOMIC_RELAXED)) < pool->n_sets) {
+		n = i + LPS_BATCH;
+		if (n > pool->n_sets)
+			n = pool->n_sets;
+		for (; i < n; i++)
+			lps_sample_set(inst, inst->sample_vec[i]);
+	}
+}
+
+static void *lps_pool_proc(void *arg)
+{
+	struct lps_pool *pool = arg;
+	uint64_t gen = 0;
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+		while (!pool->stop && pool->gen == gen)
+			pthread_cond_wait(&pool->start_cv, &pool->lock);
+		if (pool->stop)
+			break;
+		gen = pool->gen;
+		pthread_mutex_unlock(&pool->lock);
+		lps_pool_run(pool);
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->busy == 0)
+			pthread_cond_signal(&pool->done_cv);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+static void lps_pool_free(struct lps_pool *pool)
+{
+	int i;
+	if (!pool)
+		return;
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->start_cv);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 0; i < pool->n_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->start_cv);
+	pthread_cond_destroy(&pool->done_cv);
+	free(pool->threads);
+	free(pool);
+}
+
+static struct lps_pool *lps_pool_new(linux_proc_sampler_inst_t inst, int n)
+{
+	struct lps_pool *pool;
+	int rc;
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+	pool->threads = calloc(n, sizeof(*pool->threads));
+	if (!pool->threads) {
+		free(pool);
+		return NULL;
+	}
+	pool->inst = inst;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start_cv, NULL);
+	pthread_cond_init(&pool->done_cv, NULL);
+	for (pool->n_threads = 0; pool->n_threads < n; pool->n_threads++) {
+		rc = pthread_create(&pool->threads[pool->n_threads], NULL,
+				    lps_pool_proc, pool);
+		if (rc) {
+			lps_pool_free(pool);
+			errno = rc;
+			return NULL;
+		}
+		pthread_setname_np(pool->threads[pool->n_threads], "lps:sample");
+	}
+	return pool;
+}
+
+/* Sample the `n` sets in inst->sample_vec */
+static void lps_sample_sets(linux_proc_sampler_inst_t inst, int n)
+{
+	struct lps_pool *pool = inst->pool;
+	int i;
+	if (!pool || n <= LPS_BATCH) {
+		for (i = 0; i < n; i++)
+			lps_sample_set(inst, inst->sample_vec[i]);
+		return;
+	}
+	pthread_mutex_lock(&pool->lock);
+	pool->n_sets = n;
+	pool->next = 0;
+	pool->busy = pool->n_threads;
+	pool->gen++;
+	pthread_cond_broadcast(&pool->start_cv);
+	pthread_mutex_unlock(&pool->lock);
+	lps_pool_run(pool);
+	pthread_mutex_lock(&pool->lock);
+	while (pool->busy)
+		pthread_cond_wait(&pool->done_cv, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
 static int linux_proc_sampler_sample(struct ldmsd_sampler *pi)
 {
 	linux_proc_sampler_inst_t inst = (void*)pi;
-	int i, rc;
+	int i, n, rc;
 	struct rbn *rbn;
 #ifdef LPDEBUG
 	INST_LOG(inst, LDMSD_LDEBUG, "Sampling\n");
 #endif
-	struct linux_proc_sampler_set *app_set;
+	struct linux_proc_sampler_set *app_set, **vec;
 	struct set_del_list del_list;
 	LIST_INIT(&del_list);
 	pthread_mutex_lock(&inst->mutex);
+	n = 0;
 	RBT_FOREACH(rbn, &inst->set_rbt) {
 		app_set = container_of(rbn, struct linux_proc_sampler_set, rbn);
 		if (app_set->dead ) {
 			LIST_INSERT_HEAD(&del_list, app_set, del);
 			continue;
 		}
-		ldms_transaction_begin(app_set->set);
-		gettimeofday(&inst->sample_start, NULL);
-		for (i = 0; i < inst->n_fn; i++) {
-			rc = inst->fn[i].fn(inst, app_set->key.os_pid, app_set->set);
-			if (rc) {
-#ifdef LPDEBUG
-				if (rc != ENOENT) {
-					INST_LOG(inst, LDMSD_LDEBUG,
-						"Removing set %s. Error %d(%s)"
-						" from %s\n",
-						ldms_set_instance_name_get(
-							app_set->set),
-						rc, STRERROR(rc),
-						inst->fn[i].fn_name);
-				}
-#endif
-				LIST_INSERT_HEAD(&del_list, app_set, del);
-				app_set->dead = rc;
-				break;
+		if (n == inst->sample_vec_max) {
+			i = inst->sample_vec_max ? 2 * inst->sample_vec_max : 64;
+			vec = realloc(inst->sample_vec, i * sizeof(*vec));
+			if (!vec) {
+				pthread_mutex_unlock(&inst->mutex);
+				return ENOMEM;
 			}
+			inst->sample_vec = vec;
+			inst->sample_vec_max = i;
+		}
+		inst->sample_vec[n++] = app_set;
+	}
+	lps_sample_sets(inst, n);
+	for (i = 0; i < n; i++) {
+		app_set = inst->sample_vec[i];
+		if (app_set->dead) {
+			LIST_INSERT_HEAD(&del_list, app_set, del);
+			continue;
 		}
 		app_set->fd_skip++;
-		if (!app_set->dead && inst->fd_msg &&
-			(app_set->fd_skip % inst->fd_msg == 0)) {
+		if (inst->fd_msg && (app_set->fd_skip % inst->fd_msg == 0)) {
 			rc = publish_fd_pid(inst, app_set);
 			if (rc) {
 				if (rc != ENOENT) {
@@ -1673,14 +2059,8 @@ static int linux_proc_sampler_sample(struct ldmsd_sampler *pi)
 				}
 				LIST_INSERT_HEAD(&del_list, app_set, del);
 				app_set->dead = rc;
-				break;
 			}
 		}
-#ifdef LPDEBUG
-		INST_LOG(inst, LDMSD_LDEBUG, "Got data for %s\n",
-			ldms_set_instance_name_get(app_set->set));
-#endif
-		ldms_transaction_end(app_set->set);
 	}
 	while (!LIST_EMPTY(&del_list)) {
                 app_set = LIST_FIRST(&del_list);
@@ -1704,6 +2084,7 @@ linux_proc_sampler config synopsis: \n\
 	    [sc_clk_tck=1] [metrics=METRICS] [cfg_file=FILE] [exe_suffix=1]\n\
             [env_msg=1] [argv_msg=1] [argv_fmt=<1,2>] [env_exclude=EFILE]\n\
             [fd_msg=N] [fd_exclude=EFILE] [published_pid_dir=PDIR]\n\
+            [sample_threads=N]\n\
 \n\
 Option descriptions:\n\
     instance_prefix    The prefix for generated instance names. Typically a cluster name\n\
@@ -1726,6 +2107,8 @@ Option descriptions:\n\
     fd_msg=N  Enable /proc/$pid/fd detail reporting every N-th sample\n\
     fd_exclude Name of a file with 1 regular expression per line.\n\
     published_pid_dir Name of a directory of interesting pids\n\
+    sample_threads=N Sample the sets with N threads besides the caller\n\
+              (default: 0).\n\
     cfg_file  The alternative config file in JSON format. The file is\n\
 	      expected to have an object that contains the following \n\
 	      attributes:\n\
@@ -2066,6 +2449,16 @@ int __handle_cfg_file(linux_proc_sampler_inst_t inst, char *val)
 				inst->sc_clk_tck);
 		}
 	}
+	ent = json_value_find(jdoc, "sample_threads");
+	if (ent) {
+		if (ent->type != JSON_INT_VALUE || json_value_int(ent) < 0) {
+			rc = EINVAL;
+			INST_LOG(inst, LDMSD_LERROR,
+				"Error: `sample_threads` must be positive/0 integer.\n");
+			goto out;
+		}
+		inst->sample_threads = json_value_int(ent);
+	}
 	ent = json_value_find(jdoc, "stream");
 	if (ent) {
 		if (ent->type != JSON_STRING_VALUE) {
@@ -3334,6 +3727,7 @@ int __handle_task_init(linux_proc_sampler_inst_t inst, json_entity_t data, int *
 	app_set = calloc(1, sizeof(*app_set));
 	if (!app_set)
 		return ENOMEM;
+	app_set->dirfd = app_set->fd_dirfd = -1;
 	app_set->task_rank = task_rank_val;
 	data_set_key(inst, app_set, start_tick, pid);
 
@@ -3787,6 +4181,18 @@ linux_proc_sampler_config(struct ldmsd_plugin *pi, struct attr_value_list *kwl,
 		if (val) {
 			inst->sc_clk_tck = sysconf(_SC_CLK_TCK);
 		}
+		val = av_value(avl, "sample_threads");
+		if (val) {
+			int dval;
+			if (sscanf(val, "%d", &dval) != 1 || dval < 0) {
+				INST_LOG(inst, LDMSD_LERROR,
+					"sample_threads='%s' not a positive/0 integer.\n",
+					val);
+				rc = EINVAL;
+				goto err;
+			}
+			inst->sample_threads = dval;
+		}
 		val = av_value(avl, "stream");
 		if (val) {
 			inst->stream_name = strdup(val);
@@ -3849,6 +4255,25 @@ linux_proc_sampler_config(struct ldmsd_plugin *pi, struct attr_value_list *kwl,
 	if (rc) {
 		goto err;
 	}
+
+	/* half of the descriptor limit may be held open by the sets */
+	struct rlimit rl;
+	struct stat st;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+		inst->fd_cache_max = rl.rlim_cur / 2;
+	else
+		inst->fd_cache_max = 65536;
+	inst->fd_count_stat = (stat("/proc/self/fd", &st) == 0 && st.st_size > 0);
+	if (inst->sample_threads) {
+		inst->pool = lps_pool_new(inst, inst->sample_threads);
+		if (!inst->pool) {
+			rc = errno;
+			INST_LOG(inst, LDMSD_LERROR,
+				"Error %d creating %d sampling threads\n",
+				rc, inst->sample_threads);
+			goto err;
+		}
+	}
 	/* default stream */
 	if (!inst->stream_name) {
 		inst->stream_name = strdup("slurm");
@@ -3975,6 +4400,12 @@ void linux_proc_sampler_term(struct ldmsd_plugin *pi)
 		app_set_destroy(inst, app_set);
 	}
 	pthread_mutex_unlock(&inst->mutex);
+	lps_pool_free(inst->pool);
+	inst->pool = NULL;
+	inst->sample_threads = 0;
+	free(inst->sample_vec);
+	inst->sample_vec = NULL;
+	inst->sample_vec_max = 0;
 	free(inst->instance_prefix);
 	inst->instance_prefix = NULL;
 	free(inst->stream_name);
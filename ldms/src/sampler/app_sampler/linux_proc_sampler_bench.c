@@ -0,0 +1,454 @@
+/*
+ * The sampler is static, so the bench is built from the plugin source.
+ */
+#include "linux_proc_sampler.c"
+
+#include <getopt.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/*
+ * linux_proc_sampler sample cost
+ *
+ * Forks N children that each open F files and pause, adds a set for each
+ * and times I samples in each of these modes:
+ *
+ *   legacy    reads the files the way the sampler used to: fopen() and
+ *             fscanf()/fgets() per file per sample, readdir() of fd/.
+ *             No set is written, so this is a lower bound for the old
+ *             sampler.
+ *   nocache   the sampler with fd_cache_max=0; every file is opened by
+ *             path and closed again at each sample.
+ *   cached    the sampler keeping the files open across samples.
+ *   threads   as cached, with -t sampling threads.
+ *
+ * After every sampler mode a few metrics of each set are checked against
+ * the values the legacy reader parses.
+ */
+
+static int nprocs = 256;
+static int nfiles = 16;
+static int iters = 20;
+static int nthreads = 4;
+static pid_t *kids;
+
+/* provided by ldmsd to the plugins it loads */
+void ldmsd_log(enum ldmsd_loglevel level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (level < LDMSD_LWARNING)
+		return;
+	printf("# ");
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+int ldmsd_set_register(ldms_set_t set, const char *plugin_name)
+{
+	return 0;
+}
+
+void ldmsd_set_deregister(const char *inst_name, const char *plugin_name)
+{
+}
+
+int ldmsd_compile_regex(regex_t *regex, const char *ex, char *errbuf,
+			size_t errsz)
+{
+	return regcomp(regex, ex, REG_EXTENDED | REG_NOSUB);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* ---- processes ---- */
+
+static void kids_start(void)
+{
+	int i, k;
+	kids = calloc(nprocs, sizeof(*kids));
+	if (!kids) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < nprocs; i++) {
+		kids[i] = fork();
+		if (kids[i] < 0) {
+			perror("fork");
+			exit(1);
+		}
+		if (kids[i] == 0) {
+			for (k = 0; k < nfiles; k++)
+				open("/dev/null", O_RDONLY);
+			pause();
+			_exit(0);
+		}
+	}
+	usleep(100000); /* let the children open their files */
+}
+
+static void kids_stop(void)
+{
+	int i;
+	for (i = 0; i < nprocs; i++)
+		kill(kids[i], SIGKILL);
+	for (i = 0; i < nprocs; i++)
+		waitpid(kids[i], NULL, 0);
+	free(kids);
+}
+
+/* ---- legacy reader ---- */
+
+struct legacy {
+	uint64_t pid, ppid, vsize, num_threads;
+	char comm[STAT_COMM_SZ];
+	uint64_t n_open_files;
+	uint64_t io_read_b;
+	int64_t oom_score_adj;
+	uint64_t vmrss;
+	uint64_t uid;
+};
+
+static int legacy_read(pid_t pid, struct legacy *l)
+{
+	char path[PROCPID_SZ], buf[4096], lbuf[256], *p;
+	uint64_t u[64], io[7];
+	DIR *dir;
+	struct dirent *dent;
+	FILE *f;
+	ssize_t len;
+	int n, x;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	f = fopen(path, "r");
+	if (!f)
+		return errno;
+	n = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[n] = 0;
+	p = strrchr(buf, ')');
+	if (!p)
+		return EINVAL;
+	*p = 0;
+	snprintf(l->comm, sizeof(l->comm), "%s", strchr(buf, '(') + 1);
+	l->pid = strtoull(buf, NULL, 10);
+	n = sscanf(p + 2, "%*c %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu "
+		   "%lu %lu %lu %lu %lu %lu %lu %lu",
+		   u, u+1, u+2, u+3, u+4, u+5, u+6, u+7, u+8, u+9, u+10, u+11,
+		   u+12, u+13, u+14, u+15, u+16, u+17, u+18, u+19);
+	if (n != 20)
+		return EINVAL;
+	l->ppid = u[0];
+	l->num_threads = u[16];
+	l->vsize = u[19];
+
+	snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	f = fopen(path, "r");
+	if (!f)
+		return errno;
+	while (fgets(lbuf, sizeof(lbuf), f)) {
+		p = strchr(lbuf, ':');
+		if (!p)
+			continue;
+		*p++ = 0;
+		if (0 == strcmp(lbuf, "VmRSS"))
+			sscanf(p, "%lu", &l->vmrss);
+		else if (0 == strcmp(lbuf, "Uid"))
+			sscanf(p, "%lu", &l->uid);
+	}
+	fclose(f);
+
+	snprintf(path, sizeof(path), "/proc/%d/io", pid);
+	f = fopen(path, "r");
+	if (!f)
+		return errno;
+	n = fscanf(f,   "rchar: %lu\n"
+			"wchar: %lu\n"
+			"syscr: %lu\n"
+			"syscw: %lu\n"
+			"read_bytes: %lu\n"
+			"write_bytes: %lu\n"
+			"cancelled_write_bytes: %lu\n",
+			io+0, io+1, io+2, io+3, io+4, io+5, io+6);
+	fclose(f);
+	if (n != 7)
+		return EINVAL;
+	l->io_read_b = io[0];
+
+	snprintf(path, sizeof(path), "/proc/%d/oom_score", pid);
+	f = fopen(path, "r");
+	if (!f)
+		return errno;
+	n = fscanf(f, "%d", &x);
+	fclose(f);
+	snprintf(path, sizeof(path), "/proc/%d/oom_score_adj", pid);
+	f = fopen(path, "r");
+	if (!f)
+		return errno;
+	n = fscanf(f, "%d", &x);
+	fclose(f);
+	l->oom_score_adj = x;
+
+	snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+	dir = opendir(path);
+	if (!dir)
+		return errno;
+	l->n_open_files = 0;
+	while ((dent = readdir(dir))) {
+		if (strcmp(dent->d_name, ".") && strcmp(dent->d_name, ".."))
+			l->n_open_files++;
+	}
+	closedir(dir);
+
+	snprintf(path, sizeof(path), "/proc/%d/root", pid);
+	len = readlink(path, buf, sizeof(buf));
+	(void)len;
+	snprintf(path, sizeof(path), "/proc/%d/syscall", pid);
+	f = fopen(path, "r");
+	if (f) {
+		if (fgets(lbuf, sizeof(lbuf), f))
+			sscanf(lbuf, "%d", &x);
+		fclose(f);
+	}
+	snprintf(path, sizeof(path), "/proc/%d/timerslack_ns", pid);
+	f = fopen(path, "r");
+	if (f) {
+		n = fscanf(f, "%lu", u);
+		fclose(f);
+	}
+	snprintf(path, sizeof(path), "/proc/%d/wchan", pid);
+	f = fopen(path, "r");
+	if (f) {
+		n = fread(lbuf, 1, sizeof(lbuf), f);
+		fclose(f);
+	}
+	return 0;
+}
+
+/* ---- sampler ---- */
+
+static int sampler_config(void)
+{
+	struct attr_value_list *kwl, *avl;
+	struct ldmsd_plugin *pi;
+	char cfg[] = "producer=bench instance=bench component_id=1 "
+		     "published_pid_dir=/nonexistent stream=bench";
+	int rc;
+
+	pi = get_plugin(ldmsd_log);
+	kwl = av_new(64);
+	avl = av_new(64);
+	if (!kwl || !avl || tokenize(cfg, kwl, avl)) {
+		rc = ENOMEM;
+		goto out;
+	}
+	rc = pi->config(pi, kwl, avl);
+	if (rc)
+		printf("Bad plugin configuration '%s'\n", cfg);
+out:
+	av_free(kwl);
+	av_free(avl);
+	return rc;
+}
+
+static int sampler_add(pid_t pid)
+{
+	json_parser_t parser;
+	json_entity_t data;
+	char buf[128];
+	int len, rc;
+
+	len = snprintf(buf, sizeof(buf), "{\"job_id\":1,\"os_pid\":%d}", pid);
+	parser = json_parser_new(0);
+	if (!parser)
+		return ENOMEM;
+	rc = json_parse_buffer(parser, buf, len, &data);
+	json_parser_free(parser);
+	if (rc)
+		return rc;
+	rc = __handle_task_init(&__inst, data, NULL);
+	json_entity_free(data);
+	return rc;
+}
+
+static uint64_t metric_u64(ldms_set_t set, const char *name)
+{
+	return ldms_metric_get_u64(set, ldms_metric_by_name(set, name));
+}
+
+static int check(void)
+{
+	struct linux_proc_sampler_set *as;
+	struct legacy l;
+	struct rbn *rbn;
+	ldms_set_t set;
+	int n = 0, bad = 0, rc;
+
+	RBT_FOREACH(rbn, &__inst.set_rbt) {
+		as = container_of(rbn, struct linux_proc_sampler_set, rbn);
+		set = as->set;
+		n++;
+		rc = legacy_read(as->key.os_pid, &l);
+		if (rc) {
+			printf("pid %" PRId64 ": legacy read error %d\n",
+			       as->key.os_pid, rc);
+			bad++;
+			continue;
+		}
+		if (l.pid != metric_u64(set, "stat_pid")
+		    || l.ppid != metric_u64(set, "stat_ppid")
+		    || l.vsize != metric_u64(set, "stat_vsize")
+		    || l.num_threads != metric_u64(set, "stat_num_threads")
+		    || strcmp(l.comm, ldms_metric_array_get_str(set,
+				ldms_metric_by_name(set, "stat_comm")))
+		    || l.n_open_files != metric_u64(set, "n_open_files")
+		    || l.io_read_b != metric_u64(set, "io_read_b")
+		    || l.oom_score_adj != ldms_metric_get_s64(set,
+				ldms_metric_by_name(set, "oom_score_adj"))
+		    || l.vmrss != metric_u64(set, "status_vmrss")
+		    || l.uid != ldms_metric_array_get_u64(set,
+				ldms_metric_by_name(set, "status_uid"), 0)) {
+			printf("pid %" PRId64 ": set values differ\n",
+			       as->key.os_pid);
+			bad++;
+		}
+	}
+	if (n != nprocs) {
+		printf("%d sets, expected %d\n", n, nprocs);
+		bad++;
+	}
+	return bad;
+}
+
+static void report(const char *name, double sec)
+{
+	printf("%-8s %10.1f us/sample %8.2f us/process\n", name,
+	       sec / iters * 1e6, sec / iters / nprocs * 1e6);
+}
+
+static int run_sampler(const char *name)
+{
+	double t0;
+	int i;
+
+	t0 = now();
+	for (i = 0; i < iters; i++)
+		linux_proc_sampler_sample(&__inst.samp);
+	report(name, now() - t0);
+	if (check()) {
+		printf("%s: FAILED\n", name);
+		return 1;
+	}
+	return 0;
+}
+
+static int run_legacy(void)
+{
+	struct legacy l;
+	double t0;
+	int i, k, rc;
+
+	t0 = now();
+	for (i = 0; i < iters; i++) {
+		for (k = 0; k < nprocs; k++) {
+			rc = legacy_read(kids[k], &l);
+			if (rc) {
+				printf("pid %d: legacy read error %d\n",
+				       kids[k], rc);
+				return 1;
+			}
+		}
+	}
+	report("legacy", now() - t0);
+	return 0;
+}
+
+static void bench_usage(const char *prog)
+{
+	printf("Usage: %s [-n processes] [-f files] [-i samples] "
+	       "[-t threads]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	long cache_max;
+	int opt, i, rc;
+
+	while ((opt = getopt(argc, argv, "n:f:i:t:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nprocs = atoi(optarg);
+			break;
+		case 'f':
+			nfiles = atoi(optarg);
+			break;
+		case 'i':
+			iters = atoi(optarg);
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		default:
+			bench_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (nprocs < 1 || nfiles < 0 || iters < 1 || nthreads < 1) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	rc = ldms_init(512 * 1024 * 1024);
+	if (rc) {
+		printf("ldms_init error %d\n", rc);
+		return 1;
+	}
+	rc = sampler_config();
+	if (rc)
+		return 1;
+	kids_start();
+	for (i = 0; i < nprocs; i++) {
+		rc = sampler_add(kids[i]);
+		if (rc) {
+			printf("pid %d: error %d adding the set\n", kids[i], rc);
+			goto out;
+		}
+	}
+	printf("# %d processes, %d extra files each, %d samples, "
+	       "fd count by %s\n", nprocs, nfiles, iters,
+	       __inst.fd_count_stat ? "stat" : "getdents64");
+
+	rc = run_legacy();
+	if (rc)
+		goto out;
+	cache_max = __inst.fd_cache_max;
+	__inst.fd_cache_max = 0;
+	rc = run_sampler("nocache");
+	if (rc)
+		goto out;
+	__inst.fd_cache_max = cache_max;
+	rc = run_sampler("cached");
+	if (rc)
+		goto out;
+	printf("# %ld descriptors held\n", __inst.fd_cached);
+	__inst.pool = lps_pool_new(&__inst, nthreads);
+	if (!__inst.pool) {
+		printf("error %d starting %d threads\n", errno, nthreads);
+		rc = 1;
+		goto out;
+	}
+	rc = run_sampler("threads");
+out:
+	linux_proc_sampler_term(&__inst.samp.base);
+	kids_stop();
+	if (rc)
+		printf("FAILED\n");
+	return rc ? 1 : 0;
+}
@@ -47,11 +47,13 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _GNU_SOURCE
 #include <ctype.h>
 #include <sys/queue.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -70,6 +72,66 @@
 
 #define PNAME "blob_stream_writer"
 
+/*
+ * stream_cb() copies each message into the active one of two batches
+ * held by the stream. The writer thread swaps the batches and writes the
+ * full one, with one writev() per file, when flush_bytes are buffered or
+ * every flush_interval. stream_cb() waits for the writer once
+ * BLOB_BACKLOG * flush_bytes are buffered. Messages of BLOB_DIRECT_SIZE
+ * bytes or more are not copied; stream_cb() writes them to the DAT file
+ * after the buffered DAT bytes.
+ */
+#define BLOB_CHUNK_SIZE		(64 * 1024)
+#define BLOB_IOV_MAX		64
+#define BLOB_FLUSH_BYTES	(1024 * 1024)
+#define BLOB_FLUSH_INTERVAL	1000000	/* usec */
+#define BLOB_BACKLOG		8
+#define BLOB_DIRECT_SIZE	BLOB_CHUNK_SIZE
+
+enum blob_file {
+	BF_OFFSET,
+	BF_TIMING,
+	BF_TYPE,
+	BF_DAT,
+	BF_COUNT
+};
+
+static const char *blob_suffix[BF_COUNT] = {
+	[BF_OFFSET] = "OFFSET",
+	[BF_TIMING] = "TIMING",
+	[BF_TYPE] = "TYPE",
+	[BF_DAT] = "DAT",
+};
+
+/* 8 byte magic numbers at the start of each file */
+static const char *blob_magic[BF_COUNT] = {
+	[BF_OFFSET] = "bloboff",
+	[BF_TIMING] = "blobtim",
+	[BF_TYPE] = "blobtyp",
+	[BF_DAT] = "blobdat",
+};
+
+struct blob_chunk {
+	struct blob_chunk *next;
+	size_t len;
+	char data[BLOB_CHUNK_SIZE];
+};
+
+/* Bytes buffered for one file. The chunks after cur are empty. */
+struct blob_seg {
+	struct blob_chunk *head;
+	struct blob_chunk *tail;
+	struct blob_chunk *cur;
+	size_t len;
+};
+
+struct blob_batch {
+	struct blob_seg seg[BF_COUNT];
+	size_t bytes;
+	int count;
+	int kicked;	/* the writer was woken for this batch */
+};
+
 static ldmsd_msg_log_f msglog;
 static pthread_mutex_t cfg_lock;
 static int closing;
@@ -86,19 +148,17 @@ enum writer_state {
 typedef struct stream_data {
 	/* set at create */
 	pthread_mutex_t write_lock;
+	pthread_mutex_t flush_lock;	/* taken before write_lock */
+	pthread_cond_t flush_cv;	/* a batch was written */
 	enum writer_state ws;
 	char* stream_name;
-	char* streamfile_name;
-	char* offsetfile_name;
-	char* timingfile_name;
-	char* typefile_name;
+	char* fname[BF_COUNT];
 	ldmsd_stream_client_t subscription;
 	/* set at first write */
-	FILE* offsetfile;
-	FILE* streamfile;
-	FILE* timingfile;
-	FILE* typefile;
+	int fd[BF_COUNT];
 	long offset;
+	struct blob_batch batch[2];
+	int active;	/* the batch stream_cb() appends to */
 	LIST_ENTRY(stream_data) entry;
 } *stream_data_t;
 
@@ -111,6 +171,16 @@ static int debug;
 static int timing;
 static int types;
 static int spool;
+static size_t flush_bytes = BLOB_FLUSH_BYTES;
+static long flush_interval = BLOB_FLUSH_INTERVAL;
+static int sync_files;
+
+static pthread_t writer_thread;
+static int writer_running;
+static int writer_stop;
+static int writer_kicked;
+static pthread_mutex_t writer_lock;
+static pthread_cond_t writer_cv;
 
 char blob_stream_char_to_type(char c)
 {
@@ -148,7 +218,262 @@ char blob_stream_type_to_char(ldmsd_stream_type_t stream_type)
 	}
 }
 
-/* open, if not open or already closed, and write to stream files. */
+/* Make room for len more bytes so that blob_seg_append() cannot fail */
+static int blob_seg_reserve(struct blob_seg *s, size_t len)
+{
+	struct blob_chunk *c;
+	size_t room = 0;
+
+	for (c = s->cur; c && room < len; c = c->next)
+		room += BLOB_CHUNK_SIZE - c->len;
+	while (room < len) {
+		c = malloc(sizeof(*c));
+		if (!c)
+			return ENOMEM;
+		c->next = NULL;
+		c->len = 0;
+		if (s->tail)
+			s->tail->next = c;
+		else
+			s->head = c;
+		s->tail = c;
+		if (!s->cur)
+			s->cur = c;
+		room += BLOB_CHUNK_SIZE;
+	}
+	return 0;
+}
+
+static void blob_seg_append(struct blob_seg *s, const void *data, size_t len)
+{
+	const char *p = data;
+	size_t n;
+
+	s->len += len;
+	while (len) {
+		if (s->cur->len == BLOB_CHUNK_SIZE)
+			s->cur = s->cur->next;
+		n = BLOB_CHUNK_SIZE - s->cur->len;
+		if (n > len)
+			n = len;
+		memcpy(&s->cur->data[s->cur->len], p, n);
+		s->cur->len += n;
+		p += n;
+		len -= n;
+	}
+}
+
+/* Empty the segment, keeping enough chunks for the next flush_bytes */
+static void blob_seg_reset(struct blob_seg *s)
+{
+	struct blob_chunk *c, *next;
+	size_t keep = flush_bytes;
+
+	for (c = s->head; c; c = c->next) {
+		c->len = 0;
+		if (keep <= BLOB_CHUNK_SIZE)
+			break;
+		keep -= BLOB_CHUNK_SIZE;
+	}
+	if (c) {
+		for (next = c->next, c->next = NULL; next; next = c) {
+			c = next->next;
+			free(next);
+		}
+	}
+	s->tail = s->head;
+	while (s->tail && s->tail->next)
+		s->tail = s->tail->next;
+	s->cur = s->head;
+	s->len = 0;
+}
+
+static void blob_seg_free(struct blob_seg *s)
+{
+	struct blob_chunk *c;
+
+	while ((c = s->head)) {
+		s->head = c->next;
+		free(c);
+	}
+	s->tail = s->cur = NULL;
+	s->len = 0;
+}
+
+static int writev_full(int fd, struct iovec *iov, int cnt)
+{
+	ssize_t n;
+
+	while (cnt) {
+		n = writev(fd, iov, cnt);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		while (cnt && (size_t)n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if (cnt) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	return 0;
+}
+
+static int blob_seg_write(int fd, struct blob_seg *s)
+{
+	struct iovec iov[BLOB_IOV_MAX];
+	struct blob_chunk *c = s->head;
+	int cnt, rc;
+
+	while (c && c->len) {
+		for (cnt = 0; c && c->len && cnt < BLOB_IOV_MAX; c = c->next) {
+			iov[cnt].iov_base = c->data;
+			iov[cnt].iov_len = c->len;
+			cnt++;
+		}
+		rc = writev_full(fd, iov, cnt);
+		if (rc)
+			return rc;
+	}
+	return 0;
+}
+
+/*
+ * Write the DAT bytes buffered in b and then msg. The flush_lock and
+ * write_lock must be held, so the other batch is empty.
+ */
+static void blob_dat_write(stream_data_t sd, struct blob_batch *b,
+			   const char *msg, size_t msg_len)
+{
+	struct blob_seg *s = &b->seg[BF_DAT];
+	struct iovec iov[BLOB_IOV_MAX + 1];
+	struct blob_chunk *c = s->head;
+	int cnt, rc;
+
+	do {
+		for (cnt = 0; c && c->len && cnt < BLOB_IOV_MAX; c = c->next) {
+			iov[cnt].iov_base = c->data;
+			iov[cnt].iov_len = c->len;
+			cnt++;
+		}
+		if (!c || !c->len) {
+			iov[cnt].iov_base = (void *)msg;
+			iov[cnt].iov_len = msg_len;
+			cnt++;
+		}
+		rc = writev_full(sd->fd[BF_DAT], iov, cnt);
+		if (rc) {
+			msglog(LDMSD_LERROR, PNAME ": error '%s' writing %zu "
+			       "bytes to %s\n", STRERROR(rc), s->len + msg_len,
+			       sd->fname[BF_DAT]);
+			break;
+		}
+	} while (c && c->len);
+	b->bytes -= s->len;
+	blob_seg_reset(s);
+}
+
+/*
+ * Write a batch to the files in fd and empty it. The flush_lock must be
+ * held.
+ */
+static void blob_batch_write(stream_data_t sd, struct blob_batch *b, int *fd)
+{
+	int i, rc;
+
+	for (i = 0; i < BF_COUNT; i++) {
+		if (fd[i] < 0)
+			continue;
+		if (b->seg[i].len) {
+			rc = blob_seg_write(fd[i], &b->seg[i]);
+			if (rc) {
+				msglog(LDMSD_LERROR, PNAME ": error '%s' writing "
+				       "%zu bytes to %s\n", STRERROR(rc),
+				       b->seg[i].len, sd->fname[i]);
+			}
+			blob_seg_reset(&b->seg[i]);
+		}
+		/* direct DAT writes leave nothing in the segment */
+		if (sync_files && b->count && fdatasync(fd[i])) {
+			msglog(LDMSD_LERROR, PNAME ": error '%s' syncing %s\n",
+			       STRERROR(errno), sd->fname[i]);
+		}
+	}
+	b->bytes = 0;
+	b->count = 0;
+	b->kicked = 0;
+}
+
+/* Write the buffered messages of a stream */
+static void stream_data_flush(stream_data_t sd)
+{
+	struct blob_batch *b;
+	int fd[BF_COUNT];
+
+	pthread_mutex_lock(&sd->flush_lock);
+	pthread_mutex_lock(&sd->write_lock);
+	b = &sd->batch[sd->active];
+	if (!b->count) {
+		pthread_mutex_unlock(&sd->write_lock);
+		pthread_mutex_unlock(&sd->flush_lock);
+		return;
+	}
+	/* The other batch is empty; it was written by the last flush */
+	sd->active = !sd->active;
+	memcpy(fd, sd->fd, sizeof(fd));
+	pthread_mutex_unlock(&sd->write_lock);
+
+	blob_batch_write(sd, b, fd);
+
+	pthread_mutex_lock(&sd->write_lock);
+	pthread_cond_broadcast(&sd->flush_cv);
+	pthread_mutex_unlock(&sd->write_lock);
+	pthread_mutex_unlock(&sd->flush_lock);
+}
+
+static void writer_kick(void)
+{
+	pthread_mutex_lock(&writer_lock);
+	writer_kicked = 1;
+	pthread_cond_signal(&writer_cv);
+	pthread_mutex_unlock(&writer_lock);
+}
+
+static void *writer_proc(void *arg)
+{
+	struct timespec ts;
+	stream_data_t sd;
+
+	pthread_mutex_lock(&writer_lock);
+	while (!writer_stop) {
+		if (!writer_kicked) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += flush_interval / 1000000;
+			ts.tv_nsec += (flush_interval % 1000000) * 1000;
+			if (ts.tv_nsec >= 1000000000) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&writer_cv, &writer_lock, &ts);
+		}
+		writer_kicked = 0;
+		pthread_mutex_unlock(&writer_lock);
+		pthread_mutex_lock(&cfg_lock);
+		LIST_FOREACH(sd, &data_list, entry)
+			stream_data_flush(sd);
+		pthread_mutex_unlock(&cfg_lock);
+		pthread_mutex_lock(&writer_lock);
+	}
+	pthread_mutex_unlock(&writer_lock);
+	return NULL;
+}
+
+/* open, if not open or already closed, and buffer the message. */
 static int stream_cb(ldmsd_stream_client_t c, void *ctxt,
 		     ldmsd_stream_type_t stream_type,
 		     const char *msg, size_t msg_len,
@@ -156,63 +481,78 @@ static int stream_cb(ldmsd_stream_client_t c, void *ctxt,
 {
 	int rc = 0;
 	stream_data_t sd = ctxt;
+	struct blob_batch *b;
+	int direct = (msg_len >= BLOB_DIRECT_SIZE);
 	if (!sd) {
 		msglog(LDMSD_LERROR, PNAME ": stream_cb ctxt is NULL\n");
 		return EINVAL;
 	}
 
+	if (direct)
+		pthread_mutex_lock(&sd->flush_lock);
 	pthread_mutex_lock(&sd->write_lock);
 	if (sd->ws == WS_NEW) {
 		stream_data_open(sd);
 	}
+	while (!direct && sd->ws == WS_OPEN &&
+	       sd->batch[sd->active].bytes >= BLOB_BACKLOG * flush_bytes) {
+		writer_kick();
+		pthread_cond_wait(&sd->flush_cv, &sd->write_lock);
+	}
 	if (sd->ws != WS_OPEN) {
 		goto out;
 	}
-	assert(sd->streamfile != NULL);
+	assert(sd->fd[BF_DAT] >= 0);
 
-	uint64_t le = htole64(sd->offset);
-	rc = fwrite(&le, sizeof(uint64_t), 1, sd->offsetfile);
-	if ( rc != 1) {
-		msglog(LDMSD_LERROR, PNAME ": error writing offset to %s\n",
-			sd->offsetfile_name);
+	b = &sd->batch[sd->active];
+	if (blob_seg_reserve(&b->seg[BF_OFFSET], sizeof(uint64_t)) ||
+	    (sd->fd[BF_TIMING] >= 0 &&
+	     blob_seg_reserve(&b->seg[BF_TIMING], 2 * sizeof(uint64_t))) ||
+	    (sd->fd[BF_TYPE] >= 0 && blob_seg_reserve(&b->seg[BF_TYPE], 1)) ||
+	    (!direct && blob_seg_reserve(&b->seg[BF_DAT], msg_len))) {
+		msglog(LDMSD_LERROR, PNAME ": out of memory buffering a %zu "
+		       "byte message of %s\n", msg_len, sd->stream_name);
+		rc = ENOMEM;
+		goto out;
 	}
+
+	uint64_t le = htole64(sd->offset);
+	blob_seg_append(&b->seg[BF_OFFSET], &le, sizeof(le));
 	if (debug)
 		msglog(LDMSD_LDEBUG, PNAME ": offset=%ld ...\n", sd->offset);
 
-	if (sd->timingfile) {
+	if (sd->fd[BF_TIMING] >= 0) {
 		struct timeval now;
 		gettimeofday(&now, NULL);
 		uint64_t tbuf[2];
 		tbuf[0] = htole64((uint64_t)now.tv_sec);
 		tbuf[1] = htole64((uint64_t)now.tv_usec);
-		rc = fwrite(tbuf, sizeof(uint64_t), 2, sd->timingfile);
-		if ( rc != 2) {
-			msglog(LDMSD_LERROR, PNAME ": error writing time to %s\n",
-				sd->timingfile_name);
-		}
+		blob_seg_append(&b->seg[BF_TIMING], tbuf, sizeof(tbuf));
 	}
 
-	if (sd->typefile) {
+	if (sd->fd[BF_TYPE] >= 0) {
 		char st = blob_stream_type_to_char(stream_type);
-		rc = fwrite(&st, 1, 1, sd->typefile);
-		if (rc != 1) {
-			int ferr = ferror(sd->typefile);
-			msglog(LDMSD_LERROR, PNAME ": short type write in %s: %s\n",
-				sd->typefile_name, STRERROR(ferr));
-		}
+		blob_seg_append(&b->seg[BF_TYPE], &st, 1);
 	}
-	rc = fwrite(msg, 1, msg_len, sd->streamfile);
-	sd->offset += rc;
-	if (rc != msg_len) {
-		int ferr = ferror(sd->streamfile);
-		msglog(LDMSD_LERROR, PNAME ": short write starting at %s:%ld: %s\n",
-			sd->streamfile_name, sd->offset, STRERROR(ferr));
+	if (direct) {
+		blob_dat_write(sd, b, msg, msg_len);
+	} else {
+		blob_seg_append(&b->seg[BF_DAT], msg, msg_len);
+		b->bytes += msg_len;
+	}
+	sd->offset += msg_len;
+	b->count++;
+	if (b->bytes >= flush_bytes && !b->kicked) {
+		b->kicked = 1;
+		writer_kick();
 	}
 	if (debug)
 		msglog(LDMSD_LDEBUG, PNAME ": msg=%.50s ...\n", msg);
 
 out:
 	pthread_mutex_unlock(&sd->write_lock);
+	if (direct)
+		pthread_mutex_unlock(&sd->flush_lock);
 	return rc;
 }
 
@@ -220,6 +560,7 @@ out:
 static stream_data_t stream_data_create(const char *stream)
 {
 	stream_data_t sd;
+	int i;
 	sd = calloc(1, sizeof(*sd));
 	if (!sd)
 		return NULL;
@@ -228,97 +569,56 @@ static stream_data_t stream_data_create(const char *stream)
 		free(sd);
 		return NULL;
 	}
+	for (i = 0; i < BF_COUNT; i++)
+		sd->fd[i] = -1;
 	pthread_mutex_init(&sd->write_lock, NULL);
+	pthread_mutex_init(&sd->flush_lock, NULL);
+	pthread_cond_init(&sd->flush_cv, NULL);
 	return sd;
 }
 
 static void stream_data_open(stream_data_t sd)
 {
-	if (!sd->streamfile_name || !sd->offsetfile_name) {
+	struct iovec iov;
+	int i, rc;
+
+	if (!sd->fname[BF_DAT] || !sd->fname[BF_OFFSET]) {
 		sd->ws = WS_ERR;
 		return;
 	}
 	time_t t = time(NULL);
-	size_t end = strlen(sd->offsetfile_name);
-	sprintf(sd->offsetfile_name + end, "%ld", (long)t);
-	end = strlen(sd->streamfile_name);
-	sprintf(sd->streamfile_name + end, "%ld", (long)t);
-
-	sd->offsetfile = fopen_perm(sd->offsetfile_name, "w", 0640);
-	sd->streamfile = fopen_perm(sd->streamfile_name, "w", 0640);
-	if (!sd->offsetfile || !sd->streamfile) {
-		msglog(LDMSD_LERROR, PNAME ": Error '%s' opening the files %s, %s.\n",
-		       STRERROR(errno), sd->offsetfile_name, sd->streamfile_name);
-		sd->ws = WS_ERR;
-		return;
-	}
-	if (sd->timingfile_name) {
-		end = strlen(sd->timingfile_name);
-		sprintf(sd->timingfile_name + end, "%ld", (long)t);
-		sd->timingfile = fopen_perm(sd->timingfile_name, "w", 0640);
-		if (!sd->timingfile) {
+	for (i = 0; i < BF_COUNT; i++) {
+		if (!sd->fname[i])
+			continue;
+		sprintf(sd->fname[i] + strlen(sd->fname[i]), "%ld", (long)t);
+		sd->fd[i] = open(sd->fname[i],
+				 O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+		if (sd->fd[i] < 0) {
 			msglog(LDMSD_LERROR, PNAME ": Error '%s' opening the file %s.\n",
-			       STRERROR(errno), sd->offsetfile_name, sd->timingfile_name);
+			       STRERROR(errno), sd->fname[i]);
 			sd->ws = WS_ERR;
 			return;
 		}
-	}
-	if (sd->typefile_name) {
-		end = strlen(sd->typefile_name);
-		sprintf(sd->typefile_name + end, "%ld", (long)t);
-		sd->typefile = fopen_perm(sd->typefile_name, "w", 0640);
-		if (!sd->typefile) {
-			msglog(LDMSD_LERROR, PNAME ": Error '%s' opening the file %s.\n",
-			       STRERROR(errno), sd->offsetfile_name, sd->typefile_name);
-			sd->ws = WS_ERR;
-			return;
-		}
-	}
-	sd->ws = WS_OPEN;
-	char magic[] = "bloboff";
-	int rc = fwrite(magic, strlen(magic)+1, 1, sd->offsetfile);
-	sd->offset += 8;
-	if (rc != 1) {
-		msglog(LDMSD_LERROR, PNAME ": Error '%s' writing to file %s.\n",
-		       STRERROR(errno), sd->offsetfile_name);
-		sd->ws = WS_ERR;
-		return;
-	}
-	char magic2[] = "blobdat";
-	rc = fwrite(magic2, strlen(magic2)+1, 1, sd->streamfile);
-	if (rc != 1) {
-		msglog(LDMSD_LERROR, PNAME ": Error '%s' writing to file %s.\n",
-		       STRERROR(errno), sd->streamfile_name);
-		sd->ws = WS_ERR;
-		return;
-	}
-	if (sd->timingfile) {
-		char magic3[] = "blobtim";
-		int rc = fwrite(magic3, strlen(magic3)+1, 1, sd->timingfile);
-		if (rc != 1) {
-			msglog(LDMSD_LERROR, PNAME ": Error '%s' writing to file %s.\n",
-			       STRERROR(errno), sd->timingfile_name);
-			sd->ws = WS_ERR;
-			return;
-		}
-	}
-	if (sd->typefile) {
-		char magic4[] = "blobtyp";
-		int rc = fwrite(magic4, strlen(magic4)+1, 1, sd->typefile);
-		if (rc != 1) {
+		iov.iov_base = (void *)blob_magic[i];
+		iov.iov_len = strlen(blob_magic[i]) + 1;
+		rc = writev_full(sd->fd[i], &iov, 1);
+		if (rc) {
 			msglog(LDMSD_LERROR, PNAME ": Error '%s' writing to file %s.\n",
-			       STRERROR(errno), sd->typefile_name);
+			       STRERROR(rc), sd->fname[i]);
 			sd->ws = WS_ERR;
 			return;
 		}
 	}
+	/* The first message follows the magic of the DAT file */
+	sd->offset = strlen(blob_magic[BF_DAT]) + 1;
+	sd->ws = WS_OPEN;
 }
 
-/* close f, free fname, and rename fname if spool=1 */
-static void fclose_and_spool(FILE* *f, char* *fname)
+/* close fd, free fname, and rename fname if spool=1 */
+static void close_and_spool(int *fd, char* *fname)
 {
-	fclose(*f);
-	*f = NULL;
+	close(*fd);
+	*fd = -1;
 	if (spool) {
 		int mode = 0750;
 		size_t n = strlen(*fname) + 20;
@@ -363,23 +663,31 @@ out:
 	*fname = NULL;
 }
 
+/*
+ * Write what is buffered and close the files. The flush_lock and
+ * write_lock must be held.
+ */
+static void stream_data_files_close(stream_data_t sd)
+{
+	int i;
+
+	blob_batch_write(sd, &sd->batch[sd->active], sd->fd);
+	pthread_cond_broadcast(&sd->flush_cv);
+	for (i = 0; i < BF_COUNT; i++) {
+		if (sd->fd[i] >= 0) {
+			close_and_spool(&sd->fd[i], &sd->fname[i]);
+		} else {
+			free(sd->fname[i]);
+			sd->fname[i] = NULL;
+		}
+	}
+}
 
 static void reset_paths(stream_data_t sd)
 {
 	if (!sd)
 		return;
-	if (sd->timingfile) {
-		fclose_and_spool(&sd->timingfile, &sd->timingfile_name);
-	}
-	if (sd->typefile) {
-		fclose_and_spool(&sd->typefile, &sd->typefile_name);
-	}
-	if (sd->streamfile) {
-		fclose_and_spool(&sd->streamfile, &sd->streamfile_name);
-	}
-	if (sd->offsetfile) {
-		fclose_and_spool(&sd->offsetfile, &sd->offsetfile_name);
-	}
+	stream_data_files_close(sd);
 	sd->ws = WS_NEW;
 }
 
@@ -405,47 +713,32 @@ static int set_paths(stream_data_t sd)
 		return rc;
 	}
 
-	if (timing) {
-		sd->timingfile_name = malloc(pathlen);
-		if (!sd->timingfile_name) {
-			sd->ws = WS_ERR;
-			return ENOMEM;
-		}
-		snprintf(sd->timingfile_name, pathlen, "%s/%s/%s.TIMING.", root_path,
-			container, sd->stream_name);
-	}
-
-	if (types) {
-		sd->typefile_name = malloc(pathlen);
-		if (!sd->typefile_name) {
+	int i;
+	for (i = 0; i < BF_COUNT; i++) {
+		if ((i == BF_TIMING && !timing) || (i == BF_TYPE && !types))
+			continue;
+		sd->fname[i] = malloc(pathlen);
+		if (!sd->fname[i]) {
 			sd->ws = WS_ERR;
 			return ENOMEM;
 		}
-		snprintf(sd->typefile_name, pathlen, "%s/%s/%s.TYPE.", root_path,
-			container, sd->stream_name);
+		snprintf(sd->fname[i], pathlen, "%s/%s/%s.%s.", root_path,
+			container, sd->stream_name, blob_suffix[i]);
 	}
-
-	sd->streamfile_name = malloc(pathlen);
-	if (!sd->streamfile_name) {
-		sd->ws = WS_ERR;
-		return ENOMEM;
-	}
-	snprintf(sd->streamfile_name, pathlen, "%s/%s/%s.DAT.", root_path,
-		container, sd->stream_name);
-
-	sd->offsetfile_name = malloc(pathlen);
-	if (!sd->offsetfile_name) {
-		sd->ws = WS_ERR;
-		return ENOMEM;
-	}
-	snprintf(sd->offsetfile_name, pathlen, "%s/%s/%s.OFFSET.", root_path,
-		container, sd->stream_name);
 	if (!sd->subscription) {
 		msglog(LDMSD_LDEBUG, PNAME ": subscribing to stream '%s'\n",
 			sd->stream_name);
 		sd->subscription = ldmsd_stream_subscribe(sd->stream_name,
 			stream_cb, sd);
 		/* stream dispatch to stream_cb now holds a reference to sd. */
+		/*
+		 * The messages are stored as received; don't parse them.
+		 * stream_cb() takes the locks of sd itself.
+		 */
+		if (sd->subscription)
+			ldmsd_stream_flags_set(sd->subscription,
+					       LDMSD_STREAM_F_RAW |
+					       LDMSD_STREAM_F_UNLOCKED);
 	}
 	return 0;
 }
@@ -557,9 +850,56 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct
 		goto out;
 	}
 
+	flush_bytes = BLOB_FLUSH_BYTES;
+	s = av_value(avl, "flush_bytes");
+	if (s) {
+		char *end;
+		long long v = strtoll(s, &end, 0);
+		if (*end != '\0' || v < 1) {
+			msglog(LDMSD_LERROR, PNAME ": flush_bytes=%s is not "
+				"a positive number.\n", s);
+			rc = EINVAL;
+			goto out;
+		}
+		flush_bytes = v;
+	}
+
+	flush_interval = BLOB_FLUSH_INTERVAL;
+	s = av_value(avl, "flush_interval");
+	if (s) {
+		char *end;
+		long v = strtol(s, &end, 0);
+		if (*end != '\0' || v < 1) {
+			msglog(LDMSD_LERROR, PNAME ": flush_interval=%s is not "
+				"a positive number of microseconds.\n", s);
+			rc = EINVAL;
+			goto out;
+		}
+		flush_interval = v;
+	}
+
+	sync_files = 0;
+	s = av_value(avl, "fsync");
+	if (s) {
+		sync_files = 1;
+	}
+
+	if (!writer_running) {
+		writer_stop = 0;
+		rc = pthread_create(&writer_thread, NULL, writer_proc, NULL);
+		if (rc) {
+			msglog(LDMSD_LERROR, PNAME ": error %d creating the "
+				"writer thread.\n", rc);
+			goto out;
+		}
+		pthread_setname_np(writer_thread, "blob_writer");
+		writer_running = 1;
+	}
+
 	stream_data_t sd = NULL;
 	LIST_FOREACH(sd, &data_list, entry) {
 		msglog(LDMSD_LINFO, PNAME ": config: %s\n", sd->stream_name);
+		pthread_mutex_lock(&sd->flush_lock);
 		pthread_mutex_lock(&sd->write_lock);
 		if (sd->ws == WS_REOPEN) {
 			reset_paths(sd);
@@ -572,6 +912,7 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct
 			}
 		}
 		pthread_mutex_unlock(&sd->write_lock);
+		pthread_mutex_unlock(&sd->flush_lock);
 	}
 
 out:
@@ -584,31 +925,46 @@ static void stream_data_close( stream_data_t sd )
 {
 	if (!sd)
 		return;
+	int i;
+	/*
+	 * ldmsd_stream_close() waits for the stream_cb() calls in progress,
+	 * so make them return before taking the locks for good.
+	 */
 	pthread_mutex_lock(&sd->write_lock);
-	if (sd->timingfile) {
-		fclose_and_spool(&sd->timingfile, &sd->timingfile_name);
-	}
-	if (sd->typefile) {
-		fclose_and_spool(&sd->typefile, &sd->typefile_name);
-	}
-	if (sd->streamfile) {
-		fclose_and_spool(&sd->streamfile, &sd->streamfile_name);
-	}
-	if (sd->offsetfile) {
-		fclose_and_spool(&sd->offsetfile, &sd->offsetfile_name);
-	}
-	free(sd->stream_name);
-	sd->stream_name = NULL;
-	ldmsd_stream_close(sd->subscription);
+	sd->ws = WS_CLOSED;
+	pthread_cond_broadcast(&sd->flush_cv);
+	pthread_mutex_unlock(&sd->write_lock);
+	if (sd->subscription)
+		ldmsd_stream_close(sd->subscription);
 	/* sd reference is no longer hiding inside cb handler */
 	sd->subscription = NULL;
-	sd->ws = WS_CLOSED;
+	pthread_mutex_lock(&sd->flush_lock);
+	pthread_mutex_lock(&sd->write_lock);
+	stream_data_files_close(sd);
+	free(sd->stream_name);
+	sd->stream_name = NULL;
+	for (i = 0; i < BF_COUNT; i++) {
+		blob_seg_free(&sd->batch[0].seg[i]);
+		blob_seg_free(&sd->batch[1].seg[i]);
+	}
 	pthread_mutex_unlock(&sd->write_lock);
+	pthread_mutex_unlock(&sd->flush_lock);
 	pthread_mutex_destroy(&sd->write_lock);
+	pthread_mutex_destroy(&sd->flush_lock);
+	pthread_cond_destroy(&sd->flush_cv);
 }
 
 static void term(struct ldmsd_plugin *self)
 {
+	/* The writer thread takes the cfg_lock to flush */
+	if (writer_running) {
+		pthread_mutex_lock(&writer_lock);
+		writer_stop = 1;
+		pthread_cond_signal(&writer_cv);
+		pthread_mutex_unlock(&writer_lock);
+		pthread_join(writer_thread, NULL);
+		writer_running = 0;
+	}
 	pthread_mutex_lock(&cfg_lock);
 	closing = 1;
 	stream_data_t sd = LIST_FIRST(&data_list);
@@ -631,6 +987,7 @@ static const char *usage(struct ldmsd_plugin *self)
 {
 	return  "    config name=blob_stream_writer path=<path> container=<container> stream=<stream> \n"
                 "           timing=1 types=1 debug=1 spool=1\n"
+		"           flush_bytes=<bytes> flush_interval=<usec> fsync=1\n"
 		"         - Set the root path for the storage of csvs and some default parameters\n"
 		"         - path       The path to the root of the csv directory\n"
 		"         - container  The directory under the path\n"
@@ -640,6 +997,11 @@ static const char *usage(struct ldmsd_plugin *self)
 		"         - types=1    Enabling TYPES output file\n"
 		"         - spool=1    Roll output to <path>/<container>/spool/\n"
 		"         - debug=1    Enabling certain debug statements.\n"
+		"         - flush_bytes=<bytes> Write buffered messages once this\n"
+		"                      many bytes are buffered (default 1048576).\n"
+		"         - flush_interval=<usec> Write buffered messages at least\n"
+		"                      this often (default 1000000).\n"
+		"         - fsync=1    fdatasync() the files after each write.\n"
 		;
 }
 
@@ -676,10 +1038,14 @@ static void __attribute__ ((constructor)) blob_stream_writer_init();
 static void blob_stream_writer_init()
 {
 	pthread_mutex_init(&cfg_lock, NULL);
+	pthread_mutex_init(&writer_lock, NULL);
+	pthread_cond_init(&writer_cv, NULL);
 }
 
 static void __attribute__ ((destructor)) blob_stream_writer_fini(void);
 static void blob_stream_writer_fini()
 {
 	pthread_mutex_destroy(&cfg_lock);
+	pthread_mutex_destroy(&writer_lock);
+	pthread_cond_destroy(&writer_cv);
 }
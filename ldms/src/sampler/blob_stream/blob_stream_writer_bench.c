@@ -0,0 +1,367 @@
+/*
+ * The writer is static, so the bench is built from the plugin source.
+ */
+#include "blob_stream_writer.c"
+
+#include <getopt.h>
+#include <glob.h>
+#include <time.h>
+
+/*
+ * Blob stream writer throughput
+ *
+ * For each message size, N messages are delivered through
+ * ldmsd_stream_deliver() to the plugin and to a reference writer that
+ * makes the four fwrite() calls per message the plugin used to make. N is
+ * capped so a run writes at most -b bytes. A run ends when the files are
+ * closed, so the rates include the last flush. The DAT, OFFSET and TYPE files of both
+ * writers must be identical; the TIMING files hold wall clock times and
+ * are only checked for length.
+ */
+
+#define STREAM "bench"
+#define REF_STREAM "bench.ref"
+
+static long max_msgs = 100000;
+static long max_bytes = 256 * 1024 * 1024;
+static long nmsgs;
+static char *dir = "/tmp";
+static char *extra = "";
+static char *msg;
+static size_t msg_len;
+
+/* provided by ldmsd to the plugins it loads */
+void ldmsd_log(enum ldmsd_loglevel level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (level < LDMSD_LWARNING)
+		return;
+	printf("# ");
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+enum ldmsd_loglevel ldmsd_loglevel_get()
+{
+	return LDMSD_LWARNING;
+}
+
+static void bench_log(enum ldmsd_loglevel level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (level < LDMSD_LWARNING)
+		return;
+	printf("# ");
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void msg_build(size_t size)
+{
+	size_t hdr;
+	free(msg);
+	msg = malloc(size + 64);
+	if (!msg) {
+		perror("malloc");
+		exit(1);
+	}
+	hdr = sprintf(msg, "{\"seq\":1,\"data\":\"");
+	if (size > hdr + 2) {
+		memset(msg + hdr, 'x', size - hdr - 2);
+		hdr = size - 2;
+	}
+	msg_len = hdr + sprintf(msg + hdr, "\"}") + 1;
+}
+
+/* ---- reference writer ---- */
+
+struct ref_writer {
+	pthread_mutex_t lock;
+	FILE *file[BF_COUNT];
+	long offset;
+};
+
+static int ref_open(struct ref_writer *w, const char *cont)
+{
+	char path[PATH_MAX];
+	int i;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, cont);
+	if (f_mkdir_p(path, 0750) && errno != EEXIST)
+		return errno;
+	pthread_mutex_init(&w->lock, NULL);
+	for (i = 0; i < BF_COUNT; i++) {
+		snprintf(path, sizeof(path), "%s/%s/%s.%s.0", dir, cont,
+			 STREAM, blob_suffix[i]);
+		w->file[i] = fopen(path, "w");
+		if (!w->file[i])
+			return errno;
+		fwrite(blob_magic[i], strlen(blob_magic[i]) + 1, 1, w->file[i]);
+	}
+	w->offset = 8;
+	return 0;
+}
+
+static int ref_write(ldmsd_stream_client_t c, void *ctxt,
+		     ldmsd_stream_type_t type, const char *data, size_t len,
+		     json_entity_t e)
+{
+	struct ref_writer *w = ctxt;
+	struct timeval tv;
+	uint64_t le, tbuf[2];
+	char st;
+
+	pthread_mutex_lock(&w->lock);
+	le = htole64(w->offset);
+	fwrite(&le, sizeof(le), 1, w->file[BF_OFFSET]);
+	gettimeofday(&tv, NULL);
+	tbuf[0] = htole64((uint64_t)tv.tv_sec);
+	tbuf[1] = htole64((uint64_t)tv.tv_usec);
+	fwrite(tbuf, sizeof(tbuf), 1, w->file[BF_TIMING]);
+	st = blob_stream_type_to_char(type);
+	fwrite(&st, 1, 1, w->file[BF_TYPE]);
+	fwrite(data, len, 1, w->file[BF_DAT]);
+	w->offset += len;
+	pthread_mutex_unlock(&w->lock);
+	return 0;
+}
+
+static void ref_close(struct ref_writer *w)
+{
+	int i;
+	for (i = 0; i < BF_COUNT; i++)
+		fclose(w->file[i]);
+	pthread_mutex_destroy(&w->lock);
+}
+
+/* ---- plugin ---- */
+
+static int plugin_open(const char *cont)
+{
+	struct attr_value_list *kwl, *avl;
+	struct ldmsd_plugin *pi;
+	char cfg[PATH_MAX + 512];
+	int rc;
+
+	closing = 0;
+	pi = get_plugin(bench_log);
+	kwl = av_new(64);
+	avl = av_new(64);
+	snprintf(cfg, sizeof(cfg), "path=%s container=%s stream=%s "
+		 "timing=1 types=1 %s", dir, cont, STREAM, extra);
+	if (!kwl || !avl || tokenize(cfg, kwl, avl)) {
+		rc = ENOMEM;
+		goto out;
+	}
+	rc = pi->config(pi, kwl, avl);
+	if (rc)
+		printf("Bad plugin configuration '%s'\n", cfg);
+out:
+	av_free(kwl);
+	av_free(avl);
+	return rc;
+}
+
+static void plugin_close(void)
+{
+	blob_stream_writer.base.term(&blob_stream_writer.base);
+}
+
+/* ---- checks ---- */
+
+static char *plugin_file(const char *cont, int i)
+{
+	char pat[PATH_MAX];
+	glob_t g;
+	char *f = NULL;
+
+	snprintf(pat, sizeof(pat), "%s/%s/%s.%s.*", dir, cont, STREAM,
+		 blob_suffix[i]);
+	if (glob(pat, 0, NULL, &g))
+		return NULL;
+	if (g.gl_pathc == 1)
+		f = strdup(g.gl_pathv[0]);
+	globfree(&g);
+	return f;
+}
+
+static char *file_read(const char *path, size_t *len)
+{
+	FILE *f = fopen(path, "r");
+	char *buf;
+	long n;
+
+	if (!f)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	n = ftell(f);
+	rewind(f);
+	buf = malloc(n + 1);
+	if (buf && fread(buf, 1, n, f) != (size_t)n) {
+		free(buf);
+		buf = NULL;
+	}
+	fclose(f);
+	*len = n;
+	return buf;
+}
+
+static int compare(const char *pcont, const char *rcont)
+{
+	char rpath[PATH_MAX];
+	char *ppath, *pbuf, *rbuf;
+	size_t plen, rlen;
+	int i, rc = 0;
+
+	for (i = 0; i < BF_COUNT; i++) {
+		ppath = plugin_file(pcont, i);
+		snprintf(rpath, sizeof(rpath), "%s/%s/%s.%s.0", dir, rcont,
+			 STREAM, blob_suffix[i]);
+		pbuf = ppath ? file_read(ppath, &plen) : NULL;
+		rbuf = file_read(rpath, &rlen);
+		if (!pbuf || !rbuf) {
+			printf("%s: cannot read the %s files\n",
+			       blob_suffix[i], pbuf ? "reference" : "plugin");
+			rc = 1;
+		} else if (plen != rlen) {
+			printf("%s: %zu bytes, expected %zu\n",
+			       blob_suffix[i], plen, rlen);
+			rc = 1;
+		} else if (i != BF_TIMING && memcmp(pbuf, rbuf, plen)) {
+			printf("%s: files differ\n", blob_suffix[i]);
+			rc = 1;
+		}
+		if (ppath)
+			unlink(ppath);
+		unlink(rpath);
+		free(ppath);
+		free(pbuf);
+		free(rbuf);
+	}
+	snprintf(rpath, sizeof(rpath), "%s/%s", dir, pcont);
+	rmdir(rpath);
+	snprintf(rpath, sizeof(rpath), "%s/%s", dir, rcont);
+	rmdir(rpath);
+	return rc;
+}
+
+static void report(const char *name, double sec)
+{
+	printf("%8zu %-10s %12.0f msg/s %10.1f MB/s\n", msg_len, name,
+	       nmsgs / sec, nmsgs * msg_len / sec / 1e6);
+}
+
+static int run(void)
+{
+	struct ref_writer ref;
+	ldmsd_stream_client_t c;
+	char pcont[64], rcont[64];
+	double t0;
+	long i;
+	int rc;
+
+	snprintf(pcont, sizeof(pcont), "blobbench.%d.%zu", getpid(), msg_len);
+	snprintf(rcont, sizeof(rcont), "blobbench.%d.%zu.ref", getpid(), msg_len);
+
+	t0 = now();
+	rc = ref_open(&ref, rcont);
+	if (rc) {
+		printf("Error %d opening the reference files\n", rc);
+		return rc;
+	}
+	c = ldmsd_stream_subscribe(REF_STREAM, ref_write, &ref);
+	if (!c) {
+		printf("Error %d subscribing to %s\n", errno, REF_STREAM);
+		return ENOMEM;
+	}
+	ldmsd_stream_flags_set(c, LDMSD_STREAM_F_RAW);
+	for (i = 0; i < nmsgs; i++)
+		ldmsd_stream_deliver(REF_STREAM, LDMSD_STREAM_STRING,
+				     msg, msg_len, NULL, NULL);
+	ldmsd_stream_close(c);
+	ref_close(&ref);
+	report("reference", now() - t0);
+
+	t0 = now();
+	rc = plugin_open(pcont);
+	if (rc)
+		return rc;
+	for (i = 0; i < nmsgs; i++)
+		ldmsd_stream_deliver(STREAM, LDMSD_STREAM_STRING,
+				     msg, msg_len, NULL, NULL);
+	plugin_close();
+	report("plugin", now() - t0);
+
+	return compare(pcont, rcont);
+}
+
+static void bench_usage(const char *prog)
+{
+	printf("Usage: %s [-n messages] [-b bytes] [-s size,size,...] "
+	       "[-D dir] [-c 'plugin options']\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	char *sizes = strdup("64,1024,16384,262144");
+	char *s, *ptr;
+	int opt, rc = 0;
+
+	while ((opt = getopt(argc, argv, "n:b:s:D:c:")) != -1) {
+		switch (opt) {
+		case 'n':
+			max_msgs = atol(optarg);
+			break;
+		case 'b':
+			max_bytes = atol(optarg);
+			break;
+		case 's':
+			free(sizes);
+			sizes = strdup(optarg);
+			break;
+		case 'D':
+			dir = optarg;
+			break;
+		case 'c':
+			extra = optarg;
+			break;
+		default:
+			bench_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (max_msgs < 1 || max_bytes < 1) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	printf("%8s %-10s %18s %15s\n", "bytes", "writer", "messages",
+	       "bandwidth");
+	for (s = strtok_r(sizes, ",", &ptr); s; s = strtok_r(NULL, ",", &ptr)) {
+		msg_build(strtoul(s, NULL, 0));
+		nmsgs = max_bytes / msg_len;
+		if (nmsgs > max_msgs)
+			nmsgs = max_msgs;
+		if (nmsgs < 1)
+			nmsgs = 1;
+		rc = run();
+		if (rc)
+			break;
+	}
+	free(sizes);
+	free(msg);
+	if (rc)
+		printf("FAILED\n");
+	return rc ? 1 : 0;
+}
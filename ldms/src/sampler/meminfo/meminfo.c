@@ -64,28 +64,25 @@
 #include "ldms.h"
 #include "ldmsd.h"
 #include "sampler_base.h"
+#include "sampler_procfs.h"
 
 #define PROC_FILE "/proc/meminfo"
 
 static char *procfile = PROC_FILE;
 static ldms_set_t set = NULL;
-static FILE *mf = 0;
+static procfs_file_t mf;
+static procfs_kv_map_t kvmap;
+static int layout_warned;
 static ldmsd_msg_log_f msglog;
 #define SAMP "meminfo"
-static int metric_offset;
 static base_data_t base;
 
-#define LBUFSZ 256
 static int create_metric_set(base_data_t base)
 {
 	ldms_schema_t schema;
-	int rc, i;
-	uint64_t metric_value;
-	char *s;
-	char lbuf[LBUFSZ];
-	char metric_name[LBUFSZ];
+	int rc;
 
-	mf = fopen(procfile, "r");
+	mf = procfs_file_open(procfile);
 	if (!mf) {
 		msglog(LDMSD_LERROR, "Could not open the " SAMP " file "
 				"'%s'...exiting sampler\n", procfile);
@@ -101,34 +98,14 @@ static int create_metric_set(base_data_t base)
 		goto err;
 	}
 
-	/* Location of first metric from proc/meminfo file */
-	metric_offset = ldms_schema_metric_count_get(schema);
-
 	/*
 	 * Process the file to define all the metrics.
 	 */
-	fseek(mf, 0, SEEK_SET);
-	do {
-		s = fgets(lbuf, sizeof(lbuf), mf);
-		if (!s)
-			break;
-
-		rc = sscanf(lbuf, "%s %" PRIu64,
-			    metric_name, &metric_value);
-		if (rc < 2)
-			break;
-
-		/* Strip the colon from metric name if present */
-		i = strlen(metric_name);
-		if (i && metric_name[i-1] == ':')
-			metric_name[i-1] = '\0';
-
-		rc = ldms_schema_metric_add(schema, metric_name, LDMS_V_U64);
-		if (rc < 0) {
-			rc = ENOMEM;
-			goto err;
-		}
-	} while (s);
+	kvmap = procfs_kv_map_new(mf, schema);
+	if (!kvmap) {
+		rc = errno;
+		goto err;
+	}
 
 	set = base_set_new(base);
 	if (!set) {
@@ -139,8 +116,9 @@ static int create_metric_set(base_data_t base)
 	return 0;
 
  err:
-	if (mf)
-		fclose(mf);
+	procfs_kv_map_free(kvmap);
+	kvmap = NULL;
+	procfs_file_close(mf);
 	mf = NULL;
 	return rc;
 }
@@ -211,11 +189,6 @@ static ldms_set_t get_set(struct ldmsd_sampler *self)
 static int sample(struct ldmsd_sampler *self)
 {
 	int rc;
-	int metric_no;
-	char *s;
-	char lbuf[256];
-	char metric_name[LBUFSZ];
-	union ldms_value v;
 
 	if (!set) {
 		msglog(LDMSD_LDEBUG, SAMP ": plugin not initialized\n");
@@ -223,30 +196,25 @@ static int sample(struct ldmsd_sampler *self)
 	}
 
 	base_sample_begin(base);
-	metric_no = metric_offset;
-	fseek(mf, 0, SEEK_SET);
-	do {
-		s = fgets(lbuf, sizeof(lbuf), mf);
-		if (!s)
-			break;
-		rc = sscanf(lbuf, "%s %"PRIu64, metric_name, &v.v_u64);
-		if (rc != 2 && rc != 3) {
-			rc = EINVAL;
-			goto out;
-		}
-
-		ldms_metric_set(set, metric_no, &v);
-		metric_no++;
-	} while (s);
- out:
+	rc = procfs_kv_map_sample(kvmap, mf, set);
+	if (rc) {
+		msglog(LDMSD_LERROR, SAMP ": error %d reading '%s'\n",
+		       rc, procfile);
+	} else if (kvmap->layout_changed && !layout_warned) {
+		msglog(LDMSD_LWARNING, SAMP ": the layout of '%s' changed "
+		       "since config, %d unknown lines ignored.\n",
+		       procfile, kvmap->unmatched);
+		layout_warned = 1;
+	}
 	base_sample_end(base);
-	return 0;
+	return rc;
 }
 
 static void term(struct ldmsd_plugin *self)
 {
-	if (mf)
-		fclose(mf);
+	procfs_kv_map_free(kvmap);
+	kvmap = NULL;
+	procfs_file_close(mf);
 	mf = NULL;
 	if (base)
 		base_del(base);
@@ -929,10 +929,14 @@ struct slps_send_result slps_send_event(struct slps *l, jbuf_t jb)
 					EPOCH_STRING, l->stream, __func__,
 					__LINE__, jb->buf);
 			}
-			target->last_publish_rc = ldmsd_stream_publish(
+			target->last_publish_rc = ldmsd_stream_try_publish(
 				target->ldms, l->stream, LDMSD_STREAM_JSON,
 				jb->buf, jb->cursor + 1);
-			if (target->last_publish_rc) {
+			if (target->last_publish_rc == EAGAIN) {
+				/* The daemon is behind, drop the event */
+				DEBUGL(LDBG, "Dropped json to %s:%s\n",
+					target->host, target->port);
+			} else if (target->last_publish_rc) {
 				if (l->send_log_f)
 					fprintf(l->send_log_f, "%s: Fail %d "
 						"publishing json to %s:%s\n",
@@ -0,0 +1,259 @@
+/**
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file procfs_sample_bench.c
+ * \brief Compare the stdio and the sampler_procfs paths on procfs files.
+ *
+ * For each file the "stdio" path is what the samplers used to do
+ * (fseek + fgets + sscanf per line) and the "procfs" path is a pread() of
+ * the whole file followed by the sampler_procfs scanners. /proc/meminfo and
+ * /proc/vmstat go into a real metric set through a procfs_kv_map.
+ *
+ * Usage: procfs_sample_bench [-n ITERATIONS]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include "ldms.h"
+#include "sampler_procfs.h"
+
+#define MAX_VALS 4096
+
+static uint64_t vals[MAX_VALS];
+static char lbuf[65536];
+
+static double ts_diff(struct timespec *a, struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+/* "key: value" lines into the set, the way meminfo/vmstat used to. */
+static int stdio_kv(FILE *f, ldms_set_t set)
+{
+	char key[128];
+	uint64_t v;
+	int i = 0;
+
+	fseek(f, 0, SEEK_SET);
+	while (fgets(lbuf, sizeof(lbuf), f)) {
+		if (2 != sscanf(lbuf, "%127s %" PRIu64, key, &v))
+			return EINVAL;
+		ldms_metric_set_u64(set, i++, v);
+	}
+	return 0;
+}
+
+/* Every number on every line after the header lines. */
+static int stdio_table(FILE *f, int skip)
+{
+	char *s;
+	int n, i = 0;
+
+	fseek(f, 0, SEEK_SET);
+	while (fgets(lbuf, sizeof(lbuf), f)) {
+		if (skip) {
+			skip--;
+			continue;
+		}
+		s = strchr(lbuf, ':');
+		if (s)
+			*s = ' ';
+		s = lbuf;
+		while (*s == ' ')
+			s++;
+		while (*s && *s != ' ')
+			s++; /* row name */
+		while (i < MAX_VALS && 1 == sscanf(s, "%" SCNu64 "%n",
+						  &vals[i], &n)) {
+			s += n;
+			i++;
+		}
+	}
+	return i;
+}
+
+static int procfs_table(procfs_file_t f, int skip)
+{
+	const char *p, *q, *w;
+	size_t len;
+	int i = 0;
+
+	if (procfs_file_read(f))
+		return -1;
+	for (p = f->buf; *p; p = procfs_next_line(p)) {
+		if (skip) {
+			skip--;
+			continue;
+		}
+		q = procfs_scan_word(p, ':', &w, &len);
+		while (q && i < MAX_VALS && (q = procfs_scan_u64(q, &vals[i])))
+			i++;
+	}
+	return i;
+}
+
+static void report(const char *path, const char *what, int n,
+		   struct timespec *w0, struct timespec *w1,
+		   struct timespec *c0, struct timespec *c1)
+{
+	double wall = ts_diff(w0, w1);
+	double cpu = ts_diff(c0, c1);
+	printf("%-16s %-7s %12.0f samples/s %10.0f ns cpu/sample\n",
+	       path, what, n / (wall / 1e9), cpu / n);
+}
+
+#define TIMED(_path, _what, _n, _stmt) do { \
+	struct timespec w0, w1, c0, c1; \
+	int _i; \
+	clock_gettime(CLOCK_MONOTONIC, &w0); \
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c0); \
+	for (_i = 0; _i < (_n); _i++) { \
+		_stmt; \
+	} \
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c1); \
+	clock_gettime(CLOCK_MONOTONIC, &w1); \
+	report(_path, _what, _n, &w0, &w1, &c0, &c1); \
+} while (0)
+
+static int bench_kv(const char *path, int n)
+{
+	procfs_file_t pf;
+	procfs_kv_map_t m;
+	ldms_schema_t schema;
+	ldms_set_t set;
+	FILE *f;
+	char name[128];
+
+	pf = procfs_file_open(path);
+	f = fopen(path, "r");
+	if (!pf || !f) {
+		perror(path);
+		return errno;
+	}
+	schema = ldms_schema_new(path);
+	m = schema ? procfs_kv_map_new(pf, schema) : NULL;
+	if (!m) {
+		fprintf(stderr, "%s: cannot build the key map\n", path);
+		return ENOMEM;
+	}
+	snprintf(name, sizeof(name), "bench%s", path);
+	set = ldms_set_new(name, schema);
+	if (!set) {
+		perror("ldms_set_new");
+		return errno;
+	}
+
+	TIMED(path, "stdio", n,
+		ldms_transaction_begin(set);
+		stdio_kv(f, set);
+		ldms_transaction_end(set));
+	TIMED(path, "procfs", n,
+		ldms_transaction_begin(set);
+		procfs_kv_map_sample(m, pf, set);
+		ldms_transaction_end(set));
+
+	ldms_set_delete(set);
+	ldms_schema_delete(schema);
+	procfs_kv_map_free(m);
+	procfs_file_close(pf);
+	fclose(f);
+	return 0;
+}
+
+static int bench_table(const char *path, int skip, int n)
+{
+	procfs_file_t pf;
+	FILE *f;
+
+	pf = procfs_file_open(path);
+	f = fopen(path, "r");
+	if (!pf || !f) {
+		perror(path);
+		return errno;
+	}
+	if (stdio_table(f, skip) != procfs_table(pf, skip))
+		printf("%s: the two paths disagree on the value count\n", path);
+	TIMED(path, "stdio", n, stdio_table(f, skip));
+	TIMED(path, "procfs", n, procfs_table(pf, skip));
+	procfs_file_close(pf);
+	fclose(f);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int n = 20000;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n':
+			n = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n ITERATIONS]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (n <= 0)
+		n = 1;
+	if (ldms_init(16*1024*1024)) {
+		fprintf(stderr, "ldms_init failed\n");
+		return 1;
+	}
+	bench_kv("/proc/meminfo", n);
+	bench_kv("/proc/vmstat", n);
+	bench_table("/proc/stat", 0, n);
+	bench_table("/proc/net/dev", 2, n);
+	return 0;
+}
@@ -67,6 +67,7 @@
 #include "ldms.h"
 #include "ldmsd.h"
 #include "../sampler_base.h"
+#include "../sampler_procfs.h"
 
 #ifndef ARRAY_LEN
 #define ARRAY_LEN(a) (sizeof(a) / sizeof(*a))
@@ -128,7 +129,7 @@ static int niface = 0;
 static char iface[MAXIFACE][20];
 
 #define SAMP "procnetdev2"
-static FILE *mf = NULL;
+static procfs_file_t mf = NULL;
 static ldmsd_msg_log_f msglog;
 static base_data_t base;
 
@@ -146,7 +147,7 @@ static int create_metric_set(base_data_t base)
 	size_t heap_sz;
 	int rc;
 
-	mf = fopen(procfile, "r");
+	mf = procfs_file_open(procfile);
 	if (!mf) {
 		msglog(LDMSD_LERROR, "Could not open " SAMP " file "
 				"'%s'...exiting\n",
@@ -200,8 +201,7 @@ err2:
         base_schema_delete(base);
         base = NULL;
 err1:
-	if (mf)
-		fclose(mf);
+	procfs_file_close(mf);
 	mf = NULL;
 
 	return rc;
@@ -312,9 +312,8 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct
 static int sample(struct ldmsd_sampler *self)
 {
 	int rc;
-	char *s;
-	char lbuf[256];
-	char curriface[IFNAMSIZ];
+	const char *p, *q, *curriface;
+	size_t curriface_len;
 	union ldms_value v[REC_METRICS_LEN];
 	int i;
 	ldms_mval_t lh, rec_inst, name_mval;
@@ -326,7 +325,7 @@ static int sample(struct ldmsd_sampler *self)
 	}
 
 	if (!mf)
-		mf = fopen(procfile, "r");
+		mf = procfs_file_open(procfile);
 	if (!mf) {
 		msglog(LDMSD_LERROR, SAMP ": Could not open /proc/net/dev file "
 				"'%s'...exiting\n", procfile);
@@ -340,41 +339,31 @@ begin:
 	/* reset device data */
 	ldms_list_purge(base->set, lh);
 
-	fseek(mf, 0, SEEK_SET); //seek should work if get to EOF
-	s = fgets(lbuf, sizeof(lbuf), mf);
-	s = fgets(lbuf, sizeof(lbuf), mf);
+	rc = procfs_file_read(mf);
+	if (rc) {
+		base_sample_end(base);
+		return rc;
+	}
+	/* skip the two header lines */
+	p = procfs_next_line(procfs_next_line(mf->buf));
 
 	/* data */
-	do {
-		s = fgets(lbuf, sizeof(lbuf), mf);
-		if (!s)
-			break;
-
-		char *pch = strchr(lbuf, ':');
-		if (pch != NULL){
-			*pch = ' ';
-		}
-
-		int rc = sscanf(lbuf, "%s %" PRIu64 " %" PRIu64 " %" PRIu64
-				" %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
-				" %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
-				" %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
-				" %" PRIu64 "\n", curriface, &v[1].v_u64,
-				&v[2].v_u64, &v[3].v_u64, &v[4].v_u64,
-				&v[5].v_u64, &v[6].v_u64, &v[7].v_u64,
-				&v[8].v_u64, &v[9].v_u64, &v[10].v_u64,
-				&v[11].v_u64, &v[12].v_u64, &v[13].v_u64,
-				&v[14].v_u64, &v[15].v_u64, &v[16].v_u64);
-		if (rc != 17){
+	for (; *p; p = procfs_next_line(p)) {
+		q = procfs_scan_word(p, ':', &curriface, &curriface_len);
+		for (i = 1; q && i < REC_METRICS_LEN; i++)
+			q = procfs_scan_u64(q, &v[i].v_u64);
+		if (!q) {
 			msglog(LDMSD_LINFO, SAMP ": wrong number of "
-					"fields in sscanf\n");
+					"fields in line\n");
 			continue;
 		}
 
 		if (niface) {
 			/* ifaces list was given in config */
 			for (i = 0; i < niface; i++) {
-				if (strcmp(curriface, iface[i]) == 0)
+				if (curriface_len < sizeof(iface[i])
+				    && iface[i][curriface_len] == '\0'
+				    && strncmp(curriface, iface[i], curriface_len) == 0)
 					goto rec;
 			}
 			/* not in the ifaces list */
@@ -386,13 +375,14 @@ begin:
 			goto resize;
 		/* iface name */
 		name_mval = ldms_record_metric_get(rec_inst, rec_metric_ids[0]);
-		snprintf(name_mval->a_char, IFNAMSIZ, "%s", curriface);
+		snprintf(name_mval->a_char, IFNAMSIZ, "%.*s",
+			 (int)curriface_len, curriface);
 		/* metrics */
 		for (i = 1; i < REC_METRICS_LEN; i++) {
 			ldms_record_set_u64(rec_inst, rec_metric_ids[i], v[i].v_u64);
 		}
 		ldms_list_append_record(base->set, lh, rec_inst);
-	} while (s);
+	}
 
 	base_sample_end(base);
 	return 0;
@@ -416,8 +406,7 @@ resize:
 
 static void term(struct ldmsd_plugin *self)
 {
-	if (mf)
-		fclose(mf);
+	procfs_file_close(mf);
 	mf = NULL;
 	base_set_delete(base);
 	base_del(base);
@@ -126,6 +126,7 @@
 #include "ldms.h"
 #include "ldmsd.h"
 #include "../sampler_base.h"
+#include "../sampler_procfs.h"
 #define PROC_FILE "/proc/stat"
 
 static char *procfile = PROC_FILE;
@@ -134,7 +135,7 @@ static int collect_softirq = 0;
 static ldms_set_t set = NULL;
 static ldms_set_t intr_set = NULL;
 static ldms_set_t softirq_set = NULL;
-static FILE *mf = 0;
+static procfs_file_t mf;
 static ldmsd_msg_log_f msglog;
 #define SAMP "procstat2"
 static int metric_offset;
@@ -192,17 +193,13 @@ enum stat_row {
 
 static int intr_max = -1; /* determine from current intr */
 
-/* big lbuf for (potentially) big "intr" line */
-#define LBUFSZ 65536
-static char lbuf[LBUFSZ];
-
 static int create_metric_sets()
 {
 	ldms_schema_t core_schema = NULL;
 	ldms_schema_t intr_schema = NULL;
 	ldms_schema_t softirq_schema = NULL;
 	int rc;
-	char *s;
+	const char *s;
 	ldms_record_t rec_def;
 	int n_cpu;
 	size_t sz;
@@ -213,7 +210,7 @@ static int create_metric_sets()
 	if (!rec_def)
 		return errno;
 
-	mf = fopen(procfile, "r");
+	mf = procfs_file_open(procfile);
 	if (!mf) {
 		msglog(LDMSD_LERROR, "Could not open the " SAMP " file "
 				"'%s'...exiting sampler\n", procfile);
@@ -257,21 +254,20 @@ static int create_metric_sets()
 	n_cpu = 0;
 	nr_irqs = 0;
 	nr_softirqs = 0;
-	fseek(mf, 0, SEEK_SET);
-	do {
-		s = fgets(lbuf, sizeof(lbuf), mf);
-		if (!s)
-			break;
+	rc = procfs_file_read(mf);
+	if (rc)
+		goto err;
+	for (s = mf->buf; *s; s = procfs_next_line(s)) {
 		if (0 == strncmp(s, "cpu", 3)) {
 			n_cpu++;
 		} else if (0 == strncmp(s, "intr", 4)) {
-			for (; *s; s++)
+			for (; *s && *s != '\n'; s++)
 				nr_irqs += (*s == ' ');
 		} else if (0 == strncmp(s, "softirq", 7)) {
-			for (; *s; s++)
+			for (; *s && *s != '\n'; s++)
 				nr_softirqs += (*s == ' ');
 		}
-	} while (s);
+	}
 
 	if (intr_max < 0) {
 		intr_max = nr_irqs;
@@ -325,8 +321,7 @@ static int create_metric_sets()
 	return 0;
 
  err:
-	if (mf)
-		fclose(mf);
+	procfs_file_close(mf);
 	if (rec_def) {
 		ldms_record_delete(rec_def);
 		rec_def = NULL;
@@ -511,7 +506,8 @@ static ldms_set_t __resize_set(base_data_t b, size_t incr)
 static int sample(struct ldmsd_sampler *self)
 {
 	int i, rc;
-	char tok[128];
+	const char *p, *q, *tok;
+	size_t tok_len;
 	int n;
 	struct stat_row_ent *ent;
 	uint64_t u64, data[16];
@@ -533,13 +529,19 @@ begin:
 	cpu_list = ldms_metric_get(set, sch_metric_ids[STAT_CPU]);
 	assert(cpu_list >= 0);
 	cpu_rec = ldms_list_first(set, cpu_list, NULL, NULL);
-	fseek(mf, 0, SEEK_SET);
-	while (1 == fscanf(mf, "%s", tok)) {
+	rc = procfs_file_read(mf);
+	if (rc)
+		goto out;
+	for (p = mf->buf; *p; p = procfs_next_line(p)) {
+		q = procfs_scan_word(p, '\0', &tok, &tok_len);
+		if (!q)
+			continue;
 		ent = bsearch(tok, stat_row_ents, ARRAY_LEN(stat_row_ents),
 				sizeof(stat_row_ents[0]), stat_row_cmp);
 		if (!ent) {
 			rc = ENOENT;
-			msglog(LDMSD_LDEBUG, SAMP ": unknown key: %s\n", tok);
+			msglog(LDMSD_LDEBUG, SAMP ": unknown key: %.*s\n",
+			       (int)tok_len, tok);
 			goto out;
 		}
 		switch (ent->type) {
@@ -556,20 +558,17 @@ begin:
 				}
 				ldms_list_append_record(set, cpu_list, cpu_rec);
 			}
-			n = fscanf(mf,  " %"PRIu64 " %"PRIu64 " %"PRIu64
-					" %"PRIu64 " %"PRIu64 " %"PRIu64
-					" %"PRIu64 " %"PRIu64 " %"PRIu64
-					" %"PRIu64,
-				&data[0], &data[1], &data[2], &data[3],
-				&data[4], &data[5], &data[6], &data[7],
-				&data[8], &data[9]);
-			if (n != 10) {
-				rc = EINVAL;
-				goto out;
+			for (n = 0; n < 10; n++) {
+				q = procfs_scan_u64(q, &data[n]);
+				if (!q) {
+					rc = EINVAL;
+					goto out;
+				}
 			}
 			/* cpu name */
 			mval = ldms_record_metric_get(cpu_rec, cpu_metric_ids[0]);
-			snprintf(mval->a_char, 8, "%.7s", tok);
+			snprintf(mval->a_char, 8, "%.*s",
+				 (int)(tok_len < 7 ? tok_len : 7), tok);
 			/* cpu stats */
 			for (i = 0; i < 10; i++) {
 				ldms_record_set_u64(cpu_rec, cpu_metric_ids[i+1], data[i]);
@@ -579,15 +578,12 @@ begin:
 		case STAT_INTR:
 			/* interrupt set */
 			if (!collect_intr) {
-				/* Read the whole interrupt line */
-				while (1 == fscanf(mf, "%"PRIu64, &u64))
-					continue;
 				/* do nothing */
 				break;
 			}
 			lh = ldms_metric_get(intr_set, metric_offset);
 			mval = ldms_list_first(intr_set, lh, NULL, NULL);
-			while (1 == fscanf(mf, "%"PRIu64, &u64)) {
+			while ((q = procfs_scan_u64(q, &u64))) {
 				if (!mval) {
 					mval = ldms_list_append_item(intr_set, lh, LDMS_V_U64, 1);
 					if (!mval) {
@@ -612,18 +608,16 @@ begin:
 			break;
 		case STAT_SOFTIRQ:
 			/* soft interrupt set */
-			/* Read the whole soft interrupt line. */
-			n = fscanf(mf,  " %"PRIu64 " %"PRIu64 " %"PRIu64
-					" %"PRIu64 " %"PRIu64 " %"PRIu64
-					" %"PRIu64 " %"PRIu64 " %"PRIu64
-					" %"PRIu64 " %"PRIu64,
-				&data[0], &data[1], &data[2], &data[3],
-				&data[4], &data[5], &data[6], &data[7],
-				&data[8], &data[9], &data[10]);
 			if (!collect_softirq) {
 				/* Do nothing */
 				break;
 			}
+			/* Read the whole soft interrupt line. */
+			for (n = 0; n < 11; n++) {
+				q = procfs_scan_u64(q, &data[n]);
+				if (!q)
+					break;
+			}
 			lh = ldms_metric_get(softirq_set, metric_offset);
 			mval = ldms_list_first(softirq_set, lh, NULL, NULL);
 			if (n != 11) {
@@ -652,8 +646,7 @@ begin:
 		case STAT_PROCESSES:
 		case STAT_PROCS_RUNNING:
 		case STAT_PROCS_BLOCKED:
-			n = fscanf(mf, "%"PRIu64 , &u64);
-			if (n != 1) {
+			if (!procfs_scan_u64(q, &u64)) {
 				rc = ENODATA;
 				goto out;
 			}
@@ -676,8 +669,7 @@ begin:
 
 static void term(struct ldmsd_plugin *self)
 {
-	if (mf)
-		fclose(mf);
+	procfs_file_close(mf);
 	mf = NULL;
 	if (base)
 		base_del(base);
@@ -0,0 +1,275 @@
+/**
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file sampler_procfs.c
+ * \brief Whole-file procfs reader and key-to-metric maps.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ldms.h"
+#include "sampler_procfs.h"
+
+#define PROCFS_BUF_SZ 4096
+
+procfs_file_t procfs_file_openat(int dirfd, const char *path, size_t buf_sz)
+{
+	int err;
+	procfs_file_t f = calloc(1, sizeof(*f));
+	if (!f)
+		return NULL;
+	f->path = strdup(path);
+	if (!f->path)
+		goto err;
+	f->buf_sz = buf_sz ? buf_sz : PROCFS_BUF_SZ;
+	if (f->buf_sz < 2)
+		f->buf_sz = 2;
+	f->buf = malloc(f->buf_sz);
+	if (!f->buf)
+		goto err;
+	f->fd = openat(dirfd, path, O_RDONLY|O_CLOEXEC);
+	if (f->fd < 0)
+		goto err;
+	f->buf[0] = '\0';
+	return f;
+ err:
+	err = errno;
+	free(f->buf);
+	free(f->path);
+	free(f);
+	errno = err;
+	return NULL;
+}
+
+procfs_file_t procfs_file_open(const char *path)
+{
+	return procfs_file_openat(AT_FDCWD, path, 0);
+}
+
+void procfs_file_close(procfs_file_t f)
+{
+	if (!f)
+		return;
+	close(f->fd);
+	free(f->buf);
+	free(f->path);
+	free(f);
+}
+
+int procfs_file_read(procfs_file_t f)
+{
+	ssize_t rc;
+	size_t off = 0;
+	char *buf;
+
+	while (1) {
+		rc = pread(f->fd, f->buf + off, f->buf_sz - off - 1, off);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		if (rc == 0)
+			break;
+		off += rc;
+		if (off + 1 < f->buf_sz)
+			continue;
+		/* the buffer is full, the file may have more */
+		buf = realloc(f->buf, f->buf_sz * 2);
+		if (!buf)
+			return ENOMEM;
+		f->buf = buf;
+		f->buf_sz *= 2;
+	}
+	f->buf[off] = '\0';
+	f->len = off;
+	return 0;
+}
+
+static int kv_ent_cmp(const void *a, const void *b)
+{
+	const struct procfs_kv_ent *x = *(const struct procfs_kv_ent **)a;
+	const struct procfs_kv_ent *y = *(const struct procfs_kv_ent **)b;
+	size_t len = x->key_len < y->key_len ? x->key_len : y->key_len;
+	int rc = memcmp(x->key, y->key, len);
+	if (rc)
+		return rc;
+	return (x->key_len > y->key_len) - (x->key_len < y->key_len);
+}
+
+static struct procfs_kv_ent *
+kv_lookup(procfs_kv_map_t m, const char *key, size_t key_len)
+{
+	struct procfs_kv_ent k = { .key = (char *)key, .key_len = key_len };
+	struct procfs_kv_ent *kp = &k, **ent;
+
+	ent = bsearch(&kp, m->sorted, m->count, sizeof(*m->sorted), kv_ent_cmp);
+	return ent ? *ent : NULL;
+}
+
+/* Scan a "key[:] value" line. */
+static inline const char *kv_scan_line(const char *p, const char **key,
+				       size_t *key_len, uint64_t *v)
+{
+	p = procfs_scan_word(p, ':', key, key_len);
+	if (!p)
+		return NULL;
+	return procfs_scan_u64(p, v);
+}
+
+void procfs_kv_map_free(procfs_kv_map_t m)
+{
+	int i;
+
+	if (!m)
+		return;
+	for (i = 0; i < m->count; i++)
+		free(m->ents[i].key);
+	free(m->ents);
+	free(m->sorted);
+	free(m);
+}
+
+procfs_kv_map_t procfs_kv_map_new(procfs_file_t f, ldms_schema_t schema)
+{
+	procfs_kv_map_t m;
+	struct procfs_kv_ent *ents;
+	const char *p, *key;
+	size_t key_len;
+	uint64_t v;
+	int rc, alloc = 0;
+
+	rc = procfs_file_read(f);
+	if (rc) {
+		errno = rc;
+		return NULL;
+	}
+	m = calloc(1, sizeof(*m));
+	if (!m)
+		return NULL;
+	for (p = f->buf; *p; p = procfs_next_line(p)) {
+		if (!kv_scan_line(p, &key, &key_len, &v))
+			break;
+		if (m->count == alloc) {
+			alloc = alloc ? alloc * 2 : 64;
+			ents = realloc(m->ents, alloc * sizeof(*ents));
+			if (!ents)
+				goto enomem;
+			m->ents = ents;
+		}
+		m->ents[m->count].key = strndup(key, key_len);
+		if (!m->ents[m->count].key)
+			goto enomem;
+		m->ents[m->count].key_len = key_len;
+		rc = ldms_schema_metric_add(schema, m->ents[m->count].key,
+					    LDMS_V_U64);
+		m->count++;
+		if (rc < 0) {
+			rc = -rc;
+			goto err;
+		}
+		m->ents[m->count - 1].mid = rc;
+	}
+	m->sorted = malloc((m->count ? m->count : 1) * sizeof(*m->sorted));
+	if (!m->sorted)
+		goto enomem;
+	for (rc = 0; rc < m->count; rc++)
+		m->sorted[rc] = &m->ents[rc];
+	qsort(m->sorted, m->count, sizeof(*m->sorted), kv_ent_cmp);
+	return m;
+
+ enomem:
+	rc = ENOMEM;
+ err:
+	procfs_kv_map_free(m);
+	errno = rc;
+	return NULL;
+}
+
+int procfs_kv_map_sample(procfs_kv_map_t m, procfs_file_t f, ldms_set_t set)
+{
+	struct procfs_kv_ent *ent;
+	const char *p, *key;
+	size_t key_len;
+	uint64_t v;
+	int rc, i = 0, n = 0;
+
+	rc = procfs_file_read(f);
+	if (rc)
+		return rc;
+	m->layout_changed = 0;
+	m->unmatched = 0;
+	for (p = f->buf; *p; p = procfs_next_line(p)) {
+		if (!kv_scan_line(p, &key, &key_len, &v))
+			return EINVAL;
+		if (i < m->count && m->ents[i].key_len == key_len &&
+		    0 == memcmp(m->ents[i].key, key, key_len)) {
+			ent = &m->ents[i];
+		} else {
+			m->layout_changed = 1;
+			ent = kv_lookup(m, key, key_len);
+			if (!ent) {
+				m->unmatched++;
+				continue;
+			}
+		}
+		ldms_metric_set_u64(set, ent->mid, v);
+		/* resume the in-order fast path after the matched key */
+		i = ent - m->ents + 1;
+		n++;
+	}
+	if (n != m->count)
+		m->layout_changed = 1;
+	return 0;
+}
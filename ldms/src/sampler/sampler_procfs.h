@@ -0,0 +1,223 @@
+/**
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file sampler_procfs.h
+ * \brief Whole-file procfs reader and allocation-free field scanner.
+ *
+ * A procfs file is read with pread() into a buffer that is reused across
+ * samples. The buffer is NUL-terminated, and the inline scanners below
+ * walk it without stdio or sscanf.
+ *
+ * Files made of "key value" lines (/proc/meminfo, /proc/vmstat) can be
+ * mapped to metrics with a ::procfs_kv_map_t. The map is built once at
+ * config time. When a sample no longer has the config-time line order,
+ * the values are still assigned by key and the map reports the change.
+ */
+#ifndef SAMPLER_PROCFS_H
+#define SAMPLER_PROCFS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ldms.h"
+
+typedef struct procfs_file_s {
+	int fd;
+	char *path;
+	char *buf;
+	size_t buf_sz;
+	size_t len; /* bytes read, buf[len] is '\0' */
+} *procfs_file_t;
+
+/**
+ * \brief Open a procfs file for whole-file reads.
+ *
+ * \returns The file handle, or NULL with errno set.
+ */
+procfs_file_t procfs_file_open(const char *path);
+
+/**
+ * \brief Open \c path relative to the directory \c dirfd.
+ *
+ * \c dirfd may be an O_PATH descriptor of a /proc/<pid> directory, so the
+ * files of a process can be opened without building their full paths.
+ * \c buf_sz is the initial buffer size, 0 for the default; the buffer
+ * still grows to hold the whole file.
+ *
+ * \returns The file handle, or NULL with errno set.
+ */
+procfs_file_t procfs_file_openat(int dirfd, const char *path, size_t buf_sz);
+
+/**
+ * \brief Close the file and free the buffer.
+ */
+void procfs_file_close(procfs_file_t f);
+
+/**
+ * \brief Read the whole file into \c f->buf.
+ *
+ * The buffer grows as needed and is kept for the next read.
+ *
+ * \returns 0 on success or an errno.
+ */
+int procfs_file_read(procfs_file_t f);
+
+/** Skip spaces and tabs. */
+static inline const char *procfs_skip_blank(const char *p)
+{
+	while (*p == ' ' || *p == '\t')
+		p++;
+	return p;
+}
+
+/** Return the start of the line after \c p, or the terminating '\0'. */
+static inline const char *procfs_next_line(const char *p)
+{
+	while (*p && *p != '\n')
+		p++;
+	return *p ? p + 1 : p;
+}
+
+/**
+ * \brief Scan a word after optional blanks.
+ *
+ * A word ends at a blank, a newline, '\0' or \c delim (pass '\0' for no
+ * delimiter). The delimiter is not part of the word and is skipped.
+ *
+ * \returns The position after the word, or NULL if there is no word.
+ */
+static inline const char *procfs_scan_word(const char *p, char delim,
+					   const char **word, size_t *len)
+{
+	const char *w;
+
+	p = procfs_skip_blank(p);
+	w = p;
+	while (*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != delim)
+		p++;
+	if (p == w)
+		return NULL;
+	*word = w;
+	*len = p - w;
+	if (delim && *p == delim)
+		p++;
+	return p;
+}
+
+/**
+ * \brief Scan a decimal integer after optional blanks.
+ *
+ * A leading '-' wraps the value like strtoull() does.
+ *
+ * \returns The position after the digits, or NULL if there is no number
+ *          or it does not fit in 64 bits.
+ */
+static inline const char *procfs_scan_u64(const char *p, uint64_t *v)
+{
+	uint64_t x = 0;
+	unsigned d;
+	int neg = 0;
+
+	p = procfs_skip_blank(p);
+	if (*p == '-') {
+		neg = 1;
+		p++;
+	}
+	if ((unsigned)(*p - '0') > 9)
+		return NULL;
+	do {
+		d = *p - '0';
+		if (x > (UINT64_MAX - d) / 10)
+			return NULL; /* overflow */
+		x = x * 10 + d;
+		p++;
+	} while ((unsigned)(*p - '0') <= 9);
+	*v = neg ? -x : x;
+	return p;
+}
+
+struct procfs_kv_ent {
+	char *key;
+	size_t key_len;
+	int mid;
+};
+
+typedef struct procfs_kv_map_s {
+	int count;
+	struct procfs_kv_ent *ents; /* in the config-time line order */
+	struct procfs_kv_ent **sorted; /* sorted by key */
+	int layout_changed; /* the last sample did not match the line order */
+	int unmatched; /* lines of the last sample with an unknown key */
+} *procfs_kv_map_t;
+
+/**
+ * \brief Build a key-to-metric map from a "key value" file.
+ *
+ * Add a LDMS_V_U64 metric to \c schema for every line of \c f that has a key
+ * followed by a number. A trailing ':' is stripped from the key. The map
+ * ends at the first line without a number.
+ *
+ * \returns The map, or NULL with errno set.
+ */
+procfs_kv_map_t procfs_kv_map_new(procfs_file_t f, ldms_schema_t schema);
+
+/**
+ * \brief Read \c f and set the mapped metrics of \c set.
+ *
+ * A line whose key is the config-time key at its position is assigned
+ * without a lookup. Otherwise the key is looked up, \c layout_changed is
+ * set and lines with an unknown key are counted in \c unmatched.
+ *
+ * \returns 0 on success, an errno from reading the file, or EINVAL at the
+ *          first line that is not a key followed by a number.
+ */
+int procfs_kv_map_sample(procfs_kv_map_t m, procfs_file_t f, ldms_set_t set);
+
+void procfs_kv_map_free(procfs_kv_map_t m);
+
+#endif
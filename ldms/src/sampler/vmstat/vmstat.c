@@ -64,6 +64,7 @@
 #include "ldms.h"
 #include "ldmsd.h"
 #include "sampler_base.h"
+#include "sampler_procfs.h"
 
 #define PROC_FILE "/proc/vmstat"
 
@@ -71,26 +72,22 @@ static char *procfile = PROC_FILE;
 
 static ldms_set_t set;
 #define SAMP "vmstat"
-static FILE *mf = 0;
+static procfs_file_t mf;
+static procfs_kv_map_t kvmap;
+static int layout_warned;
 static ldmsd_msg_log_f msglog;
-static int metric_offset = 1;
 static base_data_t base;
 
 static ldms_set_t get_set(struct ldmsd_sampler *self)
 {
 	return set;
 }
-#define LBUFSZ 256
 static int create_metric_set(base_data_t base)
 {
 	int rc;
-	uint64_t metric_value;
-	char *s;
-	char lbuf[LBUFSZ];
-	char metric_name[LBUFSZ];
 	ldms_schema_t schema;
 
-	mf = fopen(procfile, "r");
+	mf = procfs_file_open(procfile);
 	if (!mf) {
 		msglog(LDMSD_LERROR, "Could not open the " SAMP " file "
 				"'%s'...exiting\n", procfile);
@@ -106,21 +103,11 @@ static int create_metric_set(base_data_t base)
 		goto err;
 	}
 
-	/* Location of first metric from proc/vmstat file */
-	metric_offset = ldms_schema_metric_count_get(schema);
-
-	fseek(mf, 0, SEEK_SET);
-	do {
-		s = fgets(lbuf, sizeof(lbuf), mf);
-		if (!s)
-			break;
-		rc = sscanf(lbuf, "%s %" PRIu64 "\n", metric_name, &metric_value);
-		if (rc < 2)
-			goto err;
-		rc = ldms_schema_metric_add(schema, metric_name, LDMS_V_U64);
-		if (rc < 0)
-			goto err;
-	} while (s);
+	kvmap = procfs_kv_map_new(mf, schema);
+	if (!kvmap) {
+		rc = errno;
+		goto err;
+	}
 
 	set = base_set_new(base);
 	if (!set) {
@@ -130,8 +117,9 @@ static int create_metric_set(base_data_t base)
 	return 0;
 
  err:
-	if (mf)
-		fclose(mf);
+	procfs_kv_map_free(kvmap);
+	kvmap = NULL;
+	procfs_file_close(mf);
 	mf = NULL;
 	return rc;
 }
@@ -195,11 +183,6 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct
 static int sample(struct ldmsd_sampler *self)
 {
 	int rc;
-	int metric_no;
-	char *s;
-	char lbuf[LBUFSZ];
-	char metric_name[LBUFSZ];
-	union ldms_value v;
 
 	if (!set) {
 		msglog(LDMSD_LDEBUG, SAMP ": plugin not initialized\n");
@@ -207,30 +190,22 @@ static int sample(struct ldmsd_sampler *self)
 	}
 
 	base_sample_begin(base);
-	metric_no = metric_offset;
-	fseek(mf, 0, SEEK_SET);
-	do {
-		s = fgets(lbuf, sizeof(lbuf), mf);
-		if (!s)
-			break;
-		rc = sscanf(lbuf, "%s %" PRIu64 "\n", metric_name, &v.v_u64);
-		if (rc != 2) {
-			rc = EINVAL;
-			goto out;
-		}
-		ldms_metric_set(set, metric_no, &v);
-		metric_no++;
-	} while (s);
-	rc = 0;
- out:
+	rc = procfs_kv_map_sample(kvmap, mf, set);
+	if (!rc && kvmap->layout_changed && !layout_warned) {
+		msglog(LDMSD_LWARNING, SAMP ": the layout of '%s' changed "
+		       "since config, %d unknown lines ignored.\n",
+		       procfile, kvmap->unmatched);
+		layout_warned = 1;
+	}
 	base_sample_end(base);
 	return rc;
 }
 
 static void term(struct ldmsd_plugin *self)
 {
-	if (mf)
-		fclose(mf);
+	procfs_kv_map_free(kvmap);
+	kvmap = NULL;
+	procfs_file_close(mf);
 	mf = NULL;
 	if (base)
 		base_del(base);
@@ -0,0 +1,334 @@
+/**
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * influx_store_bench - measure store_influx against a local HTTP stand-in
+ *
+ * Links store_influx.c directly, stores updates of a number of sets and
+ * reports the latency of the store() calls (what the ldmsd update
+ * callback sees) and the points/sec accepted by the endpoint. Unless
+ * -H is given, a built-in stand-in server that answers every
+ * /write post with "204 No Content" is started on a local port; -d
+ * makes it answer slowly to emulate a loaded InfluxDB.
+ */
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "ldms.h"
+#include "ldmsd.h"
+
+/* store_influx.c */
+extern struct ldmsd_plugin *get_plugin(ldmsd_msg_log_f pf);
+
+static uint64_t srv_points;
+static uint64_t srv_posts;
+static uint64_t srv_conns;
+static int srv_delay;	/* ms */
+static int verbose;
+
+static void msglog(enum ldmsd_loglevel level, const char *fmt, ...)
+{
+	va_list ap;
+	if (level < LDMSD_LINFO && !verbose)
+		return;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void *conn_proc(void *arg)
+{
+	static const char rsp[] = "HTTP/1.1 204 No Content\r\n"
+				  "Content-Length: 0\r\n\r\n";
+	int fd = (int)(long)arg;
+	size_t alloc = 1024 * 1024, len = 0, body, hdr_len;
+	char *buf = malloc(alloc), *eoh, *cl, *p;
+	ssize_t cnt;
+	uint64_t lines;
+
+	while (buf) {
+		/* Read the request headers */
+		buf[len] = '\0';
+		while (!(eoh = strstr(buf, "\r\n\r\n"))) {
+			cnt = read(fd, &buf[len], alloc - len - 1);
+			if (cnt <= 0)
+				goto out;
+			len += cnt;
+			buf[len] = '\0';
+		}
+		hdr_len = eoh - buf + 4;
+		cl = strcasestr(buf, "Content-Length:");
+		body = (cl && cl < eoh) ? strtoul(cl + 15, NULL, 0) : 0;
+		if (hdr_len + body >= alloc) {
+			alloc = hdr_len + body + 1;
+			buf = realloc(buf, alloc);
+			if (!buf)
+				goto out;
+		}
+		while (len < hdr_len + body) {
+			cnt = read(fd, &buf[len], alloc - len - 1);
+			if (cnt <= 0)
+				goto out;
+			len += cnt;
+		}
+		lines = 0;
+		for (p = &buf[hdr_len]; p < &buf[hdr_len + body]; p++)
+			lines += (*p == '\n');
+		if (srv_delay)
+			usleep(srv_delay * 1000);
+		__sync_fetch_and_add(&srv_points, lines);
+		__sync_fetch_and_add(&srv_posts, 1);
+		if (write(fd, rsp, sizeof(rsp) - 1) < 0)
+			goto out;
+		/* Keep any pipelined bytes of the next request */
+		len -= hdr_len + body;
+		memmove(buf, &buf[hdr_len + body], len);
+	}
+ out:
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+static void *server_proc(void *arg)
+{
+	int lfd = (int)(long)arg;
+	pthread_t t;
+	int fd;
+
+	while ((fd = accept(lfd, NULL, NULL)) >= 0) {
+		__sync_fetch_and_add(&srv_conns, 1);
+		pthread_create(&t, NULL, conn_proc, (void *)(long)fd);
+		pthread_detach(t);
+	}
+	return NULL;
+}
+
+static int server_start(char *host_port, size_t len)
+{
+	struct sockaddr_in sin = { .sin_family = AF_INET };
+	socklen_t slen = sizeof(sin);
+	pthread_t t;
+	int fd;
+
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0 || bind(fd, (void *)&sin, sizeof(sin)) || listen(fd, 64)
+	    || getsockname(fd, (void *)&sin, &slen))
+		return errno;
+	snprintf(host_port, len, "127.0.0.1:%d", ntohs(sin.sin_port));
+	return pthread_create(&t, NULL, server_proc, (void *)(long)fd);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(uint64_t *)a, y = *(uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-H host:port] [-s sets] [-m metrics] [-u updates]\n"
+	       "          [-d delay_ms] [-c \"<store config>\"] [-v]\n"
+	       "    -H  InfluxDB (or stand-in) endpoint; by default a built-in\n"
+	       "        stand-in server is started on a local port.\n"
+	       "    -s  Number of sets (store handles), default 16.\n"
+	       "    -m  Number of u64 metrics per set, default 32.\n"
+	       "    -u  Number of updates stored per set, default 2000.\n"
+	       "    -d  Stand-in server response delay in ms, default 0.\n"
+	       "    -c  Extra store_influx config attributes, e.g.\n"
+	       "        \"batch_lines=1000 batch_age=500\".\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	char host_port[128] = "";
+	char cfg[1024];
+	char *extra = "";
+	int num_sets = 16, num_metrics = 32, num_updates = 2000;
+	struct attr_value_list *kwl, *avl;
+	struct ldmsd_plugin *pi;
+	struct ldmsd_store *st;
+	struct ldmsd_strgp_metric_list mlist;
+	ldms_schema_t schema;
+	ldms_set_t *sets;
+	ldmsd_store_handle_t *sh;
+	int *mids;
+	uint64_t *lat, t0, t1, t2, n;
+	char name[64];
+	int i, j, u, op, rc;
+
+	while ((op = getopt(argc, argv, "H:s:m:u:d:c:vh")) != -1) {
+		switch (op) {
+		case 'H':
+			snprintf(host_port, sizeof(host_port), "%s", optarg);
+			break;
+		case 's':
+			num_sets = atoi(optarg);
+			break;
+		case 'm':
+			num_metrics = atoi(optarg);
+			break;
+		case 'u':
+			num_updates = atoi(optarg);
+			break;
+		case 'd':
+			srv_delay = atoi(optarg);
+			break;
+		case 'c':
+			extra = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (num_sets < 1 || num_metrics < 1 || num_updates < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (!host_port[0]) {
+		rc = server_start(host_port, sizeof(host_port));
+		if (rc) {
+			fprintf(stderr, "Error %d starting the stand-in server\n", rc);
+			return 1;
+		}
+	}
+
+	pi = get_plugin(msglog);
+	st = (void *)pi;
+	kwl = av_new(64);
+	avl = av_new(64);
+	snprintf(cfg, sizeof(cfg), "host_port=%s %s", host_port, extra);
+	if (!kwl || !avl || tokenize(cfg, kwl, avl) || pi->config(pi, kwl, avl)) {
+		fprintf(stderr, "Bad store configuration '%s'\n", cfg);
+		return 1;
+	}
+
+	ldms_init(64 * 1024 * 1024);
+	schema = ldms_schema_new("bench");
+	mids = calloc(num_metrics + 2, sizeof(*mids));
+	mids[0] = ldms_schema_meta_add(schema, "component_id", LDMS_V_U64);
+	mids[1] = ldms_schema_metric_add(schema, "job_id", LDMS_V_U64);
+	for (i = 0; i < num_metrics; i++) {
+		snprintf(name, sizeof(name), "metric_%d", i);
+		mids[i + 2] = ldms_schema_metric_add(schema, name, LDMS_V_U64);
+	}
+	TAILQ_INIT(&mlist);
+	sets = calloc(num_sets, sizeof(*sets));
+	sh = calloc(num_sets, sizeof(*sh));
+	lat = calloc((size_t)num_sets * num_updates, sizeof(*lat));
+	if (!sets || !sh || !lat) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	for (i = 0; i < num_sets; i++) {
+		snprintf(name, sizeof(name), "bench/%d", i);
+		sets[i] = ldms_set_new(name, schema);
+		sh[i] = st->open(st, "bench", "bench", &mlist, NULL);
+		if (!sets[i] || !sh[i]) {
+			fprintf(stderr, "Error creating set/store %d\n", i);
+			return 1;
+		}
+		ldms_metric_set_u64(sets[i], mids[0], i);
+	}
+
+	n = 0;
+	t0 = now_ns();
+	for (u = 0; u < num_updates; u++) {
+		for (i = 0; i < num_sets; i++) {
+			ldms_transaction_begin(sets[i]);
+			for (j = 2; j < num_metrics + 2; j++)
+				ldms_metric_set_u64(sets[i], mids[j], u * j);
+			ldms_transaction_end(sets[i]);
+			t1 = now_ns();
+			st->store(sh[i], sets[i], mids, num_metrics + 2);
+			lat[n++] = now_ns() - t1;
+		}
+	}
+	t1 = now_ns();
+	for (i = 0; i < num_sets; i++)
+		st->flush(sh[i]);
+	t2 = now_ns();
+
+	qsort(lat, n, sizeof(*lat), cmp_u64);
+	printf("store() calls     : %lu\n", n);
+	printf("store() latency ns: p50 %lu p99 %lu max %lu\n",
+	       lat[n / 2], lat[n * 99 / 100], lat[n - 1]);
+	printf("store() rate      : %.0f points/s\n", n * 1e9 / (t1 - t0));
+	printf("end-to-end rate   : %.0f points/s (flush %.3f s)\n",
+	       n * 1e9 / (t2 - t0), (t2 - t1) / 1e9);
+	if (srv_posts || srv_conns)
+		printf("stand-in server   : %lu points, %lu posts, %lu connections\n",
+		       srv_points, srv_posts, srv_conns);
+
+	for (i = 0; i < num_sets; i++)
+		st->close(sh[i]);
+	return 0;
+}
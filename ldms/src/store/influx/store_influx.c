@@ -38,6 +38,7 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#define _GNU_SOURCE
 #include <sys/queue.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -53,12 +54,72 @@
 #include <unistd.h>
 #include <grp.h>
 #include <pwd.h>
+#include <time.h>
 #include <sys/syscall.h>
 #include <assert.h>
 #include <curl/curl.h>
 #include "ldms.h"
 #include "ldmsd.h"
 
+/*
+ * Line-protocol records from all store handles that write to the same
+ * database (container) are appended to the 'fill' batch of a shared
+ * writer. Full or aged batches are queued on the writer and posted by a
+ * single I/O thread through a curl multi handle, so store() never waits
+ * on the network and the connection to InfluxDB is kept alive between
+ * posts. Batches that still fail after retry_max attempts, or that
+ * exceed the backlog limit, are appended to <spill_dir>/<container>.lp
+ * and replayed once the endpoint accepts posts again.
+ */
+
+struct lp_batch {
+	char *data;
+	size_t len;
+	size_t alloc;
+	int lines;
+	int tries;
+	int replay;		/* read back from the spill file */
+	uint64_t next_try;	/* ms, CLOCK_MONOTONIC */
+	TAILQ_ENTRY(lp_batch) entry;
+};
+TAILQ_HEAD(lp_batch_q, lp_batch);
+
+struct influx_writer {
+	char *container;
+	char url[256];
+	int ref;
+	int closing;
+	int closed;
+	pthread_mutex_t lock;	/* fill, ready, free_q, backlog, flush */
+	pthread_cond_t cond;
+	struct lp_batch *fill;	/* batch store() appends to */
+	uint64_t fill_start;	/* ms the first line went into fill */
+	struct lp_batch_q ready;	/* batches waiting to be posted */
+	size_t backlog;		/* bytes on the ready queue */
+	struct lp_batch_q free_q;	/* recycled batches */
+	int free_count;
+	uint64_t flush_req;
+	uint64_t flush_done;
+
+	/* Owned by the I/O thread */
+	CURL *curl;
+	struct curl_slist *headers;
+	struct lp_batch *inflight;
+	char errbuf[CURL_ERROR_SIZE];
+	int spill_fd;
+	off_t replay_off;
+	uint64_t replay_next;	/* ms, no replay before this */
+	int replay_tries;
+
+	/* Statistics */
+	uint64_t points;
+	uint64_t posts;
+	uint64_t failures;
+	uint64_t spilled;
+	uint64_t dropped;
+	LIST_ENTRY(influx_writer) entry;
+};
+
 static char host_port[64];	/* hostname:port_no for influxdb */
 struct influx_store {
 	struct ldmsd_store *store;
@@ -70,87 +131,193 @@ struct influx_store {
 	int job_mid;
 	int comp_mid;
 	char **metric_name;
-	CURL *curl;
+	int metric_count;
+	struct influx_writer *w;
 	LIST_ENTRY(influx_store) entry;
-	size_t measurement_limit;
-	char measurement[0];
 };
 
 #define MEASUREMENT_LIMIT_DEFAULT	4096
+#define BATCH_BYTES_DEFAULT	(256 * 1024)
+#define BATCH_LINES_DEFAULT	5000
+#define BATCH_AGE_DEFAULT	1000	/* ms */
+#define RETRY_MAX_DEFAULT	3
+#define RETRY_INTERVAL		500	/* ms, doubled on every retry */
+#define MAX_BACKLOG_DEFAULT	(64 * 1024 * 1024)
+#define POST_TIMEOUT_DEFAULT	10000	/* ms */
+#define FREE_BATCH_MAX		4
 static size_t measurement_limit = MEASUREMENT_LIMIT_DEFAULT;
+static size_t batch_bytes = BATCH_BYTES_DEFAULT;
+static int batch_lines = BATCH_LINES_DEFAULT;
+static int batch_age = BATCH_AGE_DEFAULT;
+static int retry_max = RETRY_MAX_DEFAULT;
+static size_t max_backlog = MAX_BACKLOG_DEFAULT;
+static long post_timeout = POST_TIMEOUT_DEFAULT;
+static char spill_dir[PATH_MAX];
 static pthread_mutex_t cfg_lock = PTHREAD_MUTEX_INITIALIZER;
 LIST_HEAD(influx_store_list, influx_store) store_list;
+LIST_HEAD(influx_writer_list, influx_writer) writer_list;
 static ldmsd_msg_log_f msglog;
 
-static int set_none_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
+static CURLM *io_multi;
+static pthread_t io_thread;
+static int io_thread_running;
+
+static inline uint64_t now_ms(void)
 {
-	assert(0 == "Invalid LDMS metric type");
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
-static int update_offset(size_t cnt, size_t *line_off, size_t line_len)
+
+static int batch_reserve(struct lp_batch *b, size_t sz)
 {
-	if (cnt + *line_off < line_len) {
-		*line_off += cnt;
+	size_t alloc;
+	char *data;
+
+	if (b->len + sz <= b->alloc)
 		return 0;
+	alloc = (b->alloc ? b->alloc : measurement_limit);
+	while (alloc < b->len + sz)
+		alloc *= 2;
+	data = realloc(b->data, alloc);
+	if (!data)
+		return ENOMEM;
+	b->data = data;
+	b->alloc = alloc;
+	return 0;
+}
+
+/* Called with w->lock held */
+static struct lp_batch *batch_get(struct influx_writer *w)
+{
+	struct lp_batch *b = TAILQ_FIRST(&w->free_q);
+	if (b) {
+		TAILQ_REMOVE(&w->free_q, b, entry);
+		w->free_count--;
+	} else {
+		b = calloc(1, sizeof(*b));
+		if (!b)
+			return NULL;
+	}
+	b->len = 0;
+	b->lines = 0;
+	b->tries = 0;
+	b->replay = 0;
+	b->next_try = 0;
+	return b;
+}
+
+/* Called with w->lock held */
+static void batch_put(struct influx_writer *w, struct lp_batch *b)
+{
+	if (w->free_count < FREE_BATCH_MAX) {
+		TAILQ_INSERT_HEAD(&w->free_q, b, entry);
+		w->free_count++;
+		return;
 	}
-	return E2BIG;
+	free(b->data);
+	free(b);
+}
+
+/* Queue the fill batch for posting; called with w->lock held */
+static void fill_ready(struct influx_writer *w)
+{
+	struct lp_batch *b = w->fill;
+	if (!b || !b->lines)
+		return;
+	w->fill = NULL;
+	TAILQ_INSERT_TAIL(&w->ready, b, entry);
+	w->backlog += b->len;
+}
+
+static inline int fill_full(struct influx_writer *w)
+{
+	return w->fill->len >= batch_bytes || w->fill->lines >= batch_lines;
+}
+
+static int set_none_fn(struct lp_batch *b, ldms_set_t s, int i)
+{
+	assert(0 == "Invalid LDMS metric type");
+	return -EINVAL;
 }
-static int set_u8_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
+static int set_u8_fn(struct lp_batch *b, ldms_set_t s, int i)
 {
-	size_t cnt = snprintf(&line[*line_off], line_len, "%hhui", ldms_metric_get_u8(s, i));
-	return update_offset(cnt, line_off, line_len);
+	return snprintf(&b->data[b->len], b->alloc - b->len, "%hhui",
+			ldms_metric_get_u8(s, i));
 }
-static int set_s8_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
+static int set_s8_fn(struct lp_batch *b, ldms_set_t s, int i)
 {
-	size_t cnt = snprintf(&line[*line_off], line_len, "%hhdi", ldms_metric_get_s8(s, i));
-	return update_offset(cnt, line_off, line_len);
+	return snprintf(&b->data[b->len], b->alloc - b->len, "%hhdi",
+			ldms_metric_get_s8(s, i));
 }
-static int set_u16_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
+static int set_u16_fn(struct lp_batch *b, ldms_set_t s, int i)
 {
-	size_t cnt = snprintf(&line[*line_off], line_len, "%hui", ldms_metric_get_u16(s, i));
-	return update_offset(cnt, line_off, line_len);
+	return snprintf(&b->data[b->len], b->alloc - b->len, "%hui",
+			ldms_metric_get_u16(s, i));
 }
-static int set_s16_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
+static int set_s16_fn(struct lp_batch *b, ldms_set_t s, int i)
 {
-	size_t cnt = snprintf(&line[*line_off], line_len, "%hdi", ldms_metric_get_s16(s, i));
-	return update_offset(cnt, line_off, line_len);
+	return snprintf(&b->data[b->len], b->alloc - b->len, "%hdi",
+			ldms_metric_get_s16(s, i));
 }
-static int set_str_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
+static int set_u32_fn(struct lp_batch *b, ldms_set_t s, int i)
 {
-	size_t cnt = snprintf(&line[*line_off], line_len, "\"%s\"", ldms_metric_array_get_str(s, i));
-	return update_offset(cnt, line_off, line_len);
+	return snprintf(&b->data[b->len], b->alloc - b->len, "%ui",
+			ldms_metric_get_u32(s, i));
 }
-static int set_u32_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
+static int set_s32_fn(struct lp_batch *b, ldms_set_t s, int i)
 {
-	size_t cnt = snprintf(&line[*line_off], line_len, "%ui", ldms_metric_get_u32(s, i));
-	return update_offset(cnt, line_off, line_len);
+	return snprintf(&b->data[b->len], b->alloc - b->len, "%di",
+			ldms_metric_get_s32(s, i));
 }
-static int set_s32_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
+static int set_u64_fn(struct lp_batch *b, ldms_set_t s, int i)
 {
-	size_t cnt = snprintf(&line[*line_off], line_len, "%di", ldms_metric_get_s32(s, i));
-	return update_offset(cnt, line_off, line_len);
+	return snprintf(&b->data[b->len], b->alloc - b->len, "%lui",
+			ldms_metric_get_u64(s, i));
 }
-static int set_u64_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
+static int set_s64_fn(struct lp_batch *b, ldms_set_t s, int i)
 {
-	size_t cnt = snprintf(&line[*line_off], line_len, "%lui", ldms_metric_get_u64(s, i));
-	return update_offset(cnt, line_off, line_len);
+	return snprintf(&b->data[b->len], b->alloc - b->len, "%ldi",
+			ldms_metric_get_s64(s, i));
 }
-static int set_s64_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
+static int set_float_fn(struct lp_batch *b, ldms_set_t s, int i)
 {
-	size_t cnt = snprintf(&line[*line_off], line_len, "%ldi", ldms_metric_get_s64(s, i));
-	return update_offset(cnt, line_off, line_len);
+	return snprintf(&b->data[b->len], b->alloc - b->len, "%.9g",
+			ldms_metric_get_float(s, i));
 }
-static int set_float_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
+static int set_double_fn(struct lp_batch *b, ldms_set_t s, int i)
 {
-	size_t cnt = snprintf(&line[*line_off], line_len, "%f", ldms_metric_get_float(s, i));
-	return update_offset(cnt, line_off, line_len);
+	return snprintf(&b->data[b->len], b->alloc - b->len, "%.17g",
+			ldms_metric_get_double(s, i));
 }
-static int set_double_fn(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i)
+/* The string is quoted, with '"' and '\' escaped */
+static int set_str_fn(struct lp_batch *b, ldms_set_t s, int i)
 {
-	size_t cnt = snprintf(&line[*line_off], line_len, "%lf", ldms_metric_get_double(s, i));
-	return update_offset(cnt, line_off, line_len);
+	const char *str = ldms_metric_array_get_str(s, i);
+	size_t len = strlen(str);
+	char *p;
+
+	if (batch_reserve(b, 2 * len + 3))
+		return -ENOMEM;
+	p = &b->data[b->len];
+	*p++ = '"';
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			*p++ = '\\';
+		*p++ = *str;
+	}
+	*p++ = '"';
+	return p - &b->data[b->len];
 }
 
-typedef int (*influx_value_set_fn)(char *line, size_t *line_off, size_t line_len, ldms_set_t s, int i);
+/*
+ * Format the value into the batch and return the number of bytes the
+ * value needs, as snprintf() does. Numeric values fit in VALUE_MAX
+ * bytes; if the return value is not less than the space left, the
+ * caller must reserve more and format the value again.
+ */
+#define VALUE_MAX	64
+typedef int (*influx_value_set_fn)(struct lp_batch *b, ldms_set_t s, int i);
 influx_value_set_fn influx_value_set[] = {
 	[LDMS_V_NONE] = set_none_fn,
 	[LDMS_V_CHAR] = set_s8_fn,
@@ -178,9 +345,10 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct
 	value = av_value(avl, "host_port");
 	if (!value) {
 		msglog(LDMSD_LERROR, "The 'host_port' keyword is required.\n");
+		pthread_mutex_unlock(&cfg_lock);
 		return EINVAL;
 	}
-	strncpy(host_port, value, sizeof(host_port));
+	strncpy(host_port, value, sizeof(host_port) - 1);
 
 	value = av_value(avl, "measurement_limit");
 	if (value) {
@@ -193,6 +361,71 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct
 		}
 	}
 
+	value = av_value(avl, "batch_bytes");
+	if (value) {
+		batch_bytes = strtol(value, NULL, 0);
+		if (batch_bytes <= 0) {
+			msglog(LDMSD_LERROR,
+			       "'%s' is not a valid 'batch_bytes' value\n",
+			       value);
+			batch_bytes = BATCH_BYTES_DEFAULT;
+		}
+	}
+
+	value = av_value(avl, "batch_lines");
+	if (value) {
+		batch_lines = strtol(value, NULL, 0);
+		if (batch_lines <= 0) {
+			msglog(LDMSD_LERROR,
+			       "'%s' is not a valid 'batch_lines' value\n",
+			       value);
+			batch_lines = BATCH_LINES_DEFAULT;
+		}
+	}
+
+	value = av_value(avl, "batch_age");
+	if (value) {
+		batch_age = strtol(value, NULL, 0);
+		if (batch_age <= 0) {
+			msglog(LDMSD_LERROR,
+			       "'%s' is not a valid 'batch_age' value\n",
+			       value);
+			batch_age = BATCH_AGE_DEFAULT;
+		}
+	}
+
+	value = av_value(avl, "retry_max");
+	if (value)
+		retry_max = strtol(value, NULL, 0);
+
+	value = av_value(avl, "max_backlog");
+	if (value) {
+		max_backlog = strtol(value, NULL, 0);
+		if (max_backlog <= 0) {
+			msglog(LDMSD_LERROR,
+			       "'%s' is not a valid 'max_backlog' value\n",
+			       value);
+			max_backlog = MAX_BACKLOG_DEFAULT;
+		}
+	}
+
+	value = av_value(avl, "timeout");
+	if (value) {
+		post_timeout = strtol(value, NULL, 0);
+		if (post_timeout <= 0)
+			post_timeout = POST_TIMEOUT_DEFAULT;
+	}
+
+	value = av_value(avl, "spill_dir");
+	if (value) {
+		if (value[0] != '/') {
+			msglog(LDMSD_LERROR, "'spill_dir' must be an absolute path.\n");
+			pthread_mutex_unlock(&cfg_lock);
+			return EINVAL;
+		}
+		snprintf(spill_dir, sizeof(spill_dir), "%s", value);
+	}
+
 	pthread_mutex_unlock(&cfg_lock);
 	return 0;
 }
@@ -203,7 +436,450 @@ static void term(struct ldmsd_plugin *self)
 
 static const char *usage(struct ldmsd_plugin *self)
 {
-	return  "    config name=influx host_port=<hostname>':'<port_no>\n";
+	return  "    config name=influx host_port=<hostname>':'<port_no>\n"
+		"           [batch_bytes=<bytes>] [batch_lines=<lines>] [batch_age=<ms>]\n"
+		"           [retry_max=<count>] [max_backlog=<bytes>] [timeout=<ms>]\n"
+		"           [spill_dir=<path>]\n"
+		"         batch_bytes Post when a batch reaches this size (default 262144).\n"
+		"         batch_lines Post when a batch has this many points (default 5000).\n"
+		"         batch_age   Post a batch when it is this old (default 1000).\n"
+		"         retry_max   Retries of a failed post before it is spilled (default 3).\n"
+		"         max_backlog Bytes queued in memory before the oldest batches are\n"
+		"                     spilled or dropped (default 67108864).\n"
+		"         timeout     Timeout of a single post (default 10000).\n"
+		"         spill_dir   Directory where batches that could not be posted are\n"
+		"                     saved as <container>.lp and replayed later.\n";
+}
+
+/*
+ * Spill file handling, all in the I/O thread
+ */
+static int spill_open(struct influx_writer *w)
+{
+	char path[PATH_MAX + 256];
+	struct stat st;
+
+	if (w->spill_fd >= 0)
+		return 0;
+	if (!spill_dir[0])
+		return ENOENT;
+	snprintf(path, sizeof(path), "%s/%s.lp", spill_dir, w->container);
+	w->spill_fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0600);
+	if (w->spill_fd < 0) {
+		msglog(LDMSD_LERROR, "influx: error %d opening '%s'.\n",
+		       errno, path);
+		return errno;
+	}
+	if (fstat(w->spill_fd, &st) == 0 && st.st_size)
+		msglog(LDMSD_LINFO, "influx: %ld bytes of spilled data "
+		       "in '%s' will be replayed.\n", st.st_size, path);
+	return 0;
+}
+
+static void spill_or_drop(struct influx_writer *w, struct lp_batch *b)
+{
+	ssize_t cnt;
+	size_t off;
+
+	if (b->replay)
+		return; /* still in the spill file */
+	if (spill_open(w) == 0) {
+		for (off = 0; off < b->len; off += cnt) {
+			cnt = write(w->spill_fd, &b->data[off], b->len - off);
+			if (cnt < 0)
+				break;
+		}
+		if (off == b->len) {
+			w->spilled += b->lines;
+			return;
+		}
+		msglog(LDMSD_LERROR, "influx: error %d writing the spill "
+		       "file for '%s'.\n", errno, w->container);
+	}
+	w->dropped += b->lines;
+	msglog(LDMSD_LERROR, "influx: %d points for '%s' dropped.\n",
+	       b->lines, w->container);
+}
+
+/* Read the next batch of complete lines from the spill file */
+static struct lp_batch *spill_replay(struct influx_writer *w)
+{
+	struct lp_batch *b;
+	ssize_t cnt;
+	off_t off;
+	int partial = 0;
+	char *nl = NULL;
+
+	if (w->spill_fd < 0 && (!spill_dir[0] || spill_open(w)))
+		return NULL;
+	pthread_mutex_lock(&w->lock);
+	b = batch_get(w);
+	if (b && batch_reserve(b, batch_bytes)) {
+		batch_put(w, b);
+		b = NULL;
+	}
+	pthread_mutex_unlock(&w->lock);
+	if (!b)
+		return NULL;
+	cnt = pread(w->spill_fd, b->data, batch_bytes, w->replay_off);
+	if (cnt > 0)
+		nl = memrchr(b->data, '\n', cnt);
+	if (cnt == batch_bytes && !nl) {
+		/*
+		 * The line does not fit in a batch. Skip it, or truncate
+		 * below if it is the partial line at the end.
+		 */
+		off = w->replay_off + cnt;
+		while ((cnt = pread(w->spill_fd, b->data, batch_bytes, off)) > 0) {
+			nl = memchr(b->data, '\n', cnt);
+			if (nl)
+				break;
+			off += cnt;
+		}
+		if (nl) {
+			off += nl - b->data + 1;
+			msglog(LDMSD_LERROR, "influx: a %ld-byte spilled line "
+			       "for '%s' is longer than batch_bytes and was "
+			       "dropped.\n", (long)(off - w->replay_off),
+			       w->container);
+			w->replay_off = off;
+			w->dropped++;
+			pthread_mutex_lock(&w->lock);
+			batch_put(w, b);
+			pthread_mutex_unlock(&w->lock);
+			return NULL;
+		}
+		partial = 1;
+	}
+	if (cnt <= 0 || !nl) {
+		/*
+		 * Everything was replayed; a partial line at the end was
+		 * left by an interrupted write and is discarded.
+		 */
+		if (cnt >= 0 && cnt < batch_bytes
+		    && (w->replay_off || cnt || partial)) {
+			if (ftruncate(w->spill_fd, 0))
+				msglog(LDMSD_LERROR, "influx: error %d "
+				       "truncating the spill file of '%s'.\n",
+				       errno, w->container);
+			w->replay_off = 0;
+		}
+		pthread_mutex_lock(&w->lock);
+		batch_put(w, b);
+		pthread_mutex_unlock(&w->lock);
+		return NULL;
+	}
+	b->len = nl - b->data + 1;
+	for (nl = b->data; (nl = memchr(nl, '\n', b->len - (nl - b->data))); nl++)
+		b->lines++;
+	b->replay = 1;
+	return b;
+}
+
+static size_t discard_response(char *ptr, size_t size, size_t nmemb, void *arg)
+{
+	return size * nmemb;
+}
+
+static int writer_post(struct influx_writer *w, struct lp_batch *b)
+{
+	if (!w->curl) {
+		w->curl = curl_easy_init();
+		if (!w->curl)
+			return ENOMEM;
+		w->headers = curl_slist_append(NULL,
+				"Content-Type: application/influx");
+		curl_easy_setopt(w->curl, CURLOPT_URL, w->url);
+		curl_easy_setopt(w->curl, CURLOPT_HTTPHEADER, w->headers);
+		curl_easy_setopt(w->curl, CURLOPT_PRIVATE, w);
+		curl_easy_setopt(w->curl, CURLOPT_ERRORBUFFER, w->errbuf);
+		curl_easy_setopt(w->curl, CURLOPT_WRITEFUNCTION, discard_response);
+		curl_easy_setopt(w->curl, CURLOPT_NOSIGNAL, 1L);
+		curl_easy_setopt(w->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+		curl_easy_setopt(w->curl, CURLOPT_TIMEOUT_MS, post_timeout);
+	}
+	w->errbuf[0] = '\0';
+	curl_easy_setopt(w->curl, CURLOPT_POSTFIELDS, b->data);
+	curl_easy_setopt(w->curl, CURLOPT_POSTFIELDSIZE, (long)b->len);
+	if (curl_multi_add_handle(io_multi, w->curl) != CURLM_OK)
+		return EIO;
+	w->inflight = b;
+	return 0;
+}
+
+static void writer_done(struct influx_writer *w, CURLcode result)
+{
+	struct lp_batch *b = w->inflight;
+	long code = 0;
+
+	curl_multi_remove_handle(io_multi, w->curl);
+	w->inflight = NULL;
+	if (result == CURLE_OK)
+		curl_easy_getinfo(w->curl, CURLINFO_RESPONSE_CODE, &code);
+	if (code >= 200 && code < 300) {
+		w->posts++;
+		w->points += b->lines;
+		if (b->replay) {
+			w->replay_off += b->len;
+			w->replay_tries = 0;
+		}
+		pthread_mutex_lock(&w->lock);
+		batch_put(w, b);
+		pthread_mutex_unlock(&w->lock);
+		return;
+	}
+
+	w->failures++;
+	b->tries++;
+	if (result != CURLE_OK)
+		msglog(LDMSD_LERROR, "influx: post to '%s' failed: %s\n",
+		       w->url, w->errbuf[0] ? w->errbuf : curl_easy_strerror(result));
+	else
+		msglog(LDMSD_LERROR, "influx: post to '%s' failed with HTTP "
+		       "status %ld.\n", w->url, code);
+	/* A 4xx means the data was rejected, resending it will not help */
+	if (code >= 400 && code < 500) {
+		w->dropped += b->lines;
+		if (b->replay) {
+			/* Skip the rejected lines in the spill file */
+			w->replay_off += b->len;
+			w->replay_tries = 0;
+		}
+		pthread_mutex_lock(&w->lock);
+		batch_put(w, b);
+		pthread_mutex_unlock(&w->lock);
+		return;
+	}
+	if (b->replay) {
+		/* The lines stay in the spill file, back off before replaying */
+		if (w->replay_tries < 7)
+			w->replay_tries++;
+		w->replay_next = now_ms() +
+			((uint64_t)RETRY_INTERVAL << (w->replay_tries - 1));
+		pthread_mutex_lock(&w->lock);
+		batch_put(w, b);
+		pthread_mutex_unlock(&w->lock);
+		return;
+	}
+	if (w->closing || b->tries > retry_max) {
+		spill_or_drop(w, b);
+		pthread_mutex_lock(&w->lock);
+		batch_put(w, b);
+		pthread_mutex_unlock(&w->lock);
+		return;
+	}
+	b->next_try = now_ms() + ((uint64_t)RETRY_INTERVAL << (b->tries - 1));
+	pthread_mutex_lock(&w->lock);
+	TAILQ_INSERT_HEAD(&w->ready, b, entry);
+	w->backlog += b->len;
+	pthread_mutex_unlock(&w->lock);
+}
+
+/*
+ * Move aged batches to the ready queue, enforce the backlog limit and
+ * post the next batch. Returns the number of ms until this writer needs
+ * attention again.
+ */
+static uint64_t writer_service(struct influx_writer *w, uint64_t now)
+{
+	struct lp_batch_q spill = TAILQ_HEAD_INITIALIZER(spill);
+	struct lp_batch *b, *s;
+	uint64_t wait = batch_age;
+	int idle;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->fill && w->fill->lines) {
+		if (w->closing || w->flush_req != w->flush_done
+		    || now - w->fill_start >= batch_age)
+			fill_ready(w);
+		else
+			wait = w->fill_start + batch_age - now;
+	}
+	while (w->backlog > max_backlog && (b = TAILQ_FIRST(&w->ready))) {
+		TAILQ_REMOVE(&w->ready, b, entry);
+		w->backlog -= b->len;
+		TAILQ_INSERT_TAIL(&spill, b, entry);
+	}
+	b = NULL;
+	if (!w->inflight) {
+		b = TAILQ_FIRST(&w->ready);
+		if (b && b->next_try > now && !w->closing) {
+			if (b->next_try - now < wait)
+				wait = b->next_try - now;
+			b = NULL;
+		} else if (b) {
+			TAILQ_REMOVE(&w->ready, b, entry);
+			w->backlog -= b->len;
+		}
+		if (!b && w->flush_req != w->flush_done
+		    && TAILQ_EMPTY(&w->ready)) {
+			w->flush_done = w->flush_req;
+			pthread_cond_broadcast(&w->cond);
+		}
+	}
+	idle = (!w->inflight && !b && TAILQ_EMPTY(&w->ready));
+	pthread_mutex_unlock(&w->lock);
+
+	while ((s = TAILQ_FIRST(&spill))) {
+		TAILQ_REMOVE(&spill, s, entry);
+		spill_or_drop(w, s);
+		pthread_mutex_lock(&w->lock);
+		batch_put(w, s);
+		pthread_mutex_unlock(&w->lock);
+	}
+	if (idle && !w->closing) {
+		if (w->replay_next > now) {
+			if (w->replay_next - now < wait)
+				wait = w->replay_next - now;
+		} else {
+			b = spill_replay(w);
+		}
+	}
+	if (b && writer_post(w, b)) {
+		spill_or_drop(w, b);
+		pthread_mutex_lock(&w->lock);
+		batch_put(w, b);
+		pthread_mutex_unlock(&w->lock);
+	}
+	return wait;
+}
+
+static void writer_free(struct influx_writer *w)
+{
+	struct lp_batch *b;
+
+	if (w->fill) {
+		free(w->fill->data);
+		free(w->fill);
+	}
+	while ((b = TAILQ_FIRST(&w->free_q))) {
+		TAILQ_REMOVE(&w->free_q, b, entry);
+		free(b->data);
+		free(b);
+	}
+	if (w->curl)
+		curl_easy_cleanup(w->curl);
+	curl_slist_free_all(w->headers);
+	if (w->spill_fd >= 0)
+		close(w->spill_fd);
+	free(w->container);
+	free(w);
+}
+
+static void *io_proc(void *arg)
+{
+	struct influx_writer *w, *next_w;
+	CURLMsg *msg;
+	uint64_t now, wait, tmo;
+	int running, nmsg;
+
+	while (1) {
+		now = now_ms();
+		tmo = batch_age;
+		pthread_mutex_lock(&cfg_lock);
+		w = LIST_FIRST(&writer_list);
+		while (w) {
+			next_w = LIST_NEXT(w, entry);
+			wait = writer_service(w, now);
+			if (wait < tmo)
+				tmo = wait;
+			pthread_mutex_lock(&w->lock);
+			if (w->closing && !w->inflight
+			    && (!w->fill || !w->fill->lines)
+			    && TAILQ_EMPTY(&w->ready)) {
+				/* close_store() frees the writer */
+				LIST_REMOVE(w, entry);
+				w->closed = 1;
+				pthread_cond_broadcast(&w->cond);
+			}
+			pthread_mutex_unlock(&w->lock);
+			w = next_w;
+		}
+		pthread_mutex_unlock(&cfg_lock);
+
+		curl_multi_perform(io_multi, &running);
+		while ((msg = curl_multi_info_read(io_multi, &nmsg))) {
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+			w = NULL;
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&w);
+			if (w)
+				writer_done(w, msg->data.result);
+			tmo = 0;
+		}
+		if (tmo)
+			curl_multi_poll(io_multi, NULL, 0, tmo, NULL);
+	}
+	return NULL;
+}
+
+static inline void io_wakeup(void)
+{
+	curl_multi_wakeup(io_multi);
+}
+
+/* Called with cfg_lock held */
+static struct influx_writer *writer_get(const char *container)
+{
+	struct influx_writer *w;
+
+	LIST_FOREACH(w, &writer_list, entry) {
+		if (!w->closing && 0 == strcmp(w->container, container)) {
+			w->ref++;
+			return w;
+		}
+	}
+	if (!io_thread_running) {
+		io_multi = curl_multi_init();
+		if (!io_multi)
+			return NULL;
+		if (pthread_create(&io_thread, NULL, io_proc, NULL)) {
+			curl_multi_cleanup(io_multi);
+			io_multi = NULL;
+			return NULL;
+		}
+		pthread_setname_np(io_thread, "influx:io");
+		io_thread_running = 1;
+	}
+	w = calloc(1, sizeof(*w));
+	if (!w)
+		return NULL;
+	w->container = strdup(container);
+	if (!w->container) {
+		free(w);
+		return NULL;
+	}
+	snprintf(w->url, sizeof(w->url), "http://%s/write?db=%s",
+		 host_port, container);
+	w->ref = 1;
+	w->spill_fd = -1;
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	TAILQ_INIT(&w->ready);
+	TAILQ_INIT(&w->free_q);
+	LIST_INSERT_HEAD(&writer_list, w, entry);
+	return w;
+}
+
+static void writer_put(struct influx_writer *w)
+{
+	pthread_mutex_lock(&cfg_lock);
+	if (--w->ref) {
+		pthread_mutex_unlock(&cfg_lock);
+		return;
+	}
+	pthread_mutex_lock(&w->lock);
+	w->closing = 1;
+	pthread_mutex_unlock(&cfg_lock);
+	io_wakeup();
+	while (!w->closed)
+		pthread_cond_wait(&w->cond, &w->lock);
+	pthread_mutex_unlock(&w->lock);
+	msglog(LDMSD_LINFO, "influx: '%s' posted %lu points in %lu posts, "
+	       "%lu failed posts, %lu points spilled, %lu points dropped.\n",
+	       w->container, w->points, w->posts, w->failures,
+	       w->spilled, w->dropped);
+	writer_free(w);
 }
 
 static ldmsd_store_handle_t
@@ -212,10 +888,9 @@ open_store(struct ldmsd_store *s, const char *container, const char *schema,
 {
 	struct influx_store *is = NULL;
 
-	is = malloc(sizeof(*is) + measurement_limit);
+	is = calloc(1, sizeof(*is));
 	if (!is)
 		goto out;
-	is->measurement_limit = measurement_limit;
 	pthread_mutex_init(&is->lock, NULL);
 	is->store = s;
 	is->ucontext = ucontext;
@@ -231,13 +906,17 @@ open_store(struct ldmsd_store *s, const char *container, const char *schema,
 	is->job_mid = -1;
 	is->comp_mid = -1;
 
-	is->curl = curl_easy_init();
-	if (!is->curl)
-		goto err3;
 	pthread_mutex_lock(&cfg_lock);
+	is->w = writer_get(container);
+	if (!is->w) {
+		pthread_mutex_unlock(&cfg_lock);
+		goto err4;
+	}
 	LIST_INSERT_HEAD(&store_list, is, entry);
 	pthread_mutex_unlock(&cfg_lock);
 	return is;
+ err4:
+	free(is->host_port);
  err3:
 	free(is->schema);
  err2:
@@ -277,10 +956,11 @@ static int init_store(struct influx_store *is, ldms_set_t set, int *mids, int co
 	is->metric_name = calloc(sizeof(char *), count);
 	if (!is->metric_name)
 		return ENOMEM;
+	is->metric_count = count;
 
 	/* Refactor metric names containing special characters */
 	for (i = 0; i < count; i++) {
-		char *name = strdup(ldms_metric_name_get(set, i));
+		char *name = strdup(ldms_metric_name_get(set, mids[i]));
 		if (!name)
 			return ENOMEM;
 		is->metric_name[i] = fixup(name);
@@ -288,72 +968,49 @@ static int init_store(struct influx_store *is, ldms_set_t set, int *mids, int co
 	return 0;
 }
 
-static size_t __element_byte_len_[] = {
-	[LDMS_V_NONE] = 0,
-	[LDMS_V_CHAR] = 1,
-	[LDMS_V_U8] = 1,
-	[LDMS_V_S8] = 1,
-	[LDMS_V_U16] = 2,
-	[LDMS_V_S16] = 2,
-	[LDMS_V_U32] = 4,
-	[LDMS_V_S32] = 4,
-	[LDMS_V_U64] = 8,
-	[LDMS_V_S64] = 8,
-	[LDMS_V_F32] = 4,
-	[LDMS_V_D64] = 8,
-	[LDMS_V_CHAR_ARRAY] = 1,
-	[LDMS_V_U8_ARRAY] = 1,
-	[LDMS_V_S8_ARRAY] = 1,
-	[LDMS_V_U16_ARRAY] = 2,
-	[LDMS_V_S16_ARRAY] = 2,
-	[LDMS_V_U32_ARRAY] = 4,
-	[LDMS_V_S32_ARRAY] = 4,
-	[LDMS_V_F32_ARRAY] = 4,
-	[LDMS_V_U64_ARRAY] = 8,
-	[LDMS_V_S64_ARRAY] = 8,
-	[LDMS_V_D64_ARRAY] = 8,
-};
-
-static inline size_t __element_byte_len(enum ldms_value_type t)
+static inline uint64_t tag_value(ldms_set_t set, int mid)
 {
-	if (t < LDMS_V_FIRST || t > LDMS_V_LAST)
-		assert(0 == "Invalid type specified");
-	return __element_byte_len_[t];
+	return (mid < 0 ? 0 : ldms_metric_get_u64(set, mid));
 }
 
 static int
 store(ldmsd_store_handle_t _sh, ldms_set_t set, int *metric_arry, size_t metric_count)
 {
 	struct influx_store *is = _sh;
+	struct influx_writer *w;
 	struct ldms_timestamp timestamp;
-	int i;
+	struct lp_batch *b;
+	int i, cnt;
 	int rc = 0;
-	size_t cnt, off;
-	char *measurement;
+	size_t line_off;
+	int wakeup = 0;
 	if (!is)
 		return EINVAL;
 
 	pthread_mutex_lock(&is->lock);
-	if (is->job_mid < 0) {
+	if (!is->metric_name) {
 		rc = init_store(is, set, metric_arry, metric_count);
 		if (rc)
 			goto err;
 	}
+	w = is->w;
 
-	char url[128];
-	snprintf(url, sizeof(url), "http://%s/write?db=%s", is->host_port, is->container);
-	curl_easy_setopt(is->curl, CURLOPT_URL, url);
-
-	struct curl_slist *headers = NULL;
-	headers = curl_slist_append(headers, "Content-Type: application/influx");
-
-	measurement = is->measurement;
-	cnt = snprintf(measurement, is->measurement_limit,
-		       "%s,job_id=%lui,component_id=%lui ",
-		       is->schema,
-		       ldms_metric_get_u64(set, is->job_mid),
-		       ldms_metric_get_u64(set, is->comp_mid));
-	off = cnt;
+	pthread_mutex_lock(&w->lock);
+	if (!w->fill) {
+		w->fill = batch_get(w);
+		if (!w->fill) {
+			pthread_mutex_unlock(&w->lock);
+			goto err;
+		}
+	}
+	b = w->fill;
+	line_off = b->len;
+	if (batch_reserve(b, strlen(is->schema) + 2 * VALUE_MAX))
+		goto err_w;
+	b->len += sprintf(&b->data[b->len], "%s,job_id=%lui,component_id=%lui ",
+			  is->schema,
+			  tag_value(set, is->job_mid),
+			  tag_value(set, is->comp_mid));
 
 	enum ldms_value_type metric_type;
 
@@ -369,52 +1026,84 @@ store(ldmsd_store_handle_t _sh, ldms_set_t set, int *metric_arry, size_t metric_
 			       "The metric %s:%s of type %s is not supported by "
 			       "InfluxDB and is being ignored.\n",
 			       is->schema,
-			       ldms_metric_type_to_str(metric_type),
-			       ldms_metric_name_get(set, metric_arry[i]));
+			       ldms_metric_name_get(set, metric_arry[i]),
+			       ldms_metric_type_to_str(metric_type));
 			continue;
 		}
-		if (comma) {
-			if (off > is->measurement_limit - 16)
-				goto err;
-			measurement[off++] = ',';
-		} else
+		if (batch_reserve(b, strlen(is->metric_name[i]) + 2 + VALUE_MAX))
+			goto err_w;
+		if (comma)
+			b->data[b->len++] = ',';
+		else
 			comma = 1;
-		cnt = snprintf(&measurement[off], is->measurement_limit - off,
-			       "%s=", is->metric_name[i]);
-		off += cnt;
-		if (influx_value_set[metric_type](measurement, &off,
-						  is->measurement_limit,
-						  set, metric_arry[i]))
-			goto err;
+		b->len += sprintf(&b->data[b->len], "%s=", is->metric_name[i]);
+		cnt = influx_value_set[metric_type](b, set, metric_arry[i]);
+		if (cnt >= 0 && cnt >= b->alloc - b->len) {
+			if (batch_reserve(b, cnt + 1))
+				goto err_w;
+			cnt = influx_value_set[metric_type](b, set, metric_arry[i]);
+		}
+		if (cnt < 0 || cnt >= b->alloc - b->len)
+			goto err_w;
+		b->len += cnt;
 	}
 	timestamp = ldms_transaction_timestamp_get(set);
 	long long int ts =  ((long long)timestamp.sec * 1000000000L)
 		+ ((long long)timestamp.usec * 1000L);
-	cnt = snprintf(&measurement[off], is->measurement_limit - off, " %lld", ts);
-	off += cnt;
-
-	curl_easy_setopt(is->curl, CURLOPT_POSTFIELDS, measurement);
-	curl_easy_setopt(is->curl, CURLOPT_POSTFIELDSIZE, off);
-	curl_easy_setopt(is->curl, CURLOPT_HTTPHEADER, headers);
-	curl_easy_perform(is->curl);
-	curl_slist_free_all(headers);
+	if (batch_reserve(b, VALUE_MAX))
+		goto err_w;
+	b->len += sprintf(&b->data[b->len], " %lld\n", ts);
+
+	if (!b->lines++)
+		w->fill_start = now_ms();
+	if (fill_full(w)) {
+		fill_ready(w);
+		wakeup = 1;
+	}
+	pthread_mutex_unlock(&w->lock);
 	pthread_mutex_unlock(&is->lock);
+	if (wakeup)
+		io_wakeup();
 	return 0;
+err_w:
+	/* Discard the partial line */
+	b->len = line_off;
+	pthread_mutex_unlock(&w->lock);
 err:
 	pthread_mutex_unlock(&is->lock);
 
-	msglog(LDMSD_LERROR, "Overflow formatting InfluxDB measurement data.\n");
+	msglog(LDMSD_LERROR, "Out of memory formatting InfluxDB measurement data.\n");
 	return ENOMEM;
 }
 
+/*
+ * Post everything that was stored before the call and wait for it to be
+ * posted, spilled or dropped.
+ */
 static int flush_store(ldmsd_store_handle_t _sh)
 {
+	struct influx_store *is = _sh;
+	struct influx_writer *w;
+	uint64_t gen;
+
+	if (!is)
+		return EINVAL;
+	w = is->w;
+	pthread_mutex_lock(&w->lock);
+	gen = ++w->flush_req;
+	pthread_mutex_unlock(&w->lock);
+	io_wakeup();
+	pthread_mutex_lock(&w->lock);
+	while (w->flush_done < gen && !w->closed)
+		pthread_cond_wait(&w->cond, &w->lock);
+	pthread_mutex_unlock(&w->lock);
 	return 0;
 }
 
 static void close_store(ldmsd_store_handle_t _sh)
 {
 	struct influx_store *is = _sh;
+	int i;
 
 	if (!is)
 		return;
@@ -423,6 +1112,13 @@ static void close_store(ldmsd_store_handle_t _sh)
 	LIST_REMOVE(is, entry);
 	pthread_mutex_unlock(&cfg_lock);
 
+	writer_put(is->w);
+	if (is->metric_name) {
+		for (i = 0; i < is->metric_count; i++)
+			free(is->metric_name[i]);
+		free(is->metric_name);
+	}
+	free(is->host_port);
 	free(is->container);
 	free(is->schema);
 	free(is);
@@ -460,6 +1156,7 @@ static void store_influx_init()
 {
 	curl_global_init(CURL_GLOBAL_DEFAULT);
 	LIST_INIT(&store_list);
+	LIST_INIT(&writer_list);
 }
 
 static void __attribute__ ((destructor)) store_influx_fini(void);
@@ -104,6 +104,10 @@ static const char *job_name_rank_time_attrs[] = { "job_id", "name", "rank", "tim
  *        }
  *     ]
  *  }
+ *
+ * The connector batches kernels into one message per publishing window.
+ * Batched items carry their own "timestamp", which takes precedence over
+ * the one of the message.
  */
 static struct sos_schema_template kokkos_appmon_template = {
 	.name = "kokkos_appmon4",
@@ -308,7 +312,7 @@ static int stream_recv_cb(ldmsd_stream_client_t c, void *ctxt,
 	int rc;
 	json_entity_t v, list, item;
 	uint64_t rank, job_id;
-	double timestamp, current_kernel_time, total_kernel_time;
+	double timestamp, item_timestamp, current_kernel_time, total_kernel_time;
 	uint64_t level, type, current_kernel_count, total_kernel_count;
 	char *name, *attr_name, *node_name;
 
@@ -356,6 +360,14 @@ static int stream_recv_cb(ldmsd_stream_client_t c, void *ctxt,
 			goto out;
 		name = json_value_str(v)->str;
 
+		item_timestamp = timestamp;
+		if (json_attr_find(item, "timestamp")) {
+			rc = get_json_value(item, "timestamp", JSON_STRING_VALUE, &v);
+			if (rc)
+				goto out;
+			item_timestamp = strtod(json_value_str(v)->str, NULL);
+		}
+
 		rc = get_json_value(item, "type", JSON_INT_VALUE, &v);
 		if (rc)
 			goto out;
@@ -394,7 +406,7 @@ static int stream_recv_cb(ldmsd_stream_client_t c, void *ctxt,
 			       kokkos_store.name, errno);
 			goto out;
 		}
-		sos_obj_attr_by_id_set(obj, TIMESTAMP_ID, timestamp);
+		sos_obj_attr_by_id_set(obj, TIMESTAMP_ID, item_timestamp);
 		sos_obj_attr_by_id_set(obj, JOB_ID, job_id);
 		sos_obj_attr_by_id_set(obj, NODE_NAME_ID, strlen(node_name), node_name);
 		sos_obj_attr_by_id_set(obj, RANK_ID, rank);
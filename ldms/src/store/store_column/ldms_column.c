@@ -0,0 +1,215 @@
+/**
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file ldms_column.c
+ * \brief Reader of the store_column segments.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ldms_column.h"
+
+struct ldms_column_map_s {
+	int fd;
+	void *addr;
+	size_t len;
+};
+
+struct ldms_column_seg_s {
+	char *dir;
+	struct ldms_column_hdr_s *hdr;
+	size_t hdr_len;
+	struct ldms_column_map_s *maps;
+};
+
+ldms_column_seg_t ldms_column_seg_open(const char *dir)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	ldms_column_seg_t seg;
+	int fd = -1, i, rc;
+
+	seg = calloc(1, sizeof(*seg));
+	if (!seg)
+		return NULL;
+	seg->dir = strdup(dir);
+	if (!seg->dir)
+		goto err;
+	snprintf(path, sizeof(path), "%s/%s", dir, LDMS_COLUMN_HDR_FILE);
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st))
+		goto err;
+	if (st.st_size < sizeof(*seg->hdr)) {
+		errno = EINVAL;
+		goto err;
+	}
+	seg->hdr_len = st.st_size;
+	seg->hdr = mmap(NULL, seg->hdr_len, PROT_READ, MAP_SHARED, fd, 0);
+	if (seg->hdr == MAP_FAILED) {
+		seg->hdr = NULL;
+		goto err;
+	}
+	close(fd);
+	fd = -1;
+	if (memcmp(seg->hdr->magic, LDMS_COLUMN_MAGIC, sizeof(LDMS_COLUMN_MAGIC))
+	    || seg->hdr->version != LDMS_COLUMN_VERSION
+	    || seg->hdr_len < sizeof(*seg->hdr) +
+			seg->hdr->col_count * sizeof(seg->hdr->cols[0])) {
+		errno = EINVAL;
+		goto err;
+	}
+	seg->maps = calloc(seg->hdr->col_count, sizeof(*seg->maps));
+	if (!seg->maps)
+		goto err;
+	for (i = 0; i < seg->hdr->col_count; i++)
+		seg->maps[i].fd = -1;
+	return seg;
+
+ err:
+	rc = errno;
+	if (fd >= 0)
+		close(fd);
+	if (seg->hdr)
+		munmap(seg->hdr, seg->hdr_len);
+	free(seg->dir);
+	free(seg);
+	errno = rc;
+	return NULL;
+}
+
+void ldms_column_seg_close(ldms_column_seg_t seg)
+{
+	int i;
+
+	if (!seg)
+		return;
+	for (i = 0; seg->maps && i < seg->hdr->col_count; i++) {
+		if (seg->maps[i].addr)
+			munmap(seg->maps[i].addr, seg->maps[i].len);
+		if (seg->maps[i].fd >= 0)
+			close(seg->maps[i].fd);
+	}
+	free(seg->maps);
+	munmap(seg->hdr, seg->hdr_len);
+	free(seg->dir);
+	free(seg);
+}
+
+const struct ldms_column_hdr_s *ldms_column_seg_hdr(ldms_column_seg_t seg)
+{
+	return seg->hdr;
+}
+
+uint64_t ldms_column_seg_rows(ldms_column_seg_t seg)
+{
+	return __atomic_load_n(&seg->hdr->row_count, __ATOMIC_ACQUIRE);
+}
+
+int ldms_column_find(ldms_column_seg_t seg, const char *name)
+{
+	int i;
+	for (i = 0; i < seg->hdr->col_count; i++) {
+		if (0 == strncmp(seg->hdr->cols[i].name, name,
+				 LDMS_COLUMN_NAME_LEN))
+			return i;
+	}
+	return -1;
+}
+
+const void *ldms_column_map(ldms_column_seg_t seg, int idx, uint64_t *rows)
+{
+	struct ldms_column_map_s *m;
+	char path[PATH_MAX];
+	struct stat st;
+	uint64_t n;
+	size_t width;
+
+	if (idx < 0 || idx >= seg->hdr->col_count) {
+		errno = EINVAL;
+		return NULL;
+	}
+	m = &seg->maps[idx];
+	width = seg->hdr->cols[idx].width;
+	if (m->fd < 0) {
+		snprintf(path, sizeof(path), "%s/%04d.col", seg->dir, idx);
+		m->fd = open(path, O_RDONLY);
+		if (m->fd < 0)
+			return NULL;
+	}
+	if (fstat(m->fd, &st))
+		return NULL;
+	/* the file may be preallocated past the last complete row */
+	n = ldms_column_seg_rows(seg);
+	if (width && n > st.st_size / width)
+		n = st.st_size / width;
+	if (!n || !width) {
+		errno = ENODATA;
+		return NULL;
+	}
+	if (m->addr && m->len >= n * width)
+		goto out;
+	if (m->addr)
+		munmap(m->addr, m->len);
+	m->len = n * width;
+	m->addr = mmap(NULL, m->len, PROT_READ, MAP_SHARED, m->fd, 0);
+	if (m->addr == MAP_FAILED) {
+		m->addr = NULL;
+		return NULL;
+	}
+	madvise(m->addr, m->len, MADV_SEQUENTIAL);
+ out:
+	*rows = n;
+	return m->addr;
+}
@@ -0,0 +1,153 @@
+/**
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file ldms_column.h
+ * \brief On-disk format of store_column and the column reader.
+ *
+ * store_column writes the rows of a decomposition row schema into a
+ * segment directory:
+ *
+ * \code
+ * <path>/<container>/<schema>-<digest>[.<epoch>]/
+ *     HEADER     struct ldms_column_hdr_s + col_count column descriptors
+ *     0000.col   fixed-width values of column 0, one per row
+ *     0001.col   ...
+ * \endcode
+ *
+ * Column \c i of row \c r is at offset \c r*width in its column file. All
+ * values are little-endian. A timestamp is two 32-bit words, seconds then
+ * microseconds. A char array is NUL-padded to the column width.
+ *
+ * \c row_count in the header is updated after a row has been written to
+ * every column file, so a reader may scan a segment that is still being
+ * written and see only complete rows.
+ */
+#ifndef __LDMS_COLUMN_H__
+#define __LDMS_COLUMN_H__
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LDMS_COLUMN_MAGIC	"LDMSCOL"
+#define LDMS_COLUMN_VERSION	1
+#define LDMS_COLUMN_NAME_LEN	128
+#define LDMS_COLUMN_HDR_FILE	"HEADER"
+
+struct ldms_column_desc_s {
+	char name[LDMS_COLUMN_NAME_LEN];
+	uint32_t type;		/* enum ldms_value_type */
+	uint32_t array_len;	/* elements per row, 1 for scalars */
+	uint32_t width;		/* bytes per row */
+	uint32_t reserved;
+};
+
+struct ldms_column_hdr_s {
+	char magic[8];		/* LDMS_COLUMN_MAGIC */
+	uint32_t version;	/* LDMS_COLUMN_VERSION */
+	uint32_t col_count;
+	uint64_t row_count;	/* complete rows in every column file */
+	uint8_t digest[32];	/* row schema digest */
+	char schema[LDMS_COLUMN_NAME_LEN];
+	struct ldms_column_desc_s cols[];
+};
+
+typedef struct ldms_column_seg_s *ldms_column_seg_t;
+
+/**
+ * \brief Open a segment directory for reading
+ *
+ * Only the header is read. Column files are opened on demand.
+ *
+ * \param dir The segment directory
+ * \returns The segment handle, or NULL with \c errno set.
+ */
+ldms_column_seg_t ldms_column_seg_open(const char *dir);
+
+/** \brief Unmap the columns and free the segment handle */
+void ldms_column_seg_close(ldms_column_seg_t seg);
+
+/** \brief The segment header, including the column descriptors */
+const struct ldms_column_hdr_s *ldms_column_seg_hdr(ldms_column_seg_t seg);
+
+/**
+ * \brief The number of complete rows
+ *
+ * The count is re-read from the header, so it grows while the store is
+ * appending to the segment.
+ */
+uint64_t ldms_column_seg_rows(ldms_column_seg_t seg);
+
+/**
+ * \brief Find a column by name
+ * \returns The column index, or -1 if there is no such column.
+ */
+int ldms_column_find(ldms_column_seg_t seg, const char *name);
+
+/**
+ * \brief Map the values of one column
+ *
+ * Only the file of column \c idx is touched. The returned pointer stays
+ * valid until the next call for the same column or until the segment is
+ * closed.
+ *
+ * \param seg The segment handle
+ * \param idx The column index
+ * \param[out] rows The number of rows available at the returned address
+ * \returns The address of the value of row 0, or NULL with \c errno set
+ *          (ENODATA if the segment has no rows yet).
+ */
+const void *ldms_column_map(ldms_column_seg_t seg, int idx, uint64_t *rows);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,347 @@
+/**
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file ldms_column_dump.c
+ * \brief Print or summarize the columns of a store_column segment.
+ *
+ * Only the files of the selected columns are read.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <float.h>
+#include <endian.h>
+#include <getopt.h>
+#include "ldms_core.h"
+#include "ldms_column.h"
+
+static const char *type_names[] = {
+	[LDMS_V_CHAR]       = "char",
+	[LDMS_V_U8]         = "u8",
+	[LDMS_V_S8]         = "s8",
+	[LDMS_V_U16]        = "u16",
+	[LDMS_V_S16]        = "s16",
+	[LDMS_V_U32]        = "u32",
+	[LDMS_V_S32]        = "s32",
+	[LDMS_V_U64]        = "u64",
+	[LDMS_V_S64]        = "s64",
+	[LDMS_V_F32]        = "f32",
+	[LDMS_V_D64]        = "d64",
+	[LDMS_V_CHAR_ARRAY] = "char[]",
+	[LDMS_V_U8_ARRAY]   = "u8[]",
+	[LDMS_V_S8_ARRAY]   = "s8[]",
+	[LDMS_V_U16_ARRAY]  = "u16[]",
+	[LDMS_V_S16_ARRAY]  = "s16[]",
+	[LDMS_V_U32_ARRAY]  = "u32[]",
+	[LDMS_V_S32_ARRAY]  = "s32[]",
+	[LDMS_V_U64_ARRAY]  = "u64[]",
+	[LDMS_V_S64_ARRAY]  = "s64[]",
+	[LDMS_V_F32_ARRAY]  = "f32[]",
+	[LDMS_V_D64_ARRAY]  = "d64[]",
+	[LDMS_V_TIMESTAMP]  = "timestamp",
+};
+
+static const char *type_name(uint32_t type)
+{
+	if (type > LDMS_V_LAST || !type_names[type])
+		return "unknown";
+	return type_names[type];
+}
+
+static void usage(const char *argv0)
+{
+	printf("usage: %s [-H] [-a] [-c COL,COL,...] [-s SEP] SEGMENT_DIR\n"
+	       "    -H  print the segment header\n"
+	       "    -a  print count/min/max/mean of the selected columns\n"
+	       "        instead of the rows\n"
+	       "    -c  the columns to read, by name or index (default: all)\n"
+	       "    -s  the field separator (default: ',')\n", argv0);
+}
+
+/* Element \c i of a column value as a double, for the summaries. */
+static double elem_double(uint32_t type, const void *v, int i)
+{
+	switch (type) {
+	case LDMS_V_CHAR:
+	case LDMS_V_S8:
+	case LDMS_V_S8_ARRAY:
+		return ((const int8_t *)v)[i];
+	case LDMS_V_U8:
+	case LDMS_V_U8_ARRAY:
+		return ((const uint8_t *)v)[i];
+	case LDMS_V_U16:
+	case LDMS_V_U16_ARRAY:
+		return le16toh(((const uint16_t *)v)[i]);
+	case LDMS_V_S16:
+	case LDMS_V_S16_ARRAY:
+		return (int16_t)le16toh(((const uint16_t *)v)[i]);
+	case LDMS_V_U32:
+	case LDMS_V_U32_ARRAY:
+		return le32toh(((const uint32_t *)v)[i]);
+	case LDMS_V_S32:
+	case LDMS_V_S32_ARRAY:
+		return (int32_t)le32toh(((const uint32_t *)v)[i]);
+	case LDMS_V_U64:
+	case LDMS_V_U64_ARRAY:
+		return le64toh(((const uint64_t *)v)[i]);
+	case LDMS_V_S64:
+	case LDMS_V_S64_ARRAY:
+		return (int64_t)le64toh(((const uint64_t *)v)[i]);
+	case LDMS_V_F32:
+	case LDMS_V_F32_ARRAY:
+		return ((const float *)v)[i];
+	case LDMS_V_D64:
+	case LDMS_V_D64_ARRAY:
+		return ((const double *)v)[i];
+	case LDMS_V_TIMESTAMP:
+		return le32toh(((const uint32_t *)v)[0]) +
+		       le32toh(((const uint32_t *)v)[1]) / 1e6;
+	}
+	return 0;
+}
+
+static void print_value(const struct ldms_column_desc_s *d, const void *v,
+			const char *sep)
+{
+	const uint32_t *ts;
+	int i, n;
+
+	switch (d->type) {
+	case LDMS_V_CHAR_ARRAY:
+		printf("%.*s", (int)d->width, (const char *)v);
+		return;
+	case LDMS_V_TIMESTAMP:
+		ts = v;
+		printf("%u.%06u", le32toh(ts[0]), le32toh(ts[1]));
+		return;
+	case LDMS_V_F32:
+	case LDMS_V_F32_ARRAY:
+	case LDMS_V_D64:
+	case LDMS_V_D64_ARRAY:
+		n = d->array_len;
+		for (i = 0; i < n; i++)
+			printf("%s%.17g", i ? sep : "", elem_double(d->type, v, i));
+		return;
+	case LDMS_V_U64:
+	case LDMS_V_U64_ARRAY:
+		n = d->array_len;
+		for (i = 0; i < n; i++)
+			printf("%s%" PRIu64, i ? sep : "",
+			       le64toh(((const uint64_t *)v)[i]));
+		return;
+	default:
+		n = d->array_len;
+		for (i = 0; i < n; i++)
+			printf("%s%.0f", i ? sep : "", elem_double(d->type, v, i));
+		return;
+	}
+}
+
+static void print_header(ldms_column_seg_t seg)
+{
+	const struct ldms_column_hdr_s *hdr = ldms_column_seg_hdr(seg);
+	int i;
+
+	printf("schema: %.*s\n", LDMS_COLUMN_NAME_LEN, hdr->schema);
+	printf("digest: ");
+	for (i = 0; i < sizeof(hdr->digest); i++)
+		printf("%02X", hdr->digest[i]);
+	printf("\nrows: %" PRIu64 "\n", ldms_column_seg_rows(seg));
+	for (i = 0; i < hdr->col_count; i++)
+		printf("%4d %-32.*s %-10s %6u %6u\n", i, LDMS_COLUMN_NAME_LEN,
+		       hdr->cols[i].name, type_name(hdr->cols[i].type),
+		       hdr->cols[i].array_len, hdr->cols[i].width);
+}
+
+static int summarize(ldms_column_seg_t seg, int idx)
+{
+	const struct ldms_column_desc_s *d = &ldms_column_seg_hdr(seg)->cols[idx];
+	const char *base;
+	uint64_t r, rows;
+	double v, min = DBL_MAX, max = -DBL_MAX, sum = 0;
+	int i;
+
+	if (d->type == LDMS_V_CHAR_ARRAY) {
+		printf("%-32.*s (not numeric)\n", LDMS_COLUMN_NAME_LEN, d->name);
+		return 0;
+	}
+	base = ldms_column_map(seg, idx, &rows);
+	if (!base)
+		return errno == ENODATA ? 0 : errno;
+	for (r = 0; r < rows; r++) {
+		for (i = 0; i < d->array_len; i++) {
+			v = elem_double(d->type, base + r * d->width, i);
+			if (v < min)
+				min = v;
+			if (v > max)
+				max = v;
+			sum += v;
+		}
+	}
+	printf("%-32.*s %12" PRIu64 " %20.17g %20.17g %20.17g\n",
+	       LDMS_COLUMN_NAME_LEN, d->name, rows * d->array_len, min, max,
+	       sum / (rows * d->array_len));
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const struct ldms_column_hdr_s *hdr;
+	ldms_column_seg_t seg;
+	const char *sep = ",";
+	char *cols = NULL, *tok, *ptr, *end;
+	int *sel = NULL, nsel = 0, show_hdr = 0, aggr = 0;
+	const char **bases = NULL;
+	uint64_t r, rows, n;
+	int opt, i, rc = 0;
+
+	while ((opt = getopt(argc, argv, "Hac:s:")) != -1) {
+		switch (opt) {
+		case 'H':
+			show_hdr = 1;
+			break;
+		case 'a':
+			aggr = 1;
+			break;
+		case 'c':
+			cols = optarg;
+			break;
+		case 's':
+			sep = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	seg = ldms_column_seg_open(argv[optind]);
+	if (!seg) {
+		fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+		return 1;
+	}
+	hdr = ldms_column_seg_hdr(seg);
+	if (show_hdr) {
+		print_header(seg);
+		goto out;
+	}
+
+	sel = calloc(hdr->col_count + 1, sizeof(*sel));
+	bases = calloc(hdr->col_count + 1, sizeof(*bases));
+	if (!sel || !bases) {
+		rc = ENOMEM;
+		goto out;
+	}
+	if (cols) {
+		for (tok = strtok_r(cols, ",", &ptr); tok;
+		     tok = strtok_r(NULL, ",", &ptr)) {
+			i = ldms_column_find(seg, tok);
+			if (i < 0) {
+				i = strtol(tok, &end, 0);
+				if (*end || i < 0 || i >= hdr->col_count) {
+					fprintf(stderr, "no column '%s'\n", tok);
+					rc = ENOENT;
+					goto out;
+				}
+			}
+			if (nsel < hdr->col_count)
+				sel[nsel++] = i;
+		}
+	} else {
+		for (i = 0; i < hdr->col_count; i++)
+			sel[nsel++] = i;
+	}
+
+	if (aggr) {
+		printf("%-32s %12s %20s %20s %20s\n",
+		       "column", "count", "min", "max", "mean");
+		for (i = 0; i < nsel && !rc; i++)
+			rc = summarize(seg, sel[i]);
+		goto out;
+	}
+
+	/* the row count is sampled once so that every column agrees */
+	rows = ldms_column_seg_rows(seg);
+	for (i = 0; i < nsel; i++) {
+		bases[i] = ldms_column_map(seg, sel[i], &n);
+		if (!bases[i]) {
+			if (errno == ENODATA)
+				goto out;
+			rc = errno;
+			goto out;
+		}
+		if (n < rows)
+			rows = n;
+	}
+	for (i = 0; i < nsel; i++)
+		printf("%s%.*s", i ? sep : "#", LDMS_COLUMN_NAME_LEN,
+		       hdr->cols[sel[i]].name);
+	printf("\n");
+	for (r = 0; r < rows; r++) {
+		for (i = 0; i < nsel; i++) {
+			if (i)
+				printf("%s", sep);
+			print_value(&hdr->cols[sel[i]],
+				    bases[i] + r * hdr->cols[sel[i]].width, sep);
+		}
+		printf("\n");
+	}
+ out:
+	if (rc)
+		fprintf(stderr, "error: %s\n", strerror(rc));
+	free(sel);
+	free(bases);
+	ldms_column_seg_close(seg);
+	return rc ? 1 : 0;
+}
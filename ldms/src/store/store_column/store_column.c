@@ -0,0 +1,934 @@
+/**
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file store_column.c
+ * \brief Binary columnar store for decomposed rows.
+ *
+ * Each row schema (name and digest) of a container gets a segment
+ * directory with one fixed-width file per column. The column files are
+ * grown in steps of \c grow_rows rows and written through a shared
+ * mapping, so appending a row is a copy per column. See ldms_column.h for
+ * the file format.
+ */
+#define _GNU_SOURCE
+#include <sys/queue.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <endian.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <coll/rbt.h>
+#include "ovis_util/util.h"
+#include "ldms.h"
+#include "ldmsd.h"
+#include "ldms_column.h"
+
+#define PNAME "store_column"
+
+static ldmsd_msg_log_f msglog;
+#define LOG_(LVL, FMT, ...) msglog(LVL, PNAME ": " FMT, ## __VA_ARGS__)
+
+/* Same roll policies as store_csv */
+#define MINROLLTYPE 1
+#define MAXROLLTYPE 5
+#define MIN_ROLL_1 10
+#define MIN_ROLL_RECORDS 3
+#define MIN_ROLL_BYTES 1024
+#define ROLL_LIMIT_INTERVAL 60
+
+#define DEFAULT_CHAR_WIDTH 64
+#define DEFAULT_GROW_ROWS 4096
+#define LOST_LOG_INTERVAL 60	/* seconds between lost-row messages */
+
+static pthread_mutex_t cfg_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *root_path;
+static int rollover;
+static int rollagain;
+static int rolltype = -1;
+static bool rollempty = true;
+static int char_width = DEFAULT_CHAR_WIDTH;
+static int grow_rows = DEFAULT_GROW_ROWS;
+static pthread_t rothread;
+static int rothread_used;
+
+struct col_file {
+	int fd;
+	char *map;
+	size_t map_len;
+};
+
+/* The column files of a row schema in a container; shared by strgps. */
+typedef struct col_store_s {
+	struct rbn rbn;
+	char *base;		/* <path>/<container>/<schema>-<digest> */
+	int ref;		/* protected by cfg_lock */
+	pthread_mutex_t lock;
+	char *dir;		/* the current segment directory */
+	time_t otime;
+	int col_count;
+	struct ldms_column_desc_s *desc;
+	char schema[LDMS_COLUMN_NAME_LEN];
+	struct ldms_digest_s digest;
+	struct ldms_column_hdr_s *hdr;	/* mapped HEADER of the segment */
+	size_t hdr_len;
+	struct col_file *files;
+	uint64_t store_count;	/* rows since the last roll */
+	uint64_t byte_count;	/* bytes since the last roll */
+	int len_warned;
+	uint64_t lost_rows;	/* rows that could not be stored */
+	time_t lost_log_time;	/* when lost rows were last logged */
+} *col_store_t;
+
+static int base_cmp(void *tree_key, const void *key)
+{
+	return strcmp(tree_key, key);
+}
+
+static struct rbt col_store_tree = RBT_INITIALIZER(base_cmp);
+
+struct col_schema_key_s {
+	const struct ldms_digest_s *digest;
+	const char *name;
+};
+
+static int col_schema_key_cmp(void *tree_key, const void *key)
+{
+	int ret;
+	const struct col_schema_key_s *tk = tree_key, *k = key;
+	ret = memcmp(tk->digest, k->digest, sizeof(*tk->digest));
+	if (ret)
+		return ret;
+	return strcmp(tk->name, k->name);
+}
+
+struct col_schema_rbn_s {
+	struct rbn rbn;
+	struct col_schema_key_s key;
+	struct ldms_digest_s digest;
+	char name[LDMS_COLUMN_NAME_LEN];
+	col_store_t cs;
+};
+
+/* This is `strgp->store_handle` */
+typedef struct col_strgp_handle_s {
+	struct rbt schema_rbt;
+} *col_strgp_handle_t;
+
+static const size_t __elem_sz[] = {
+	[LDMS_V_CHAR]       = 1,
+	[LDMS_V_U8]         = 1,
+	[LDMS_V_S8]         = 1,
+	[LDMS_V_U16]        = 2,
+	[LDMS_V_S16]        = 2,
+	[LDMS_V_U32]        = 4,
+	[LDMS_V_S32]        = 4,
+	[LDMS_V_U64]        = 8,
+	[LDMS_V_S64]        = 8,
+	[LDMS_V_F32]        = 4,
+	[LDMS_V_D64]        = 8,
+	[LDMS_V_CHAR_ARRAY] = 1,
+	[LDMS_V_U8_ARRAY]   = 1,
+	[LDMS_V_S8_ARRAY]   = 1,
+	[LDMS_V_U16_ARRAY]  = 2,
+	[LDMS_V_S16_ARRAY]  = 2,
+	[LDMS_V_U32_ARRAY]  = 4,
+	[LDMS_V_S32_ARRAY]  = 4,
+	[LDMS_V_U64_ARRAY]  = 8,
+	[LDMS_V_S64_ARRAY]  = 8,
+	[LDMS_V_F32_ARRAY]  = 4,
+	[LDMS_V_D64_ARRAY]  = 8,
+	[LDMS_V_TIMESTAMP]  = 8,
+	[LDMS_V_LAST+1]     = 0,
+};
+
+static int col_desc_init(struct ldms_column_desc_s *d, ldmsd_col_t col)
+{
+	size_t esz = col->type <= LDMS_V_LAST ? __elem_sz[col->type] : 0;
+
+	if (!esz) {
+		LOG_(LDMSD_LERROR, "column '%s': unsupported type %s\n",
+		     col->name, ldms_metric_type_to_str(col->type));
+		return EINVAL;
+	}
+	memset(d, 0, sizeof(*d));
+	snprintf(d->name, sizeof(d->name), "%s", col->name);
+	d->type = col->type;
+	if (col->type == LDMS_V_CHAR_ARRAY) {
+		d->array_len = col->array_len < char_width ?
+				char_width : col->array_len;
+		d->width = d->array_len;
+	} else if (ldms_type_is_array(col->type)) {
+		d->array_len = col->array_len;
+		d->width = esz * col->array_len;
+	} else {
+		d->array_len = 1;
+		d->width = esz;
+	}
+	return 0;
+}
+
+/*
+ * Grow the file and its mapping to \c need bytes, in steps of grow_rows
+ * rows. The blocks are allocated before they are mapped, so a full file
+ * system fails here instead of raising SIGBUS on a store.
+ */
+static int col_file_grow(struct col_file *f, size_t need, size_t width)
+{
+	size_t step = (size_t)grow_rows * width;
+	size_t len;
+	char *map;
+	int rc;
+
+	len = (need + step - 1) / step * step;
+	rc = posix_fallocate(f->fd, 0, len);
+	if (rc)
+		return rc;
+	map = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, f->fd, 0);
+	if (map == MAP_FAILED)
+		return errno;
+	if (f->map)
+		munmap(f->map, f->map_len);
+	f->map = map;
+	f->map_len = len;
+	return 0;
+}
+
+/* caller must hold cs->lock */
+static void col_seg_close(col_store_t cs)
+{
+	uint64_t rows;
+	int i;
+
+	if (!cs->hdr)
+		return;
+	rows = cs->hdr->row_count;
+	for (i = 0; cs->files && i < cs->col_count; i++) {
+		if (cs->files[i].map)
+			munmap(cs->files[i].map, cs->files[i].map_len);
+		if (cs->files[i].fd >= 0) {
+			/* drop the preallocated tail */
+			if (ftruncate(cs->files[i].fd, rows * cs->desc[i].width))
+				LOG_(LDMSD_LERROR, "cannot truncate column %d "
+				     "of '%s', errno: %d\n", i, cs->dir, errno);
+			close(cs->files[i].fd);
+		}
+	}
+	free(cs->files);
+	cs->files = NULL;
+	msync(cs->hdr, cs->hdr_len, MS_SYNC);
+	munmap(cs->hdr, cs->hdr_len);
+	cs->hdr = NULL;
+	free(cs->dir);
+	cs->dir = NULL;
+}
+
+/* caller must hold cs->lock */
+static int col_seg_open(col_store_t cs, time_t otime)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	struct col_file *f;
+	int fd, i, rc, exist;
+
+	if (rolltype >= MINROLLTYPE)
+		rc = asprintf(&cs->dir, "%s.%ld", cs->base, otime);
+	else
+		rc = asprintf(&cs->dir, "%s", cs->base);
+	if (rc < 0) {
+		cs->dir = NULL;
+		return ENOMEM;
+	}
+	rc = f_mkdir_p(cs->dir, 0755);
+	if (rc && rc != EEXIST) {
+		LOG_(LDMSD_LERROR, "cannot create '%s', errno: %d\n",
+		     cs->dir, rc);
+		goto err_0;
+	}
+	cs->otime = otime;
+
+	/* HEADER */
+	cs->hdr_len = sizeof(*cs->hdr) + cs->col_count * sizeof(cs->desc[0]);
+	snprintf(path, sizeof(path), "%s/%s", cs->dir, LDMS_COLUMN_HDR_FILE);
+	fd = open(path, O_RDWR|O_CREAT, LDMSD_DEFAULT_FILE_PERM);
+	if (fd < 0 || fstat(fd, &st)) {
+		rc = errno;
+		LOG_(LDMSD_LERROR, "cannot open '%s', errno: %d\n", path, rc);
+		if (fd >= 0)
+			close(fd);
+		goto err_0;
+	}
+	exist = st.st_size > 0;
+	if (exist && st.st_size != cs->hdr_len) {
+		rc = EEXIST;
+		LOG_(LDMSD_LERROR, "'%s' has a different layout\n", path);
+		close(fd);
+		goto err_0;
+	}
+	if (!exist && ftruncate(fd, cs->hdr_len)) {
+		rc = errno;
+		close(fd);
+		goto err_0;
+	}
+	cs->hdr = mmap(NULL, cs->hdr_len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (cs->hdr == MAP_FAILED) {
+		rc = errno;
+		cs->hdr = NULL;
+		goto err_0;
+	}
+	if (exist) {
+		/* continue a segment from a previous run */
+		if (memcmp(cs->hdr->magic, LDMS_COLUMN_MAGIC, sizeof(LDMS_COLUMN_MAGIC))
+		    || cs->hdr->version != LDMS_COLUMN_VERSION
+		    || cs->hdr->col_count != cs->col_count
+		    || memcmp(cs->hdr->cols, cs->desc,
+			      cs->col_count * sizeof(cs->desc[0]))) {
+			rc = EEXIST;
+			LOG_(LDMSD_LERROR, "'%s' has a different layout\n", path);
+			goto err_1;
+		}
+	} else {
+		memcpy(cs->hdr->magic, LDMS_COLUMN_MAGIC, sizeof(LDMS_COLUMN_MAGIC));
+		cs->hdr->version = LDMS_COLUMN_VERSION;
+		cs->hdr->col_count = cs->col_count;
+		cs->hdr->row_count = 0;
+		memcpy(cs->hdr->digest, cs->digest.digest, sizeof(cs->hdr->digest));
+		snprintf(cs->hdr->schema, sizeof(cs->hdr->schema), "%s", cs->schema);
+		memcpy(cs->hdr->cols, cs->desc, cs->col_count * sizeof(cs->desc[0]));
+	}
+
+	/* column files */
+	cs->files = calloc(cs->col_count, sizeof(*cs->files));
+	if (!cs->files) {
+		rc = ENOMEM;
+		goto err_1;
+	}
+	for (i = 0; i < cs->col_count; i++)
+		cs->files[i].fd = -1;
+	for (i = 0; i < cs->col_count; i++) {
+		f = &cs->files[i];
+		snprintf(path, sizeof(path), "%s/%04d.col", cs->dir, i);
+		f->fd = open(path, O_RDWR|O_CREAT, LDMSD_DEFAULT_FILE_PERM);
+		if (f->fd < 0) {
+			rc = errno;
+			LOG_(LDMSD_LERROR, "cannot open '%s', errno: %d\n",
+			     path, rc);
+			goto err_2;
+		}
+		rc = col_file_grow(f, (cs->hdr->row_count + 1) * cs->desc[i].width,
+				   cs->desc[i].width);
+		if (rc) {
+			LOG_(LDMSD_LERROR, "cannot map '%s', errno: %d\n",
+			     path, rc);
+			goto err_2;
+		}
+	}
+	return 0;
+
+ err_2:
+	col_seg_close(cs);
+	return rc;
+ err_1:
+	munmap(cs->hdr, cs->hdr_len);
+	cs->hdr = NULL;
+ err_0:
+	free(cs->dir);
+	cs->dir = NULL;
+	return rc;
+}
+
+/* caller must hold cfg_lock */
+static col_store_t col_store_get(const char *container, ldmsd_row_t row)
+{
+	char dstr[2*LDMS_DIGEST_LENGTH+1];
+	col_store_t cs;
+	char *base;
+	int i, rc;
+
+	ldms_digest_str((ldms_digest_t)row->schema_digest, dstr, sizeof(dstr));
+	/* 64 bits of the digest are enough to tell the layouts apart */
+	dstr[16] = 0;
+	if (asprintf(&base, "%s/%s/%s-%s", root_path, container,
+		     row->schema_name, dstr) < 0)
+		return NULL;
+	cs = (void *)rbt_find(&col_store_tree, base);
+	if (cs) {
+		free(base);
+		cs->ref++;
+		return cs;
+	}
+
+	cs = calloc(1, sizeof(*cs));
+	if (!cs)
+		goto err_0;
+	cs->base = base;
+	cs->ref = 1;
+	pthread_mutex_init(&cs->lock, NULL);
+	snprintf(cs->schema, sizeof(cs->schema), "%s", row->schema_name);
+	memcpy(&cs->digest, row->schema_digest, sizeof(cs->digest));
+	cs->col_count = row->col_count;
+	cs->desc = calloc(row->col_count, sizeof(*cs->desc));
+	if (!cs->desc)
+		goto err_1;
+	for (i = 0; i < row->col_count; i++) {
+		rc = col_desc_init(&cs->desc[i], &row->cols[i]);
+		if (rc)
+			goto err_2;
+	}
+	rc = col_seg_open(cs, time(NULL));
+	if (rc)
+		goto err_2;
+	rbn_init(&cs->rbn, cs->base);
+	rbt_ins(&col_store_tree, &cs->rbn);
+	return cs;
+
+ err_2:
+	free(cs->desc);
+ err_1:
+	pthread_mutex_destroy(&cs->lock);
+	free(cs);
+ err_0:
+	free(base);
+	return NULL;
+}
+
+/* caller must hold cfg_lock */
+static void col_store_put(col_store_t cs)
+{
+	if (--cs->ref)
+		return;
+	rbt_del(&col_store_tree, &cs->rbn);
+	pthread_mutex_lock(&cs->lock);
+	if (cs->lost_rows)
+		LOG_(LDMSD_LERROR, "'%s': %" PRIu64 " rows were not stored\n",
+		     cs->base, cs->lost_rows);
+	col_seg_close(cs);
+	pthread_mutex_unlock(&cs->lock);
+	pthread_mutex_destroy(&cs->lock);
+	free(cs->desc);
+	free(cs->base);
+	free(cs);
+}
+
+/* caller must hold cs->lock */
+static int col_store_row(col_store_t cs, ldmsd_row_t row)
+{
+	struct ldms_column_desc_s *d;
+	ldmsd_col_t col;
+	uint64_t r;
+	uint32_t *ts;
+	char *dst;
+	size_t n, off;
+	int i, rc;
+
+	if (!cs->hdr)
+		return ENOENT; /* a roll failed to open the new segment */
+	if (row->col_count != cs->col_count)
+		return EINVAL;
+	r = cs->hdr->row_count;
+	for (i = 0; i < cs->col_count; i++) {
+		d = &cs->desc[i];
+		col = &row->cols[i];
+		off = r * d->width;
+		if (off + d->width > cs->files[i].map_len) {
+			rc = col_file_grow(&cs->files[i], off + d->width,
+					   d->width);
+			if (rc)
+				return rc;
+		}
+		dst = cs->files[i].map + off;
+		switch (d->type) {
+		case LDMS_V_TIMESTAMP:
+			ts = (uint32_t *)dst;
+			ts[0] = htole32(col->mval->v_ts.sec);
+			ts[1] = htole32(col->mval->v_ts.usec);
+			break;
+		case LDMS_V_CHAR_ARRAY:
+			n = strnlen(col->mval->a_char, col->array_len);
+			if (n > d->width)
+				n = d->width;
+			memcpy(dst, col->mval->a_char, n);
+			memset(dst + n, 0, d->width - n);
+			break;
+		default:
+			/* set data is already little-endian */
+			if (col->array_len == d->array_len || d->array_len == 1) {
+				memcpy(dst, col->mval, d->width);
+				break;
+			}
+			n = __elem_sz[d->type] * col->array_len;
+			if (n > d->width)
+				n = d->width;
+			memcpy(dst, col->mval, n);
+			memset(dst + n, 0, d->width - n);
+			if (!cs->len_warned) {
+				LOG_(LDMSD_LWARNING, "'%s' column '%s': array "
+				     "length %d differs from %d in the header, "
+				     "values are truncated or zero-padded.\n",
+				     cs->base, d->name, col->array_len,
+				     d->array_len);
+				cs->len_warned = 1;
+			}
+			break;
+		}
+		cs->byte_count += d->width;
+	}
+	/* publish the row to readers */
+	__atomic_store_n(&cs->hdr->row_count, r + 1, __ATOMIC_RELEASE);
+	cs->store_count++;
+	return 0;
+}
+
+static void roll_cb(col_store_t cs, time_t appx)
+{
+	pthread_mutex_lock(&cs->lock);
+	switch (rolltype) {
+	case 1:
+	case 2:
+	case 5:
+		if (!cs->store_count && !rollempty)
+			/* skip rollover of empty segments */
+			goto out;
+		break;
+	case 3:
+		if (cs->store_count < rollover)
+			goto out;
+		break;
+	case 4:
+		if (cs->byte_count < rollover)
+			goto out;
+		break;
+	default:
+		LOG_(LDMSD_LDEBUG, "Error: unexpected rolltype %d\n", rolltype);
+		break;
+	}
+	if (cs->hdr && cs->otime == appx)
+		goto out; /* the segment name would not change */
+	col_seg_close(cs);
+	if (col_seg_open(cs, appx))
+		LOG_(LDMSD_LERROR, "cannot open a new segment for '%s'; "
+		     "rows are dropped until the next roll.\n", cs->base);
+	cs->store_count = 0;
+	cs->byte_count = 0;
+ out:
+	pthread_mutex_unlock(&cs->lock);
+}
+
+static void handle_rollover(void)
+{
+	struct rbn *rbn;
+	time_t appx;
+
+	pthread_mutex_lock(&cfg_lock);
+	appx = time(NULL);
+	RBT_FOREACH(rbn, &col_store_tree) {
+		roll_cb(container_of(rbn, struct col_store_s, rbn), appx);
+	}
+	pthread_mutex_unlock(&cfg_lock);
+}
+
+static void *rollover_proc(void *arg)
+{
+	time_t rawtime;
+	struct tm info;
+	int tsleep, sec_since_midnight, oldstate;
+
+	while (1) {
+		switch (rolltype) {
+		case 1:
+			tsleep = (rollover < MIN_ROLL_1) ? MIN_ROLL_1 : rollover;
+			break;
+		case 2:
+			time(&rawtime);
+			localtime_r(&rawtime, &info);
+			sec_since_midnight = info.tm_hour*3600 +
+					     info.tm_min*60 + info.tm_sec;
+			tsleep = 86400 - sec_since_midnight + rollover;
+			if (tsleep < MIN_ROLL_1) {
+				/* if we just did a roll then skip this one */
+				tsleep += 86400;
+			}
+			break;
+		case 3:
+			if (rollover < MIN_ROLL_RECORDS)
+				rollover = MIN_ROLL_RECORDS;
+			tsleep = ROLL_LIMIT_INTERVAL;
+			break;
+		case 4:
+			if (rollover < MIN_ROLL_BYTES)
+				rollover = MIN_ROLL_BYTES;
+			tsleep = ROLL_LIMIT_INTERVAL;
+			break;
+		case 5:
+			time(&rawtime);
+			localtime_r(&rawtime, &info);
+			sec_since_midnight = info.tm_hour*3600 +
+					     info.tm_min*60 + info.tm_sec;
+			if (sec_since_midnight < rollover) {
+				tsleep = rollover - sec_since_midnight;
+			} else {
+				int y = sec_since_midnight - rollover;
+				int z = y / rollagain;
+				tsleep = (z + 1)*rollagain + rollover - sec_since_midnight;
+			}
+			if (tsleep < MIN_ROLL_1)
+				tsleep += rollagain;
+			break;
+		default:
+			tsleep = 60;
+			break;
+		}
+		sleep(tsleep);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldstate);
+		handle_rollover();
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &oldstate);
+	}
+	return NULL;
+}
+
+static int config_int(struct attr_value_list *avl, const char *name,
+		      int *val, int min)
+{
+	char *value, *end;
+	long v;
+
+	value = av_value(avl, name);
+	if (!value)
+		return 0;
+	v = strtol(value, &end, 0);
+	if (*value == '\0' || *end != '\0' || v < min || v > INT32_MAX) {
+		LOG_(LDMSD_LERROR, "bad %s= value '%s'\n", name, value);
+		return EINVAL;
+	}
+	*val = v;
+	return 0;
+}
+
+static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
+		  struct attr_value_list *avl)
+{
+	char *value;
+	int roll = -1, rtype = -1, ragain = 0, cwidth = char_width;
+	int grows = grow_rows, rempty = rollempty;
+	int rc = 0;
+
+	pthread_mutex_lock(&cfg_lock);
+	if (root_path) {
+		LOG_(LDMSD_LERROR, "reconfiguration is not supported\n");
+		rc = EINVAL;
+		goto out;
+	}
+	value = av_value(avl, "path");
+	if (!value) {
+		LOG_(LDMSD_LERROR, "missing path=\n");
+		rc = EINVAL;
+		goto out;
+	}
+	rc = config_int(avl, "rollover", &roll, 0);
+	rc = rc ? rc : config_int(avl, "rolltype", &rtype, MINROLLTYPE);
+	rc = rc ? rc : config_int(avl, "rollagain", &ragain, 0);
+	rc = rc ? rc : config_int(avl, "rollempty", &rempty, 0);
+	rc = rc ? rc : config_int(avl, "char_width", &cwidth, 1);
+	rc = rc ? rc : config_int(avl, "grow_rows", &grows, 1);
+	if (rc)
+		goto out;
+	if (rtype > MAXROLLTYPE) {
+		LOG_(LDMSD_LERROR, "rolltype out of range.\n");
+		rc = EINVAL;
+		goto out;
+	}
+	if (rtype != -1 && roll < 0) {
+		LOG_(LDMSD_LERROR, "rolltype given without rollover.\n");
+		rc = EINVAL;
+		goto out;
+	}
+	if (rtype == 5 && (ragain < roll || ragain < MIN_ROLL_1)) {
+		LOG_(LDMSD_LERROR, "rolltype=5 needs rollagain > max(rollover,10)\n");
+		rc = EINVAL;
+		goto out;
+	}
+	root_path = strdup(value);
+	if (!root_path) {
+		rc = ENOMEM;
+		goto out;
+	}
+	char_width = cwidth;
+	grow_rows = grows;
+	rollempty = rempty;
+	rollover = roll;
+	rollagain = ragain;
+	if (rtype >= MINROLLTYPE) {
+		rolltype = rtype;
+		if (pthread_create(&rothread, NULL, rollover_proc, NULL) == 0) {
+			rothread_used = 1;
+			pthread_setname_np(rothread, "store_column:roll");
+		}
+	}
+ out:
+	pthread_mutex_unlock(&cfg_lock);
+	return rc;
+}
+
+static void term(struct ldmsd_plugin *self)
+{
+	if (rothread_used) {
+		pthread_cancel(rothread);
+		pthread_join(rothread, NULL);
+		rothread_used = 0;
+	}
+	pthread_mutex_lock(&cfg_lock);
+	free(root_path);
+	root_path = NULL;
+	pthread_mutex_unlock(&cfg_lock);
+}
+
+static const char *usage(struct ldmsd_plugin *self)
+{
+	return  "    config name=store_column path=<path> [rollover=<num> rolltype=<num>]\n"
+		"           [rollagain=<num>] [rollempty=0|1] [char_width=<num>]\n"
+		"           [grow_rows=<num>]\n"
+		"         - path       The root directory of the column segments\n"
+		"         - rollover   Greater than or equal to zero; enables segment\n"
+		"                      rollover and sets the interval\n"
+		"         - rolltype   [1-5] The rollover policy, as in store_csv:\n"
+		"                      1: roll every rollover seconds\n"
+		"                      2: roll daily at rollover seconds after midnight\n"
+		"                      3: roll after rollover rows\n"
+		"                      4: roll after rollover bytes\n"
+		"                      5: roll daily at rollover seconds after midnight\n"
+		"                         and every rollagain seconds thereafter\n"
+		"         - rollempty  0 suppresses rollover of empty segments (default 1)\n"
+		"         - char_width Minimum width of char array columns (default 64)\n"
+		"         - grow_rows  Rows preallocated each time a column file grows\n"
+		"                      (default 4096)\n"
+		"    The strgp container is a subdirectory of path. Only decomposition\n"
+		"    strgps are supported.\n";
+}
+
+static ldmsd_store_handle_t
+open_store(struct ldmsd_store *s, const char *container, const char *schema,
+	   struct ldmsd_strgp_metric_list *metric_list, void *ucontext)
+{
+	errno = ENOSYS;
+	LOG_(LDMSD_LERROR, "only decomposition strgps are supported\n");
+	return NULL;
+}
+
+static void *get_ucontext(ldmsd_store_handle_t _sh)
+{
+	return NULL;
+}
+
+static int
+store(ldmsd_store_handle_t _sh, ldms_set_t set, int *metric_arry,
+      size_t metric_count)
+{
+	LOG_(LDMSD_LERROR, "only decomposition strgps are supported\n");
+	return ENOSYS;
+}
+
+static int flush_store(ldmsd_store_handle_t _sh)
+{
+	col_strgp_handle_t sh = _sh;
+	struct col_schema_rbn_s *srbn;
+	struct rbn *rbn;
+	col_store_t cs;
+	int i;
+
+	if (!sh)
+		return 0;
+	RBT_FOREACH(rbn, &sh->schema_rbt) {
+		srbn = container_of(rbn, struct col_schema_rbn_s, rbn);
+		cs = srbn->cs;
+		pthread_mutex_lock(&cs->lock);
+		for (i = 0; cs->files && i < cs->col_count; i++)
+			msync(cs->files[i].map, cs->files[i].map_len, MS_ASYNC);
+		if (cs->hdr)
+			msync(cs->hdr, cs->hdr_len, MS_ASYNC);
+		pthread_mutex_unlock(&cs->lock);
+	}
+	return 0;
+}
+
+/* protected by strgp->lock */
+static void close_store(ldmsd_store_handle_t _sh)
+{
+	col_strgp_handle_t sh = _sh;
+	struct col_schema_rbn_s *srbn;
+	struct rbn *rbn;
+
+	if (!sh)
+		return;
+	pthread_mutex_lock(&cfg_lock);
+	while ((rbn = rbt_min(&sh->schema_rbt))) {
+		rbt_del(&sh->schema_rbt, rbn);
+		srbn = container_of(rbn, struct col_schema_rbn_s, rbn);
+		col_store_put(srbn->cs);
+		free(srbn);
+	}
+	pthread_mutex_unlock(&cfg_lock);
+	free(sh);
+}
+
+/* protected by strgp->lock */
+static struct col_schema_rbn_s *
+col_schema_get(ldmsd_strgp_t strgp, col_strgp_handle_t sh, ldmsd_row_t row)
+{
+	struct col_schema_rbn_s *srbn;
+
+	srbn = calloc(1, sizeof(*srbn));
+	if (!srbn)
+		return NULL;
+	pthread_mutex_lock(&cfg_lock);
+	if (root_path)
+		srbn->cs = col_store_get(strgp->container, row);
+	else
+		LOG_(LDMSD_LERROR, "the plugin is not configured\n");
+	pthread_mutex_unlock(&cfg_lock);
+	if (!srbn->cs) {
+		free(srbn);
+		return NULL;
+	}
+	snprintf(srbn->name, sizeof(srbn->name), "%s", row->schema_name);
+	memcpy(&srbn->digest, row->schema_digest, sizeof(srbn->digest));
+	srbn->key.name = srbn->name;
+	srbn->key.digest = &srbn->digest;
+	rbn_init(&srbn->rbn, &srbn->key);
+	rbt_ins(&sh->schema_rbt, &srbn->rbn);
+	return srbn;
+}
+
+/*
+ * Count a row that could not be stored. The message is logged at most
+ * once every LOST_LOG_INTERVAL seconds per segment.
+ * caller must hold cs->lock
+ */
+static void col_store_lost(col_store_t cs, int rc)
+{
+	time_t now = time(NULL);
+
+	cs->lost_rows++;
+	if (cs->lost_log_time && now - cs->lost_log_time < LOST_LOG_INTERVAL)
+		return;
+	cs->lost_log_time = now;
+	LOG_(LDMSD_LERROR, "cannot store a row in '%s', error %d; "
+	     "%" PRIu64 " rows lost so far\n",
+	     cs->dir ? cs->dir : cs->base, rc, cs->lost_rows);
+}
+
+/* protected by strgp->lock */
+static int
+commit_rows(ldmsd_strgp_t strgp, ldms_set_t set, ldmsd_row_list_t row_list,
+	    int row_count)
+{
+	col_strgp_handle_t sh;
+	struct col_schema_rbn_s *srbn;
+	struct col_schema_key_s key;
+	ldmsd_row_t row;
+	int rc;
+
+	sh = strgp->store_handle;
+	if (!sh) {
+		sh = calloc(1, sizeof(*sh));
+		if (!sh)
+			return ENOMEM;
+		rbt_init(&sh->schema_rbt, col_schema_key_cmp);
+		strgp->store_handle = sh;
+	}
+
+	TAILQ_FOREACH(row, row_list, entry) {
+		key.digest = row->schema_digest;
+		key.name = row->schema_name;
+		srbn = (void *)rbt_find(&sh->schema_rbt, &key);
+		if (!srbn) {
+			srbn = col_schema_get(strgp, sh, row);
+			if (!srbn)
+				continue; /* already logged */
+		}
+		pthread_mutex_lock(&srbn->cs->lock);
+		rc = col_store_row(srbn->cs, row);
+		if (rc)
+			col_store_lost(srbn->cs, rc);
+		pthread_mutex_unlock(&srbn->cs->lock);
+	}
+	return 0;
+}
+
+static struct ldmsd_store store_column = {
+	.base = {
+		.name = "column",
+		.type = LDMSD_PLUGIN_STORE,
+		.term = term,
+		.config = config,
+		.usage = usage,
+	},
+	.open = open_store,
+	.get_context = get_ucontext,
+	.store = store,
+	.flush = flush_store,
+	.close = close_store,
+	.commit = commit_rows,
+};
+
+struct ldmsd_plugin *get_plugin(ldmsd_msg_log_f pf)
+{
+	msglog = pf;
+	return &store_column.base;
+}
@@ -0,0 +1,207 @@
+/*
+ * The writers are static, so the test is built from the plugin source.
+ */
+#include "store_column.c"
+
+/*
+ * store_column round trip
+ *
+ * Rows are committed through commit_rows() and the store is closed. The
+ * segment is then read back with the libldms_column reader. A second
+ * strgp continues the segment as a restarted ldmsd would, and the rows of
+ * both runs are read back. A row that does not fit the segment must be
+ * counted as lost. grow_rows is small, so the column files are grown
+ * several times.
+ */
+
+#define SCHEMA_NAME "coltest"
+#define NAME_LEN 16
+#define ROWS 10
+
+/* provided by ldmsd to the plugins it loads */
+void ldmsd_log(enum ldmsd_loglevel level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (level < LDMSD_LWARNING)
+		return;
+	printf("# ");
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+enum ldmsd_loglevel ldmsd_loglevel_get()
+{
+	return LDMSD_LWARNING;
+}
+
+static struct ldms_digest_s digest = { .digest = { 0xc0, 0x1 } };
+
+static union ldms_value v_ts, v_seq, v_val;
+static char v_name[NAME_LEN];
+
+static ldmsd_row_t row_new(int col_count)
+{
+	ldmsd_row_t row;
+
+	row = calloc(1, sizeof(*row) + 4 * sizeof(row->cols[0]));
+	if (!row) {
+		printf("Bail out! out of memory\n");
+		exit(1);
+	}
+	row->schema_name = SCHEMA_NAME;
+	row->schema_digest = &digest;
+	row->col_count = col_count;
+	row->cols[0].name = "timestamp";
+	row->cols[0].type = LDMS_V_TIMESTAMP;
+	row->cols[0].mval = &v_ts;
+	row->cols[0].array_len = 1;
+	row->cols[1].name = "seq";
+	row->cols[1].type = LDMS_V_U64;
+	row->cols[1].mval = &v_seq;
+	row->cols[1].array_len = 1;
+	row->cols[2].name = "val";
+	row->cols[2].type = LDMS_V_D64;
+	row->cols[2].mval = &v_val;
+	row->cols[2].array_len = 1;
+	row->cols[3].name = "name";
+	row->cols[3].type = LDMS_V_CHAR_ARRAY;
+	row->cols[3].mval = (ldms_mval_t)v_name;
+	row->cols[3].array_len = NAME_LEN;
+	return row;
+}
+
+/* Commit rows first .. first+count-1 through a new strgp and close it */
+static int run_store(int first, int count, int bad)
+{
+	struct ldmsd_strgp strgp;
+	struct ldmsd_row_list_s row_list;
+	struct col_schema_rbn_s *srbn;
+	col_strgp_handle_t sh;
+	ldmsd_row_t row, bad_row;
+	uint64_t lost = 0;
+	int i;
+
+	memset(&strgp, 0, sizeof(strgp));
+	strgp.container = "test";
+	row = row_new(4);
+	bad_row = row_new(3);
+	for (i = first; i < first + count; i++) {
+		v_ts.v_ts.sec = 1000 + i;
+		v_ts.v_ts.usec = i;
+		v_seq.v_u64 = htole64(i);
+		v_val.v_d = i / 4.0;
+		snprintf(v_name, sizeof(v_name), "row-%d", i);
+		TAILQ_INIT(&row_list);
+		TAILQ_INSERT_TAIL(&row_list, row, entry);
+		commit_rows(&strgp, NULL, &row_list, 1);
+	}
+	for (i = 0; i < bad; i++) {
+		TAILQ_INIT(&row_list);
+		TAILQ_INSERT_TAIL(&row_list, bad_row, entry);
+		commit_rows(&strgp, NULL, &row_list, 1);
+	}
+	sh = strgp.store_handle;
+	if (sh && (srbn = (void *)rbt_min(&sh->schema_rbt)))
+		lost = srbn->cs->lost_rows;
+	close_store(sh);
+	free(row);
+	free(bad_row);
+	if (!sh) {
+		printf("# no store handle\n");
+		return -1;
+	}
+	return lost;
+}
+
+/* Read the segment back and check rows 0 .. count-1 */
+static int check_rows(const char *seg_dir, int count)
+{
+	ldms_column_seg_t seg;
+	const uint32_t *ts;
+	const uint64_t *seq;
+	const double *val;
+	const char *name;
+	char expect[NAME_LEN];
+	uint64_t n;
+	int i, ok = 1;
+
+	seg = ldms_column_seg_open(seg_dir);
+	if (!seg) {
+		printf("# cannot open '%s', errno %d\n", seg_dir, errno);
+		return 0;
+	}
+	n = ldms_column_seg_rows(seg);
+	if (n != count) {
+		printf("# %" PRIu64 " rows, expected %d\n", n, count);
+		ok = 0;
+		goto out;
+	}
+	ts = ldms_column_map(seg, ldms_column_find(seg, "timestamp"), &n);
+	seq = ldms_column_map(seg, ldms_column_find(seg, "seq"), &n);
+	val = ldms_column_map(seg, ldms_column_find(seg, "val"), &n);
+	name = ldms_column_map(seg, ldms_column_find(seg, "name"), &n);
+	if (!ts || !seq || !val || !name) {
+		printf("# cannot map the columns, errno %d\n", errno);
+		ok = 0;
+		goto out;
+	}
+	for (i = 0; i < count; i++) {
+		snprintf(expect, sizeof(expect), "row-%d", i);
+		if (le32toh(ts[2*i]) != 1000 + i || le32toh(ts[2*i+1]) != i
+		    || le64toh(seq[i]) != i || val[i] != i / 4.0
+		    || strncmp(name + i * DEFAULT_CHAR_WIDTH, expect,
+			       DEFAULT_CHAR_WIDTH)) {
+			printf("# row %d differs\n", i);
+			ok = 0;
+			break;
+		}
+	}
+ out:
+	ldms_column_seg_close(seg);
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	char dir[] = "/tmp/store_column_test.XXXXXX";
+	char seg_dir[PATH_MAX];
+	char dstr[2*LDMS_DIGEST_LENGTH+1];
+	char cmd[PATH_MAX + 16];
+	int lost, ok, rc = 0;
+
+	if (!mkdtemp(dir)) {
+		printf("Bail out! cannot create a directory: %d\n", errno);
+		return 1;
+	}
+	msglog = ldmsd_log;
+	root_path = strdup(dir);
+	grow_rows = 4;
+	ldms_digest_str(&digest, dstr, sizeof(dstr));
+	dstr[16] = 0;
+	snprintf(seg_dir, sizeof(seg_dir), "%s/test/%s-%s", dir, SCHEMA_NAME, dstr);
+
+	printf("1..3\n");
+
+	lost = run_store(0, ROWS, 0);
+	ok = lost == 0 && check_rows(seg_dir, ROWS);
+	printf("%s 1 - store and read back %d rows\n", ok ? "ok" : "not ok", ROWS);
+	rc |= !ok;
+
+	lost = run_store(ROWS, ROWS, 0);
+	ok = lost == 0 && check_rows(seg_dir, 2 * ROWS);
+	printf("%s 2 - reopen and append %d rows\n", ok ? "ok" : "not ok", ROWS);
+	rc |= !ok;
+
+	lost = run_store(2 * ROWS, 1, 2);
+	ok = lost == 2 && check_rows(seg_dir, 2 * ROWS + 1);
+	printf("%s 3 - count lost rows\n", ok ? "ok" : "not ok");
+	rc |= !ok;
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+	if (system(cmd))
+		printf("# cannot remove %s\n", dir);
+	free(root_path);
+	return rc;
+}
@@ -150,6 +150,12 @@ struct csv_lent {
 	int idx; /* list entry's index */
 };
 
+struct csv_col_plan {
+	int mid;
+	enum ldms_value_type type;
+	size_t count;
+};
+
 typedef enum csv_store_handle_type {
 	CSV_STORE_HANDLE,     /* for `struct csv_store_handle`     */
 	CSV_ROW_STORE_HANDLE, /* for `struct csv_row_store_handle` */
@@ -174,6 +180,17 @@ struct csv_store_handle {
 	int64_t byte_count;
 	int num_lists; /* Number of list metrics */
 	struct csv_lent *lents;
+	/* formatted output not yet written, see csv_obuf_flush() */
+	char *obuf;
+	size_t obuf_len;
+	size_t obuf_sz;
+	uint64_t obuf_total; /* bytes formatted so far */
+	/* columns of sets without lists, see csv_plan_build() */
+	struct ldms_digest_s plan_digest;
+	int *plan_mids; /* copy of the metric_array the plan was built from */
+	size_t plan_mcount;
+	int plan_len;
+	struct csv_col_plan *plan;
 	int ref_count; /* number of strgp using the csv file; protected by cfg_lock */
 	CSV_STORE_HANDLE_COMMON;
 };
@@ -233,6 +250,8 @@ struct roll_cb_arg {
 	time_t appx;
 };
 
+static int csv_obuf_flush(struct csv_store_handle *sh);
+
 static void roll_cb(void *obj, void *cb_arg)
 {
 	if (!obj || !cb_arg)
@@ -283,8 +302,10 @@ static void roll_cb(void *obj, void *cb_arg)
 	}
 
 
-	if (s_handle->file)
+	if (s_handle->file) {
+		csv_obuf_flush(s_handle);
 		fflush(s_handle->file);
+	}
 	if (s_handle->headerfile)
 		fflush(s_handle->headerfile);
 
@@ -867,6 +888,7 @@ static int print_header_from_row(struct csv_store_handle *s_handle,
 		return EINVAL;
 	}
 	s_handle->printheader = DONT_PRINT_HEADER;
+	csv_obuf_flush(s_handle);
 
 	fp = s_handle->headerfile;
 	if (!fp){
@@ -925,6 +947,7 @@ static int print_header_from_store(struct csv_store_handle *s_handle, ldms_set_t
 		return EINVAL;
 	}
 	s_handle->printheader = DONT_PRINT_HEADER;
+	csv_obuf_flush(s_handle);
 
 	fp = s_handle->headerfile;
 	if (!fp){
@@ -1013,425 +1036,358 @@ open_store(struct ldmsd_store *s, const char *container, const char* schema,
 	return s_handle;
 }
 
-static inline void __print_check(struct csv_store_handle *sh, int rc)
+/*
+ * Output buffer
+ *
+ * Rows are formatted into a buffer owned by the handle and written to the
+ * file descriptor with one write() per buffer instead of one stdio call
+ * per field. Everything that writes to s_handle->file through stdio (the
+ * header), flushes or closes it must call csv_obuf_flush() first.
+ * csv_obuf_flush() flushes the FILE before it writes, so the output keeps
+ * its order. Caller must hold s_handle->lock.
+ */
+#define CSV_OBUF_SZ (256 * 1024)
+
+/* room for a ',' + udata + ',' + quote + an integer or a %.17g + quote */
+#define CSV_FIELD_MAX 96
+
+/* room for a %f of any double */
+#define CSV_FIELD_F_MAX 400
+
+static int csv_obuf_flush(struct csv_store_handle *sh)
+{
+	char *p = sh->obuf;
+	size_t n = sh->obuf_len;
+	ssize_t wsz;
+	int fd, rc = 0;
+
+	if (!n)
+		return 0;
+	sh->obuf_len = 0;
+	if (!sh->file) {
+		msglog(LDMSD_LERROR, PNAME ": dropping %zu bytes for '%s': file is closed\n",
+		       n, sh->path);
+		return EBADF;
+	}
+	fflush(sh->file);
+	fd = fileno(sh->file);
+	while (n) {
+		wsz = write(fd, p, n);
+		if (wsz < 0) {
+			if (errno == EINTR)
+				continue;
+			rc = errno;
+			msglog(LDMSD_LERROR, PNAME ": Error %d writing to '%s'\n",
+			       rc, sh->path);
+			break;
+		}
+		p += wsz;
+		n -= wsz;
+	}
+	return rc;
+}
+
+/* Returns where to format up to len bytes, or NULL */
+static inline char *csv_obuf_reserve(struct csv_store_handle *sh, size_t len)
+{
+	char *b;
+	size_t sz;
+
+	if (sh->obuf_len + len <= sh->obuf_sz)
+		return sh->obuf + sh->obuf_len;
+	csv_obuf_flush(sh);
+	if (len > sh->obuf_sz) {
+		sz = (len > CSV_OBUF_SZ ? len : CSV_OBUF_SZ);
+		b = realloc(sh->obuf, sz);
+		if (!b) {
+			msglog(LDMSD_LCRITICAL, PNAME ": Out of memory\n");
+			return NULL;
+		}
+		sh->obuf = b;
+		sh->obuf_sz = sz;
+	}
+	return sh->obuf;
+}
+
+static inline void csv_obuf_commit(struct csv_store_handle *sh, char *end)
 {
-	if (rc < 0) {
-		msglog(LDMSD_LERROR, PNAME ": Error %d writing to '%s'\n",
-		       rc, sh->path);
+	size_t len = end - (sh->obuf + sh->obuf_len);
+	sh->obuf_len += len;
+	sh->obuf_total += len;
+}
+
+static const char csv_digits[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/* %PRIu64 of v at p, padded with zeros to at least width digits */
+static inline char *csv_utoa(char *p, uint64_t v, int width)
+{
+	char buf[24];
+	char *q = buf + sizeof(buf);
+	size_t n;
+
+	while (v >= 100) {
+		const char *d = &csv_digits[(v % 100) * 2];
+		v /= 100;
+		q -= 2;
+		q[0] = d[0];
+		q[1] = d[1];
+	}
+	if (v >= 10) {
+		q -= 2;
+		q[0] = csv_digits[v * 2];
+		q[1] = csv_digits[v * 2 + 1];
 	} else {
-		sh->byte_count += rc;
+		*--q = '0' + v;
+	}
+	while (buf + sizeof(buf) - q < width)
+		*--q = '0';
+	n = buf + sizeof(buf) - q;
+	memcpy(p, q, n);
+	return p + n;
+}
+
+static inline char *csv_itoa(char *p, int64_t v)
+{
+	if (v < 0) {
+		*p++ = '-';
+		return csv_utoa(p, -(uint64_t)v, 0);
+	}
+	return csv_utoa(p, v, 0);
+}
+
+/* floating point keeps the printf formats so the output does not change */
+static inline char *csv_ftoa(char *p, const char *fmt, double v, size_t room)
+{
+	int n = snprintf(p, room, fmt, v);
+	return p + n;
+}
+
+/* ",<udata>" when udata is on */
+static inline char *csv_udata(struct csv_store_handle *sh, char *p, uint64_t udata)
+{
+	if (sh->udata) {
+		*p++ = ',';
+		p = csv_utoa(p, udata, 0);
 	}
+	return p;
+}
+
+/*
+ * Typed writers for the store() path. The scalar writers write
+ * [,udata],value. The array writers write each element that way when
+ * expand_array is set, otherwise [,udata],<lquote>v0<sep>v1...<rquote>.
+ */
+#define CSV_SCALAR_WRITER(_name_, _field_, _fmt_)			\
+static void csv_put_##_name_(struct csv_store_handle *sh,		\
+			     uint64_t udata, ldms_mval_t mval)		\
+{									\
+	char *p = csv_obuf_reserve(sh, CSV_FIELD_MAX);			\
+	if (!p)								\
+		return;							\
+	p = csv_udata(sh, p, udata);					\
+	*p++ = ',';							\
+	p = _fmt_(p, mval->_field_);					\
+	csv_obuf_commit(sh, p);						\
+}
+
+#define CSV_ARRAY_WRITER(_name_, _field_, _fmt_)			\
+static void csv_put_##_name_##_array(struct csv_store_handle *sh,	\
+				     uint64_t udata, size_t count,	\
+				     ldms_mval_t mval,			\
+				     char lq, char sep, char rq)	\
+{									\
+	char *p;							\
+	size_t i;							\
+	if (sh->expand_array) {						\
+		for (i = 0; i < count; i++) {				\
+			p = csv_obuf_reserve(sh, CSV_FIELD_MAX);	\
+			if (!p)						\
+				return;					\
+			p = csv_udata(sh, p, udata);			\
+			*p++ = ',';					\
+			p = _fmt_(p, mval->_field_[i]);			\
+			csv_obuf_commit(sh, p);				\
+		}							\
+		return;							\
+	}								\
+	for (i = 0; i < count; i++) {					\
+		p = csv_obuf_reserve(sh, CSV_FIELD_MAX);		\
+		if (!p)							\
+			return;						\
+		if (i == 0) {						\
+			p = csv_udata(sh, p, udata);			\
+			*p++ = ',';					\
+			*p++ = lq;					\
+		} else {						\
+			*p++ = sep;					\
+		}							\
+		p = _fmt_(p, mval->_field_[i]);				\
+		csv_obuf_commit(sh, p);					\
+	}								\
+	p = csv_obuf_reserve(sh, CSV_FIELD_MAX);			\
+	if (!p)								\
+		return;							\
+	if (count == 0)							\
+		p = csv_udata(sh, p, udata);				\
+	*p++ = rq;							\
+	csv_obuf_commit(sh, p);						\
+}
+
+#define CSV_U(_p_, _v_) csv_utoa(_p_, _v_, 0)
+#define CSV_I(_p_, _v_) csv_itoa(_p_, _v_)
+#define CSV_F(_p_, _v_) csv_ftoa(_p_, "%.9g", _v_, CSV_FIELD_MAX / 2)
+#define CSV_D(_p_, _v_) csv_ftoa(_p_, "%.17g", _v_, CSV_FIELD_MAX / 2)
+
+CSV_SCALAR_WRITER(u8, v_u8, CSV_U)
+CSV_SCALAR_WRITER(s8, v_s8, CSV_I)
+CSV_SCALAR_WRITER(u16, v_u16, CSV_U)
+CSV_SCALAR_WRITER(s16, v_s16, CSV_I)
+CSV_SCALAR_WRITER(u32, v_u32, CSV_U)
+CSV_SCALAR_WRITER(s32, v_s32, CSV_I)
+CSV_SCALAR_WRITER(u64, v_u64, CSV_U)
+CSV_SCALAR_WRITER(s64, v_s64, CSV_I)
+CSV_SCALAR_WRITER(f32, v_f, CSV_F)
+CSV_SCALAR_WRITER(d64, v_d, CSV_D)
+
+CSV_ARRAY_WRITER(u8, a_u8, CSV_U)
+CSV_ARRAY_WRITER(s8, a_s8, CSV_I)
+CSV_ARRAY_WRITER(u16, a_u16, CSV_U)
+CSV_ARRAY_WRITER(s16, a_s16, CSV_I)
+CSV_ARRAY_WRITER(u32, a_u32, CSV_U)
+CSV_ARRAY_WRITER(s32, a_s32, CSV_I)
+CSV_ARRAY_WRITER(u64, a_u64, CSV_U)
+CSV_ARRAY_WRITER(s64, a_s64, CSV_I)
+CSV_ARRAY_WRITER(f32, a_f, CSV_F)
+CSV_ARRAY_WRITER(d64, a_d, CSV_D)
+
+static void csv_put_str(struct csv_store_handle *sh, const char *pre,
+			const char *wsqt, const char *s)
+{
+	size_t pre_len = strlen(pre);
+	size_t q_len = strlen(wsqt);
+	size_t s_len = strlen(s);
+	char *p;
+
+	p = csv_obuf_reserve(sh, pre_len + 2 * q_len + s_len);
+	if (!p)
+		return;
+	memcpy(p, pre, pre_len);
+	p += pre_len;
+	memcpy(p, wsqt, q_len);
+	p += q_len;
+	memcpy(p, s, s_len);
+	p += s_len;
+	memcpy(p, wsqt, q_len);
+	p += q_len;
+	csv_obuf_commit(sh, p);
 }
 
 static void
 store_metric(struct csv_store_handle *sh, const char *wsqt, uint64_t udata,
 		enum ldms_value_type mtype, size_t count, ldms_mval_t mval)
 {
-	int rc, i;
+	char *p;
+	int i;
 	ldms_mval_t v;
 	switch (mtype) {
 	case LDMS_V_CHAR_ARRAY:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
+		p = csv_obuf_reserve(sh, CSV_FIELD_MAX);
+		if (!p)
+			return;
+		p = csv_udata(sh, p, udata);
+		*p++ = ',';
+		csv_obuf_commit(sh, p);
 		/* our csv does not included embedded nuls */
-		rc = fprintf(sh->file, ",%s%s%s", wsqt, mval->a_char, wsqt);
-		__print_check(sh, rc);
+		csv_put_str(sh, "", wsqt, mval->a_char);
 		break;
 	case LDMS_V_CHAR:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%c", mval->v_char);
-		__print_check(sh, rc);
+		p = csv_obuf_reserve(sh, CSV_FIELD_MAX);
+		if (!p)
+			return;
+		p = csv_udata(sh, p, udata);
+		*p++ = ',';
+		*p++ = mval->v_char;
+		csv_obuf_commit(sh, p);
 		break;
 	case LDMS_V_U8_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++){
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%hhu", mval->a_u8[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%hhu",
-							sh->array_lquote,
-							mval->a_u8[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%hhu",
-							sh->array_sep,
-							mval->a_u8[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
+		csv_put_u8_array(sh, udata, count, mval,
+				 sh->array_lquote, sh->array_sep, sh->array_rquote);
 		break;
 	case LDMS_V_U8:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%hhu", mval->v_u8);
-		__print_check(sh, rc);
+		csv_put_u8(sh, udata, mval);
 		break;
 	case LDMS_V_S8_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%hhd", mval->a_s8[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%hhd",
-							sh->array_lquote,
-							mval->a_s8[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%hhd",
-							sh->array_sep,
-							mval->a_s8[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
+		csv_put_s8_array(sh, udata, count, mval,
+				 sh->array_lquote, sh->array_sep, sh->array_rquote);
 		break;
 	case LDMS_V_S8:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%hhd", mval->v_s8);
-		__print_check(sh, rc);
+		csv_put_s8(sh, udata, mval);
 		break;
 	case LDMS_V_U16_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%hu", mval->a_u16[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%hu",
-							sh->array_lquote,
-							mval->a_u16[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%hu",
-							sh->array_sep,
-							mval->a_u16[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
+		csv_put_u16_array(sh, udata, count, mval,
+				  sh->array_lquote, sh->array_sep, sh->array_rquote);
 		break;
 	case LDMS_V_U16:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%hu", mval->v_u16);
-		__print_check(sh, rc);
+		csv_put_u16(sh, udata, mval);
 		break;
 	case LDMS_V_S16_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%hd", mval->a_s16[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%hd",
-							sh->array_lquote,
-							mval->a_s16[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%hd",
-							sh->array_sep,
-							mval->a_s16[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
+		csv_put_s16_array(sh, udata, count, mval,
+				  sh->array_lquote, sh->array_sep, sh->array_rquote);
 		break;
 	case LDMS_V_S16:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%hd", mval->v_s16);
-		__print_check(sh, rc);
+		csv_put_s16(sh, udata, mval);
 		break;
 	case LDMS_V_U32_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%" PRIu32, mval->a_u32[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%" PRIu32,
-							sh->array_lquote,
-							mval->a_u32[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%" PRIu32,
-							sh->array_sep,
-							mval->a_u32[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
+		csv_put_u32_array(sh, udata, count, mval,
+				  sh->array_lquote, sh->array_sep, sh->array_rquote);
 		break;
 	case LDMS_V_U32:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%" PRIu32, mval->v_u32);
-		__print_check(sh, rc);
+		csv_put_u32(sh, udata, mval);
 		break;
 	case LDMS_V_S32_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%" PRId32, mval->a_s32[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%" PRId32,
-							sh->array_lquote,
-							mval->a_s32[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%" PRId32,
-							sh->array_sep,
-							mval->a_s32[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
+		csv_put_s32_array(sh, udata, count, mval,
+				  sh->array_lquote, sh->array_sep, sh->array_rquote);
 		break;
 	case LDMS_V_S32:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%" PRId32, mval->v_s32);
-		__print_check(sh, rc);
+		csv_put_s32(sh, udata, mval);
 		break;
 	case LDMS_V_U64_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%" PRIu64, mval->a_u64[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%" PRIu64,
-							sh->array_lquote,
-							mval->a_u64[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%" PRIu64,
-							sh->array_sep,
-							mval->a_u64[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
+		csv_put_u64_array(sh, udata, count, mval,
+				  sh->array_lquote, sh->array_sep, sh->array_rquote);
 		break;
 	case LDMS_V_U64:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%"PRIu64, mval->v_u64);
-		__print_check(sh, rc);
+		csv_put_u64(sh, udata, mval);
 		break;
 	case LDMS_V_S64_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%" PRId64, mval->a_s64[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",\"%" PRId64, mval->a_s64[i]);
-				} else {
-					rc = fprintf(sh->file, ",%" PRId64, mval->a_s64[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "\"");
-			__print_check(sh, rc);
-		}
+		/* always written as ",\"v0,v1,...\"" */
+		csv_put_s64_array(sh, udata, count, mval, '"', ',', '"');
 		break;
 	case LDMS_V_S64:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%" PRId64, mval->v_s64);
-		__print_check(sh, rc);
+		csv_put_s64(sh, udata, mval);
 		break;
 	case LDMS_V_F32_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%.9g", mval->a_f[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%.9g",
-							sh->array_lquote,
-							mval->a_f[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%.9g",
-							sh->array_sep,
-							mval->a_f[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
+		csv_put_f32_array(sh, udata, count, mval,
+				  sh->array_lquote, sh->array_sep, sh->array_rquote);
 		break;
 	case LDMS_V_F32:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%.9g", mval->v_f);
-		__print_check(sh, rc);
+		csv_put_f32(sh, udata, mval);
 		break;
 	case LDMS_V_D64_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%.17g", mval->a_d[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%.17g",
-							sh->array_lquote,
-							mval->a_d[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%.17g",
-							sh->array_sep,
-							mval->a_d[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
+		csv_put_d64_array(sh, udata, count, mval,
+				  sh->array_lquote, sh->array_sep, sh->array_rquote);
 		break;
 	case LDMS_V_D64:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%.17g", mval->v_d);
-		__print_check(sh, rc);
+		csv_put_d64(sh, udata, mval);
 		break;
 	case LDMS_V_RECORD_INST:
 		for (i = 0; i < ldms_record_card(mval); i++) {
@@ -1443,12 +1399,13 @@ store_metric(struct csv_store_handle *sh, const char *wsqt, uint64_t udata,
 	default:
 		msglog(LDMSD_LERROR, PNAME ": Received unrecognized metric value type %d\n", mtype);
 		/* print no value */
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",");
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",");
-		__print_check(sh, rc);
+		p = csv_obuf_reserve(sh, CSV_FIELD_MAX);
+		if (!p)
+			return;
+		if (sh->udata)
+			*p++ = ',';
+		*p++ = ',';
+		csv_obuf_commit(sh, p);
 		break;
 	}
 }
@@ -1457,26 +1414,73 @@ static void
 store_time_job_app(struct csv_store_handle *sh, const struct ldms_timestamp *ts, ldms_set_t set)
 {
 	const char *pname;
+	char *p = csv_obuf_reserve(sh, CSV_FIELD_MAX);
+	if (!p)
+		return;
 	/* Print timestamp fields */
 	if (sh->time_format == TF_MILLISEC) {
 		/* Alternate time format. First field is milliseconds-since-epoch,
 		   and the second field is the left-over microseconds */
-		fprintf(sh->file, "%"PRIu64",%"PRIu32,
-			((uint64_t)ts->sec * 1000) + (ts->usec / 1000),
-			ts->usec % 1000);
+		p = csv_utoa(p, ((uint64_t)ts->sec * 1000) + (ts->usec / 1000), 0);
+		*p++ = ',';
+		p = csv_utoa(p, ts->usec % 1000, 0);
 	} else {
 		/* Traditional time format, where the first field is
 		   <seconds>.<microseconds>, second is microseconds repeated */
-		fprintf(sh->file, "%"PRIu32".%06"PRIu32 ",%"PRIu32,
-			ts->sec, ts->usec, ts->usec);
+		p = csv_utoa(p, ts->sec, 0);
+		*p++ = '.';
+		p = csv_utoa(p, ts->usec, 6);
+		*p++ = ',';
+		p = csv_utoa(p, ts->usec, 0);
 	}
+	csv_obuf_commit(sh, p);
 	pname = ldms_set_producer_name_get(set);
 	if (pname != NULL){
-		fprintf(sh->file, ",%s", pname);
+		csv_put_str(sh, ",", "", pname);
 		sh->byte_count += strlen(pname);
 	} else {
-		fprintf(sh->file, ",");
+		csv_put_str(sh, ",", "", "");
+	}
+}
+
+/*
+ * The columns of a set without lists, resolved once per schema digest
+ * and metric list so that store() does not look up the type and length
+ * of every metric.
+ */
+static int csv_plan_build(struct csv_store_handle *sh, ldms_set_t set,
+			  int *metric_array, size_t metric_count)
+{
+	struct csv_col_plan *plan;
+	enum ldms_value_type type;
+	int *mids;
+	int i, n = 0;
+
+	plan = realloc(sh->plan, (metric_count ? metric_count : 1) * sizeof(*plan));
+	if (!plan)
+		return ENOMEM;
+	sh->plan = plan;
+	mids = realloc(sh->plan_mids, (metric_count ? metric_count : 1) * sizeof(*mids));
+	if (!mids)
+		return ENOMEM;
+	sh->plan_mids = mids;
+	for (i = 0; i < metric_count; i++) {
+		type = ldms_metric_type_get(set, metric_array[i]);
+		if (type == LDMS_V_RECORD_TYPE)
+			continue;
+		plan[n].mid = metric_array[i];
+		plan[n].type = type;
+		if (ldms_type_is_array(type))
+			plan[n].count = ldms_metric_array_get_len(set, metric_array[i]);
+		else
+			plan[n].count = 1;
+		n++;
 	}
+	sh->plan_len = n;
+	memcpy(mids, metric_array, metric_count * sizeof(*mids));
+	sh->plan_mcount = metric_count;
+	memcpy(&sh->plan_digest, ldms_set_digest_get(set), sizeof(sh->plan_digest));
+	return 0;
 }
 
 static int store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_array, size_t metric_count)
@@ -1581,10 +1585,39 @@ static int store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arr
 	const char *name;
 	size_t count;
 	union ldms_value v;
+	uint64_t pos;
 	struct csv_lent *lents = s_handle->lents;
+
+	if (!s_handle->num_lists) {
+		if ((s_handle->plan_mcount != metric_count ||
+		     memcmp(s_handle->plan_mids, metric_array,
+			    metric_count * sizeof(*metric_array)) ||
+		     memcmp(&s_handle->plan_digest, ldms_set_digest_get(set),
+			    sizeof(s_handle->plan_digest))) &&
+		    csv_plan_build(s_handle, set, metric_array, metric_count)) {
+			msglog(LDMSD_LCRITICAL, PNAME ": Out of memory\n");
+			pthread_mutex_unlock(&s_handle->lock);
+			return ENOMEM;
+		}
+		store_time_job_app(s_handle, ts, set);
+		pos = s_handle->obuf_total;
+		for (i = 0; i < s_handle->plan_len; i++) {
+			struct csv_col_plan *col = &s_handle->plan[i];
+			mval = ldms_metric_get(set, col->mid);
+			udata = (s_handle->udata ?
+				 ldms_metric_user_data_get(set, col->mid) : 0);
+			store_metric(s_handle, wsqt, udata,
+				     col->type, col->count, mval);
+		}
+		s_handle->byte_count += s_handle->obuf_total - pos;
+		csv_put_str(s_handle, "\n", "", "");
+		goto flush;
+	}
+
 	do {
 		int lidx = 0;
 		store_time_job_app(s_handle, ts, set);
+		pos = s_handle->obuf_total;
 		for (i = 0; i < metric_count; i++) {
 			mval = ldms_metric_get(set, metric_array[i]);
 			udata = ldms_metric_user_data_get(set, metric_array[i]);
@@ -1643,9 +1676,11 @@ static int store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arr
 					     metric_type, count, mval);
 			}
 		}
-		fprintf(s_handle->file,"\n");
+		s_handle->byte_count += s_handle->obuf_total - pos;
+		csv_put_str(s_handle, "\n", "", "");
 	} while (done < s_handle->num_lists);
 
+ flush:
 	s_handle->store_count++;
 
 	if ((s_handle->buffer_type == 3) &&
@@ -1660,7 +1695,7 @@ static int store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arr
 		doflush = 1;
 	}
 	if ((s_handle->buffer_sz == 0) || doflush){
-		fflush(s_handle->file);
+		csv_obuf_flush(s_handle);
 		fsync(fileno(s_handle->file));
 	}
 	pthread_mutex_unlock(&s_handle->lock);
@@ -1676,6 +1711,7 @@ static int flush_store(ldmsd_store_handle_t _s_handle)
 		return -1;
 	}
 	pthread_mutex_lock(&s_handle->lock);
+	csv_obuf_flush(s_handle);
 	fflush(s_handle->file);
 	pthread_mutex_unlock(&s_handle->lock);
 	return 0;
@@ -1686,6 +1722,7 @@ static void __csv_handle_close(struct csv_store_handle *s_handle)
 	pthread_mutex_lock(&s_handle->lock);
 	msglog(LDMSD_LDEBUG, PNAME ": Closing with path <%s>\n",
 	       s_handle->path);
+	csv_obuf_flush(s_handle);
 	fflush(s_handle->file);
 	if (s_handle->path)
 		free(s_handle->path);
@@ -1705,6 +1742,9 @@ static void __csv_handle_close(struct csv_store_handle *s_handle)
 		free(s_handle->store_key);
 	free(s_handle->container);
 	free(s_handle->schema);
+	free(s_handle->obuf);
+	free(s_handle->plan);
+	free(s_handle->plan_mids);
 	pthread_mutex_unlock(&s_handle->lock);
 	pthread_mutex_destroy(&s_handle->lock);
 	free(s_handle);
@@ -1977,242 +2017,179 @@ csv_row_schema_get(ldmsd_strgp_t strgp, struct csv_row_store_handle *rs_handle,
 	return NULL;
 }
 
-typedef struct csv_store_col_info_s {
-	struct csv_store_handle *s_handle;
-	ldms_mval_t v;
-	const char *ustr;
-	const char *sep;
-	const char *wsqt;
-	int i;
-} *csv_store_col_info_t;
-
-typedef int (*csv_store_col_fn)(csv_store_col_info_t ci);
-
-static int store_col_char(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%c", ci->ustr, ci->sep, ci->v->v_char);
-}
-
-static int store_col_u8(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%hhu", ci->ustr, ci->sep, ci->v->v_u8);
-}
-
-static int store_col_s8(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%hhd", ci->ustr, ci->sep, ci->v->v_s8);
-}
-
-static int store_col_u16(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%hu", ci->ustr, ci->sep, ci->v->v_u16);
-}
-
-static int store_col_s16(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%hd", ci->ustr, ci->sep, ci->v->v_s16);
-}
-
-static int store_col_u32(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%u", ci->ustr, ci->sep, ci->v->v_u32);
-}
-
-static int store_col_s32(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%d", ci->ustr, ci->sep, ci->v->v_s32);
-}
-
-static int store_col_u64(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%lu", ci->ustr, ci->sep, ci->v->v_u64);
-}
-
-static int store_col_s64(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%ld", ci->ustr, ci->sep, ci->v->v_s64);
-}
-
-static int store_col_f(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%f", ci->ustr, ci->sep, ci->v->v_f);
-}
-
-static int store_col_d(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%f", ci->ustr, ci->sep, ci->v->v_d);
-}
-
-static int store_col_ts(csv_store_col_info_t ci)
+/*
+ * Column writers for the decomposition path. Each column is written as
+ * [sep][udata,]value, with every array element in its own column.
+ */
+static inline char *csv_col_prefix(char *p, const char *sep, int has_udata,
+				   uint64_t udata)
 {
-	if (ci->s_handle->time_format == TF_MILLISEC) {
-		/* Alternate time format. First field is milliseconds-since-epoch,
-		   and the second field is the left-over microseconds */
-		return fprintf(ci->s_handle->file, "%s%s%lu,%u",
-				ci->ustr, ci->sep,
-				((uint64_t)ci->v->v_ts.sec * 1000) + (ci->v->v_ts.usec / 1000),
-				ci->v->v_ts.usec % 1000);
-	} else {
-		/* Traditional time format, where the first field is
-		   <seconds>.<microseconds>, second is microseconds repeated */
-		return fprintf(ci->s_handle->file, "%s%s%u.%06u,%u",
-				ci->ustr, ci->sep, ci->v->v_ts.sec,
-				ci->v->v_ts.usec, ci->v->v_ts.usec);
+	if (*sep)
+		*p++ = ',';
+	if (has_udata) {
+		p = csv_utoa(p, udata, 0);
+		*p++ = ',';
 	}
+	return p;
 }
 
-static int store_col_char_array(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%s%s%s",
-			ci->ustr, ci->sep, ci->wsqt, ci->v->a_char, ci->wsqt);
-}
-
-static int store_col_u8_array(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%hhu", ci->ustr, ci->sep, ci->v->a_u8[ci->i]);
-}
-
-static int store_col_s8_array(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%hhd", ci->ustr, ci->sep, ci->v->a_s8[ci->i]);
-}
-
-static int store_col_u16_array(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%hu", ci->ustr, ci->sep, ci->v->a_u16[ci->i]);
-}
-
-static int store_col_s16_array(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%hd", ci->ustr, ci->sep, ci->v->a_s16[ci->i]);
+#define CSV_COL_ARRAY_WRITER(_name_, _field_, _fmt_)			\
+static int store_col_##_name_##_array(struct csv_store_handle *sh,	\
+				      ldmsd_col_t col, const char *sep,	\
+				      int has_udata, uint64_t udata)	\
+{									\
+	char *p;							\
+	int i;								\
+	for (i = 0; i < col->array_len; i++) {				\
+		p = csv_obuf_reserve(sh, CSV_FIELD_MAX);		\
+		if (!p)							\
+			return ENOMEM;					\
+		p = csv_col_prefix(p, sep, has_udata, udata);		\
+		p = _fmt_(p, col->mval->_field_[i]);			\
+		csv_obuf_commit(sh, p);					\
+		sep = ",";						\
+	}								\
+	return 0;							\
 }
 
-static int store_col_u32_array(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%u", ci->ustr, ci->sep, ci->v->a_u32[ci->i]);
-}
-
-static int store_col_s32_array(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%d", ci->ustr, ci->sep, ci->v->a_s32[ci->i]);
-}
-
-static int store_col_u64_array(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%lu", ci->ustr, ci->sep, ci->v->a_u64[ci->i]);
-}
-
-static int store_col_s64_array(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%ld", ci->ustr, ci->sep, ci->v->a_s64[ci->i]);
-}
-
-static int store_col_f_array(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%.9g", ci->ustr, ci->sep, ci->v->a_f[ci->i]);
-}
-
-static int store_col_d_array(csv_store_col_info_t ci)
-{
-	return fprintf(ci->s_handle->file, "%s%s%.17g", ci->ustr, ci->sep, ci->v->a_d[ci->i]);
-}
-
-csv_store_col_fn __store_col_fn_tbl[] = {
-	[LDMS_V_CHAR]       = store_col_char,
-	[LDMS_V_U8]         = store_col_u8,
-	[LDMS_V_S8]         = store_col_s8,
-	[LDMS_V_U16]        = store_col_u16,
-	[LDMS_V_S16]        = store_col_s16,
-	[LDMS_V_U32]        = store_col_u32,
-	[LDMS_V_S32]        = store_col_s32,
-	[LDMS_V_U64]        = store_col_u64,
-	[LDMS_V_S64]        = store_col_s64,
-	[LDMS_V_F32]        = store_col_f,
-	[LDMS_V_D64]        = store_col_d,
-	[LDMS_V_CHAR_ARRAY] = store_col_char_array,
-	[LDMS_V_U8_ARRAY]   = store_col_u8_array,
-	[LDMS_V_S8_ARRAY]   = store_col_s8_array,
-	[LDMS_V_U16_ARRAY]  = store_col_u16_array,
-	[LDMS_V_S16_ARRAY]  = store_col_s16_array,
-	[LDMS_V_U32_ARRAY]  = store_col_u32_array,
-	[LDMS_V_S32_ARRAY]  = store_col_s32_array,
-	[LDMS_V_U64_ARRAY]  = store_col_u64_array,
-	[LDMS_V_S64_ARRAY]  = store_col_s64_array,
-	[LDMS_V_F32_ARRAY]  = store_col_f_array,
-	[LDMS_V_D64_ARRAY]  = store_col_d_array,
-	[LDMS_V_TIMESTAMP]  = store_col_ts,
-	[LDMS_V_LAST+1]     = NULL,
-};
+CSV_COL_ARRAY_WRITER(u8, a_u8, CSV_U)
+CSV_COL_ARRAY_WRITER(s8, a_s8, CSV_I)
+CSV_COL_ARRAY_WRITER(u16, a_u16, CSV_U)
+CSV_COL_ARRAY_WRITER(s16, a_s16, CSV_I)
+CSV_COL_ARRAY_WRITER(u32, a_u32, CSV_U)
+CSV_COL_ARRAY_WRITER(s32, a_s32, CSV_I)
+CSV_COL_ARRAY_WRITER(u64, a_u64, CSV_U)
+CSV_COL_ARRAY_WRITER(s64, a_s64, CSV_I)
+CSV_COL_ARRAY_WRITER(f32, a_f, CSV_F)
+CSV_COL_ARRAY_WRITER(d64, a_d, CSV_D)
 
 /* caller MUST hold s_handle->lock */
 static int store_col(ldms_set_t set, struct csv_store_handle *s_handle,
 		     ldmsd_col_t col, int is_first)
 {
-	uint64_t udata;
-	int rc = 0, i, len;
-	const char *ustr = "";
-	char udata_str[64] = "";
-	char udata_str_arr[64] = ""; /* for array elements */
+	uint64_t udata = 0;
+	int has_udata = 0;
 	const char *sep = is_first?"":",";
-	struct csv_store_col_info_s ci;
-	csv_store_col_fn col_fn;
+	ldms_mval_t v = col->mval;
+	char *b, *p;
 
-	col_fn = col->type > LDMS_V_LAST ? NULL : __store_col_fn_tbl[col->type];
-	if (!col_fn) {
+	if (s_handle->udata && !is_phony_metric_id(col->metric_id)) {
+		/* NOTE: Phony metrics do NOT have udata. */
+		udata = ldms_metric_user_data_get(set, col->metric_id);
+		has_udata = 1;
+	}
+
+	switch (col->type) {
+	case LDMS_V_U8_ARRAY:
+		return store_col_u8_array(s_handle, col, sep, has_udata, udata);
+	case LDMS_V_S8_ARRAY:
+		return store_col_s8_array(s_handle, col, sep, has_udata, udata);
+	case LDMS_V_U16_ARRAY:
+		return store_col_u16_array(s_handle, col, sep, has_udata, udata);
+	case LDMS_V_S16_ARRAY:
+		return store_col_s16_array(s_handle, col, sep, has_udata, udata);
+	case LDMS_V_U32_ARRAY:
+		return store_col_u32_array(s_handle, col, sep, has_udata, udata);
+	case LDMS_V_S32_ARRAY:
+		return store_col_s32_array(s_handle, col, sep, has_udata, udata);
+	case LDMS_V_U64_ARRAY:
+		return store_col_u64_array(s_handle, col, sep, has_udata, udata);
+	case LDMS_V_S64_ARRAY:
+		return store_col_s64_array(s_handle, col, sep, has_udata, udata);
+	case LDMS_V_F32_ARRAY:
+		return store_col_f32_array(s_handle, col, sep, has_udata, udata);
+	case LDMS_V_D64_ARRAY:
+		return store_col_d64_array(s_handle, col, sep, has_udata, udata);
+	case LDMS_V_CHAR_ARRAY:
+		p = csv_obuf_reserve(s_handle, CSV_FIELD_MAX);
+		if (!p)
+			return ENOMEM;
+		csv_obuf_commit(s_handle, csv_col_prefix(p, sep, has_udata, udata));
+		csv_put_str(s_handle, "", s_handle->ietfcsv?"\"":"", v->a_char);
+		return 0;
+	case LDMS_V_CHAR:
+	case LDMS_V_U8:
+	case LDMS_V_S8:
+	case LDMS_V_U16:
+	case LDMS_V_S16:
+	case LDMS_V_U32:
+	case LDMS_V_S32:
+	case LDMS_V_U64:
+	case LDMS_V_S64:
+	case LDMS_V_F32:
+	case LDMS_V_D64:
+	case LDMS_V_TIMESTAMP:
+		break;
+	default:
 		ERR_LOG("Unsupported type %d: %s\n", col->type, ldms_metric_type_to_str(col->type));
 		return EINVAL;
 	}
 
-	if (s_handle->udata && !is_phony_metric_id(col->metric_id)) {
-		/* NOTE: Phony metrics do NOT have udata. */
-		udata = ldms_metric_user_data_get(set, col->metric_id);
-		snprintf(udata_str, sizeof(udata_str), "%s%lu", sep, udata);
-		sep = ",";
-		snprintf(udata_str_arr, sizeof(udata_str_arr), "%s%lu", sep, udata);
-		ustr = udata_str;
-	}
-
-	ci.ustr = ustr;
-	ci.sep = sep;
-	ci.s_handle = s_handle;
-	ci.v = col->mval;
-	ci.wsqt = s_handle->ietfcsv?"\"":""; /* ietf quotation wrapping strings */
-
-	if (ldms_type_is_array(col->type) && col->type != LDMS_V_CHAR_ARRAY) {
-		/* array */
-		for (i = 0; i < col->array_len; i++) {
-			ci.i = i;
-			len = col_fn(&ci);
-			if (len < 0) {
-				rc = errno;
-				ERR_LOG("Error %d writing to '%s'\n", errno, s_handle->filename);
-			} else {
-				s_handle->byte_count += len;
-			}
-			if (i == 0) {
-				/* make sure to have "," for the rest */
-				ci.ustr = udata_str_arr;
-				ci.sep = ",";
-			}
-		}
-	} else {
-		/* single value */
-		len = col_fn(&ci);
-		if (len < 0) {
-			rc = errno;
-			ERR_LOG("Error %d writing to '%s'\n", errno, s_handle->filename);
+	b = csv_obuf_reserve(s_handle, CSV_FIELD_F_MAX);
+	if (!b)
+		return ENOMEM;
+	p = csv_col_prefix(b, sep, has_udata, udata);
+	switch (col->type) {
+	case LDMS_V_CHAR:
+		*p++ = v->v_char;
+		break;
+	case LDMS_V_U8:
+		p = csv_utoa(p, v->v_u8, 0);
+		break;
+	case LDMS_V_S8:
+		p = csv_itoa(p, v->v_s8);
+		break;
+	case LDMS_V_U16:
+		p = csv_utoa(p, v->v_u16, 0);
+		break;
+	case LDMS_V_S16:
+		p = csv_itoa(p, v->v_s16);
+		break;
+	case LDMS_V_U32:
+		p = csv_utoa(p, v->v_u32, 0);
+		break;
+	case LDMS_V_S32:
+		p = csv_itoa(p, v->v_s32);
+		break;
+	case LDMS_V_U64:
+		p = csv_utoa(p, v->v_u64, 0);
+		break;
+	case LDMS_V_S64:
+		p = csv_itoa(p, v->v_s64);
+		break;
+	case LDMS_V_F32:
+		p = csv_ftoa(p, "%f", v->v_f, CSV_FIELD_F_MAX - (p - b));
+		break;
+	case LDMS_V_D64:
+		p = csv_ftoa(p, "%f", v->v_d, CSV_FIELD_F_MAX - (p - b));
+		break;
+	default: /* LDMS_V_TIMESTAMP */
+		if (s_handle->time_format == TF_MILLISEC) {
+			/* Alternate time format. First field is milliseconds-since-epoch,
+			   and the second field is the left-over microseconds */
+			p = csv_utoa(p, ((uint64_t)v->v_ts.sec * 1000) + (v->v_ts.usec / 1000), 0);
+			*p++ = ',';
+			p = csv_utoa(p, v->v_ts.usec % 1000, 0);
 		} else {
-			s_handle->byte_count += len;
+			/* Traditional time format, where the first field is
+			   <seconds>.<microseconds>, second is microseconds repeated */
+			p = csv_utoa(p, v->v_ts.sec, 0);
+			*p++ = '.';
+			p = csv_utoa(p, v->v_ts.usec, 6);
+			*p++ = ',';
+			p = csv_utoa(p, v->v_ts.usec, 0);
 		}
+		break;
 	}
-
-	return rc;
+	csv_obuf_commit(s_handle, p);
+	return 0;
 }
 
 static int
 store_row(ldmsd_strgp_t strgp, ldms_set_t set, struct csv_store_handle *s_handle, ldmsd_row_t row)
 {
 	int rc, i, col_rc;
+	uint64_t pos;
 	ldmsd_col_t col;
 
 	rc = 0;
@@ -2241,13 +2218,15 @@ store_row(ldmsd_strgp_t strgp, ldms_set_t set, struct csv_store_handle *s_handle
 		break;
 	}
 
+	pos = s_handle->obuf_total;
 	for (i = 0; i < row->col_count; i++) {
 		col = &row->cols[i];
 		col_rc = store_col(set, s_handle, col, 0 == i);
 		if (col_rc)
 			rc = col_rc;
 	}
-	fprintf(s_handle->file, "\n");
+	s_handle->byte_count += s_handle->obuf_total - pos;
+	csv_put_str(s_handle, "\n", "", "");
 	int doflush = 0;
 	if ((s_handle->buffer_type == 3) &&
 	    ((s_handle->store_count - s_handle->lastflush) >=
@@ -2261,7 +2240,7 @@ store_row(ldmsd_strgp_t strgp, ldms_set_t set, struct csv_store_handle *s_handle
 		doflush = 1;
 	}
 	if ((s_handle->buffer_sz == 0) || doflush){
-		fflush(s_handle->file);
+		csv_obuf_flush(s_handle);
 		fsync(fileno(s_handle->file));
 	}
  out:
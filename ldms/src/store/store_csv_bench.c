@@ -0,0 +1,639 @@
+/*
+ * The writers are static, so the bench is built from the plugin source.
+ */
+#include "store_csv.c"
+
+#include <stdarg.h>
+#include <float.h>
+#include <math.h>
+#include <time.h>
+
+/*
+ * CSV writer benchmark
+ *
+ * A set with a metric of every scalar and array type is filled with
+ * random values, including the extremes of each type, NaN, infinities
+ * and empty strings. Every store the set is written both by store() and
+ * store_row() and by a reference writer that makes the same fprintf()
+ * calls the plugin used to make. Each combination of expand_array,
+ * userdata, ietfcsv and time_format is a test that checks the files and
+ * the byte counts are identical. The last test reports the time per
+ * store of each writer.
+ */
+
+#define SCHEMA_NAME "csvbench"
+#define STR_LEN 32
+
+static int dim = 64;
+static int store_count = 200;
+static int timed_count = 5000;
+static char *dir = "/tmp";
+
+static const enum ldms_value_type bench_types[] = {
+	LDMS_V_CHAR, LDMS_V_U8, LDMS_V_S8, LDMS_V_U16, LDMS_V_S16,
+	LDMS_V_U32, LDMS_V_S32, LDMS_V_U64, LDMS_V_S64,
+	LDMS_V_F32, LDMS_V_D64, LDMS_V_CHAR_ARRAY,
+	LDMS_V_U8_ARRAY, LDMS_V_S8_ARRAY, LDMS_V_U16_ARRAY, LDMS_V_S16_ARRAY,
+	LDMS_V_U32_ARRAY, LDMS_V_S32_ARRAY, LDMS_V_U64_ARRAY, LDMS_V_S64_ARRAY,
+	LDMS_V_F32_ARRAY, LDMS_V_D64_ARRAY,
+};
+#define TYPE_COUNT (sizeof(bench_types) / sizeof(bench_types[0]))
+
+static void bench_usage(const char *prog)
+{
+	printf("Usage: %s [-d array_len] [-n stores] [-t timed_stores] "
+	       "[-D dir]\n", prog);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* provided by ldmsd to the plugins it loads */
+void ldmsd_log(enum ldmsd_loglevel level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (level < LDMSD_LWARNING)
+		return;
+	printf("# ");
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+enum ldmsd_loglevel ldmsd_loglevel_get()
+{
+	return LDMSD_LWARNING;
+}
+
+/* ---- reference writer ---- */
+
+struct ref_handle {
+	FILE *file;
+	int64_t byte_count;
+	struct csv_store_handle *cfg;	/* the options to write with */
+};
+
+static void ref_check(struct ref_handle *rh, int rc)
+{
+	if (rc >= 0)
+		rh->byte_count += rc;
+}
+
+/* one value in the format the plugin used for the store() path */
+static int ref_value(FILE *f, const char *pre, enum ldms_value_type type,
+		     ldms_mval_t v, int i)
+{
+	switch (type) {
+	case LDMS_V_U8:
+		return fprintf(f, "%s%hhu", pre, v->v_u8);
+	case LDMS_V_S8:
+		return fprintf(f, "%s%hhd", pre, v->v_s8);
+	case LDMS_V_U16:
+		return fprintf(f, "%s%hu", pre, v->v_u16);
+	case LDMS_V_S16:
+		return fprintf(f, "%s%hd", pre, v->v_s16);
+	case LDMS_V_U32:
+		return fprintf(f, "%s%" PRIu32, pre, v->v_u32);
+	case LDMS_V_S32:
+		return fprintf(f, "%s%" PRId32, pre, v->v_s32);
+	case LDMS_V_U64:
+		return fprintf(f, "%s%" PRIu64, pre, v->v_u64);
+	case LDMS_V_S64:
+		return fprintf(f, "%s%" PRId64, pre, v->v_s64);
+	case LDMS_V_F32:
+		return fprintf(f, "%s%.9g", pre, v->v_f);
+	case LDMS_V_D64:
+		return fprintf(f, "%s%.17g", pre, v->v_d);
+	case LDMS_V_U8_ARRAY:
+		return fprintf(f, "%s%hhu", pre, v->a_u8[i]);
+	case LDMS_V_S8_ARRAY:
+		return fprintf(f, "%s%hhd", pre, v->a_s8[i]);
+	case LDMS_V_U16_ARRAY:
+		return fprintf(f, "%s%hu", pre, v->a_u16[i]);
+	case LDMS_V_S16_ARRAY:
+		return fprintf(f, "%s%hd", pre, v->a_s16[i]);
+	case LDMS_V_U32_ARRAY:
+		return fprintf(f, "%s%" PRIu32, pre, v->a_u32[i]);
+	case LDMS_V_S32_ARRAY:
+		return fprintf(f, "%s%" PRId32, pre, v->a_s32[i]);
+	case LDMS_V_U64_ARRAY:
+		return fprintf(f, "%s%" PRIu64, pre, v->a_u64[i]);
+	case LDMS_V_S64_ARRAY:
+		return fprintf(f, "%s%" PRId64, pre, v->a_s64[i]);
+	case LDMS_V_F32_ARRAY:
+		return fprintf(f, "%s%.9g", pre, v->a_f[i]);
+	case LDMS_V_D64_ARRAY:
+		return fprintf(f, "%s%.17g", pre, v->a_d[i]);
+	default:
+		return -1;
+	}
+}
+
+static void ref_metric(struct ref_handle *rh, const char *wsqt, uint64_t udata,
+		       enum ldms_value_type type, size_t count, ldms_mval_t v)
+{
+	struct csv_store_handle *cfg = rh->cfg;
+	char pre[3];
+	int i;
+
+	if (cfg->udata && (!ldms_type_is_array(type) || !cfg->expand_array ||
+			   type == LDMS_V_CHAR_ARRAY))
+		ref_check(rh, fprintf(rh->file, ",%" PRIu64, udata));
+	switch (type) {
+	case LDMS_V_CHAR_ARRAY:
+		ref_check(rh, fprintf(rh->file, ",%s%s%s", wsqt, v->a_char, wsqt));
+		return;
+	case LDMS_V_CHAR:
+		ref_check(rh, fprintf(rh->file, ",%c", v->v_char));
+		return;
+	default:
+		break;
+	}
+	if (!ldms_type_is_array(type)) {
+		ref_check(rh, ref_value(rh->file, ",", type, v, 0));
+		return;
+	}
+	for (i = 0; i < count; i++) {
+		if (cfg->expand_array) {
+			if (cfg->udata)
+				ref_check(rh, fprintf(rh->file, ",%" PRIu64, udata));
+			ref_check(rh, ref_value(rh->file, ",", type, v, i));
+		} else if (type == LDMS_V_S64_ARRAY) {
+			ref_check(rh, ref_value(rh->file, (i ? "," : ",\""),
+						type, v, i));
+		} else {
+			if (i == 0)
+				snprintf(pre, sizeof(pre), ",%c", cfg->array_lquote);
+			else
+				snprintf(pre, sizeof(pre), "%c", cfg->array_sep);
+			ref_check(rh, ref_value(rh->file, pre, type, v, i));
+		}
+	}
+	if (cfg->expand_array)
+		return;
+	if (type == LDMS_V_S64_ARRAY)
+		ref_check(rh, fprintf(rh->file, "\""));
+	else
+		ref_check(rh, fprintf(rh->file, "%c", cfg->array_rquote));
+}
+
+static void ref_store(struct ref_handle *rh, ldms_set_t set,
+		      int *metric_array, size_t metric_count)
+{
+	const struct ldms_timestamp ts = ldms_transaction_timestamp_get(set);
+	const char *wsqt = (rh->cfg->ietfcsv ? "\"" : "");
+	const char *pname;
+	enum ldms_value_type type;
+	size_t count;
+	int i;
+
+	if (rh->cfg->time_format == TF_MILLISEC)
+		fprintf(rh->file, "%"PRIu64",%"PRIu32,
+			((uint64_t)ts.sec * 1000) + (ts.usec / 1000),
+			ts.usec % 1000);
+	else
+		fprintf(rh->file, "%"PRIu32".%06"PRIu32 ",%"PRIu32,
+			ts.sec, ts.usec, ts.usec);
+	pname = ldms_set_producer_name_get(set);
+	fprintf(rh->file, ",%s", pname);
+	rh->byte_count += strlen(pname);
+	for (i = 0; i < metric_count; i++) {
+		type = ldms_metric_type_get(set, metric_array[i]);
+		count = (ldms_type_is_array(type) ?
+			 ldms_metric_array_get_len(set, metric_array[i]) : 1);
+		ref_metric(rh, wsqt, ldms_metric_user_data_get(set, metric_array[i]),
+			   type, count, ldms_metric_get(set, metric_array[i]));
+	}
+	fprintf(rh->file, "\n");
+}
+
+/* one column in the format the plugin used for the store_row() path */
+static void ref_col(struct ref_handle *rh, ldms_set_t set, ldmsd_col_t col,
+		    int is_first)
+{
+	struct csv_store_handle *cfg = rh->cfg;
+	const char *wsqt = (cfg->ietfcsv ? "\"" : "");
+	char ustr[64] = "", ustr_arr[64] = "";
+	const char *sep = (is_first ? "" : ",");
+	ldms_mval_t v = col->mval;
+	char pre[72];
+	int i;
+
+	if (cfg->udata && !is_phony_metric_id(col->metric_id)) {
+		uint64_t udata = ldms_metric_user_data_get(set, col->metric_id);
+		snprintf(ustr, sizeof(ustr), "%s%lu", sep, udata);
+		sep = ",";
+		snprintf(ustr_arr, sizeof(ustr_arr), ",%lu", udata);
+	}
+	snprintf(pre, sizeof(pre), "%s%s", ustr, sep);
+	switch (col->type) {
+	case LDMS_V_CHAR:
+		ref_check(rh, fprintf(rh->file, "%s%c", pre, v->v_char));
+		return;
+	case LDMS_V_F32:
+		ref_check(rh, fprintf(rh->file, "%s%f", pre, v->v_f));
+		return;
+	case LDMS_V_D64:
+		ref_check(rh, fprintf(rh->file, "%s%f", pre, v->v_d));
+		return;
+	case LDMS_V_CHAR_ARRAY:
+		ref_check(rh, fprintf(rh->file, "%s%s%s%s", pre, wsqt,
+				      v->a_char, wsqt));
+		return;
+	case LDMS_V_TIMESTAMP:
+		if (cfg->time_format == TF_MILLISEC)
+			ref_check(rh, fprintf(rh->file, "%s%lu,%u", pre,
+				((uint64_t)v->v_ts.sec * 1000) + (v->v_ts.usec / 1000),
+				v->v_ts.usec % 1000));
+		else
+			ref_check(rh, fprintf(rh->file, "%s%u.%06u,%u", pre,
+				v->v_ts.sec, v->v_ts.usec, v->v_ts.usec));
+		return;
+	default:
+		break;
+	}
+	if (!ldms_type_is_array(col->type)) {
+		ref_check(rh, ref_value(rh->file, pre, col->type, v, 0));
+		return;
+	}
+	for (i = 0; i < col->array_len; i++) {
+		ref_check(rh, ref_value(rh->file, pre, col->type, v, i));
+		snprintf(pre, sizeof(pre), "%s,", ustr_arr);
+	}
+}
+
+static void ref_row(struct ref_handle *rh, ldms_set_t set, ldmsd_row_t row)
+{
+	int i;
+
+	for (i = 0; i < row->col_count; i++)
+		ref_col(rh, set, &row->cols[i], 0 == i);
+	fprintf(rh->file, "\n");
+}
+
+/* ---- set ---- */
+
+static uint64_t rand64(void)
+{
+	return ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
+}
+
+/* mostly ordinary values, sometimes an edge of the type */
+static uint64_t rand_int(void)
+{
+	switch (rand() % 8) {
+	case 0:
+		return 0;
+	case 1:
+		return (uint64_t)-1;
+	case 2:
+		return (uint64_t)1 << (rand() % 64);
+	case 3:
+		return -(rand() % 1000);
+	default:
+		return rand64() >> (rand() % 64);
+	}
+}
+
+static double rand_double(int is_float)
+{
+	double big = (is_float ? FLT_MAX : DBL_MAX);
+	double small = (is_float ? FLT_MIN : DBL_MIN);
+
+	switch (rand() % 12) {
+	case 0:
+		return 0.0;
+	case 1:
+		return -0.0;
+	case 2:
+		return NAN;
+	case 3:
+		return (rand() % 2 ? INFINITY : -INFINITY);
+	case 4:
+		return (rand() % 2 ? big : -big);
+	case 5:
+		return small * (rand() % 100);
+	case 6:
+		return (double)(rand() % 100000);
+	default:
+		return ((double)rand() / RAND_MAX - 0.5) *
+			pow(10, rand() % 40 - 20);
+	}
+}
+
+static void fill_str(char *s)
+{
+	int i, len = rand() % STR_LEN;
+
+	for (i = 0; i < len; i++)
+		s[i] = ' ' + 1 + rand() % 94;
+	s[len] = '\0';
+}
+
+static void update(ldms_set_t set)
+{
+	enum ldms_value_type type;
+	ldms_mval_t v;
+	uint64_t x;
+	int i, j, len;
+
+	ldms_transaction_begin(set);
+	for (i = 0; i < TYPE_COUNT; i++) {
+		type = bench_types[i];
+		v = ldms_metric_get(set, i);
+		len = (ldms_type_is_array(type) ? ldms_metric_array_get_len(set, i) : 1);
+		if (rand() % 4 == 0)
+			ldms_metric_user_data_set(set, i, rand_int());
+		for (j = 0; j < len; j++) {
+			x = rand_int();
+			switch (type) {
+			case LDMS_V_CHAR:
+				v->v_char = ' ' + 1 + rand() % 94;
+				break;
+			case LDMS_V_CHAR_ARRAY:
+				fill_str(v->a_char);
+				j = len;
+				break;
+			case LDMS_V_U8:
+			case LDMS_V_S8:
+			case LDMS_V_U8_ARRAY:
+			case LDMS_V_S8_ARRAY:
+				v->a_u8[j] = x;
+				break;
+			case LDMS_V_U16:
+			case LDMS_V_S16:
+			case LDMS_V_U16_ARRAY:
+			case LDMS_V_S16_ARRAY:
+				v->a_u16[j] = x;
+				break;
+			case LDMS_V_U32:
+			case LDMS_V_S32:
+			case LDMS_V_U32_ARRAY:
+			case LDMS_V_S32_ARRAY:
+				v->a_u32[j] = x;
+				break;
+			case LDMS_V_F32:
+			case LDMS_V_F32_ARRAY:
+				v->a_f[j] = rand_double(1);
+				break;
+			case LDMS_V_D64:
+			case LDMS_V_D64_ARRAY:
+				v->a_d[j] = rand_double(0);
+				break;
+			default:
+				v->a_u64[j] = x;
+				break;
+			}
+		}
+	}
+	ldms_transaction_end(set);
+}
+
+/* a phony timestamp column followed by a column per metric */
+static ldmsd_row_t row_new(ldms_set_t set, union ldms_value *ts)
+{
+	ldmsd_row_t row;
+	int i;
+
+	row = calloc(1, sizeof(*row) + (TYPE_COUNT + 1) * sizeof(row->cols[0]));
+	row->col_count = TYPE_COUNT + 1;
+	row->cols[0].name = "timestamp";
+	row->cols[0].type = LDMS_V_TIMESTAMP;
+	row->cols[0].mval = ts;
+	row->cols[0].metric_id = LDMSD_PHONY_METRIC_ID_TIMESTAMP;
+	row->cols[0].rec_metric_id = -1;
+	for (i = 0; i < TYPE_COUNT; i++) {
+		ldmsd_col_t col = &row->cols[i + 1];
+		col->name = ldms_metric_name_get(set, i);
+		col->type = bench_types[i];
+		col->mval = ldms_metric_get(set, i);
+		col->array_len = (ldms_type_is_array(col->type) ?
+				  ldms_metric_array_get_len(set, i) : 1);
+		col->metric_id = i;
+		col->rec_metric_id = -1;
+	}
+	return row;
+}
+
+/* ---- tests ---- */
+
+static struct csv_store_handle *handle_new(const char *path, int expand_array,
+					   int udata, int ietfcsv, int time_format)
+{
+	struct csv_store_handle *sh = calloc(1, sizeof(*sh));
+
+	sh->type = CSV_STORE_HANDLE;
+	sh->path = strdup(path);
+	sh->file = fopen(path, "w");
+	if (!sh->file) {
+		printf("Bail out! cannot open %s: %d\n", path, errno);
+		exit(1);
+	}
+	pthread_mutex_init(&sh->lock, NULL);
+	sh->printheader = DONT_PRINT_HEADER;
+	sh->num_lists = -1;
+	sh->store_key = "bench/" SCHEMA_NAME;
+	sh->buffer_sz = INT_MAX;
+	sh->expand_array = expand_array;
+	sh->array_sep = ':';
+	sh->array_lquote = '"';
+	sh->array_rquote = '"';
+	sh->udata = udata;
+	sh->ietfcsv = ietfcsv;
+	sh->time_format = time_format;
+	return sh;
+}
+
+static void handle_free(struct csv_store_handle *sh)
+{
+	csv_obuf_flush(sh);
+	fclose(sh->file);
+	free(sh->path);
+	free(sh->obuf);
+	free(sh->plan);
+	free(sh->lents);
+	free(sh);
+}
+
+static int same_file(const char *a, const char *b, long *size)
+{
+	FILE *fa = fopen(a, "r"), *fb = fopen(b, "r");
+	int ca, cb, same = (fa && fb);
+
+	*size = 0;
+	while (same) {
+		ca = getc(fa);
+		cb = getc(fb);
+		if (ca != cb)
+			same = 0;
+		if (ca == EOF)
+			break;
+		(*size)++;
+	}
+	if (!same)
+		printf("# %s and %s differ at byte %ld\n", a, b, *size);
+	if (fa)
+		fclose(fa);
+	if (fb)
+		fclose(fb);
+	return same;
+}
+
+static int run_compare(ldms_set_t set, int *metric_array, int test_no,
+		       int expand_array, int udata, int ietfcsv, int time_format)
+{
+	char ref_path[PATH_MAX], new_path[PATH_MAX];
+	char ref_rpath[PATH_MAX], new_rpath[PATH_MAX];
+	struct csv_store_handle *sh, *rsh;
+	struct ref_handle ref, rref;
+	union ldms_value ts;
+	ldmsd_row_t row;
+	long size = 0, rsize = 0;
+	int i, ok, same, rsame;
+
+	snprintf(ref_path, sizeof(ref_path), "%s/csvbench.%d.ref", dir, getpid());
+	snprintf(new_path, sizeof(new_path), "%s/csvbench.%d.new", dir, getpid());
+	snprintf(ref_rpath, sizeof(ref_rpath), "%s/csvbench.%d.rref", dir, getpid());
+	snprintf(new_rpath, sizeof(new_rpath), "%s/csvbench.%d.rnew", dir, getpid());
+	sh = handle_new(new_path, expand_array, udata, ietfcsv, time_format);
+	rsh = handle_new(new_rpath, expand_array, udata, ietfcsv, time_format);
+	ref.cfg = rref.cfg = sh;
+	ref.byte_count = rref.byte_count = 0;
+	ref.file = fopen(ref_path, "w");
+	rref.file = fopen(ref_rpath, "w");
+	if (!ref.file || !rref.file) {
+		printf("Bail out! cannot open the reference files in %s\n", dir);
+		exit(1);
+	}
+	row = row_new(set, &ts);
+	srand(test_no);
+	for (i = 0; i < store_count; i++) {
+		update(set);
+		ref_store(&ref, set, metric_array, TYPE_COUNT);
+		store(sh, set, metric_array, TYPE_COUNT);
+		ts.v_ts = ldms_transaction_timestamp_get(set);
+		ref_row(&rref, set, row);
+		store_row(NULL, set, rsh, row);
+	}
+	fclose(ref.file);
+	fclose(rref.file);
+	ok = (ref.byte_count == sh->byte_count &&
+	      rref.byte_count == rsh->byte_count);
+	if (!ok)
+		printf("# byte_count %" PRId64 "/%" PRId64 ", rows %" PRId64
+		       "/%" PRId64 "\n", ref.byte_count, sh->byte_count,
+		       rref.byte_count, rsh->byte_count);
+	handle_free(sh);
+	handle_free(rsh);
+	same = same_file(ref_path, new_path, &size);
+	rsame = same_file(ref_rpath, new_rpath, &rsize);
+	ok = same && rsame && ok;
+	printf("%s %d - expand_array=%d userdata=%d ietfcsv=%d time_format=%d: "
+	       "%ld bytes, %ld row bytes\n", (ok ? "ok" : "not ok"), test_no,
+	       expand_array, udata, ietfcsv, time_format, size, rsize);
+	unlink(ref_path);
+	unlink(new_path);
+	unlink(ref_rpath);
+	unlink(new_rpath);
+	free(row);
+	return !ok;
+}
+
+static void run_timed(ldms_set_t set, int *metric_array, int test_no)
+{
+	struct csv_store_handle *sh;
+	struct ref_handle ref;
+	double t, t_ref = 0, t_new = 0;
+	int i;
+
+	sh = handle_new("/dev/null", 1, 0, 0, 0);
+	ref.cfg = sh;
+	ref.byte_count = 0;
+	ref.file = fopen("/dev/null", "w");
+	srand(test_no);
+	for (i = 0; i < timed_count; i++) {
+		update(set);
+		t = now();
+		ref_store(&ref, set, metric_array, TYPE_COUNT);
+		t_ref += now() - t;
+		t = now();
+		store(sh, set, metric_array, TYPE_COUNT);
+		t_new += now() - t;
+	}
+	fflush(ref.file);
+	fclose(ref.file);
+	handle_free(sh);
+	printf("ok %d - fprintf %.2f us/store, buffered %.2f us/store (%.1fx), "
+	       "%.0f bytes/store\n", test_no, t_ref * 1e6 / timed_count,
+	       t_new * 1e6 / timed_count, t_ref / t_new,
+	       (double)ref.byte_count / timed_count);
+}
+
+int main(int argc, char **argv)
+{
+	ldms_schema_t schema;
+	ldms_set_t set;
+	int metric_array[TYPE_COUNT];
+	char name[16];
+	int op, i, rc = 0, n = 0;
+	int expand_array, udata, ietfcsv, time_format;
+
+	while ((op = getopt(argc, argv, "d:n:t:D:h")) != -1) {
+		switch (op) {
+		case 'd':
+			dim = atoi(optarg);
+			break;
+		case 'n':
+			store_count = atoi(optarg);
+			break;
+		case 't':
+			timed_count = atoi(optarg);
+			break;
+		case 'D':
+			dir = optarg;
+			break;
+		default:
+			bench_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (dim < 1 || store_count < 1 || timed_count < 1) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	msglog = ldmsd_log;
+	ldms_init(16 * 1024 * 1024);
+	schema = ldms_schema_new(SCHEMA_NAME);
+	for (i = 0; i < TYPE_COUNT; i++) {
+		snprintf(name, sizeof(name), "m%d", i);
+		if (bench_types[i] == LDMS_V_CHAR_ARRAY)
+			ldms_schema_metric_array_add(schema, name, bench_types[i], STR_LEN);
+		else if (ldms_type_is_array(bench_types[i]))
+			ldms_schema_metric_array_add(schema, name, bench_types[i], dim);
+		else
+			ldms_schema_metric_add(schema, name, bench_types[i]);
+		metric_array[i] = i;
+	}
+	set = ldms_set_new("node/" SCHEMA_NAME, schema);
+	if (!set) {
+		printf("Bail out! cannot create the set\n");
+		return 1;
+	}
+	ldms_set_producer_name_set(set, "node");
+
+	printf("1..17\n");
+	for (expand_array = 0; expand_array < 2; expand_array++)
+	for (udata = 0; udata < 2; udata++)
+	for (ietfcsv = 0; ietfcsv < 2; ietfcsv++)
+	for (time_format = 0; time_format < 2; time_format++)
+		rc |= run_compare(set, metric_array, ++n, expand_array,
+				  udata, ietfcsv, time_format);
+	run_timed(set, metric_array, ++n);
+	return (rc ? 1 : 0);
+}
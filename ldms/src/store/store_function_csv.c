@@ -273,6 +273,7 @@ struct setdatapoint{ //one of these for each instance for each schema
 	struct dinfo* datavals; /* derived vals from the last timestep (one for each derived metric)
 				   indicies are those of the derived metrics (not the sources).
 				   The der and datavals are in the same order. */
+	uint64_t* slab; /* one allocation holding the storevals and returnvals of all the datavals */
 };
 /******/
 
@@ -328,6 +329,7 @@ struct function_store_handle { //these are per-schema
 	int64_t lastflush;
 	int64_t store_count;
 	int64_t byte_count;
+	struct func_plan *plan; /* der compiled for evaluation. built on the first store */
 };
 
 /******/
@@ -2664,12 +2666,470 @@ oom1:
 
 };
 
+/****** compiled evaluation plan (one per schema) ******/
+/*
+ * doFunc works out the shape of a derived metric from its derived_data
+ * and fetches every input element through the ldms accessors on every
+ * store. The plan does that work once per schema: the base metrics that
+ * the derived metrics read are copied into one contiguous array per
+ * store, and each derived metric becomes an op whose inputs point either
+ * into that array or at the return values of an earlier derived metric
+ * in the set's slab. The op loops then run over plain uint64_t arrays.
+ *
+ * The results are exactly those of doFunc, including its handling of
+ * invalid inputs. A MAX_N/MIN_N/SUM_N/AVG_N whose inputs do not all have
+ * the dimensionality of the result (calcDimValidate does not check the
+ * last one) is still evaluated by doFunc, as are sets whose schema digest
+ * differs from the one the plan was built for.
+ */
+struct plan_in {
+	met_t typei;
+	int i; /* BASE: offset into the plan vals. DER: index of the derived metric */
+	int dim;
+};
+
+struct plan_op {
+	struct derived_data* dd;
+	struct plan_in* in; /* dd->nvars inputs. NULL for RAWTERM */
+	int fallback; /* evaluate with doFunc */
+	int nocheck; /* RATE/DELTA of a base scalar do not check for negative diffs */
+};
+
+struct plan_base {
+	int mi; /* index into the metric_arry */
+	int dim;
+	int scalar;
+	int off; /* offset into the plan vals */
+};
+
+struct func_plan {
+	struct ldms_digest_s digest;
+	int compid_idx;
+	int jobid_idx;
+	int nbase;
+	struct plan_base* base;
+	size_t nvals;
+	uint64_t* vals; /* base values of the set being stored. under the handle lock */
+	int numder;
+	struct plan_op* op; /* same order as the der */
+};
+
+static void plan_free(struct func_plan* plan){
+	int i;
+
+	if (!plan)
+		return;
+	for (i = 0; i < plan->numder; i++)
+		free(plan->op[i].in);
+	free(plan->op);
+	free(plan->base);
+	free(plan->vals);
+	free(plan);
+}
+
+static struct func_plan* plan_new(struct function_store_handle *s_handle,
+				  ldms_set_t set, size_t metric_count){
+	struct func_plan* plan;
+	int* base_off = NULL;
+	int i, k;
+
+	plan = calloc(1, sizeof(*plan));
+	if (!plan)
+		goto err;
+	plan->numder = s_handle->numder;
+	plan->op = calloc(plan->numder ? plan->numder : 1, sizeof(struct plan_op));
+	plan->base = calloc(metric_count ? metric_count : 1, sizeof(struct plan_base));
+	base_off = malloc((metric_count ? metric_count : 1) * sizeof(int));
+	if (!plan->op || !plan->base || !base_off)
+		goto err;
+	for (i = 0; i < metric_count; i++)
+		base_off[i] = -1;
+
+	memcpy(&plan->digest, ldms_set_digest_get(set), sizeof(plan->digest));
+	plan->compid_idx = ldms_metric_by_name(set, "component_id");
+	plan->jobid_idx = ldms_metric_by_name(set, "job_id");
+
+	for (i = 0; i < plan->numder; i++){
+		struct derived_data* dd = s_handle->der[i];
+		struct plan_op* op = &plan->op[i];
+
+		op->dd = dd;
+		if (dd->fct == RAWTERM)
+			continue;
+		op->in = calloc(dd->nvars, sizeof(struct plan_in));
+		if (!op->in)
+			goto err;
+		for (k = 0; k < dd->nvars; k++){
+			struct idx_type* vals = &dd->varidx[k];
+			op->in[k].typei = vals->typei;
+			op->in[k].dim = vals->dim;
+			if (vals->typei == DER){
+				op->in[k].i = vals->i;
+				continue;
+			}
+			if (base_off[vals->i] < 0){
+				struct plan_base* b = &plan->base[plan->nbase++];
+				b->mi = vals->i;
+				b->dim = vals->dim;
+				b->scalar = (vals->metric_type == LDMS_V_U64);
+				b->off = plan->nvals;
+				base_off[vals->i] = b->off;
+				plan->nvals += b->dim;
+			}
+			op->in[k].i = base_off[vals->i];
+		}
+
+		switch (dd->fct){
+		case RATE:
+		case DELTA:
+			op->nocheck = ((dd->varidx[0].typei == BASE) &&
+				       (dd->varidx[0].metric_type == LDMS_V_U64));
+			break;
+		case MAX_N:
+		case MIN_N:
+		case SUM_N:
+		case AVG_N:
+			for (k = 0; k < dd->nvars; k++){
+				if (dd->varidx[k].dim != dd->dim)
+					op->fallback = 1;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	plan->vals = calloc(plan->nvals ? plan->nvals : 1, sizeof(uint64_t));
+	if (!plan->vals)
+		goto err;
+	free(base_off);
+	return plan;
+
+err:
+	msglog(LDMSD_LCRITICAL, "%s: ENOMEM building the plan for %s\n",
+	       __FILE__, s_handle->store_key);
+	free(base_off);
+	plan_free(plan);
+	return NULL;
+}
+
+static int plan_match(struct func_plan* plan, ldms_set_t set){
+	return (memcmp(&plan->digest, ldms_set_digest_get(set),
+		       sizeof(plan->digest)) == 0);
+}
+
+/* copy the base metrics of this set into the plan vals */
+static void plan_gather(struct func_plan* plan, ldms_set_t set, int* metric_arry){
+	int i;
+
+	for (i = 0; i < plan->nbase; i++){
+		struct plan_base* b = &plan->base[i];
+		if (b->scalar)
+			plan->vals[b->off] = ldms_metric_get_u64(set, metric_arry[b->mi]);
+		else
+			memcpy(&plan->vals[b->off],
+			       ldms_metric_array_get(set, metric_arry[b->mi])->a_u64,
+			       b->dim * sizeof(uint64_t));
+	}
+}
+
+static inline const uint64_t* plan_input(struct func_plan* plan,
+					 struct setdatapoint* dp,
+					 struct plan_in* in, int* valid){
+	if (in->typei == BASE){
+		*valid = 1;
+		return &plan->vals[in->i];
+	}
+	*valid = dp->datavals[in->i].returnvalid;
+	return dp->datavals[in->i].returnvals;
+}
+
+/*
+ * Same results as doFunc (see the notes there on the order of the casts).
+ * Flags that invalidate the whole result are found in a separate pass
+ * so that the arithmetic loops are branch free.
+ */
+static int plan_eval(struct func_plan* plan, int i,
+		     ldms_set_t set, int* metric_arry,
+		     struct setdatapoint* dp,
+		     struct timeval diff, int flagtime){
+
+	struct plan_op* op = &plan->op[i];
+	struct derived_data* dd = op->dd;
+	struct dinfo* di = &dp->datavals[dd->idx];
+	func_t fct = dd->fct;
+	double scale = dd->scale;
+	int dim = dd->dim;
+	uint64_t* restrict r = di->returnvals;
+	const uint64_t* a;
+	const uint64_t* b;
+	int valid, va, vb;
+	int bad = 0;
+	int j, k;
+
+	if (op->fallback)
+		return doFunc(set, metric_arry, dp, dd, diff, flagtime);
+
+	a = plan_input(plan, dp, &op->in[0], &va);
+
+	switch (fct){
+	case RAW:
+		valid = va;
+		if (valid)
+			for (j = 0; j < dim; j++)
+				r[j] = a[j] * scale;
+		break;
+	case THRESH_GE:
+		valid = va;
+		if (valid)
+			for (j = 0; j < dim; j++)
+				r[j] = (a[j] >= scale ? 1:0);
+		break;
+	case THRESH_LT:
+		valid = va;
+		if (valid)
+			for (j = 0; j < dim; j++)
+				r[j] = (a[j] < scale ? 1:0);
+		break;
+	case MAX:
+	case MIN:
+	case SUM:
+	case AVG:
+	{
+		int n = op->in[0].dim;
+		uint64_t x;
+
+		valid = va;
+		if (!valid)
+			break;
+		x = a[0];
+		switch (fct){
+		case MAX:
+			for (j = 1; j < n; j++)
+				x = (x < a[j] ? a[j] : x);
+			break;
+		case MIN:
+			for (j = 1; j < n; j++)
+				x = (x > a[j] ? a[j] : x);
+			break;
+		default:
+			for (j = 1; j < n; j++)
+				x += a[j];
+			break;
+		}
+		if (fct == AVG)
+			x = (uint64_t)(((double)x * scale)/(double)n);
+		else
+			x *= scale;
+		r[0] = x;
+	}
+		break;
+	case RATE:
+	case DELTA:
+	{
+		uint64_t* restrict s = di->storevals;
+
+		valid = va;
+		if (!op->nocheck){
+			for (j = 0; j < dim; j++)
+				bad |= (a[j] < s[j]);
+			if (bad)
+				valid = 0;
+		}
+		if (!di->storevalid || flagtime)
+			valid = 0;
+		if (valid){
+			if (fct == DELTA){
+				for (j = 0; j < dim; j++)
+					r[j] = (uint64_t)((double)(a[j] - s[j])*scale);
+			} else {
+				double dt_usec = (double)(diff.tv_sec*1000000+diff.tv_usec);
+				for (j = 0; j < dim; j++)
+					r[j] = (uint64_t)((((double)(a[j] - s[j])*1000000.0)*scale)/dt_usec);
+			}
+		}
+		if (va)
+			memcpy(s, a, dim * sizeof(uint64_t));
+		else if (dim)
+			s[0] = 0;
+		di->storevalid = va;
+	}
+		break;
+	case MAX_N:
+	case MIN_N:
+		if (!va){
+			//doFunc leaves the old return values in place here
+			di->returnvalid = 0;
+			return 0;
+		}
+		memcpy(r, a, dim * sizeof(uint64_t));
+		valid = 1;
+		for (k = 1; k < dd->nvars; k++){
+			b = plan_input(plan, dp, &op->in[k], &vb);
+			if (!vb){
+				valid = 0;
+				break;
+			}
+			if (fct == MAX_N){
+				for (j = 0; j < dim; j++)
+					r[j] = (r[j] < b[j] ? b[j] : r[j]);
+			} else {
+				for (j = 0; j < dim; j++)
+					r[j] = (r[j] > b[j] ? b[j] : r[j]);
+			}
+		}
+		if (valid)
+			for (j = 0; j < dim; j++)
+				r[j] *= scale;
+		break;
+	case SUM_N:
+	case AVG_N:
+		for (j = 0; j < dim; j++)
+			r[j] = 0;
+		valid = 1;
+		for (k = 0; k < dd->nvars; k++){
+			b = plan_input(plan, dp, &op->in[k], &vb);
+			if (!vb){
+				valid = 0;
+				break;
+			}
+			for (j = 0; j < dim; j++)
+				r[j] += b[j];
+		}
+		if (valid){
+			if (fct == SUM_N){
+				for (j = 0; j < dim; j++)
+					r[j] *= scale;
+			} else {
+				for (j = 0; j < dim; j++)
+					r[j] = (uint64_t)(((double)(r[j]) * scale)/(double)dd->nvars);
+			}
+		}
+		break;
+	case SUB_AB:
+	case MUL_AB:
+	case DIV_AB:
+		b = plan_input(plan, dp, &op->in[1], &vb);
+		valid = va * vb;
+		if (fct == SUB_AB){
+			for (j = 0; j < dim; j++)
+				bad |= (b[j] > a[j]);
+		} else if (fct == DIV_AB){
+			for (j = 0; j < dim; j++)
+				bad |= (b[j] == 0);
+		}
+		if (bad)
+			valid = 0;
+		if (!valid)
+			break;
+		switch (fct){
+		case SUB_AB:
+			for (j = 0; j < dim; j++){
+				r[j] = a[j] - b[j];
+				r[j] *= scale;
+			}
+			break;
+		case MUL_AB:
+			for (j = 0; j < dim; j++){
+				r[j] = a[j];
+				r[j] *= (b[j] * scale);
+			}
+			break;
+		default:
+			for (j = 0; j < dim; j++)
+				r[j] = (uint64_t)(((double)a[j]/(double)b[j])*scale);
+			break;
+		}
+		break;
+	case SUM_VS:
+	case SUB_VS:
+	case SUB_SV:
+	case MUL_VS:
+	case DIV_VS:
+	case DIV_SV:
+	{
+		const uint64_t* v;
+		uint64_t ts;
+
+		if (fct == SUB_SV || fct == DIV_SV){
+			v = plan_input(plan, dp, &op->in[1], &vb);
+			ts = a[0];
+			valid = (va && vb);
+		} else {
+			v = a;
+			ts = plan_input(plan, dp, &op->in[1], &vb)[0];
+			valid = (vb && va);
+		}
+		switch (fct){
+		case SUB_VS:
+			for (j = 0; j < dim; j++)
+				bad |= (ts > v[j]);
+			break;
+		case SUB_SV:
+			for (j = 0; j < dim; j++)
+				bad |= (v[j] > ts);
+			break;
+		case DIV_VS:
+			bad = (ts == 0);
+			break;
+		case DIV_SV:
+			for (j = 0; j < dim; j++)
+				bad |= (v[j] == 0);
+			break;
+		default:
+			break;
+		}
+		if (bad)
+			valid = 0;
+		if (!valid)
+			break;
+		switch (fct){
+		case SUM_VS:
+			for (j = 0; j < dim; j++)
+				r[j] = (v[j] + ts) * scale;
+			break;
+		case SUB_VS:
+			for (j = 0; j < dim; j++)
+				r[j] = (v[j] - ts) * scale;
+			break;
+		case SUB_SV:
+			for (j = 0; j < dim; j++)
+				r[j] = (ts - v[j]) * scale;
+			break;
+		case MUL_VS:
+			for (j = 0; j < dim; j++)
+				r[j] = v[j] * ts * scale;
+			break;
+		case DIV_VS:
+			for (j = 0; j < dim; j++)
+				r[j] = (uint64_t)(((double)v[j]/(double)ts)*scale);
+			break;
+		default:
+			for (j = 0; j < dim; j++)
+				r[j] = (uint64_t)(((double)ts/(double)v[j])*scale);
+			break;
+		}
+	}
+		break;
+	default:
+		return doFunc(set, metric_arry, dp, dd, diff, flagtime);
+	}
+
+	if (!valid)
+		for (j = 0; j < dim; j++)
+			r[j] = 0;
+	di->returnvalid = valid;
+	return valid;
+}
+/******/
+
 static int get_datapoint(idx_t* sets_idx, const char* instance_name,
 			 int numder, struct derived_data** der,
 			 int* numsets, struct setdatapoint** rdp, int* firsttime){
 
 	struct setdatapoint* dp = NULL;
-	int i, j;
+	size_t nslab;
+	int i;
 
 	if (rdp == NULL){
 		msglog(LDMSD_LERROR, "%s: arg to getDatapoint is NULL!\n",
@@ -2692,6 +3152,7 @@ static int get_datapoint(idx_t* sets_idx, const char* instance_name,
 		}
 		dp->ts = NULL;
 		dp->datavals = NULL;
+		dp->slab = NULL;
 		(*numsets)++;
 
 		idx_add(*sets_idx, (void*)instance_name,
@@ -2719,22 +3180,32 @@ static int get_datapoint(idx_t* sets_idx, const char* instance_name,
 		}
 
 		//create the space for the return vals and store vals if needed
+		nslab = 0;
+		for (i = 0; i < numder; i++){
+			if (func_def[der[i]->fct].createreturn)
+				nslab += der[i]->dim;
+			if (func_def[der[i]->fct].createstore)
+				nslab += der[i]->dim;
+		}
+		dp->slab = calloc(nslab ? nslab : 1, sizeof(uint64_t));
+		if (dp->slab == NULL)
+			goto err;
+
+		nslab = 0;
 		for (i = 0; i < numder; i++){
 			dp->datavals[i].dim = der[i]->dim;
 
 			if (func_def[der[i]->fct].createreturn){
-				dp->datavals[i].returnvals = calloc(dp->datavals[i].dim, sizeof(uint64_t));
-				if (dp->datavals[i].returnvals == NULL)
-					goto err;
+				dp->datavals[i].returnvals = &dp->slab[nslab];
+				nslab += dp->datavals[i].dim;
 				dp->datavals[i].returnvalid = 0;
 			} else {
 				dp->datavals[i].returnvals = NULL;
 			}
 
 			if (func_def[der[i]->fct].createstore){
-				dp->datavals[i].storevals = calloc(dp->datavals[i].dim, sizeof(uint64_t));
-				if (dp->datavals[i].storevals == NULL)
-					goto err;
+				dp->datavals[i].storevals = &dp->slab[nslab];
+				nslab += dp->datavals[i].dim;
 				dp->datavals[i].storevalid = 0;
 			} else {
 				dp->datavals[i].storevals = NULL;
@@ -2750,12 +3221,6 @@ static int get_datapoint(idx_t* sets_idx, const char* instance_name,
 
 err:
 	msglog(LDMSD_LCRITICAL, "%s: ENOMEM\n", __FILE__);
-	for (j = 0; j <= i; j++){
-		if (dp->datavals[j].storevals)
-			free(dp->datavals[j].storevals);
-		if (dp->datavals[j].returnvals)
-			free(dp->datavals[j].returnvals);
-	}
 	free(dp->datavals);
 	free(dp->ts);
 	free(dp);
@@ -2773,6 +3238,7 @@ store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arry, size_t m
 	const struct ldms_timestamp _ts = ldms_transaction_timestamp_get(set);
 	const struct ldms_timestamp *ts = &_ts;
 	struct setdatapoint* dp = NULL;
+	struct func_plan* plan;
 	const char* pname;
 	uint64_t compid;
 	uint64_t jobid;
@@ -2827,6 +3293,13 @@ store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arry, size_t m
 		return rc;
 	}
 
+	//without a plan (ENOMEM or another schema digest) use doFunc
+	if (!s_handle->plan)
+		s_handle->plan = plan_new(s_handle, set, metric_count);
+	plan = s_handle->plan;
+	if (plan && !plan_match(plan, set))
+		plan = NULL;
+
 	/*
 	 * New in v3: if time diff is not positive, always write out something and flag.
 	 * if its RAW data, write the val. if its RATE data, write zero
@@ -2858,13 +3331,19 @@ store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arry, size_t m
 
 	pname = ldms_set_producer_name_get(set);
 
-	tempidx = ldms_metric_by_name(set, "component_id");
+	if (plan)
+		tempidx = plan->compid_idx;
+	else
+		tempidx = ldms_metric_by_name(set, "component_id");
 	if (tempidx != -1)
 		compid = ldms_metric_get_u64(set, metric_arry[tempidx]);
 	else
 		compid = 0;
 
-	tempidx = ldms_metric_by_name(set, "job_id");
+	if (plan)
+		tempidx = plan->jobid_idx;
+	else
+		tempidx = ldms_metric_by_name(set, "job_id");
 	if (tempidx != -1)
 		jobid = ldms_metric_get_u64(set, metric_arry[tempidx]);
 	else
@@ -2889,6 +3368,9 @@ store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arry, size_t m
 	}
 	//always get the vals because may need the stored value, even if skip this time
 
+	if (plan)
+		plan_gather(plan, set, metric_arry);
+
 	for (i = 0; i < s_handle->numder; i++){ //go thru all the vals....only write the writeout vals
 
 //		msglog(LDMSD_LDEBUG, "%s: Schema %s Updating variable %d of %d: %s\n",
@@ -2899,9 +3381,13 @@ store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arry, size_t m
 			if (!skip)
 				(void)doRAWTERMFunc(set, s_handle, metric_arry, s_handle->der[i]);
 		} else {
-			(void)doFunc(set, metric_arry,
-				     dp, s_handle->der[i],
-				     diff, setflagtime);
+			if (plan)
+				(void)plan_eval(plan, i, set, metric_arry,
+						dp, diff, setflagtime);
+			else
+				(void)doFunc(set, metric_arry,
+					     dp, s_handle->der[i],
+					     diff, setflagtime);
 			//write it out, if its writeout and not skip
 			//FIXME: Should the writeout be moved in so its like doRAWTERMFunc ?
 			if (!skip && s_handle->der[i]->writeout){
@@ -3016,6 +3502,9 @@ static void close_store(ldmsd_store_handle_t _s_handle)
 
 	s_handle->numder = 0;
 
+	plan_free(s_handle->plan);
+	s_handle->plan = NULL;
+
 	if (s_handle->sets_idx) {
 		//FIXME: need someway to iterate thru this to get the ptrs to free them
 		idx_destroy(s_handle->sets_idx);
@@ -0,0 +1,299 @@
+#include <stdarg.h>
+#include <time.h>
+
+/*
+ * The evaluators are static, so the bench is built from the plugin source.
+ */
+#include "store_function_csv.c"
+
+/*
+ * Derived metric evaluation benchmark
+ *
+ * Parses a function config that uses every function, with base and derived
+ * inputs, over a set of u64 scalars and arrays. Each store the set is
+ * updated with counters that occasionally go backwards and divisors that
+ * are sometimes zero, and every derived metric is evaluated both by doFunc
+ * and by the compiled plan. The first test checks that the return values
+ * and flags, which are what the store writes out, are identical. The
+ * second test reports the time per store of each evaluator.
+ */
+
+#define SCHEMA_NAME "fbench"
+
+static int dim = 64;
+static int store_count = 20000;
+
+static const char *fct_conf[] = {
+	"r_a RATE 1 a 1.0",
+	"r_va RATE 1 va 1000.0",
+	"d_va DELTA 1 va 1.0",
+	"raw_va RAW 1 va 0.5",
+	"ge_va THRESH_GE 1 va 500",
+	"lt_va THRESH_LT 1 vb 250",
+	"max_va MAX 1 va 1.0",
+	"min_va MIN 1 vb 1.0",
+	"sum_va SUM 1 va 2.0",
+	"avg_va AVG 1 va 1.0",
+	"sum_a SUM 1 a 1.5",
+	"sumn SUM_N 2 va,vb 1.0",
+	"avgn AVG_N 3 va,vb,vz 1.0",
+	"maxn MAX_N 2 va,vb 1.0",
+	"minn MIN_N 2 va,vb 3.0",
+	"maxn_s MAX_N 3 va,vb,a 1.0",
+	"sub SUB_AB 2 va,vb 1.0",
+	"mul MUL_AB 2 va,vb 0.25",
+	"div DIV_AB 2 va,vz 100.0",
+	"sub_s SUB_AB 2 a,b 1.0",
+	"sumvs SUM_VS 2 va,a 1.0",
+	"subvs SUB_VS 2 va,b 1.0",
+	"subsv SUB_SV 2 b,vb 1.0",
+	"mulvs MUL_VS 2 vb,b 1.0",
+	"divvs DIV_VS 2 va,b 10.0",
+	"divsv DIV_SV 2 a,vz 10.0",
+	"r_sub RATE 1 sub 1.0",
+	"maxn_d MAX_N 2 r_va,d_va 1.0",
+	"sumn_d SUM_N 2 d_va,raw_va 1.0",
+	"sub_d SUB_AB 2 d_va,r_va 1.0",
+	"vs_d SUM_VS 2 d_va,r_a 1.0",
+	"max_d MAX 1 r_sub 1.0",
+	"ge_d THRESH_GE 1 d_va 5",
+	"raw_d RAW 1 r_va 2.0",
+	NULL
+};
+
+static void bench_usage(const char *prog)
+{
+	printf("Usage: %s [-d array_len] [-n stores]\n", prog);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_log(enum ldmsd_loglevel level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (level < LDMSD_LWARNING)
+		return;
+	printf("# ");
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+/* mimics counters with resets, gauges and divisors that may be zero */
+static void update(ldms_set_t set, int step)
+{
+	static uint64_t a, *va;
+	int j;
+
+	if (!va)
+		va = calloc(dim, sizeof(*va));
+	a += rand() % 100;
+	if (step % 53 == 52)
+		a = rand() % 10;
+	ldms_metric_set_u64(set, 2, a);
+	ldms_metric_set_u64(set, 3, rand() % 50);
+	for (j = 0; j < dim; j++) {
+		va[j] += rand() % 1000;
+		if (step % 41 == 40 && j % 7 == 0)
+			va[j] = rand() % 10;
+		ldms_metric_array_set_u64(set, 4, j, va[j]);
+		ldms_metric_array_set_u64(set, 5, j, rand() % 500);
+		ldms_metric_array_set_u64(set, 6, j, rand() % 4);
+	}
+}
+
+static void step_time(int step, struct timeval *diff, int *flagtime)
+{
+	diff->tv_sec = 1;
+	diff->tv_usec = rand() % 1000000;
+	*flagtime = (step % 50 == 49);
+}
+
+static int bench_config(struct function_store_handle *h, ldms_set_t set,
+			int *metric_arry, size_t metric_count)
+{
+	char fname[] = "/tmp/store_function_csv_bench.XXXXXX";
+	FILE *f;
+	int fd, i, rc;
+
+	fd = mkstemp(fname);
+	if (fd < 0)
+		return errno;
+	f = fdopen(fd, "w");
+	for (i = 0; fct_conf[i]; i++)
+		fprintf(f, SCHEMA_NAME " %s 1\n", fct_conf[i]);
+	fclose(f);
+	rc = derivedConfig(fname, h, set, metric_arry, metric_count);
+	unlink(fname);
+	if (!rc && h->numder != i)
+		rc = EINVAL;
+	return rc;
+}
+
+static int compare(struct function_store_handle *h,
+		   struct setdatapoint *x, struct setdatapoint *y, int step)
+{
+	int i;
+
+	for (i = 0; i < h->numder; i++) {
+		struct dinfo *dx = &x->datavals[i];
+		struct dinfo *dy = &y->datavals[i];
+		if (h->der[i]->fct == RAWTERM)
+			continue;
+		if (!dx->returnvalid != !dy->returnvalid ||
+		    memcmp(dx->returnvals, dy->returnvals,
+			   dx->dim * sizeof(uint64_t))) {
+			printf("# store %d: %s differs\n", step, h->der[i]->name);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void eval_func(struct function_store_handle *h, ldms_set_t set,
+		      int *metric_arry, struct setdatapoint *dp,
+		      struct timeval diff, int flagtime)
+{
+	int i;
+
+	for (i = 0; i < h->numder; i++)
+		(void)doFunc(set, metric_arry, dp, h->der[i], diff, flagtime);
+}
+
+static void eval_plan(struct function_store_handle *h, ldms_set_t set,
+		      int *metric_arry, struct setdatapoint *dp,
+		      struct timeval diff, int flagtime)
+{
+	int i;
+
+	plan_gather(h->plan, set, metric_arry);
+	for (i = 0; i < h->numder; i++)
+		(void)plan_eval(h->plan, i, set, metric_arry, dp, diff, flagtime);
+}
+
+static struct setdatapoint *datapoint(struct function_store_handle *h,
+				      const char *name)
+{
+	struct setdatapoint *dp;
+	int first;
+
+	if (get_datapoint(&h->sets_idx, name, h->numder, h->der,
+			  &h->numsets, &dp, &first))
+		return NULL;
+	return dp;
+}
+
+typedef void (*eval_fn_t)(struct function_store_handle *, ldms_set_t, int *,
+			  struct setdatapoint *, struct timeval, int);
+
+static double run_timed(struct function_store_handle *h, ldms_set_t set,
+			int *metric_arry, const char *name, eval_fn_t fn)
+{
+	struct setdatapoint *dp = datapoint(h, name);
+	struct timeval diff;
+	double t, total = 0;
+	int i, flagtime;
+
+	srand(2);
+	for (i = 0; i < store_count; i++) {
+		update(set, i);
+		step_time(i, &diff, &flagtime);
+		t = now();
+		fn(h, set, metric_arry, dp, diff, flagtime);
+		total += now() - t;
+	}
+	return total;
+}
+
+int main(int argc, char **argv)
+{
+	struct function_store_handle h = {0};
+	struct setdatapoint *x, *y;
+	ldms_schema_t schema;
+	ldms_set_t set;
+	struct timeval diff;
+	int *metric_arry;
+	size_t metric_count;
+	double t_func, t_plan;
+	int op, i, rc, flagtime;
+
+	while ((op = getopt(argc, argv, "d:n:h")) != -1) {
+		switch (op) {
+		case 'd':
+			dim = atoi(optarg);
+			break;
+		case 'n':
+			store_count = atoi(optarg);
+			break;
+		default:
+			bench_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (dim < 1 || store_count < 1) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	msglog = bench_log;
+	ldms_init(16 * 1024 * 1024);
+	schema = ldms_schema_new(SCHEMA_NAME);
+	ldms_schema_metric_add(schema, "component_id", LDMS_V_U64);
+	ldms_schema_metric_add(schema, "job_id", LDMS_V_U64);
+	ldms_schema_metric_add(schema, "a", LDMS_V_U64);
+	ldms_schema_metric_add(schema, "b", LDMS_V_U64);
+	ldms_schema_metric_array_add(schema, "va", LDMS_V_U64_ARRAY, dim);
+	ldms_schema_metric_array_add(schema, "vb", LDMS_V_U64_ARRAY, dim);
+	ldms_schema_metric_array_add(schema, "vz", LDMS_V_U64_ARRAY, dim);
+	set = ldms_set_new("node/" SCHEMA_NAME, schema);
+	if (!set) {
+		printf("Bail out! cannot create the set\n");
+		return 1;
+	}
+	metric_count = ldms_set_card_get(set);
+	metric_arry = calloc(metric_count, sizeof(int));
+	for (i = 0; i < metric_count; i++)
+		metric_arry[i] = i;
+
+	h.schema = SCHEMA_NAME;
+	h.store_key = "bench/" SCHEMA_NAME;
+	h.sets_idx = idx_create();
+	update(set, 0);
+	rc = bench_config(&h, set, metric_arry, metric_count);
+	if (rc) {
+		printf("Bail out! function config failed: %d\n", rc);
+		return 1;
+	}
+	h.plan = plan_new(&h, set, metric_count);
+	if (!h.plan) {
+		printf("Bail out! cannot build the plan\n");
+		return 1;
+	}
+
+	printf("1..2\n");
+	x = datapoint(&h, "func");
+	y = datapoint(&h, "plan");
+	srand(1);
+	for (i = 0, rc = 0; i < store_count && !rc; i++) {
+		update(set, i);
+		step_time(i, &diff, &flagtime);
+		eval_func(&h, set, metric_arry, x, diff, flagtime);
+		eval_plan(&h, set, metric_arry, y, diff, flagtime);
+		rc = compare(&h, x, y, i);
+	}
+	printf("%s 1 - %d derived metrics of dim %d agree over %d stores\n",
+	       (rc ? "not ok" : "ok"), h.numder, dim, i);
+
+	t_func = run_timed(&h, set, metric_arry, "func_timed", eval_func);
+	t_plan = run_timed(&h, set, metric_arry, "plan_timed", eval_plan);
+	printf("ok 2 - doFunc %.2f us/store, plan %.2f us/store (%.1fx)\n",
+	       t_func * 1e6 / store_count, t_plan * 1e6 / store_count,
+	       t_func / t_plan);
+	return (rc ? 1 : 0);
+}
@@ -0,0 +1,433 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "ldms.h"
+
+/*
+ * Directory latency benchmark
+ *
+ * A forked server publishes a growing number of sets, each with a few
+ * set-info pairs. For every set count the client times a complete dir
+ * in the JSON encoding, a complete dir in the binary encoding and an
+ * incremental dir after a handful of sets changed, and checks that the
+ * two encodings describe the same sets. Each change re-creates one set,
+ * so the incremental dir also carries a deletion.
+ */
+
+#define SCHEMA_NAME "dir_latency"
+#define CHANGE_COUNT 16
+#define START_TIMEOUT 30	/* seconds for the server to start listening */
+#define CMD_TIMEOUT 300		/* seconds for the server to run a command */
+
+static const char *xprt = "sock";
+static int port;
+static int repeat = 5;
+static char *counts = "100,1000,5000";
+
+static int cmd_fd[2];	/* client -> server */
+static int ack_fd[2];	/* server -> client */
+static pid_t server_pid;
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-x xprt] [-p port] [-c count,count,...] "
+	       "[-r repeat]\n", prog);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t hash_str(uint64_t h, const char *s)
+{
+	for (; *s; s++)
+		h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+	return h * 31;
+}
+
+/* An order independent digest of everything a dir reports */
+static uint64_t hash_dir_set(ldms_dir_set_t d)
+{
+	uint64_t h = 14695981039346656037ULL;
+	int i;
+	h = hash_str(h, d->inst_name);
+	h = hash_str(h, d->schema_name);
+	h = hash_str(h, d->digest_str);
+	h = hash_str(h, d->flags);
+	h = hash_str(h, d->perm);
+	h = h * 31 + d->meta_size;
+	h = h * 31 + d->data_size;
+	h = h * 31 + d->heap_size;
+	h = h * 31 + d->uid;
+	h = h * 31 + d->gid;
+	h = h * 31 + d->card;
+	h = h * 31 + d->array_card;
+	h = h * 31 + d->meta_gn;
+	h = h * 31 + d->data_gn;
+	h = h * 31 + d->timestamp.sec;
+	for (i = 0; i < d->info_count; i++) {
+		h = hash_str(h, d->info[i].key);
+		h = hash_str(h, d->info[i].value);
+	}
+	return h;
+}
+
+/* ---- server ---- */
+
+static ldms_schema_t schema;
+static ldms_set_t *sets;
+static int set_count;
+
+static void server_set_new(int i)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "node-%05d/" SCHEMA_NAME, i);
+	sets[i] = ldms_set_new(name, schema);
+	assert(sets[i]);
+	ldms_set_producer_name_set(sets[i], "bench");
+	ldms_set_info_set(sets[i], "component_id", name + 5);
+	ldms_set_info_set(sets[i], "site", "bench");
+	ldms_transaction_begin(sets[i]);
+	ldms_metric_set_u64(sets[i], 0, i);
+	ldms_transaction_end(sets[i]);
+	ldms_set_publish(sets[i]);
+}
+
+static void server_grow(int count)
+{
+	ldms_set_t *s;
+	int i;
+
+	s = realloc(sets, count * sizeof(*sets));
+	assert(s);
+	sets = s;
+	for (i = set_count; i < count; i++)
+		server_set_new(i);
+	set_count = count;
+}
+
+/* Re-create the last set and change the set-info of a few others */
+static void server_change(int gen)
+{
+	char value[32];
+	int i;
+
+	ldms_set_delete(sets[set_count - 1]);
+	server_set_new(set_count - 1);
+	snprintf(value, sizeof(value), "%d", gen);
+	for (i = 0; i < CHANGE_COUNT && i < set_count; i++)
+		ldms_set_info_set(sets[(gen * 7919 + i * 131) % set_count],
+				  "changed", value);
+}
+
+static void server_event_cb(ldms_t x, ldms_xprt_event_t e, void *arg)
+{
+	if (e->type == LDMS_XPRT_EVENT_DISCONNECTED ||
+	    e->type == LDMS_XPRT_EVENT_REJECTED ||
+	    e->type == LDMS_XPRT_EVENT_ERROR)
+		ldms_xprt_put(x);
+}
+
+static int server(void)
+{
+	struct sockaddr_in sin = {0};
+	ldms_t x;
+	char cmd;
+	int arg, rc;
+
+	ldms_init(512 * 1024 * 1024);
+	schema = ldms_schema_new(SCHEMA_NAME);
+	assert(schema);
+	ldms_schema_metric_add(schema, "value", LDMS_V_U64);
+	ldms_schema_metric_array_add(schema, "counters", LDMS_V_U64_ARRAY, 8);
+
+	x = ldms_xprt_new(xprt);
+	if (!x) {
+		printf("Bail out! ldms_xprt_new(%s) failed\n", xprt);
+		return 1;
+	}
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(port);
+	rc = ldms_xprt_listen(x, (void *)&sin, sizeof(sin), server_event_cb, NULL);
+	if (rc) {
+		printf("Bail out! listen on port %d failed: %d\n", port, rc);
+		return 1;
+	}
+	cmd = 'R';
+	if (write(ack_fd[1], &cmd, 1) != 1)
+		return 1;
+	while (read(cmd_fd[0], &cmd, 1) == 1) {
+		if (read(cmd_fd[0], &arg, sizeof(arg)) != sizeof(arg))
+			break;
+		switch (cmd) {
+		case 'N':
+			server_grow(arg);
+			break;
+		case 'C':
+			server_change(arg);
+			break;
+		case 'Q':
+			return 0;
+		}
+		if (write(ack_fd[1], &cmd, 1) != 1)
+			break;
+	}
+	return 0;
+}
+
+/*
+ * Wait up to `timeout` seconds for the server's acknowledgement. Returns
+ * 0 on success or -1, with a message, if the server exited or did not
+ * answer in time.
+ */
+static int server_ack(int timeout)
+{
+	struct pollfd pfd = { .fd = ack_fd[0], .events = POLLIN };
+	int status, rc;
+	char ack;
+
+	while (timeout-- > 0) {
+		rc = poll(&pfd, 1, 1000);
+		if (rc < 0 && errno != EINTR)
+			break;
+		if (rc > 0)
+			return (read(ack_fd[0], &ack, 1) == 1) ? 0 : -1;
+		if (waitpid(server_pid, &status, WNOHANG) == server_pid) {
+			printf("Bail out! server exited with status %d\n",
+			       WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+			server_pid = 0;
+			return -1;
+		}
+	}
+	printf("Bail out! server did not answer\n");
+	return -1;
+}
+
+static void server_cmd(char cmd, int arg)
+{
+	if (write(cmd_fd[1], &cmd, 1) != 1 ||
+	    write(cmd_fd[1], &arg, sizeof(arg)) != sizeof(arg) ||
+	    (cmd != 'Q' && server_ack(CMD_TIMEOUT))) {
+		printf("Bail out! server is gone\n");
+		if (server_pid)
+			kill(server_pid, SIGKILL);
+		exit(1);
+	}
+}
+
+/* ---- client ---- */
+
+struct dir_result {
+	sem_t sem;
+	int rc;
+	int count;		/* sets reported */
+	int del_count;		/* of which LDMS_DIR_DEL */
+	uint64_t gn;
+	uint64_t hash;
+};
+
+static sem_t conn_sem;
+static int conn_rc;
+
+static void client_event_cb(ldms_t x, ldms_xprt_event_t e, void *arg)
+{
+	switch (e->type) {
+	case LDMS_XPRT_EVENT_CONNECTED:
+		conn_rc = 0;
+		sem_post(&conn_sem);
+		break;
+	case LDMS_XPRT_EVENT_REJECTED:
+	case LDMS_XPRT_EVENT_ERROR:
+		conn_rc = ECONNREFUSED;
+		sem_post(&conn_sem);
+		break;
+	default:
+		break;
+	}
+}
+
+static void dir_cb(ldms_t x, int status, ldms_dir_t dir, void *arg)
+{
+	struct dir_result *r = arg;
+	int i;
+
+	if (status) {
+		r->rc = status;
+		sem_post(&r->sem);
+		return;
+	}
+	for (i = 0; i < dir->set_count; i++)
+		r->hash += hash_dir_set(&dir->set_data[i]);
+	r->count += dir->set_count;
+	if (dir->type == LDMS_DIR_DEL)
+		r->del_count += dir->set_count;
+	r->gn = dir->gn;
+	if (!dir->more)
+		sem_post(&r->sem);
+	ldms_xprt_dir_free(x, dir);
+}
+
+static double do_dir(ldms_t x, uint32_t flags, uint64_t gn,
+		     struct dir_result *r)
+{
+	double t0;
+	int rc;
+
+	memset(r, 0, sizeof(*r));
+	sem_init(&r->sem, 0, 0);
+	t0 = now();
+	rc = ldms_xprt_dir_since(x, dir_cb, r, flags, gn);
+	if (rc) {
+		r->rc = rc;
+		return 0;
+	}
+	sem_wait(&r->sem);
+	return now() - t0;
+}
+
+static int run(ldms_t x, int count, int test_no)
+{
+	struct dir_result json, bin, inc;
+	double t_json = 0, t_bin = 0, t_inc = 0;
+	static int gen;
+	int i, ok;
+
+	server_cmd('N', count);
+	for (i = 0; i < repeat; i++) {
+		t_json += do_dir(x, LDMS_DIR_F_JSON, 0, &json);
+		t_bin += do_dir(x, 0, 0, &bin);
+		server_cmd('C', ++gen);
+		t_inc += do_dir(x, 0, bin.gn, &inc);
+	}
+	ok = !json.rc && !bin.rc && !inc.rc
+		&& json.count == count && bin.count == count
+		&& json.hash == bin.hash && bin.gn
+		&& inc.del_count == 1
+		&& inc.count >= 2 && inc.count <= CHANGE_COUNT + 2
+		&& inc.gn > bin.gn;
+	printf("%s %d - %d sets: json %.3f ms, binary %.3f ms, "
+	       "incremental (%d entries) %.3f ms\n",
+	       (ok ? "ok" : "not ok"), test_no, count,
+	       t_json * 1e3 / repeat, t_bin * 1e3 / repeat,
+	       inc.count, t_inc * 1e3 / repeat);
+	if (!ok)
+		printf("# rc %d/%d/%d, count %d/%d/%d, hash %s\n",
+		       json.rc, bin.rc, inc.rc, json.count, bin.count,
+		       inc.count, (json.hash == bin.hash ? "same" : "differs"));
+	return !ok;
+}
+
+static int client(void)
+{
+	struct sockaddr_in sin = {0};
+	char *s, *tok, *ctx;
+	ldms_t x;
+	int rc = 0, n = 0;
+
+	if (server_ack(START_TIMEOUT)) {
+		printf("Bail out! server did not start\n");
+		if (server_pid)
+			kill(server_pid, SIGKILL);
+		return 1;
+	}
+	ldms_init(16 * 1024 * 1024);
+	x = ldms_xprt_new(xprt);
+	assert(x);
+	sem_init(&conn_sem, 0, 0);
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(port);
+	rc = ldms_xprt_connect(x, (void *)&sin, sizeof(sin), client_event_cb, NULL);
+	if (!rc) {
+		sem_wait(&conn_sem);
+		rc = conn_rc;
+	}
+	if (rc) {
+		printf("Bail out! connect to port %d failed: %d\n", port, rc);
+		return 1;
+	}
+
+	s = strdup(counts);
+	for (tok = strtok_r(s, ",", &ctx); tok; tok = strtok_r(NULL, ",", &ctx))
+		n++;
+	printf("1..%d\n", n);
+	strcpy(s, counts);
+	n = 0;
+	for (tok = strtok_r(s, ",", &ctx); tok; tok = strtok_r(NULL, ",", &ctx))
+		rc |= run(x, atoi(tok), ++n);
+	free(s);
+	server_cmd('Q', 0);
+	ldms_xprt_close(x);
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	pid_t pid;
+	int op, rc, status;
+
+	port = 20000 + getpid() % 20000;
+	while ((op = getopt(argc, argv, "x:p:c:r:h")) != -1) {
+		switch (op) {
+		case 'x':
+			xprt = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'c':
+			counts = optarg;
+			break;
+		case 'r':
+			repeat = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (repeat < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (pipe(cmd_fd) || pipe(ack_fd)) {
+		perror("pipe");
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);	/* report a gone server instead */
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (pid == 0) {
+		close(cmd_fd[1]);
+		close(ack_fd[0]);
+		_exit(server());
+	}
+	/* so that a server that is gone reads as EOF */
+	close(cmd_fd[0]);
+	close(ack_fd[1]);
+	server_pid = pid;
+	rc = client();
+	if (server_pid && waitpid(pid, &status, 0) == pid && WIFEXITED(status))
+		rc |= WEXITSTATUS(status);
+	return (rc ? 1 : 0);
+}
@@ -0,0 +1,158 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "ldms.h"
+#include "ldms_heap.h"
+
+/*
+ * List churn microbenchmark
+ *
+ * Rebuilds a list of u64 arrays of varying length on every iteration,
+ * the way samplers that report per-process or per-job records do, and
+ * reports the append/remove rate with the tree-only heap and with the
+ * size-class free lists enabled. The list contents are verified after
+ * each rebuild, so the program doubles as a test of the heap.
+ */
+
+#define SCHEMA_NAME "list_churn"
+
+static int item_count = 256;
+static int iter_count = 2000;
+static int max_len = 4;
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-n items] [-i iterations] [-l max_array_len]\n", prog);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int rebuild(ldms_set_t set, ldms_mval_t lh, int iter)
+{
+	ldms_mval_t v;
+	int i, j, len;
+
+	ldms_transaction_begin(set);
+	/* Drop every other entry, then fill the list back up */
+	v = ldms_list_first(set, lh, NULL, NULL);
+	for (i = 0; v; i++) {
+		ldms_mval_t next = ldms_list_next(set, v, NULL, NULL);
+		if ((i & 1) == (iter & 1))
+			ldms_list_remove_item(set, lh, v);
+		v = next;
+	}
+	for (i = ldms_list_len(set, lh); i < item_count; i++) {
+		len = 1 + (i + iter) % max_len;
+		v = ldms_list_append_item(set, lh, LDMS_V_U64_ARRAY, len);
+		if (!v) {
+			ldms_transaction_end(set);
+			return -1;
+		}
+		for (j = 0; j < len; j++)
+			v->a_u64[j] = len;
+	}
+	ldms_transaction_end(set);
+	return 0;
+}
+
+static int verify(ldms_set_t set, ldms_mval_t lh)
+{
+	enum ldms_value_type type;
+	ldms_mval_t v;
+	size_t cnt;
+	int i, n = 0;
+
+	for (v = ldms_list_first(set, lh, &type, &cnt); v;
+	     v = ldms_list_next(set, v, &type, &cnt)) {
+		if (type != LDMS_V_U64_ARRAY || cnt < 1 || cnt > max_len)
+			return -1;
+		for (i = 0; i < cnt; i++) {
+			if (v->a_u64[i] != cnt)
+				return -1;
+		}
+		n++;
+	}
+	return (n == item_count ? 0 : -1);
+}
+
+static int run(int size_class, int test_no)
+{
+	char name[64];
+	ldms_schema_t schema;
+	ldms_set_t set;
+	ldms_mval_t lh;
+	size_t heap_sz;
+	double t0, t1;
+	int i, mid, rc = 0;
+
+	ldms_heap_size_class_enable(size_class);
+	schema = ldms_schema_new(SCHEMA_NAME);
+	assert(schema);
+	heap_sz = ldms_list_heap_size_get(LDMS_V_U64_ARRAY, item_count, max_len);
+	mid = ldms_schema_metric_list_add(schema, "list", NULL, heap_sz);
+	assert(mid >= 0);
+	snprintf(name, sizeof(name), "list_churn_%d", size_class);
+	set = ldms_set_new(name, schema);
+	assert(set);
+	lh = ldms_metric_get(set, mid);
+
+	t0 = now();
+	for (i = 0; i < iter_count; i++) {
+		if (rebuild(set, lh, i) || verify(set, lh)) {
+			rc = -1;
+			break;
+		}
+	}
+	t1 = now();
+
+	printf("%s %d - %s heap, %d iterations of %d items\n",
+	       (rc ? "not ok" : "ok"), test_no,
+	       (size_class ? "size-class" : "tree"), i, item_count);
+	/* roughly item_count / 2 removals and appends per iteration */
+	printf("# %.0f list ops/s (%.3f s)\n",
+	       (double)i * item_count / (t1 - t0), t1 - t0);
+
+	ldms_set_delete(set);
+	ldms_schema_delete(schema);
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	int op, rc;
+
+	while ((op = getopt(argc, argv, "n:i:l:h")) != -1) {
+		switch (op) {
+		case 'n':
+			item_count = atoi(optarg);
+			break;
+		case 'i':
+			iter_count = atoi(optarg);
+			break;
+		case 'l':
+			max_len = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (item_count < 1 || iter_count < 1 || max_len < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	ldms_init(64 * 1024 * 1024);
+	printf("1..2\n");
+	rc = run(0, 1);
+	rc |= run(1, 2);
+	return (rc ? 1 : 0);
+}
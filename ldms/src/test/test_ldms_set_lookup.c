@@ -0,0 +1,188 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "ldms.h"
+
+/*
+ * Set lookup scaling benchmark
+ *
+ * Publishes a number of sets and has a growing number of threads look
+ * them up by instance name with ldms_set_by_name(), the way the zap I/O
+ * threads resolve lookup, update and push requests. While the readers
+ * run, one writer keeps deleting and re-creating a few of the sets so
+ * that lookups race with changes to the set registry. Every lookup of a
+ * stable set must succeed and return the set with the requested name.
+ */
+
+#define SCHEMA_NAME "set_lookup"
+#define CHURN_COUNT 8
+
+static int set_count = 10000;
+static int lookup_count = 1000000;
+static char *threads = "1,2,4,8";
+
+static ldms_schema_t schema;
+static ldms_set_t *sets;
+static volatile int churn_stop;
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-n sets] [-l lookups_per_thread] "
+	       "[-t threads,threads,...]\n", prog);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void set_name(char *buf, size_t sz, int i)
+{
+	snprintf(buf, sz, "node-%05d/" SCHEMA_NAME, i);
+}
+
+static ldms_set_t set_new(int i)
+{
+	char name[64];
+	ldms_set_t set;
+
+	set_name(name, sizeof(name), i);
+	set = ldms_set_new(name, schema);
+	assert(set);
+	ldms_set_publish(set);
+	return set;
+}
+
+/* The first CHURN_COUNT sets come and go while the readers run */
+static void *churn_proc(void *arg)
+{
+	long *ops = arg;
+	int i;
+
+	while (!churn_stop) {
+		i = *ops % CHURN_COUNT;
+		ldms_set_delete(sets[i]);
+		sets[i] = set_new(i);
+		(*ops)++;
+	}
+	return NULL;
+}
+
+struct reader {
+	pthread_t thread;
+	unsigned int seed;
+	long errors;
+};
+
+static void *reader_proc(void *arg)
+{
+	struct reader *r = arg;
+	char name[64];
+	ldms_set_t set;
+	int i, n;
+
+	for (i = 0; i < lookup_count; i++) {
+		n = rand_r(&r->seed) % set_count;
+		set_name(name, sizeof(name), n);
+		set = ldms_set_by_name(name);
+		if (!set) {
+			if (n >= CHURN_COUNT)
+				r->errors++;
+			continue;
+		}
+		if (strcmp(ldms_set_instance_name_get(set), name))
+			r->errors++;
+		ldms_set_put(set);
+	}
+	return NULL;
+}
+
+static int run(int thread_count, int test_no)
+{
+	struct reader *r;
+	pthread_t churn;
+	long churn_ops = 0, errors = 0;
+	double t0, t1;
+	int i;
+
+	r = calloc(thread_count, sizeof(*r));
+	assert(r);
+	churn_stop = 0;
+	pthread_create(&churn, NULL, churn_proc, &churn_ops);
+	t0 = now();
+	for (i = 0; i < thread_count; i++) {
+		r[i].seed = i + 1;
+		pthread_create(&r[i].thread, NULL, reader_proc, &r[i]);
+	}
+	for (i = 0; i < thread_count; i++) {
+		pthread_join(r[i].thread, NULL);
+		errors += r[i].errors;
+	}
+	t1 = now();
+	churn_stop = 1;
+	pthread_join(churn, NULL);
+	free(r);
+
+	printf("%s %d - %d threads, %d sets\n", (errors ? "not ok" : "ok"),
+	       test_no, thread_count, set_count);
+	printf("# %.0f lookups/s (%.3f s), %ld set re-creations\n",
+	       (double)thread_count * lookup_count / (t1 - t0), t1 - t0,
+	       churn_ops);
+	if (errors)
+		printf("# %ld failed lookups\n", errors);
+	return (errors != 0);
+}
+
+int main(int argc, char **argv)
+{
+	char *s, *tok, *ctx;
+	int op, i, n, rc = 0;
+
+	while ((op = getopt(argc, argv, "n:l:t:h")) != -1) {
+		switch (op) {
+		case 'n':
+			set_count = atoi(optarg);
+			break;
+		case 'l':
+			lookup_count = atoi(optarg);
+			break;
+		case 't':
+			threads = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (set_count <= CHURN_COUNT || lookup_count < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	ldms_init(512 * 1024 * 1024);
+	schema = ldms_schema_new(SCHEMA_NAME);
+	assert(schema);
+	ldms_schema_metric_add(schema, "value", LDMS_V_U64);
+	sets = calloc(set_count, sizeof(*sets));
+	assert(sets);
+	for (i = 0; i < set_count; i++)
+		sets[i] = set_new(i);
+
+	s = strdup(threads);
+	n = 0;
+	for (tok = strtok_r(s, ",", &ctx); tok; tok = strtok_r(NULL, ",", &ctx))
+		n++;
+	printf("1..%d\n", n);
+	strcpy(s, threads);
+	n = 0;
+	for (tok = strtok_r(s, ",", &ctx); tok; tok = strtok_r(NULL, ",", &ctx))
+		rc |= run(atoi(tok), ++n);
+	free(s);
+	return (rc ? 1 : 0);
+}
@@ -90,6 +90,7 @@ ev_t ev_new(ev_type_t evt)
 	e->e_refcount = 1;
 	e->e_type = evt;
 	e->e_posted = 0;
+	e->e_slot = NULL;
 
 	return (ev_t)&e->e_ev;
 }
@@ -125,7 +126,7 @@ int ev_canceled(ev_t ev)
 int ev_post(ev_worker_t src, ev_worker_t dst, ev_t ev, struct timespec *to)
 {
 	ev__t e = EV(ev);
-	int rc;
+	int wake;
 
 	/* If multiple threads attempt to post the same event all but
 	 * one will receive EBUSY. If the event is already posted all
@@ -134,38 +135,54 @@ int ev_post(ev_worker_t src, ev_worker_t dst, ev_t ev, struct timespec *to)
 		return EBUSY;
 
 	e->e_status = EV_OK;
+	e->e_src = src;
+	e->e_dst = dst;
 
-	if (to) {
-		e->e_to = *to;
-	} else {
+	if (!to) {
 		e->e_to.tv_sec = 0;
 		e->e_to.tv_nsec = 0;
+		if (dst->w_state == EV_WORKER_FLUSHING)
+			goto err;
+		ev_get(&e->e_ev);
+		__ev_queue_push(dst, e);
+		__ev_worker_wake(dst, 0);
+		return 0;
 	}
 
-	e->e_src = src;
-	e->e_dst = dst;
-	rbn_init(&e->e_to_rbn, &e->e_to);
-
+	e->e_to = *to;
+	e->e_to_tick = __ev_ts_tick(to, 1);
 	pthread_mutex_lock(&dst->w_lock);
-	if (dst->w_state == EV_WORKER_FLUSHING)
+	if (dst->w_state == EV_WORKER_FLUSHING) {
+		pthread_mutex_unlock(&dst->w_lock);
 		goto err;
+	}
 	ev_get(&e->e_ev);
-	if (to) {
-		rbt_ins(&dst->w_event_tree, &e->e_to_rbn);
-	} else {
-		__sync_fetch_and_add(&dst->w_ev_list_len, 1);
-		TAILQ_INSERT_TAIL(&dst->w_event_list, e, e_entry);
-
+	/*
+	 * wh_now is ahead of the clock if the clock stepped back since the
+	 * worker last advanced the wheel. The worker must then re-compute
+	 * its timeout as well.
+	 */
+	wake = __ev_wheel_sync(&dst->w_wheel);
+	if (e->e_to_tick <= dst->w_wheel.wh_now) {
+		/* Already expired */
+		pthread_mutex_unlock(&dst->w_lock);
+		__ev_queue_push(dst, e);
+		__ev_worker_wake(dst, wake);
+		return 0;
+	}
+	__ev_wheel_ins(&dst->w_wheel, e);
+	dst->w_wheel_len++;
+	/* Make the worker re-compute its timeout if this event is earlier */
+	if (e->e_to_tick < dst->w_wake_tick) {
+		dst->w_wake_tick = e->e_to_tick;
+		wake = 1;
 	}
-	rc = (ev_time_cmp(&e->e_to, &dst->w_sem_wait) <= 0);
 	pthread_mutex_unlock(&dst->w_lock);
-	if (rc)
-		sem_post(&dst->w_sem);
-
+	if (wake)
+		__ev_worker_wake(dst, 1);
 	return 0;
  err:
 	e->e_posted = 0;
-	pthread_mutex_unlock(&dst->w_lock);
 	return EBUSY;
 }
 
@@ -185,23 +202,23 @@ int ev_cancel(ev_t ev)
 	e->e_status = EV_FLUSH;
 
 	/*
-	 * If the event is on the list or is soon to expire, do
-	 * nothing. This avoids racing with the worker.
+	 * If the event is on the queue, is being delivered, or is soon to
+	 * expire, do nothing. This avoids racing with the worker.
 	 */
 	rc = 0;
 	(void)clock_gettime(CLOCK_REALTIME, &now);
-	if (ev_time_diff(&e->e_to, &now) < 1.0) {
+	if (!e->e_slot || ev_time_diff(&e->e_to, &now) < 1.0) {
 		rc = EBUSY;
 		goto out;
 	}
 
-	rbt_del(&e->e_dst->w_event_tree, &e->e_to_rbn);
-	__sync_fetch_and_add(&e->e_dst->w_ev_list_len, 1);
-	TAILQ_INSERT_TAIL(&e->e_dst->w_event_list, e, e_entry);
+	__ev_wheel_del(&e->e_dst->w_wheel, e);
+	e->e_dst->w_wheel_len--;
+	__ev_queue_push(e->e_dst, e);
  out:
 	pthread_mutex_unlock(&e->e_dst->w_lock);
 	if (!rc)
-		sem_post(&e->e_dst->w_sem);
+		__ev_worker_wake(e->e_dst, 0);
 	return rc;
 }
 
@@ -137,8 +137,9 @@ int ev_listen(ev_worker_t evw, ev_type_t evt);
  * unspecified.
  *
  * Events posted with a timeout will be delivered when the timeout
- * expires. If two events are posted with the same timeout, the order
- * in which they are delivered is undefined.
+ * expires. Timeouts are kept with a resolution of one millisecond. If
+ * two events are posted with timeouts in the same millisecond, the
+ * order in which they are delivered is undefined.
  *
  * \param src The source worker
  * \param dst The destination worker
@@ -2,7 +2,6 @@
 #define __EV_PRIV_H_
 
 #include <sys/queue.h>
-#include <semaphore.h>
 #include <inttypes.h>
 #include <coll/rbt.h>
 #include "ev.h"
@@ -14,6 +13,13 @@ struct ev_type_s {
 	size_t t_size;
 };
 
+/* Link in a worker's queue of immediate events */
+struct ev_qlink {
+	struct ev_qlink *q_next;
+};
+
+TAILQ_HEAD(ev_wheel_slot, ev__s);
+
 typedef struct ev__s {
 	ev_worker_t e_src;
 	ev_worker_t e_dst;
@@ -22,11 +28,34 @@ typedef struct ev__s {
 	int e_posted;
 	ev_status_t e_status;
 	struct timespec e_to;
-	struct rbn e_to_rbn;
+	uint64_t e_to_tick;	/* e_to rounded up to a wheel tick */
+	struct ev_wheel_slot *e_slot;	/* wheel slot, NULL if not on the wheel */
 	TAILQ_ENTRY(ev__s) e_entry;
+	struct ev_qlink e_qlink;
 	struct ev_s e_ev;
 } *ev__t;
 
+/*
+ * Hierarchical timing wheel
+ *
+ * Level n has EV_WHEEL_SLOTS slots that each cover EV_WHEEL_SLOTS^n
+ * ticks. When the tick count wraps at one level, the matching slot of
+ * the level above is cascaded down. Four levels of 256 one millisecond
+ * ticks cover about 49 days; events further out are parked in the last
+ * slot of the top level and re-inserted when it cascades.
+ */
+#define EV_WHEEL_TICK_NS	1000000
+#define EV_WHEEL_BITS		8
+#define EV_WHEEL_SLOTS		(1 << EV_WHEEL_BITS)
+#define EV_WHEEL_MASK		(EV_WHEEL_SLOTS - 1)
+#define EV_WHEEL_LEVELS		4
+
+struct ev_wheel {
+	uint64_t wh_now;	/* the last tick processed */
+	int wh_count[EV_WHEEL_LEVELS];
+	struct ev_wheel_slot wh_slot[EV_WHEEL_LEVELS][EV_WHEEL_SLOTS];
+};
+
 enum evw_state_e {
 	EV_WORKER_STOPPED,
 	EV_WORKER_RUNNING,
@@ -38,19 +67,44 @@ struct ev_worker_s {
 	ev_actor_t w_actor;
 	pthread_t w_thread;
 	enum evw_state_e w_state;
-	struct timespec w_sem_wait;
-	sem_t w_sem;
 	struct rbn w_rbn;
-	pthread_mutex_t w_lock;
 	ev_actor_t *w_dispatch;
 	size_t w_dispatch_len;
-	/* An ordered tree of events with timeouts */
-	struct rbt w_event_tree;
-	/* A list of events without timeouts */
-	TAILQ_HEAD(w_event_list, ev__s) w_event_list;
+
+	/*
+	 * Events without timeouts are pushed on a lock-free multi-producer,
+	 * single-consumer queue that only the worker thread pops.
+	 */
+	struct ev_qlink *w_q_head;	/* producers */
+	struct ev_qlink *w_q_tail;	/* worker thread */
+	struct ev_qlink w_q_stub;
 	int w_ev_list_len;
+
+	/* Events with timeouts, protected by w_lock */
+	pthread_mutex_t w_lock;
+	struct ev_wheel w_wheel;
+	int w_wheel_len;
+	uint64_t w_wake_tick;	/* tick the sleeping worker will wake at */
+
+	/*
+	 * The worker sleeps in poll() on w_efd. w_sleeping is set while it
+	 * does so that only the first poster after it went to sleep pays
+	 * for the eventfd write.
+	 */
+	int w_efd;
+	int w_sleeping;
 };
 
 #define EV(_e_) container_of(_e_, struct ev__s, e_ev);
-#endif
 
+void __ev_queue_push(ev_worker_t w, ev__t e);
+void __ev_worker_wake(ev_worker_t w, int force);
+uint64_t __ev_ts_tick(const struct timespec *ts, int round_up);
+void __ev_wheel_ins(struct ev_wheel *wh, ev__t e);
+void __ev_wheel_del(struct ev_wheel *wh, ev__t e);
+/*
+ * Move the wheel back to the current time if the realtime clock stepped
+ * back. Returns 1 if it did.
+ */
+int __ev_wheel_sync(struct ev_wheel *wh);
+#endif
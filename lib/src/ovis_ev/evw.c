@@ -6,6 +6,10 @@
 #include <pthread.h>
 #include <time.h>
 #include <inttypes.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/eventfd.h>
 #include <coll/rbt.h>
 #include "ev.h"
 #include "ev_priv.h"
@@ -43,28 +47,263 @@ int ev_time_cmp(struct timespec *tsa, const struct timespec *tsb)
 
 }
 
+uint64_t __ev_ts_tick(const struct timespec *ts, int round_up)
+{
+	uint64_t ns = (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+	if (round_up)
+		ns += EV_WHEEL_TICK_NS - 1;
+	return ns / EV_WHEEL_TICK_NS;
+}
+
+static uint64_t ev_now_tick(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return __ev_ts_tick(&now, 0);
+}
+
 /*
- * Process all of the events in the worker's event list.
+ * Multi-producer, single-consumer queue of immediate events
  *
- * Called with the worker lock held.
+ * Producers exchange the head and then link the previous head to the
+ * new entry. Only the worker thread pops from the tail. The stub entry
+ * keeps the queue from ever being empty so that a producer never has
+ * to touch the tail.
+ */
+static void ev_queue_push(ev_worker_t w, struct ev_qlink *l)
+{
+	struct ev_qlink *prev;
+	l->q_next = NULL;
+	prev = __atomic_exchange_n(&w->w_q_head, l, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&prev->q_next, l, __ATOMIC_RELEASE);
+}
+
+void __ev_queue_push(ev_worker_t w, ev__t e)
+{
+	__sync_fetch_and_add(&w->w_ev_list_len, 1);
+	ev_queue_push(w, &e->e_qlink);
+}
+
+/*
+ * Returns NULL if the queue is empty, or if a producer has not yet
+ * finished linking its entry. The caller tells the two apart with
+ * ev_queue_empty().
+ */
+static ev__t ev_queue_pop(ev_worker_t w)
+{
+	struct ev_qlink *tail = w->w_q_tail;
+	struct ev_qlink *next = __atomic_load_n(&tail->q_next, __ATOMIC_ACQUIRE);
+
+	if (tail == &w->w_q_stub) {
+		if (!next)
+			return NULL;
+		w->w_q_tail = tail = next;
+		next = __atomic_load_n(&tail->q_next, __ATOMIC_ACQUIRE);
+	}
+	if (next)
+		goto out;
+	if (tail != __atomic_load_n(&w->w_q_head, __ATOMIC_SEQ_CST))
+		return NULL;
+	/* tail is the last entry, put the stub behind it */
+	ev_queue_push(w, &w->w_q_stub);
+	next = __atomic_load_n(&tail->q_next, __ATOMIC_ACQUIRE);
+	if (!next)
+		return NULL;
+ out:
+	w->w_q_tail = next;
+	__sync_fetch_and_sub(&w->w_ev_list_len, 1);
+	return container_of(tail, struct ev__s, e_qlink);
+}
+
+static int ev_queue_empty(ev_worker_t w)
+{
+	return w->w_q_tail == &w->w_q_stub &&
+		__atomic_load_n(&w->w_q_head, __ATOMIC_SEQ_CST) == &w->w_q_stub;
+}
+
+/*
+ * Wake up the worker if it is sleeping. If force is set, the worker is
+ * woken up even if it has not gone to sleep yet, so that it re-computes
+ * its timeout.
+ */
+void __ev_worker_wake(ev_worker_t w, int force)
+{
+	if (!force) {
+		if (!__atomic_load_n(&w->w_sleeping, __ATOMIC_SEQ_CST))
+			return;
+		if (!__sync_bool_compare_and_swap(&w->w_sleeping, 1, 0))
+			return;
+	}
+	(void)eventfd_write(w->w_efd, 1);
+}
+
+void __ev_wheel_ins(struct ev_wheel *wh, ev__t e)
+{
+	uint64_t delta, tick = e->e_to_tick;
+	int lvl;
+
+	delta = (tick > wh->wh_now ? tick - wh->wh_now : 0);
+	for (lvl = 0; lvl < EV_WHEEL_LEVELS - 1; lvl++) {
+		if (delta < (1ULL << (EV_WHEEL_BITS * (lvl + 1))))
+			break;
+	}
+	if (delta >= (1ULL << (EV_WHEEL_BITS * EV_WHEEL_LEVELS)))
+		tick = wh->wh_now + (1ULL << (EV_WHEEL_BITS * EV_WHEEL_LEVELS)) - 1;
+	e->e_slot = &wh->wh_slot[lvl][(tick >> (EV_WHEEL_BITS * lvl)) & EV_WHEEL_MASK];
+	TAILQ_INSERT_TAIL(e->e_slot, e, e_entry);
+	wh->wh_count[lvl]++;
+}
+
+void __ev_wheel_del(struct ev_wheel *wh, ev__t e)
+{
+	int lvl = (e->e_slot - &wh->wh_slot[0][0]) / EV_WHEEL_SLOTS;
+	TAILQ_REMOVE(e->e_slot, e, e_entry);
+	wh->wh_count[lvl]--;
+	e->e_slot = NULL;
+}
+
+static void ev_wheel_cascade(struct ev_wheel *wh, int lvl)
+{
+	struct ev_wheel_slot *slot;
+	ev__t e;
+
+	slot = &wh->wh_slot[lvl][(wh->wh_now >> (EV_WHEEL_BITS * lvl)) & EV_WHEEL_MASK];
+	while ((e = TAILQ_FIRST(slot))) {
+		__ev_wheel_del(wh, e);
+		__ev_wheel_ins(wh, e);
+	}
+}
+
+/* Move every event on the wheel to the fire list */
+static void ev_wheel_drain(struct ev_wheel *wh, struct ev_wheel_slot *fire)
+{
+	ev__t e;
+	int lvl, i;
+
+	for (lvl = 0; lvl < EV_WHEEL_LEVELS; lvl++) {
+		for (i = 0; i < EV_WHEEL_SLOTS && wh->wh_count[lvl]; i++) {
+			while ((e = TAILQ_FIRST(&wh->wh_slot[lvl][i]))) {
+				__ev_wheel_del(wh, e);
+				TAILQ_INSERT_TAIL(fire, e, e_entry);
+			}
+		}
+	}
+}
+
+/*
+ * Returns the tick at which the worker has to look at the wheel again,
+ * either to deliver events or to cascade a slot, or UINT64_MAX if the
+ * wheel is empty.
  */
-static void process_immediate_events(ev_worker_t w)
+static uint64_t ev_wheel_next_tick(struct ev_wheel *wh)
 {
+	uint64_t base, tick = UINT64_MAX;
+	int lvl, i, shift;
+
+	for (lvl = 0; lvl < EV_WHEEL_LEVELS; lvl++) {
+		if (!wh->wh_count[lvl])
+			continue;
+		shift = EV_WHEEL_BITS * lvl;
+		base = wh->wh_now >> shift;
+		for (i = 1; i <= EV_WHEEL_SLOTS; i++) {
+			if (TAILQ_EMPTY(&wh->wh_slot[lvl][(base + i) & EV_WHEEL_MASK]))
+				continue;
+			if (((base + i) << shift) < tick)
+				tick = (base + i) << shift;
+			break;
+		}
+	}
+	return tick;
+}
+
+/*
+ * Move the wheel back to tick. The slots are chosen from the distance to
+ * wh_now, so every event is re-inserted; none of them has expired.
+ */
+static void ev_wheel_rebase(struct ev_wheel *wh, uint64_t tick)
+{
+	struct ev_wheel_slot tmp = TAILQ_HEAD_INITIALIZER(tmp);
 	ev__t e;
-	ev_actor_t actor;
- next:
-	if (TAILQ_EMPTY(&w->w_event_list))
+
+	ev_wheel_drain(wh, &tmp);
+	wh->wh_now = tick;
+	while ((e = TAILQ_FIRST(&tmp))) {
+		TAILQ_REMOVE(&tmp, e, e_entry);
+		__ev_wheel_ins(wh, e);
+	}
+}
+
+int __ev_wheel_sync(struct ev_wheel *wh)
+{
+	uint64_t now = ev_now_tick();
+
+	if (now >= wh->wh_now)
+		return 0;
+	ev_wheel_rebase(wh, now);
+	return 1;
+}
+
+/*
+ * Advance the wheel to tick and move all events that expired on the
+ * way to the fire list. If the realtime clock stepped back, the wheel is
+ * moved back with it.
+ */
+static void ev_wheel_advance(struct ev_wheel *wh, uint64_t tick,
+			     struct ev_wheel_slot *fire)
+{
+	struct ev_wheel_slot *slot;
+	uint64_t next;
+	ev__t e;
+	int lvl;
+
+	if (tick < wh->wh_now) {
+		ev_wheel_rebase(wh, tick);
 		return;
+	}
+	while (wh->wh_now < tick) {
+		if (tick - wh->wh_now > EV_WHEEL_SLOTS) {
+			/*
+			 * More than a revolution of the first level to go:
+			 * jump to the tick before the next one that has
+			 * events to deliver or cascade.
+			 */
+			next = ev_wheel_next_tick(wh);
+			if (next > tick) {
+				wh->wh_now = tick;
+				break;
+			}
+			wh->wh_now = next - 1;
+		} else {
+			for (lvl = 0; lvl < EV_WHEEL_LEVELS; lvl++) {
+				if (wh->wh_count[lvl])
+					break;
+			}
+			if (lvl == EV_WHEEL_LEVELS) {
+				wh->wh_now = tick;
+				break;
+			}
+		}
+		wh->wh_now++;
+		for (lvl = 1; lvl < EV_WHEEL_LEVELS; lvl++) {
+			if (wh->wh_now & ((1ULL << (EV_WHEEL_BITS * lvl)) - 1))
+				break;
+			ev_wheel_cascade(wh, lvl);
+		}
+		slot = &wh->wh_slot[0][wh->wh_now & EV_WHEEL_MASK];
+		while ((e = TAILQ_FIRST(slot))) {
+			__ev_wheel_del(wh, e);
+			TAILQ_INSERT_TAIL(fire, e, e_entry);
+		}
+	}
+}
 
-	e = TAILQ_FIRST(&w->w_event_list);
-	TAILQ_REMOVE(&w->w_event_list, e, e_entry);
-	__sync_fetch_and_sub(&w->w_ev_list_len, 1);
-	e->e_posted = 0;
+static void ev_deliver(ev_worker_t w, ev__t e)
+{
+	ev_actor_t actor;
 
+	e->e_posted = 0;
 	if (w->w_state == EV_WORKER_FLUSHING)
 		e->e_status = EV_FLUSH;
-
-	pthread_mutex_unlock(&w->w_lock);
 	actor = NULL;
 	if (e->e_type->t_id < w->w_dispatch_len)
 		actor = w->w_dispatch[e->e_type->t_id];
@@ -72,52 +311,67 @@ static void process_immediate_events(ev_worker_t w)
 		actor = w->w_actor;
 	actor(e->e_src, e->e_dst, e->e_status, &e->e_ev);
 	ev_put(&e->e_ev);
-	pthread_mutex_lock(&w->w_lock);
-	goto next;
 }
 
 /*
- * Process all of the events in the worker's event tree that have a
- * timeout before or at the current time.
- *
- * Return the 1st event that has a timeout > now
+ * Deliver up to EV_BATCH events from the worker's queue of immediate
+ * events, so that a steady stream of posts cannot hold back the timed
+ * events. Returns the number of events delivered.
  */
-static ev__t process_to_events(ev_worker_t w)
+#define EV_BATCH 256
+static int process_immediate_events(ev_worker_t w)
 {
 	ev__t e;
-	struct rbn *rbn;
-	struct timespec now;
-	ev_actor_t actor;
-	clock_gettime(CLOCK_REALTIME, &now);
- next:
-	e = NULL;
-	rbn = rbt_min(&w->w_event_tree);
-	if (!rbn)
-		goto out;
+	int n;
 
-	e = container_of(rbn, struct ev__s, e_to_rbn);
-	if (w->w_state == EV_WORKER_FLUSHING) {
-		e->e_status = EV_FLUSH;
-	} else {
-		if (ev_time_cmp(&e->e_to, &now) > 0)
-			goto out;
+	for (n = 0; n < EV_BATCH; n++) {
+		e = ev_queue_pop(w);
+		if (!e) {
+			if (!ev_queue_empty(w)) {
+				/* A producer is in the middle of a push */
+				sched_yield();
+				continue;
+			}
+			break;
+		}
+		ev_deliver(w, e);
 	}
+	return n;
+}
+
+/*
+ * Deliver the events on the wheel that expired at or before the
+ * current time, or all of them if the worker is flushing.
+ *
+ * Returns the tick at which the worker should wake up next.
+ */
+static uint64_t process_to_events(ev_worker_t w)
+{
+	struct ev_wheel_slot fire = TAILQ_HEAD_INITIALIZER(fire);
+	uint64_t next;
+	ev__t e;
+	int n = 0;
 
-	rbt_del(&w->w_event_tree, &e->e_to_rbn);
-	e->e_posted = 0;
-	pthread_mutex_unlock(&w->w_lock);
-	actor = NULL;
-	if (e->e_type->t_id < w->w_dispatch_len)
-		actor = w->w_dispatch[e->e_type->t_id];
-	if (!actor)
-		actor = w->w_actor;
-	actor(e->e_src, e->e_dst, e->e_status, &e->e_ev);
-	ev_put(&e->e_ev);
 	pthread_mutex_lock(&w->w_lock);
-	goto next;
+	if (w->w_state == EV_WORKER_FLUSHING)
+		ev_wheel_drain(&w->w_wheel, &fire);
+	else
+		ev_wheel_advance(&w->w_wheel, ev_now_tick(), &fire);
+	TAILQ_FOREACH(e, &fire, e_entry)
+		n++;
+	w->w_wheel_len -= n;
+	pthread_mutex_unlock(&w->w_lock);
 
- out:
-	return e;
+	while ((e = TAILQ_FIRST(&fire))) {
+		TAILQ_REMOVE(&fire, e, e_entry);
+		ev_deliver(w, e);
+	}
+
+	pthread_mutex_lock(&w->w_lock);
+	next = ev_wheel_next_tick(&w->w_wheel);
+	w->w_wake_tick = next;
+	pthread_mutex_unlock(&w->w_lock);
+	return next;
 }
 
 void ev_sched_to(struct timespec *to, time_t secs, int nsecs)
@@ -127,26 +381,45 @@ void ev_sched_to(struct timespec *to, time_t secs, int nsecs)
 	to->tv_nsec += nsecs;
 }
 
+#define EV_IDLE_TIMEOUT_MS 10000
 static void *worker_proc(void *arg)
 {
-	ev__t e;
 	ev_worker_t w = arg;
+	struct pollfd pfd = { .fd = w->w_efd, .events = POLLIN };
+	uint64_t next, now;
+	eventfd_t cnt;
+	int n, timeout;
+
 	w->w_state = EV_WORKER_RUNNING;
-	ev_sched_to(&w->w_sem_wait, 0, 0);
-	sem_timedwait(&w->w_sem, &w->w_sem_wait);
 	while (1) {
-		pthread_mutex_lock(&w->w_lock);
-		process_immediate_events(w);
-		e = process_to_events(w);
-		if (e) {
-			w->w_sem_wait = e->e_to;
-		} else {
-			ev_sched_to(&w->w_sem_wait, 10, 0);
-		}
-		if (w->w_state == EV_WORKER_FLUSHING)
+		n = process_immediate_events(w);
+		next = process_to_events(w);
+		if (w->w_state == EV_WORKER_FLUSHING) {
+			/* Deliver anything that was posted while flushing */
+			while (process_immediate_events(w))
+				;
 			w->w_state = EV_WORKER_RUNNING;
-		pthread_mutex_unlock(&w->w_lock);
-		sem_timedwait(&w->w_sem, &w->w_sem_wait);
+		}
+		if (n == EV_BATCH)
+			continue;
+
+		now = ev_now_tick();
+		if (next == UINT64_MAX || next - now > EV_IDLE_TIMEOUT_MS)
+			timeout = EV_IDLE_TIMEOUT_MS;
+		else if (next <= now)
+			continue;
+		else
+			timeout = next - now;
+
+		__atomic_store_n(&w->w_sleeping, 1, __ATOMIC_SEQ_CST);
+		if (!ev_queue_empty(w)) {
+			__atomic_store_n(&w->w_sleeping, 0, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		(void)poll(&pfd, 1, timeout);
+		__atomic_store_n(&w->w_sleeping, 0, __ATOMIC_SEQ_CST);
+		if (pfd.revents & POLLIN)
+			(void)eventfd_read(w->w_efd, &cnt);
 	}
 	return NULL;
 }
@@ -156,12 +429,12 @@ void ev_flush(ev_worker_t w)
 	pthread_mutex_lock(&w->w_lock);
 	w->w_state = EV_WORKER_FLUSHING;
 	pthread_mutex_unlock(&w->w_lock);
-	sem_post(&w->w_sem);
+	__ev_worker_wake(w, 1);
 }
 
 ev_worker_t ev_worker_new(const char *name, ev_actor_t actor_fn)
 {
-	int err = ENOMEM;
+	int i, j, err = ENOMEM;
 	ev_worker_t w;
 	struct rbn *rbn;
 
@@ -172,14 +445,21 @@ ev_worker_t ev_worker_new(const char *name, ev_actor_t actor_fn)
 	if (!w->w_name)
 		goto err_1;
 	w->w_actor = actor_fn;
-	err = sem_init(&w->w_sem, 0, 0);
-	if (err)
-		goto err_2;
+	w->w_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (w->w_efd < 0) {
+		err = errno;
+		goto err_1;
+	}
 
 	w->w_state = EV_WORKER_STOPPED;
 	pthread_mutex_init(&w->w_lock, NULL);
-	rbt_init(&w->w_event_tree, (int (*)(void *, const void*))ev_time_cmp);
-	TAILQ_INIT(&w->w_event_list);
+	w->w_q_head = w->w_q_tail = &w->w_q_stub;
+	w->w_wheel.wh_now = ev_now_tick();
+	for (i = 0; i < EV_WHEEL_LEVELS; i++) {
+		for (j = 0; j < EV_WHEEL_SLOTS; j++)
+			TAILQ_INIT(&w->w_wheel.wh_slot[i][j]);
+	}
+	w->w_wake_tick = UINT64_MAX;
 
 	pthread_mutex_lock(&worker_lock);
 	err = EEXIST;
@@ -203,6 +483,7 @@ ev_worker_t ev_worker_new(const char *name, ev_actor_t actor_fn)
 	return w;
  err_2:
 	pthread_mutex_unlock(&worker_lock);
+	close(w->w_efd);
  err_1:
 	free(w->w_name);
  err_0:
@@ -279,8 +560,8 @@ int ev_pending(ev_worker_t w)
 	int count = 0;
 
 	pthread_mutex_lock(&w->w_lock);
-	count = rbt_card(&w->w_event_tree);
-	count += w->w_ev_list_len;
+	count = w->w_wheel_len;
 	pthread_mutex_unlock(&w->w_lock);
+	count += __atomic_load_n(&w->w_ev_list_len, __ATOMIC_RELAXED);
 	return count;
 }
@@ -0,0 +1,307 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include "ev.h"
+
+/*
+ * Post/dispatch benchmark
+ *
+ * For each number of posting threads, every thread posts a number of
+ * immediate events to one worker and the worker's actor records how
+ * long each event waited. The test reports the post rate, the delivery
+ * rate and the post-to-dispatch latency. Two more tests check that
+ * timed events are never delivered early and that a cancelled timed
+ * event is delivered promptly with EV_FLUSH.
+ */
+
+struct bench_ev {
+	struct timespec posted;	/* CLOCK_MONOTONIC */
+	struct timespec to;	/* CLOCK_REALTIME timeout, if any */
+};
+
+static int post_count = 100000;
+static char *threads = "1,2,4,8,16,32,64";
+
+static ev_type_t bench_type;
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static long delivered, expected;
+
+#define LAT_BUCKETS 32
+static long lat_hist[LAT_BUCKETS];	/* log2 of the latency in ns */
+static double lat_sum, lat_max;
+static long early, flushed;
+static double late_sum;
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-n posts_per_thread] [-t threads,threads,...]\n",
+	       prog);
+}
+
+static double ts_diff(const struct timespec *a, const struct timespec *b)
+{
+	return (a->tv_sec - b->tv_sec) + (a->tv_nsec - b->tv_nsec) * 1e-9;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void delivered_one(void)
+{
+	pthread_mutex_lock(&done_lock);
+	if (++delivered == expected)
+		pthread_cond_signal(&done_cond);
+	pthread_mutex_unlock(&done_lock);
+}
+
+static int bench_actor(ev_worker_t src, ev_worker_t dst, ev_status_t status, ev_t ev)
+{
+	struct bench_ev *b = EV_DATA(ev, struct bench_ev);
+	struct timespec ts;
+	double lat;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	lat = ts_diff(&ts, &b->posted);
+	lat_sum += lat;
+	if (lat > lat_max)
+		lat_max = lat;
+	for (i = 0; i < LAT_BUCKETS - 1 && (1L << i) < lat * 1e9; i++)
+		;
+	lat_hist[i]++;
+	if (status == EV_FLUSH)
+		flushed++;
+	if (b->to.tv_sec) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		if (ev_time_cmp(&ts, &b->to) < 0)
+			early++;
+		late_sum += ts_diff(&ts, &b->to);
+	}
+	ev_put(ev);
+	delivered_one();
+	return 0;
+}
+
+static ev_t bench_ev_new(struct timespec *to)
+{
+	ev_t ev = ev_new(bench_type);
+	struct bench_ev *b;
+
+	if (!ev)
+		return NULL;
+	b = EV_DATA(ev, struct bench_ev);
+	if (to)
+		b->to = *to;
+	else
+		memset(&b->to, 0, sizeof(b->to));
+	clock_gettime(CLOCK_MONOTONIC, &b->posted);
+	return ev;
+}
+
+static void wait_delivered(void)
+{
+	pthread_mutex_lock(&done_lock);
+	while (delivered < expected)
+		pthread_cond_wait(&done_cond, &done_lock);
+	pthread_mutex_unlock(&done_lock);
+}
+
+static void reset(long count)
+{
+	delivered = 0;
+	expected = count;
+	memset(lat_hist, 0, sizeof(lat_hist));
+	lat_sum = lat_max = late_sum = 0;
+	early = flushed = 0;
+}
+
+/* Upper bound of the bucket that holds the p-th latency percentile */
+static double lat_pct(double p)
+{
+	long n = 0, target = expected * p;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		n += lat_hist[i];
+		if (n > target)
+			break;
+	}
+	return (1L << i) * 1e-3;	/* us */
+}
+
+struct poster {
+	pthread_t thread;
+	ev_worker_t w;
+	long errors;
+};
+
+static void *poster_proc(void *arg)
+{
+	struct poster *p = arg;
+	ev_t ev;
+	int i;
+
+	for (i = 0; i < post_count; i++) {
+		ev = bench_ev_new(NULL);
+		if (!ev || ev_post(NULL, p->w, ev, NULL)) {
+			p->errors++;
+			delivered_one();
+		}
+	}
+	return NULL;
+}
+
+static int run_post(int thread_count, int test_no)
+{
+	struct poster *p;
+	char name[32];
+	ev_worker_t w;
+	double t0, t1, t2;
+	long errors = 0;
+	int i;
+
+	snprintf(name, sizeof(name), "bench_%d", test_no);
+	w = ev_worker_new(name, bench_actor);
+	p = calloc(thread_count, sizeof(*p));
+	if (!w || !p) {
+		printf("Bail out! out of memory\n");
+		exit(1);
+	}
+	reset((long)thread_count * post_count);
+	t0 = now();
+	for (i = 0; i < thread_count; i++) {
+		p[i].w = w;
+		pthread_create(&p[i].thread, NULL, poster_proc, &p[i]);
+	}
+	for (i = 0; i < thread_count; i++) {
+		pthread_join(p[i].thread, NULL);
+		errors += p[i].errors;
+	}
+	t1 = now();
+	wait_delivered();
+	t2 = now();
+	free(p);
+
+	errors += ev_pending(w);
+	printf("%s %d - %d posting threads\n", (errors ? "not ok" : "ok"),
+	       test_no, thread_count);
+	printf("# %.0f posts/s, %.0f deliveries/s, latency avg %.1f us, "
+	       "p50 < %.0f us, p99 < %.0f us, max %.1f us\n",
+	       expected / (t1 - t0), expected / (t2 - t0),
+	       lat_sum * 1e6 / expected, lat_pct(0.50), lat_pct(0.99),
+	       lat_max * 1e6);
+	if (errors)
+		printf("# %ld failed posts or pending events\n", errors);
+	return (errors != 0);
+}
+
+#define TIMED_COUNT 1000
+static int run_timed(int test_no)
+{
+	struct timespec to;
+	ev_worker_t w;
+	ev_t ev;
+	int i, errors = 0;
+
+	w = ev_worker_new("bench_timed", bench_actor);
+	if (!w) {
+		printf("Bail out! out of memory\n");
+		exit(1);
+	}
+	reset(TIMED_COUNT);
+	srand(1);
+	for (i = 0; i < TIMED_COUNT; i++) {
+		/* spread over 0 to 2 s to exercise the cascade */
+		ev_sched_to(&to, 0, 0);
+		to.tv_nsec += (rand() % 2000) * 1000000L;
+		to.tv_sec += to.tv_nsec / 1000000000;
+		to.tv_nsec %= 1000000000;
+		ev = bench_ev_new(&to);
+		if (!ev || ev_post(NULL, w, ev, &to))
+			errors++;
+	}
+	wait_delivered();
+	errors += early + ev_pending(w);
+	printf("%s %d - %d timed events, %ld early, avg lateness %.3f ms\n",
+	       (errors ? "not ok" : "ok"), test_no, TIMED_COUNT, early,
+	       late_sum * 1e3 / TIMED_COUNT);
+	return (errors != 0);
+}
+
+static int run_cancel(int test_no)
+{
+	struct timespec to;
+	ev_worker_t w;
+	ev_t ev;
+	double t0, t;
+	int rc, ok;
+
+	w = ev_worker_new("bench_cancel", bench_actor);
+	if (!w) {
+		printf("Bail out! out of memory\n");
+		exit(1);
+	}
+	reset(1);
+	ev_sched_to(&to, 3600, 0);
+	ev = bench_ev_new(&to);
+	ev_get(ev);
+	ev_post(NULL, w, ev, &to);
+	t0 = now();
+	rc = ev_cancel(ev);
+	wait_delivered();
+	t = now() - t0;
+	ok = (rc == 0 && flushed == 1 && ev_canceled(ev) && t < 1.0
+	      && ev_pending(w) == 0);
+	ev_put(ev);
+	printf("%s %d - cancelled timed event delivered in %.3f ms\n",
+	       (ok ? "ok" : "not ok"), test_no, t * 1e3);
+	return !ok;
+}
+
+int main(int argc, char **argv)
+{
+	char *s, *tok, *ctx;
+	int op, n, rc = 0;
+
+	while ((op = getopt(argc, argv, "n:t:h")) != -1) {
+		switch (op) {
+		case 'n':
+			post_count = atoi(optarg);
+			break;
+		case 't':
+			threads = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (post_count < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	bench_type = ev_type_new("bench", sizeof(struct bench_ev));
+	s = strdup(threads);
+	n = 0;
+	for (tok = strtok_r(s, ",", &ctx); tok; tok = strtok_r(NULL, ",", &ctx))
+		n++;
+	printf("1..%d\n", n + 2);
+	strcpy(s, threads);
+	n = 0;
+	for (tok = strtok_r(s, ",", &ctx); tok; tok = strtok_r(NULL, ",", &ctx))
+		rc |= run_post(atoi(tok), ++n);
+	free(s);
+	rc |= run_timed(++n);
+	rc |= run_cancel(++n);
+	return (rc ? 1 : 0);
+}
@@ -46,6 +46,7 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#define _GNU_SOURCE
 #include "ovis_event_priv.h"
 #include <stdlib.h>
 #include <fcntl.h>
@@ -55,18 +56,31 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
-
-#define __TIMER_VALID(tv) ((tv)->tv_sec >= 0)
+#include <sched.h>
+#include <time.h>
+#include <sys/timerfd.h>
 
 #define ROUND(x, p) ( ((x)+((p)-1))/(p)*(p) )
-#define USEC 1000000
+#define NSEC 1000000000
 
 #define OVIS_EVENT_HEAP_SIZE_DEFAULT 16384
 
 static
 void ovis_scheduler_destroy(ovis_scheduler_t m);
 
-static void __ovis_event_next_wakeup(const struct timeval *now, ovis_event_t ev);
+static void __ovis_event_next_wakeup(uint64_t now, ovis_event_t ev);
+
+static inline uint64_t __ovis_event_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * NSEC + ts.tv_nsec;
+}
+
+static inline uint64_t __timeval_ns(const struct timeval *tv)
+{
+	return tv->tv_sec * NSEC + tv->tv_usec * 1000;
+}
 
 static inline
 void ovis_scheduler_ref_get(ovis_scheduler_t m)
@@ -112,7 +126,7 @@ void ovis_event_heap_free(struct ovis_event_heap *h)
 static inline
 int ovis_event_lt(ovis_event_t e0, ovis_event_t e1)
 {
-	return timercmp(&e0->priv.tv, &e1->priv.tv, <);
+	return e0->priv.ts < e1->priv.ts;
 }
 
 static inline
@@ -230,6 +244,36 @@ loop:
 	goto loop;
 }
 
+static
+void __ovis_event_timerfd_cb(ovis_event_t ev)
+{
+	uint64_t expirations;
+	ovis_scheduler_t m = ev->param.ctxt;
+	/* just reap the expiration count, the loop processes the heap next */
+	(void)read(m->tfd, &expirations, sizeof(expirations));
+	/* the timer is spent, make sure the next arm reaches the kernel */
+	pthread_mutex_lock(&m->mutex);
+	m->tfd_ts = 0;
+	pthread_mutex_unlock(&m->mutex);
+}
+
+/* Arm the timerfd for the heap top. Must hold m->mutex. */
+static
+void __ovis_scheduler_timer_arm(ovis_scheduler_t m)
+{
+	struct itimerspec its = {};
+	ovis_event_t ev = ovis_event_heap_top(m->heap);
+	uint64_t ts = ev ? ev->priv.ts : 0;
+
+	if (ts == m->tfd_ts)
+		return;
+	/* it_value of zero disarms the timer */
+	its.it_value.tv_sec = ts / NSEC;
+	its.it_value.tv_nsec = ts % NSEC;
+	(void)timerfd_settime(m->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+	m->tfd_ts = ts;
+}
+
 static inline int __ovis_event_get_heap_size()
 {
 	char *sz_str = getenv("OVIS_EVENT_HEAP_SIZE");
@@ -254,6 +298,7 @@ ovis_scheduler_t ovis_scheduler_new()
 	m->efd = -1;
 	m->pfd[0] = -1;
 	m->pfd[1] = -1;
+	m->tfd = -1;
 	m->heap = NULL;
 	m->evcount = 0;
 	m->refcount = 1;
@@ -282,8 +327,6 @@ ovis_scheduler_t ovis_scheduler_new()
 
 	m->ovis_ev.param.ctxt = m;
 	m->ovis_ev.param.cb_fn = __ovis_event_pipe_cb;
-	m->ovis_ev.priv.tv.tv_sec = -1;
-	m->ovis_ev.priv.tv.tv_usec = 0;
 	m->ovis_ev.param.fd = m->pfd[0];
 	m->ovis_ev.priv.idx = -1;
 	m->ovis_ev.param.epoll_events = EPOLLIN;
@@ -295,6 +338,26 @@ ovis_scheduler_t ovis_scheduler_new()
 	if (rc != 0)
 		goto err;
 
+	/*
+	 * CLOCK_REALTIME keeps the periodic events aligned to the wall clock;
+	 * the absolute deadline follows clock adjustments.
+	 */
+	m->tfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK|TFD_CLOEXEC);
+	if (m->tfd < 0)
+		goto err;
+	m->timer_ev.param.ctxt = m;
+	m->timer_ev.param.cb_fn = __ovis_event_timerfd_cb;
+	m->timer_ev.param.fd = m->tfd;
+	m->timer_ev.priv.idx = -1;
+	m->timer_ev.param.epoll_events = EPOLLIN;
+	m->timer_ev.param.type = OVIS_EVENT_EPOLL;
+
+	m->ev[0].events = m->timer_ev.param.epoll_events;
+	m->ev[0].data.ptr = &m->timer_ev;
+	rc = epoll_ctl(m->efd, EPOLL_CTL_ADD, m->tfd, &m->ev[0]);
+	if (rc != 0)
+		goto err;
+
 	goto out;
 
 err:
@@ -317,6 +380,11 @@ void ovis_scheduler_destroy(ovis_scheduler_t m)
 	if (m->pfd[1] >= 0)
 		close(m->pfd[1]);
 
+	if (m->tfd >= 0)
+		close(m->tfd);
+
+	free(m->cpus);
+
 	if (m->heap)
 		ovis_event_heap_free(m->heap);
 
@@ -329,87 +397,89 @@ void ovis_scheduler_free(ovis_scheduler_t m)
 	ovis_scheduler_ref_put(m);
 }
 
+static inline
+void __ovis_event_jitter_record(ovis_event_t ev, uint64_t ns)
+{
+	struct ovis_event_jitter_s *j = &ev->priv.jitter;
+	int bin = ns ? 63 - __builtin_clzll(ns) : 0;
+
+	if (bin >= OVIS_EVENT_JITTER_BINS)
+		bin = OVIS_EVENT_JITTER_BINS - 1;
+	j->hist[bin]++;
+	if (!j->count || ns < j->min_ns)
+		j->min_ns = ns;
+	if (ns > j->max_ns)
+		j->max_ns = ns;
+	j->sum_ns += ns;
+	j->count++;
+}
+
 /**
- * Process events in the heap and returns time-to-next-event.
+ * Dispatch the timer and periodic events that are due.
  *
- * \retval timeout the timeout (milliseconds) to the next event.
+ * The clock is read once per batch. All events expiring at that time are
+ * re-scheduled under one lock acquisition and the timerfd is re-armed for the
+ * next deadline before the callbacks are called.
  */
 static
-int ovis_event_heap_process(ovis_scheduler_t m)
+void ovis_event_heap_process(ovis_scheduler_t m)
 {
-	struct timeval tv, dtv;
-	uint64_t us;
+	struct ovis_event_batch_ent *ent;
 	ovis_event_t ev;
-	int timeout = -1;
+	uint64_t now, ts;
+	int i, n;
 
 loop:
 	pthread_mutex_lock(&m->mutex);
-	ev = ovis_event_heap_top(m->heap);
-	if (!ev) {
-		timeout = -1;
-		goto out;
+	now = __ovis_event_now();
+	for (n = 0; n < OVIS_EVENT_BATCH_MAX; n++) {
+		ev = ovis_event_heap_top(m->heap);
+		if (!ev || ev->priv.ts > now)
+			break;
+		m->batch[n].ev = ev;
+		m->batch[n].ts = ev->priv.ts;
+		__ovis_event_next_wakeup(now, ev);
+		ovis_event_heap_update(m->heap, ev->priv.idx);
+		if (ev->param.type == OVIS_EVENT_PERIODIC)
+			ev->cb.type = OVIS_EVENT_PERIODIC;
+		else
+			ev->cb.type = OVIS_EVENT_TIMEOUT;
 	}
+	m->batch_len = n;
+	__ovis_scheduler_timer_arm(m);
+	pthread_mutex_unlock(&m->mutex);
 
-	gettimeofday(&tv, NULL);
-	if (!timercmp(&ev->priv.tv, &tv, >)) {
-		/* current time is greater than event time */
-		goto process_event;
+	for (i = 0; i < n; i++) {
+		/* an earlier callback may have deleted the event */
+		pthread_mutex_lock(&m->mutex);
+		ent = &m->batch[i];
+		ev = ent->ev;
+		ts = ent->ts;
+		ent->ev = NULL;
+		pthread_mutex_unlock(&m->mutex);
+		if (!ev)
+			continue;
+		now = __ovis_event_now();
+		__ovis_event_jitter_record(ev, now > ts ? now - ts : 0);
+		ev->param.cb_fn(ev);
 	}
-	timersub(&ev->priv.tv, &tv, &dtv);
-	assert(dtv.tv_sec >= 0);
-	assert(dtv.tv_usec >= 0);
-	/* tv_usec + 999 is for rounding-up transforming usec -> msec */
-	timeout = dtv.tv_sec*1000 + (dtv.tv_usec + 999)/1000;
-	/*
-	printf("timeout: %d\n", timeout);
-	printf("ev->tv: %ld.%06ld\n", ev->tv.tv_sec, ev->tv.tv_usec);
-	printf("tv: %ld.%06ld\n", tv.tv_sec, tv.tv_usec);
-	printf("dtv: %ld.%06ld\n", dtv.tv_sec, dtv.tv_usec);
-	*/
-	goto out;
+	if (n == OVIS_EVENT_BATCH_MAX)
+		goto loop;
 
-process_event:
-	switch (ev->param.type) {
-	case OVIS_EVENT_TIMEOUT:
-	case OVIS_EVENT_EPOLL_TIMEOUT:
-		/* timeout event application callback */
-		gettimeofday(&tv, NULL);
-		timeradd(&tv, &ev->param.timeout, &ev->priv.tv);
-		ovis_event_heap_update(m->heap, ev->priv.idx);
-		ev->cb.type = OVIS_EVENT_TIMEOUT;
-		break;
-	case OVIS_EVENT_PERIODIC:
-		/* periodic event application callback */
-		gettimeofday(&tv, NULL);
-		us = tv.tv_sec * USEC + tv.tv_usec;
-		us = ROUND(us, ev->param.periodic.period_us);
-		us += ev->param.periodic.phase_us;
-		ev->priv.tv.tv_sec = us / USEC;
-		ev->priv.tv.tv_usec = us % USEC;
-		ovis_event_heap_update(m->heap, ev->priv.idx);
-		ev->cb.type = OVIS_EVENT_PERIODIC;
-		break;
-	default:
-		assert(0 == "Unexpected event type");
-	}
-	pthread_mutex_unlock(&m->mutex);
-	ev->param.cb_fn(ev);
-	goto loop;
-out:
+	pthread_mutex_lock(&m->mutex);
+	m->batch_len = 0;
 	if (m->state == OVIS_EVENT_MANAGER_RUNNING)
 		m->state = OVIS_EVENT_MANAGER_WAITING;
 	pthread_mutex_unlock(&m->mutex);
-	return timeout;
 }
 
 static
 int __ovis_event_timer_update(ovis_scheduler_t m, ovis_event_t ev)
 {
-	struct timeval tv;
 	pthread_mutex_lock(&m->mutex);
-	gettimeofday(&tv, NULL);
-	timeradd(&tv, &ev->param.timeout, &ev->priv.tv);
+	__ovis_event_next_wakeup(__ovis_event_now(), ev);
 	ovis_event_heap_update(m->heap, ev->priv.idx);
+	__ovis_scheduler_timer_arm(m);
 	pthread_mutex_unlock(&m->mutex);
 	return 0;
 }
@@ -489,30 +559,49 @@ out:
 	return ev;
 }
 
-static void __ovis_event_next_wakeup(const struct timeval *now, ovis_event_t ev)
+static void __ovis_event_next_wakeup(uint64_t now, ovis_event_t ev)
 {
-	uint64_t us;
+	uint64_t ts, period, phase;
 	switch (ev->param.type) {
 	case OVIS_EVENT_TIMEOUT:
 	case OVIS_EVENT_EPOLL_TIMEOUT:
-		timeradd(now, &ev->param.timeout, &ev->priv.tv);
+		ts = now + __timeval_ns(&ev->param.timeout);
+		if (ts <= now)
+			ts = now + 1;
 		break;
 	case OVIS_EVENT_PERIODIC:
-		us = now->tv_sec * USEC + now->tv_usec;
-		us = ROUND(us, ev->param.periodic.period_us);
-		us += ev->param.periodic.phase_us;
-		ev->priv.tv.tv_sec = us / USEC;
-		ev->priv.tv.tv_usec = us % USEC;
+		if (ev->param.periodic.period_ns) {
+			period = ev->param.periodic.period_ns;
+			phase = ev->param.periodic.phase_ns;
+		} else {
+			period = ev->param.periodic.period_us * 1000;
+			phase = ev->param.periodic.phase_us * 1000;
+		}
+		ts = ROUND(now, period) + phase;
+		/* a negative phase may land at or before now */
+		while (ts <= now)
+			ts += period;
 		break;
 	default:
 		assert(0 == "Bad event type");
+		return;
 	}
+	ev->priv.ts = ts;
+}
+
+void ovis_event_jitter_get(ovis_event_t ev, struct ovis_event_jitter_s *j)
+{
+	*j = ev->priv.jitter;
+}
+
+void ovis_event_jitter_reset(ovis_event_t ev)
+{
+	memset(&ev->priv.jitter, 0, sizeof(ev->priv.jitter));
 }
 
 int ovis_scheduler_event_add(ovis_scheduler_t m, ovis_event_t ev)
 {
 	int rc = 0;
-	ssize_t wb;
 
 	if (ev->param.type & OVIS_EVENT_EPOLL) {
 		struct epoll_event e;
@@ -534,26 +623,17 @@ int ovis_scheduler_event_add(ovis_scheduler_t m, ovis_event_t ev)
 			goto out;
 		}
 		pthread_mutex_lock(&m->mutex);
-		struct timeval tv;
 		/* calculate wake up time */
-		gettimeofday(&tv, NULL);
-		__ovis_event_next_wakeup(&tv, ev);
+		__ovis_event_next_wakeup(__ovis_event_now(), ev);
 		rc = ovis_event_heap_insert(m->heap, ev);
 		if (rc) {
 			pthread_mutex_unlock(&m->mutex);
 			goto out;
 		}
 		m->evcount++;
-		/* notify only if the new event affect the next timeout */
-		if (m->state == OVIS_EVENT_MANAGER_WAITING
-				&& ev->priv.idx == 0) {
-			wb = write(m->pfd[1], &ev, sizeof(ev));
-			if (wb == -1) {
-				rc = errno;
-				pthread_mutex_unlock(&m->mutex);
-				goto out;
-			}
-		}
+		/* the timerfd wakes the loop if the new event is the next one */
+		if (ev->priv.idx == 0)
+			__ovis_scheduler_timer_arm(m);
 		pthread_mutex_unlock(&m->mutex);
 	}
 
@@ -563,7 +643,7 @@ out:
 
 int ovis_scheduler_event_del(ovis_scheduler_t m, ovis_event_t ev)
 {
-	int rc = 0;
+	int i, rc = 0;
 	ssize_t wb;
 
 	if (ev->param.type & OVIS_EVENT_EPOLL) {
@@ -585,8 +665,13 @@ int ovis_scheduler_event_del(ovis_scheduler_t m, ovis_event_t ev)
 	}
 
 	pthread_mutex_lock(&m->mutex);
+	for (i = 0; i < m->batch_len; i++) {
+		if (m->batch[i].ev == ev)
+			m->batch[i].ev = NULL;
+	}
 	if (ev->priv.idx >= 0) {
 		ovis_event_heap_remove(m->heap, ev);
+		__ovis_scheduler_timer_arm(m);
 		m->evcount--;
 		/* notify only last delete event */
 		if (m->state == OVIS_EVENT_MANAGER_WAITING && m->evcount == 0) {
@@ -632,10 +717,49 @@ int ovis_event_term_check(ovis_scheduler_t m)
 	return rc;
 }
 
+static
+int __ovis_scheduler_affinity_apply(ovis_scheduler_t m)
+{
+	cpu_set_t set;
+	int i;
+
+	if (!m->ncpus)
+		return 0;
+	CPU_ZERO(&set);
+	for (i = 0; i < m->ncpus; i++)
+		CPU_SET(m->cpus[i], &set);
+	return pthread_setaffinity_np(m->thread, sizeof(set), &set);
+}
+
+int ovis_scheduler_affinity_set(ovis_scheduler_t m, const int *cpus, int ncpus)
+{
+	int i, rc = 0;
+	int *a = NULL;
+
+	for (i = 0; i < ncpus; i++) {
+		if (cpus[i] < 0 || cpus[i] >= CPU_SETSIZE)
+			return EINVAL;
+	}
+	if (ncpus) {
+		a = malloc(ncpus * sizeof(*a));
+		if (!a)
+			return ENOMEM;
+		memcpy(a, cpus, ncpus * sizeof(*a));
+	}
+	pthread_mutex_lock(&m->mutex);
+	free(m->cpus);
+	m->cpus = a;
+	m->ncpus = ncpus;
+	if (m->state == OVIS_EVENT_MANAGER_RUNNING
+			|| m->state == OVIS_EVENT_MANAGER_WAITING)
+		rc = __ovis_scheduler_affinity_apply(m);
+	pthread_mutex_unlock(&m->mutex);
+	return rc;
+}
+
 int ovis_scheduler_loop(ovis_scheduler_t m, int return_on_empty)
 {
 	ovis_event_t ev;
-	int timeout;
 	int i;
 	int rc = 0;
 	int cnt;
@@ -646,6 +770,9 @@ int ovis_scheduler_loop(ovis_scheduler_t m, int return_on_empty)
 	case OVIS_EVENT_MANAGER_INIT:
 	case OVIS_EVENT_MANAGER_TERM:
 		m->state = OVIS_EVENT_MANAGER_RUNNING;
+		m->thread = pthread_self();
+		/* the affinity is a hint, the loop runs regardless */
+		(void)__ovis_scheduler_affinity_apply(m);
 		rc = 0;
 		break;
 	case OVIS_EVENT_MANAGER_WAITING:
@@ -658,7 +785,7 @@ int ovis_scheduler_loop(ovis_scheduler_t m, int return_on_empty)
 		goto out;
 
 loop:
-	timeout = ovis_event_heap_process(m);
+	ovis_event_heap_process(m);
 	pthread_mutex_lock(&m->mutex);
 	if (!m->evcount && return_on_empty) {
 		pthread_mutex_unlock(&m->mutex);
@@ -666,7 +793,7 @@ loop:
 	}
 	pthread_mutex_unlock(&m->mutex);
 
-	cnt = epoll_wait(m->efd, m->ev, MAX_EPOLL_EVENTS, timeout);
+	cnt = epoll_wait(m->efd, m->ev, MAX_EPOLL_EVENTS, -1);
 	if (cnt < 0) {
 		if (errno == EINTR)
 			goto loop;
@@ -110,7 +110,18 @@
  * micro-seconds) and a phase (a time shift in microseconds), and the ovis
  * scheduler will try to wake up periodically at \c period*n+phase. The periodic
  * event might have a slight wake up time slack, but it does not have
- * continuously time shifting like the timeout event.
+ * continuously time shifting like the timeout event. Periods shorter than a
+ * microsecond can be given in nanoseconds with \c period_ns and \c phase_ns.
+ *
+ * Timer and periodic events are driven by a \c timerfd(2) armed with an
+ * absolute \c CLOCK_REALTIME deadline, so the wake up has nanosecond
+ * resolution. All events that are due at a wake up are dispatched in one
+ * batch. The scheduler records the wake up jitter (dispatch time minus
+ * scheduled time) of every timer and periodic event in a log2 histogram,
+ * see ::ovis_event_jitter_get().
+ *
+ * ::ovis_scheduler_affinity_set() pins the thread running the scheduler loop
+ * to a set of CPUs.
  *
  *
  * \section example EXAMPLE
@@ -202,8 +213,28 @@ typedef struct ovis_scheduler_s *ovis_scheduler_t;
 typedef struct ovis_periodic_s {
 	uint64_t period_us; /* period in microseconds */
 	uint64_t phase_us; /* phase in microseconds */
+	uint64_t period_ns; /* period in nanoseconds; overrides period_us if not 0 */
+	uint64_t phase_ns; /* phase in nanoseconds; used with period_ns */
 } *ovis_periodic_t;
 
+#define OVIS_EVENT_JITTER_BINS 32
+
+/**
+ * Wake up jitter statistics of a timer or periodic event.
+ *
+ * The jitter is the time the callback is dispatched minus the time the event
+ * was scheduled for. \c hist[i] counts the wake ups with a jitter in
+ * [2^i, 2^(i+1)) nanoseconds (\c hist[0] also counts 0 ns). The last bin
+ * counts everything above.
+ */
+typedef struct ovis_event_jitter_s {
+	uint64_t count;
+	uint64_t min_ns;
+	uint64_t max_ns;
+	uint64_t sum_ns;
+	uint64_t hist[OVIS_EVENT_JITTER_BINS];
+} *ovis_event_jitter_t;
+
 typedef union ovis_event_time_param_u {
 	struct timeval timeout;
 	struct ovis_periodic_s periodic;
@@ -248,8 +279,9 @@ struct ovis_event_s {
 
 	/* private data for ovis_scheduler */
 	struct {
-		struct timeval tv;
+		uint64_t ts; /* next wake up time (ns since the Epoch) */
 		int idx;
+		struct ovis_event_jitter_s jitter;
 	} priv; /* private data for ovis_scheduler */
 };
 
@@ -342,6 +374,35 @@ int ovis_scheduler_event_del(ovis_scheduler_t m, ovis_event_t ev);
 int ovis_scheduler_epoll_event_mod(ovis_scheduler_t s, ovis_event_t ev,
 				   int epoll_events);
 
+/**
+ * Copy the wake up jitter statistics of the event \p ev into \p j.
+ *
+ * The statistics are updated by the scheduler thread without locking. The
+ * copy is a snapshot that may be off by the wake up in progress.
+ */
+void ovis_event_jitter_get(ovis_event_t ev, struct ovis_event_jitter_s *j);
+
+/**
+ * Clear the wake up jitter statistics of the event \p ev.
+ */
+void ovis_event_jitter_reset(ovis_event_t ev);
+
+/**
+ * Pin the thread running the scheduler loop to the given CPUs.
+ *
+ * If the loop is already running, the thread is pinned immediately.
+ * Otherwise, the thread calling ::ovis_scheduler_loop() pins itself when the
+ * loop starts.
+ *
+ * \param s the scheduler handle.
+ * \param cpus the array of CPU numbers.
+ * \param ncpus the number of entries in \p cpus. 0 leaves the affinity as is.
+ *
+ * \retval 0 if OK.
+ * \retval errno if error.
+ */
+int ovis_scheduler_affinity_set(ovis_scheduler_t s, const int *cpus, int ncpus);
+
 /**
  * Free memory allocated from ::ovis_event_create().
  *
@@ -55,6 +55,12 @@
 #include <stddef.h>
 
 #define MAX_EPOLL_EVENTS 128
+#define OVIS_EVENT_BATCH_MAX 128
+
+struct ovis_event_batch_ent {
+	ovis_event_t ev;
+	uint64_t ts; /* the scheduled time of this wake up */
+};
 
 struct ovis_event_heap {
 	uint32_t alloc_len;
@@ -67,7 +73,16 @@ struct ovis_scheduler_s {
 	int refcount;
 	int efd; /* epoll fd */
 	int pfd[2]; /* pipe for event notification */
+	int tfd; /* timerfd armed for the heap top */
+	uint64_t tfd_ts; /* the time tfd is armed for, 0 if disarmed */
 	struct ovis_event_s ovis_ev;
+	struct ovis_event_s timer_ev;
+	/* the timer events being dispatched */
+	struct ovis_event_batch_ent batch[OVIS_EVENT_BATCH_MAX];
+	int batch_len;
+	pthread_t thread; /* the thread running the loop */
+	int *cpus; /* CPU affinity of the loop thread */
+	int ncpus;
 	struct epoll_event ev[MAX_EPOLL_EVENTS];
 	pthread_mutex_t mutex;
 	struct ovis_event_heap *heap;
@@ -13,3 +13,12 @@ eslowdown=$(echo "scale=2;$je/$st" |bc)
 bslowdown=$(echo "scale=2;$jb/$st" |bc)
 echo elements/sprintf duration ratio is $eslowdown
 echo bulkfmt/sprintf duration ratio is $bslowdown
+for m in darshan slurm netlink batch; do
+	yy=$(grep " $m .*json_parse_buffer_yy time" $tmp |sed -e 's/.* //g')
+	jp=$(grep " $m .*json_parse_buffer time" $tmp |sed -e 's/.* //g')
+	if test -z "$yy" -o -z "$jp"; then
+		echo "ERROR: no $m parse times"
+		exit 1
+	fi
+	echo $m flex-bison/json_parse_buffer duration ratio is $(echo "scale=2;$yy/$jp" |bc)
+done
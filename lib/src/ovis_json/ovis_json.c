@@ -3,6 +3,7 @@
 #include <assert.h>
 #include <errno.h>
 #include "ovis_json.h"
+#include "ovis_json_priv.h"
 
 #define JSON_BUF_START_LEN 8192
 
@@ -63,7 +64,7 @@ jbuf_t jbuf_append_va(jbuf_t jb, const char *fmt, va_list _ap)
 	va_end(ap);
 	if (cnt >= space) {
 		space = jb->buf_len + cnt + JSON_BUF_START_LEN;
-		jb = realloc(jb, space);
+		jb = realloc(jb, sizeof(*jb) + space);
 		if (jb) {
 			jb->buf_len = space;
 			goto retry;
@@ -95,42 +96,206 @@ jbuf_t jbuf_append_attr(jbuf_t jb, const char *name, const char *fmt, ...)
 	return jb;
 }
 
+static inline int __name_cmp(const char *name, size_t len, json_str_t s)
+{
+	size_t n = len < s->str_len ? len : s->str_len;
+	int rc = memcmp(name, s->str, n);
+	if (rc)
+		return rc;
+	return (len > s->str_len) - (len < s->str_len);
+}
+
+static inline uint32_t __name_hash(const char *name, size_t len)
+{
+	uint32_t h = 2166136261u;	/* FNV-1a */
+	while (len--) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static inline void *__dict_alloc(json_dict_t d, size_t size)
+{
+	if (d->arena)
+		return json_arena_alloc(d->arena, size);
+	return malloc(size);
+}
+
+static inline void __dict_release(json_dict_t d, void *p)
+{
+	if (!d->arena)
+		free(p);
+}
+
+/* Returns the slot holding \c name or the empty slot where it would go */
+static inline json_attr_t *__dict_hash_slot(json_dict_t d, const char *name,
+					    size_t len)
+{
+	uint32_t i = __name_hash(name, len) & d->hash_mask;
+	json_attr_t a;
+	while ((a = d->attr_hash[i])) {
+		if (0 == __name_cmp(name, len, a->name->value.str_))
+			break;
+		i = (i + 1) & d->hash_mask;
+	}
+	return &d->attr_hash[i];
+}
+
+/*
+ * Returns the attribute named \c name or NULL. For a small dictionary,
+ * \c pos is set to the position at which the name is or would be.
+ */
+static json_attr_t __dict_lookup(json_dict_t d, const char *name, size_t len,
+				 int *pos)
+{
+	int lo, hi, mid, rc;
+
+	if (d->attr_hash)
+		return *__dict_hash_slot(d, name, len);
+	lo = 0;
+	hi = d->attr_count - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		rc = __name_cmp(name, len, d->attr_vec[mid]->name->value.str_);
+		if (!rc) {
+			*pos = mid;
+			return d->attr_vec[mid];
+		}
+		if (rc < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	*pos = lo;
+	return NULL;
+}
+
+static inline void __dict_hash_ins(json_dict_t d, json_attr_t a)
+{
+	json_str_t n = a->name->value.str_;
+	*__dict_hash_slot(d, n->str, n->str_len) = a;
+}
+
+/* Size the hash table for at least \c count attributes and fill it */
+static int __dict_hash_build(json_dict_t d, int count)
+{
+	uint32_t size = 2 * JSON_DICT_SMALL;
+	json_attr_t *h;
+	int i;
+
+	while (size < 2 * (uint32_t)count)
+		size <<= 1;
+	if (!d->attr_hash || size != d->hash_mask + 1) {
+		h = __dict_alloc(d, size * sizeof(*h));
+		if (!h)
+			return ENOMEM;
+		if (d->attr_hash)
+			__dict_release(d, d->attr_hash);
+		d->attr_hash = h;
+		d->hash_mask = size - 1;
+	}
+	memset(d->attr_hash, 0, size * sizeof(*h));
+	for (i = 0; i < d->attr_count; i++)
+		__dict_hash_ins(d, d->attr_vec[i]);
+	return 0;
+}
+
+int json_dict_index(json_dict_t d)
+{
+	json_attr_t a, *v = d->attr_vec;
+	json_attr_t *slot;
+	int i, j, count;
+
+	if (d->attr_count <= JSON_DICT_SMALL) {
+		/* Stable insertion sort; the last of equal names is kept */
+		for (i = 1; i < d->attr_count; i++) {
+			a = v[i];
+			for (j = i; j > 0 && __name_cmp(a->name->value.str_->str,
+						a->name->value.str_->str_len,
+						v[j-1]->name->value.str_) < 0; j--)
+				v[j] = v[j-1];
+			v[j] = a;
+		}
+		for (i = j = 0; i < d->attr_count; i++) {
+			if (i + 1 < d->attr_count &&
+			    0 == __name_cmp(v[i]->name->value.str_->str,
+					    v[i]->name->value.str_->str_len,
+					    v[i+1]->name->value.str_))
+				continue;
+			v[j] = v[i];
+			v[j]->dict = d;
+			v[j]->idx = j;
+			j++;
+		}
+		d->attr_count = j;
+		return 0;
+	}
+	count = d->attr_count;
+	d->attr_count = 0;
+	if (__dict_hash_build(d, count))
+		return ENOMEM;
+	for (i = j = 0; i < count; i++) {
+		a = v[i];
+		a->dict = d;
+		slot = __dict_hash_slot(d, a->name->value.str_->str,
+					a->name->value.str_->str_len);
+		if (*slot) {
+			/* As json_attr_add(), the later one goes to the end */
+			v[(*slot)->idx] = NULL;
+			j++;
+		}
+		a->idx = i;
+		*slot = a;
+	}
+	if (!j)
+		return 0;
+	for (i = j = 0; i < count; i++) {
+		if (!v[i])
+			continue;
+		v[j] = v[i];
+		v[j]->idx = j;
+		j++;
+	}
+	d->attr_count = j;
+	return 0;
+}
+
 json_entity_t json_attr_first(json_entity_t d)
 {
-	hent_t ent;
+	json_dict_t dict;
 	assert(d->type == JSON_DICT_VALUE);
-	ent = htbl_first(d->value.dict_->attr_table);
-	if (!ent)
+	dict = d->value.dict_;
+	if (!dict->attr_count)
 		return NULL;
-	json_attr_t a = container_of(ent, struct json_attr_s, attr_ent);
-	return &a->base;
+	return &dict->attr_vec[0]->base;
 }
 
 json_entity_t json_attr_next(json_entity_t a)
 {
-	hent_t ent;
-	json_attr_t next;
+	json_dict_t d;
+	int i;
 	assert(a->type == JSON_ATTR_VALUE);
-	ent = htbl_next(&a->value.attr_->attr_ent);
-	if (ent) {
-		next = container_of(ent, struct json_attr_s, attr_ent);
-		return &next->base;
-	}
+	d = a->value.attr_->dict;
+	if (!d)
+		return NULL;
+	i = a->value.attr_->idx + 1;
+	if (i < d->attr_count)
+		return &d->attr_vec[i]->base;
 	return NULL;
 }
 
 json_entity_t json_attr_find(json_entity_t d, const char *name)
 {
-	hent_t ent;
 	json_attr_t a;
+	int pos;
 	assert (d->type == JSON_DICT_VALUE);
-	ent = htbl_find(d->value.dict_->attr_table, name, strlen(name));
-	if (ent) {
+	a = __dict_lookup(d->value.dict_, name, strlen(name), &pos);
+	if (a) {
 #ifdef JDEBUG
 		fprintf(stderr, "json found attr %s while searching for %s\n",
-			(char *)ent->key, name);
+			a->name->value.str_->str, name);
 #endif
-		a = container_of(ent, struct json_attr_s, attr_ent);
 		return &a->base;
 	}
 	return NULL;
@@ -140,31 +305,15 @@ int json_attr_count(json_entity_t d)
 {
 	assert(d->type == JSON_DICT_VALUE);
 	json_dict_t dict = (json_dict_t)d;
-	return dict->attr_table->entry_count;
-}
-
-int attr_cmp(const void *a, const void *b, size_t key_len)
-{
-#ifdef JDEBUG
-	fprintf(stderr, "attr_cmp( %s, %s, %zu)\n",
-		(char *)a, (char *)b, key_len);
-#endif
-	return strncmp(a, b, key_len);
+	return dict->attr_count;
 }
 
-#define JSON_HTBL_DEPTH	23
-
 static json_entity_t json_dict_new(void)
 {
-	json_dict_t d = malloc(sizeof *d);
+	json_dict_t d = calloc(1, sizeof *d);
 	if (d) {
 		d->base.type = JSON_DICT_VALUE;
 		d->base.value.dict_ = d;
-		d->attr_table = htbl_alloc(attr_cmp, JSON_HTBL_DEPTH);
-		if (!d->attr_table) {
-			free(d);
-			return NULL;
-		}
 		return &d->base;
 	}
 	return NULL;
@@ -175,6 +324,7 @@ static json_entity_t json_str_new(const char *s)
 	json_str_t str = malloc(sizeof *str);
 	if (str) {
 		str->base.type = JSON_STRING_VALUE;
+		str->base.flags = 0;
 		str->base.value.str_ = str;
 		str->str = strdup(s);
 		if (!str->str) {
@@ -192,7 +342,9 @@ static json_entity_t json_list_new(void)
 	json_list_t a = malloc(sizeof *a);
 	if (a) {
 		a->base.type = JSON_LIST_VALUE;
+		a->base.flags = 0;
 		a->base.value.list_ = a;
+		a->arena = NULL;
 		a->item_count = 0;
 		TAILQ_INIT(&a->item_list);
 		return &a->base;
@@ -203,6 +355,8 @@ static json_entity_t json_list_new(void)
 void json_item_add(json_entity_t a, json_entity_t e)
 {
 	assert(a->type == JSON_LIST_VALUE);
+	if (a->value.list_->arena && !(e->flags & JSON_F_ARENA))
+		a->value.list_->arena->foreign = 1;
 	a->value.list_->item_count++;
 	TAILQ_INSERT_TAIL(&a->value.list_->item_list, e, item_entry);
 }
@@ -261,9 +415,12 @@ static json_entity_t json_attr_new(const char *name, json_entity_t value)
 	json_attr_t a = malloc(sizeof *a);
 	if (a) {
 		a->base.type = JSON_ATTR_VALUE;
+		a->base.flags = 0;
 		a->base.value.attr_ = a;
 		a->name = s;
 		a->value = value;
+		a->dict = NULL;
+		a->idx = 0;
 		return &a->base;
 	}
 	json_entity_free(s);
@@ -285,6 +442,7 @@ json_entity_t json_entity_new(enum json_value_e type, ...)
 		if (!e)
 			goto out;
 		e->type = type;
+		e->flags = 0;
 		i = va_arg(ap, uint64_t);
 		e->value.int_ = i;
 		break;
@@ -293,6 +451,7 @@ json_entity_t json_entity_new(enum json_value_e type, ...)
 		if (!e)
 			goto out;
 		e->type = type;
+		e->flags = 0;
 		i = va_arg(ap, int);
 		e->value.bool_ = i;
 		break;
@@ -301,6 +460,7 @@ json_entity_t json_entity_new(enum json_value_e type, ...)
 		if (!e)
 			goto out;
 		e->type = type;
+		e->flags = 0;
 		d = va_arg(ap, double);
 		e->value.double_ = d;
 		break;
@@ -324,6 +484,7 @@ json_entity_t json_entity_new(enum json_value_e type, ...)
 		if (!e)
 			goto out;
 		e->type = type;
+		e->flags = 0;
 		e->value.int_ = 0;
 		break;
 	default:
@@ -344,7 +505,7 @@ static jbuf_t __list_dump(jbuf_t jb, json_entity_t e)
 	for (i = json_item_first(e); i; i = json_item_next(i)) {
 		if (count)
 			jb = jbuf_append_str(jb, ",");
-		__entity_dump(jb, i);
+		jb = __entity_dump(jb, i);
 		count++;
 	}
 	jb = jbuf_append_str(jb, "]");
@@ -391,10 +552,10 @@ static jbuf_t __entity_dump(jbuf_t jb, json_entity_t e)
 		jb = __entity_dump(jb, e->value.attr_->value);
 		break;
 	case JSON_LIST_VALUE:
-		__list_dump(jb, e);
+		jb = __list_dump(jb, e);
 		break;
 	case JSON_DICT_VALUE:
-		__dict_dump(jb, e);
+		jb = __dict_dump(jb, e);
 		break;
 	case JSON_NULL_VALUE:
 		jb = jbuf_append_str(jb, "null");
@@ -496,29 +657,86 @@ json_entity_t json_entity_copy(json_entity_t e)
 	return new;
 }
 
+static void __attr_unlink(json_dict_t dict, json_attr_t attr)
+{
+	int i;
+
+	for (i = attr->idx + 1; i < dict->attr_count; i++) {
+		dict->attr_vec[i-1] = dict->attr_vec[i];
+		dict->attr_vec[i-1]->idx = i - 1;
+	}
+	dict->attr_count--;
+	if (dict->attr_hash)
+		__dict_hash_build(dict, dict->attr_count);
+	attr->dict = NULL;
+}
+
 static void json_attr_free(json_attr_t a);
-static inline void __attr_rem(json_entity_t d, json_entity_t a)
+static void __attr_rem(json_entity_t d, json_entity_t a)
 {
-	htbl_del(d->value.dict_->attr_table, &a->value.attr_->attr_ent);
-	json_attr_free(a->value.attr_);
+	json_attr_t attr = a->value.attr_;
+
+	__attr_unlink(d->value.dict_, attr);
+	if (!(a->flags & JSON_F_ARENA)) {
+		json_attr_free(attr);
+	} else if (attr->value && !(attr->value->flags & JSON_F_ARENA)) {
+		json_entity_free(attr->value);
+		attr->value = NULL;
+	}
 }
 
-void __attr_add(json_entity_t d, json_entity_t a)
+int __attr_add(json_entity_t d, json_entity_t a)
 {
+	json_dict_t dict = d->value.dict_;
+	json_attr_t attr = a->value.attr_;
+	json_attr_t *vec;
 	json_str_t name;
-	json_entity_t a_;
+	json_attr_t a_;
+	int i, pos, max;
 
 	name = json_attr_name(a);
-	a_ = json_attr_find(d, name->str);
+	a_ = __dict_lookup(dict, name->str, name->str_len, &pos);
 	if (a_) {
 #ifdef JDEBUG
 		fprintf(stderr, "json removing entry %s for %s\n",
-			json_attr_name(a_)->str, name->str);
+			a_->name->value.str_->str, name->str);
 #endif
-		__attr_rem(d, a_);
+		__attr_rem(d, &a_->base);
 	}
-	hent_init(&a->value.attr_->attr_ent, name->str, name->str_len);
-	htbl_ins(d->value.dict_->attr_table, &a->value.attr_->attr_ent);
+	if (dict->attr_count == dict->attr_max) {
+		max = dict->attr_max ? 2 * dict->attr_max : 8;
+		vec = __dict_alloc(dict, max * sizeof(*vec));
+		if (!vec)
+			return ENOMEM;
+		if (dict->attr_count)
+			memcpy(vec, dict->attr_vec, dict->attr_count * sizeof(*vec));
+		__dict_release(dict, dict->attr_vec);
+		dict->attr_vec = vec;
+		dict->attr_max = max;
+	}
+	if (!dict->attr_hash && dict->attr_count < JSON_DICT_SMALL) {
+		for (i = dict->attr_count; i > pos; i--) {
+			dict->attr_vec[i] = dict->attr_vec[i-1];
+			dict->attr_vec[i]->idx = i;
+		}
+	} else {
+		pos = dict->attr_count;
+	}
+	dict->attr_vec[pos] = attr;
+	attr->dict = dict;
+	attr->idx = pos;
+	dict->attr_count++;
+	if (dict->attr_hash && 2 * dict->attr_count <= dict->hash_mask + 1) {
+		__dict_hash_ins(dict, attr);
+	} else if (dict->attr_count > JSON_DICT_SMALL) {
+		if (__dict_hash_build(dict, dict->attr_count)) {
+			__attr_unlink(dict, attr);
+			return ENOMEM;
+		}
+	}
+	if (dict->arena && !(a->flags & JSON_F_ARENA))
+		dict->arena->foreign = 1;
+	return 0;
 }
 
 int json_attr_add(json_entity_t d, const char *name, json_entity_t v)
@@ -528,7 +746,11 @@ int json_attr_add(json_entity_t d, const char *name, json_entity_t v)
 	a = json_attr_new(name, v);
 	if (!a)
 		return ENOMEM;
-	__attr_add(d, a);
+	if (__attr_add(d, a)) {
+		a->value.attr_->value = NULL;
+		json_entity_free(a);
+		return ENOMEM;
+	}
 	return 0;
 }
 
@@ -541,7 +763,10 @@ int json_dict_merge(json_entity_t dst, json_entity_t src)
 		b = json_entity_copy(a);
 		if (!b)
 			return ENOMEM;
-		__attr_add(dst, b);
+		if (__attr_add(dst, b)) {
+			json_entity_free(b);
+			return ENOMEM;
+		}
 	}
 	return 0;
 }
@@ -593,27 +818,115 @@ static void json_attr_free(json_attr_t a)
 
 static void json_dict_free(json_dict_t d)
 {
-	json_attr_t i;
-	hent_t ent;
-	htbl_t t;
+	int i;
 	if (!d)
 		return;
-
-	t = d->attr_table;
-	while (!htbl_empty(t)) {
-		ent = htbl_first(t);
-		htbl_del(t, ent);
-		i = container_of(ent, struct json_attr_s, attr_ent);
-		json_attr_free(i);
+	for (i = 0; i < d->attr_count; i++) {
+		d->attr_vec[i]->dict = NULL;
+		json_entity_free(&d->attr_vec[i]->base);
 	}
-	htbl_free(t);
+	free(d->attr_vec);
+	free(d->attr_hash);
 	free(d);
 }
 
+/* Free the heap entities that were added to a document */
+static void __arena_release(json_entity_t e)
+{
+	json_entity_t i, next, v;
+	json_dict_t d;
+	int j;
+
+	switch (e->type) {
+	case JSON_LIST_VALUE:
+		for (i = json_item_first(e); i; i = next) {
+			next = json_item_next(i);
+			if (i->flags & JSON_F_ARENA)
+				__arena_release(i);
+			else
+				json_entity_free(i);
+		}
+		break;
+	case JSON_DICT_VALUE:
+		d = e->value.dict_;
+		for (j = 0; j < d->attr_count; j++) {
+			if (!(d->attr_vec[j]->base.flags & JSON_F_ARENA)) {
+				json_entity_free(&d->attr_vec[j]->base);
+				continue;
+			}
+			v = d->attr_vec[j]->value;
+			if (v->flags & JSON_F_ARENA)
+				__arena_release(v);
+			else
+				json_entity_free(v);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+struct json_doc_s *json_doc_new(size_t size)
+{
+	struct json_arena_chunk_s *c;
+	struct json_doc_s *doc;
+
+	size += sizeof(*doc);
+	if (size < JSON_ARENA_MIN)
+		size = JSON_ARENA_MIN;
+	c = malloc(sizeof(*c) + size);
+	if (!c)
+		return NULL;
+	c->next = NULL;
+	c->size = size;
+	c->used = 0;
+	doc = (void *)c->data;
+	doc->arena.chunk = c;
+	doc->arena.foreign = 0;
+	(void)json_arena_alloc(&doc->arena, sizeof(*doc));
+	return doc;
+}
+
+void *json_arena_grow(struct json_arena_s *arena, size_t size)
+{
+	struct json_arena_chunk_s *c;
+	size_t csize = 2 * arena->chunk->size;
+
+	if (csize < size)
+		csize = size;
+	c = malloc(sizeof(*c) + csize);
+	if (!c)
+		return NULL;
+	c->next = arena->chunk;
+	c->size = csize;
+	c->used = size;
+	arena->chunk = c;
+	return c->data;
+}
+
+void json_doc_free(struct json_doc_s *doc)
+{
+	struct json_arena_chunk_s *c, *next;
+
+	if (doc->arena.foreign)
+		__arena_release(&doc->root.entity);
+	/* The first chunk, which holds doc, is the last in the chain */
+	for (c = doc->arena.chunk; c; c = next) {
+		next = c->next;
+		free(c);
+	}
+}
+
 void json_entity_free(json_entity_t e)
 {
 	if (!e)
 		return;
+	if (e->flags & JSON_F_ARENA) {
+		if (e->flags & JSON_F_ROOT)
+			json_doc_free(container_of(e, struct json_doc_s,
+						   root.entity));
+		return;
+	}
 	switch (e->type) {
 	case JSON_INT_VALUE:
 		free(e);
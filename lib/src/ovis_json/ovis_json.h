@@ -71,8 +71,22 @@ enum json_value_e {
 	JSON_NULL_VALUE
 };
 
+/*
+ * The entities of a document returned by json_parse_buffer() are
+ * allocated from an arena that is released when the root entity is
+ * freed. json_entity_free() of any other entity of the document does
+ * nothing, so an entity removed from a parsed document remains valid
+ * only until the document is freed; use json_entity_copy() to keep it
+ * longer. Heap entities added to a parsed document are freed with it.
+ */
+#define JSON_F_ARENA	0x1	/* allocated from a document arena */
+#define JSON_F_ROOT	0x2	/* the root of a document arena */
+
+struct json_arena_s;
+
 struct json_entity_s {
 	enum json_value_e type;
+	int flags;
 	union {
 		int bool_;
 		int64_t int_;
@@ -93,6 +107,7 @@ struct json_str_s {
 
 struct json_list_s {
 	struct json_entity_s base;
+	struct json_arena_s *arena;	/* the document arena, or NULL */
 	int item_count;
 	TAILQ_HEAD(json_item_list, json_entity_s) item_list;
 };
@@ -101,12 +116,25 @@ struct json_attr_s {
 	struct json_entity_s base;
 	json_entity_t name;
 	json_entity_t value;
-	struct hent attr_ent;
+	json_dict_t dict;	/* the dictionary holding the attribute */
+	int idx;		/* the position in dict->attr_vec */
 };
 
+/*
+ * Dictionaries of up to JSON_DICT_SMALL attributes keep them in an array
+ * sorted by name. Larger ones append to the array and index it with an
+ * open addressing hash table.
+ */
+#define JSON_DICT_SMALL	16
+
 struct json_dict_s {
 	struct json_entity_s base;
-	htbl_t attr_table;
+	struct json_arena_s *arena;	/* the document arena, or NULL */
+	int attr_count;
+	int attr_max;
+	json_attr_t *attr_vec;
+	json_attr_t *attr_hash;		/* NULL while the dict is small */
+	uint32_t hash_mask;
 };
 
 struct json_loc_s {
@@ -121,6 +149,11 @@ typedef void *yyscan_t;
 typedef struct json_parser_s {
 	yyscan_t scanner;
 	struct yy_buffer_state *buffer_state;
+	/* Structural index and attribute stack of json_parse_buffer() */
+	uint32_t *index;
+	size_t index_max;
+	json_attr_t *attr_stack;
+	size_t attr_stack_max;
 } *json_parser_t;
 
 typedef struct jbuf_s {
@@ -136,8 +169,31 @@ extern void json_entity_free(json_entity_t e);
 extern const char *json_type_name(enum json_value_e type);
 extern enum json_value_e json_entity_type(json_entity_t e);
 
+/**
+ * \brief Parse a JSON document
+ *
+ * The structure of the document is found with a vectorized scan and the
+ * entities are allocated from a single arena. Input that this parser
+ * does not handle, including malformed input, is passed to the flex/bison
+ * parser, json_parse_buffer_yy(), so the accepted syntax and the errors
+ * are the same.
+ *
+ * \param p	The parser
+ * \param buf	The document
+ * \param buf_len The length of \c buf, which need not be NUL-terminated
+ * \param e	Set to the root entity, freed with json_entity_free()
+ *
+ * \return 0 on success or an error code.
+ */
 extern int json_parse_buffer(json_parser_t p, char *buf, size_t buf_len, json_entity_t *e);
 
+/**
+ * \brief Parse a JSON document with the flex/bison parser
+ *
+ * Each entity of the document is allocated separately.
+ */
+extern int json_parse_buffer_yy(json_parser_t p, char *buf, size_t buf_len, json_entity_t *e);
+
 extern json_entity_t json_entity_new(enum json_value_e type, ...);
 
 /**
@@ -147,6 +147,8 @@ void json_parser_free(json_parser_t parser)
 	if (!parser)
 		return;
 	yylex_destroy(parser->scanner);
+	free(parser->index);
+	free(parser->attr_stack);
 	free(parser);
 }
 
@@ -204,6 +204,81 @@ double ldmsd_timeval_diff(struct timeval *start, struct timeval *end)
         return (end->tv_sec-start->tv_sec)*1000000.0 + (end->tv_usec-start->tv_usec);
 }
 
+/* Messages shaped like those of slurm_notifier and netlink-notifier */
+static char slurm_msg[] =
+	"{\"schema\":\"slurm_step_data\",\"event\":\"step_init\","
+	"\"timestamp\":1679432311,\"context\":\"nid00042(slurmstepd),4242,0\","
+	"\"data\":{\"subscriber_data\":{\"tag\":\"weather\",\"ver\":2},"
+	"\"job_name\":\"wrf_ensemble_12\",\"job_user\":\"someuser\","
+	"\"job_id\":4242,\"nodeid\":3,\"step_id\":0,\"alloc_mb\":190000,"
+	"\"ncpus\":128,\"nnodes\":16,\"local_tasks\":64,\"total_tasks\":1024 }}";
+
+static char netlink_msg[] =
+	"{\"msgno\":81723,\"schema\":\"linux_task_data\","
+	"\"event\":\"task_init_priv\",\"timestamp\":1679432311,"
+	"\"context\":\"*\",\"data\":{\"ProducerName\":\"nid00042\","
+	"\"component_id\":42,\"start\":\"1679432311.123456\","
+	"\"start_tick\":\"81237612\",\"job_id\":\"4242\",\"serial\":912,"
+	"\"os_pid\":171717,\"uid\":12345,\"gid\":12345,\"task_pid\":171717,"
+	"\"task_global_id\":-1,\"is_thread\":0,"
+	"\"exe\":\"/projects/app/bin/wrf.exe\"}}";
+
+typedef int (*parse_fn_t)(json_parser_t p, char *buf, size_t buf_len,
+			  json_entity_t *e);
+
+/* Returns the time in microseconds to parse and free msg count times */
+double parse_time(json_parser_t p, parse_fn_t parse, char *msg, int count)
+{
+	struct timeval tv1, tv2;
+	json_entity_t e;
+	size_t len = strlen(msg);
+	int i;
+
+	gettimeofday(&tv1, NULL);
+	for (i = 0; i < count; i++) {
+		if (parse(p, msg, len, &e))
+			return -1;
+		json_entity_free(e);
+	}
+	gettimeofday(&tv2, NULL);
+	return ldmsd_timeval_diff(&tv1, &tv2);
+}
+
+/*
+ * Compare json_parse_buffer() to the flex/bison parser. Both must build
+ * the same entities.
+ */
+int parse_compare(json_parser_t p, const char *name, char *msg, int count)
+{
+	json_entity_t e1, e2;
+	jbuf_t jb1, jb2;
+	int rc;
+
+	if (json_parse_buffer_yy(p, msg, strlen(msg), &e1) ||
+	    json_parse_buffer(p, msg, strlen(msg), &e2)) {
+		printf("%s: parse error\n", name);
+		return 1;
+	}
+	jb1 = json_entity_dump(NULL, e1);
+	jb2 = json_entity_dump(NULL, e2);
+	rc = (!jb1 || !jb2 || strcmp(jb1->buf, jb2->buf));
+	if (rc)
+		printf("%s: the parsers disagree\n", name);
+	else if (!(e2->flags & JSON_F_ARENA))
+		printf("%s: json_parse_buffer used the flex/bison parser\n", name);
+	jbuf_free(jb1);
+	jbuf_free(jb2);
+	json_entity_free(e1);
+	json_entity_free(e2);
+	if (rc)
+		return rc;
+	printf("%d %s %zu bytes json_parse_buffer_yy time us %g\n", count, name,
+	       strlen(msg), parse_time(p, json_parse_buffer_yy, msg, count));
+	printf("%d %s %zu bytes json_parse_buffer time us %g\n", count, name,
+	       strlen(msg), parse_time(p, json_parse_buffer, msg, count));
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	if (argc < 2) {
@@ -259,5 +334,28 @@ int main(int argc, char *argv[])
 	printf("%d sprintf time us %g\n",count, ldmsd_timeval_diff(&tv1, &tv2));
 	printf("%d jbuf elements time us    %g\n",count, ldmsd_timeval_diff(&tv2, &tv3));
 	printf("%d jbuf fmt time us    %g\n",count, ldmsd_timeval_diff(&tv3, &tv4));
-	return 0;
+
+	json_parser_t p = json_parser_new(0);
+	if (!p)
+		return 1;
+	int rc = parse_compare(p, "darshan", buf, count);
+	rc |= parse_compare(p, "slurm", slurm_msg, count);
+	rc |= parse_compare(p, "netlink", netlink_msg, count);
+	/* A batch of darshan records in one message */
+	jb = jbuf_new();
+	if (jb)
+		jb = jbuf_append_str(jb, "{\"schema\":\"darshan_batch\",\"records\":[");
+	for (i = 0; jb && i < 64; i++) {
+		make_string_sprintf(1, buf,
+			record_count + i, rwo, offset, length, max_byte, rw_switch, flushes, start_time, end_time, tspec_start, tspec_end, total_time, mod_name, data_type);
+		jb = jbuf_append_str(jb, "%s%s", i ? "," : "", buf);
+	}
+	if (jb)
+		jb = jbuf_append_str(jb, "]}");
+	if (!jb)
+		return 1;
+	rc |= parse_compare(p, "batch", jb->buf, count / 64 + 1);
+	jbuf_free(jb);
+	json_parser_free(p);
+	return rc;
 }
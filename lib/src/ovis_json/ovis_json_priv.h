@@ -0,0 +1,59 @@
+#ifndef _OVIS_JSON_PRIV_H_
+#define _OVIS_JSON_PRIV_H_
+#include "ovis_json.h"
+
+/*
+ * Document arena
+ *
+ * A parsed document is a chain of chunks. The first chunk begins with the
+ * json_doc_s holding the arena and the root entity, so freeing the root
+ * releases the document with one free() per chunk.
+ */
+#define JSON_ARENA_ALIGN	8
+#define JSON_ARENA_MIN		4096
+
+struct json_arena_chunk_s {
+	struct json_arena_chunk_s *next;
+	size_t size;
+	size_t used;
+	char data[] __attribute__((aligned(JSON_ARENA_ALIGN)));
+};
+
+struct json_arena_s {
+	struct json_arena_chunk_s *chunk;	/* current chunk, head of the chain */
+	int foreign;	/* heap entities were added to the document */
+};
+
+struct json_doc_s {
+	struct json_arena_s arena;
+	union {
+		struct json_entity_s entity;
+		struct json_str_s str;
+		struct json_list_s list;
+		struct json_dict_s dict;
+	} root;
+};
+
+struct json_doc_s *json_doc_new(size_t size);
+void json_doc_free(struct json_doc_s *doc);
+void *json_arena_grow(struct json_arena_s *arena, size_t size);
+
+static inline void *json_arena_alloc(struct json_arena_s *arena, size_t size)
+{
+	struct json_arena_chunk_s *c = arena->chunk;
+	void *p;
+	size = (size + JSON_ARENA_ALIGN - 1) & ~(size_t)(JSON_ARENA_ALIGN - 1);
+	if (size > c->size - c->used)
+		return json_arena_grow(arena, size);
+	p = &c->data[c->used];
+	c->used += size;
+	return p;
+}
+
+/*
+ * Index the attr_count attributes in d->attr_vec, given in document
+ * order. A later attribute replaces an earlier one of the same name.
+ */
+int json_dict_index(json_dict_t d);
+
+#endif
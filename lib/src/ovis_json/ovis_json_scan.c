@@ -0,0 +1,623 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2023 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2023 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * json_parse_buffer()
+ *
+ * The document is parsed in two passes. The first classifies the input
+ * 64 bytes at a time (with SSE2 where available) and records the offset
+ * of every structural character, '{', '}', '[', ']', ':' and ',', and of
+ * the first character of every string and scalar outside of strings. The
+ * second walks that index and builds the entities in an arena sized from
+ * the document.
+ *
+ * Strings are kept as they appear in the document, as the flex lexer does.
+ * Anything the second pass does not accept -- single-quoted strings,
+ * characters the lexer would skip, malformed documents -- is parsed again
+ * with json_parse_buffer_yy() so both produce the same result.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "ovis_json.h"
+#include "ovis_json_priv.h"
+
+#define SCAN_RETRY	-1	/* give the document to the flex/bison parser */
+#define SCAN_MAX_DEPTH	512
+#define SCAN_MAX_TOKEN	64
+
+struct scan_s {
+	json_parser_t p;
+	const char *buf;
+	size_t len;
+	const uint32_t *idx;
+	size_t idx_count;
+	size_t k;		/* the next index */
+	size_t attr_top;	/* the top of p->attr_stack */
+	int depth;
+	struct json_arena_s *arena;
+};
+
+/* Character masks of a 64 byte block, bit i for byte i */
+struct block_s {
+	uint64_t quote;
+	uint64_t bslash;
+	uint64_t op;
+	uint64_t ws;
+};
+
+#ifdef __SSE2__
+static inline void __block_classify(const char *s, struct block_s *b)
+{
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i bslash = _mm_set1_epi8('\\');
+	const __m128i lower = _mm_set1_epi8(0x20);
+	const __m128i obrace = _mm_set1_epi8('{');	/* '[' | 0x20 */
+	const __m128i cbrace = _mm_set1_epi8('}');	/* ']' | 0x20 */
+	const __m128i colon = _mm_set1_epi8(':');
+	const __m128i comma = _mm_set1_epi8(',');
+	const __m128i sp = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i nl = _mm_set1_epi8('\n');
+	const __m128i cr = _mm_set1_epi8('\r');
+	__m128i v, l, op, ws;
+	uint64_t m;
+	int i;
+
+	b->quote = b->bslash = b->op = b->ws = 0;
+	for (i = 0; i < 4; i++) {
+		v = _mm_loadu_si128((const __m128i *)(s + 16 * i));
+		l = _mm_or_si128(v, lower);
+		op = _mm_or_si128(_mm_cmpeq_epi8(l, obrace),
+				  _mm_cmpeq_epi8(l, cbrace));
+		op = _mm_or_si128(op, _mm_cmpeq_epi8(v, colon));
+		op = _mm_or_si128(op, _mm_cmpeq_epi8(v, comma));
+		ws = _mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab));
+		ws = _mm_or_si128(ws, _mm_cmpeq_epi8(v, nl));
+		ws = _mm_or_si128(ws, _mm_cmpeq_epi8(v, cr));
+		m = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote));
+		b->quote |= m << (16 * i);
+		m = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, bslash));
+		b->bslash |= m << (16 * i);
+		m = (uint16_t)_mm_movemask_epi8(op);
+		b->op |= m << (16 * i);
+		m = (uint16_t)_mm_movemask_epi8(ws);
+		b->ws |= m << (16 * i);
+	}
+}
+#else
+static inline void __block_classify(const char *s, struct block_s *b)
+{
+	uint64_t bit;
+	int i;
+
+	b->quote = b->bslash = b->op = b->ws = 0;
+	for (i = 0; i < 64; i++) {
+		bit = 1ULL << i;
+		switch (s[i]) {
+		case '"':
+			b->quote |= bit;
+			break;
+		case '\\':
+			b->bslash |= bit;
+			break;
+		case '{': case '}': case '[': case ']': case ':': case ',':
+			b->op |= bit;
+			break;
+		case ' ': case '\t': case '\n': case '\r':
+			b->ws |= bit;
+			break;
+		}
+	}
+}
+#endif
+
+/*
+ * Returns the mask of the characters escaped by a backslash. An odd
+ * length run of backslashes escapes the character that follows it;
+ * *carry is set when that character is in the next block.
+ */
+static inline uint64_t __escaped(uint64_t bslash, uint64_t *carry)
+{
+	const uint64_t even = 0x5555555555555555ULL;
+	uint64_t follows, odd_starts, even_ends;
+
+	bslash &= ~*carry;
+	follows = (bslash << 1) | *carry;
+	odd_starts = bslash & ~even & ~follows;
+	*carry = __builtin_add_overflow(odd_starts, bslash, &even_ends);
+	return (even ^ (even_ends << 1)) & follows;
+}
+
+/* Bit i is set if an odd number of bits 0..i are set */
+static inline uint64_t __prefix_xor(uint64_t m)
+{
+	m ^= m << 1;
+	m ^= m << 2;
+	m ^= m << 4;
+	m ^= m << 8;
+	m ^= m << 16;
+	m ^= m << 32;
+	return m;
+}
+
+static int __index_grow(json_parser_t p, size_t count)
+{
+	size_t max = p->index_max ? p->index_max : 1024;
+	uint32_t *idx;
+
+	while (max < count)
+		max *= 2;
+	idx = realloc(p->index, max * sizeof(*idx));
+	if (!idx)
+		return ENOMEM;
+	p->index = idx;
+	p->index_max = max;
+	return 0;
+}
+
+/* First pass, fills p->index */
+static int __index_build(json_parser_t p, const char *buf, size_t len,
+			 size_t *count)
+{
+	uint64_t esc_carry = 0, in_str_carry = 0, scalar_carry = 0;
+	uint64_t quote, in_str, str_tail, scalar, scalar_nq, structural;
+	struct block_s b;
+	const char *s;
+	char tail[64];
+	size_t off, n = 0;
+	int rc;
+
+	if (p->index_max < len / 4 + 64) {
+		rc = __index_grow(p, len / 4 + 64);
+		if (rc)
+			return rc;
+	}
+	for (off = 0; off < len; off += 64) {
+		s = buf + off;
+		if (len - off < 64) {
+			memset(tail, ' ', sizeof(tail));
+			memcpy(tail, s, len - off);
+			s = tail;
+		}
+		if (p->index_max - n < 64) {
+			rc = __index_grow(p, n + 64);
+			if (rc)
+				return rc;
+		}
+		__block_classify(s, &b);
+		quote = b.quote & ~__escaped(b.bslash, &esc_carry);
+		/* The opening quote and the string, not the closing quote */
+		in_str = __prefix_xor(quote) ^ in_str_carry;
+		in_str_carry = (uint64_t)((int64_t)in_str >> 63);
+		/* The string and its closing quote, not the opening quote */
+		str_tail = in_str ^ quote;
+		scalar = ~(b.op | b.ws);
+		scalar_nq = scalar & ~quote;
+		structural = b.op |
+			(scalar & ~((scalar_nq << 1) | scalar_carry));
+		scalar_carry = scalar_nq >> 63;
+		structural &= ~str_tail;
+		while (structural) {
+			p->index[n++] = off + __builtin_ctzll(structural);
+			structural &= structural - 1;
+		}
+	}
+	if (in_str_carry)
+		return SCAN_RETRY;	/* unterminated string */
+	*count = n;
+	return 0;
+}
+
+static inline int __is_ws(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline int __is_hex(char c)
+{
+	return (c >= '0' && c <= '9') ||
+		(c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+/* The end of the token at s->idx[s->k - 1], trailing white space removed */
+static inline size_t __token_end(struct scan_s *s)
+{
+	size_t end = s->k < s->idx_count ? s->idx[s->k] : s->len;
+	while (__is_ws(s->buf[end - 1]))
+		end--;
+	return end;
+}
+
+static inline void __entity_init(json_entity_t e, enum json_value_e type)
+{
+	e->type = type;
+	e->flags = JSON_F_ARENA;
+}
+
+static int __scan_str(struct scan_s *s, size_t pos, json_entity_t *pe,
+		      void *slot)
+{
+	size_t end = __token_end(s) - 1;
+	const char *str = &s->buf[pos + 1];
+	size_t i, len;
+	json_str_t e;
+
+	if (end <= pos || s->buf[end] != '"')
+		return SCAN_RETRY;
+	len = end - pos - 1;
+	/* The lexer accepts only the JSON escape sequences */
+	for (i = 0; i < len; i++) {
+		if (str[i] != '\\')
+			continue;
+		if (i + 1 >= len)
+			return SCAN_RETRY;
+		switch (str[++i]) {
+		case '"': case '\\': case '/': case 'b':
+		case 'f': case 'n': case 'r': case 't':
+			break;
+		case 'u':
+			if (i + 4 >= len || !__is_hex(str[i+1]) ||
+			    !__is_hex(str[i+2]) || !__is_hex(str[i+3]) ||
+			    !__is_hex(str[i+4]))
+				return SCAN_RETRY;
+			i += 4;
+			break;
+		default:
+			return SCAN_RETRY;
+		}
+	}
+	e = slot ? slot : json_arena_alloc(s->arena, sizeof(*e));
+	if (!e)
+		return ENOMEM;
+	e->str = json_arena_alloc(s->arena, len + 1);
+	if (!e->str)
+		return ENOMEM;
+	__entity_init(&e->base, JSON_STRING_VALUE);
+	e->base.value.str_ = e;
+	memcpy(e->str, str, len);
+	e->str[len] = '\0';
+	e->str_len = len;
+	*pe = &e->base;
+	return 0;
+}
+
+/* Match the lexer's [-+]?[0-9]+, returns 0 if the token is not an integer */
+static int __is_int(const char *t, size_t len)
+{
+	size_t i = 0;
+	if (t[0] == '-' || t[0] == '+')
+		i++;
+	if (i == len)
+		return 0;
+	for (; i < len; i++) {
+		if (t[i] < '0' || t[i] > '9')
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Match [-+]?[0-9]+\.?[0-9]*([eE][-+]?[0-9]+)?, the floats of the lexer
+ * that begin with a digit
+ */
+static int __is_float(const char *t, size_t len)
+{
+	size_t i = 0, d;
+	if (t[i] == '-' || t[i] == '+')
+		i++;
+	d = i;
+	while (i < len && t[i] >= '0' && t[i] <= '9')
+		i++;
+	if (i == d)
+		return 0;
+	if (i < len && t[i] == '.')
+		i++;
+	while (i < len && t[i] >= '0' && t[i] <= '9')
+		i++;
+	if (i < len && (t[i] == 'e' || t[i] == 'E')) {
+		i++;
+		if (i < len && (t[i] == '-' || t[i] == '+'))
+			i++;
+		d = i;
+		while (i < len && t[i] >= '0' && t[i] <= '9')
+			i++;
+		if (i == d)
+			return 0;
+	}
+	return i == len;
+}
+
+static int __scan_scalar(struct scan_s *s, size_t pos, json_entity_t *pe,
+			 void *slot)
+{
+	size_t len = __token_end(s) - pos;
+	const char *t = &s->buf[pos];
+	char tok[SCAN_MAX_TOKEN];
+	json_entity_t e;
+
+	e = slot ? slot : json_arena_alloc(s->arena, sizeof(*e));
+	if (!e)
+		return ENOMEM;
+	if (len == 4 && 0 == memcmp(t, "true", 4)) {
+		__entity_init(e, JSON_BOOL_VALUE);
+		e->value.bool_ = 1;
+	} else if (len == 5 && 0 == memcmp(t, "false", 5)) {
+		__entity_init(e, JSON_BOOL_VALUE);
+		e->value.bool_ = 0;
+	} else if (len == 4 && 0 == memcmp(t, "null", 4)) {
+		__entity_init(e, JSON_NULL_VALUE);
+		e->value.int_ = 0;
+	} else {
+		if (len >= SCAN_MAX_TOKEN)
+			return SCAN_RETRY;
+		memcpy(tok, t, len);
+		tok[len] = '\0';
+		if (__is_int(tok, len)) {
+			__entity_init(e, JSON_INT_VALUE);
+			e->value.int_ = strtoll(tok, NULL, 0);
+		} else if (__is_float(tok, len)) {
+			__entity_init(e, JSON_FLOAT_VALUE);
+			e->value.double_ = strtold(tok, NULL);
+		} else {
+			return SCAN_RETRY;
+		}
+	}
+	*pe = e;
+	return 0;
+}
+
+static inline int __next(struct scan_s *s, size_t *pos)
+{
+	if (s->k >= s->idx_count)
+		return SCAN_RETRY;
+	*pos = s->idx[s->k++];
+	return 0;
+}
+
+static inline char __peek(struct scan_s *s)
+{
+	if (s->k >= s->idx_count)
+		return '\0';
+	return s->buf[s->idx[s->k]];
+}
+
+static int __scan_value(struct scan_s *s, json_entity_t *pe, void *slot);
+
+static int __scan_list(struct scan_s *s, json_entity_t *pe, void *slot)
+{
+	json_list_t l;
+	json_entity_t v;
+	size_t pos;
+	int rc;
+
+	l = slot ? slot : json_arena_alloc(s->arena, sizeof(*l));
+	if (!l)
+		return ENOMEM;
+	__entity_init(&l->base, JSON_LIST_VALUE);
+	l->base.value.list_ = l;
+	l->arena = s->arena;
+	l->item_count = 0;
+	TAILQ_INIT(&l->item_list);
+	*pe = &l->base;
+	if (__peek(s) == ']') {
+		s->k++;
+		return 0;
+	}
+	do {
+		rc = __scan_value(s, &v, NULL);
+		if (rc)
+			return rc;
+		TAILQ_INSERT_TAIL(&l->item_list, v, item_entry);
+		l->item_count++;
+		rc = __next(s, &pos);
+		if (rc)
+			return rc;
+	} while (s->buf[pos] == ',');
+	if (s->buf[pos] != ']')
+		return SCAN_RETRY;
+	return 0;
+}
+
+static int __scan_dict(struct scan_s *s, json_entity_t *pe, void *slot)
+{
+	json_parser_t p = s->p;
+	size_t base = s->attr_top;
+	json_entity_t name, v;
+	json_attr_t a, *stack;
+	json_dict_t d;
+	size_t pos, max;
+	int rc;
+
+	d = slot ? slot : json_arena_alloc(s->arena, sizeof(*d));
+	if (!d)
+		return ENOMEM;
+	__entity_init(&d->base, JSON_DICT_VALUE);
+	d->base.value.dict_ = d;
+	d->arena = s->arena;
+	d->attr_count = d->attr_max = 0;
+	d->attr_vec = d->attr_hash = NULL;
+	d->hash_mask = 0;
+	*pe = &d->base;
+	if (__peek(s) == '}') {
+		s->k++;
+		return 0;
+	}
+	do {
+		rc = __next(s, &pos);
+		if (rc)
+			return rc;
+		if (s->buf[pos] != '"')
+			return SCAN_RETRY;
+		rc = __scan_str(s, pos, &name, NULL);
+		if (rc)
+			return rc;
+		rc = __next(s, &pos);
+		if (rc)
+			return rc;
+		if (s->buf[pos] != ':')
+			return SCAN_RETRY;
+		rc = __scan_value(s, &v, NULL);
+		if (rc)
+			return rc;
+		a = json_arena_alloc(s->arena, sizeof(*a));
+		if (!a)
+			return ENOMEM;
+		__entity_init(&a->base, JSON_ATTR_VALUE);
+		a->base.value.attr_ = a;
+		a->name = name;
+		a->value = v;
+		if (s->attr_top == p->attr_stack_max) {
+			max = p->attr_stack_max ? 2 * p->attr_stack_max : 256;
+			stack = realloc(p->attr_stack, max * sizeof(*stack));
+			if (!stack)
+				return ENOMEM;
+			p->attr_stack = stack;
+			p->attr_stack_max = max;
+		}
+		p->attr_stack[s->attr_top++] = a;
+		rc = __next(s, &pos);
+		if (rc)
+			return rc;
+	} while (s->buf[pos] == ',');
+	if (s->buf[pos] != '}')
+		return SCAN_RETRY;
+
+	d->attr_count = d->attr_max = s->attr_top - base;
+	d->attr_vec = json_arena_alloc(s->arena,
+				       d->attr_count * sizeof(*d->attr_vec));
+	if (!d->attr_vec)
+		return ENOMEM;
+	memcpy(d->attr_vec, &p->attr_stack[base],
+	       d->attr_count * sizeof(*d->attr_vec));
+	s->attr_top = base;
+	return json_dict_index(d);
+}
+
+static int __scan_value(struct scan_s *s, json_entity_t *pe, void *slot)
+{
+	size_t pos;
+	int rc;
+
+	rc = __next(s, &pos);
+	if (rc)
+		return rc;
+	switch (s->buf[pos]) {
+	case '{':
+		if (++s->depth > SCAN_MAX_DEPTH)
+			return SCAN_RETRY;
+		rc = __scan_dict(s, pe, slot);
+		s->depth--;
+		return rc;
+	case '[':
+		if (++s->depth > SCAN_MAX_DEPTH)
+			return SCAN_RETRY;
+		rc = __scan_list(s, pe, slot);
+		s->depth--;
+		return rc;
+	case '"':
+		return __scan_str(s, pos, pe, slot);
+	case '}':
+	case ']':
+	case ':':
+	case ',':
+		return SCAN_RETRY;
+	default:
+		return __scan_scalar(s, pos, pe, slot);
+	}
+}
+
+int json_parse_buffer(json_parser_t p, char *buf, size_t buf_len,
+		      json_entity_t *pentity)
+{
+	struct json_doc_s *doc;
+	struct scan_s s;
+	json_entity_t e;
+	size_t count;
+	int rc;
+
+	*pentity = NULL;
+	if (buf_len >= UINT32_MAX)
+		goto retry;
+	rc = __index_build(p, buf, buf_len, &count);
+	if (rc == SCAN_RETRY)
+		goto retry;
+	if (rc)
+		return rc;
+	/* Roughly the size of the entities each index stands for */
+	doc = json_doc_new(count * 48 + buf_len);
+	if (!doc)
+		return ENOMEM;
+	s.p = p;
+	s.buf = buf;
+	s.len = buf_len;
+	s.idx = p->index;
+	s.idx_count = count;
+	s.k = 0;
+	s.attr_top = 0;
+	s.depth = 0;
+	s.arena = &doc->arena;
+	rc = __scan_value(&s, &e, &doc->root);
+	if (rc) {
+		json_doc_free(doc);
+		if (rc == SCAN_RETRY)
+			goto retry;
+		return rc;
+	}
+	assert(e == &doc->root.entity);
+	e->flags |= JSON_F_ROOT;
+	*pentity = e;
+	return 0;
+ retry:
+	return json_parse_buffer_yy(p, buf, buf_len, pentity);
+}
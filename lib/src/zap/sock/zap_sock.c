@@ -55,6 +55,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
@@ -95,6 +96,7 @@ static ovis_log_t zslog;
 #endif
 
 static int init_complete = 0;
+static int z_sock_nodelay = ZAP_SOCK_NODELAY;
 
 static void *io_thread_proc(void *arg);
 
@@ -356,6 +358,18 @@ static int __set_sock_opts(struct z_sock_ep *sep)
 		LOG_(sep, "zap_sock: WARNING: set TCP_KEEPINTVL error: %d\n", errno);
 		return errno;
 	}
+	/*
+	 * Every message is written whole, so Nagle only delays the small
+	 * replies and stream credits that the peer is waiting for. Without
+	 * the option the messages are late, not lost, so a failure is not
+	 * fatal.
+	 */
+	if (z_sock_nodelay) {
+		i = 1;
+		rc = setsockopt(sep->sock, SOL_TCP, TCP_NODELAY, &i, sizeof(int));
+		if (rc)
+			LOG_(sep, "zap_sock: WARNING: set TCP_NODELAY error: %d\n", errno);
+	}
 
 	/* send/recv bufsiz */
 	sz = SOCKBUF_SZ;
@@ -474,6 +488,8 @@ static void process_sep_msg_connect(struct z_sock_ep *sep)
 		return;
 	}
 
+	sep->peer_features = ntohs(msg->hdr.reserved);
+
 	struct zap_event ev = {
 		.type = ZAP_EVENT_CONNECT_REQUEST,
 		.data = (void*)msg->data,
@@ -503,6 +519,7 @@ static void process_sep_msg_accepted(struct z_sock_ep *sep)
 		goto err;
 
 	msg = sep->buff.data;
+	sep->peer_features = ntohs(msg->hdr.reserved);
 
 	ev.type = ZAP_EVENT_CONNECTED;
 	ev.status = ZAP_ERR_OK;
@@ -590,87 +607,468 @@ static void process_sep_msg_sendrecv(struct z_sock_ep *sep)
 	sep->ep.cb(&sep->ep, &ev);
 }
 
-/**
- * Receiving a read request message.
+/* A read response prepared for sending */
+struct z_sock_read_resp_s {
+	struct sock_msg_read_resp rmsg;
+	const char *src;
+	uint32_t data_len;
+	uint32_t src_map_key;
+	uint64_t base_hash; /* the reader's hash for a delta response, or 0 */
+};
+
+/*
+ * Validate the read of a local map region requested by the peer and
+ * prepare the read response. The caller must hold `z_key_tree_mutex`.
  */
-static void process_sep_msg_read_req(struct z_sock_ep *sep)
+static void __sock_read_resp_prep(struct z_sock_read_resp_s *resp,
+				  uint32_t xid, uint64_t ctxt,
+				  uint32_t src_map_key, uint64_t src_ptr,
+				  uint32_t be_data_len)
 {
-	/* unpack received message */
-	struct sock_msg_read_req *msg;
+	struct sock_msg_read_resp *rmsg = &resp->rmsg;
 	uint32_t data_len;
 	char *src;
-	struct sock_msg_read_resp rmsg;
-	memset(&(rmsg), 0, sizeof(rmsg));
+	int rc;
 
-	msg = sep->buff.data;
+	memset(rmsg, 0, sizeof(*rmsg));
 
 	/* Need to swap locally interpreted values */
-	data_len = ntohl(msg->data_len);
-	src = (char *)be64toh(msg->src_ptr);
+	data_len = ntohl(be_data_len);
+	src = (char *)be64toh(src_ptr);
 
-	int rc = 0;
-	pthread_mutex_lock(&z_key_tree_mutex);
-	rc = z_sock_map_key_access_validate(msg->src_map_key, src, data_len,
+	rc = z_sock_map_key_access_validate(src_map_key, src, data_len,
 				       ZAP_ACCESS_READ);
-	pthread_mutex_unlock(&z_key_tree_mutex);
 	/*
 	 * The data the other side receives could be garbage
 	 * if the map is deleted after this point.
 	 */
 	switch (rc) {
 	case 0:	/* OK */
-		rmsg.status = 0;
+		rmsg->status = 0;
 		break;
 	case EACCES:
-		rmsg.status = htons(ZAP_ERR_REMOTE_PERMISSION);
+		rmsg->status = htons(ZAP_ERR_REMOTE_PERMISSION);
 		break;
 	case ERANGE:
-		rmsg.status = htons(ZAP_ERR_REMOTE_LEN);
+		rmsg->status = htons(ZAP_ERR_REMOTE_LEN);
 		break;
 	case ENOENT:
-		rmsg.status = htons(ZAP_ERR_REMOTE_MAP);
+		rmsg->status = htons(ZAP_ERR_REMOTE_MAP);
 		break;
 	default:
-		rmsg.status = htons(ZAP_ERR_PARAMETER);
+		rmsg->status = htons(ZAP_ERR_PARAMETER);
 		break;
 	}
 	if (rc)
-		rmsg.data_len = data_len = 0;
+		rmsg->data_len = data_len = 0;
 	else
-		rmsg.data_len = msg->data_len; /* Still in BE */
+		rmsg->data_len = be_data_len; /* Still in BE */
+
+	z_sock_hdr_init(&rmsg->hdr, xid, SOCK_MSG_READ_RESP, sizeof(*rmsg) + data_len, ctxt);
+	resp->src = src;
+	resp->data_len = data_len;
+	resp->src_map_key = src_map_key;
+	resp->base_hash = 0;
+}
+
+/*
+ * Delta-encoded read responses
+ *
+ * For a read entry carrying a base_hash, the endpoint keeps a copy (the
+ * image) of the region it sent. When a later read of the same region
+ * carries the hash of the image, i.e. the reader still holds exactly the
+ * data that was sent, only the 8-byte words that differ from the image are
+ * sent. Otherwise the whole region is sent and the image is refreshed.
+ * A reader whose data does not match what was sent (e.g. the source
+ * changed while the response was being written) simply gets the whole
+ * region on the next read.
+ */
+static size_t z_sock_delta_mem = ZAP_SOCK_DELTA_MEM;
+
+static int z_delta_rbn_cmp(void *a, const void *b)
+{
+	const struct z_sock_delta_key *x = a;
+	const struct z_sock_delta_key *y = b;
+	if (x->map_key != y->map_key)
+		return (x->map_key < y->map_key)?(-1):(1);
+	if (x->ptr != y->ptr)
+		return (x->ptr < y->ptr)?(-1):(1);
+	if (x->len != y->len)
+		return (x->len < y->len)?(-1):(1);
+	return 0;
+}
 
-	z_sock_hdr_init(&rmsg.hdr, msg->hdr.xid, SOCK_MSG_READ_RESP, sizeof(rmsg) + data_len, msg->hdr.ctxt);
-	if (__sock_send_msg(sep, &rmsg.hdr, sizeof(rmsg), src, data_len))
+#define Z_SOCK_DELTA_WORDS(len) (((len) + 7) / 8)
+#define Z_SOCK_DELTA_BITMAP_LEN(len) (((Z_SOCK_DELTA_WORDS(len) + 63) / 64) * 8)
+
+static inline uint64_t __delta_hash_word(uint64_t h, uint64_t w)
+{
+	h ^= w * 0x9e3779b97f4a7c15ULL;
+	h = (h << 31) | (h >> 33);
+	return h * 0x100000001b3ULL;
+}
+
+static inline uint64_t __delta_hash_final(uint64_t h, size_t len)
+{
+	h = __delta_hash_word(h, len);
+	h ^= h >> 32;
+	return h ? h : 1; /* 0 means "no base" on the wire */
+}
+
+#define Z_SOCK_DELTA_HASH_SEED 0xcbf29ce484222325ULL
+
+/* The hash of a region as compared by the two ends */
+static uint64_t z_sock_delta_hash(const char *p, size_t len)
+{
+	uint64_t h = Z_SOCK_DELTA_HASH_SEED;
+	uint64_t w;
+	size_t i, n = len / 8;
+
+	for (i = 0; i < n; i++) {
+		memcpy(&w, p + i * 8, 8);
+		h = __delta_hash_word(h, w);
+	}
+	if (len % 8) {
+		w = 0;
+		memcpy(&w, p + n * 8, len % 8);
+		h = __delta_hash_word(h, w);
+	}
+	return __delta_hash_final(h, len);
+}
+
+/*
+ * Encode the words of `src` that differ from `img` into sep->delta_buf
+ * and bring `img` up to date. Returns the encoded length, or -1 if the
+ * buffer cannot be allocated.
+ */
+static ssize_t __sock_delta_encode(struct z_sock_ep *sep,
+				   struct z_sock_delta_img *img,
+				   const char *src)
+{
+	size_t len = img->key.len;
+	size_t n = len / 8;
+	size_t bm_len = Z_SOCK_DELTA_BITMAP_LEN(len);
+	uint64_t h = Z_SOCK_DELTA_HASH_SEED;
+	uint64_t *bm, v, o;
+	size_t i, tail;
+	char *out, *buf;
+
+	if (sep->delta_buf_len < bm_len + len) {
+		buf = realloc(sep->delta_buf, bm_len + len);
+		if (!buf)
+			return -1;
+		sep->delta_buf = buf;
+		sep->delta_buf_len = bm_len + len;
+	}
+	bm = (uint64_t *)sep->delta_buf;
+	out = sep->delta_buf + bm_len;
+	memset(bm, 0, bm_len);
+	for (i = 0; i < n; i++) {
+		memcpy(&v, src + i * 8, 8);
+		memcpy(&o, img->data + i * 8, 8);
+		if (v != o) {
+			bm[i / 64] |= 1ULL << (i % 64);
+			memcpy(out, &v, 8);
+			memcpy(img->data + i * 8, &v, 8);
+			out += 8;
+		}
+		h = __delta_hash_word(h, v);
+	}
+	tail = len % 8;
+	if (tail) {
+		v = o = 0;
+		memcpy(&v, src + n * 8, tail);
+		memcpy(&o, img->data + n * 8, tail);
+		if (v != o) {
+			bm[n / 64] |= 1ULL << (n % 64);
+			memcpy(out, &v, tail);
+			memcpy(img->data + n * 8, &v, tail);
+			out += tail;
+		}
+		h = __delta_hash_word(h, v);
+	}
+	for (i = 0; i < bm_len / 8; i++)
+		bm[i] = htole64(bm[i]);
+	img->hash = __delta_hash_final(h, len);
+	return out - sep->delta_buf;
+}
+
+/*
+ * Apply a delta produced by __sock_delta_encode() to `dst`. Returns 0 on
+ * success or -1 if the delta is malformed.
+ */
+static int __sock_delta_apply(char *dst, size_t len,
+			      const char *delta, size_t delta_len)
+{
+	size_t nwords = Z_SOCK_DELTA_WORDS(len);
+	size_t bm_len = Z_SOCK_DELTA_BITMAP_LEN(len);
+	const char *p = delta + bm_len;
+	const char *end = delta + delta_len;
+	size_t i, w, wl;
+	uint64_t bits;
+
+	if (delta_len < bm_len)
+		return -1;
+	for (i = 0; i < bm_len / 8; i++) {
+		memcpy(&bits, delta + i * 8, 8);
+		bits = le64toh(bits);
+		while (bits) {
+			w = i * 64 + __builtin_ctzll(bits);
+			bits &= bits - 1;
+			if (w >= nwords)
+				return -1;
+			wl = ((w == nwords - 1) && (len % 8))?(len % 8):(8);
+			if (end - p < wl)
+				return -1;
+			memcpy(dst + w * 8, p, wl);
+			p += wl;
+		}
+	}
+	return (p == end)?(0):(-1);
+}
+
+/* caller must hold sep->ep.lock */
+static void __sock_delta_img_free(struct z_sock_ep *sep,
+				  struct z_sock_delta_img *img)
+{
+	rbt_del(&sep->delta_rbt, &img->rbn);
+	TAILQ_REMOVE(&sep->delta_lru, img, lru_link);
+	sep->delta_bytes -= img->key.len;
+	free(img);
+}
+
+/*
+ * Make room for an image of `len` bytes by evicting the least recently
+ * used images, e.g. those of maps that were unmapped. Returns 0 if the
+ * image fits. The caller must hold sep->ep.lock.
+ */
+static int __sock_delta_img_reserve(struct z_sock_ep *sep, size_t len)
+{
+	struct z_sock_delta_img *img;
+
+	while (sep->delta_bytes + len > z_sock_delta_mem
+	       && (img = TAILQ_FIRST(&sep->delta_lru)))
+		__sock_delta_img_free(sep, img);
+	if (sep->delta_bytes + len <= z_sock_delta_mem)
+		return 0;
+	if (!sep->delta_cap_logged) {
+		sep->delta_cap_logged = 1;
+		LOG_(sep, "A %zu-byte region exceeds ZAP_SOCK_DELTA_MEM "
+		     "(%zu), it is always sent in full\n",
+		     len, z_sock_delta_mem);
+	}
+	return ENOSPC;
+}
+
+/*
+ * Send the read response for an entry that carries a base_hash.
+ * The caller must hold sep->ep.lock.
+ */
+static zap_err_t __sock_send_read_resp_delta(struct z_sock_ep *sep,
+					     struct z_sock_read_resp_s *resp)
+{
+	struct sock_msg_read_delta_resp dmsg;
+	struct z_sock_delta_img *img = NULL;
+	struct z_sock_delta_key key;
+	struct rbn *rbn;
+	ssize_t dlen;
+
+	if (!resp->data_len)
+		goto full;
+	key.map_key = resp->src_map_key;
+	key.len = resp->data_len;
+	key.ptr = (uint64_t)resp->src;
+	rbn = rbt_find(&sep->delta_rbt, &key);
+	if (rbn)
+		img = container_of(rbn, struct z_sock_delta_img, rbn);
+	if (resp->rmsg.status) {
+		/* the region is gone */
+		if (img)
+			__sock_delta_img_free(sep, img);
+		goto full;
+	}
+	if (Z_SOCK_DELTA_BITMAP_LEN(key.len) + key.len > sep->ep.z->max_msg)
+		goto full;
+	if (img) {
+		TAILQ_REMOVE(&sep->delta_lru, img, lru_link);
+		TAILQ_INSERT_TAIL(&sep->delta_lru, img, lru_link);
+	}
+	if (img && img->hash == resp->base_hash) {
+		dlen = __sock_delta_encode(sep, img, resp->src);
+		if (dlen < 0)
+			goto full;
+		memset(&dmsg, 0, sizeof(dmsg));
+		z_sock_hdr_init(&dmsg.hdr, resp->rmsg.hdr.xid,
+				SOCK_MSG_READ_DELTA_RESP, sizeof(dmsg) + dlen,
+				resp->rmsg.hdr.ctxt);
+		dmsg.data_len = htonl(key.len);
+		dmsg.delta_len = htonl(dlen);
+		return __sock_send_msg_nolock(sep, &dmsg.hdr, sizeof(dmsg),
+					      sep->delta_buf, dlen);
+	}
+	/* (re)take the image of the data being sent in full */
+	if (!img && !__sock_delta_img_reserve(sep, key.len)) {
+		img = malloc(sizeof(*img) + key.len);
+		if (img) {
+			img->key = key;
+			rbn_init(&img->rbn, &img->key);
+			rbt_ins(&sep->delta_rbt, &img->rbn);
+			TAILQ_INSERT_TAIL(&sep->delta_lru, img, lru_link);
+			sep->delta_bytes += key.len;
+		}
+	}
+	if (img) {
+		memcpy(img->data, resp->src, key.len);
+		img->hash = z_sock_delta_hash(img->data, key.len);
+	}
+ full:
+	return __sock_send_msg_nolock(sep, &resp->rmsg.hdr, sizeof(resp->rmsg),
+				      resp->src, resp->data_len);
+}
+
+/**
+ * Receiving a read request message.
+ */
+static void process_sep_msg_read_req(struct z_sock_ep *sep)
+{
+	struct sock_msg_read_req *msg = sep->buff.data;
+	struct z_sock_read_resp_s resp;
+
+	pthread_mutex_lock(&z_key_tree_mutex);
+	__sock_read_resp_prep(&resp, msg->hdr.xid, msg->hdr.ctxt,
+			      msg->src_map_key, msg->src_ptr, msg->data_len);
+	pthread_mutex_unlock(&z_key_tree_mutex);
+	if (__sock_send_msg(sep, &resp.rmsg.hdr, sizeof(resp.rmsg),
+			    resp.src, resp.data_len))
 		shutdown(sep->sock, SHUT_RDWR);
 }
 
-struct z_sock_send_wr_s *__sock_wr_alloc(size_t data_len, struct z_sock_io *io)
+#define Z_SOCK_READV_CHUNK 64
+/**
+ * Receiving a vectored read request message.
+ *
+ * Each entry is answered with its own read response. The responses are
+ * validated and queued a chunk at a time so that sock_write() can send
+ * them in a few system calls.
+ */
+static void __process_readv(struct z_sock_ep *sep, int delta)
+{
+	struct sock_msg_readv_req *msg = sep->buff.data;
+	struct sock_msg_readv_delta_req *dmsg = sep->buff.data;
+	struct sock_readv_ent *ent;
+	struct z_sock_read_resp_s resp[Z_SOCK_READV_CHUNK];
+	uint32_t i, j, n, count;
+	size_t ent_sz;
+	zap_err_t zerr = ZAP_ERR_OK;
+
+	/* count is at the same offset in both requests */
+	count = ntohl(msg->count);
+	ent_sz = delta ? sizeof(dmsg->ents[0]) : sizeof(msg->ents[0]);
+	if (ntohl(msg->hdr.msg_len) != sizeof(*msg) + count * ent_sz) {
+		LOG_(sep, "Bad vectored read request length %u, count %u\n",
+		     ntohl(msg->hdr.msg_len), count);
+		goto err;
+	}
+	for (i = 0; i < count; i += n) {
+		n = count - i;
+		if (n > Z_SOCK_READV_CHUNK)
+			n = Z_SOCK_READV_CHUNK;
+		pthread_mutex_lock(&z_key_tree_mutex);
+		for (j = 0; j < n; j++) {
+			ent = delta ? &dmsg->ents[i + j].ent : &msg->ents[i + j];
+			__sock_read_resp_prep(&resp[j], msg->hdr.xid, ent->ctxt,
+					      ent->src_map_key, ent->src_ptr,
+					      ent->data_len);
+			if (delta)
+				resp[j].base_hash =
+					be64toh(dmsg->ents[i + j].base_hash);
+		}
+		pthread_mutex_unlock(&z_key_tree_mutex);
+		pthread_mutex_lock(&sep->ep.lock);
+		for (j = 0; j < n; j++) {
+			if (resp[j].base_hash)
+				zerr = __sock_send_read_resp_delta(sep, &resp[j]);
+			else
+				zerr = __sock_send_msg_nolock(sep,
+						&resp[j].rmsg.hdr,
+						sizeof(resp[j].rmsg),
+						resp[j].src, resp[j].data_len);
+			if (zerr)
+				break;
+		}
+		pthread_mutex_unlock(&sep->ep.lock);
+		if (zerr)
+			goto err;
+	}
+	return;
+ err:
+	shutdown(sep->sock, SHUT_RDWR);
+}
+
+static void process_sep_msg_readv_req(struct z_sock_ep *sep)
+{
+	__process_readv(sep, 0);
+}
+
+static void process_sep_msg_readv_delta_req(struct z_sock_ep *sep)
+{
+	__process_readv(sep, 1);
+}
+
+/* caller must hold sep->ep.lock */
+static struct z_sock_send_wr_s *
+__sock_wr_alloc(struct z_sock_ep *sep, size_t data_len, struct z_sock_io *io)
 {
 	struct z_sock_send_wr_s *wr;
-	wr = calloc(1, sizeof(*wr) + data_len);
-	if (!wr)
-		return NULL;
+	if (!data_len && (wr = TAILQ_FIRST(&sep->wr_free_q))) {
+		TAILQ_REMOVE(&sep->wr_free_q, wr, link);
+		sep->wr_free_count--;
+		memset(wr, 0, sizeof(*wr));
+	} else {
+		wr = calloc(1, sizeof(*wr) + data_len);
+		if (!wr)
+			return NULL;
+		wr->alloc_len = data_len;
+	}
 	wr->io = io;
 	return wr;
 }
 
-void __sock_wr_free(struct z_sock_send_wr_s *wr)
+/* caller must hold sep->ep.lock */
+static void __sock_wr_free(struct z_sock_ep *sep, struct z_sock_send_wr_s *wr)
 {
-	free(wr);
+	/* Only header-only work requests are recycled */
+	if (wr->alloc_len || sep->wr_free_count >= ZAP_SOCK_FREE_Q_MAX) {
+		free(wr);
+		return;
+	}
+	TAILQ_INSERT_HEAD(&sep->wr_free_q, wr, link);
+	sep->wr_free_count++;
 }
 
 /* caller must hold sep->ep.lock */
 static inline
 struct z_sock_io *__sock_io_alloc(struct z_sock_ep *sep)
 {
-	return calloc(1, sizeof(struct z_sock_io));
+	struct z_sock_io *io = TAILQ_FIRST(&sep->io_free_q);
+	if (!io)
+		return calloc(1, sizeof(struct z_sock_io));
+	TAILQ_REMOVE(&sep->io_free_q, io, q_link);
+	sep->io_free_count--;
+	memset(io, 0, sizeof(*io));
+	return io;
 }
 
 /* caller must hold sep->ep.lock */
 static inline
 void __sock_io_free(struct z_sock_ep *sep, struct z_sock_io *io)
 {
-	free(io);
+	if (sep->io_free_count >= ZAP_SOCK_FREE_Q_MAX) {
+		free(io);
+		return;
+	}
+	TAILQ_INSERT_HEAD(&sep->io_free_q, io, q_link);
+	sep->io_free_count++;
 }
 
 /**
@@ -730,6 +1128,65 @@ static void process_sep_msg_read_resp(struct z_sock_ep *sep)
 	sep->ep.cb((void*)sep, &ev);
 }
 
+/**
+ * Receiving a delta-encoded read response message.
+ */
+static void process_sep_msg_read_delta_resp(struct z_sock_ep *sep)
+{
+	struct z_sock_io *io;
+	struct sock_msg_read_delta_resp *msg;
+	uint32_t data_len, delta_len;
+	int rc;
+
+	msg = sep->buff.data;
+
+	/* Get the matching request from the io_q */
+	pthread_mutex_lock(&sep->ep.lock);
+	io = TAILQ_FIRST(&sep->io_q);
+	ZAP_ASSERT(io, (&sep->ep), "%s: The io_q is empty.\n", __func__);
+	ZAP_ASSERT(msg->hdr.xid == io->xid, (&sep->ep),
+			"%s: The transaction IDs mismatched between the "
+			"IO entry %d and message %d.\n", __func__,
+			io->xid, msg->hdr.xid);
+	TAILQ_REMOVE(&sep->io_q, io, q_link);
+
+	data_len = ntohl(msg->data_len);
+	delta_len = ntohl(msg->delta_len);
+
+	if (msg->status == 0) {
+		rc = z_map_access_validate(io->dst_map, io->dst_ptr,
+					   data_len, 0);
+		switch (rc) {
+		case 0:
+			if (ntohl(msg->hdr.msg_len) != sizeof(*msg) + delta_len ||
+			    __sock_delta_apply(io->dst_ptr, data_len,
+					       msg->data, delta_len)) {
+				LOG_(sep, "Malformed delta read response\n");
+				rc = ZAP_ERR_PARAMETER;
+			}
+			break;
+		case EACCES:
+			rc = ZAP_ERR_LOCAL_PERMISSION;
+			break;
+		case ERANGE:
+			rc = ZAP_ERR_LOCAL_LEN;
+			break;
+		}
+	} else {
+		rc = ntohs(msg->status);
+	}
+	assert( io->ctxt == (void*)msg->hdr.ctxt );
+	__sock_io_free(sep, io);
+	pthread_mutex_unlock(&sep->ep.lock);
+
+	struct zap_event ev = {
+		.type = ZAP_EVENT_READ_COMPLETE,
+		.status = rc,
+		.context = (void*) msg->hdr.ctxt
+	};
+	sep->ep.cb((void*)sep, &ev);
+}
+
 static uint32_t g_xid = 0;
 static void
 z_sock_hdr_init(struct sock_msg_hdr *hdr, uint32_t xid,
@@ -1099,6 +1556,9 @@ static process_sep_msg_fn_t process_sep_msg_fns[SOCK_MSG_TYPE_LAST] = {
 	[SOCK_MSG_ACCEPTED] = process_sep_msg_accepted,
 	[SOCK_MSG_REJECTED] = process_sep_msg_rejected,
 	[SOCK_MSG_ACK_ACCEPTED] = process_sep_msg_ack_accepted,
+	[SOCK_MSG_READV_REQ] = process_sep_msg_readv_req,
+	[SOCK_MSG_READ_DELTA_RESP] = process_sep_msg_read_delta_resp,
+	[SOCK_MSG_READV_DELTA_REQ] = process_sep_msg_readv_delta_req,
 };
 
 static zap_err_t __sock_send_connect(struct z_sock_ep *sep, char *buf, size_t len);
@@ -1114,7 +1574,9 @@ static zap_err_t __sock_send_connect(struct z_sock_ep *sep, char *buf, size_t le
 static void sock_ev_cb(struct epoll_event *ev)
 {
 	struct z_sock_ep *sep = ev->data.ptr;
+	struct timespec start;
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	ref_get(&sep->ep.ref, "zap_sock:sock_ev_cb");
 	DEBUG_LOG(sep, "ep: %p, sock_ev_cb(), ev:%04x -- BEGIN --\n", sep, ev->events);
 	DEBUG_LOG(sep, "ep: %p, state: %s\n", sep, __zap_ep_state_str(sep->ep.state));
@@ -1158,6 +1620,7 @@ static void sock_ev_cb(struct epoll_event *ev)
  out:
 	DEBUG_LOG(sep, "ep: %p, state: %s\n", sep, __zap_ep_state_str(sep->ep.state));
 	DEBUG_LOG(sep, "ep: %p, sock_ev_cb() -- END --\n", sep);
+	zap_io_thread_ep_charge(&sep->ep, &start);
 	ref_put(&sep->ep.ref, "zap_sock:sock_ev_cb");
 }
 
@@ -1216,9 +1679,29 @@ static void sock_write(struct epoll_event *ev)
 		goto out;
 	}
 
-	/* msg */
-	while (wr->msg_len) {
-		wsz = send(sep->sock, wr->msg.bytes + wr->off, wr->msg_len, MSG_NOSIGNAL);
+	/*
+	 * Gather the remaining message header and the (possibly mapped)
+	 * data into a single sendmsg() so that a READ_RESP goes out
+	 * straight from the map memory without an intermediate copy.
+	 */
+	while (wr->msg_len || wr->data_len) {
+		struct iovec iov[2];
+		struct msghdr mh = { .msg_iov = iov };
+		size_t doff = 0;
+
+		if (wr->msg_len) {
+			iov[mh.msg_iovlen].iov_base = wr->msg.bytes + wr->off;
+			iov[mh.msg_iovlen].iov_len = wr->msg_len;
+			mh.msg_iovlen++;
+		} else {
+			doff = wr->off;
+		}
+		if (wr->data_len) {
+			iov[mh.msg_iovlen].iov_base = (char *)wr->data + doff;
+			iov[mh.msg_iovlen].iov_len = wr->data_len;
+			mh.msg_iovlen++;
+		}
+		wsz = sendmsg(sep->sock, &mh, MSG_NOSIGNAL);
 		if (wsz < 0) {
 			if (errno == EAGAIN || errno == EWOULDBLOCK) {
 				__enable_epoll_out(sep);
@@ -1228,26 +1711,16 @@ static void sock_write(struct epoll_event *ev)
 			goto err;
 		}
 		DEBUG_LOG(sep, "ep: %p, wrote %ld bytes\n", sep, wsz);
-		wr->msg_len -= wsz;
-		if (!wr->msg_len)
-			wr->off = 0; /* reset off for data */
-		else
-			wr->off += wsz;
-	}
-
-	/* data, wr->msg_len is already 0 */
-	assert(wr->msg_len == 0);
-	while (wr->data_len) {
-		wsz = send(sep->sock, wr->data + wr->off, wr->data_len, MSG_NOSIGNAL);
-		if (wsz < 0) {
-			if (errno == EAGAIN || errno == EWOULDBLOCK) {
-				__enable_epoll_out(sep);
-				goto out;
+		if (wr->msg_len) {
+			if ((size_t)wsz < wr->msg_len) {
+				wr->msg_len -= wsz;
+				wr->off += wsz;
+				continue;
 			}
-			/* otherwise bad error */
-			goto err;
+			wsz -= wr->msg_len;
+			wr->msg_len = 0;
+			wr->off = 0; /* reset off for data */
 		}
-		DEBUG_LOG(sep, "ep: %p, wrote %ld bytes\n", sep, wsz);
 		wr->data_len -= wsz;
 		wr->off += wsz;
 	}
@@ -1270,7 +1743,7 @@ static void sock_write(struct epoll_event *ev)
 		wr->io->xid = wr->msg.hdr.xid;
 		wr->io->wr = NULL;
 	}
-	__sock_wr_free(wr);
+	__sock_wr_free(sep, wr);
 	goto next;
 
  out:
@@ -1411,6 +1884,8 @@ static void *io_thread_proc(void *arg)
 			sep = thr->ev[i].data.ptr;
 			sep->ev_fn(&thr->ev[i]);
 		}
+		/* no event of our endpoints is in progress here */
+		zap_io_thread_rebalance(&thr->zap_io_thread);
 	}
 
 	pthread_cleanup_pop(1);
@@ -1432,6 +1907,7 @@ static zap_err_t __sock_send_connect(struct z_sock_ep *sep, char *buf, size_t le
 	zap_err_t zerr;
 	struct sock_msg_connect msg;
 	z_sock_hdr_init(&msg.hdr, 0, SOCK_MSG_CONNECT, (uint32_t)(sizeof(msg) + len), 0);
+	msg.hdr.reserved = htons(Z_SOCK_FEATURES);
 	msg.data_len = htonl(len);
 	ZAP_VERSION_SET(msg.ver);
 	memcpy(&msg.sig, ZAP_SOCK_SIG, sizeof(msg.sig));
@@ -1449,6 +1925,8 @@ static zap_err_t __sock_send(struct z_sock_ep *sep, uint16_t msg_type,
 	struct sock_msg_sendrecv msg;
 
 	z_sock_hdr_init(&msg.hdr, 0, msg_type, (uint32_t)(sizeof(msg) + len), 0);
+	if (msg_type == SOCK_MSG_ACCEPTED)
+		msg.hdr.reserved = htons(Z_SOCK_FEATURES);
 	msg.data_len = htonl(len);
 
 	return __sock_send_msg_nolock(sep, &msg.hdr, sizeof(msg), buf, len);
@@ -1508,7 +1986,7 @@ static zap_err_t __sock_send_msg_nolock(struct z_sock_ep *sep,
 	/* allocate send wr */
 	if (mtype == SOCK_MSG_READ_RESP) {
 		/* allow big message, and do not copy `data`  */
-		wr = __sock_wr_alloc(0, NULL);
+		wr = __sock_wr_alloc(sep, 0, NULL);
 		if (!wr)
 			return ZAP_ERR_RESOURCE;
 		wr->msg_len = msg_size;
@@ -1522,7 +2000,7 @@ static zap_err_t __sock_send_msg_nolock(struct z_sock_ep *sep,
 				  sep, data_len);
 			return ZAP_ERR_NO_SPACE;
 		}
-		wr = __sock_wr_alloc(data_len, NULL);
+		wr = __sock_wr_alloc(sep, data_len, NULL);
 		if (!wr)
 			return ZAP_ERR_RESOURCE;
 		wr->msg_len = msg_size + data_len;
@@ -1748,11 +2226,17 @@ static zap_err_t z_sock_listen(zap_ep_t ep, struct sockaddr *sa,
 	return zerr;
 }
 
-static zap_err_t z_sock_send(zap_ep_t ep, char *buf, size_t len)
+static zap_err_t z_sock_sendv(zap_ep_t ep, struct iovec *iov, int iovcnt)
 {
 	struct z_sock_ep *sep = (struct z_sock_ep *)ep;
 	struct z_sock_io *io;
 	zap_err_t zerr;
+	size_t len = 0;
+	char *p;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
 
 	pthread_mutex_lock(&sep->ep.lock);
 
@@ -1770,7 +2254,7 @@ static zap_err_t z_sock_send(zap_ep_t ep, char *buf, size_t len)
 	io->comp_type = ZAP_EVENT_SEND_COMPLETE;
 	io->ctxt = NULL;
 
-	io->wr = __sock_wr_alloc(len, io);
+	io->wr = __sock_wr_alloc(sep, len, io);
 	if (!io->wr) {
 		zerr = ZAP_ERR_RESOURCE;
 		goto err1;
@@ -1783,7 +2267,11 @@ static zap_err_t z_sock_send(zap_ep_t ep, char *buf, size_t len)
 	z_sock_hdr_init(&io->wr->msg.sendrecv.hdr, 0, SOCK_MSG_SENDRECV,
 			sizeof(io->wr->msg.sendrecv) + len, 0);
 	io->wr->msg.sendrecv.data_len = htonl((uint32_t)len);
-	memcpy(io->wr->msg.bytes + sizeof(io->wr->msg.sendrecv), buf, len);
+	p = io->wr->msg.bytes + sizeof(io->wr->msg.sendrecv);
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(p, iov[i].iov_base, iov[i].iov_len);
+		p += iov[i].iov_len;
+	}
 
 	TAILQ_INSERT_TAIL(&sep->io_q, io, q_link);
 	/* Post the work request */
@@ -1797,6 +2285,12 @@ err0:
 	return zerr;
 }
 
+static zap_err_t z_sock_send(zap_ep_t ep, char *buf, size_t len)
+{
+	struct iovec iov = { .iov_base = buf, .iov_len = len };
+	return z_sock_sendv(ep, &iov, 1);
+}
+
 void z_sock_atfork()
 {
 	/* reset at fork */
@@ -1832,7 +2326,7 @@ zap_err_t z_sock_send_mapped(zap_ep_t ep, zap_map_t map, void *buf,
 	io->comp_type = ZAP_EVENT_SEND_MAPPED_COMPLETE;
 	io->ctxt = context;
 
-	io->wr = __sock_wr_alloc(0, io);
+	io->wr = __sock_wr_alloc(sep, 0, io);
 	if (!io->wr) {
 		zerr = ZAP_ERR_RESOURCE;
 		goto err1;
@@ -1864,6 +2358,7 @@ err0:
 static int init_once()
 {
 	static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+	const char *env;
 
 	pthread_mutex_lock(&mutex);
 	/* check if we lose the race */
@@ -1878,6 +2373,12 @@ static int init_once()
 	z_key_tree.comparator = z_rbn_cmp;
 	pthread_mutex_init(&z_key_tree_mutex, NULL);
 
+	z_sock_delta_mem = ZAP_ENV_INT(ZAP_SOCK_DELTA_MEM);
+	/* zap_env_int() takes 0 for unset, so read this one directly */
+	env = getenv("ZAP_SOCK_NODELAY");
+	if (env)
+		z_sock_nodelay = atoi(env);
+
 	zslog = ovis_log_register("xprt.zap.sock", "Messages for zap_sock");
 	if (!zslog) {
 		ovis_log(NULL, OVIS_LWARN, "Failed to create zap_sock's "
@@ -1905,6 +2406,10 @@ static zap_ep_t z_sock_new(zap_t z, zap_cb_fn_t cb)
 	TAILQ_INIT(&sep->io_q);
 	TAILQ_INIT(&sep->io_cq);
 	TAILQ_INIT(&sep->sq);
+	TAILQ_INIT(&sep->io_free_q);
+	TAILQ_INIT(&sep->wr_free_q);
+	rbt_init(&sep->delta_rbt, z_delta_rbn_cmp);
+	TAILQ_INIT(&sep->delta_lru);
 	sep->sock = -1;
 	pthread_cond_init(&sep->sq_cond, NULL);
 
@@ -1928,6 +2433,8 @@ static void z_sock_destroy(zap_ep_t ep)
 {
 	struct z_sock_ep *sep = (struct z_sock_ep *)ep;
 	z_sock_send_wr_t wr;
+	struct z_sock_io *io;
+	struct rbn *rbn;
 
 	DEBUG_LOG(sep, "z_sock_destroy(%p)\n", sep);
 
@@ -1936,6 +2443,19 @@ static void z_sock_destroy(zap_ep_t ep)
 		TAILQ_REMOVE(&sep->sq, wr, link);
 		free(wr);
 	}
+	while ((wr = TAILQ_FIRST(&sep->wr_free_q))) {
+		TAILQ_REMOVE(&sep->wr_free_q, wr, link);
+		free(wr);
+	}
+	while ((io = TAILQ_FIRST(&sep->io_free_q))) {
+		TAILQ_REMOVE(&sep->io_free_q, io, q_link);
+		free(io);
+	}
+	while ((rbn = rbt_min(&sep->delta_rbt))) {
+		__sock_delta_img_free(sep, container_of(rbn,
+					struct z_sock_delta_img, rbn));
+	}
+	free(sep->delta_buf);
 
 	if (sep->conn_data)
 		free(sep->conn_data);
@@ -2090,7 +2610,7 @@ static zap_err_t z_sock_read(zap_ep_t ep, zap_map_t src_map, char *src,
 	io->comp_type = ZAP_EVENT_READ_COMPLETE;
 	io->ctxt = context;
 
-	io->wr = __sock_wr_alloc(0, io);
+	io->wr = __sock_wr_alloc(sep, 0, io);
 	if (!io->wr) {
 		zerr = ZAP_ERR_RESOURCE;
 		goto err1;
@@ -2120,6 +2640,129 @@ err0:
 	return zerr;
 }
 
+/* The maximum number of entries in a SOCK_MSG_READV_REQ */
+#define Z_SOCK_READV_MAX 1024
+
+static zap_err_t z_sock_read_v(zap_ep_t ep, struct zap_read_ent *ents, int n,
+			       int *n_posted)
+{
+	struct z_sock_ep *sep = (struct z_sock_ep *)ep;
+	TAILQ_HEAD(, z_sock_io) io_list;
+	struct zap_read_ent *ent;
+	struct sock_readv_ent *rent;
+	struct z_sock_io *io;
+	z_sock_send_wr_t wr;
+	zap_err_t zerr = ZAP_ERR_OK;
+	size_t len, ent_sz;
+	int i, cnt;
+	/* Z_SOCK_F_DELTA peers get the entries with a base hash */
+	int delta = !!(sep->peer_features & Z_SOCK_F_DELTA);
+
+	*n_posted = 0;
+	if (0 == (sep->peer_features & Z_SOCK_F_READV)) {
+		/* The peer does not understand SOCK_MSG_READV_REQ */
+		for (i = 0; i < n; i++) {
+			ent = &ents[i];
+			zerr = z_sock_read(ep, ent->src_map, ent->src,
+					   ent->dst_map, ent->dst, ent->sz,
+					   ent->context);
+			if (zerr)
+				return zerr;
+			(*n_posted)++;
+		}
+		return ZAP_ERR_OK;
+	}
+
+	pthread_mutex_lock(&sep->ep.lock);
+	while (*n_posted < n) {
+		if (sep->ep.state != ZAP_EP_CONNECTED) {
+			zerr = ZAP_ERR_NOT_CONNECTED;
+			goto out;
+		}
+		ent = &ents[*n_posted];
+		cnt = n - *n_posted;
+		if (cnt > Z_SOCK_READV_MAX)
+			cnt = Z_SOCK_READV_MAX;
+
+		/* validate; the entries before a bad one are still posted */
+		for (i = 0; i < cnt; i++) {
+			if (z_map_access_validate(ent[i].src_map, ent[i].src,
+					ent[i].sz, ZAP_ACCESS_READ) != 0) {
+				zerr = ZAP_ERR_REMOTE_PERMISSION;
+				break;
+			}
+			if (z_map_access_validate(ent[i].dst_map, ent[i].dst,
+					ent[i].sz, ZAP_ACCESS_NONE) != 0) {
+				zerr = ZAP_ERR_LOCAL_LEN;
+				break;
+			}
+		}
+		cnt = i;
+		if (!cnt)
+			goto out;
+
+		ent_sz = delta ? sizeof(wr->msg.readv_delta_req.ents[0])
+			       : sizeof(wr->msg.readv_req.ents[0]);
+		len = sizeof(wr->msg.readv_req) + cnt * ent_sz;
+		wr = __sock_wr_alloc(sep, cnt * ent_sz, NULL);
+		if (!wr) {
+			zerr = ZAP_ERR_RESOURCE;
+			goto out;
+		}
+		wr->msg_len = len;
+		z_sock_hdr_init(&wr->msg.hdr, 0, delta ? SOCK_MSG_READV_DELTA_REQ
+							: SOCK_MSG_READV_REQ,
+				len, 0);
+		wr->msg.readv_req.count = htonl(cnt);
+
+		TAILQ_INIT(&io_list);
+		for (i = 0; i < cnt; i++) {
+			io = __sock_io_alloc(sep);
+			if (!io) {
+				while ((io = TAILQ_FIRST(&io_list))) {
+					TAILQ_REMOVE(&io_list, io, q_link);
+					__sock_io_free(sep, io);
+				}
+				__sock_wr_free(sep, wr);
+				zerr = ZAP_ERR_RESOURCE;
+				goto out;
+			}
+			io->comp_type = ZAP_EVENT_READ_COMPLETE;
+			io->ctxt = ent[i].context;
+			io->dst_map = ent[i].dst_map;
+			io->dst_ptr = ent[i].dst;
+			/* all responses carry the xid of the request */
+			io->xid = wr->msg.hdr.xid;
+			TAILQ_INSERT_TAIL(&io_list, io, q_link);
+
+			rent = delta ? &wr->msg.readv_delta_req.ents[i].ent
+				     : &wr->msg.readv_req.ents[i];
+			rent->src_map_key = SOCK_MAP_KEY_GET(ent[i].src_map);
+			rent->src_ptr = htobe64((uint64_t)ent[i].src);
+			rent->data_len = htonl((uint32_t)ent[i].sz);
+			rent->ctxt = (uint64_t)ent[i].context;
+			if (!delta)
+				continue;
+			wr->msg.readv_delta_req.ents[i].base_hash = 0;
+			if (ent[i].flags & ZAP_READ_F_DELTA) {
+				/* the peer may send only what changed */
+				wr->msg.readv_delta_req.ents[i].base_hash =
+					htobe64(z_sock_delta_hash(ent[i].dst,
+								  ent[i].sz));
+			}
+		}
+		TAILQ_CONCAT(&sep->io_q, &io_list, q_link);
+		/* write message */
+		__wr_post(sep, wr);
+		*n_posted += cnt;
+		if (zerr)
+			goto out;
+	}
+ out:
+	pthread_mutex_unlock(&sep->ep.lock);
+	return zerr;
+}
+
 static zap_err_t z_sock_write(zap_ep_t ep, zap_map_t src_map, char *src,
 			      zap_map_t dst_map, char *dst, size_t sz,
 			      void *context)
@@ -2154,7 +2797,7 @@ static zap_err_t z_sock_write(zap_ep_t ep, zap_map_t src_map, char *src,
 	io->comp_type = ZAP_EVENT_WRITE_COMPLETE;
 	io->ctxt = context;
 
-	io->wr = __sock_wr_alloc(0, io);
+	io->wr = __sock_wr_alloc(sep, 0, io);
 	if (!io->wr) {
 		zerr = ZAP_ERR_RESOURCE;
 		goto err1;
@@ -2273,6 +2916,8 @@ zap_err_t zap_transport_get(zap_t *pz, zap_mem_info_fn_t mem_info_fn)
 	z->close = z_sock_close;
 	z->send = z_sock_send;
 	z->read = z_sock_read;
+	z->read_v = z_sock_read_v;
+	z->sendv = z_sock_sendv;
 	z->write = z_sock_write;
 	z->unmap = z_sock_unmap;
 	z->share = z_sock_share;
@@ -78,6 +78,15 @@
  */
 #define ZAP_SOCK_KEEPCNT 3
 
+/**
+ * \brief Default of the TCP_NODELAY option.
+ *
+ * Nagle's algorithm delays the small replies and stream credits that the
+ * peer waits for. Set the ZAP_SOCK_NODELAY environment variable to 0 to
+ * keep it enabled.
+ */
+#define ZAP_SOCK_NODELAY 1
+
 /**
  * \brief Value for TCP_KEEPINTVL option for initiator side socket.
  *
@@ -106,6 +115,9 @@ typedef enum sock_msg_type {
 	SOCK_MSG_ACCEPTED,    /*  Connection  accepted      */
 	SOCK_MSG_REJECTED,    /*  Reject      data */
 	SOCK_MSG_ACK_ACCEPTED,/*  Acknowledge accepted msg  */
+	SOCK_MSG_READV_REQ,   /*  Vectored    read request  */
+	SOCK_MSG_READ_DELTA_RESP, /* Delta-encoded read response */
+	SOCK_MSG_READV_DELTA_REQ, /* Vectored read request with base hashes */
 	SOCK_MSG_TYPE_LAST,   /*  Range limiter, upper  */
 	SOCK_MSG_FIRST = SOCK_MSG_CONNECT /* Range limiter, lower */
 } sock_msg_type_t;;
@@ -122,6 +134,9 @@ static const char *__sock_msg_type_str[SOCK_MSG_TYPE_LAST] = {
 	[SOCK_MSG_ACCEPTED]    =  "SOCK_MSG_ACCEPTED",
 	[SOCK_MSG_REJECTED]    =  "SOCK_MSG_REJECTED",
 	[SOCK_MSG_ACK_ACCEPTED] = "SOCK_MSG_ACK_ACCEPTED",
+	[SOCK_MSG_READV_REQ]   =  "SOCK_MSG_READV_REQ",
+	[SOCK_MSG_READ_DELTA_RESP] = "SOCK_MSG_READ_DELTA_RESP",
+	[SOCK_MSG_READV_DELTA_REQ] = "SOCK_MSG_READV_DELTA_REQ",
 };
 
 static inline
@@ -141,7 +156,7 @@ const char *sock_msg_type_str(sock_msg_type_t t)
  */
 struct sock_msg_hdr {
 	uint16_t msg_type; /**< The request type */
-	uint16_t reserved;
+	uint16_t reserved; /**< Z_SOCK_F_* features in CONNECT and ACCEPTED */
 	uint32_t msg_len;  /**< Length of the entire message, header included. */
 	uint32_t xid;	   /**< Transaction Id to check against reply */
 	uint64_t ctxt;	   /**< User context to be returned in reply */
@@ -149,6 +164,15 @@ struct sock_msg_hdr {
 
 static char ZAP_SOCK_SIG[8] = "SOCKET";
 
+/*
+ * Optional protocol features, advertised in the `reserved` header field of
+ * the CONNECT and ACCEPTED messages. Peers that do not know about them
+ * send 0.
+ */
+#define Z_SOCK_F_READV 0x0001 /* understands SOCK_MSG_READV_REQ */
+#define Z_SOCK_F_DELTA 0x0002 /* understands SOCK_MSG_READV_DELTA_REQ */
+#define Z_SOCK_FEATURES (Z_SOCK_F_READV|Z_SOCK_F_DELTA)
+
 /**
  * Connect message.
  */
@@ -179,6 +203,38 @@ struct sock_msg_read_req {
 	uint32_t data_len; /**< Data length */
 };
 
+/**
+ * Vectored read request. The peer answers each entry with a
+ * ::sock_msg_read_resp carrying the request \c xid and the entry \c ctxt,
+ * in the order of the entries.
+ */
+struct sock_msg_readv_req {
+	struct sock_msg_hdr hdr;
+	uint32_t count; /**< Number of entries */
+	struct sock_readv_ent {
+		uint32_t src_map_key; /**< Source map reference */
+		uint64_t src_ptr; /**< Source memory */
+		uint32_t data_len; /**< Data length */
+		uint64_t ctxt; /**< User context returned in the response */
+	} ents[OVIS_FLEX];
+};
+
+/**
+ * Vectored read request to a Z_SOCK_F_DELTA peer. The entries are answered
+ * as those of ::sock_msg_readv_req, except that an entry with a non-zero
+ * \c base_hash, the hash of the data that the reader holds at the
+ * destination, is answered with a ::sock_msg_read_delta_resp if the hash
+ * matches the data last sent for the region.
+ */
+struct sock_msg_readv_delta_req {
+	struct sock_msg_hdr hdr;
+	uint32_t count; /**< Number of entries */
+	struct sock_readv_delta_ent {
+		struct sock_readv_ent ent;
+		uint64_t base_hash; /**< Hash of the reader's data, 0 if none */
+	} ents[OVIS_FLEX];
+};
+
 /**
  * Read response
  */
@@ -190,6 +246,23 @@ struct sock_msg_read_resp {
 	char data[OVIS_FLEX]; /**< Response data */
 };
 
+/**
+ * Delta-encoded read response
+ *
+ * The region is handled as 8-byte words (the last one may be shorter).
+ * \c data starts with a bitmap of the words that changed, one bit per word
+ * in little-endian 64-bit units, followed by the new value of each changed
+ * word in order.
+ */
+struct sock_msg_read_delta_resp {
+	struct sock_msg_hdr hdr;
+	uint16_t status; /**< Return status */
+	uint64_t dst_ptr; /**< Destination memory addr (on initiator) */
+	uint32_t data_len; /**< Length of the region */
+	uint32_t delta_len; /**< Length of the bitmap and the words */
+	char data[OVIS_FLEX]; /**< Bitmap and changed words */
+};
+
 /**
  * Write request
  */
@@ -228,7 +301,10 @@ typedef union sock_msg_u {
 	struct sock_msg_connect connect;
 	struct sock_msg_rendezvous rendezvous;
 	struct sock_msg_read_req read_req;
+	struct sock_msg_readv_req readv_req;
+	struct sock_msg_readv_delta_req readv_delta_req;
 	struct sock_msg_read_resp read_resp;
+	struct sock_msg_read_delta_resp read_delta_resp;
 	struct sock_msg_write_req write_req;
 	struct sock_msg_write_resp write_resp;
 	char bytes[0]; /* access as bytes */
@@ -248,6 +324,7 @@ typedef struct z_sock_send_wr_s {
 	size_t off; /* offset of msg or data */
 	const char *data;
 	int flags; /* various wr flags */
+	size_t alloc_len; /* inline data bytes allocated after msg */
 	union sock_msg_u msg; /* The message */
 } *z_sock_send_wr_t;
 
@@ -285,6 +362,7 @@ struct z_sock_ep {
 
 	int sock_connected;
 	int app_accepted;
+	uint16_t peer_features; /* Z_SOCK_F_* advertised by the peer */
 
 	struct epoll_event ev;
 	void (*ev_fn)(struct epoll_event *);
@@ -294,12 +372,59 @@ struct z_sock_ep {
 	TAILQ_HEAD(, z_sock_io) io_q; /* manages ops from app (read/write/send) */
 	TAILQ_HEAD(, z_sock_io) io_cq; /* completion queue, currently serves only send completion */
 	TAILQ_HEAD(, z_sock_send_wr_s) sq; /* send queue */
+
+	/*
+	 * Free lists of header-only work requests and io entries so that
+	 * the read request/response path does not hit the allocator.
+	 * Protected by ep.lock.
+	 */
+	TAILQ_HEAD(, z_sock_io) io_free_q;
+	TAILQ_HEAD(, z_sock_send_wr_s) wr_free_q;
+	int io_free_count;
+	int wr_free_count;
+
+	/*
+	 * Images of the regions last sent to the peer for reads that carry
+	 * a base_hash, and the buffer the delta responses are encoded in.
+	 * Used only by the io thread while processing read requests.
+	 * delta_lru is ordered by last use; the least recently used images
+	 * are evicted when delta_bytes would exceed ZAP_SOCK_DELTA_MEM.
+	 */
+	struct rbt delta_rbt;
+	TAILQ_HEAD(, z_sock_delta_img) delta_lru;
+	size_t delta_bytes; /* total bytes of the images */
+	int delta_cap_logged;
+	char *delta_buf;
+	size_t delta_buf_len;
+
 	LIST_ENTRY(z_sock_ep) link;
 	pthread_cond_t sq_cond;
 };
 
 #define ZAP_SOCK_EV_SIZE 4096
 
+/* The maximum number of cached entries in each endpoint free list */
+#define ZAP_SOCK_FREE_Q_MAX 128
+
+/*
+ * Default limit of the memory used for the delta images of an endpoint.
+ * Can be changed with the ZAP_SOCK_DELTA_MEM environment variable.
+ */
+#define ZAP_SOCK_DELTA_MEM (64*1024*1024)
+
+/* The image of a region last sent in a read response with delta support */
+struct z_sock_delta_img {
+	struct rbn rbn;
+	TAILQ_ENTRY(z_sock_delta_img) lru_link;
+	struct z_sock_delta_key {
+		uint32_t map_key;
+		uint32_t len;
+		uint64_t ptr;
+	} key;
+	uint64_t hash;
+	char data[OVIS_FLEX];
+};
+
 typedef struct z_sock_io_thread {
 	struct zap_io_thread zap_io_thread;
 	int efd; /* epoll fd */
@@ -0,0 +1,446 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file zap_test_delta_perf.c
+ *
+ * Compare full and delta-encoded (::ZAP_READ_F_DELTA) reads.
+ *
+ * The server and the client run in the same process over the given
+ * transport. The server exports sets sized like the data sections of a few
+ * common LDMS schemas. In each round, a fraction of the 8-byte words of
+ * every set is changed and the client reads all the sets with one
+ * zap_read_v() call. Each schema is measured with full reads and with
+ * delta reads. The report gives the bytes that crossed the socket (both
+ * directions, counted by interposing read(2) in this program) and the
+ * CPU time (both ends) per set update.
+ *
+ * ```
+ * $ zap_test_delta_perf -x sock -p PORT [-h HOST] [-n NUM_SETS]
+ *                       [-c CHANGE_PCT] [-r ROUNDS]
+ * ```
+ */
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <sys/errno.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <assert.h>
+#include <dlfcn.h>
+#include "zap.h"
+
+#ifdef NDEBUG
+#define ASSERT(COND) do { \
+	if (COND) \
+		break; \
+	printf("assert(" #COND ") failed.\n"); \
+	exit(-1); \
+} while (0)
+#else
+#define ASSERT(COND) assert(COND)
+#endif
+
+/* Bytes received from the sockets; the program is linked with
+ * --export-dynamic so that the transport library calls this read(). */
+static uint64_t wire_bytes;
+static ssize_t (*libc_read)(int fd, void *buf, size_t count);
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+	ssize_t rc;
+	if (!libc_read)
+		libc_read = dlsym(RTLD_NEXT, "read");
+	rc = libc_read(fd, buf, count);
+	if (rc > 0)
+		__atomic_fetch_add(&wire_bytes, rc, __ATOMIC_RELAXED);
+	return rc;
+}
+
+/* Data section sizes of the sets of a few samplers */
+struct schema_s {
+	const char *name;
+	size_t size;
+} schemas[] = {
+	{ "meminfo",   544 },
+	{ "procstat2", 680 },
+	{ "vmstat",   1648 },
+};
+#define NUM_SCHEMAS (sizeof(schemas)/sizeof(schemas[0]))
+
+#pragma pack(push, 4)
+struct msg_dir_rep {
+	int  idx;
+	void *addr;
+	int  len;
+};
+#pragma pack(pop)
+
+struct set_s {
+	char *srv_mem;
+	char *cli_mem;
+	size_t len;
+	zap_map_t srv_map;
+	zap_map_t cli_map;
+	zap_map_t rmap; /* the server map on the client side */
+	void *raddr;
+};
+
+zap_t zap;
+struct set_s *sets;
+int num_sets = 1000; /* per schema */
+int change_pct = 10;
+int num_rounds = 100;
+
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+int rendezvous;
+int completed;
+zap_ep_t cli_ep;
+
+zap_mem_info_t test_meminfo(void)
+{
+	return NULL;
+}
+
+void server_cb(zap_ep_t ep, zap_event_t ev)
+{
+	struct msg_dir_rep rep;
+	zap_err_t err;
+	int i;
+
+	switch (ev->type) {
+	case ZAP_EVENT_CONNECT_REQUEST:
+		err = zap_accept(ep, server_cb, NULL, 0);
+		ASSERT(err == ZAP_ERR_OK);
+		break;
+	case ZAP_EVENT_CONNECTED:
+		for (i = 0; i < NUM_SCHEMAS * num_sets; i++) {
+			rep.idx = i;
+			rep.addr = sets[i].srv_mem;
+			rep.len = sets[i].len;
+			err = zap_share(ep, sets[i].srv_map, (void *)&rep,
+					sizeof(rep));
+			ASSERT(err == ZAP_ERR_OK);
+		}
+		break;
+	case ZAP_EVENT_DISCONNECTED:
+		zap_free(ep);
+		break;
+	case ZAP_EVENT_SEND_COMPLETE:
+	case ZAP_EVENT_SEND_MAPPED_COMPLETE:
+		break;
+	default:
+		printf("Unexpected server event %s\n", zap_event_str(ev->type));
+		ASSERT(0);
+	}
+}
+
+void client_cb(zap_ep_t ep, zap_event_t ev)
+{
+	struct msg_dir_rep *rep;
+
+	switch (ev->type) {
+	case ZAP_EVENT_CONNECTED:
+		break;
+	case ZAP_EVENT_RENDEZVOUS:
+		rep = (void *)ev->data;
+		ASSERT(ev->data_len == sizeof(*rep));
+		sets[rep->idx].rmap = ev->map;
+		sets[rep->idx].raddr = rep->addr;
+		pthread_mutex_lock(&mutex);
+		if (++rendezvous == NUM_SCHEMAS * num_sets)
+			pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&mutex);
+		break;
+	case ZAP_EVENT_READ_COMPLETE:
+		ASSERT(ev->status == ZAP_ERR_OK);
+		pthread_mutex_lock(&mutex);
+		if (++completed == num_sets)
+			pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&mutex);
+		break;
+	case ZAP_EVENT_DISCONNECTED:
+	case ZAP_EVENT_SEND_COMPLETE:
+	case ZAP_EVENT_SEND_MAPPED_COMPLETE:
+		break;
+	default:
+		printf("Unexpected client event %s\n", zap_event_str(ev->type));
+		ASSERT(0);
+	}
+}
+
+static uint64_t rng_state = 88172645463325252ULL;
+static uint64_t rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+/* Change `change_pct` percent of the words of the sets of a schema */
+static void sample(struct set_s *s, int n)
+{
+	uint64_t *w, nwords;
+	int i, j, k;
+
+	for (i = 0; i < n; i++) {
+		w = (uint64_t *)s[i].srv_mem;
+		nwords = s[i].len / 8;
+		w[0]++; /* a timestamp-like word always changes */
+		k = nwords * change_pct / 100;
+		for (j = 1; j < k; j++)
+			w[rng_next() % nwords] += rng_next() % 1000;
+	}
+}
+
+/* Read all the sets of a schema and wait for the completions */
+static void update(struct zap_read_ent *ents, struct set_s *s, int n, int flags)
+{
+	zap_err_t err;
+	int i, n_posted;
+
+	for (i = 0; i < n; i++) {
+		ents[i].src_map = s[i].rmap;
+		ents[i].src = s[i].raddr;
+		ents[i].dst_map = s[i].cli_map;
+		ents[i].dst = s[i].cli_mem;
+		ents[i].sz = s[i].len;
+		ents[i].context = &s[i];
+		ents[i].flags = flags;
+	}
+	pthread_mutex_lock(&mutex);
+	completed = 0;
+	pthread_mutex_unlock(&mutex);
+	err = zap_read_v(cli_ep, ents, n, &n_posted);
+	ASSERT(err == ZAP_ERR_OK && n_posted == n);
+	pthread_mutex_lock(&mutex);
+	while (completed < n)
+		pthread_cond_wait(&cond, &mutex);
+	pthread_mutex_unlock(&mutex);
+	for (i = 0; i < n; i++)
+		ASSERT(0 == memcmp(s[i].srv_mem, s[i].cli_mem, s[i].len));
+}
+
+static double cpu_sec(void)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+		+ (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+}
+
+static void run(struct zap_read_ent *ents, int schema, int flags)
+{
+	struct set_s *s = &sets[schema * num_sets];
+	uint64_t b0, b1;
+	double c0, c1, nupd;
+	int r;
+
+	/* warm up; the first delta read of a region is a full read */
+	sample(s, num_sets);
+	update(ents, s, num_sets, flags);
+
+	b0 = __atomic_load_n(&wire_bytes, __ATOMIC_SEQ_CST);
+	c0 = cpu_sec();
+	for (r = 0; r < num_rounds; r++) {
+		sample(s, num_sets);
+		update(ents, s, num_sets, flags);
+	}
+	c1 = cpu_sec();
+	b1 = __atomic_load_n(&wire_bytes, __ATOMIC_SEQ_CST);
+	nupd = (double)num_rounds * num_sets;
+	printf("%-10s %6zu  %-5s %12.1f %12.2f\n", schemas[schema].name,
+	       schemas[schema].size, flags ? "delta" : "full",
+	       (b1 - b0) / nupd, (c1 - c0) * 1e6 / nupd);
+}
+
+int resolve(const char *hostname, struct sockaddr_in *sin)
+{
+	struct hostent *h;
+
+	h = gethostbyname(hostname);
+	if (!h) {
+		printf("Error resolving hostname '%s'\n", hostname);
+		return -1;
+	}
+	if (h->h_addrtype != AF_INET) {
+		printf("Hostname '%s' resolved to an unsupported"
+				" address family\n", hostname);
+		return -1;
+	}
+	sin->sin_addr.s_addr = *(unsigned int *)(h->h_addr_list[0]);
+	sin->sin_family = h->h_addrtype;
+	return 0;
+}
+
+#define FMT_ARGS "x:p:h:n:c:r:"
+void usage(int argc, char *argv[])
+{
+	printf("usage: %s -x name -p port_no [-h host] [-n NUM_SETS] "
+	       "[-c CHANGE_PCT] [-r ROUNDS]\n"
+	       "    -x name	The transport to use.\n"
+	       "    -p port_no	The port number.\n"
+	       "    -h host	The host to listen/connect (default: localhost).\n"
+	       "    -n NUM_SETS	The number of sets per schema (default: 1000).\n"
+	       "    -c CHANGE_PCT	The percentage of the words changed in\n"
+	       "		each round (default: 10).\n"
+	       "    -r ROUNDS	The number of update rounds (default: 100).\n",
+	       argv[0]);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *xprt = NULL;
+	const char *host = "localhost";
+	struct sockaddr_in sin = {};
+	struct zap_read_ent *ents;
+	unsigned short port_no = 0;
+	zap_ep_t lep;
+	zap_err_t err;
+	int i, rc, ptmp;
+
+	setbuf(stdout, NULL);
+
+	while (-1 != (rc = getopt(argc, argv, FMT_ARGS))) {
+		switch (rc) {
+		case 'x':
+			xprt = optarg;
+			break;
+		case 'p':
+			ptmp = atoi(optarg);
+			if (ptmp > 0 && ptmp < USHRT_MAX)
+				port_no = ptmp;
+			break;
+		case 'h':
+			host = optarg;
+			break;
+		case 'n':
+			num_sets = atoi(optarg);
+			break;
+		case 'c':
+			change_pct = atoi(optarg);
+			break;
+		case 'r':
+			num_rounds = atoi(optarg);
+			break;
+		default:
+			usage(argc, argv);
+		}
+	}
+	if (!xprt || !port_no || num_sets <= 0 || num_rounds <= 0 ||
+	    change_pct < 0 || change_pct > 100)
+		usage(argc, argv);
+
+	if (resolve(host, &sin))
+		usage(argc, argv);
+	sin.sin_port = htons(port_no);
+
+	sets = calloc(NUM_SCHEMAS * num_sets, sizeof(*sets));
+	ents = calloc(num_sets, sizeof(*ents));
+	ASSERT(sets && ents);
+	for (i = 0; i < NUM_SCHEMAS * num_sets; i++) {
+		sets[i].len = schemas[i / num_sets].size;
+		sets[i].srv_mem = calloc(1, sets[i].len);
+		sets[i].cli_mem = calloc(1, sets[i].len);
+		ASSERT(sets[i].srv_mem && sets[i].cli_mem);
+		err = zap_map(&sets[i].srv_map, sets[i].srv_mem, sets[i].len,
+			      ZAP_ACCESS_READ);
+		ASSERT(err == ZAP_ERR_OK);
+		err = zap_map(&sets[i].cli_map, sets[i].cli_mem, sets[i].len,
+			      ZAP_ACCESS_READ|ZAP_ACCESS_WRITE);
+		ASSERT(err == ZAP_ERR_OK);
+	}
+
+	zap = zap_get(xprt, test_meminfo);
+	if (!zap) {
+		printf("%s: could not load the '%s' xprt.\n", __func__, xprt);
+		exit(1);
+	}
+
+	lep = zap_new(zap, server_cb);
+	ASSERT(lep);
+	err = zap_listen(lep, (struct sockaddr *)&sin, sizeof(sin));
+	if (err) {
+		printf("zap_listen failed: %s\n", zap_err_str(err));
+		exit(1);
+	}
+
+	cli_ep = zap_new(zap, client_cb);
+	ASSERT(cli_ep);
+	err = zap_connect(cli_ep, (struct sockaddr *)&sin, sizeof(sin), NULL, 0);
+	ASSERT(err == ZAP_ERR_OK);
+
+	pthread_mutex_lock(&mutex);
+	while (rendezvous < NUM_SCHEMAS * num_sets)
+		pthread_cond_wait(&cond, &mutex);
+	pthread_mutex_unlock(&mutex);
+
+	printf("xprt: %s, sets/schema: %d, changed: %d%%, rounds: %d\n",
+	       xprt, num_sets, change_pct, num_rounds);
+	printf("%-10s %6s  %-5s %12s %12s\n", "schema", "bytes", "mode",
+	       "wire B/upd", "CPU us/upd");
+	for (i = 0; i < NUM_SCHEMAS; i++) {
+		run(ents, i, 0);
+		run(ents, i, ZAP_READ_F_DELTA);
+	}
+
+	zap_close(cli_ep);
+	sleep(1);
+	return 0;
+}
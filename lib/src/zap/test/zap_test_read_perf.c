@@ -0,0 +1,419 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file zap_test_read_perf.c
+ *
+ * Measure zap_read() throughput and allocator pressure.
+ *
+ * The server and the client run in the same process over the given
+ * transport. The client keeps a window of outstanding reads on a set of
+ * shared memory regions and, at the end, reports the number of reads per
+ * second and the number of heap allocations per read (counted by
+ * interposing malloc/calloc/realloc in this program).
+ *
+ * ```
+ * $ zap_test_read_perf -x sock -p PORT [-h HOST] [-n NUM_SETS] [-z SET_SIZE]
+ *                      [-r NUM_READS] [-w WINDOW]
+ * ```
+ */
+#include <unistd.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <sys/errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <assert.h>
+#include <time.h>
+#include "zap.h"
+
+#ifdef NDEBUG
+#define ASSERT(COND) do { \
+	if (COND) \
+		break; \
+	printf("assert(" #COND ") failed.\n"); \
+	exit(-1); \
+} while (0)
+#else
+#define ASSERT(COND) assert(COND)
+#endif
+
+/* glibc allocator entry points used by the counting wrappers below */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t alloc_count;
+
+void *malloc(size_t size)
+{
+	__atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	__atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	__atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+
+#pragma pack(push, 4)
+struct msg_dir_rep {
+	int  idx;
+	void *addr;
+	int  len;
+};
+#pragma pack(pop)
+
+struct remote_set_desc {
+	zap_map_t map;
+	void      *addr;
+	int       len;
+};
+
+zap_t zap;
+char *srv_mem;  /* server set memory */
+char *cli_mem;  /* client set memory */
+zap_map_t *srv_maps;
+zap_map_t *cli_maps;
+struct remote_set_desc *rsets;
+
+int num_sets = 1024;
+size_t set_size = 4096;
+uint64_t num_reads = 1000000;
+int window = 64;
+
+struct zap_mem_info meminfo;
+
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+int rendezvous;
+int connected;
+uint64_t posted;
+uint64_t completed;
+zap_ep_t cli_ep;
+
+zap_mem_info_t test_meminfo(void)
+{
+	return &meminfo;
+}
+
+void server_cb(zap_ep_t ep, zap_event_t ev)
+{
+	struct msg_dir_rep rep;
+	zap_err_t err;
+	int i;
+
+	switch (ev->type) {
+	case ZAP_EVENT_CONNECT_REQUEST:
+		err = zap_accept(ep, server_cb, NULL, 0);
+		ASSERT(err == ZAP_ERR_OK);
+		break;
+	case ZAP_EVENT_CONNECTED:
+		for (i = 0; i < num_sets; i++) {
+			rep.idx = i;
+			rep.addr = srv_mem + i * set_size;
+			rep.len = set_size;
+			err = zap_share(ep, srv_maps[i], (void *)&rep, sizeof(rep));
+			ASSERT(err == ZAP_ERR_OK);
+		}
+		break;
+	case ZAP_EVENT_DISCONNECTED:
+		zap_free(ep);
+		break;
+	case ZAP_EVENT_SEND_COMPLETE:
+	case ZAP_EVENT_SEND_MAPPED_COMPLETE:
+		break;
+	default:
+		printf("Unexpected server event %s\n", zap_event_str(ev->type));
+		ASSERT(0);
+	}
+}
+
+static void post_read(int i)
+{
+	zap_err_t err;
+	err = zap_read(cli_ep, rsets[i].map, rsets[i].addr,
+		       cli_maps[i], cli_mem + i * set_size, set_size,
+		       (void *)(long)i);
+	ASSERT(err == ZAP_ERR_OK);
+}
+
+void client_cb(zap_ep_t ep, zap_event_t ev)
+{
+	struct msg_dir_rep *rep;
+	int post = -1;
+
+	switch (ev->type) {
+	case ZAP_EVENT_CONNECTED:
+		pthread_mutex_lock(&mutex);
+		connected = 1;
+		pthread_mutex_unlock(&mutex);
+		break;
+	case ZAP_EVENT_RENDEZVOUS:
+		rep = (void *)ev->data;
+		ASSERT(ev->data_len == sizeof(*rep));
+		rsets[rep->idx].map = ev->map;
+		rsets[rep->idx].addr = rep->addr;
+		rsets[rep->idx].len = rep->len;
+		pthread_mutex_lock(&mutex);
+		if (++rendezvous == num_sets)
+			pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&mutex);
+		break;
+	case ZAP_EVENT_READ_COMPLETE:
+		ASSERT(ev->status == ZAP_ERR_OK);
+		pthread_mutex_lock(&mutex);
+		completed++;
+		if (posted < num_reads) {
+			post = (posted++) % num_sets;
+		} else if (completed == num_reads) {
+			pthread_cond_signal(&cond);
+		}
+		pthread_mutex_unlock(&mutex);
+		if (post >= 0)
+			post_read(post);
+		break;
+	case ZAP_EVENT_DISCONNECTED:
+		break;
+	case ZAP_EVENT_SEND_COMPLETE:
+	case ZAP_EVENT_SEND_MAPPED_COMPLETE:
+		break;
+	default:
+		printf("Unexpected client event %s\n", zap_event_str(ev->type));
+		ASSERT(0);
+	}
+}
+
+int resolve(const char *hostname, struct sockaddr_in *sin)
+{
+	struct hostent *h;
+
+	h = gethostbyname(hostname);
+	if (!h) {
+		printf("Error resolving hostname '%s'\n", hostname);
+		return -1;
+	}
+	if (h->h_addrtype != AF_INET) {
+		printf("Hostname '%s' resolved to an unsupported"
+				" address family\n", hostname);
+		return -1;
+	}
+	sin->sin_addr.s_addr = *(unsigned int *)(h->h_addr_list[0]);
+	sin->sin_family = h->h_addrtype;
+	return 0;
+}
+
+#define FMT_ARGS "x:p:h:n:z:r:w:"
+void usage(int argc, char *argv[])
+{
+	printf("usage: %s -x name -p port_no [-h host] [-n NUM_SETS] "
+	       "[-z SET_SIZE] [-r NUM_READS] [-w WINDOW]\n"
+	       "    -x name	The transport to use.\n"
+	       "    -p port_no	The port number.\n"
+	       "    -h host	The host to listen/connect (default: localhost).\n"
+	       "    -n NUM_SETS	The number of sets (default: 1024).\n"
+	       "    -z SET_SIZE	The size of each set in bytes (default: 4096).\n"
+	       "    -r NUM_READS	The total number of reads (default: 1000000).\n"
+	       "    -w WINDOW	The number of outstanding reads (default: 64).\n",
+	       argv[0]);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *xprt = NULL;
+	const char *host = "localhost";
+	struct sockaddr_in sin = {};
+	struct timespec t0, t1;
+	uint64_t a0, a1;
+	unsigned short port_no = 0;
+	zap_ep_t lep;
+	zap_err_t err;
+	double dt;
+	int i, rc, ptmp;
+
+	setbuf(stdout, NULL);
+
+	while (-1 != (rc = getopt(argc, argv, FMT_ARGS))) {
+		switch (rc) {
+		case 'x':
+			xprt = optarg;
+			break;
+		case 'p':
+			ptmp = atoi(optarg);
+			if (ptmp > 0 && ptmp < USHRT_MAX)
+				port_no = ptmp;
+			break;
+		case 'h':
+			host = optarg;
+			break;
+		case 'n':
+			num_sets = atoi(optarg);
+			break;
+		case 'z':
+			set_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			num_reads = strtoull(optarg, NULL, 0);
+			break;
+		case 'w':
+			window = atoi(optarg);
+			break;
+		default:
+			usage(argc, argv);
+		}
+	}
+	if (!xprt || !port_no || num_sets <= 0 || !set_size || window <= 0)
+		usage(argc, argv);
+	if (window > num_reads)
+		window = num_reads;
+
+	if (resolve(host, &sin))
+		usage(argc, argv);
+	sin.sin_port = htons(port_no);
+
+	srv_mem = calloc(num_sets, set_size);
+	cli_mem = calloc(num_sets, set_size);
+	srv_maps = calloc(num_sets, sizeof(*srv_maps));
+	cli_maps = calloc(num_sets, sizeof(*cli_maps));
+	rsets = calloc(num_sets, sizeof(*rsets));
+	ASSERT(srv_mem && cli_mem && srv_maps && cli_maps && rsets);
+	for (i = 0; i < num_sets; i++) {
+		memset(srv_mem + i * set_size, i, set_size);
+		err = zap_map(&srv_maps[i], srv_mem + i * set_size, set_size,
+			      ZAP_ACCESS_READ);
+		ASSERT(err == ZAP_ERR_OK);
+		err = zap_map(&cli_maps[i], cli_mem + i * set_size, set_size,
+			      ZAP_ACCESS_READ|ZAP_ACCESS_WRITE);
+		ASSERT(err == ZAP_ERR_OK);
+	}
+	meminfo.start = srv_mem;
+	meminfo.len = num_sets * set_size;
+
+	zap = zap_get(xprt, test_meminfo);
+	if (!zap) {
+		printf("%s: could not load the '%s' xprt.\n", __func__, xprt);
+		exit(1);
+	}
+
+	lep = zap_new(zap, server_cb);
+	ASSERT(lep);
+	err = zap_listen(lep, (struct sockaddr *)&sin, sizeof(sin));
+	if (err) {
+		printf("zap_listen failed: %s\n", zap_err_str(err));
+		exit(1);
+	}
+
+	cli_ep = zap_new(zap, client_cb);
+	ASSERT(cli_ep);
+	err = zap_connect(cli_ep, (struct sockaddr *)&sin, sizeof(sin), NULL, 0);
+	ASSERT(err == ZAP_ERR_OK);
+
+	pthread_mutex_lock(&mutex);
+	while (rendezvous < num_sets)
+		pthread_cond_wait(&cond, &mutex);
+	pthread_mutex_unlock(&mutex);
+
+	/* warm up: one pass over all sets without re-posting */
+	pthread_mutex_lock(&mutex);
+	posted = num_reads;
+	completed = 0;
+	pthread_mutex_unlock(&mutex);
+	for (i = 0; i < num_sets; i++)
+		post_read(i);
+	while (1) {
+		pthread_mutex_lock(&mutex);
+		rc = (completed >= num_sets);
+		pthread_mutex_unlock(&mutex);
+		if (rc)
+			break;
+		usleep(1000);
+	}
+	ASSERT(0 == memcmp(srv_mem, cli_mem, num_sets * set_size));
+
+	pthread_mutex_lock(&mutex);
+	completed = 0;
+	posted = window;
+	pthread_mutex_unlock(&mutex);
+
+	a0 = __atomic_load_n(&alloc_count, __ATOMIC_SEQ_CST);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < window; i++)
+		post_read(i % num_sets);
+	pthread_mutex_lock(&mutex);
+	while (completed < num_reads)
+		pthread_cond_wait(&cond, &mutex);
+	pthread_mutex_unlock(&mutex);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	a1 = __atomic_load_n(&alloc_count, __ATOMIC_SEQ_CST);
+
+	dt = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+	printf("xprt: %s, sets: %d, set_size: %zu, window: %d\n",
+	       xprt, num_sets, set_size, window);
+	printf("reads: %" PRIu64 ", time: %.3f s, reads/sec: %.0f, "
+	       "MB/sec: %.1f\n", num_reads, dt, num_reads / dt,
+	       num_reads * set_size / dt / 1e6);
+	printf("allocations: %" PRIu64 ", allocations/read: %.3f\n",
+	       a1 - a0, (double)(a1 - a0) / num_reads);
+
+	zap_close(cli_ep);
+	sleep(1);
+	return 0;
+}
@@ -82,6 +82,15 @@ int __zap_assert = 0;
 static double zap_io_busy = ZAP_IO_BUSY;
 static int zap_io_max;
 
+/* seconds between the rebalancing of a busy io thread, 0 to disable */
+#define ZAP_IO_REBALANCE 10 /* default value */
+static int zap_io_rebalance = ZAP_IO_REBALANCE;
+/* the minimum utilization gap between the busy and the target thread */
+#define ZAP_IO_REBALANCE_MARGIN 0.2 /* default value */
+static double zap_io_rebalance_margin = ZAP_IO_REBALANCE_MARGIN;
+/* a migrated endpoint stays put for this many rebalance periods */
+#define ZAP_IO_REBALANCE_HOLD 6
+
 LIST_HEAD(zap_list, zap) zap_list;
 
 pthread_mutex_t zap_list_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -431,6 +440,11 @@ void zap_set_priority(zap_ep_t ep, int prio)
 	ep->prio = prio;
 }
 
+void zap_set_pinned(zap_ep_t ep, int pinned)
+{
+	ep->pinned = pinned;
+}
+
 zap_err_t zap_accept(zap_ep_t ep, zap_cb_fn_t cb, char *data, size_t data_len)
 {
 	zap_err_t zerr;
@@ -490,6 +504,36 @@ zap_err_t zap_send(zap_ep_t ep, void *buf, size_t sz)
 	return zerr;
 }
 
+zap_err_t zap_sendv(zap_ep_t ep, struct iovec *iov, int iovcnt)
+{
+	zap_err_t zerr;
+	size_t len = 0;
+	char *buf, *p;
+	int i;
+
+	ref_get(&ep->ref, "zap_sendv");
+	if (ep->z->sendv) {
+		zerr = ep->z->sendv(ep, iov, iovcnt);
+		goto out;
+	}
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+	buf = malloc(len);
+	if (!buf) {
+		zerr = ZAP_ERR_RESOURCE;
+		goto out;
+	}
+	for (p = buf, i = 0; i < iovcnt; i++) {
+		memcpy(p, iov[i].iov_base, iov[i].iov_len);
+		p += iov[i].iov_len;
+	}
+	zerr = ep->z->send(ep, buf, len);
+	free(buf);
+ out:
+	ref_put(&ep->ref, "zap_sendv");
+	return zerr;
+}
+
 zap_err_t zap_send_mapped(zap_ep_t ep, zap_map_t map, void *buf, size_t len,
 			  void *context)
 {
@@ -569,6 +613,40 @@ zap_err_t zap_read(zap_ep_t ep,
 	return zerr;
 }
 
+zap_err_t zap_read_v(zap_ep_t ep, struct zap_read_ent *ents, int n,
+		     int *n_posted)
+{
+	zap_err_t zerr = ZAP_ERR_OK;
+	zap_err_t rc;
+	int i;
+
+	*n_posted = 0;
+	for (i = 0; i < n; i++) {
+		if (ents[i].dst_map->type != ZAP_MAP_LOCAL ||
+		    ents[i].src_map->type != ZAP_MAP_REMOTE) {
+			/* post only the entries before the bad one */
+			zerr = ZAP_ERR_INVALID_MAP_TYPE;
+			n = i;
+			break;
+		}
+	}
+	if (!n)
+		return zerr;
+	if (ep->z->read_v) {
+		rc = ep->z->read_v(ep, ents, n, n_posted);
+		return rc ? rc : zerr;
+	}
+	for (i = 0; i < n; i++) {
+		rc = ep->z->read(ep, ents[i].src_map, ents[i].src,
+				 ents[i].dst_map, ents[i].dst, ents[i].sz,
+				 ents[i].context);
+		if (rc)
+			return rc;
+		(*n_posted)++;
+	}
+	return zerr;
+}
+
 
 size_t zap_map_len(zap_map_t map)
 {
@@ -711,6 +789,7 @@ int zap_io_thread_init(zap_io_thread_t t, zap_t z, const char *name, int stat_wi
 	pthread_mutex_init(&t->mutex, &mattr);
 	LIST_INIT(&t->_ep_list);
 	t->_n_ep = 0;
+	clock_gettime(CLOCK_REALTIME, &t->_rebalance_ts);
 	return 0;
 }
 
@@ -880,6 +959,138 @@ zap_err_t zap_io_thread_ep_release(zap_ep_t ep)
 	return zerr;
 }
 
+/*
+ * Move \c ep from thread \c from to thread \c to.
+ *
+ * The caller holds z->_io_mutex and ep->lock, and runs in \c from at a point
+ * where it is not processing events.
+ */
+static zap_err_t __zap_ep_migrate(zap_ep_t ep, zap_io_thread_t from,
+				  zap_io_thread_t to)
+{
+	zap_err_t zerr;
+	zap_t z = ep->z;
+
+	zerr = z->io_thread_ep_release(from, ep);
+	if (zerr)
+		return zerr;
+	zerr = z->io_thread_ep_assign(to, ep);
+	if (zerr) {
+		if (z->io_thread_ep_assign(from, ep))
+			ovis_log(zlog, OVIS_LERROR, "cannot move endpoint %p "
+				 "back to io thread '%s'\n", ep, from->stat->name);
+		return zerr;
+	}
+
+	pthread_mutex_lock(&from->mutex);
+	LIST_REMOVE(ep, _entry);
+	from->_n_ep--;
+	from->stat->n_eps = from->_n_ep;
+	from->stat->migrated_out++;
+	pthread_mutex_unlock(&from->mutex);
+	__atomic_fetch_sub(&from->stat->sq_sz, ep->sq_sz, __ATOMIC_SEQ_CST);
+
+	pthread_mutex_lock(&to->mutex);
+	LIST_INSERT_HEAD(&to->_ep_list, ep, _entry);
+	to->_n_ep++;
+	to->stat->n_eps = to->_n_ep;
+	to->stat->migrated_in++;
+	pthread_mutex_unlock(&to->mutex);
+	__atomic_fetch_add(&to->stat->sq_sz, ep->sq_sz, __ATOMIC_SEQ_CST);
+
+	ep->thread = to;
+	return ZAP_ERR_OK;
+}
+
+void zap_io_thread_rebalance(zap_io_thread_t t)
+{
+	zap_t z = t->zap;
+	zap_io_thread_t _t, to;
+	zap_ep_t ep, cand;
+	struct timespec now;
+	int64_t period_us;
+	double u, to_u, _u;
+	uint64_t budget_us;
+
+	if (!zap_io_rebalance)
+		return;
+	clock_gettime(CLOCK_REALTIME, &now);
+	period_us = zap_timespec_diff_us(&t->_rebalance_ts, &now);
+	if (period_us < zap_io_rebalance * 1000000L)
+		return;
+	t->_rebalance_ts = now;
+
+	u = zap_thrstat_get_utilization(t->stat);
+	if (u < zap_io_busy)
+		goto reset;
+	/* never wait for the other threads here */
+	if (pthread_mutex_trylock(&z->_io_mutex))
+		goto reset;
+
+	/* The least busy thread, which must be less busy by the margin */
+	to = NULL;
+	to_u = u - zap_io_rebalance_margin;
+	LIST_FOREACH(_t, &z->_io_threads, _entry) {
+		if (_t == t)
+			continue;
+		_u = zap_thrstat_get_utilization(_t->stat);
+		if (_u < to_u) {
+			to = _t;
+			to_u = _u;
+		}
+	}
+	if (!to)
+		goto unlock;
+
+	/*
+	 * Move the most expensive endpoint that fits in half of the gap, so
+	 * that both threads end up below the busier one of the two. An
+	 * endpoint that alone exceeds the budget would only move the hot spot
+	 * to the other thread.
+	 */
+	budget_us = (u - to_u) / 2 * period_us;
+	cand = NULL;
+	pthread_mutex_lock(&t->mutex);
+	LIST_FOREACH(ep, &t->_ep_list, _entry) {
+		if (ep->pinned || ep->state != ZAP_EP_CONNECTED)
+			continue;
+		if (!ep->_ev_cost_us || ep->_ev_cost_us > budget_us)
+			continue;
+		if (now.tv_sec - ep->_migrate_ts <
+				ZAP_IO_REBALANCE_HOLD * zap_io_rebalance)
+			continue;
+		if (!cand || cand->_ev_cost_us < ep->_ev_cost_us)
+			cand = ep;
+	}
+	if (cand)
+		ref_get(&cand->ref, "zap_io_thread_rebalance");
+	pthread_mutex_unlock(&t->mutex);
+	if (!cand)
+		goto unlock;
+
+	/* the endpoint lock is taken before z->_io_mutex elsewhere */
+	if (0 == pthread_mutex_trylock(&cand->lock)) {
+		if (cand->state == ZAP_EP_CONNECTED && cand->thread == t &&
+		    0 == __zap_ep_migrate(cand, t, to)) {
+			cand->_migrate_ts = now.tv_sec;
+			ovis_log(zlog, OVIS_LINFO, "moved endpoint %p "
+				 "(%" PRIu64 " us) from '%s' (%.2f) to '%s' (%.2f)\n",
+				 cand, cand->_ev_cost_us, t->stat->name, u,
+				 to->stat->name, to_u);
+		}
+		pthread_mutex_unlock(&cand->lock);
+	}
+	ref_put(&cand->ref, "zap_io_thread_rebalance");
+ unlock:
+	pthread_mutex_unlock(&z->_io_mutex);
+ reset:
+	pthread_mutex_lock(&t->mutex);
+	LIST_FOREACH(ep, &t->_ep_list, _entry) {
+		ep->_ev_cost_us = 0;
+	}
+	pthread_mutex_unlock(&t->mutex);
+}
+
 void zap_thrstat_reset(zap_thrstat_t stats)
 {
 	struct timespec now;
@@ -1081,6 +1292,8 @@ struct zap_thrstat_result *zap_thrstat_get_result()
 		res->entries[i].utilization = zap_thrstat_get_utilization(t);
 		res->entries[i].n_eps = t->n_eps;
 		res->entries[i].sq_sz = t->sq_sz;
+		res->entries[i].migrated_in = t->migrated_in;
+		res->entries[i].migrated_out = t->migrated_out;
 		i += 1;
 	}
 out:
@@ -1149,6 +1362,20 @@ static void zap_init(void)
 				zap_io_busy);
 		zap_io_busy = ZAP_IO_BUSY;
 	}
+	zap_io_rebalance = ZAP_ENV_INT(ZAP_IO_REBALANCE);
+	if (zap_io_rebalance < 0) {
+		ovis_log(NULL, OVIS_LERROR, "bad ZAP_IO_REBALANCE value: %d, "
+				"the value must be 0 (disabled) or greater\n",
+				zap_io_rebalance);
+		zap_io_rebalance = ZAP_IO_REBALANCE;
+	}
+	zap_io_rebalance_margin = ZAP_ENV_DBL(ZAP_IO_REBALANCE_MARGIN);
+	if (zap_io_rebalance_margin < 0.0 || zap_io_rebalance_margin > 1.0) {
+		ovis_log(NULL, OVIS_LERROR, "bad ZAP_IO_REBALANCE_MARGIN value: "
+				"%lf, the value must be in (0.0-1.0) range\n",
+				zap_io_rebalance_margin);
+		zap_io_rebalance_margin = ZAP_IO_REBALANCE_MARGIN;
+	}
 	__atomic_store_n(&zap_initialized, 1, __ATOMIC_SEQ_CST);
 	pthread_mutex_unlock(&mutex);
 }
@@ -81,6 +81,7 @@
 #include <inttypes.h>
 #include <sys/queue.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
 
@@ -372,6 +373,19 @@ zap_ep_t zap_new(zap_t z, zap_cb_fn_t cb);
  */
 void zap_set_priority(zap_ep_t ep, int prio);
 
+/** \brief Pin an endpoint to its IO thread
+ *
+ * libzap periodically moves endpoints from busy IO threads to idle
+ * ones. A pinned endpoint stays on the IO thread it was assigned to
+ * when it connected. By default endpoints are not pinned.
+ *
+ * A non-zero value for the \c pinned argument pins the endpoint.
+ *
+ * \param ep	The Zap endpoint handle
+ * \param pinned	The pinned flag
+ */
+void zap_set_pinned(zap_ep_t ep, int pinned);
+
 /** \brief Release an endpoint
  *
  * Drop the implicit zap_new() reference. This is functionally
@@ -579,6 +593,22 @@ zap_err_t zap_close(zap_ep_t ep);
  */
 zap_err_t zap_send(zap_ep_t ep, void *buf, size_t sz);
 
+/** \brief Send data gathered from several buffers to the peer
+ *
+ * The peer receives one message holding the buffers in \c iov in
+ * order, exactly as if their concatenation had been sent with
+ * \c zap_send(). The buffers are copied out before the function
+ * returns, so transports that support it gather them directly into
+ * their send buffer instead of the caller assembling the message.
+ *
+ * \param ep	The endpoint handle
+ * \param iov	The buffers to send
+ * \param iovcnt	The number of entries in \c iov
+ * \returns	ZAP_ERR_OK on success, or a zap_err_t value indicating the
+ *		reason for failure.
+ */
+zap_err_t zap_sendv(zap_ep_t ep, struct iovec *iov, int iovcnt);
+
 /**
  * \brief Send data to peer using map.
  *
@@ -624,6 +654,50 @@ zap_err_t zap_read(zap_ep_t z,
 		   zap_map_t dst_map, char *dst, size_t sz,
 		   void *context);
 
+/** \brief An entry of a ::zap_read_v() request */
+struct zap_read_ent {
+	zap_map_t src_map; /*! The remote map of the source */
+	char *src;         /*! The source address in \c src_map */
+	zap_map_t dst_map; /*! The local map of the destination */
+	char *dst;         /*! The destination address in \c dst_map */
+	size_t sz;         /*! The number of bytes to read */
+	void *context;     /*! The context of the completion event */
+	int flags;         /*! ZAP_READ_F_* flags */
+};
+
+/**
+ * The destination of the read still holds the data of a previous read of
+ * the same source region. The transport may transfer only the part of the
+ * source that changed since then and patch the destination in place. If
+ * the destination does not match what the transport last delivered, the
+ * whole region is transferred. Transports without delta support ignore
+ * the flag.
+ */
+#define ZAP_READ_F_DELTA 0x1
+
+/**
+ * \brief RDMA read data from multiple remote buffers in one request
+ *
+ * This is equivalent to calling ::zap_read() on each of the \c n entries
+ * in order, except that the transport may submit all of the reads to the
+ * peer in a single request. A \c ZAP_EVENT_READ_COMPLETE event carrying
+ * the entry's \c context is delivered for each posted entry, in order.
+ *
+ * Transports that do not support vectored reads post the entries one by
+ * one.
+ *
+ * \param ep       The endpoint handle.
+ * \param ents     The array of read entries.
+ * \param n        The number of entries in \c ents.
+ * \param n_posted Set to the number of entries that were posted. The
+ *                 completion events are delivered only for these entries.
+ *
+ * \retval ZAP_ERR_OK All entries were posted.
+ * \retval ZAP_ERR    The error that stopped the posting at \c *n_posted.
+ */
+zap_err_t zap_read_v(zap_ep_t ep, struct zap_read_ent *ents, int n,
+		     int *n_posted);
+
 /** \brief Zap buffer mapping access rights. */
 typedef enum zap_access {
 	ZAP_ACCESS_NONE = 0,	/*! Only local access is allowed */
@@ -833,6 +907,8 @@ struct zap_thrstat_result_entry {
 	double utilization;		/*< The thread utilization */
 	uint64_t n_eps;			/*< Number of endpoints */
 	uint64_t sq_sz;			/*< Send queue size */
+	uint64_t migrated_in;		/*< Endpoints moved in by rebalancing */
+	uint64_t migrated_out;		/*< Endpoints moved out by rebalancing */
 };
 
 struct zap_thrstat_result {
@@ -183,6 +183,13 @@ struct zap_ep {
 	/** (private to libzap) for thread->ep_list */
 	LIST_ENTRY(zap_ep) _entry;
 	uint64_t sq_sz; /* send queue size of the endpoint */
+
+	int pinned;		/* !0 to keep the endpoint on its io thread */
+	/** (private to libzap) event processing time (usec) in the current
+	 *  rebalance period, see zap_io_thread_ep_charge() */
+	uint64_t _ev_cost_us;
+	/** (private to libzap) the last time (sec) the endpoint migrated */
+	time_t _migrate_ts;
 };
 
 struct zap {
@@ -258,6 +265,24 @@ struct zap {
 	zap_err_t (*send_mapped)(zap_ep_t ep, zap_map_t map, void *buf,
 				 size_t len, void *context);
 
+	/**
+	 * \brief Read multiple remote buffers in one request (optional).
+	 *
+	 * See ::zap_read_v(). The maps of the entries have already been
+	 * type-checked. If the transport does not provide this operation,
+	 * libzap posts the entries with \c read().
+	 */
+	zap_err_t (*read_v)(zap_ep_t ep, struct zap_read_ent *ents, int n,
+			    int *n_posted);
+
+	/**
+	 * \brief Send a message gathered from several buffers (optional).
+	 *
+	 * See ::zap_sendv(). If the transport does not provide this
+	 * operation, libzap copies the buffers into one and calls \c send().
+	 */
+	zap_err_t (*sendv)(zap_ep_t ep, struct iovec *iov, int iovcnt);
+
 	/**
 	 * Create and start an IO thread.
 	 *
@@ -470,6 +495,39 @@ zap_err_t zap_io_thread_ep_assign(zap_ep_t ep);
  */
 zap_err_t zap_io_thread_ep_release(zap_ep_t ep);
 
+/**
+ * Charge the event processing time since \c start to \c ep.
+ *
+ * The transport IO thread may call this function at the end of processing an
+ * event of the endpoint. The accumulated cost tells the rebalancer (see
+ * \c zap_io_thread_rebalance()) how much of the thread an endpoint uses.
+ * \c start shall be taken with \c CLOCK_MONOTONIC.
+ */
+static inline void zap_io_thread_ep_charge(zap_ep_t ep, struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ep->_ev_cost_us += zap_timespec_diff_us(start, &now);
+}
+
+/**
+ * Rebalance the endpoints of the IO thread \c t.
+ *
+ * The transport IO thread may call this function in between the event
+ * batches, i.e. when it is not processing any event of its endpoints. Once
+ * every \c ZAP_IO_REBALANCE seconds, if \c t is busier than
+ * \c ZAP_IO_BUSY and the least busy thread of the transport is less busy
+ * by at least \c ZAP_IO_REBALANCE_MARGIN, libzap moves one unpinned
+ * endpoint from \c t to that thread with \c zap.io_thread_ep_release() and
+ * \c zap.io_thread_ep_assign(). Both hooks are called with the endpoint lock
+ * held. The endpoint is chosen by the cost charged with
+ * \c zap_io_thread_ep_charge() so that the move does not simply swap the
+ * busy and the idle thread.
+ *
+ * Transports that do not call this function are never rebalanced.
+ */
+void zap_io_thread_rebalance(zap_io_thread_t t);
+
 /*
  * The zap_thrstat structure maintains state for
  * the Zap thread utilization tracking functions.
@@ -489,6 +547,8 @@ struct zap_thrstat {
 	uint64_t *proc_window;
 	uint64_t sq_sz; /* send queue size (in entries) */
 	uint64_t n_eps; /* number of endpoints */
+	uint64_t migrated_in; /* endpoints moved in by the rebalancer */
+	uint64_t migrated_out; /* endpoints moved out by the rebalancer */
 	LIST_ENTRY(zap_thrstat) entry;
 };
 #define ZAP_THRSTAT_WINDOW 4096	/*< default window size */
@@ -525,6 +585,8 @@ struct zap_io_thread {
 	LIST_HEAD(, zap_ep) _ep_list;
 	/** (private to libzap) number of associated endpoints */
 	int _n_ep;
+	/** (private to libzap) the start of the current rebalance period */
+	struct timespec _rebalance_ts;
 };
 
 #endif